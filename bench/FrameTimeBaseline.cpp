@@ -0,0 +1,210 @@
+#include "FrameTimeBaseline.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Just enough JSON for the baseline layout: nested objects with string keys and number values
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : m_text(text), m_pos(0) {}
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c)
+    {
+        skipSpace();
+        return m_pos < m_text.size() && m_text[m_pos] == c;
+    }
+
+    bool atEnd()
+    {
+        skipSpace();
+        return m_pos >= m_text.size();
+    }
+
+    bool readString(std::string& value)
+    {
+        if (!consume('"')) {
+            return false;
+        }
+        value.clear();
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size()) {
+                m_pos++;
+            }
+            value += m_text[m_pos++];
+        }
+        return consume('"');
+    }
+
+    bool readNumber(double& value)
+    {
+        skipSpace();
+        const char* start = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        value = std::strtod(start, &end);
+        if (end == start) {
+            return false;
+        }
+        m_pos += static_cast<size_t>(end - start);
+        return true;
+    }
+
+    // Object members as key / callback pairs; the callback reads the value
+    template <typename ReadValue>
+    bool readObject(ReadValue readValue)
+    {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            std::string key;
+            if (!readString(key) || !consume(':') || !readValue(key)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+private:
+    void skipSpace()
+    {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+            m_pos++;
+        }
+    }
+
+    const std::string& m_text;
+    size_t m_pos;
+};
+
+bool FrameTimeBaseline::load(const std::string& path)
+{
+    m_devices.clear();
+    std::ifstream file(path);
+    if (!file) {
+        return true;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    JsonReader reader(text);
+    bool ok = reader.readObject([&](const std::string& device) {
+        return reader.readObject([&](const std::string& scenario) {
+            Entry& entry = m_devices[device][scenario];
+            return reader.readObject([&](const std::string& metric) {
+                double value = 0.0;
+                if (!reader.readNumber(value)) {
+                    return false;
+                }
+                if (metric == "gpuMedian") {
+                    entry.gpuMedian = value;
+                } else if (metric == "gpuP99") {
+                    entry.gpuP99 = value;
+                } else if (metric == "cpuMedian") {
+                    entry.cpuMedian = value;
+                } else if (metric == "cpuP99") {
+                    entry.cpuP99 = value;
+                }
+                return true;
+            });
+        });
+    }) && reader.atEnd();
+
+    if (!ok) {
+        std::cerr << "Invalid frame-time baseline " << path << std::endl;
+        m_devices.clear();
+    }
+    return ok;
+}
+
+bool FrameTimeBaseline::save(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write frame-time baseline " << path << std::endl;
+        return false;
+    }
+
+    out << "{";
+    bool firstDevice = true;
+    for (const auto& device : m_devices) {
+        out << (firstDevice ? "\n" : ",\n") << "  \"" << device.first << "\": {";
+        bool firstScenario = true;
+        for (const auto& scenario : device.second) {
+            const Entry& entry = scenario.second;
+            out << (firstScenario ? "\n" : ",\n") << "    \"" << scenario.first << "\": { \"gpuMedian\": " << entry.gpuMedian
+                << ", \"gpuP99\": " << entry.gpuP99 << ", \"cpuMedian\": " << entry.cpuMedian
+                << ", \"cpuP99\": " << entry.cpuP99 << " }";
+            firstScenario = false;
+        }
+        out << "\n  }";
+        firstDevice = false;
+    }
+    out << "\n}\n";
+    return static_cast<bool>(out);
+}
+
+const FrameTimeBaseline::Entry* FrameTimeBaseline::find(const std::string& device, const std::string& scenario) const
+{
+    auto deviceIt = m_devices.find(device);
+    if (deviceIt == m_devices.end()) {
+        return nullptr;
+    }
+    auto scenarioIt = deviceIt->second.find(scenario);
+    return scenarioIt != deviceIt->second.end() ? &scenarioIt->second : nullptr;
+}
+
+bool FrameTimeBaseline::compare(const Entry& baseline, const Entry& measured, double tolerance)
+{
+    struct Metric {
+        const char* name;
+        double baseline;
+        double measured;
+        double tolerance;
+    };
+    const Metric metrics[] = {
+        { "gpu median", baseline.gpuMedian, measured.gpuMedian, tolerance },
+        { "gpu p99", baseline.gpuP99, measured.gpuP99, tolerance * 2.0 },
+        { "cpu median", baseline.cpuMedian, measured.cpuMedian, tolerance },
+        { "cpu p99", baseline.cpuP99, measured.cpuP99, tolerance * 2.0 },
+    };
+
+    bool ok = true;
+    int checked = 0;
+    for (const Metric& metric : metrics) {
+        // A zero baseline (timings unavailable when it was recorded) is not checked
+        if (metric.baseline <= 0.0) {
+            continue;
+        }
+        checked++;
+        double limit = metric.baseline * (1.0 + metric.tolerance);
+        bool regressed = metric.measured > limit;
+        char line[160];
+        std::snprintf(line, sizeof(line), "  %-10s %8.3f ms  baseline %8.3f ms  limit %8.3f ms  %+6.1f%%%s",
+                      metric.name, metric.measured, metric.baseline, limit,
+                      (metric.measured / metric.baseline - 1.0) * 100.0, regressed ? "  REGRESSION" : "");
+        std::cout << line << std::endl;
+        ok = ok && !regressed;
+    }
+    if (checked == 0) {
+        std::cerr << "  no metric of the baseline entry is above zero: nothing to check against" << std::endl;
+        return false;
+    }
+    return ok;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <map>
+#include <string>
+
+// Checked-in frame-time baselines of the bench regression scenarios, per device name:
+//
+//   { "Apple M2 Pro": { "overview": { "gpuMedian": 3.1, "gpuP99": 3.9, "cpuMedian": 0.6, "cpuP99": 1.1 }, ... } }
+//
+// A run regresses when a metric exceeds its baseline by more than the tolerance (p99 gets twice
+// the tolerance, tails are noisier than medians). A device or scenario without an entry, or an
+// entry without a single nonzero metric, fails the check rather than passing it vacuously.
+class FrameTimeBaseline {
+public:
+    struct Entry {
+        double gpuMedian = 0.0;    // Milliseconds
+        double gpuP99 = 0.0;
+        double cpuMedian = 0.0;
+        double cpuP99 = 0.0;
+    };
+
+    // A missing file is an empty baseline; false only for a file that does not parse
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    const Entry* find(const std::string& device, const std::string& scenario) const;
+    void set(const std::string& device, const std::string& scenario, const Entry& entry) { m_devices[device][scenario] = entry; }
+
+    // Prints one line per metric; false when any metric regressed or none could be checked
+    static bool compare(const Entry& baseline, const Entry& measured, double tolerance);
+
+private:
+    std::map<std::string, std::map<std::string, Entry>> m_devices;
+};
@@ -0,0 +1,1341 @@
+#define NS_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#define MTK_PRIVATE_IMPLEMENTATION
+#define CA_PRIVATE_IMPLEMENTATION
+#define MTLFX_PRIVATE_IMPLEMENTATION
+
+#include <Metal/Metal.hpp>
+#include <QuartzCore/QuartzCore.hpp>
+#include <MetalFX/MetalFX.hpp>
+
+#include "Renderer.hpp"
+#include "GpuMemoryBudget.hpp"
+#include "InputRecording.hpp"
+#include "FrameTimeBaseline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Headless benchmark: renders the demo scene offscreen along a scripted camera path
+// with a fixed animation clock and placement seed, then writes per-frame timings (CSV)
+// and a summary (JSON). Identical arguments give identical GPU work on every run.
+
+struct BenchOptions {
+    int frames = 600;
+    int warmupFrames = 60;       // Rendered but not recorded (pipeline warm-up, Hi-Z history)
+    int width = 1920;
+    int height = 1080;
+    uint32_t seed = 1;
+    std::string quality;         // Render settings preset (empty = renderer default, High)
+    std::string settingsPath;    // Render settings file applied over the preset
+    int bladesPerCell = 0;       // 0 = renderer default
+    float frameTime = 1.0f / 60.0f; // Simulated seconds per frame (drives uniforms.time)
+    float dynamicResolutionMs = 0.0f; // GPU budget for dynamic resolution (0 = native resolution)
+    float rasterizationRateMs = 0.0f; // GPU budget for the variable rasterization rate (0 = full rate)
+    bool temporalUpscaling = false; // MetalFX temporal upscaling (1x + motion vectors) instead of 4x MSAA
+    bool temporalAntialiasing = false; // In-house TAA (1x + motion vectors) instead of MSAA; recorded from the renderer
+    int interactors = 1;         // Trample interactors (ball + wandering stand-ins)
+    bool interactorPhysics = false; // Stand-ins simulated as GPU rigid bodies instead of scripted orbits
+    std::string externalControl;    // Shared memory channel an external process drives the interactors through
+    bool trampleSummary = true;  // Whole-cell trample test against the summary pyramid
+    bool grassVisibility = false; // Visibility-buffer grass shading (IDs pass + full-screen lighting)
+    bool grassLean = false;      // Grass pipelines without contact shadows, translucency and sheen
+    bool halfPrecision = false;  // Half-precision grass, ground and sky shading
+    int pointLights = 0;         // Firefly point lights scattered over the field (clustered shading)
+    bool impostors = true;       // Far-field cells drawn as baked impostor cards
+    float impostorDistance = 0.0f; // Blade-to-card crossfade distance (0 = renderer default)
+    bool geometryBlades = false; // Tapered opaque blade meshes instead of the alpha-tested texture
+    int resourceBudgetMB = 0;    // Resource cache budget (0 = renderer default)
+    int gpuMemoryBudgetMB = 0;   // GPU memory budget the caches shrink under (0 = share of the working set)
+    bool sparseGround = false;   // Ground sampled from the streamed sparse virtual texture
+    std::string instancesPath;   // Authored InstanceFile field mapped instead of the generated one
+    std::string exportInstancesPath; // Write the generated field as an InstanceFile before running
+    bool streamGrass = false;    // Chunks streamed around the camera over a kilometer-scale world
+    bool densityMap = true;      // Blades placed by the density / species mask (false = uniform)
+    float densityLodDistance = -1.0f; // Distance where cells start thinning their blades (0 = off, <0 = renderer default)
+    float bladePhysicsRadius = 0.0f; // Blade springs within this many meters of the camera (0 = stateless wind)
+    bool windFluid = false;          // Stable-fluids wind perturbation driven by the interactors
+    int windGusts = 0;               // Gust particles spawned per frame (0 = none)
+    float season = 1.0f;             // Blade palette season (0 spring, 1 summer, 2 autumn, 3 winter)
+    bool parallelEncoding = false;   // Scene sub-encoders filled on worker threads
+    bool asyncCompute = true;        // Simulation and cull passes on the async compute queue
+    bool cpuCellCulling = false;     // Grass cells culled on the CPU instead of the compute pass
+    bool depthPrepass = false;       // Grass depth prepass, then shading at equal depth
+    bool cellSort = true;            // Compute cull visits the cells front to back
+    bool windPoses = true;           // Mid and far blades bend through the baked wind poses
+    bool tilePost = true;            // Fog and tone mapping in tile memory at the end of the 4x scene pass
+    bool objectIds = false;          // Scene pass writes object IDs; the frame centre is picked every recorded frame
+    int captureFrame = -1;           // Recorded frame captured to a .gputrace document (<0 = none)
+    float captureSpikeMs = 0.0f;     // Capture the frames after any GPU frame slower than this (0 = off)
+    std::string tracePath;           // Chrome trace of the recorded frames (empty = none)
+    std::string videoPath;           // Hardware-encoded video of the recorded frames (empty = none)
+    std::string screenshotPath;      // Output, depth and trample map of the last recorded frame (empty = none)
+    int batchViews = 0;              // Batch rendering of this many random viewpoints (0 = off)
+    std::string batchDirectory;      // Where the batch images are written (empty = read back only)
+    float trampleHz = -1.0f;         // Simulation rates in steps per second (0 = per frame, <0 = renderer default)
+    float physicsHz = -1.0f;
+    float windHz = -1.0f;
+    float simulationScale = 0.0f;    // Power policy scale on the fixed simulation rates (0 = renderer default)
+    int sampleCount = 0;             // Recorded from the renderer: scene MSAA samples,
+    int bladeSegments = 0;           // nearest blade LOD segments
+    int trampleMapSize = 0;          // and trample map texels per side
+    int views = 1;               // Cameras per frame: the path camera plus overview cameras (multi-view)
+    std::string path = "orbit";
+    std::string replayPath;      // Input recording replayed instead of the camera path (its seed and length)
+    std::string scenario;        // Canonical regression scenario the options were set from (empty = none)
+    std::string baselinePath;    // Frame-time baselines the scenario is checked against (empty = no check)
+    float tolerance = 0.1f;      // Allowed slowdown over the baseline median (twice that for p99)
+    bool updateBaseline = false; // Record this run as the device's baseline instead of checking it
+    bool microbench = false;     // Time isolated shader workloads instead of the camera path
+    int microbenchSamples = 64;  // Timed command buffers per workload
+    bool sweep = false;          // Blade count and trample size scaling sweep instead of one run
+    bool sweepMsaa = false;      // Repeat the sweep at 1x (temporal upscaling), 2x, 4x and 8x MSAA
+    int sweepFrames = 120;       // Recorded frames per sweep setting (after the warm-up frames)
+    std::string precompilePath;  // Build every pipeline permutation into this archive and exit (no bench run)
+    std::string csvPath = "bench.csv";
+    std::string jsonPath = "bench.json";
+};
+
+struct CameraPose {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+struct FrameSample {
+    int frame;
+    double cpuMs;                // CPU time spent encoding and committing the frame
+    GpuTimings gpu;              // Latest resolved GPU timings (trails the CPU by up to the in-flight depth)
+    float renderScale;           // Dynamic resolution scale used for the frame
+};
+
+static void printUsage()
+{
+    std::cout << "Usage: VegetationBench [options]\n"
+              << "  --frames N        Recorded frames (default 600)\n"
+              << "  --warmup N        Unrecorded warm-up frames (default 60)\n"
+              << "  --size WxH        Offscreen resolution (default 1920x1080)\n"
+              << "  --seed N          Grass placement seed (default 1)\n"
+              << "  --quality NAME    Render settings preset: low, medium, high (default), ultra\n"
+              << "  --settings FILE   Render settings file (\"key = value\" lines) applied over the preset\n"
+              << "  --density N       Blades per grid cell (default: renderer default)\n"
+              << "  --path NAME       Camera path: orbit, flyover, ground, overview (default orbit)\n"
+              << "  --replay FILE     Replay an input recording (demo F10 / --record) instead of a path\n"
+              << "  --dynres MS       Dynamic resolution (MetalFX) with a GPU budget of MS milliseconds\n"
+              << "  --vrr MS          Variable rasterization rate (fog rows, screen edges) with a GPU budget of MS milliseconds\n"
+              << "  --temporal        MetalFX temporal upscaling instead of 4x MSAA\n"
+              << "  --taa             Temporal antialiasing (jittered 1x scene + history resolve) instead of MSAA\n"
+              << "  --interactors N   Trample interactors, ball included (default 1, max 256)\n"
+              << "  --physics         Simulate the stand-in interactors as GPU rigid bodies (spheres and capsules)\n"
+              << "  --external-control NAME  Interactors and wind gusts from another process through shared memory NAME\n"
+              << "  --no-trample-summary  Sample the trample map for every blade (no whole-cell test)\n"
+              << "  --visibility      Visibility-buffer grass shading (lighting once per pixel)\n"
+              << "  --grass-lean      Grass shading without contact shadows, translucency and sheen\n"
+              << "  --half            Half-precision grass, ground and sky shading (compare the gpu pass times)\n"
+              << "  --point-lights N  Scatter N firefly point lights over the field (default 0, max 1024)\n"
+              << "  --no-impostors    Draw every cell's blades (no far-field impostor cards)\n"
+              << "  --impostor-distance M  Distance where cells switch to impostor cards (default: renderer default)\n"
+              << "  --geometry-blades Tapered opaque blade meshes, no alpha test or alpha-to-coverage\n"
+              << "  --resource-budget-mb N  Texture / mesh cache budget (default: renderer default)\n"
+              << "  --gpu-memory-budget-mb N  GPU memory the caches evict to stay under (default: 90% of the working set)\n"
+              << "  --sparse-ground   Stream the ground from a sparse virtual texture (Apple GPU family 6+)\n"
+              << "  --instances FILE  Map an authored instance file instead of generating the field\n"
+              << "  --export-instances FILE  Write the generated field (seed, density) as an instance file\n"
+              << "  --stream-grass    Stream grass chunks around the camera instead of the static field\n"
+              << "  --uniform-grass   Place blades uniformly instead of by the density map\n"
+              << "  --density-lod M   Distance where cells start drawing fewer, wider blades (0 = off)\n"
+              << "  --blade-physics M Simulate blade springs within M meters of the camera (default 0 = off)\n"
+              << "  --wind-fluid      Add a stable-fluids wind grid with interactor wakes to the procedural wind\n"
+              << "  --wind-gusts N    Spawn N drifting gust particles per frame over the field (GPU-simulated)\n"
+              << "  --season S        Blade palette season: 0 spring, 1 summer (default), 2 autumn, 3 winter; fractions blend\n"
+              << "  --trample-hz N    Trample stamps per second (0 = every frame, the default)\n"
+              << "  --physics-hz N    Interactor body and blade spring steps per second (0 = every frame; default 60)\n"
+              << "  --wind-hz N       Wind fluid steps per second (0 = every frame, the default)\n"
+              << "  --sim-scale S     Scale the fixed simulation rates (power policy; 0.5 = half the steps)\n"
+              << "  --parallel-encoding Encode the scene pass from worker threads (parallel render encoder)\n"
+              << "  --no-async-compute  Keep the simulation and cull passes on the frame's command queue\n"
+              << "  --cpu-cull          Frustum-cull the grass cells on the CPU (NEON) instead of the compute pass\n"
+              << "  --depth-prepass     Grass depth prepass, then shading at equal depth\n"
+              << "  --no-cell-sort      Cull the grass cells in grid order instead of front to back\n"
+              << "  --no-wind-poses     Procedural wind bend for every blade instead of baked poses past the first LOD\n"
+              << "  --no-tile-post      Fog and tone map in a separate post pass instead of in tile memory (Apple GPUs)\n"
+              << "  --object-ids        Write object IDs in the scene pass and pick 16x16 pixels at the centre every recorded frame\n"
+              << "  --capture-frame N Capture recorded frame N to bench_frame_N.gputrace (needs MTL_CAPTURE_ENABLED=1)\n"
+              << "  --capture-spike MS  Capture the next frame into spike_K.gputrace whenever a GPU frame exceeds MS\n"
+              << "  --trace FILE      Chrome trace (Perfetto) of the recorded frames: CPU scopes, GPU passes, counters\n"
+              << "  --record-video FILE  HEVC (or H.264) video of the recorded frames from the hardware encoder\n"
+              << "  --screenshot FILE Last recorded frame: FILE.png, plus FILE_depth.exr and FILE_trample.exr (async readback)\n"
+              << "  --batch N         Render N random viewpoints back to back and report images per second\n"
+              << "  --batch-out DIR   Write the batch images to DIR/view_NNNNN.png (default: read back only)\n"
+              << "  --views N         Split screen: the path camera on the left, N - 1 overview cameras on the right (1-4)\n"
+              << "  --scenario NAME   Regression scenario (overview, ground, interactors, max-density); later options override it\n"
+              << "  --baseline FILE   Fail (exit code 2) when the scenario's median / p99 frame times exceed FILE's entry for this device,\n"
+              << "                    or when FILE has no entry for this device and scenario\n"
+              << "  --tolerance PCT   Allowed slowdown over the baseline median in percent (default 10, twice that for p99)\n"
+              << "  --update-baseline Write this run into the baseline file instead of checking it\n"
+              << "  --microbench      Time each shader workload alone (trample stamp per map size, cull, generation,\n"
+              << "                    grass vertex with rasterization discard, grass fragment over 1/4/16 full-screen layers)\n"
+              << "                    after the warm-up frames; results go to the JSON file, no CSV\n"
+              << "  --microbench-samples N  Timed command buffers per workload (default 64)\n"
+              << "  --sweep           Scaling sweep: 10K to 4M blades at the current trample map (counts past the\n"
+              << "                    field's maximum density are flagged capped or listed as skipped), then 256 to 4096\n"
+              << "                    trample texels per side at 30K blades; frame time, grass vertex / fragment split\n"
+              << "                    and GPU memory per setting go to the JSON file, no CSV\n"
+              << "  --sweep-msaa      Repeat the sweep at 1x (temporal upscaling), 2x, 4x and 8x MSAA\n"
+              << "  --sweep-frames N  Recorded frames per sweep setting (default 120; --warmup frames before each)\n"
+              << "  --precompile-pipelines FILE  Compile every scene pipeline permutation into the binary archive FILE\n"
+              << "                    and exit (the PrecompiledPipelines build target; run where no pipeline cache exists)\n"
+              << "  --csv FILE        Per-frame output (default bench.csv)\n"
+              << "  --json FILE       Summary output (default bench.json)\n";
+}
+
+// Canonical regression scenarios: each stresses one part of the frame through the plain options
+static bool applyScenario(const std::string& name, BenchOptions& options)
+{
+    if (name == "overview") {
+        // Still camera high above the field: cull, impostors and the far field
+        options.path = "overview";
+    } else if (name == "ground") {
+        // Knee-height walk: near-field blades, overdraw and the grass fragment stage
+        options.path = "ground";
+    } else if (name == "interactors") {
+        // Every interactor as a simulated body: trample stamping, physics and contact shading
+        options.path = "orbit";
+        options.interactors = 256;
+        options.interactorPhysics = true;
+    } else if (name == "max-density") {
+        // Densest field the renderer allows (the density is clamped to its maximum)
+        options.path = "orbit";
+        options.bladesPerCell = 1 << 16;
+    } else {
+        std::cerr << "Unknown scenario: " << name << " (overview, ground, interactors, max-density)" << std::endl;
+        return false;
+    }
+    options.scenario = name;
+    return true;
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return false;
+        } else if (arg == "--frames" && hasValue) {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmupFrames = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--size" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 ||
+                options.width <= 0 || options.height <= 0) {
+                std::cerr << "Invalid --size, expected WxH" << std::endl;
+                return false;
+            }
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--density" && hasValue) {
+            options.bladesPerCell = std::atoi(argv[++i]);
+        } else if (arg == "--dynres" && hasValue) {
+            options.dynamicResolutionMs = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--vrr" && hasValue) {
+            options.rasterizationRateMs = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--temporal") {
+            options.temporalUpscaling = true;
+        } else if (arg == "--taa") {
+            options.temporalAntialiasing = true;
+        } else if (arg == "--interactors" && hasValue) {
+            options.interactors = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--physics") {
+            options.interactorPhysics = true;
+        } else if (arg == "--external-control" && hasValue) {
+            options.externalControl = argv[++i];
+        } else if (arg == "--no-trample-summary") {
+            options.trampleSummary = false;
+        } else if (arg == "--visibility") {
+            options.grassVisibility = true;
+        } else if (arg == "--grass-lean") {
+            options.grassLean = true;
+        } else if (arg == "--half") {
+            options.halfPrecision = true;
+        } else if (arg == "--point-lights" && hasValue) {
+            options.pointLights = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--no-impostors") {
+            options.impostors = false;
+        } else if (arg == "--impostor-distance" && hasValue) {
+            options.impostorDistance = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--geometry-blades") {
+            options.geometryBlades = true;
+        } else if (arg == "--resource-budget-mb" && hasValue) {
+            options.resourceBudgetMB = std::atoi(argv[++i]);
+        } else if (arg == "--gpu-memory-budget-mb" && hasValue) {
+            options.gpuMemoryBudgetMB = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sparse-ground") {
+            options.sparseGround = true;
+        } else if (arg == "--instances" && hasValue) {
+            options.instancesPath = argv[++i];
+        } else if (arg == "--export-instances" && hasValue) {
+            options.exportInstancesPath = argv[++i];
+        } else if (arg == "--stream-grass") {
+            options.streamGrass = true;
+        } else if (arg == "--uniform-grass") {
+            options.densityMap = false;
+        } else if (arg == "--density-lod" && hasValue) {
+            options.densityLodDistance = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--blade-physics" && hasValue) {
+            options.bladePhysicsRadius = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--wind-fluid") {
+            options.windFluid = true;
+        } else if (arg == "--season" && hasValue) {
+            options.season = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--wind-gusts" && hasValue) {
+            options.windGusts = std::clamp(std::atoi(argv[++i]), 0, WIND_MAX_GUST_SPAWNS);
+        } else if (arg == "--trample-hz" && hasValue) {
+            options.trampleHz = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--physics-hz" && hasValue) {
+            options.physicsHz = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--wind-hz" && hasValue) {
+            options.windHz = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--quality" && hasValue) {
+            options.quality = argv[++i];
+        } else if (arg == "--settings" && hasValue) {
+            options.settingsPath = argv[++i];
+        } else if (arg == "--sim-scale" && hasValue) {
+            options.simulationScale = std::max(0.01f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--parallel-encoding") {
+            options.parallelEncoding = true;
+        } else if (arg == "--no-async-compute") {
+            options.asyncCompute = false;
+        } else if (arg == "--cpu-cull") {
+            options.cpuCellCulling = true;
+        } else if (arg == "--depth-prepass") {
+            options.depthPrepass = true;
+        } else if (arg == "--no-cell-sort") {
+            options.cellSort = false;
+        } else if (arg == "--no-wind-poses") {
+            options.windPoses = false;
+        } else if (arg == "--no-tile-post") {
+            options.tilePost = false;
+        } else if (arg == "--object-ids") {
+            options.objectIds = true;
+        } else if (arg == "--capture-frame" && hasValue) {
+            options.captureFrame = std::atoi(argv[++i]);
+        } else if (arg == "--capture-spike" && hasValue) {
+            options.captureSpikeMs = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        } else if (arg == "--trace" && hasValue) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--record-video" && hasValue) {
+            options.videoPath = argv[++i];
+        } else if (arg == "--screenshot" && hasValue) {
+            options.screenshotPath = argv[++i];
+        } else if (arg == "--batch" && hasValue) {
+            options.batchViews = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--batch-out" && hasValue) {
+            options.batchDirectory = argv[++i];
+        } else if (arg == "--views" && hasValue) {
+            options.views = std::clamp(std::atoi(argv[++i]), 1, static_cast<int>(MAX_RENDER_VIEWS));
+        } else if (arg == "--path" && hasValue) {
+            options.path = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--scenario" && hasValue) {
+            if (!applyScenario(argv[++i], options)) {
+                return false;
+            }
+        } else if (arg == "--baseline" && hasValue) {
+            options.baselinePath = argv[++i];
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::max(0.0f, static_cast<float>(std::atof(argv[++i]))) / 100.0f;
+        } else if (arg == "--update-baseline") {
+            options.updateBaseline = true;
+        } else if (arg == "--microbench") {
+            options.microbench = true;
+        } else if (arg == "--microbench-samples" && hasValue) {
+            options.microbenchSamples = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--sweep") {
+            options.sweep = true;
+        } else if (arg == "--sweep-msaa") {
+            options.sweep = true;
+            options.sweepMsaa = true;
+        } else if (arg == "--sweep-frames" && hasValue) {
+            options.sweepFrames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--precompile-pipelines" && hasValue) {
+            options.precompilePath = argv[++i];
+        } else if (arg == "--csv" && hasValue) {
+            options.csvPath = argv[++i];
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            printUsage();
+            return false;
+        }
+    }
+
+    RenderSettings::Quality quality;
+    if (!options.quality.empty() && !RenderSettings::parseQuality(options.quality, quality)) {
+        std::cerr << "Unknown quality: " << options.quality << " (low, medium, high, ultra)" << std::endl;
+        return false;
+    }
+    if (options.path != "orbit" && options.path != "flyover" && options.path != "ground" && options.path != "overview") {
+        std::cerr << "Unknown camera path: " << options.path << std::endl;
+        return false;
+    }
+    if (options.sweep && options.microbench) {
+        std::cerr << "--sweep and --microbench are separate runs" << std::endl;
+        return false;
+    }
+    if (!options.baselinePath.empty() && options.scenario.empty()) {
+        std::cerr << "--baseline needs a --scenario to look up" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Fireflies for --point-lights: small warm lights hovering in the grass, placed from the seed so
+// runs compare like for like
+static std::vector<PointLight> scatterFireflies(const Renderer* renderer, int count, uint32_t seed)
+{
+    std::mt19937 gen(seed ^ 0x9e3779b9u);
+    std::uniform_real_distribution<float> position(-14.0f, 14.0f);
+    std::uniform_real_distribution<float> hover(0.3f, 1.2f);
+    std::uniform_real_distribution<float> radius(1.5f, 3.0f);
+    std::uniform_real_distribution<float> warmth(0.0f, 1.0f);
+
+    std::vector<PointLight> lights(static_cast<size_t>(count));
+    for (PointLight& light : lights) {
+        float x = position(gen);
+        float z = position(gen);
+        float w = warmth(gen);
+        light.position = simd::make_float3(x, renderer->getGroundHeight(x, z) + hover(gen), z);
+        light.radius = radius(gen);
+        light.color = simd::make_float3(1.0f, 0.75f + 0.2f * w, 0.3f + 0.3f * w) * 0.6f;
+    }
+    return lights;
+}
+
+// Gusts for --wind-gusts: blasts and drifting gusts scattered over the field, drawn from a
+// generator seeded once per run so every run spawns the same sequence
+static WindGustParticle scatterWindGust(std::mt19937& gen)
+{
+    std::uniform_real_distribution<float> position(-14.0f, 14.0f);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    WindGustParticle gust = {};
+    gust.position = simd::make_float2(position(gen), position(gen));
+    simd::float2 heading = simd::normalize(simd::make_float2(direction(gen), direction(gen)) + simd::make_float2(1e-3f, 0.0f));
+    if (unit(gen) < 0.25f) {
+        gust.radialSpeed = 8.0f; // Blast: outward front that widens fast and dies quickly
+        gust.radius = 1.0f;
+        gust.growth = 6.0f;
+        gust.lifetime = 0.6f;
+    } else {
+        gust.drift = heading * 5.0f;
+        gust.wind = heading * (3.0f + 4.0f * unit(gen));
+        gust.radius = 2.0f + 2.0f * unit(gen);
+        gust.growth = 0.5f;
+        gust.drag = 0.5f;
+        gust.lifetime = 1.0f + 2.0f * unit(gen);
+    }
+    return gust;
+}
+
+// Viewpoints for --batch: standing to drone heights over the field, looking into the grass,
+// placed from the seed; one scene time step apart so the trails and the wind keep moving
+static std::vector<Renderer::BatchView> scatterBatchViews(const Renderer* renderer, int count, uint32_t seed, float frameTime)
+{
+    std::mt19937 gen(seed ^ 0x85ebca6bu);
+    std::uniform_real_distribution<float> position(-14.0f, 14.0f);
+    std::uniform_real_distribution<float> height(0.3f, 8.0f);
+    std::uniform_real_distribution<float> yaw(-180.0f, 180.0f);
+    std::uniform_real_distribution<float> pitch(-45.0f, 0.0f);
+
+    std::vector<Renderer::BatchView> views(static_cast<size_t>(count));
+    for (size_t i = 0; i < views.size(); ++i) {
+        Renderer::BatchView& view = views[i];
+        float x = position(gen);
+        float z = position(gen);
+        view.position = glm::vec3(x, renderer->getGroundHeight(x, z) + height(gen), z);
+        view.yaw = yaw(gen);
+        view.pitch = pitch(gen);
+        view.time = static_cast<float>(i) * frameTime;
+    }
+    return views;
+}
+
+static bool runBatch(Renderer* renderer, const BenchOptions& options)
+{
+    std::vector<Renderer::BatchView> views = scatterBatchViews(renderer, options.batchViews, options.seed, options.frameTime);
+    std::atomic<int> written(0);
+    std::string directory = options.batchDirectory;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool ok = renderer->renderBatch(views, [&written, &directory](size_t index, const ReadbackImage& image) {
+        if (directory.empty()) {
+            return;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "/view_%05zu.png", index);
+        if (writeReadbackImage(image, directory + name)) {
+            written.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    if (!ok) {
+        return false;
+    }
+    std::cout << "Batch: " << views.size() << " views in " << seconds << " s, "
+              << static_cast<double>(views.size()) / std::max(seconds, 1e-9) << " images/s";
+    if (!directory.empty()) {
+        std::cout << " (" << written.load() << " written to " << directory << ")";
+    }
+    std::cout << std::endl;
+    return directory.empty() || written.load() == static_cast<int>(views.size());
+}
+
+// Camera pose at normalized path time t in [0, 1]
+static CameraPose evaluatePath(const std::string& path, float t)
+{
+    const float twoPi = 6.28318530718f;
+    CameraPose pose;
+
+    if (path == "flyover") {
+        // Straight pass across the field, looking down at the grass
+        pose.position = glm::vec3(-14.0f + 28.0f * t, 6.0f, 12.0f - 24.0f * t);
+        pose.yaw = -45.0f;
+        pose.pitch = -30.0f;
+    } else if (path == "overview") {
+        // Fixed pose above the field edge, the whole field and the far field in view
+        pose.position = glm::vec3(0.0f, 14.0f, 20.0f);
+        pose.yaw = -90.0f;
+        pose.pitch = -35.0f;
+    } else if (path == "ground") {
+        // Knee-height sweep through the densest near-field grass (worst case for LOD 0 and overdraw)
+        float angle = t * twoPi;
+        pose.position = glm::vec3(std::sin(angle) * 6.0f, 0.3f, std::cos(angle) * 6.0f);
+        pose.yaw = -glm::degrees(angle);
+        pose.pitch = -5.0f;
+    } else {
+        // Orbit around the field center at medium height, always looking inward
+        float angle = t * twoPi;
+        pose.position = glm::vec3(std::cos(angle) * 10.0f, 3.0f, std::sin(angle) * 10.0f);
+        pose.yaw = glm::degrees(angle) + 180.0f;
+        pose.pitch = -15.0f;
+    }
+    return pose;
+}
+
+static double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+static double mean(const std::vector<double>& values)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (double value : values) {
+        sum += value;
+    }
+    return sum / static_cast<double>(values.size());
+}
+
+static void writeStats(std::ofstream& out, const char* name, const std::vector<double>& values, bool last)
+{
+    out << "    \"" << name << "\": { \"mean\": " << mean(values)
+        << ", \"median\": " << percentile(values, 0.5)
+        << ", \"p95\": " << percentile(values, 0.95)
+        << ", \"p99\": " << percentile(values, 0.99)
+        << ", \"min\": " << percentile(values, 0.0)
+        << ", \"max\": " << percentile(values, 1.0) << " }" << (last ? "\n" : ",\n");
+}
+
+static bool writeCsv(const BenchOptions& options, const std::vector<FrameSample>& samples)
+{
+    std::ofstream out(options.csvPath);
+    if (!out) {
+        std::cerr << "Failed to open " << options.csvPath << std::endl;
+        return false;
+    }
+
+    out << "frame,cpu_ms,render_scale,gpu_frame_ms";
+    for (int pass = 0; pass < GpuPassCount; ++pass) {
+        out << ",gpu_" << GpuProfiler::passName(static_cast<GpuPass>(pass)) << "_ms";
+    }
+    out << "\n";
+
+    for (const FrameSample& sample : samples) {
+        out << sample.frame << "," << sample.cpuMs << "," << sample.renderScale << "," << sample.gpu.frameMs;
+        for (int pass = 0; pass < GpuPassCount; ++pass) {
+            out << "," << sample.gpu.passMs[pass];
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+static bool writeJson(const BenchOptions& options, const std::vector<FrameSample>& samples,
+                      uint32_t bladeCount, uint32_t placedBlades, const char* deviceName, double wallSeconds,
+                      const GpuMemoryBudget& memory)
+{
+    std::ofstream out(options.jsonPath);
+    if (!out) {
+        std::cerr << "Failed to open " << options.jsonPath << std::endl;
+        return false;
+    }
+
+    std::vector<double> cpu;
+    std::vector<double> renderScale;
+    std::vector<double> gpuFrame;
+    std::vector<std::vector<double>> passes(GpuPassCount);
+    bool perPass = false;
+    for (const FrameSample& sample : samples) {
+        cpu.push_back(sample.cpuMs);
+        renderScale.push_back(sample.renderScale);
+        gpuFrame.push_back(sample.gpu.frameMs);
+        for (int pass = 0; pass < GpuPassCount; ++pass) {
+            passes[pass].push_back(sample.gpu.passMs[pass]);
+        }
+        perPass = perPass || sample.gpu.perPass;
+    }
+
+    out << "{\n";
+    out << "  \"device\": \"" << deviceName << "\",\n";
+    out << "  \"path\": \"" << options.path << "\",\n";
+    out << "  \"scenario\": \"" << options.scenario << "\",\n";
+    out << "  \"replay\": \"" << options.replayPath << "\",\n";
+    out << "  \"width\": " << options.width << ",\n";
+    out << "  \"height\": " << options.height << ",\n";
+    out << "  \"frames\": " << samples.size() << ",\n";
+    out << "  \"warmupFrames\": " << options.warmupFrames << ",\n";
+    out << "  \"seed\": " << options.seed << ",\n";
+    out << "  \"quality\": \"" << (options.quality.empty() ? "high" : options.quality) << "\",\n";
+    out << "  \"settings\": \"" << options.settingsPath << "\",\n";
+    out << "  \"sampleCount\": " << options.sampleCount << ",\n";
+    out << "  \"bladeSegments\": " << options.bladeSegments << ",\n";
+    out << "  \"trampleMapSize\": " << options.trampleMapSize << ",\n";
+    out << "  \"blades\": " << bladeCount << ",\n";
+    out << "  \"placedBlades\": " << placedBlades << ",\n";
+    out << "  \"wallSeconds\": " << wallSeconds << ",\n";
+    out << "  \"dynamicResolutionMs\": " << options.dynamicResolutionMs << ",\n";
+    out << "  \"rasterizationRateMs\": " << options.rasterizationRateMs << ",\n";
+    out << "  \"temporalUpscaling\": " << (options.temporalUpscaling ? "true" : "false") << ",\n";
+    out << "  \"temporalAntialiasing\": " << (options.temporalAntialiasing ? "true" : "false") << ",\n";
+    out << "  \"interactors\": " << options.interactors << ",\n";
+    out << "  \"interactorPhysics\": " << (options.interactorPhysics ? "true" : "false") << ",\n";
+    out << "  \"trampleSummary\": " << (options.trampleSummary ? "true" : "false") << ",\n";
+    out << "  \"grassVisibility\": " << (options.grassVisibility ? "true" : "false") << ",\n";
+    out << "  \"grassLean\": " << (options.grassLean ? "true" : "false") << ",\n";
+    out << "  \"halfPrecision\": " << (options.halfPrecision ? "true" : "false") << ",\n";
+    out << "  \"pointLights\": " << options.pointLights << ",\n";
+    out << "  \"impostors\": " << (options.impostors ? "true" : "false") << ",\n";
+    out << "  \"impostorDistance\": " << options.impostorDistance << ",\n";
+    out << "  \"geometryBlades\": " << (options.geometryBlades ? "true" : "false") << ",\n";
+    out << "  \"resourceBudgetMB\": " << options.resourceBudgetMB << ",\n";
+    out << "  \"gpuMemoryBudgetMB\": " << options.gpuMemoryBudgetMB << ",\n";
+    out << "  \"sparseGround\": " << (options.sparseGround ? "true" : "false") << ",\n";
+    out << "  \"instances\": \"" << options.instancesPath << "\",\n";
+    out << "  \"streamGrass\": " << (options.streamGrass ? "true" : "false") << ",\n";
+    out << "  \"densityMap\": " << (options.densityMap ? "true" : "false") << ",\n";
+    out << "  \"densityLodDistance\": " << options.densityLodDistance << ",\n";
+    out << "  \"bladePhysicsRadius\": " << options.bladePhysicsRadius << ",\n";
+    out << "  \"windFluid\": " << (options.windFluid ? "true" : "false") << ",\n";
+    out << "  \"windGusts\": " << options.windGusts << ",\n";
+    out << "  \"season\": " << options.season << ",\n";
+    out << "  \"trampleHz\": " << options.trampleHz << ",\n";
+    out << "  \"physicsHz\": " << options.physicsHz << ",\n";
+    out << "  \"windHz\": " << options.windHz << ",\n";
+    out << "  \"simulationScale\": " << options.simulationScale << ",\n";
+    out << "  \"parallelEncoding\": " << (options.parallelEncoding ? "true" : "false") << ",\n";
+    out << "  \"asyncCompute\": " << (options.asyncCompute ? "true" : "false") << ",\n";
+    out << "  \"cpuCellCulling\": " << (options.cpuCellCulling ? "true" : "false") << ",\n";
+    out << "  \"depthPrepass\": " << (options.depthPrepass ? "true" : "false") << ",\n";
+    out << "  \"cellSort\": " << (options.cellSort ? "true" : "false") << ",\n";
+    out << "  \"windPoses\": " << (options.windPoses ? "true" : "false") << ",\n";
+    out << "  \"tilePost\": " << (options.tilePost ? "true" : "false") << ",\n";
+    out << "  \"objectIds\": " << (options.objectIds ? "true" : "false") << ",\n";
+    out << "  \"captureSpikeMs\": " << options.captureSpikeMs << ",\n";
+    out << "  \"views\": " << options.views << ",\n";
+    // Latest sample of the run, in bytes
+    out << "  \"gpuMemory\": {\n";
+    for (int category = 0; category < GpuMemoryBudget::CategoryCount; ++category) {
+        GpuMemoryBudget::Category id = static_cast<GpuMemoryBudget::Category>(category);
+        out << "    \"" << GpuMemoryBudget::categoryName(id) << "\": " << memory.getBytes(id) << ",\n";
+    }
+    out << "    \"tracked\": " << memory.getTrackedBytes() << ",\n";
+    out << "    \"untracked\": " << memory.getUntrackedBytes() << ",\n";
+    out << "    \"allocated\": " << memory.getAllocatedBytes() << ",\n";
+    out << "    \"budget\": " << memory.getBudgetBytes() << ",\n";
+    out << "    \"workingSet\": " << memory.getWorkingSetBytes() << ",\n";
+    out << "    \"underPressure\": " << (memory.isUnderPressure() ? "true" : "false") << "\n";
+    out << "  },\n";
+    out << "  \"perPassTimestamps\": " << (perPass ? "true" : "false") << ",\n";
+    out << "  \"timingsMs\": {\n";
+    writeStats(out, "cpu", cpu, false);
+    writeStats(out, "renderScale", renderScale, false);
+    writeStats(out, "gpuFrame", gpuFrame, false);
+    for (int pass = 0; pass < GpuPassCount; ++pass) {
+        std::string name = std::string("gpu") + GpuProfiler::passName(static_cast<GpuPass>(pass));
+        writeStats(out, name.c_str(), passes[pass], pass == GpuPassCount - 1);
+    }
+    out << "  }\n";
+    out << "}\n";
+    return true;
+}
+
+// Each workload on the warmed-up scene, written as one JSON array; false when none could run
+static bool runMicrobenchmarks(Renderer* renderer, const BenchOptions& options, const char* deviceName)
+{
+    struct Run {
+        Renderer::Microbenchmark kind;
+        int size;                // Trample map texels per side / fragment layers (0 = current / default)
+    };
+    const Run runs[] = {
+        { Renderer::MicrobenchTrampleStamp, 256 },
+        { Renderer::MicrobenchTrampleStamp, 512 },
+        { Renderer::MicrobenchTrampleStamp, 1024 },
+        { Renderer::MicrobenchTrampleStamp, 2048 },
+        { Renderer::MicrobenchTrampleStamp, 4096 },
+        { Renderer::MicrobenchCull, 0 },
+        { Renderer::MicrobenchGenerate, 0 },
+        { Renderer::MicrobenchGrassVertex, 0 },
+        { Renderer::MicrobenchGrassFragment, 1 },
+        { Renderer::MicrobenchGrassFragment, 4 },
+        { Renderer::MicrobenchGrassFragment, 16 },
+    };
+    // The trample runs resize the map; the later workloads see the size the bench was set up with
+    int trampleMapSize = renderer->getTrampleMapSize();
+
+    std::ofstream out(options.jsonPath);
+    if (!out) {
+        std::cerr << "Failed to open " << options.jsonPath << std::endl;
+        return false;
+    }
+    out << "{\n";
+    out << "  \"device\": \"" << deviceName << "\",\n";
+    out << "  \"width\": " << options.width << ",\n";
+    out << "  \"height\": " << options.height << ",\n";
+    out << "  \"seed\": " << options.seed << ",\n";
+    out << "  \"sampleCount\": " << options.sampleCount << ",\n";
+    out << "  \"interactors\": " << options.interactors << ",\n";
+    out << "  \"repeatsPerSample\": " << Renderer::kMicrobenchRepeats << ",\n";
+    out << "  \"microbenchmarks\": [";
+
+    int completed = 0;
+    for (const Run& run : runs) {
+        if (run.kind != Renderer::MicrobenchTrampleStamp && renderer->getTrampleMapSize() != trampleMapSize) {
+            renderer->setTrampleMapSize(trampleMapSize);
+            renderer->draw();
+        }
+        Renderer::MicrobenchResult result;
+        if (!renderer->runMicrobenchmark(run.kind, run.size, options.microbenchSamples, result)) {
+            continue;
+        }
+        // Throughput in items per nanosecond of the median repetition
+        double itemsPerNs = result.medianMs > 0.0 ? static_cast<double>(result.items) / (result.medianMs * 1e6) : 0.0;
+        char line[160];
+        std::snprintf(line, sizeof(line), "  %-14s %5d  median %8.4f ms  min %8.4f  max %8.4f  %12llu items  %8.3f /ns",
+                      Renderer::microbenchName(run.kind), run.size, result.medianMs, result.minMs, result.maxMs,
+                      static_cast<unsigned long long>(result.items), itemsPerNs);
+        std::cout << line << std::endl;
+
+        out << (completed > 0 ? ",\n" : "\n");
+        out << "    { \"name\": \"" << Renderer::microbenchName(run.kind) << "\", \"size\": " << run.size
+            << ", \"medianMs\": " << result.medianMs << ", \"minMs\": " << result.minMs << ", \"maxMs\": " << result.maxMs
+            << ", \"samples\": " << result.samples << ", \"items\": " << result.items << " }";
+        completed++;
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+    return completed > 0;
+}
+
+// The blade counts cover the 30K default field up to 4M; the generated field stops at its maximum
+// density, so the first count past it runs at the cap (flagged "capped") and the later ones are
+// reported as skipped rather than measured again
+static const uint32_t kSweepBladeCounts[] = { 10000, 30000, 100000, 300000, 1000000, 2000000, 4000000 };
+static const uint32_t kSweepBaselineBlades = 30000;
+static const int kSweepTrampleSizes[] = { 256, 512, 1024, 2048, 4096 };
+
+struct SweepPoint {
+    int sampleCount;             // 1 = temporal upscaling
+    int trampleMapSize;
+    uint32_t bladeCount;         // Requested
+    uint32_t blades;             // Generated (clamped to the maximum density)
+    bool capped;                 // Fewer blades than requested: the field's maximum density
+    double gpuMedian;            // Milliseconds
+    double gpuP99;
+    double cpuMedian;
+    double grassMedian;          // Grass pass (0 without per-pass timestamps)
+    double grassVertexMs;        // Grass vertex stage alone (rasterization discarded)
+    size_t instanceBytes;
+    size_t trampleBytes;
+    size_t allocatedBytes;
+};
+
+// One setting of the sweep: warm-up and recorded frames along the camera path, then the grass
+// vertex stage alone on the last frame's visible blades (the rest of the grass pass is the
+// fragment side)
+static SweepPoint measureSweepPoint(Renderer* renderer, const BenchOptions& options, int sampleCount,
+                                    int trampleMapSize, uint32_t bladeCount, int bladesPerCell)
+{
+    renderer->setTrampleMapSize(trampleMapSize);
+    renderer->setGrassDensity(bladesPerCell);
+
+    std::vector<double> gpu;
+    std::vector<double> cpu;
+    std::vector<double> grass;
+    int totalFrames = options.warmupFrames + options.sweepFrames;
+    for (int frame = 0; frame < totalFrames; ++frame) {
+        float pathTime = static_cast<float>(frame) / static_cast<float>(std::max(1, totalFrames - 1));
+        CameraPose pose = evaluatePath(options.path, pathTime);
+        renderer->setCameraPose(pose.position, pose.yaw, pose.pitch);
+        renderer->setFixedTime(static_cast<float>(frame) * options.frameTime);
+
+        auto cpuStart = std::chrono::high_resolution_clock::now();
+        renderer->draw();
+        auto cpuEnd = std::chrono::high_resolution_clock::now();
+        if (frame >= options.warmupFrames) {
+            GpuTimings timings = renderer->getGpuTimings();
+            cpu.push_back(std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count());
+            gpu.push_back(timings.frameMs);
+            if (timings.perPass) {
+                grass.push_back(timings.passMs[GpuPassGrass]);
+            }
+        }
+    }
+
+    SweepPoint point = {};
+    point.sampleCount = sampleCount;
+    point.trampleMapSize = renderer->getTrampleMapSize();
+    point.bladeCount = bladeCount;
+    point.blades = renderer->getGrassInstanceCount();
+    point.gpuMedian = percentile(gpu, 0.5);
+    point.gpuP99 = percentile(gpu, 0.99);
+    point.cpuMedian = percentile(cpu, 0.5);
+    point.grassMedian = percentile(grass, 0.5);
+    Renderer::MicrobenchResult vertex;
+    if (renderer->runMicrobenchmark(Renderer::MicrobenchGrassVertex, 0, 16, vertex)) {
+        point.grassVertexMs = vertex.medianMs;
+    }
+    const GpuMemoryBudget& memory = renderer->getGpuMemory();
+    point.instanceBytes = memory.getBytes(GpuMemoryBudget::CategoryInstances);
+    point.trampleBytes = memory.getBytes(GpuMemoryBudget::CategoryTrample);
+    point.allocatedBytes = memory.getAllocatedBytes();
+    return point;
+}
+
+// Blade count and trample size sweeps per sample count, written as one JSON array; false when
+// nothing could be measured
+static bool runSweep(Renderer* renderer, const BenchOptions& options, const char* deviceName)
+{
+    std::vector<int> sampleCounts;
+    if (options.sweepMsaa) {
+        sampleCounts = { 1, 2, 4, 8 }; // 8x only where the device supports it
+    } else {
+        sampleCounts.push_back(options.temporalUpscaling ? 1 : options.sampleCount);
+    }
+    // Cells of the field: the density is per cell
+    int cellCount = static_cast<int>(renderer->getGrassInstanceCount() / std::max(renderer->getRenderSettings().bladesPerCell, 1));
+    auto bladesPerCell = [&](uint32_t bladeCount) {
+        return std::max(static_cast<int>((bladeCount + cellCount / 2) / std::max(cellCount, 1)), 1);
+    };
+    int defaultTrampleSize = renderer->getTrampleMapSize();
+    std::string path = options.path == "replay" ? "orbit" : options.path;
+    BenchOptions sweepOptions = options;
+    sweepOptions.path = path;
+
+    std::vector<SweepPoint> points;
+    std::vector<uint32_t> skippedBladeCounts; // Past the cap, per sample count
+    for (int sampleCount : sampleCounts) {
+        bool applied = sampleCount == 1 ? renderer->setTemporalUpscaling(true)
+                                        : renderer->setTemporalUpscaling(false) && renderer->setSceneSampleCount(sampleCount);
+        if (!applied) {
+            std::cerr << "Sweep: " << sampleCount << "x unavailable, skipped" << std::endl;
+            continue;
+        }
+        // The switch happens in draw() once the pipelines exist
+        renderer->waitForPipelines();
+        renderer->draw();
+
+        uint32_t previousBlades = 0;
+        for (uint32_t bladeCount : kSweepBladeCounts) {
+            renderer->setGrassDensity(bladesPerCell(bladeCount));
+            if (renderer->getGrassInstanceCount() == previousBlades) {
+                std::cout << "Sweep: " << bladeCount << " blades skipped (the field is capped at " << previousBlades
+                          << ")" << std::endl;
+                if (sampleCount == sampleCounts.front()) {
+                    skippedBladeCounts.push_back(bladeCount);
+                }
+                continue;
+            }
+            previousBlades = renderer->getGrassInstanceCount();
+            points.push_back(measureSweepPoint(renderer, sweepOptions, sampleCount, defaultTrampleSize, bladeCount,
+                                               bladesPerCell(bladeCount)));
+            points.back().capped = points.back().blades + static_cast<uint32_t>(cellCount) < bladeCount;
+        }
+        for (int trampleMapSize : kSweepTrampleSizes) {
+            if (trampleMapSize == defaultTrampleSize) {
+                continue; // Measured by the blade sweep at the baseline count
+            }
+            points.push_back(measureSweepPoint(renderer, sweepOptions, sampleCount, trampleMapSize, kSweepBaselineBlades,
+                                               bladesPerCell(kSweepBaselineBlades)));
+        }
+        renderer->setTrampleMapSize(defaultTrampleSize);
+    }
+
+    std::cout << "  msaa  trample     blades   gpu ms    p99   grass  vertex  fragment  instances MB  allocated MB" << std::endl;
+    for (const SweepPoint& point : points) {
+        double fragmentMs = point.grassMedian > 0.0 ? std::max(point.grassMedian - point.grassVertexMs, 0.0) : 0.0;
+        char line[192];
+        std::snprintf(line, sizeof(line), "  %3dx  %7d  %9u  %7.3f  %5.2f  %6.3f  %6.3f  %8.3f  %12.1f  %12.1f%s",
+                      point.sampleCount, point.trampleMapSize, point.blades, point.gpuMedian, point.gpuP99,
+                      point.grassMedian, point.grassVertexMs, fragmentMs,
+                      static_cast<double>(point.instanceBytes) / (1024.0 * 1024.0),
+                      static_cast<double>(point.allocatedBytes) / (1024.0 * 1024.0),
+                      point.capped ? "  (capped)" : "");
+        std::cout << line << std::endl;
+    }
+    if (!skippedBladeCounts.empty()) {
+        std::cout << "  skipped (past the field's maximum density):";
+        for (uint32_t bladeCount : skippedBladeCounts) {
+            std::cout << " " << bladeCount;
+        }
+        std::cout << std::endl;
+    }
+
+    std::ofstream out(options.jsonPath);
+    if (!out) {
+        std::cerr << "Failed to open " << options.jsonPath << std::endl;
+        return false;
+    }
+    out << "{\n";
+    out << "  \"device\": \"" << deviceName << "\",\n";
+    out << "  \"path\": \"" << path << "\",\n";
+    out << "  \"width\": " << options.width << ",\n";
+    out << "  \"height\": " << options.height << ",\n";
+    out << "  \"seed\": " << options.seed << ",\n";
+    out << "  \"framesPerSetting\": " << options.sweepFrames << ",\n";
+    out << "  \"warmupFrames\": " << options.warmupFrames << ",\n";
+    out << "  \"baselineBlades\": " << kSweepBaselineBlades << ",\n";
+    out << "  \"skippedBladeCounts\": [";
+    for (size_t i = 0; i < skippedBladeCounts.size(); ++i) {
+        out << (i > 0 ? ", " : "") << skippedBladeCounts[i];
+    }
+    out << "],\n";
+    out << "  \"sweep\": [";
+    for (size_t i = 0; i < points.size(); ++i) {
+        const SweepPoint& point = points[i];
+        out << (i > 0 ? ",\n" : "\n");
+        out << "    { \"sampleCount\": " << point.sampleCount << ", \"trampleMapSize\": " << point.trampleMapSize
+            << ", \"requestedBlades\": " << point.bladeCount << ", \"blades\": " << point.blades
+            << ", \"capped\": " << (point.capped ? "true" : "false")
+            << ", \"gpuMedianMs\": " << point.gpuMedian << ", \"gpuP99Ms\": " << point.gpuP99
+            << ", \"cpuMedianMs\": " << point.cpuMedian << ", \"grassMs\": " << point.grassMedian
+            << ", \"grassVertexMs\": " << point.grassVertexMs
+            << ", \"instanceBytes\": " << point.instanceBytes << ", \"trampleBytes\": " << point.trampleBytes
+            << ", \"allocatedBytes\": " << point.allocatedBytes << " }";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+    return !points.empty();
+}
+
+// Records or checks the scenario's median and p99 frame times; false on a regression
+static bool checkBaseline(const BenchOptions& options, const std::vector<FrameSample>& samples, const std::string& deviceName)
+{
+    std::vector<double> cpu;
+    std::vector<double> gpuFrame;
+    for (const FrameSample& sample : samples) {
+        cpu.push_back(sample.cpuMs);
+        if (sample.gpu.frameMs > 0.0) {
+            gpuFrame.push_back(sample.gpu.frameMs);
+        }
+    }
+    FrameTimeBaseline::Entry measured;
+    measured.gpuMedian = percentile(gpuFrame, 0.5);
+    measured.gpuP99 = percentile(gpuFrame, 0.99);
+    measured.cpuMedian = percentile(cpu, 0.5);
+    measured.cpuP99 = percentile(cpu, 0.99);
+
+    FrameTimeBaseline baseline;
+    if (!baseline.load(options.baselinePath)) {
+        return false;
+    }
+    if (options.updateBaseline) {
+        baseline.set(deviceName, options.scenario, measured);
+        if (!baseline.save(options.baselinePath)) {
+            return false;
+        }
+        std::cout << "Baseline: recorded " << options.scenario << " for " << deviceName << " in " << options.baselinePath << std::endl;
+        return true;
+    }
+
+    // No entry is a failure too: a gate without numbers would pass every run
+    const FrameTimeBaseline::Entry* entry = baseline.find(deviceName, options.scenario);
+    if (!entry) {
+        std::cerr << "Baseline: no " << options.scenario << " entry for " << deviceName << " in " << options.baselinePath
+                  << " (run with --update-baseline on this device to record one)" << std::endl;
+        return false;
+    }
+    std::cout << "Baseline: " << options.scenario << " on " << deviceName << ", tolerance "
+              << options.tolerance * 100.0f << "%" << std::endl;
+    bool ok = FrameTimeBaseline::compare(*entry, measured, options.tolerance);
+    if (!ok) {
+        std::cerr << "Frame-time regression in scenario " << options.scenario << std::endl;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    // A replay brings its own seed and length; the warm-up holds its first frame
+    InputRecording replay;
+    if (!options.replayPath.empty()) {
+        if (!replay.load(options.replayPath) || replay.frames.empty()) {
+            std::cerr << "Input recording unusable: " << options.replayPath << std::endl;
+            return 1;
+        }
+        options.seed = replay.seed;
+        options.frames = static_cast<int>(replay.frames.size());
+        options.path = "replay";
+    }
+
+    MTL::Device* device = MTL::CreateSystemDefaultDevice();
+    if (!device) {
+        std::cerr << "Failed to create Metal device" << std::endl;
+        return -1;
+    }
+
+    Renderer* renderer = new Renderer(device, options.width, options.height, options.seed);
+    if (!options.precompilePath.empty()) {
+        bool ok = renderer->precompilePipelines(options.precompilePath);
+        delete renderer;
+        device->release();
+        return ok ? 0 : 1;
+    }
+    // Settings first: the individual options below override them
+    if (!options.quality.empty() || !options.settingsPath.empty()) {
+        RenderSettings settings;
+        RenderSettings::Quality quality;
+        if (RenderSettings::parseQuality(options.quality, quality)) {
+            settings = RenderSettings::preset(quality);
+        }
+        if (!options.settingsPath.empty() && !settings.load(options.settingsPath)) {
+            options.settingsPath.clear();
+        }
+        renderer->applyRenderSettings(settings);
+    }
+    if (options.bladesPerCell > 0) {
+        renderer->setGrassDensity(options.bladesPerCell);
+    }
+    renderer->setGrassDensityMapEnabled(options.densityMap);
+    options.densityMap = renderer->isGrassDensityMapEnabled();
+    if (!options.exportInstancesPath.empty() && !renderer->exportGrassInstances(options.exportInstancesPath)) {
+        std::cerr << "Failed to export the grass field to " << options.exportInstancesPath << std::endl;
+    }
+    if (!options.instancesPath.empty() && !renderer->loadGrassInstances(options.instancesPath)) {
+        std::cerr << "Instance file unusable, benchmarking the generated field" << std::endl;
+        options.instancesPath.clear();
+    }
+    if (options.dynamicResolutionMs > 0.0f && !renderer->setDynamicResolution(true, options.dynamicResolutionMs)) {
+        std::cerr << "Dynamic resolution unavailable (no MetalFX support), rendering at native resolution" << std::endl;
+    }
+    if (options.rasterizationRateMs > 0.0f && !renderer->setVariableRasterizationRate(true, options.rasterizationRateMs)) {
+        std::cerr << "Variable rasterization rate unavailable, shading at full rate" << std::endl;
+        options.rasterizationRateMs = 0.0f;
+    }
+    renderer->setInteractorCount(options.interactors);
+    options.interactors = renderer->getInteractorCount();
+    renderer->setInteractorPhysics(options.interactorPhysics);
+    options.interactorPhysics = renderer->isInteractorPhysicsEnabled();
+    if (!options.externalControl.empty() && !renderer->setExternalControl(options.externalControl)) {
+        std::cerr << "External control unavailable, keeping the scripted interactors" << std::endl;
+    }
+    renderer->setTrampleSummaryEnabled(options.trampleSummary);
+    if (options.temporalUpscaling && !renderer->setTemporalUpscaling(true)) {
+        std::cerr << "Temporal upscaling unavailable, rendering with 4x MSAA" << std::endl;
+        options.temporalUpscaling = false;
+    }
+    if (options.temporalAntialiasing && !renderer->setTemporalAntialiasing(true)) {
+        std::cerr << "Temporal antialiasing unavailable, rendering with MSAA" << std::endl;
+    }
+    if (options.grassVisibility && !renderer->setGrassVisibilityShading(true)) {
+        std::cerr << "Visibility-buffer grass unavailable, shading grass in the scene pass" << std::endl;
+        options.grassVisibility = false;
+    }
+    if (options.grassLean) {
+        Renderer::GrassShadingFeatures features;
+        features.contactShadows = false;
+        features.translucency = false;
+        features.windSheen = false;
+        renderer->setGrassShadingFeatures(features);
+    }
+    if (options.halfPrecision) {
+        renderer->setHalfPrecisionShading(true);
+    }
+    options.halfPrecision = renderer->isHalfPrecisionShading();
+    if (options.pointLights > 0) {
+        renderer->setPointLights(scatterFireflies(renderer, options.pointLights, options.seed));
+        options.pointLights = static_cast<int>(renderer->getPointLightCount());
+    }
+    renderer->setGrassImpostors(options.impostors && renderer->isGrassImpostorsEnabled(),
+                                options.impostorDistance > 0.0f ? options.impostorDistance : renderer->getGrassImpostorDistance());
+    options.impostors = renderer->isGrassImpostorsEnabled();
+    options.impostorDistance = renderer->getGrassImpostorDistance();
+    if (options.densityLodDistance >= 0.0f) {
+        renderer->setGrassDensityLod(options.densityLodDistance);
+    }
+    options.densityLodDistance = renderer->getGrassDensityLodDistance();
+    if (options.bladePhysicsRadius > 0.0f && !renderer->setBladePhysics(options.bladePhysicsRadius)) {
+        std::cerr << "Blade physics unavailable, using the stateless wind bend" << std::endl;
+    }
+    options.bladePhysicsRadius = renderer->getBladePhysicsRadius();
+    if (options.windFluid && !renderer->setWindFluid(true)) {
+        std::cerr << "Wind fluid unavailable, using the procedural wind" << std::endl;
+    }
+    options.windFluid = renderer->isWindFluidEnabled();
+    renderer->setGrassSeason(options.season);
+    float* simulationRates[Renderer::SimulationSystemCount] = { &options.trampleHz, &options.physicsHz, &options.windHz };
+    for (int system = 0; system < Renderer::SimulationSystemCount; ++system) {
+        Renderer::SimulationSystem id = static_cast<Renderer::SimulationSystem>(system);
+        if (*simulationRates[system] >= 0.0f) {
+            renderer->setSimulationRate(id, *simulationRates[system]);
+        }
+        *simulationRates[system] = renderer->getSimulationRate(id);
+    }
+    Renderer::PowerPolicy powerPolicy = renderer->getPowerPolicy();
+    if (options.simulationScale > 0.0f) {
+        powerPolicy.simulationScale = options.simulationScale;
+        renderer->setPowerPolicy(powerPolicy);
+    }
+    options.simulationScale = powerPolicy.simulationScale;
+    options.sampleCount = renderer->getSceneSampleCount();
+    options.temporalAntialiasing = renderer->isTemporalAntialiasing();
+    options.temporalUpscaling = options.temporalUpscaling && !options.temporalAntialiasing;
+    options.bladeSegments = renderer->getGrassBladeSegments();
+    options.trampleMapSize = renderer->getTrampleMapSize();
+    renderer->setParallelEncoding(options.parallelEncoding);
+    renderer->setAsyncCompute(options.asyncCompute);
+    renderer->setCpuCellCulling(options.cpuCellCulling);
+    renderer->setGrassDepthPrepass(options.depthPrepass);
+    renderer->setFrontToBackCells(options.cellSort);
+    renderer->setGrassWindPoses(options.windPoses);
+    renderer->setInTilePost(options.tilePost);
+    options.tilePost = renderer->isInTilePostEnabled();
+    renderer->setObjectIds(options.objectIds);
+    if (options.geometryBlades) {
+        renderer->setGeometryBlades(true);
+    }
+    if (options.resourceBudgetMB > 0) {
+        renderer->setResourceCacheBudget(static_cast<size_t>(options.resourceBudgetMB) * 1024 * 1024);
+    }
+    renderer->setGpuMemoryBudget(static_cast<size_t>(options.gpuMemoryBudgetMB) * 1024 * 1024);
+    if (options.sparseGround) {
+        renderer->setSparseGroundTexture(true);
+    }
+    if (options.streamGrass && !renderer->setGrassStreaming(true)) {
+        std::cerr << "Grass streaming unavailable, benchmarking the static field" << std::endl;
+        options.streamGrass = false;
+    }
+    if (options.views > 1) {
+        // Left half follows the path; the right half is stacked overview cameras looking down at
+        // the field from evenly spaced sides
+        std::vector<Renderer::RenderView> views(options.views);
+        views[0].followCamera = true;
+        views[0].viewport = simd::make_float4(0.0f, 0.0f, 0.5f, 1.0f);
+        float overviewHeight = 1.0f / static_cast<float>(options.views - 1);
+        for (int i = 1; i < options.views; ++i) {
+            float angle = 6.2831853f * static_cast<float>(i - 1) / static_cast<float>(options.views - 1);
+            views[i].position = glm::vec3(std::cos(angle) * 20.0f, 14.0f, std::sin(angle) * 20.0f);
+            views[i].yaw = glm::degrees(angle) + 180.0f;
+            views[i].pitch = -35.0f;
+            views[i].viewport = simd::make_float4(0.5f, overviewHeight * static_cast<float>(i - 1), 0.5f, overviewHeight);
+        }
+        renderer->setViews(views);
+    }
+
+    std::cout << "VegetationBench: " << device->name()->utf8String() << ", " << options.width << "x" << options.height
+              << ", path " << options.path << ", " << renderer->getGrassInstanceCount() << " blades" << std::endl;
+
+    // Keep pipeline compilation and texture decoding out of the measurement (the first frames
+    // would otherwise draw the placeholders)
+    renderer->waitForPipelines();
+    renderer->waitForTextures();
+    std::cout << "Resource cache: " << renderer->getResourceCacheBytes() / (1024 * 1024) << " MB resident" << std::endl;
+    BufferHeap::Stats heapStats = renderer->getBufferHeapStats();
+    std::cout << "Buffer heaps: " << heapStats.liveBuffers << " buffers in " << heapStats.heapCount << " heap(s), "
+              << heapStats.blockBytes / (1024 * 1024) << " of " << heapStats.heapBytes / (1024 * 1024) << " MB used ("
+              << heapStats.requestedBytes / (1024 * 1024) << " MB requested), fragmentation "
+              << static_cast<int>(heapStats.fragmentation() * 100.0 + 0.5) << "%" << std::endl;
+
+    if (options.microbench) {
+        // Warm-up frames at the path's start fill the visible lists, bins and trample window
+        CameraPose pose = evaluatePath(options.path == "replay" ? "orbit" : options.path, 0.0f);
+        renderer->setCameraPose(pose.position, pose.yaw, pose.pitch);
+        for (int frame = 0; frame < std::max(options.warmupFrames, 1); ++frame) {
+            renderer->setFixedTime(static_cast<float>(frame) * options.frameTime);
+            renderer->draw();
+        }
+        std::cout << "Microbenchmarks: " << options.microbenchSamples << " samples of " << Renderer::kMicrobenchRepeats
+                  << " repetitions each" << std::endl;
+        bool ok = runMicrobenchmarks(renderer, options, device->name()->utf8String());
+        if (ok) {
+            std::cout << "Wrote " << options.jsonPath << std::endl;
+        }
+        delete renderer;
+        device->release();
+        return ok ? 0 : 1;
+    }
+
+    if (options.batchViews > 0) {
+        bool ok = runBatch(renderer, options);
+        delete renderer;
+        device->release();
+        return ok ? 0 : 1;
+    }
+
+    if (options.sweep) {
+        bool ok = runSweep(renderer, options, device->name()->utf8String());
+        if (ok) {
+            std::cout << "Wrote " << options.jsonPath << std::endl;
+        }
+        delete renderer;
+        device->release();
+        return ok ? 0 : 1;
+    }
+
+    std::vector<FrameSample> samples;
+    samples.reserve(options.frames);
+
+    int totalFrames = options.warmupFrames + options.frames;
+    auto benchStart = std::chrono::high_resolution_clock::now();
+    uint64_t pickedRegions = 0;  // Object picks handed back (render thread, inside draw())
+    std::mt19937 gustGen(options.seed ^ 0xc2b2ae35u);
+    int peakGusts = 0;
+    uint64_t pickedKinds[5] = {}; // Picked pixels per ObjectIdKind (4 = unknown)
+
+    for (int frame = 0; frame < totalFrames; ++frame) {
+        // Deterministic clock and camera: the same frame index always renders the same image
+        if (options.replayPath.empty()) {
+            float pathTime = static_cast<float>(frame) / static_cast<float>(std::max(1, totalFrames - 1));
+            CameraPose pose = evaluatePath(options.path, pathTime);
+            renderer->setCameraPose(pose.position, pose.yaw, pose.pitch);
+            renderer->setFixedTime(static_cast<float>(frame) * options.frameTime);
+        } else if (frame < options.warmupFrames) {
+            renderer->setCameraPose(replay.startPosition, replay.startYaw, replay.startPitch);
+            renderer->setFixedTime(replay.frames[0].sceneTime);
+        } else {
+            // Recorded packets drive the camera and the key toggles (outside the CPU measurement)
+            const InputRecording::Frame& recorded = replay.frames[frame - options.warmupFrames];
+            if (frame == options.warmupFrames) {
+                renderer->beginInputReplay(replay);
+            }
+            renderer->setFixedTime(recorded.sceneTime);
+            renderer->update(recorded.input, recorded.deltaTime);
+        }
+        if (frame == options.warmupFrames && options.captureSpikeMs > 0.0f) {
+            renderer->setCaptureTrigger(options.captureSpikeMs, 1, ".");
+        }
+        if (frame == options.warmupFrames && !options.tracePath.empty()) {
+            renderer->setTraceRecording(true);
+        }
+        if (frame == options.warmupFrames && !options.videoPath.empty() &&
+            !renderer->startVideoRecording(options.videoPath, 1.0 / options.frameTime)) {
+            options.videoPath.clear();
+        }
+        if (options.captureFrame >= 0 && frame == options.warmupFrames + options.captureFrame) {
+            renderer->captureFrames(1, "bench_frame_" + std::to_string(options.captureFrame));
+        }
+
+        if (options.objectIds && frame >= options.warmupFrames) {
+            renderer->pickObjects(options.width / 2 - 8, options.height / 2 - 8, 16, 16,
+                                  [&pickedRegions, &pickedKinds](const std::vector<uint32_t>& ids, uint32_t, uint32_t) {
+                pickedRegions++;
+                for (uint32_t id : ids) {
+                    pickedKinds[std::min<uint32_t>(OBJECT_ID_KIND(id), 4)]++;
+                }
+            });
+        }
+
+        for (int i = 0; i < options.windGusts; ++i) {
+            renderer->spawnWindGust(scatterWindGust(gustGen));
+        }
+        peakGusts = std::max(peakGusts, renderer->getLiveWindGustCount());
+
+        if (frame == totalFrames - 1 && !options.screenshotPath.empty()) {
+            renderer->saveRenderTarget(Renderer::ReadbackTargetOutput, 0, options.screenshotPath);
+            renderer->saveRenderTarget(Renderer::ReadbackTargetDepth, 0, options.screenshotPath + "_depth");
+            renderer->saveRenderTarget(Renderer::ReadbackTargetTrampleMap, 0, options.screenshotPath + "_trample");
+        }
+
+        auto cpuStart = std::chrono::high_resolution_clock::now();
+        renderer->draw();
+        auto cpuEnd = std::chrono::high_resolution_clock::now();
+
+        if (frame >= options.warmupFrames) {
+            FrameSample sample;
+            sample.frame = frame - options.warmupFrames;
+            sample.cpuMs = std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+            sample.gpu = renderer->getGpuTimings();
+            sample.renderScale = renderer->getRenderScale();
+            samples.push_back(sample);
+        }
+    }
+
+    renderer->waitUntilIdle();
+    renderer->stopVideoRecording();
+    if (options.windGusts > 0) {
+        std::cout << "Wind gusts: " << options.windGusts << " spawned per frame, up to " << peakGusts << " live" << std::endl;
+    }
+    if (options.objectIds) {
+        // Picks of the last frames in flight are handed back by later draws, never drawn here
+        std::cout << "Object picks: " << pickedRegions << " regions, pixels on nothing " << pickedKinds[ObjectIdKindNone]
+                  << ", ground " << pickedKinds[ObjectIdKindGround] << ", blades " << pickedKinds[ObjectIdKindBlade]
+                  << ", interactors " << pickedKinds[ObjectIdKindInteractor] << std::endl;
+    }
+    if (!options.tracePath.empty()) {
+        renderer->setTraceRecording(false);
+        renderer->writeTrace(options.tracePath);
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - benchStart).count();
+
+    bool ok = writeCsv(options, samples);
+    ok = writeJson(options, samples, renderer->getGrassInstanceCount(), renderer->getGrassPlacedCount(),
+                   device->name()->utf8String(), wallSeconds, renderer->getGpuMemory()) && ok;
+    if (ok) {
+        std::cout << "Wrote " << options.csvPath << " and " << options.jsonPath << std::endl;
+    }
+    bool withinBaseline = options.baselinePath.empty() || checkBaseline(options, samples, device->name()->utf8String());
+
+    // Cleanup
+    delete renderer;
+    device->release();
+
+    if (!ok) {
+        return 1;
+    }
+    return withinBaseline ? 0 : 2;
+}
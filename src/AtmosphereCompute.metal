@@ -0,0 +1,48 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Atmosphere LUT: sky radiance for every (angle to the sun, view elevation) pair, rebuilt only
+// when the sun moves. The sky pass and the post-pass fog read it with atmosphereColor(), so neither
+// evaluates the gradient, haze and sun glow per pixel, and the fog always matches the horizon.
+kernel void buildAtmosphereLut(
+    texture2d<float, access::write> atmosphereLut [[texture(0)]],
+    constant AtmosphereUniforms &atmosphere [[buffer(AtmosphereBufferIndexUniforms)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= atmosphereLut.get_width() || gid.y >= atmosphereLut.get_height()) {
+        return;
+    }
+    // Texel centers land on both ends of each axis (see atmosphereColor)
+    float2 local = float2(gid) / float2(atmosphereLut.get_width() - 1, atmosphereLut.get_height() - 1);
+    float cosSun = cos(local.x * M_PI_F);
+    float sinElevation = mix(ATMOSPHERE_LUT_MIN_ELEVATION, 1.0, local.y);
+
+    // More saturated, clearer "Ghibli-ish" palette (not washed out)
+    float3 topColor     = float3(0.16, 0.38, 0.82);
+    float3 horizonColor = float3(0.72, 0.90, 0.98);
+    float3 hazeColor    = float3(0.80, 0.90, 0.98);
+
+    // Warmer horizon toward a low sun
+    float sunLow = 1.0 - saturate(atmosphere.sunDirection.y * 3.0);
+    float towardSun = pow(cosSun * 0.5 + 0.5, 4.0);
+    horizonColor = mix(horizonColor, float3(1.0, 0.78, 0.58), sunLow * towardSun * 0.6);
+
+    // Base gradient over the lower part of the dome (0 = horizon, 1 = zenith band)
+    float y = saturate(sinElevation * 2.5);
+    float3 col = mix(horizonColor, topColor, smoothstep(0.0, 1.0, y));
+
+    // Haze: strongest near horizon, dies quickly upward (avoid whole-sky whitening)
+    float haze = exp2(-y * 10.0);
+    col = mix(col, hazeColor, haze * 0.25);
+
+    // Forward scattering around the sun: a tight disc glow plus a broad halo
+    float forward = saturate(cosSun);
+    col += atmosphere.sunColor * (pow(forward, 256.0) * 0.6 + pow(forward, 8.0) * 0.12);
+
+    // Stored as the linear radiance the post pass's exposure and Reinhard tone map turn back into
+    // these colors, so the sky and the fog go through the same tone map as the geometry
+    float3 display = min(col, float3(0.995));
+    atmosphereLut.write(float4(display / (1.0 - display) / POST_EXPOSURE, 1.0), gid);
+}
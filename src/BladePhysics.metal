@@ -0,0 +1,71 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Blade springs near the camera: every blade of the listed cells carries a tip bend and its rate
+// of change across frames. Each step pulls the bend towards the pose the stateless shader would
+// give it (the wind field at its root), pushes it away from the interactors binned to its tile,
+// and lets a damped spring recover from both, so blades overshoot, sway back and spring up behind
+// a passing body. Cells are listed by the CPU from the simulation radius, so the cost follows the
+// radius, not the field; the vertex stages fade to the stateless pose at its edge.
+kernel void simulateBlades(
+    constant Uniforms &uniforms [[buffer(BladePhysicsBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BladePhysicsBufferIndexSceneConstants)]],
+    const device InstanceData *instances [[buffer(BladePhysicsBufferIndexInstances)]],
+    const device GrassCell *cells [[buffer(BladePhysicsBufferIndexCells)]],
+    device BladeState *states [[buffer(BladePhysicsBufferIndexStates)]],
+    const device Interactor *interactors [[buffer(BladePhysicsBufferIndexInteractors)]],
+    const device InteractorBin *interactorBins [[buffer(BladePhysicsBufferIndexBins)]],
+    constant BladePhysicsUniforms &params [[buffer(BladePhysicsBufferIndexParams)]],
+    constant uint *cellList [[buffer(BladePhysicsBufferIndexCellList)]],
+    texture2d_array<float> windField [[texture(0)]],
+    uint groupID [[threadgroup_position_in_grid]],
+    uint tid [[thread_index_in_threadgroup]],
+    uint groupSize [[threads_per_threadgroup]]
+) {
+    if (groupID >= params.cellCount) {
+        return;
+    }
+    GrassCell cell = cells[cellList[groupID]];
+    constexpr sampler windSampler(filter::linear, address::clamp_to_edge);
+    float dt = params.deltaTime;
+
+    for (uint i = tid; i < cell.instanceCount; i += groupSize) {
+        uint index = cell.firstInstance + i;
+        InstanceData instance = instances[index];
+        float3 root = instancePosition(instance, scene.grassMinXZ, scene.grassMaxXZ);
+
+        // Rest pose: the stateless wind bend at the tip (see grassBladeVertex)
+        float2 windUV = windFieldUV(root.xz, scene.groundMinXZ, scene.groundMaxXZ);
+        float4 wind = windField.sample(windSampler, windUV, 0, level(0.0));
+        float2 target = normalize(wind.xy) * wind.z * 1.2;
+
+        // Interactors lean the blade away from their center, strongest at the center
+        InteractorBin bin = interactorBins[interactorBinIndex(root.xz, uniforms)];
+        for (uint b = 0; b < bin.count; ++b) {
+            Interactor interactor = interactors[bin.indices[b]];
+            float2 away = root.xz - interactor.position.xz;
+            float reach = interactor.radius + interactor.falloff;
+            float dist = length(away);
+            if (dist < reach && dist > 1e-4) {
+                target += away / dist * params.interactorPush * (1.0 - dist / reach);
+            }
+        }
+
+        // Damped spring, integrated semi-implicitly; stiffer and softer blades by their hash
+        BladeState state = states[index];
+        float stiffness = params.stiffness * (0.7 + 0.6 * instanceHash(instance));
+        float damping = 2.0 * params.dampingRatio * sqrt(stiffness);
+        float2 acceleration = stiffness * (target - state.bend) - damping * state.velocity;
+        state.velocity += acceleration * dt;
+        state.bend += state.velocity * dt;
+
+        // Blades cannot fold past the ground
+        float bendLength = length(state.bend);
+        if (bendLength > 1.4) {
+            state.bend *= 1.4 / bendLength;
+        }
+        states[index] = state;
+    }
+}
@@ -0,0 +1,208 @@
+#include "BufferHeap.hpp"
+#include <algorithm>
+#include <iostream>
+
+BufferHeap::BufferHeap(MTL::Device* device)
+    : m_device(device)
+    , m_heapAllocations(0)
+    , m_framesInFlight(0)
+{
+}
+
+BufferHeap::~BufferHeap()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_retired.wait(lock, [this] { return m_framesInFlight == 0; });
+    if (!m_blocks.empty()) {
+        std::cerr << "BufferHeap: " << m_blocks.size() << " buffer(s) still live at shutdown" << std::endl;
+    }
+    for (Heap* heap : m_heaps) {
+        heap->heap->release();
+        delete heap;
+    }
+}
+
+int BufferHeap::orderFor(NS::UInteger size)
+{
+    int order = 0;
+    while (blockSize(order) < size) {
+        ++order;
+    }
+    return order;
+}
+
+bool BufferHeap::allocate(Heap* heap, int order, NS::UInteger& offset)
+{
+    int available = order;
+    while (available <= heap->maxOrder && heap->free[available].empty()) {
+        ++available;
+    }
+    if (available > heap->maxOrder) {
+        return false;
+    }
+
+    offset = heap->free[available].back();
+    heap->free[available].pop_back();
+    // Split down to the requested class; the upper halves stay free
+    while (available > order) {
+        --available;
+        heap->free[available].push_back(offset + blockSize(available));
+    }
+    heap->blockBytes += blockSize(order);
+    return true;
+}
+
+void BufferHeap::freeBlock(const Block& block)
+{
+    Heap* heap = block.heap;
+    heap->blockBytes -= blockSize(block.order);
+
+    // Merge with the buddy while it is free too
+    NS::UInteger offset = block.offset;
+    int order = block.order;
+    while (order < heap->maxOrder) {
+        NS::UInteger buddy = offset ^ blockSize(order);
+        std::vector<NS::UInteger>& list = heap->free[order];
+        auto it = std::find(list.begin(), list.end(), buddy);
+        if (it == list.end()) {
+            break;
+        }
+        list.erase(it);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    heap->free[order].push_back(offset);
+}
+
+BufferHeap::Heap* BufferHeap::createHeap(NS::UInteger minimumSize)
+{
+    NS::UInteger size = kMinHeapSize;
+    while (size < minimumSize) {
+        size *= 2;
+    }
+
+    MTL::HeapDescriptor* descriptor = MTL::HeapDescriptor::alloc()->init();
+    descriptor->setType(MTL::HeapTypePlacement);
+    descriptor->setSize(size);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    // Same as the render target heaps: passes rely on automatic hazard tracking
+    descriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    MTL::Heap* metalHeap = m_device->newHeap(descriptor);
+    descriptor->release();
+
+    if (!metalHeap) {
+        std::cerr << "Failed to create buffer heap (" << (size >> 20) << " MB)" << std::endl;
+        return nullptr;
+    }
+
+    Heap* heap = new Heap();
+    heap->heap = metalHeap;
+    heap->maxOrder = orderFor(size);
+    heap->free.resize(heap->maxOrder + 1);
+    heap->free[heap->maxOrder].push_back(0);
+    heap->blockBytes = 0;
+    m_heaps.push_back(heap);
+    m_heapAllocations++;
+    return heap;
+}
+
+MTL::Buffer* BufferHeap::newBuffer(size_t size)
+{
+    const MTL::ResourceOptions options = MTL::ResourceStorageModePrivate | MTL::ResourceHazardTrackingModeTracked;
+    MTL::SizeAndAlign sizeAndAlign = m_device->heapBufferSizeAndAlign(std::max<size_t>(size, 1), options);
+    // Blocks sit at multiples of their size, so a class at least as large as the alignment is aligned
+    int order = orderFor(std::max(sizeAndAlign.size, sizeAndAlign.align));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Heap* heap = nullptr;
+    NS::UInteger offset = 0;
+    for (Heap* candidate : m_heaps) {
+        if (candidate->maxOrder >= order && allocate(candidate, order, offset)) {
+            heap = candidate;
+            break;
+        }
+    }
+    if (!heap) {
+        heap = createHeap(blockSize(order));
+        if (!heap || !allocate(heap, order, offset)) {
+            return m_device->newBuffer(size, MTL::ResourceStorageModePrivate);
+        }
+    }
+
+    MTL::Buffer* buffer = heap->heap->newBuffer(size, options, offset);
+    if (!buffer) {
+        freeBlock({ heap, offset, order, size });
+        return m_device->newBuffer(size, MTL::ResourceStorageModePrivate);
+    }
+    m_blocks[buffer] = { heap, offset, order, size };
+    return buffer;
+}
+
+void BufferHeap::release(MTL::Buffer* buffer)
+{
+    if (!buffer) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_blocks.find(buffer);
+        if (it != m_blocks.end()) {
+            m_released.push_back(it->second);
+            m_blocks.erase(it);
+        }
+    }
+    buffer->release();
+}
+
+void BufferHeap::commit(MTL::CommandBuffer* commandBuffer)
+{
+    std::vector<Block> released;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_released.empty() || !commandBuffer) {
+            return;
+        }
+        released.swap(m_released);
+        m_framesInFlight++;
+    }
+
+    commandBuffer->addCompletedHandler([this, released](MTL::CommandBuffer*) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Block& block : released) {
+            freeBlock(block);
+        }
+        // Give emptied heaps back, keeping the first one for the next uploads
+        for (size_t i = m_heaps.size(); i-- > 1;) {
+            if (m_heaps[i]->blockBytes == 0) {
+                m_heaps[i]->heap->release();
+                delete m_heaps[i];
+                m_heaps.erase(m_heaps.begin() + i);
+            }
+        }
+        m_framesInFlight--;
+        m_retired.notify_all();
+    });
+}
+
+BufferHeap::Stats BufferHeap::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.heapCount = static_cast<int>(m_heaps.size());
+    stats.heapAllocations = m_heapAllocations;
+    stats.liveBuffers = static_cast<int>(m_blocks.size());
+    for (const Heap* heap : m_heaps) {
+        stats.heapBytes += blockSize(heap->maxOrder);
+        stats.blockBytes += heap->blockBytes;
+        for (int order = heap->maxOrder; order >= 0; --order) {
+            if (!heap->free[order].empty()) {
+                stats.largestFreeBlock = std::max<uint64_t>(stats.largestFreeBlock, blockSize(order));
+                break;
+            }
+        }
+    }
+    for (const auto& entry : m_blocks) {
+        stats.requestedBytes += entry.second.size;
+    }
+    return stats;
+}
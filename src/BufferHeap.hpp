@@ -0,0 +1,79 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Private buffers sub-allocated from placement MTL::Heaps, so static geometry, instance and cell
+// buffers share a few driver allocations instead of one each. Every heap is a buddy allocator:
+// requests round up to a power-of-two size class (at least kMinBlock), a block is split down to
+// the class it serves and merges with its free buddy again when released, which keeps the free
+// space in large runs without moving live buffers. Heaps are power-of-two buckets of at least
+// kMinHeapSize; a released range is reused only once the command buffer passed to the next
+// commit() completes (the GPU may still read the old buffer), and heaps left empty are handed
+// back to the driver then. Render thread, except for the completion handlers.
+class BufferHeap {
+public:
+    struct Stats {
+        int heapCount = 0;
+        uint64_t heapBytes = 0;       // Reserved by all heaps
+        uint64_t blockBytes = 0;      // Held by live buffers, rounded up to their size class
+        uint64_t requestedBytes = 0;  // Asked for by live buffers
+        uint64_t largestFreeBlock = 0;
+        int liveBuffers = 0;
+        int heapAllocations = 0;      // Heaps created so far (driver allocations)
+        // Share of the free space outside the largest free block (0 = one contiguous run)
+        double fragmentation() const
+        {
+            uint64_t freeBytes = heapBytes - blockBytes;
+            return freeBytes > 0 ? 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(freeBytes) : 0.0;
+        }
+    };
+
+    explicit BufferHeap(MTL::Device* device);
+    ~BufferHeap(); // Waits for the committed frees still in flight
+
+    // Private buffer of size bytes; falls back to a plain device buffer if no heap can be made
+    MTL::Buffer* newBuffer(size_t size);
+    // Releases the buffer (any buffer: ones not made here are just released), its range is
+    // reused after the next commit()
+    void release(MTL::Buffer* buffer);
+    // Ranges released so far become reusable once commandBuffer completes
+    void commit(MTL::CommandBuffer* commandBuffer);
+
+    Stats getStats() const;
+
+private:
+    static constexpr NS::UInteger kMinBlock = 4096;
+    static constexpr NS::UInteger kMinHeapSize = 32ull * 1024 * 1024;
+
+    struct Heap {
+        MTL::Heap* heap;
+        int maxOrder;                                  // The whole heap is one block of this order
+        std::vector<std::vector<NS::UInteger>> free;   // Free block offsets per order
+        uint64_t blockBytes;
+    };
+    struct Block {
+        Heap* heap;
+        NS::UInteger offset;
+        int order;
+        size_t size;                                   // Requested bytes
+    };
+
+    static NS::UInteger blockSize(int order) { return kMinBlock << order; }
+    static int orderFor(NS::UInteger size);
+    bool allocate(Heap* heap, int order, NS::UInteger& offset);
+    void freeBlock(const Block& block);                // Caller holds m_mutex
+    Heap* createHeap(NS::UInteger minimumSize);
+
+    MTL::Device* m_device;
+    std::vector<Heap*> m_heaps;
+    std::map<const MTL::Buffer*, Block> m_blocks;      // Live buffers placed in a heap
+    std::vector<Block> m_released;                     // Not committed yet
+    int m_heapAllocations;
+    int m_framesInFlight;                              // Commits whose frees are pending
+    mutable std::mutex m_mutex;
+    std::condition_variable m_retired;
+};
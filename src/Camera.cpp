@@ -25,6 +25,12 @@ glm::mat4 Camera::getProjectionMatrix(float width, float height)
     return glm::perspective(glm::radians(45.0f), width / height, 0.1f, 100.0f);
 }
 
+glm::mat4 Camera::getProjectionMatrix(float width, float height, glm::vec2 jitter)
+{
+    // Translating clip space by jitter * w moves every projected point by jitter after the divide
+    return glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * getProjectionMatrix(width, height);
+}
+
 void Camera::processKeyboard(int key, float deltaTime)
 {
     // Standard WASD movement. Update position based on front and right vectors.
@@ -69,6 +75,14 @@ void Camera::processMouseMovement(float xoffset, float yoffset)
     updateCameraVectors();
 }
 
+void Camera::setPose(glm::vec3 newPosition, float newYaw, float newPitch)
+{
+    position = newPosition;
+    yaw = newYaw;
+    pitch = std::clamp(newPitch, -89.0f, 89.0f);
+    updateCameraVectors();
+}
+
 void Camera::updateCameraVectors()
 {
     // Calculate new front, right, and up vectors using Euler angles (standard implementation)
@@ -8,11 +8,16 @@ public:
     
     glm::mat4 getViewMatrix();
     glm::mat4 getProjectionMatrix(float width, float height);
+    // Same projection shifted by a subpixel jitter in clip space (x right, y up; one pixel of a
+    // w-pixel-wide viewport is 2 / w): the sample offsets of the temporal modes
+    glm::mat4 getProjectionMatrix(float width, float height, glm::vec2 jitter);
     
     // 键盘输入 (WASD)
     void processKeyboard(int key, float deltaTime);
     // 鼠标移动 (视角)
     void processMouseMovement(float xoffset, float yoffset);
+    // Place the camera directly (scripted paths)
+    void setPose(glm::vec3 newPosition, float newYaw, float newPitch);
 
 
     glm::vec3 position;
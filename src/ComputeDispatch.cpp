@@ -0,0 +1,37 @@
+#include "ComputeDispatch.hpp"
+#include <algorithm>
+
+ComputeDispatch::ComputeDispatch(MTL::Device* device)
+    : m_nonUniformThreadgroups(device->supportsFamily(MTL::GPUFamilyApple4) || device->supportsFamily(MTL::GPUFamilyMac2))
+{
+}
+
+MTL::Size ComputeDispatch::threadgroupSize(MTL::ComputePipelineState* pipeline, MTL::Size grid)
+{
+    NS::UInteger simdWidth = std::max<NS::UInteger>(pipeline->threadExecutionWidth(), 1);
+    NS::UInteger maxThreads = std::max(pipeline->maxTotalThreadsPerThreadgroup(), simdWidth);
+
+    if (grid.height <= 1 && grid.depth <= 1) {
+        NS::UInteger needed = (std::max<NS::UInteger>(grid.width, 1) + simdWidth - 1) / simdWidth * simdWidth;
+        return MTL::Size(std::min(needed, maxThreads / simdWidth * simdWidth), 1, 1);
+    }
+    NS::UInteger rows = std::clamp<NS::UInteger>(grid.height, 1, maxThreads / simdWidth);
+    return MTL::Size(simdWidth, rows, 1);
+}
+
+void ComputeDispatch::dispatch(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline, MTL::Size grid) const
+{
+    if (!encoder || !pipeline || grid.width == 0 || grid.height == 0 || grid.depth == 0) {
+        return;
+    }
+
+    MTL::Size group = threadgroupSize(pipeline, grid);
+    if (m_nonUniformThreadgroups) {
+        encoder->dispatchThreads(grid, group);
+        return;
+    }
+    encoder->dispatchThreadgroups(MTL::Size(
+        (grid.width + group.width - 1) / group.width,
+        (grid.height + group.height - 1) / group.height,
+        (grid.depth + group.depth - 1) / group.depth), group);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <Metal/Metal.hpp>
+
+// Threadgroup sizing for compute kernels, taken from the pipeline instead of hard-coded.
+// Groups are one SIMD-group (threadExecutionWidth) wide and as tall as the pipeline allows
+// (maxTotalThreadsPerThreadgroup, which drops for register-heavy kernels), so every kernel fills
+// the GPU whatever its generation. Grid kernels (one thread per element, bounds-checked in the
+// kernel) go through dispatch(): devices with non-uniform threadgroups get dispatchThreads and
+// shrunk edge groups, the others round the grid up to whole groups.
+class ComputeDispatch {
+public:
+    explicit ComputeDispatch(MTL::Device* device);
+
+    // Encode a grid of the given size with the encoder's current pipeline (sized for pipeline)
+    void dispatch(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline, MTL::Size grid) const;
+
+    // Group for pipeline over a grid (or a per-group workload) of the given size:
+    // 1D grids get whole SIMD-groups up to the grid width, 2D and 3D grids one SIMD-group per row
+    static MTL::Size threadgroupSize(MTL::ComputePipelineState* pipeline, MTL::Size grid);
+
+    bool supportsNonUniformThreadgroups() const { return m_nonUniformThreadgroups; }
+
+private:
+    bool m_nonUniformThreadgroups;
+};
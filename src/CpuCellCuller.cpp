@@ -0,0 +1,130 @@
+#include "CpuCellCuller.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+CpuCellCuller::CpuCellCuller()
+    : m_cellCount(0)
+    , m_visibleCellCount(0)
+    , m_visibleInstanceCount(0)
+    , m_lastCullMs(0.0)
+{
+}
+
+void CpuCellCuller::setCells(const GrassCell* cells, uint32_t cellCount)
+{
+    m_cellCount = cells ? cellCount : 0;
+
+    // Padding boxes are inverted (min = +max float, max = -max float), so every plane rejects them
+    size_t padded = (static_cast<size_t>(m_cellCount) + kLanes - 1) / kLanes * kLanes;
+    m_minX.assign(padded, FLT_MAX);
+    m_minY.assign(padded, FLT_MAX);
+    m_minZ.assign(padded, FLT_MAX);
+    m_maxX.assign(padded, -FLT_MAX);
+    m_maxY.assign(padded, -FLT_MAX);
+    m_maxZ.assign(padded, -FLT_MAX);
+    m_firstInstance.assign(padded, 0);
+    m_instanceCount.assign(padded, 0);
+    m_visible.assign(padded, 0);
+
+    for (uint32_t i = 0; i < m_cellCount; ++i) {
+        const GrassCell& cell = cells[i];
+        m_minX[i] = cell.boundsMin.x;
+        m_minY[i] = cell.boundsMin.y;
+        m_minZ[i] = cell.boundsMin.z;
+        m_maxX[i] = cell.boundsMax.x;
+        m_maxY[i] = cell.boundsMax.y;
+        m_maxZ[i] = cell.boundsMax.z;
+        m_firstInstance[i] = cell.firstInstance;
+        m_instanceCount[i] = cell.instanceCount;
+    }
+}
+
+void CpuCellCuller::cullBlock(uint32_t first, const simd::float4* planes, uint32_t viewCount)
+{
+#if defined(__ARM_NEON)
+    uint32x4_t visibleLo = vdupq_n_u32(0);
+    uint32x4_t visibleHi = vdupq_n_u32(0);
+    for (uint32_t view = 0; view < viewCount; ++view) {
+        uint32x4_t insideLo = vdupq_n_u32(~0u);
+        uint32x4_t insideHi = vdupq_n_u32(~0u);
+        for (int p = 0; p < 6; ++p) {
+            // Positive vertex: the box corner furthest along the plane normal
+            simd::float4 plane = planes[view * 6 + p];
+            const float* x = (plane.x >= 0.0f ? m_maxX.data() : m_minX.data()) + first;
+            const float* y = (plane.y >= 0.0f ? m_maxY.data() : m_minY.data()) + first;
+            const float* z = (plane.z >= 0.0f ? m_maxZ.data() : m_minZ.data()) + first;
+
+            float32x4_t distanceLo = vdupq_n_f32(plane.w);
+            float32x4_t distanceHi = vdupq_n_f32(plane.w);
+            distanceLo = vfmaq_n_f32(distanceLo, vld1q_f32(x), plane.x);
+            distanceHi = vfmaq_n_f32(distanceHi, vld1q_f32(x + 4), plane.x);
+            distanceLo = vfmaq_n_f32(distanceLo, vld1q_f32(y), plane.y);
+            distanceHi = vfmaq_n_f32(distanceHi, vld1q_f32(y + 4), plane.y);
+            distanceLo = vfmaq_n_f32(distanceLo, vld1q_f32(z), plane.z);
+            distanceHi = vfmaq_n_f32(distanceHi, vld1q_f32(z + 4), plane.z);
+            insideLo = vandq_u32(insideLo, vcgeq_f32(distanceLo, vdupq_n_f32(0.0f)));
+            insideHi = vandq_u32(insideHi, vcgeq_f32(distanceHi, vdupq_n_f32(0.0f)));
+        }
+        visibleLo = vorrq_u32(visibleLo, insideLo);
+        visibleHi = vorrq_u32(visibleHi, insideHi);
+    }
+
+    // All-ones lanes narrow to 0xFF bytes
+    uint16x8_t visible16 = vcombine_u16(vmovn_u32(visibleLo), vmovn_u32(visibleHi));
+    vst1_u8(m_visible.data() + first, vmovn_u16(visible16));
+#else
+    for (uint32_t lane = 0; lane < kLanes; ++lane) {
+        uint32_t i = first + lane;
+        bool visible = false;
+        for (uint32_t view = 0; view < viewCount && !visible; ++view) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p) {
+                simd::float4 plane = planes[view * 6 + p];
+                float x = plane.x >= 0.0f ? m_maxX[i] : m_minX[i];
+                float y = plane.y >= 0.0f ? m_maxY[i] : m_minY[i];
+                float z = plane.z >= 0.0f ? m_maxZ[i] : m_minZ[i];
+                inside = plane.x * x + plane.y * y + plane.z * z + plane.w >= 0.0f;
+            }
+            visible = inside;
+        }
+        m_visible[i] = visible ? 0xFF : 0;
+    }
+#endif
+}
+
+void CpuCellCuller::cull(const simd::float4* planes, uint32_t viewCount)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    m_ranges.clear();
+    m_visibleCellCount = 0;
+    m_visibleInstanceCount = 0;
+    viewCount = std::max(viewCount, 1u);
+
+    uint32_t padded = static_cast<uint32_t>(m_visible.size());
+    for (uint32_t first = 0; first < padded; first += kLanes) {
+        cullBlock(first, planes, viewCount);
+    }
+
+    // Cells are stored in instance order, so neighbours usually continue each other's range
+    for (uint32_t i = 0; i < m_cellCount; ++i) {
+        if (!m_visible[i] || m_instanceCount[i] == 0) {
+            continue;
+        }
+        m_visibleCellCount++;
+        m_visibleInstanceCount += m_instanceCount[i];
+        if (!m_ranges.empty() && m_ranges.back().firstInstance + m_ranges.back().instanceCount == m_firstInstance[i]) {
+            m_ranges.back().instanceCount += m_instanceCount[i];
+        } else {
+            m_ranges.push_back({ m_firstInstance[i], m_instanceCount[i] });
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    m_lastCullMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "ShaderTypes.h"
+#include <simd/simd.h>
+#include <cstdint>
+#include <vector>
+
+// Host-side frustum culling of the grass cells, for devices or modes without the compute cull
+// pass. The cell bounds are kept in structure-of-arrays form (one array per AABB component,
+// padded to a multiple of eight with empty boxes) so the plane tests run on eight cells at a time:
+// per plane the corner furthest along the normal is picked once for the whole array (the normal
+// is the same for every cell), leaving three multiply-adds and a compare per cell with NEON, or
+// the scalar loop elsewhere. Visible cells become instance ranges, adjacent ones merged, which
+// the grass pass draws directly; 100k cells take a few tens of microseconds on one core.
+class CpuCellCuller {
+public:
+    struct Range {
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    CpuCellCuller();
+
+    // Copy the cell bounds into the SoA arrays (again whenever the field changes)
+    void setCells(const GrassCell* cells, uint32_t cellCount);
+    uint32_t getCellCount() const { return m_cellCount; }
+
+    // Keep the cells inside any of the views' frusta (6 inward planes per view, see
+    // extractFrustumPlanes() in Renderer.cpp) and list their instance ranges
+    void cull(const simd::float4* planes, uint32_t viewCount);
+
+    const std::vector<Range>& getVisibleRanges() const { return m_ranges; }
+    uint32_t getVisibleCellCount() const { return m_visibleCellCount; }
+    uint32_t getVisibleInstanceCount() const { return m_visibleInstanceCount; }
+    double getLastCullMs() const { return m_lastCullMs; }
+
+private:
+    static constexpr uint32_t kLanes = 8; // Cells per step (two NEON vectors)
+
+    void cullBlock(uint32_t first, const simd::float4* planes, uint32_t viewCount);
+
+    uint32_t m_cellCount;
+    std::vector<float> m_minX, m_minY, m_minZ; // Padded to a multiple of kLanes
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+    std::vector<uint32_t> m_firstInstance;
+    std::vector<uint32_t> m_instanceCount;
+    std::vector<uint8_t> m_visible;            // Per cell, written by cull()
+    std::vector<Range> m_ranges;
+    uint32_t m_visibleCellCount;
+    uint32_t m_visibleInstanceCount;
+    double m_lastCullMs;
+};
@@ -0,0 +1,414 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Compute shaders for GPU-driven grass culling
+// The cull pass compacts visible instance indices and fills the indirect draw arguments
+
+// Reset the per-bucket indirect draw arguments before culling (one thread per species and LOD
+// bucket; the first one also resets the impostor card draw)
+kernel void resetGrassDrawArguments(
+    device GrassDrawArguments *drawArgs [[buffer(CullBufferIndexDrawArguments)]],
+    constant CullUniforms &cull [[buffer(CullBufferIndexUniforms)]],
+    device GrassImpostorDrawArguments *impostorDrawArgs [[buffer(CullBufferIndexImpostorDrawArguments)]],
+    uint gid [[thread_position_in_grid]]
+) {
+    if (gid >= GRASS_DRAW_BUCKET_COUNT) {
+        return;
+    }
+    
+    if (gid == 0 && cull.impostorEnabled != 0) {
+        impostorDrawArgs->vertexCount = 4;
+        atomic_store_explicit(&impostorDrawArgs->instanceCount, 0u, memory_order_relaxed);
+        impostorDrawArgs->vertexStart = 0;
+        impostorDrawArgs->baseInstance = 0;
+    }
+
+    drawArgs[gid].indexCount = cull.bucketMeshes[gid].x;
+    atomic_store_explicit(&drawArgs[gid].instanceCount, 0u, memory_order_relaxed);
+    drawArgs[gid].indexStart = cull.bucketMeshes[gid].y;
+    drawArgs[gid].baseVertex = int(cull.bucketMeshes[gid].z);
+    // instance_id includes baseInstance, so each bucket reads its own region of the visible list
+    drawArgs[gid].baseInstance = gid * cull.bucketCapacity;
+}
+
+// Test an AABB against the six frustum planes (positive-vertex test)
+static bool boxInFrustum(float3 boxMin, float3 boxMax, constant float4 *planes) {
+    for (int i = 0; i < 6; ++i) {
+        float3 positive = select(boxMin, boxMax, planes[i].xyz >= 0.0);
+        if (dot(planes[i].xyz, positive) + planes[i].w < 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Views whose frustum holds the AABB (bit per view)
+static uint boxViewMask(float3 boxMin, float3 boxMax, constant CullUniforms &cull) {
+    uint mask = 0;
+    for (uint v = 0; v < cull.viewCount; ++v) {
+        if (boxInFrustum(boxMin, boxMax, cull.frustumPlanes + 6 * v)) {
+            mask |= 1u << v;
+        }
+    }
+    return mask;
+}
+
+// Hierarchical-Z occlusion test against the previous frame's depth pyramid.
+// Returns true when the box is definitely hidden behind already-rendered depth.
+static bool boxOccluded(float3 boxMin, float3 boxMax, constant CullUniforms &cull,
+                        texture2d<float, access::read> hiZ) {
+    // Project the 8 corners of the box
+    float3 ndcMin = float3(1e9);
+    float3 ndcMax = float3(-1e9);
+    for (uint i = 0; i < 8; ++i) {
+        float3 corner = float3((i & 1) ? boxMax.x : boxMin.x,
+                               (i & 2) ? boxMax.y : boxMin.y,
+                               (i & 4) ? boxMax.z : boxMin.z);
+        float4 clip = cull.prevViewProjection * float4(corner, 1.0);
+        if (clip.w <= 0.0) {
+            return false; // Crosses the camera plane: treat as visible
+        }
+        float3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    // Off-screen (in last frame's view): no depth information, keep it
+    if (any(ndcMax.xy < -1.0) || any(ndcMin.xy > 1.0)) {
+        return false;
+    }
+
+    // Screen-space rectangle in UV (texture Y points down)
+    float2 uvMin = saturate(float2(ndcMin.x * 0.5 + 0.5, 0.5 - ndcMax.y * 0.5));
+    float2 uvMax = saturate(float2(ndcMax.x * 0.5 + 0.5, 0.5 - ndcMin.y * 0.5));
+
+    // Last frame may have rendered only the top-left region of the depth target
+    uvMin *= cull.hiZUVScale;
+    uvMax *= cull.hiZUVScale;
+
+    // Pick the level where the rectangle spans at most 2x2 texels
+    float2 extent = (uvMax - uvMin) * cull.hiZSize;
+    float level = ceil(log2(max(max(extent.x, extent.y), 1.0)));
+    uint mip = min(uint(level), cull.hiZMipCount - 1);
+
+    uint2 levelSize = uint2(hiZ.get_width(mip), hiZ.get_height(mip));
+    uint2 texMin = min(uint2(uvMin * float2(levelSize)), levelSize - 1);
+    uint2 texMax = min(uint2(uvMax * float2(levelSize)), levelSize - 1);
+
+    float occluderDepth = max(max(hiZ.read(texMin, mip).r, hiZ.read(uint2(texMax.x, texMin.y), mip).r),
+                              max(hiZ.read(uint2(texMin.x, texMax.y), mip).r, hiZ.read(texMax, mip).r));
+
+    // Nearest depth of the object behind the farthest occluder depth => hidden
+    return ndcMin.z > occluderDepth;
+}
+
+// Trample strength range (min, max) over a world XZ rectangle from the summary pyramid.
+// Picks the level where the rectangle spans at most 2x2 summary texels; a summary texel covers a
+// storage block, i.e. a superset of the world texels asked for, so both bounds stay conservative.
+// Parts of the rectangle outside the window are untrampled.
+static float2 trampleRange(float2 xzMin, float2 xzMax, constant CullUniforms &cull,
+                           texture2d<float, access::read> summary) {
+    float2 windowMin = cull.trampleWindowMinXZ;
+    float2 windowMax = windowMin + cull.trampleWindowSize;
+    if (any(xzMax < windowMin) || any(xzMin >= windowMax)) {
+        return float2(0.0);
+    }
+    bool insideWindow = all(xzMin >= windowMin) && all(xzMax < windowMax);
+
+    // Clamped half a texel inside the window, so the border texels' blocks are the ones read
+    uint2 baseSize = uint2(summary.get_width(), summary.get_height());
+    float tilesPerMeter = trampleTexelsPerMeter(baseSize.x, cull.trampleWindowSize);
+    float halfTexel = 0.5 / (tilesPerMeter * float(TRAMPLE_SUMMARY_TILE));
+    float2 lo = max(xzMin, windowMin + halfTexel);
+    float2 hi = min(xzMax, windowMax - halfTexel);
+    float2 extent = (hi - lo) * tilesPerMeter;
+    uint mip = min(uint(ceil(log2(max(max(extent.x, extent.y), 1.0)))), cull.trampleSummaryMipCount - 1);
+
+    // World blocks of this level, stored at block mod level size like texels in the map
+    float blocksPerMeter = tilesPerMeter / float(1u << mip);
+    uint2 levelSize = uint2(summary.get_width(mip), summary.get_height(mip));
+    int2 blockMin = int2(floor(lo * blocksPerMeter));
+    int2 blockMax = int2(floor(hi * blocksPerMeter));
+    float2 a = summary.read(trampleStorageTexel(blockMin, levelSize), mip).rg;
+    float2 b = summary.read(trampleStorageTexel(int2(blockMax.x, blockMin.y), levelSize), mip).rg;
+    float2 c = summary.read(trampleStorageTexel(int2(blockMin.x, blockMax.y), levelSize), mip).rg;
+    float2 d = summary.read(trampleStorageTexel(blockMax, levelSize), mip).rg;
+    float earliest = min(min(a.x, b.x), min(c.x, d.x));
+    float latest = max(max(a.y, b.y), max(c.y, d.y));
+
+    float minStrength = insideWindow ? trampleStrength(earliest, cull.time, cull.trampleDecayRate) : 0.0;
+    return float2(minStrength, trampleStrength(latest, cull.time, cull.trampleDecayRate));
+}
+
+// Append an instance to the visible region of one species and LOD bucket
+static void appendVisible(device VisibleInstance *visibleInstances,
+                          device GrassDrawArguments *drawArgs,
+                          constant CullUniforms &cull,
+                          uint bucket, uint instanceID, float fade, uint viewMask) {
+    uint slot = atomic_fetch_add_explicit(&drawArgs[bucket].instanceCount, 1u, memory_order_relaxed);
+    VisibleInstance entry;
+    entry.instanceID = instanceID;
+    entry.lodFade = fade;
+    entry.viewMask = viewMask;
+    visibleInstances[bucket * cull.bucketCapacity + slot] = entry;
+}
+
+// Blades of the density LOD share that fade out past its end (as a fraction of the share)
+constant float kDensityLodFadeBand = 0.1;
+
+// Per-blade culling: density LOD, trample, frustum and Hi-Z test, LOD selection, append to the
+// compacted list of the blade's species and LOD. bladeFade scales every fade written (the cell's blades fading into its
+// impostor card); densityRank is the blade's position in its cell's progressive order (0..1).
+// The blade is tested against the frustums of cellViewMask's views only (the ones holding its
+// cell) and listed once for all of them: its mask tells each view's draw whether to keep it, and
+// its LODs follow the nearest camera.
+static void cullInstance(uint instanceID,
+                         const device InstanceData *instances,
+                         device VisibleInstance *visibleInstances,
+                         device GrassDrawArguments *drawArgs,
+                         constant CullUniforms &cull,
+                         texture2d<float, access::read> hiZ,
+                         texture2d<float, access::read> trampleMap,
+                         bool sampleTrample,
+                         float bladeFade,
+                         float densityRank,
+                         uint cellViewMask) {
+    // Blade center (the vertex shader bends around this point, so the sphere stays conservative)
+    InstanceData instance = instances[instanceID];
+    float3 center = instancePosition(instance, cull.fieldMinXZ, cull.fieldMaxXZ);
+    uint species = instanceSpecies(instance);
+    uint gid = instanceID;
+    float dist = nearestViewDistance(center, cull.viewCameraPositions, cull.viewCount);
+
+    // Density LOD: every prefix of a cell is evenly spread, so far blades keep only the share of
+    // their distance; the last ones of the share fade (the vertex shader widens the survivors)
+    float densityFraction = grassDensityLodFraction(dist, cull.densityLodDistance);
+    float densityEnd = densityFraction * (1.0 + kDensityLodFadeBand);
+    if (densityRank >= densityEnd) {
+        return;
+    }
+    bladeFade *= saturate((densityEnd - densityRank) / (densityFraction * kDensityLodFadeBand));
+
+    // Fully trampled blades would be flattened to nothing: drop them before rasterization
+    // (skipped when the cell's summary shows nothing in it is trampled that hard)
+    if (sampleTrample) {
+        float trample = trampleAt(trampleMap, center.xz, cull.trampleWindowMinXZ, cull.trampleWindowSize,
+                                  cull.time, cull.trampleDecayRate);
+        if (trample >= TRAMPLE_CULL_THRESHOLD) {
+            return;
+        }
+    }
+
+    // Widened by the density LOD like the vertex shader does
+    float bladeRadius = grassDensityLodRadius(cull.bladeRadius, densityFraction);
+    uint viewMask = 0;
+    for (uint v = 0; v < cull.viewCount; ++v) {
+        if ((cellViewMask & (1u << v)) != 0 && sphereInFrustum(center, bladeRadius, cull.frustumPlanes + 6 * v)) {
+            viewMask |= 1u << v;
+        }
+    }
+    if (viewMask == 0) {
+        return;
+    }
+
+    // Occlusion test against last frame's Hi-Z (ball, terrain and near grass)
+    float3 extent = float3(bladeRadius);
+    if (cull.hiZEnabled != 0 && boxOccluded(center - extent, center + extent, cull, hiZ)) {
+        return;
+    }
+
+    // ============================================================
+    // LOD SELECTION WITH CROSSFADE
+    // ============================================================
+    // Inside a fade band around a LOD distance the blade goes into both buckets:
+    // the near LOD fades out while the far LOD fades in (alpha-to-coverage dithers the pair)
+    float halfBand = cull.lodFadeWidth * 0.5;
+
+    uint lod = 0;
+    for (uint i = 0; i < GRASS_LOD_COUNT - 1; ++i) {
+        float boundary = cull.lodDistances[i];
+        if (dist < boundary - halfBand) {
+            break;
+        }
+        if (dist < boundary + halfBand) {
+            float fadeIn = saturate((dist - (boundary - halfBand)) / max(cull.lodFadeWidth, 1e-4));
+            appendVisible(visibleInstances, drawArgs, cull, grassDrawBucket(species, i), gid, (1.0 - fadeIn) * bladeFade, viewMask);
+            appendVisible(visibleInstances, drawArgs, cull, grassDrawBucket(species, i + 1), gid, fadeIn * bladeFade, viewMask);
+            return;
+        }
+        lod = i + 1;
+    }
+
+    appendVisible(visibleInstances, drawArgs, cull, grassDrawBucket(species, lod), gid, bladeFade, viewMask);
+}
+
+// Argument buffer wrapping the grass indirect command buffer (one command per bucket)
+struct GrassCommandBufferContainer {
+    command_buffer commands [[id(0)]];
+};
+
+// Turn the per-bucket draw arguments written by the cull pass into indirect render commands.
+// The commands inherit pipeline state and buffers from the render encoder that executes them.
+kernel void encodeGrassDrawCommands(
+    device GrassCommandBufferContainer &container [[buffer(CullBufferIndexGrassCommands)]],
+    device GrassDrawArguments *drawArgs [[buffer(CullBufferIndexDrawArguments)]],
+    const device ushort *indices [[buffer(CullBufferIndexGrassIndices)]],
+    uint gid [[thread_position_in_grid]]
+) {
+    if (gid >= GRASS_DRAW_BUCKET_COUNT) {
+        return;
+    }
+
+    render_command command(container.commands, gid);
+    uint instanceCount = atomic_load_explicit(&drawArgs[gid].instanceCount, memory_order_relaxed);
+    if (instanceCount == 0) {
+        command.reset();
+        return;
+    }
+
+    command.draw_indexed_primitives(primitive_type::triangle,
+                                    drawArgs[gid].indexCount,
+                                    indices + drawArgs[gid].indexStart,
+                                    instanceCount,
+                                    drawArgs[gid].baseVertex,
+                                    drawArgs[gid].baseInstance);
+}
+
+// Order the cells front to back for the cull pass: one threadgroup, one thread per cell, a bitonic
+// sort of (distance of the cell center to the nearest camera, cell index) in threadgroup memory.
+// Threadgroups of a dispatch start in index order, so blades of near cells are mostly appended to
+// their buckets first, drawn first, and fill the depth buffer before the far blades they cover.
+// Empty cells sort last.
+kernel void sortGrassCellsByDistance(
+    const device GrassCell *cells [[buffer(CullBufferIndexCells)]],
+    constant CullUniforms &cull [[buffer(CullBufferIndexUniforms)]],
+    device uint *cellOrder [[buffer(CullBufferIndexCellOrder)]],
+    uint tid [[thread_index_in_threadgroup]]
+) {
+    threadgroup float keys[GRASS_CELL_SORT_CAPACITY];
+    threadgroup uint indices[GRASS_CELL_SORT_CAPACITY];
+
+    float key = INFINITY;
+    if (tid < cull.cellCount && cells[tid].instanceCount > 0) {
+        float3 center = (cells[tid].boundsMin.xyz + cells[tid].boundsMax.xyz) * 0.5;
+        key = nearestViewDistance(center, cull.viewCameraPositions, cull.viewCount);
+    }
+    keys[tid] = key;
+    indices[tid] = tid;
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (uint size = 2; size <= GRASS_CELL_SORT_CAPACITY; size <<= 1) {
+        for (uint stride = size >> 1; stride > 0; stride >>= 1) {
+            uint partner = tid ^ stride;
+            if (partner > tid) {
+                bool ascending = (tid & size) == 0;
+                float a = keys[tid];
+                float b = keys[partner];
+                uint ia = indices[tid];
+                uint ib = indices[partner];
+                bool swap = ascending ? (a > b || (a == b && ia > ib)) : (a < b || (a == b && ia < ib));
+                if (swap) {
+                    keys[tid] = b;
+                    keys[partner] = a;
+                    indices[tid] = ib;
+                    indices[partner] = ia;
+                }
+            }
+            threadgroup_barrier(mem_flags::mem_threadgroup);
+        }
+    }
+
+    if (tid < cull.cellCount) {
+        cellOrder[tid] = indices[tid];
+    }
+}
+
+// One threadgroup per grid cell: cull the whole cell first, then its blades.
+// Instances are sorted by cell, so each cell reads one contiguous range.
+kernel void cullGrassInstances(
+    const device InstanceData *instances [[buffer(CullBufferIndexInstances)]],
+    device VisibleInstance *visibleInstances [[buffer(CullBufferIndexVisibleInstances)]],
+    device GrassDrawArguments *drawArgs [[buffer(CullBufferIndexDrawArguments)]],
+    constant CullUniforms &cull [[buffer(CullBufferIndexUniforms)]],
+    const device GrassCell *cells [[buffer(CullBufferIndexCells)]],
+    device GrassImpostor *impostors [[buffer(CullBufferIndexImpostors)]],
+    device GrassImpostorDrawArguments *impostorDrawArgs [[buffer(CullBufferIndexImpostorDrawArguments)]],
+    texture2d<float, access::read> hiZ [[texture(CullTextureIndexHiZ)]],
+    texture2d<float, access::read> trampleMap [[texture(CullTextureIndexTrampleMap)]],
+    texture2d<float, access::read> trampleSummary [[texture(CullTextureIndexTrampleSummary)]],
+    const device uint *cellOrder [[buffer(CullBufferIndexCellOrder)]],
+    uint groupIndex [[threadgroup_position_in_grid]],
+    uint tid [[thread_index_in_threadgroup]],
+    uint threadsPerGroup [[threads_per_threadgroup]]
+) {
+    // Check bounds
+    if (groupIndex >= cull.cellCount) {
+        return;
+    }
+    uint cellIndex = cull.cellOrderEnabled != 0 ? cellOrder[groupIndex] : groupIndex;
+
+    GrassCell cell = cells[cellIndex];
+    if (cell.instanceCount == 0) {
+        return;
+    }
+
+    // Whole-cell rejection against the union of the views' frustums (uniform across the threadgroup)
+    float3 boxMin = cell.boundsMin.xyz;
+    float3 boxMax = cell.boundsMax.xyz;
+    uint cellViewMask = boxViewMask(boxMin, boxMax, cull);
+    if (cellViewMask == 0) {
+        return;
+    }
+
+    // Whole-cell trample test: a cell flattened everywhere is dropped, and blades are only
+    // sampled when some part of the cell is trampled past the cull threshold
+    bool sampleTrample = true;
+    if (cull.trampleSummaryEnabled != 0) {
+        float2 strength = trampleRange(boxMin.xz, boxMax.xz, cull, trampleSummary);
+        if (strength.x >= TRAMPLE_CULL_THRESHOLD) {
+            return;
+        }
+        sampleTrample = strength.y >= TRAMPLE_CULL_THRESHOLD;
+    }
+
+    if (cull.hiZEnabled != 0 && boxOccluded(boxMin, boxMax, cull, hiZ)) {
+        return;
+    }
+
+    // Far field: the cell's impostor card fades in over the band while its blades fade out,
+    // and past the band the blades are not visited at all (a fixed cost per cell)
+    float impostorFade = 0.0;
+    if (cull.impostorEnabled != 0) {
+        float3 center = (boxMin + boxMax) * 0.5;
+        float bandStart = cull.impostorDistance - cull.impostorFadeWidth * 0.5;
+        float centerDist = nearestViewDistance(center, cull.viewCameraPositions, cull.viewCount);
+        impostorFade = saturate((centerDist - bandStart) / max(cull.impostorFadeWidth, 1e-4));
+        if (impostorFade > 0.0 && tid == 0) {
+            uint slot = atomic_fetch_add_explicit(&impostorDrawArgs->instanceCount, 1u, memory_order_relaxed);
+            impostors[slot].centerFade = float4(center, impostorFade);
+        }
+        if (impostorFade >= 1.0) {
+            return;
+        }
+    }
+    if (cull.impostorsOnly != 0) {
+        return;
+    }
+
+    // Per-blade culling over the cell's contiguous instance range, up to the density LOD share the
+    // cell's nearest point can keep (for the nearest camera)
+    float nearestDist = INFINITY;
+    for (uint v = 0; v < cull.viewCount; ++v) {
+        float3 camera = cull.viewCameraPositions[v].xyz;
+        nearestDist = min(nearestDist, distance(clamp(camera, boxMin, boxMax), camera));
+    }
+    float visitShare = grassDensityLodFraction(nearestDist, cull.densityLodDistance) * (1.0 + kDensityLodFadeBand);
+    uint visitCount = min(cell.instanceCount, uint(ceil(visitShare * float(cell.instanceCount))));
+    float rankScale = 1.0 / float(cell.instanceCount);
+    for (uint i = tid; i < visitCount; i += threadsPerGroup) {
+        cullInstance(cell.firstInstance + i, instances, visibleInstances, drawArgs, cull, hiZ, trampleMap, sampleTrample,
+                     1.0 - impostorFade, (float(i) + 0.5) * rankScale, cellViewMask);
+    }
+}
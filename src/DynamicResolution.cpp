@@ -0,0 +1,301 @@
+#include "DynamicResolution.hpp"
+#include "RenderTargetHeap.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Radical inverse of index in the given base (Halton sequence, values in [0, 1))
+static float halton(uint32_t index, uint32_t base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0) {
+        fraction /= static_cast<float>(base);
+        result += fraction * static_cast<float>(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+DynamicResolution::DynamicResolution(MTL::Device* device, RenderTargetHeap* heap)
+    : m_device(device)
+    , m_heap(heap)
+    , m_scaler(nullptr)
+    , m_temporalScaler(nullptr)
+    , m_colorTexture(nullptr)
+    , m_motionTexture(nullptr)
+    , m_outputWidth(0)
+    , m_outputHeight(0)
+    , m_renderWidth(0)
+    , m_renderHeight(0)
+    , m_scale(kMaxScale)
+    , m_fixedScale(0.0f)
+    , m_scaleLimit(kMaxScale)
+    , m_targetFrameMs(1000.0f / 60.0f)
+    , m_filteredGpuMs(0.0)
+    , m_enabled(false)
+    , m_temporalSupported(MTLFX::TemporalScalerDescriptor::supportsDevice(device))
+    , m_temporal(false)
+    , m_resetHistory(true)
+    , m_jitterIndex(0)
+    , m_jitter(simd::make_float2(0.0f, 0.0f))
+{
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    if (m_scaler) {
+        m_scaler->release();
+    }
+    if (m_temporalScaler) {
+        m_temporalScaler->release();
+    }
+    if (m_colorTexture) {
+        m_colorTexture->release();
+    }
+    if (m_motionTexture) {
+        m_motionTexture->release();
+    }
+}
+
+bool DynamicResolution::isSupported(MTL::Device* device)
+{
+    return MTLFX::SpatialScalerDescriptor::supportsDevice(device);
+}
+
+void DynamicResolution::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    // Start from native resolution (or the pinned scale) and let the controller settle again
+    m_scale = m_fixedScale > 0.0f ? m_fixedScale : kMaxScale;
+    m_filteredGpuMs = 0.0;
+    updateRenderSize();
+}
+
+void DynamicResolution::setFixedScale(float scale)
+{
+    m_fixedScale = scale > 0.0f ? std::clamp(scale, kMinScale, kMaxScale) : 0.0f;
+    m_scale = m_fixedScale > 0.0f ? m_fixedScale : kMaxScale;
+    m_filteredGpuMs = 0.0;
+    updateRenderSize();
+}
+
+void DynamicResolution::setScaleLimit(float limit)
+{
+    limit = std::clamp(limit, kMinScale, kMaxScale);
+    if (limit != m_scaleLimit) {
+        m_scaleLimit = limit;
+        updateRenderSize();
+    }
+}
+
+void DynamicResolution::setTemporal(bool temporal)
+{
+    m_temporal = temporal;
+    // The history belongs to the other mode's frames
+    m_resetHistory = true;
+    m_jitterIndex = 0;
+}
+
+MTL::TextureUsage DynamicResolution::getOutputUsage() const
+{
+    MTL::TextureUsage usage = m_scaler ? m_scaler->outputTextureUsage() : MTL::TextureUsageUnknown;
+    if (m_temporalScaler) {
+        usage |= m_temporalScaler->outputTextureUsage();
+    }
+    return usage;
+}
+
+MTL::TextureUsage DynamicResolution::getDepthUsage() const
+{
+    return m_temporalScaler ? m_temporalScaler->depthTextureUsage() : MTL::TextureUsageUnknown;
+}
+
+void DynamicResolution::resize(NS::UInteger outputWidth, NS::UInteger outputHeight)
+{
+    if (m_scaler) {
+        m_scaler->release();
+        m_scaler = nullptr;
+    }
+    if (m_temporalScaler) {
+        m_temporalScaler->release();
+        m_temporalScaler = nullptr;
+    }
+    if (m_colorTexture) {
+        m_colorTexture->release();
+        m_colorTexture = nullptr;
+    }
+    if (m_motionTexture) {
+        m_motionTexture->release();
+        m_motionTexture = nullptr;
+    }
+
+    m_outputWidth = outputWidth;
+    m_resetHistory = true;
+    m_outputHeight = outputHeight;
+    if (outputWidth == 0 || outputHeight == 0) {
+        return;
+    }
+
+    // Input is allocated at the output size; the per-frame region is set as the content size
+    MTLFX::SpatialScalerDescriptor* descriptor = MTLFX::SpatialScalerDescriptor::alloc()->init();
+    descriptor->setInputWidth(outputWidth);
+    descriptor->setInputHeight(outputHeight);
+    descriptor->setOutputWidth(outputWidth);
+    descriptor->setOutputHeight(outputHeight);
+    descriptor->setColorTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    descriptor->setOutputTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    descriptor->setColorProcessingMode(MTLFX::SpatialScalerColorProcessingModePerceptual); // Tone-mapped LDR input
+
+    m_scaler = descriptor->newSpatialScaler(m_device);
+    descriptor->release();
+
+    if (!m_scaler) {
+        std::cerr << "Failed to create MetalFX spatial scaler" << std::endl;
+        return;
+    }
+
+    if (m_temporalSupported) {
+        createTemporalScaler();
+    }
+
+    MTL::TextureDescriptor* colorDescriptor = MTL::TextureDescriptor::alloc()->init();
+    colorDescriptor->setWidth(outputWidth);
+    colorDescriptor->setHeight(outputHeight);
+    colorDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    colorDescriptor->setTextureType(MTL::TextureType2D);
+    colorDescriptor->setUsage(MTL::TextureUsageRenderTarget | m_scaler->colorTextureUsage() |
+                              (m_temporalScaler ? m_temporalScaler->colorTextureUsage() : MTL::TextureUsageUnknown));
+
+    m_colorTexture = m_heap->newTexture(colorDescriptor);
+    colorDescriptor->release();
+
+    if (!m_colorTexture) {
+        std::cerr << "Failed to create dynamic resolution color target" << std::endl;
+        m_scaler->release();
+        m_scaler = nullptr;
+        return;
+    }
+
+    if (m_temporalScaler) {
+        MTL::TextureDescriptor* motionDescriptor = MTL::TextureDescriptor::alloc()->init();
+        motionDescriptor->setWidth(outputWidth);
+        motionDescriptor->setHeight(outputHeight);
+        motionDescriptor->setPixelFormat(kMotionFormat);
+        motionDescriptor->setTextureType(MTL::TextureType2D);
+        motionDescriptor->setUsage(MTL::TextureUsageRenderTarget | m_temporalScaler->motionTextureUsage());
+
+        m_motionTexture = m_heap->newTexture(motionDescriptor);
+        motionDescriptor->release();
+
+        if (!m_motionTexture) {
+            std::cerr << "Failed to create motion vector target" << std::endl;
+        }
+    }
+
+    updateRenderSize();
+}
+
+void DynamicResolution::createTemporalScaler()
+{
+    // Same output-sized input with a per-frame content region as the spatial scaler
+    MTLFX::TemporalScalerDescriptor* descriptor = MTLFX::TemporalScalerDescriptor::alloc()->init();
+    descriptor->setInputWidth(m_outputWidth);
+    descriptor->setInputHeight(m_outputHeight);
+    descriptor->setOutputWidth(m_outputWidth);
+    descriptor->setOutputHeight(m_outputHeight);
+    descriptor->setColorTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    descriptor->setDepthTextureFormat(MTL::PixelFormatDepth32Float);
+    descriptor->setMotionTextureFormat(kMotionFormat);
+    descriptor->setOutputTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    descriptor->setInputContentPropertiesEnabled(true);
+    descriptor->setInputContentMinScale(kMinScale);
+    descriptor->setInputContentMaxScale(kMaxScale);
+
+    m_temporalScaler = descriptor->newTemporalScaler(m_device);
+    descriptor->release();
+
+    if (!m_temporalScaler) {
+        std::cerr << "Failed to create MetalFX temporal scaler" << std::endl;
+    }
+}
+
+void DynamicResolution::update(double gpuFrameMs)
+{
+    if (!isEnabled() || m_fixedScale > 0.0f || gpuFrameMs <= 0.0) {
+        return;
+    }
+
+    // Smooth the per-frame noise, then move toward the scale that would hit the budget.
+    // GPU cost is roughly proportional to pixel count, i.e. to scale squared.
+    m_filteredGpuMs = (m_filteredGpuMs <= 0.0) ? gpuFrameMs : m_filteredGpuMs * 0.9 + gpuFrameMs * 0.1;
+    double error = (m_targetFrameMs - m_filteredGpuMs) / m_targetFrameMs;
+    if (std::abs(error) < kDeadband) {
+        return;
+    }
+
+    float desired = m_scale * static_cast<float>(std::sqrt(m_targetFrameMs / m_filteredGpuMs));
+    m_scale = std::clamp(m_scale + (desired - m_scale) * kAdjustRate, kMinScale, m_scaleLimit);
+    updateRenderSize();
+}
+
+void DynamicResolution::updateRenderSize()
+{
+    // Aligned so the region does not change on every tiny scale step
+    auto scaled = [this](NS::UInteger size) {
+        NS::UInteger value = static_cast<NS::UInteger>(static_cast<float>(size) * (isScaling() ? getScale() : kMaxScale));
+        value = (value + kSizeAlignment - 1) / kSizeAlignment * kSizeAlignment;
+        return std::clamp<NS::UInteger>(value, 1, size);
+    };
+    m_renderWidth = scaled(m_outputWidth);
+    m_renderHeight = scaled(m_outputHeight);
+}
+
+simd::float2 DynamicResolution::nextJitter()
+{
+    if (!isTemporal() || m_outputWidth == 0) {
+        m_jitter = simd::make_float2(0.0f, 0.0f);
+        return m_jitter;
+    }
+
+    // Halton(2, 3) over a cycle long enough that a render pixel still covers every output pixel
+    float scale = static_cast<float>(m_renderWidth) / static_cast<float>(m_outputWidth);
+    uint32_t phases = static_cast<uint32_t>(std::ceil(kJitterPhasesNative / (scale * scale)));
+    m_jitterIndex = m_jitterIndex % phases + 1; // Index 0 would be the unjittered (0, 0)
+    m_jitter = simd::make_float2(halton(m_jitterIndex, 2) - 0.5f, halton(m_jitterIndex, 3) - 0.5f);
+    return m_jitter;
+}
+
+void DynamicResolution::encodeUpscale(MTL::CommandBuffer* commandBuffer, MTL::Texture* depthTexture, MTL::Texture* output)
+{
+    if (!m_scaler || !m_colorTexture || !output) {
+        return;
+    }
+
+    if (isTemporal()) {
+        if (!depthTexture) {
+            return;
+        }
+        m_temporalScaler->setInputContentWidth(m_renderWidth);
+        m_temporalScaler->setInputContentHeight(m_renderHeight);
+        m_temporalScaler->setColorTexture(m_colorTexture);
+        m_temporalScaler->setDepthTexture(depthTexture);
+        m_temporalScaler->setMotionTexture(m_motionTexture);
+        m_temporalScaler->setOutputTexture(output);
+        m_temporalScaler->setJitterOffsetX(m_jitter.x);
+        m_temporalScaler->setJitterOffsetY(m_jitter.y);
+        // Motion vectors are written in UV units of the render region
+        m_temporalScaler->setMotionVectorScaleX(static_cast<float>(m_renderWidth));
+        m_temporalScaler->setMotionVectorScaleY(static_cast<float>(m_renderHeight));
+        m_temporalScaler->setReset(m_resetHistory);
+        m_temporalScaler->encodeToCommandBuffer(commandBuffer);
+        m_resetHistory = false;
+        return;
+    }
+
+    m_scaler->setInputContentWidth(m_renderWidth);
+    m_scaler->setInputContentHeight(m_renderHeight);
+    m_scaler->setColorTexture(m_colorTexture);
+    m_scaler->setOutputTexture(output);
+    m_scaler->encodeToCommandBuffer(commandBuffer);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <MetalFX/MetalFX.hpp>
+#include <simd/simd.h>
+#include <algorithm>
+#include <cstdint>
+
+class RenderTargetHeap;
+
+// Dynamic resolution: the scene renders into the top-left region of an output-sized color
+// target, the region shrinks or grows each frame to hold the GPU frame time at a budget, and
+// MTLFX::SpatialScaler upscales the region to the output texture.
+// Temporal mode replaces the spatial scaler with MTLFX::TemporalScaler: the scene is rendered
+// without MSAA through a subpixel-jittered projection and also writes depth and motion vectors,
+// and the scaler accumulates the jittered frames (antialiasing even at a scale of 1).
+class DynamicResolution {
+public:
+    static constexpr MTL::PixelFormat kMotionFormat = MTL::PixelFormatRG16Float;
+
+    DynamicResolution(MTL::Device* device, RenderTargetHeap* heap);
+    ~DynamicResolution();
+
+    static bool isSupported(MTL::Device* device);
+
+    // Recreate the scalers and internal targets for a new output size
+    void resize(NS::UInteger outputWidth, NS::UInteger outputHeight);
+
+    // Feed the latest resolved GPU frame time; adjusts the render scale toward the budget
+    void update(double gpuFrameMs);
+
+    // Advance the jitter sequence; returns this frame's offset in render pixels (y down, zero unless temporal)
+    simd::float2 nextJitter();
+
+    // Upscale the current region of getColorTexture() into output (temporal mode also reads depth and motion)
+    void encodeUpscale(MTL::CommandBuffer* commandBuffer, MTL::Texture* depthTexture, MTL::Texture* output);
+
+    bool isEnabled() const { return m_enabled && m_scaler; }
+    void setEnabled(bool enabled);
+    bool isTemporalAvailable() const { return m_temporalScaler && m_motionTexture; }
+    bool isTemporal() const { return m_temporal && isTemporalAvailable(); }
+    void setTemporal(bool temporal);
+    void resetHistory() { m_resetHistory = true; } // Camera cut: the next temporal upscale starts over
+    bool isActive() const { return isScaling() || isTemporal(); } // Scene renders into getColorTexture()
+    bool isScaling() const { return (m_enabled || m_scaleLimit < kMaxScale) && m_scaler; } // Region below native
+    float getTargetFrameMs() const { return m_targetFrameMs; }
+    void setTargetFrameMs(float targetFrameMs) { m_targetFrameMs = targetFrameMs; }
+    float getScale() const { return std::min(m_scale, m_scaleLimit); }
+    // Pin the scale (clamped to the scaler's range) instead of following the budget; 0 = adaptive
+    void setFixedScale(float scale);
+    float getFixedScale() const { return m_fixedScale; }
+    // Ceiling on the scale whatever the mode (the quality governor); below 1 it scales even when disabled
+    void setScaleLimit(float limit);
+    float getScaleLimit() const { return m_scaleLimit; }
+    NS::UInteger getRenderWidth() const { return m_renderWidth; }
+    NS::UInteger getRenderHeight() const { return m_renderHeight; }
+    MTL::Texture* getColorTexture() const { return m_colorTexture; }
+    MTL::Texture* getMotionTexture() const { return m_motionTexture; }
+    MTL::TextureUsage getOutputUsage() const; // Usage the output texture needs
+    MTL::TextureUsage getDepthUsage() const;  // Usage the temporal scaler's depth input needs
+
+private:
+    static constexpr float kMinScale = 0.5f;
+    static constexpr float kMaxScale = 1.0f;
+    static constexpr float kDeadband = 0.05f;       // Ignore budget errors below 5%
+    static constexpr float kAdjustRate = 0.1f;      // Fraction of the correction applied per frame
+    static constexpr NS::UInteger kSizeAlignment = 8;
+    static constexpr float kJitterPhasesNative = 8.0f; // Jitter sequence length at scale 1 (grows as 1 / scale^2)
+
+    void updateRenderSize();
+    void createTemporalScaler();
+
+    MTL::Device* m_device;
+    RenderTargetHeap* m_heap;
+    MTLFX::SpatialScaler* m_scaler;
+    MTLFX::TemporalScaler* m_temporalScaler; // Null when the device has no temporal scaler
+    MTL::Texture* m_colorTexture;   // Scaler input, output-sized; only the render region is valid
+    MTL::Texture* m_motionTexture;  // Temporal input: per-pixel motion in render-UV units
+    NS::UInteger m_outputWidth;
+    NS::UInteger m_outputHeight;
+    NS::UInteger m_renderWidth;
+    NS::UInteger m_renderHeight;
+    float m_scale;
+    float m_fixedScale;             // > 0: the controller is off and the scale stays here
+    float m_scaleLimit;             // Ceiling on m_scale (kMaxScale = none)
+    float m_targetFrameMs;
+    double m_filteredGpuMs;
+    bool m_enabled;
+    bool m_temporalSupported;
+    bool m_temporal;
+    bool m_resetHistory;            // Next temporal upscale discards the accumulated history
+    uint32_t m_jitterIndex;
+    simd::float2 m_jitter;          // Offset the current frame was rendered with
+};
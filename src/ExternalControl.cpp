@@ -0,0 +1,197 @@
+#include "ExternalControl.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t roundToPages(size_t bytes)
+{
+    size_t page = static_cast<size_t>(getpagesize());
+    return (bytes + page - 1) / page * page;
+}
+
+ExternalControl::ExternalControl(const std::string& name, MTL::Device* device)
+    : m_name(name)
+    , m_device(device)
+    , m_fd(-1)
+    , m_mapping(nullptr)
+    , m_mappingBytes(0)
+    , m_header(nullptr)
+    , m_nextRead(0)
+    , m_current(kNone)
+{
+    for (uint32_t i = 0; i < kSlotCount; ++i) {
+        m_slotBuffers[i] = nullptr;
+    }
+    for (int i = 0; i < kMaxHolders; ++i) {
+        m_held[i] = kNone;
+    }
+
+    // The layout is fixed at compile time, so both sides know the size without reading the header
+    m_mappingBytes = roundToPages(sizeof(ExternalControlHeader)) + kSlotCount * roundToPages(sizeof(ExternalControlFrame));
+    m_fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    bool created = m_fd >= 0;
+    if (!created && errno == EEXIST) {
+        m_fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (m_fd < 0) {
+        std::cerr << "External control: cannot open shared memory " << name << " (" << std::strerror(errno) << ")" << std::endl;
+        return;
+    }
+    if (!mapObject(created)) {
+        return;
+    }
+
+    if (m_device) {
+        // Page-aligned, whole pages: every slot can back a buffer without a copy
+        size_t slotBytes = roundToPages(sizeof(ExternalControlFrame));
+        for (uint32_t i = 0; i < kSlotCount; ++i) {
+            m_slotBuffers[i] = m_device->newBuffer(slot(i), slotBytes, MTL::ResourceStorageModeShared, nullptr);
+            if (!m_slotBuffers[i]) {
+                std::cerr << "External control: failed to wrap slot " << i << " in a buffer" << std::endl;
+            }
+        }
+        // Frames published before the renderer attached are stale: start from the next one
+        uint64_t head = m_header->head.load(std::memory_order_acquire);
+        m_nextRead = head;
+        m_header->tail.store(head, std::memory_order_release);
+    }
+    std::cout << "External control: " << (created ? "created " : "attached to ") << name << std::endl;
+}
+
+ExternalControl::~ExternalControl()
+{
+    for (uint32_t i = 0; i < kSlotCount; ++i) {
+        if (m_slotBuffers[i]) {
+            m_slotBuffers[i]->release();
+        }
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingBytes);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool ExternalControl::mapObject(bool create)
+{
+    if (create && ftruncate(m_fd, static_cast<off_t>(m_mappingBytes)) != 0) {
+        std::cerr << "External control: cannot size " << m_name << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    struct stat info = {};
+    if (!create && (fstat(m_fd, &info) != 0 || static_cast<size_t>(info.st_size) < m_mappingBytes)) {
+        std::cerr << "External control: " << m_name << " is not a channel of this layout (or is still being created)" << std::endl;
+        return false;
+    }
+    void* mapping = mmap(nullptr, m_mappingBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "External control: cannot map " << m_name << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    m_mapping = mapping;
+
+    ExternalControlHeader* header = static_cast<ExternalControlHeader*>(mapping);
+    if (create) {
+        // Fresh pages are zero: the counters start at 0; the magic publishes the rest
+        header = new (mapping) ExternalControlHeader();
+        header->version = ExternalControlHeader::kVersion;
+        header->slotCount = kSlotCount;
+        header->slotBytes = static_cast<uint32_t>(roundToPages(sizeof(ExternalControlFrame)));
+        header->magic.store(ExternalControlHeader::kMagic, std::memory_order_release);
+    } else if (header->magic.load(std::memory_order_acquire) == ExternalControlHeader::kMagic &&
+               (header->version != ExternalControlHeader::kVersion || header->slotCount != kSlotCount ||
+                header->slotBytes != roundToPages(sizeof(ExternalControlFrame)))) {
+        std::cerr << "External control: " << m_name << " has another layout (version " << header->version << ")" << std::endl;
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+ExternalControlFrame* ExternalControl::slot(uint64_t sequence) const
+{
+    uint8_t* slots = static_cast<uint8_t*>(m_mapping) + roundToPages(sizeof(ExternalControlHeader));
+    return reinterpret_cast<ExternalControlFrame*>(slots + (sequence % kSlotCount) * roundToPages(sizeof(ExternalControlFrame)));
+}
+
+ExternalControlFrame* ExternalControl::beginFrame()
+{
+    if (!m_header || m_header->magic.load(std::memory_order_acquire) != ExternalControlHeader::kMagic) {
+        return nullptr;
+    }
+    uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    if (head - m_header->tail.load(std::memory_order_acquire) >= kSlotCount) {
+        return nullptr;
+    }
+    return slot(head);
+}
+
+void ExternalControl::publish()
+{
+    if (m_header) {
+        m_header->head.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void ExternalControl::sanitize(ExternalControlFrame* frame)
+{
+    // fmax before fmin: a NaN radius ends up at the minimum
+    auto clampRadius = [](float value, float lo) {
+        return std::fmin(std::fmax(value, lo), INTERACTOR_MAX_RADIUS);
+    };
+    frame->interactorCount = std::clamp<uint32_t>(frame->interactorCount, 1, MAX_INTERACTORS);
+    for (uint32_t i = 0; i < frame->interactorCount; ++i) {
+        Interactor& interactor = frame->interactors[i];
+        interactor.radius = clampRadius(interactor.radius, INTERACTOR_MIN_RADIUS);
+        interactor.falloff = clampRadius(interactor.falloff, 0.0f);
+        interactor.bodyRadius = clampRadius(interactor.bodyRadius, INTERACTOR_MIN_RADIUS);
+        interactor.halfHeight = clampRadius(interactor.halfHeight, 0.0f);
+    }
+    frame->gustCount = std::min<uint32_t>(frame->gustCount, WIND_MAX_GUSTS);
+}
+
+bool ExternalControl::poll(int frameSlot, const ExternalControlFrame*& frame, MTL::Buffer*& buffer, bool& fresh)
+{
+    fresh = false;
+    if (!m_header || frameSlot < 0 || frameSlot >= kMaxHolders ||
+        m_header->magic.load(std::memory_order_acquire) != ExternalControlHeader::kMagic) {
+        return false;
+    }
+
+    // frameSlot's previous frame completed: whatever it drew from may be rewritten
+    m_held[frameSlot] = kNone;
+
+    // Newest published frame; the ones in between are skipped
+    uint64_t head = m_header->head.load(std::memory_order_acquire);
+    if (head > m_nextRead) {
+        m_current = head - 1;
+        m_nextRead = head;
+        fresh = true;
+        sanitize(slot(m_current)); // Published: the producer no longer writes it
+    }
+    if (m_current == kNone) {
+        return false;
+    }
+    m_held[frameSlot] = m_current;
+
+    // Everything below the oldest held frame goes back to the producer
+    uint64_t tail = m_nextRead;
+    for (int i = 0; i < kMaxHolders; ++i) {
+        if (m_held[i] != kNone && m_held[i] < tail) {
+            tail = m_held[i];
+        }
+    }
+    m_header->tail.store(tail, std::memory_order_release);
+
+    frame = slot(m_current);
+    buffer = m_slotBuffers[m_current % kSlotCount];
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "ShaderTypes.h"
+
+// Interactors and wind gusts written by another process (gameplay, a simulation) for one frame.
+// The interactor array comes first and in the GPU layout: the renderer draws straight from the
+// shared memory, so a frame is never serialized or copied on either side.
+struct ExternalControlFrame {
+    Interactor interactors[MAX_INTERACTORS];
+    uint32_t interactorCount;       // First interactorCount entries are used (at least 1: the ball)
+    uint32_t gustCount;             // New gusts blown into the wind fluid for this frame
+    WindGust gusts[WIND_MAX_GUSTS];
+    float gustDurations[WIND_MAX_GUSTS]; // Seconds each new gust keeps blowing
+};
+
+// Start of the shared memory object; producer and consumer counters sit on their own cache lines
+struct ExternalControlHeader {
+    static constexpr uint32_t kMagic = 0x56474543; // "VGEC"
+    static constexpr uint32_t kVersion = 1;
+
+    std::atomic<uint32_t> magic;    // Written last by whoever created the object
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotBytes;             // ExternalControlFrame rounded up to whole pages
+    alignas(64) std::atomic<uint64_t> head; // Frames published by the producer
+    alignas(64) std::atomic<uint64_t> tail; // Frames released by the renderer (the GPU is done with them)
+};
+
+// POSIX shared memory channel from one producer process to the renderer: a lock-free single
+// producer / single consumer ring of ExternalControlFrame slots, each on its own pages. The
+// producer fills slot head % slotCount while head - tail < slotCount and publishes it; the
+// renderer takes the newest published frame each frame (older ones are skipped), binds its slot
+// as the frame's interactor buffer (a no-copy MTL::Buffer over the mapping) and releases it once
+// the frame slot that drew it comes around again. Whichever side opens the name first creates it.
+class ExternalControl {
+public:
+    static constexpr uint32_t kSlotCount = 8; // Up to kMaxFramesInFlight held by the renderer, the rest for the producer
+
+    // device: the renderer side (wraps every slot in a no-copy buffer); nullptr for a producer
+    ExternalControl(const std::string& name, MTL::Device* device);
+    ~ExternalControl();
+
+    bool isValid() const { return m_header != nullptr; }
+    const std::string& getName() const { return m_name; }
+
+    // Producer: the slot to fill, or nullptr while the renderer still holds every free one
+    ExternalControlFrame* beginFrame();
+    void publish();
+
+    // Renderer, once per frame after frameSlot's previous frame completed: releases what
+    // frameSlot held and takes the newest frame (or keeps the last one); false before any
+    // frame was published. frame / buffer stay valid until frameSlot polls again. A new frame's
+    // interactor count and radii are clamped in place first (INTERACTOR_MIN_RADIUS to
+    // INTERACTOR_MAX_RADIUS, falloff and capsule half height up to the same maximum), so a zero
+    // or huge radius cannot divide by zero or flood the stamp footprint and interactor bins.
+    bool poll(int frameSlot, const ExternalControlFrame*& frame, MTL::Buffer*& buffer, bool& fresh);
+
+private:
+    static constexpr int kMaxHolders = 4; // Renderer frame slots (>= kMaxFramesInFlight)
+    static constexpr uint64_t kNone = UINT64_MAX;
+
+    bool mapObject(bool create);
+    ExternalControlFrame* slot(uint64_t sequence) const;
+    static void sanitize(ExternalControlFrame* frame);
+
+    std::string m_name;
+    MTL::Device* m_device;
+    int m_fd;
+    void* m_mapping;
+    size_t m_mappingBytes;
+    ExternalControlHeader* m_header;
+    MTL::Buffer* m_slotBuffers[kSlotCount];
+    uint64_t m_nextRead;                  // First sequence not consumed yet
+    uint64_t m_current;                   // Newest consumed frame (kNone before the first)
+    uint64_t m_held[kMaxHolders];         // Sequence each renderer frame slot draws from
+};
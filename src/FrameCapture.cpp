@@ -0,0 +1,101 @@
+#include "FrameCapture.hpp"
+#include <Foundation/Foundation.hpp>
+#include <algorithm>
+#include <iostream>
+
+static std::string tracePath(const std::string& path)
+{
+    static const std::string kExtension = ".gputrace";
+    bool hasExtension = path.size() >= kExtension.size()
+        && path.compare(path.size() - kExtension.size(), kExtension.size(), kExtension) == 0;
+    return hasExtension ? path : path + kExtension;
+}
+
+FrameCapture::FrameCapture(MTL::CommandQueue* commandQueue)
+    : m_commandQueue(commandQueue)
+    , m_pendingFrames(0)
+    , m_framesLeft(0)
+    , m_autoThresholdMs(0.0)
+    , m_autoFrames(1)
+    , m_autoArmed(true)
+    , m_autoCount(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    if (m_framesLeft > 0) {
+        MTL::CaptureManager::sharedCaptureManager()->stopCapture();
+    }
+}
+
+bool FrameCapture::request(int frameCount, const std::string& path)
+{
+    if (frameCount <= 0 || path.empty()) {
+        return false;
+    }
+    if (m_framesLeft > 0 || m_pendingFrames > 0) {
+        std::cerr << "GPU capture already in progress; ignoring " << path << std::endl;
+        return false;
+    }
+    if (!MTL::CaptureManager::sharedCaptureManager()->supportsDestination(MTL::CaptureDestinationGPUTraceDocument)) {
+        std::cerr << "GPU capture to a trace document is unavailable (run with MTL_CAPTURE_ENABLED=1)" << std::endl;
+        return false;
+    }
+    m_pendingPath = tracePath(path);
+    m_pendingFrames = frameCount;
+    return true;
+}
+
+void FrameCapture::setAutoTrigger(double thresholdMs, int frameCount, const std::string& directory)
+{
+    m_autoThresholdMs = std::max(thresholdMs, 0.0);
+    m_autoFrames = std::max(frameCount, 1);
+    m_autoDirectory = directory.empty() ? "." : directory;
+    m_autoArmed = true;
+}
+
+void FrameCapture::beginFrame(double gpuFrameMs)
+{
+    if (m_autoThresholdMs > 0.0 && gpuFrameMs > 0.0) {
+        if (gpuFrameMs <= m_autoThresholdMs) {
+            m_autoArmed = true;
+        } else if (m_autoArmed && m_framesLeft == 0 && m_pendingFrames == 0) {
+            std::string path = m_autoDirectory + "/spike_" + std::to_string(m_autoCount++);
+            std::cout << "GPU frame took " << gpuFrameMs << " ms (threshold " << m_autoThresholdMs
+                      << " ms); capturing " << m_autoFrames << " frame(s)" << std::endl;
+            m_autoArmed = !request(m_autoFrames, path);
+        }
+    }
+
+    if (m_pendingFrames == 0 || m_framesLeft > 0) {
+        return;
+    }
+
+    MTL::CaptureDescriptor* descriptor = MTL::CaptureDescriptor::alloc()->init();
+    descriptor->setCaptureObject(m_commandQueue);
+    descriptor->setDestination(MTL::CaptureDestinationGPUTraceDocument);
+    descriptor->setOutputURL(NS::URL::fileURLWithPath(NS::String::string(m_pendingPath.c_str(), NS::UTF8StringEncoding)));
+
+    NS::Error* error = nullptr;
+    if (MTL::CaptureManager::sharedCaptureManager()->startCapture(descriptor, &error)) {
+        m_framesLeft = m_pendingFrames;
+        std::cout << "GPU capture: recording " << m_framesLeft << " frame(s) to " << m_pendingPath << std::endl;
+    } else {
+        std::cerr << "GPU capture to " << m_pendingPath << " failed: "
+                  << (error ? error->localizedDescription()->utf8String() : "unknown error") << std::endl;
+    }
+    descriptor->release();
+    m_pendingFrames = 0;
+}
+
+void FrameCapture::endFrame()
+{
+    if (m_framesLeft == 0) {
+        return;
+    }
+    if (--m_framesLeft == 0) {
+        MTL::CaptureManager::sharedCaptureManager()->stopCapture();
+        std::cout << "GPU capture: written " << m_pendingPath << std::endl;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <string>
+
+// Programmatic GPU capture of the renderer's command queue into .gputrace documents, for
+// spikes that are hard to reproduce under Xcode. request() captures the next N frames;
+// the auto trigger starts a capture when a frame's GPU time crosses a threshold. GPU times
+// resolve a few frames late, so it catches the frames following the slow one (recurring spikes,
+// streaming or pipeline hitches) rather than the slow frame itself, and re-arms once the GPU
+// time is back under the threshold. The process needs MTL_CAPTURE_ENABLED=1 in its environment
+// (or MetalCaptureEnabled in its Info.plist); without it startCapture fails and says so.
+class FrameCapture {
+public:
+    explicit FrameCapture(MTL::CommandQueue* commandQueue);
+    ~FrameCapture();
+
+    // Capture the next frameCount frames into path (.gputrace appended if missing). Overwrites nothing:
+    // Metal refuses an existing document.
+    bool request(int frameCount, const std::string& path);
+
+    // Start a frameCount-frame capture into directory (one numbered document per trigger) whenever
+    // the GPU frame time exceeds thresholdMs; 0 disables
+    void setAutoTrigger(double thresholdMs, int frameCount, const std::string& directory);
+    double getAutoTriggerMs() const { return m_autoThresholdMs; }
+
+    // Around each frame: begin before its command buffers are created, end after the last commits.
+    // gpuFrameMs is the latest resolved GPU frame time (feeds the auto trigger).
+    void beginFrame(double gpuFrameMs);
+    void endFrame();
+
+    bool isCapturing() const { return m_framesLeft > 0; }
+
+private:
+    MTL::CommandQueue* m_commandQueue;
+    std::string m_pendingPath;  // Requested capture, started by the next beginFrame()
+    int m_pendingFrames;
+    int m_framesLeft;           // Frames still to capture (0 = not capturing)
+    double m_autoThresholdMs;
+    int m_autoFrames;
+    std::string m_autoDirectory;
+    bool m_autoArmed;           // Cleared by a trigger until the GPU time drops below the threshold
+    int m_autoCount;            // Documents written by the auto trigger
+};
@@ -0,0 +1,39 @@
+#include "FramePacket.hpp"
+#include <GLFW/glfw3.h>
+
+void FramePacket::merge(const FramePacket& later)
+{
+    keys |= later.keys;
+    for (int i = 0; i < kMouseButtonCount; ++i) {
+        mouseButtons[i] = mouseButtons[i] || later.mouseButtons[i];
+    }
+    cursorX = later.cursorX;
+    cursorY = later.cursorY;
+    windowWidth = later.windowWidth;
+    windowHeight = later.windowHeight;
+    framebufferWidth = later.framebufferWidth;
+    framebufferHeight = later.framebufferHeight;
+    focused = later.focused;
+}
+
+FramePacket FramePacket::sample(GLFWwindow* window)
+{
+    FramePacket packet;
+    if (!window) {
+        return packet;
+    }
+    // GLFW_KEY_SPACE is the first named key
+    for (int key = GLFW_KEY_SPACE; key <= GLFW_KEY_LAST && key < kKeyCount; ++key) {
+        if (glfwGetKey(window, key) == GLFW_PRESS) {
+            packet.keys.set(static_cast<size_t>(key));
+        }
+    }
+    for (int button = 0; button < kMouseButtonCount; ++button) {
+        packet.mouseButtons[button] = glfwGetMouseButton(window, button) == GLFW_PRESS;
+    }
+    glfwGetCursorPos(window, &packet.cursorX, &packet.cursorY);
+    glfwGetWindowSize(window, &packet.windowWidth, &packet.windowHeight);
+    glfwGetFramebufferSize(window, &packet.framebufferWidth, &packet.framebufferHeight);
+    packet.focused = glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0;
+    return packet;
+}
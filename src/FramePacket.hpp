@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+
+struct GLFWwindow;
+
+// Window and input state for one frame of the renderer, sampled by the thread that owns the
+// GLFW window (the main thread on macOS), so the renderer never calls into GLFW for input and
+// can run on its own thread.
+struct FramePacket {
+    static constexpr int kKeyCount = 512;     // Covers GLFW_KEY_LAST
+    static constexpr int kMouseButtonCount = 3;
+
+    std::bitset<kKeyCount> keys;              // Held (or pressed since the last packet consumed)
+    bool mouseButtons[kMouseButtonCount] = {};
+    double cursorX = 0.0;                     // Window coordinates
+    double cursorY = 0.0;
+    int windowWidth = 0;                      // Points (overlay layout)
+    int windowHeight = 0;
+    int framebufferWidth = 0;                 // Pixels (drawable size)
+    int framebufferHeight = 0;
+    bool focused = true;
+
+    bool keyDown(int key) const { return key >= 0 && key < kKeyCount && keys.test(static_cast<size_t>(key)); }
+
+    // Fold a later packet into this one: keys and buttons held in either count (a tap shorter than
+    // a render frame is not lost), positions and sizes come from the later packet
+    void merge(const FramePacket& later);
+
+    static FramePacket sample(GLFWwindow* window); // Window thread only
+};
+
+// Lock-free single-producer / single-consumer ring: the window thread pushes, the render thread
+// pops. Capacity - 1 entries fit; a full ring refuses the push and the producer keeps merging
+// into its pending packet until there is room.
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    bool tryPush(const T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % Capacity;
+        if (next == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        m_items[head] = value;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_items[tail];
+        m_tail.store((tail + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_items[Capacity];
+    std::atomic<size_t> m_head{ 0 }; // Next slot the producer writes
+    std::atomic<size_t> m_tail{ 0 }; // Next slot the consumer reads
+};
@@ -0,0 +1,200 @@
+#include "GpuBreadcrumbs.hpp"
+#include <cstring>
+#include <iostream>
+
+static const char* encoderStateName(MTL::CommandEncoderErrorState state)
+{
+    switch (state) {
+        case MTL::CommandEncoderErrorStateCompleted:
+            return "completed";
+        case MTL::CommandEncoderErrorStateAffected:
+            return "affected";
+        case MTL::CommandEncoderErrorStatePending:
+            return "pending";
+        case MTL::CommandEncoderErrorStateFaulted:
+            return "FAULTED";
+        default:
+            return "unknown";
+    }
+}
+
+GpuBreadcrumbs::GpuBreadcrumbs(MTL::Device* device, int framesInFlight)
+    : m_buffer(device->newBuffer(static_cast<NS::UInteger>(framesInFlight) * kMaxPasses, MTL::ResourceStorageModeShared))
+    , m_descriptor(MTL::CommandBufferDescriptor::alloc()->init())
+    , m_slots(framesInFlight)
+    , m_slot(0)
+    , m_enabled(false)
+{
+    m_descriptor->setErrorOptions(MTL::CommandBufferErrorOptionEncoderExecutionStatus);
+    if (m_buffer) {
+        m_buffer->setLabel(NS::String::string("GPU breadcrumbs", NS::UTF8StringEncoding));
+        std::memset(m_buffer->contents(), 0, m_buffer->length());
+    } else {
+        std::cerr << "GPU breadcrumbs: failed to allocate the marker buffer" << std::endl;
+    }
+    for (int lane = 0; lane < LaneCount; ++lane) {
+        m_events[lane] = device->newEvent();
+        m_eventValues[lane] = 0;
+    }
+    for (Slot& slot : m_slots) {
+        slot.frame = 0;
+        slot.passes.reserve(kMaxPasses);
+        for (int& open : slot.open) {
+            open = -1;
+        }
+        slot.inFlight = false;
+    }
+}
+
+GpuBreadcrumbs::~GpuBreadcrumbs()
+{
+    if (m_buffer) {
+        m_buffer->release();
+    }
+    for (MTL::Event* event : m_events) {
+        if (event) {
+            event->release();
+        }
+    }
+    m_descriptor->release();
+}
+
+void GpuBreadcrumbs::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    std::cout << "GPU breadcrumbs: " << (isEnabled() ? "ON" : "OFF") << std::endl;
+}
+
+void GpuBreadcrumbs::beginFrame(int slot, uint64_t frame)
+{
+    m_slot = slot;
+    Slot& state = m_slots[slot];
+    state.frame = frame;
+    state.passes.clear();
+    for (int& open : state.open) {
+        open = -1;
+    }
+    if (m_buffer) {
+        std::memset(static_cast<uint8_t*>(m_buffer->contents()) + static_cast<size_t>(slot) * kMaxPasses, MarkerNone, kMaxPasses);
+    }
+}
+
+void GpuBreadcrumbs::mark(MTL::BlitCommandEncoder* encoder, uint32_t pass, Marker marker)
+{
+    NS::UInteger offset = static_cast<NS::UInteger>(m_slot) * kMaxPasses + pass;
+    encoder->fillBuffer(m_buffer, NS::Range::Make(offset, 1), marker);
+}
+
+MTL::BlitCommandEncoder* GpuBreadcrumbs::markerEncoder(MTL::CommandBuffer* commandBuffer, Lane lane, bool closesPass)
+{
+    // Encoders of one command buffer may overlap: the signal fires once everything encoded before
+    // it has completed, so the marker behind the wait can only run after the pass it closes
+    if (closesPass && m_events[lane]) {
+        uint64_t value = ++m_eventValues[lane];
+        commandBuffer->encodeSignalEvent(m_events[lane], value);
+        commandBuffer->encodeWait(m_events[lane], value);
+    }
+    return commandBuffer->blitCommandEncoder();
+}
+
+void GpuBreadcrumbs::markPass(MTL::CommandBuffer* commandBuffer, const char* name, Lane lane)
+{
+    Slot& slot = m_slots[m_slot];
+    if (!isEnabled() || slot.passes.size() >= kMaxPasses) {
+        return;
+    }
+
+    // One encoder closes the lane's previous pass and opens this one
+    MTL::BlitCommandEncoder* encoder = markerEncoder(commandBuffer, lane, slot.open[lane] >= 0);
+    if (!encoder) {
+        return;
+    }
+    uint32_t pass = static_cast<uint32_t>(slot.passes.size());
+    if (slot.open[lane] >= 0) {
+        mark(encoder, static_cast<uint32_t>(slot.open[lane]), MarkerDone);
+    }
+    mark(encoder, pass, MarkerBegun);
+    encoder->endEncoding();
+    slot.passes.push_back(name);
+    slot.open[lane] = static_cast<int>(pass);
+}
+
+void GpuBreadcrumbs::endPasses(MTL::CommandBuffer* commandBuffer, Lane lane)
+{
+    Slot& slot = m_slots[m_slot];
+    if (!isEnabled() || slot.open[lane] < 0) {
+        return;
+    }
+    MTL::BlitCommandEncoder* encoder = markerEncoder(commandBuffer, lane, true);
+    if (encoder) {
+        mark(encoder, static_cast<uint32_t>(slot.open[lane]), MarkerDone);
+        encoder->endEncoding();
+    }
+    slot.open[lane] = -1;
+}
+
+void GpuBreadcrumbs::watch(MTL::CommandBuffer* commandBuffer, Lane lane)
+{
+    int slotIndex = m_slot;
+    Slot& slot = m_slots[slotIndex];
+    bool frame = lane == LaneFrame;
+    if (frame) {
+        slot.inFlight = true;
+    }
+    commandBuffer->addCompletedHandler([this, slotIndex, frame](MTL::CommandBuffer* completed) {
+        Slot& slot = m_slots[slotIndex];
+        if (completed->status() == MTL::CommandBufferStatusError) {
+            std::lock_guard<std::mutex> lock(m_logMutex);
+            NS::Error* error = completed->error();
+            std::cerr << "GPU: " << (frame ? "frame " : "async compute of frame ") << slot.frame
+                      << " failed (error " << (error ? error->code() : 0) << ": "
+                      << (error && error->localizedDescription() ? error->localizedDescription()->utf8String() : "no description")
+                      << ")" << std::endl;
+
+            // Per-encoder state: the faulted encoders, the ones affected by them, the ones never run
+            NS::Dictionary* info = error ? error->userInfo() : nullptr;
+            NS::Array* encoders = info ? info->object<NS::Array>(MTL::CommandBufferEncoderInfoErrorKey) : nullptr;
+            for (NS::UInteger i = 0; encoders && i < encoders->count(); ++i) {
+                MTL::CommandBufferEncoderInfo* encoderInfo = encoders->object<MTL::CommandBufferEncoderInfo>(i);
+                std::cerr << "  encoder " << i << " " << (encoderInfo->label() ? encoderInfo->label()->utf8String() : "(unlabelled)")
+                          << ": " << encoderStateName(encoderInfo->errorState()) << std::endl;
+            }
+            logTrail(slot, slotIndex);
+        }
+        if (frame) {
+            slot.inFlight = false;
+        }
+    });
+}
+
+void GpuBreadcrumbs::logTrail(const Slot& slot, int slotIndex) const
+{
+    if (slot.passes.empty() || !m_buffer) {
+        return;
+    }
+    const uint8_t* markers = static_cast<const uint8_t*>(m_buffer->contents()) + static_cast<size_t>(slotIndex) * kMaxPasses;
+    size_t done = 0;
+    std::cerr << "  breadcrumbs:";
+    for (size_t i = 0; i < slot.passes.size(); ++i) {
+        if (markers[i] == MarkerDone) {
+            done++;
+        } else {
+            std::cerr << " " << slot.passes[i] << (markers[i] == MarkerBegun ? " (running)" : " (not reached)");
+        }
+    }
+    std::cerr << " - " << done << " of " << slot.passes.size() << " passes finished" << std::endl;
+}
+
+void GpuBreadcrumbs::reportStalled(double waitedSeconds) const
+{
+    std::lock_guard<std::mutex> lock(m_logMutex);
+    std::cerr << "GPU: no frame completed for " << waitedSeconds << " s" << std::endl;
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        const Slot& slot = m_slots[i];
+        if (!slot.inFlight) {
+            continue;
+        }
+        std::cerr << "  frame " << slot.frame << " in flight" << (slot.passes.empty() ? " (no breadcrumbs)" : "") << std::endl;
+        logTrail(slot, static_cast<int>(i));
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// GPU fault and hang diagnostics for the frame command buffers. Every frame command buffer asks
+// for per-encoder execution status; watch() logs a failed frame's error, the state of each of its
+// encoders (labelled with the render graph pass names) and its breadcrumb trail. With
+// breadcrumbs on, the render graph wraps each pass in one-byte markers that tiny blit encoders
+// write into a shared buffer (per frame slot: 1 when the pass was reached, 2 once it finished),
+// so the pass a timed-out or hung frame stopped in can be read back from the CPU even when no
+// completion handler ever runs: reportStalled() logs the frames in flight when the frame slot
+// wait times out. A pass is only marked finished behind an event its lane signals after the
+// pass's work and waits on, so a lane's marked passes run one after another; the two lanes may
+// still overlap, so the trail names the passes still running in each, not a single culprit.
+class GpuBreadcrumbs {
+public:
+    static constexpr uint32_t kMaxPasses = 64; // Markers per frame; later passes go unmarked
+
+    // Command buffers of one frame: its own and the render graph's async compute one. Each lane
+    // closes its own passes; the trail lists both in encoding order.
+    enum Lane { LaneFrame = 0, LaneAsync, LaneCount };
+
+    GpuBreadcrumbs(MTL::Device* device, int framesInFlight);
+    ~GpuBreadcrumbs();
+
+    // Descriptor of the frame (and async compute) command buffers (encoder execution status on)
+    const MTL::CommandBufferDescriptor* getCommandBufferDescriptor() const { return m_descriptor; }
+
+    // Markers cost one blit encoder and one event wait per pass boundary: off unless asked for
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled && m_buffer; }
+
+    // Frame start, once the slot's last command buffer has completed: clears its trail
+    void beginFrame(int slot, uint64_t frame);
+    // Render graph: before each encoded pass (name: string literal, kept) and after the last one
+    void markPass(MTL::CommandBuffer* commandBuffer, const char* name, Lane lane = LaneFrame);
+    void endPasses(MTL::CommandBuffer* commandBuffer, Lane lane = LaneFrame);
+    // Log the frame's failure from its completed handler (added before the slot is released);
+    // the async lane's command buffer is watched the same way but does not end the frame
+    void watch(MTL::CommandBuffer* commandBuffer, Lane lane = LaneFrame);
+
+    // Frame slot wait timed out: log every frame still in flight and where its passes stand
+    void reportStalled(double waitedSeconds) const;
+
+private:
+    enum Marker : uint8_t { MarkerNone = 0, MarkerBegun = 1, MarkerDone = 2 };
+
+    struct Slot {
+        uint64_t frame;
+        std::vector<const char*> passes; // Marked passes in encoding order
+        int open[LaneCount];             // Each lane's pass still to be closed (-1 = none)
+        std::atomic<bool> inFlight;      // Committed frame whose completed handler has not run
+    };
+
+    void mark(MTL::BlitCommandEncoder* encoder, uint32_t pass, Marker marker);
+    // Encoder after the lane's work so far has completed (the marker of a pass it closes)
+    MTL::BlitCommandEncoder* markerEncoder(MTL::CommandBuffer* commandBuffer, Lane lane, bool closesPass);
+    void logTrail(const Slot& slot, int slotIndex) const;
+
+    MTL::Buffer* m_buffer;              // framesInFlight x kMaxPasses markers (shared)
+    MTL::CommandBufferDescriptor* m_descriptor;
+    MTL::Event* m_events[LaneCount];    // Per lane: signalled after a pass, waited on by its Done marker
+    uint64_t m_eventValues[LaneCount];
+    std::vector<Slot> m_slots;
+    int m_slot;                         // Slot of the frame being encoded
+    bool m_enabled;
+    mutable std::mutex m_logMutex;      // Completed handlers and the render thread both log
+};
@@ -0,0 +1,82 @@
+#include "GpuMemoryBudget.hpp"
+#include <numeric>
+
+static const char* const kCategoryNames[GpuMemoryBudget::CategoryCount] = {
+    "instances", "meshes", "textures", "renderTargets", "trample", "streaming", "simulation", "other"
+};
+
+GpuMemoryBudget::GpuMemoryBudget(MTL::Device* device)
+    : m_device(device)
+    , m_bytes()
+    , m_allocatedBytes(0)
+    , m_workingSetBytes(0)
+    , m_requestedBudget(0)
+    , m_pressure(false)
+    , m_samples(0)
+{
+}
+
+const char* GpuMemoryBudget::categoryName(Category category)
+{
+    return category >= 0 && category < CategoryCount ? kCategoryNames[category] : "unknown";
+}
+
+void GpuMemoryBudget::begin()
+{
+    for (int i = 0; i < CategoryCount; ++i) {
+        m_bytes[i] = 0;
+    }
+    m_counted.clear();
+}
+
+void GpuMemoryBudget::add(Category category, const MTL::Resource* resource)
+{
+    if (!resource || !m_counted.insert(resource).second) {
+        return;
+    }
+    m_bytes[category] += static_cast<size_t>(resource->allocatedSize());
+}
+
+void GpuMemoryBudget::addBytes(Category category, size_t bytes)
+{
+    m_bytes[category] += bytes;
+}
+
+void GpuMemoryBudget::end()
+{
+    m_allocatedBytes = static_cast<size_t>(m_device->currentAllocatedSize());
+    m_workingSetBytes = static_cast<size_t>(m_device->recommendedMaxWorkingSetSize());
+    m_samples++;
+
+    size_t budget = getBudgetBytes();
+    if (m_allocatedBytes > budget) {
+        m_pressure = true;
+    } else if (static_cast<double>(m_allocatedBytes) < static_cast<double>(budget) * kReleaseShare) {
+        m_pressure = false;
+    }
+}
+
+size_t GpuMemoryBudget::getTrackedBytes() const
+{
+    return std::accumulate(m_bytes, m_bytes + CategoryCount, size_t(0));
+}
+
+size_t GpuMemoryBudget::getUntrackedBytes() const
+{
+    size_t tracked = getTrackedBytes();
+    return m_allocatedBytes > tracked ? m_allocatedBytes - tracked : 0;
+}
+
+size_t GpuMemoryBudget::getBudgetBytes() const
+{
+    if (m_requestedBudget > 0) {
+        return m_requestedBudget;
+    }
+    return static_cast<size_t>(static_cast<double>(m_workingSetBytes) * kWorkingSetShare);
+}
+
+size_t GpuMemoryBudget::getOverBudgetBytes() const
+{
+    size_t budget = getBudgetBytes();
+    return m_allocatedBytes > budget ? m_allocatedBytes - budget : 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <cstddef>
+#include <unordered_set>
+
+// Per-category accounting of the renderer's GPU memory, checked against the device: one sample
+// lists every long-lived resource under its category (begin(), add() / addBytes(), end()) and
+// reads MTL::Device::currentAllocatedSize() and recommendedMaxWorkingSetSize() alongside, so the
+// difference to the tracked total shows what no category covers (driver state, heap slack,
+// resources the renderer does not list). The budget is a share of the working set limit (or an
+// explicit size); past it the sample reports pressure until usage falls well below again, which
+// is what the caches shrink on (Renderer::updateGpuMemoryBudget()).
+class GpuMemoryBudget {
+public:
+    enum Category {
+        CategoryInstances = 0,  // Blade instances, cells, cull output and indirect arguments
+        CategoryMeshes,         // Blade, ground and ball geometry
+        CategoryTextures,       // Albedo, terrain, noise and impostor textures
+        CategoryRenderTargets,  // Render target heaps (scene, depth, Hi-Z, graph and upscaler targets)
+        CategoryTrample,        // Trample map, summary and their transfer buffers
+        CategoryStreaming,      // Grass chunk pool and the sparse ground tiles
+        CategorySimulation,     // Blade springs, interactor bodies and the wind grid
+        CategoryOther,          // Per-frame rings and the unused part of the buffer heaps
+        CategoryCount
+    };
+
+    explicit GpuMemoryBudget(MTL::Device* device);
+
+    static const char* categoryName(Category category);
+
+    // One sample: resources are counted once by allocatedSize() however often they are added
+    // (null entries are skipped)
+    void begin();
+    void add(Category category, const MTL::Resource* resource);
+    void addBytes(Category category, size_t bytes);
+    void end();
+
+    // Budget in bytes; 0 = kWorkingSetShare of the device's recommended working set
+    void setBudgetBytes(size_t bytes) { m_requestedBudget = bytes; }
+
+    bool hasSample() const { return m_samples > 0; }
+    size_t getBytes(Category category) const { return m_bytes[category]; }
+    size_t getTrackedBytes() const;
+    size_t getAllocatedBytes() const { return m_allocatedBytes; }      // Device total (currentAllocatedSize)
+    size_t getUntrackedBytes() const;                                  // Device total past the tracked categories
+    size_t getWorkingSetBytes() const { return m_workingSetBytes; }    // recommendedMaxWorkingSetSize
+    size_t getBudgetBytes() const;
+    size_t getOverBudgetBytes() const;                                 // Device total past the budget (0 = within)
+    // Set once the device total passes the budget, cleared below kReleaseShare of it
+    bool isUnderPressure() const { return m_pressure; }
+
+private:
+    static constexpr double kWorkingSetShare = 0.9; // Leave the rest of the system-wide limit to everyone else
+    static constexpr double kReleaseShare = 0.8;
+
+    MTL::Device* m_device;
+    size_t m_bytes[CategoryCount];
+    std::unordered_set<const MTL::Resource*> m_counted; // Resources of the current sample
+    size_t m_allocatedBytes;
+    size_t m_workingSetBytes;
+    size_t m_requestedBudget;
+    bool m_pressure;
+    int m_samples;
+};
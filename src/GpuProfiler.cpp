@@ -0,0 +1,262 @@
+#include "GpuProfiler.hpp"
+#include "TraceRecorder.hpp"
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+GpuProfiler::GpuProfiler(MTL::Device* device, int framesInFlight)
+    : m_device(device)
+    , m_sampleBuffer(nullptr)
+    , m_framesInFlight(framesInFlight)
+    , m_slot(0)
+    , m_asyncCommandBuffer(nullptr)
+    , m_stageBoundary(false)
+    , m_drawBoundary(false)
+    , m_sampledMask(framesInFlight)
+    , m_calibrationCpu(0)
+    , m_calibrationGpu(0)
+    , m_nsPerGpuTick(1.0)
+    , m_trace(nullptr)
+{
+    std::memset(&m_timings, 0, sizeof(m_timings));
+    
+    m_stageBoundary = m_device->supportsCounterSampling(MTL::CounterSamplingPointAtStageBoundary);
+    m_drawBoundary = m_device->supportsCounterSampling(MTL::CounterSamplingPointAtDrawBoundary);
+    
+    // Find the timestamp counter set
+    MTL::CounterSet* timestampSet = nullptr;
+    NS::Array* counterSets = m_device->counterSets();
+    for (NS::UInteger i = 0; counterSets && i < counterSets->count(); ++i) {
+        MTL::CounterSet* set = counterSets->object<MTL::CounterSet>(i);
+        if (set->name()->isEqualToString(MTL::CommonCounterSetTimestamp)) {
+            timestampSet = set;
+            break;
+        }
+    }
+    
+    if (!timestampSet || (!m_stageBoundary && !m_drawBoundary)) {
+        std::cout << "GPU timestamp counters unavailable; reporting command buffer time only" << std::endl;
+        m_stageBoundary = false;
+        m_drawBoundary = false;
+        return;
+    }
+    
+    MTL::CounterSampleBufferDescriptor* descriptor = MTL::CounterSampleBufferDescriptor::alloc()->init();
+    descriptor->setCounterSet(timestampSet);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+    descriptor->setSampleCount(static_cast<NS::UInteger>(framesInFlight) * GpuPassCount * 2);
+    
+    NS::Error* error = nullptr;
+    m_sampleBuffer = m_device->newCounterSampleBuffer(descriptor, &error);
+    descriptor->release();
+    
+    if (!m_sampleBuffer) {
+        if (error) {
+            std::cerr << "Failed to create counter sample buffer: " << error->localizedDescription()->utf8String() << std::endl;
+        } else {
+            std::cerr << "Failed to create counter sample buffer" << std::endl;
+        }
+        m_stageBoundary = false;
+        m_drawBoundary = false;
+        return;
+    }
+    
+    m_device->sampleTimestamps(&m_calibrationCpu, &m_calibrationGpu);
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    if (m_asyncCommandBuffer) {
+        m_asyncCommandBuffer->release();
+    }
+    if (m_sampleBuffer) {
+        m_sampleBuffer->release();
+    }
+}
+
+void GpuProfiler::beginFrame(int slot)
+{
+    m_slot = slot % m_framesInFlight;
+    m_sampledMask[m_slot] = 0;
+    if (m_asyncCommandBuffer) {
+        m_asyncCommandBuffer->release(); // A frame that never reached endFrame()
+        m_asyncCommandBuffer = nullptr;
+    }
+}
+
+NS::UInteger GpuProfiler::sampleIndex(GpuPass pass, bool begin) const
+{
+    return (static_cast<NS::UInteger>(m_slot) * GpuPassCount + pass) * 2 + (begin ? 0 : 1);
+}
+
+MTL::ComputeCommandEncoder* GpuProfiler::computeEncoder(MTL::CommandBuffer* commandBuffer, GpuPass pass)
+{
+    if (!m_sampleBuffer || !m_stageBoundary) {
+        return commandBuffer->computeCommandEncoder();
+    }
+    
+    MTL::ComputePassDescriptor* descriptor = MTL::ComputePassDescriptor::alloc()->init();
+    MTL::ComputePassSampleBufferAttachmentDescriptor* attachment = descriptor->sampleBufferAttachments()->object(0);
+    attachment->setSampleBuffer(m_sampleBuffer);
+    attachment->setStartOfEncoderSampleIndex(sampleIndex(pass, true));
+    attachment->setEndOfEncoderSampleIndex(sampleIndex(pass, false));
+    
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder(descriptor);
+    descriptor->release();
+    
+    m_sampledMask[m_slot] |= (1u << pass);
+    return encoder;
+}
+
+void GpuProfiler::attachRenderPass(MTL::RenderPassDescriptor* descriptor, GpuPass pass)
+{
+    if (!m_sampleBuffer || !m_stageBoundary) {
+        return;
+    }
+    
+    MTL::RenderPassSampleBufferAttachmentDescriptor* attachment = descriptor->sampleBufferAttachments()->object(0);
+    attachment->setSampleBuffer(m_sampleBuffer);
+    attachment->setStartOfVertexSampleIndex(sampleIndex(pass, true));
+    attachment->setEndOfVertexSampleIndex(MTL::CounterDontSample);
+    attachment->setStartOfFragmentSampleIndex(MTL::CounterDontSample);
+    attachment->setEndOfFragmentSampleIndex(sampleIndex(pass, false));
+    
+    m_sampledMask[m_slot] |= (1u << pass);
+}
+
+void GpuProfiler::sampleDraw(MTL::RenderCommandEncoder* encoder, GpuPass pass, bool begin)
+{
+    if (!m_sampleBuffer || !m_drawBoundary) {
+        return;
+    }
+    
+    encoder->sampleCountersInBuffer(m_sampleBuffer, sampleIndex(pass, begin), true);
+    if (!begin) {
+        m_sampledMask[m_slot] |= (1u << pass);
+    }
+}
+
+void GpuProfiler::addAsyncCommandBuffer(MTL::CommandBuffer* commandBuffer)
+{
+    if (m_asyncCommandBuffer) {
+        m_asyncCommandBuffer->release();
+    }
+    m_asyncCommandBuffer = commandBuffer->retain();
+}
+
+void GpuProfiler::endFrame(MTL::CommandBuffer* commandBuffer)
+{
+    int slot = m_slot;
+    MTL::CommandBuffer* asyncCommandBuffer = m_asyncCommandBuffer; // Released by the handler
+    m_asyncCommandBuffer = nullptr;
+    commandBuffer->addCompletedHandler([this, slot, asyncCommandBuffer](MTL::CommandBuffer* completed) {
+        resolve(slot, completed, asyncCommandBuffer);
+        if (asyncCommandBuffer) {
+            asyncCommandBuffer->release();
+        }
+    });
+}
+
+void GpuProfiler::resolve(int slot, MTL::CommandBuffer* commandBuffer, MTL::CommandBuffer* asyncCommandBuffer)
+{
+    // The frame waits for its async compute work, which has completed by now (a failed one has no times)
+    double gpuStart = commandBuffer->GPUStartTime();
+    double gpuEnd = commandBuffer->GPUEndTime();
+    bool async = asyncCommandBuffer && asyncCommandBuffer->status() == MTL::CommandBufferStatusCompleted;
+    if (async) {
+        gpuStart = std::min(gpuStart, asyncCommandBuffer->GPUStartTime());
+        gpuEnd = std::max(gpuEnd, asyncCommandBuffer->GPUEndTime());
+    }
+    double frameMs = (gpuEnd - gpuStart) * 1000.0;
+    bool trace = m_trace && m_trace->isEnabled();
+    if (trace) {
+        // GPU start / end are seconds on the same uptime clock
+        m_trace->complete("GPU frame", static_cast<uint64_t>(commandBuffer->GPUStartTime() * 1e9),
+                          static_cast<uint64_t>(commandBuffer->GPUEndTime() * 1e9), TraceRecorder::kGpuTrack);
+        if (async) {
+            m_trace->complete("GPU async compute", static_cast<uint64_t>(asyncCommandBuffer->GPUStartTime() * 1e9),
+                              static_cast<uint64_t>(asyncCommandBuffer->GPUEndTime() * 1e9), TraceRecorder::kGpuTrack);
+        }
+    }
+    
+    GpuTimings timings;
+    std::memset(&timings, 0, sizeof(timings));
+    timings.frameMs = frameMs;
+    timings.perPass = (m_sampleBuffer != nullptr);
+    
+    if (m_sampleBuffer) {
+        NS::Range range = NS::Range::Make(static_cast<NS::UInteger>(slot) * GpuPassCount * 2, GpuPassCount * 2);
+        NS::Data* data = m_sampleBuffer->resolveCounterRange(range);
+        
+        if (data) {
+            const MTL::CounterResultTimestamp* samples = static_cast<const MTL::CounterResultTimestamp*>(data->mutableBytes());
+            
+            std::lock_guard<std::mutex> lock(m_mutex);
+            
+            // Re-calibrate the GPU tick length against the CPU clock
+            MTL::Timestamp cpu = 0;
+            MTL::Timestamp gpu = 0;
+            m_device->sampleTimestamps(&cpu, &gpu);
+            if (gpu > m_calibrationGpu && cpu > m_calibrationCpu) {
+                m_nsPerGpuTick = static_cast<double>(cpu - m_calibrationCpu) / static_cast<double>(gpu - m_calibrationGpu);
+            }
+            m_calibrationCpu = cpu;
+            m_calibrationGpu = gpu;
+            
+            for (int pass = 0; pass < GpuPassCount; ++pass) {
+                if ((m_sampledMask[slot] & (1u << pass)) == 0) {
+                    continue;
+                }
+                uint64_t begin = samples[pass * 2].timestamp;
+                uint64_t end = samples[pass * 2 + 1].timestamp;
+                if (begin == MTL::CounterErrorValue || end == MTL::CounterErrorValue || begin == 0 || end <= begin) {
+                    continue;
+                }
+                timings.passMs[pass] = static_cast<double>(end - begin) * m_nsPerGpuTick * 1e-6;
+                if (trace) {
+                    // GPU ticks -> CPU nanoseconds through the calibration pair just taken
+                    double beginNs = static_cast<double>(cpu) - static_cast<double>(gpu - begin) * m_nsPerGpuTick;
+                    double endNs = static_cast<double>(cpu) - static_cast<double>(gpu - end) * m_nsPerGpuTick;
+                    m_trace->complete(passName(static_cast<GpuPass>(pass)), static_cast<uint64_t>(beginNs),
+                                      static_cast<uint64_t>(endNs), TraceRecorder::kGpuTrack);
+                }
+            }
+            
+            m_timings = timings;
+            return;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timings = timings;
+}
+
+GpuTimings GpuProfiler::getTimings() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_timings;
+}
+
+const char* GpuProfiler::passName(GpuPass pass)
+{
+    switch (pass) {
+        case GpuPassTrample: return "Trample";
+        case GpuPassCull:    return "Cull";
+        case GpuPassSky:     return "Sky";
+        case GpuPassGround:  return "Ground";
+        case GpuPassGrass:   return "Grass";
+        case GpuPassBall:    return "Ball";
+        case GpuPassScene:   return "Scene";
+        case GpuPassGrassVisibility: return "GrassVis";
+        case GpuPassWind:    return "Wind";
+        case GpuPassImpostors: return "Impostor";
+        case GpuPassAtmosphere: return "Atmosphere";
+        case GpuPassPost:    return "Post";
+        case GpuPassPhysics: return "Physics";
+        case GpuPassBlades:  return "Blades";
+        case GpuPassLights:  return "Lights";
+        case GpuPassTemporalResolve: return "TAA";
+        case GpuPassShadows: return "Shadows";
+        default:             return "Unknown";
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class TraceRecorder;
+
+// GPU passes timed by GpuProfiler
+enum GpuPass {
+    GpuPassTrample = 0, // Trample map compute
+    GpuPassCull,        // Hi-Z build + culling compute
+    GpuPassSky,         // Draw-boundary sampling only
+    GpuPassGround,
+    GpuPassGrass,
+    GpuPassBall,
+    GpuPassScene,       // Whole render encoder (sky + ground + grass + ball)
+    GpuPassGrassVisibility, // Visibility-buffer grass pass (IDs + full-screen shading)
+    GpuPassWind,        // Wind field compute
+    GpuPassImpostors,   // Draw-boundary sampling of the far-field impostor cards
+    GpuPassAtmosphere,  // Atmosphere LUT compute (only on frames where the sun changed)
+    GpuPassPost,        // Fog + exposure + tone mapping of the HDR scene
+    GpuPassPhysics,     // Interactor rigid-body step (only with setInteractorPhysics())
+    GpuPassBlades,      // Blade spring step near the camera (only with setBladePhysics())
+    GpuPassLights,      // Point light clustering compute (only with setPointLights())
+    GpuPassTemporalResolve, // TAA history resolve (only with setTemporalAntialiasing())
+    GpuPassShadows,     // Sun shadow overlay of the interactors (the cached cascades redraw untimed)
+    GpuPassCount
+};
+
+// Latest resolved per-pass GPU times (milliseconds, 0 when a pass was not sampled)
+struct GpuTimings {
+    double passMs[GpuPassCount];
+    double frameMs;     // Command buffer GPUStartTime -> GPUEndTime (spanning the async compute one too)
+    bool perPass;       // Timestamp counters available (otherwise only frameMs is valid)
+};
+
+// Per-pass GPU timestamps from an MTL::CounterSampleBuffer.
+// Encoder boundaries are sampled through pass descriptors (stage-boundary sampling, Apple GPUs);
+// individual draws inside the scene encoder are sampled only where draw-boundary sampling exists.
+// Each in-flight frame owns a slice of the sample buffer, resolved from the completed handler.
+class GpuProfiler {
+public:
+    GpuProfiler(MTL::Device* device, int framesInFlight);
+    ~GpuProfiler();
+
+    // Select the sample slice for this frame (slot must not be in flight)
+    void beginFrame(int slot);
+
+    // Compute encoder with start/end timestamps attached
+    MTL::ComputeCommandEncoder* computeEncoder(MTL::CommandBuffer* commandBuffer, GpuPass pass);
+    // Attach start-of-vertex / end-of-fragment timestamps to a render pass
+    void attachRenderPass(MTL::RenderPassDescriptor* descriptor, GpuPass pass);
+    // Timestamp between draws (no-op without draw-boundary sampling); safe from several threads
+    // filling sub-encoders of one parallel render pass
+    void sampleDraw(MTL::RenderCommandEncoder* encoder, GpuPass pass, bool begin);
+
+    // The frame's async compute command buffer (render graph, committed ahead of the frame's,
+    // which waits for it): its GPU span joins the frame time
+    void addAsyncCommandBuffer(MTL::CommandBuffer* commandBuffer);
+    // Resolve asynchronously once the command buffer completes
+    void endFrame(MTL::CommandBuffer* commandBuffer);
+
+    GpuTimings getTimings() const;
+    // Resolved frames also add their command buffer and pass spans to recorder's GPU track
+    void setTraceRecorder(TraceRecorder* recorder) { m_trace = recorder; }
+    static const char* passName(GpuPass pass);
+
+private:
+    NS::UInteger sampleIndex(GpuPass pass, bool begin) const;
+    void resolve(int slot, MTL::CommandBuffer* commandBuffer, MTL::CommandBuffer* asyncCommandBuffer);
+
+    MTL::Device* m_device;
+    MTL::CounterSampleBuffer* m_sampleBuffer;   // framesInFlight * GpuPassCount * 2 samples
+    int m_framesInFlight;
+    int m_slot;                                  // Slice of the frame being encoded
+    MTL::CommandBuffer* m_asyncCommandBuffer;    // Retained for the frame being encoded (handed to endFrame())
+    bool m_stageBoundary;                        // Encoder-boundary sampling supported
+    bool m_drawBoundary;                         // Draw-boundary sampling supported
+    std::vector<std::atomic<uint32_t>> m_sampledMask; // Passes sampled per slot (sampleDraw() runs on encoding workers too)
+
+    // GPU -> CPU timestamp calibration (CPU timestamps are nanoseconds)
+    MTL::Timestamp m_calibrationCpu;
+    MTL::Timestamp m_calibrationGpu;
+    double m_nsPerGpuTick;
+
+    mutable std::mutex m_mutex;
+    GpuTimings m_timings;
+    TraceRecorder* m_trace;
+};
@@ -0,0 +1,79 @@
+#include "GpuResidency.hpp"
+#include <Foundation/Foundation.hpp>
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+GpuResidency::GpuResidency(MTL::Device* device, MTL::CommandQueue* commandQueue)
+    : m_commandQueues()
+    , m_set(nullptr)
+    , m_commits(0)
+{
+    if (!NS::ProcessInfo::processInfo()->isOperatingSystemAtLeastVersion({ 15, 0, 0 })) {
+        return;
+    }
+
+    MTL::ResidencySetDescriptor* descriptor = MTL::ResidencySetDescriptor::alloc()->init();
+    descriptor->setLabel(NS::String::string("Long-lived resources", NS::UTF8StringEncoding));
+    descriptor->setInitialCapacity(128);
+    NS::Error* error = nullptr;
+    m_set = device->newResidencySet(descriptor, &error);
+    descriptor->release();
+
+    if (!m_set) {
+        std::cerr << "Failed to create residency set: "
+                  << (error ? error->localizedDescription()->utf8String() : "unknown error") << std::endl;
+        return;
+    }
+    m_set->requestResidency();
+    addCommandQueue(commandQueue);
+}
+
+GpuResidency::~GpuResidency()
+{
+    if (m_set) {
+        m_set->endResidency();
+        for (MTL::CommandQueue* commandQueue : m_commandQueues) {
+            commandQueue->removeResidencySet(m_set);
+        }
+        m_set->release();
+    }
+}
+
+void GpuResidency::addCommandQueue(MTL::CommandQueue* commandQueue)
+{
+    if (m_set && commandQueue) {
+        commandQueue->addResidencySet(m_set);
+        m_commandQueues.push_back(commandQueue);
+    }
+}
+
+void GpuResidency::sync(std::vector<const MTL::Allocation*>& allocations)
+{
+    if (!m_set) {
+        return;
+    }
+
+    allocations.erase(std::remove(allocations.begin(), allocations.end(), nullptr), allocations.end());
+    std::sort(allocations.begin(), allocations.end());
+    allocations.erase(std::unique(allocations.begin(), allocations.end()), allocations.end());
+    if (allocations == m_resident) {
+        return;
+    }
+
+    m_added.clear();
+    m_removed.clear();
+    std::set_difference(allocations.begin(), allocations.end(), m_resident.begin(), m_resident.end(),
+                        std::back_inserter(m_added));
+    std::set_difference(m_resident.begin(), m_resident.end(), allocations.begin(), allocations.end(),
+                        std::back_inserter(m_removed));
+    if (!m_removed.empty()) {
+        m_set->removeAllocations(m_removed.data(), m_removed.size());
+    }
+    if (!m_added.empty()) {
+        m_set->addAllocations(m_added.data(), m_added.size());
+    }
+    m_set->commit();
+    m_resident = allocations;
+    m_commits++;
+}
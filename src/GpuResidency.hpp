@@ -0,0 +1,36 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <vector>
+
+// Long-lived buffers, textures and indirect command buffers kept resident through one
+// MTL::ResidencySet attached to the command queue (macOS 15+), so command buffers stop making
+// each bound resource resident on their own. sync() takes the full list once per frame and
+// applies only the difference: allocations created since the last call are added, replaced ones
+// removed, and the set is committed only when it changed. The set retains its allocations, so a
+// resource released by its owner stays alive until the next sync() drops it.
+class GpuResidency {
+public:
+    GpuResidency(MTL::Device* device, MTL::CommandQueue* commandQueue);
+    ~GpuResidency();
+
+    bool isSupported() const { return m_set != nullptr; }
+    // Another queue whose command buffers use the same resources (e.g. async compute)
+    void addCommandQueue(MTL::CommandQueue* commandQueue);
+
+    // Render thread, before the frame's command buffers are created; null entries are skipped
+    // (allocations is sorted in place)
+    void sync(std::vector<const MTL::Allocation*>& allocations);
+
+    size_t getAllocationCount() const { return m_resident.size(); }
+    uint64_t getAllocatedBytes() const { return m_set ? m_set->allocatedSize() : 0; }
+    int getCommitCount() const { return m_commits; } // Set commits so far (changes of the list)
+
+private:
+    std::vector<MTL::CommandQueue*> m_commandQueues; // Not retained
+    MTL::ResidencySet* m_set;
+    std::vector<const MTL::Allocation*> m_resident; // Sorted contents of the set
+    std::vector<const MTL::Allocation*> m_added;    // Scratch for sync()
+    std::vector<const MTL::Allocation*> m_removed;
+    int m_commits;
+};
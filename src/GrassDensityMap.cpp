@@ -0,0 +1,240 @@
+#include "GrassDensityMap.hpp"
+#include "ComputeDispatch.hpp"
+#include "ShaderTypes.h"
+#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// PCG hash (matches pcgHash() in GrassGenerate.metal)
+static uint32_t pcgHash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Smooth value noise in [0, 1] with one lattice cell per unit
+static float valueNoise(float x, float z, uint32_t seed)
+{
+    float ix = std::floor(x);
+    float iz = std::floor(z);
+    float fx = x - ix;
+    float fz = z - iz;
+    float ux = fx * fx * (3.0f - 2.0f * fx);
+    float uz = fz * fz * (3.0f - 2.0f * fz);
+
+    auto lattice = [seed](float cx, float cz) {
+        uint32_t h = pcgHash(static_cast<uint32_t>(static_cast<int32_t>(cx)) ^ pcgHash(static_cast<uint32_t>(static_cast<int32_t>(cz)) ^ seed));
+        return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+    };
+    float a = lattice(ix, iz);
+    float b = lattice(ix + 1.0f, iz);
+    float c = lattice(ix, iz + 1.0f);
+    float d = lattice(ix + 1.0f, iz + 1.0f);
+    float row0 = a + (b - a) * ux;
+    float row1 = c + (d - c) * ux;
+    return row0 + (row1 - row0) * uz;
+}
+
+static float smoothstep(float edge0, float edge1, float x)
+{
+    float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+GrassDensityMap::GrassDensityMap(MTL::Device* device, float halfSize, uint32_t seed, const std::string& path)
+    : m_halfSize(halfSize)
+    , m_width(0)
+    , m_height(0)
+    , m_authored(false)
+    , m_texture(nullptr)
+    , m_paintScratch(nullptr)
+    , m_lastPaint(nullptr)
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* imageData = path.empty() ? nullptr : stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (imageData) {
+        m_width = width;
+        m_height = height;
+        m_texels.resize(static_cast<size_t>(width) * height * 2);
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+            m_texels[i * 2 + 0] = imageData[i * 4 + 0];
+            m_texels[i * 2 + 1] = imageData[i * 4 + 1];
+        }
+        stbi_image_free(imageData);
+        m_authored = true;
+    } else {
+        generateProcedural(seed);
+    }
+
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(MTL::PixelFormatRG8Unorm);
+    descriptor->setWidth(m_width);
+    descriptor->setHeight(m_height);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+
+    m_texture = device->newTexture(descriptor);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    m_paintScratch = device->newTexture(descriptor);
+    descriptor->release();
+
+    if (!m_texture) {
+        std::cerr << "Failed to create grass density map" << std::endl;
+        return;
+    }
+    m_texture->setLabel(NS::String::string("Grass Density", NS::UTF8StringEncoding));
+    m_texture->replaceRegion(MTL::Region::Make2D(0, 0, m_width, m_height), 0, m_texels.data(), m_width * 2);
+
+    std::cout << "Grass density: " << (m_authored ? path : std::string("procedural")) << " mask, "
+              << static_cast<int>(getCoverage() * 100.0f + 0.5f) << "% coverage" << std::endl;
+}
+
+GrassDensityMap::~GrassDensityMap()
+{
+    if (m_lastPaint) {
+        m_lastPaint->release();
+    }
+    if (m_paintScratch) {
+        m_paintScratch->release();
+    }
+    if (m_texture) {
+        m_texture->release();
+    }
+}
+
+bool GrassDensityMap::encodePaint(MTL::CommandBuffer* commandBuffer, MTL::ComputePipelineState* pipeline,
+                                  const ComputeDispatch& dispatch, const Dab& dab)
+{
+    if (!m_texture || !m_paintScratch || !pipeline || dab.radius <= 0.0f) {
+        return false;
+    }
+
+    // Texel rectangle under the dab, clipped to the mask
+    float texelsPerMeter = static_cast<float>(m_width) / (2.0f * m_halfSize);
+    simd::float2 center = (dab.center + m_halfSize) * texelsPerMeter;
+    float radius = dab.radius * texelsPerMeter;
+    int x0 = std::max(static_cast<int>(std::floor(center.x - radius)), 0);
+    int z0 = std::max(static_cast<int>(std::floor(center.y - radius)), 0);
+    int x1 = std::min(static_cast<int>(std::ceil(center.x + radius)), m_width);
+    int z1 = std::min(static_cast<int>(std::ceil(center.y + radius)), m_height);
+    if (x0 >= x1 || z0 >= z1) {
+        return false;
+    }
+
+    GrassPaintUniforms params;
+    params.origin = simd::make_uint2(static_cast<uint32_t>(x0), static_cast<uint32_t>(z0));
+    params.size = simd::make_uint2(static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(z1 - z0));
+    params.center = center;
+    params.radius = radius;
+    params.hardness = std::clamp(dab.hardness, 0.0f, 1.0f);
+    params.strength = std::clamp(dab.strength, 0.0f, 1.0f);
+    params.density = std::clamp(dab.density, 0.0f, 1.0f);
+    params.species = std::clamp(dab.species, 0.0f, 1.0f);
+    params.paintSpecies = dab.species >= 0.0f ? 1u : 0u;
+
+    MTL::Size size = MTL::Size::Make(params.size.x, params.size.y, 1);
+    MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+    blitEncoder->copyFromTexture(m_texture, 0, 0, MTL::Origin::Make(x0, z0, 0), size, m_paintScratch, 0, 0, MTL::Origin::Make(0, 0, 0));
+    blitEncoder->endEncoding();
+
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
+    encoder->setComputePipelineState(pipeline);
+    encoder->setTexture(m_paintScratch, GrassPaintTextureIndexPrevious);
+    encoder->setTexture(m_texture, GrassPaintTextureIndexMask);
+    encoder->setBytes(&params, sizeof(params), 0);
+    dispatch.dispatch(encoder, pipeline, size);
+    encoder->endEncoding();
+
+    if (m_lastPaint) {
+        m_lastPaint->release();
+    }
+    m_lastPaint = commandBuffer->retain();
+    return true;
+}
+
+void GrassDensityMap::syncHostCopy()
+{
+    if (!m_lastPaint) {
+        return;
+    }
+    m_lastPaint->waitUntilCompleted();
+    m_lastPaint->release();
+    m_lastPaint = nullptr;
+    m_texture->getBytes(m_texels.data(), m_width * 2, MTL::Region::Make2D(0, 0, m_width, m_height), 0);
+}
+
+void GrassDensityMap::generateProcedural(uint32_t seed)
+{
+    m_width = kProceduralSize;
+    m_height = kProceduralSize;
+    m_texels.resize(static_cast<size_t>(m_width) * m_height * 2);
+
+    float spacing = 2.0f * m_halfSize / static_cast<float>(kProceduralSize);
+    for (int z = 0; z < m_height; ++z) {
+        for (int x = 0; x < m_width; ++x) {
+            // Texel centers
+            float worldX = -m_halfSize + (static_cast<float>(x) + 0.5f) * spacing;
+            float worldZ = -m_halfSize + (static_cast<float>(z) + 0.5f) * spacing;
+
+            // A trodden path winding along Z: bare in the middle, thinning at the edges
+            float pathX = 3.5f * std::sin(worldZ * 0.21f + 0.7f) + 1.5f * std::sin(worldZ * 0.53f);
+            float path = smoothstep(0.5f, 1.4f, std::fabs(worldX - pathX));
+
+            // Bare earth and rocks: the high ends of a coarse noise
+            float patches = 1.0f - smoothstep(0.62f, 0.72f, valueNoise(worldX / 3.5f, worldZ / 3.5f, pcgHash(seed)));
+
+            // Lush and sparse meadow
+            float lushness = 0.45f + 0.55f * valueNoise(worldX / 1.6f, worldZ / 1.6f, pcgHash(seed + 1u));
+
+            float density = path * patches * lushness;
+            float species = smoothstep(0.3f, 0.7f, valueNoise(worldX / 6.0f, worldZ / 6.0f, pcgHash(seed + 2u)));
+
+            size_t index = (static_cast<size_t>(z) * m_width + x) * 2;
+            m_texels[index + 0] = static_cast<uint8_t>(std::clamp(density, 0.0f, 1.0f) * 255.0f + 0.5f);
+            m_texels[index + 1] = static_cast<uint8_t>(std::clamp(species, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+simd::float2 GrassDensityMap::texel(int x, int z) const
+{
+    x = std::clamp(x, 0, m_width - 1);
+    z = std::clamp(z, 0, m_height - 1);
+    size_t index = (static_cast<size_t>(z) * m_width + x) * 2;
+    return simd::make_float2(m_texels[index] / 255.0f, m_texels[index + 1] / 255.0f);
+}
+
+simd::float2 GrassDensityMap::sampleAt(float x, float z) const
+{
+    // Texel centers at (i + 0.5) / size, clamped to the edge like the kernel's sampler
+    float gridX = (x + m_halfSize) / (2.0f * m_halfSize) * static_cast<float>(m_width) - 0.5f;
+    float gridZ = (z + m_halfSize) / (2.0f * m_halfSize) * static_cast<float>(m_height) - 0.5f;
+    float baseX = std::floor(gridX);
+    float baseZ = std::floor(gridZ);
+    float fx = gridX - baseX;
+    float fz = gridZ - baseZ;
+    int ix = static_cast<int>(baseX);
+    int iz = static_cast<int>(baseZ);
+
+    simd::float2 row0 = texel(ix, iz) + (texel(ix + 1, iz) - texel(ix, iz)) * fx;
+    simd::float2 row1 = texel(ix, iz + 1) + (texel(ix + 1, iz + 1) - texel(ix, iz + 1)) * fx;
+    return row0 + (row1 - row0) * fz;
+}
+
+float GrassDensityMap::getCoverage() const
+{
+    if (m_texels.empty()) {
+        return 0.0f;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < m_texels.size(); i += 2) {
+        sum += m_texels[i];
+    }
+    return static_cast<float>(sum) / (255.0f * static_cast<float>(m_texels.size() / 2));
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <simd/simd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ComputeDispatch;
+
+// Where grass grows over the field: an RG8 mask spanning [-halfSize, +halfSize] with the blade
+// density in R (0 = bare earth, paths, rocks; 1 = the full blades per cell) and the species in G
+// (selects the dominant albedo variant). The generation kernel and the CPU fallback reject
+// candidate blades against it, so bare ground costs no instances at all.
+// Authored masks are loaded from an image (R and G channels); without one a procedural meadow
+// with a winding path and bare patches is generated. Brush dabs paint the texture on the GPU;
+// the host copy follows only when syncHostCopy() is called.
+class GrassDensityMap {
+public:
+    // Loads path when it is readable, otherwise generates the procedural mask from seed
+    GrassDensityMap(MTL::Device* device, float halfSize, uint32_t seed, const std::string& path);
+    ~GrassDensityMap();
+
+    // One brush dab (world units; density and species targets in [0, 1], species < 0 keeps it)
+    struct Dab {
+        simd::float2 center;
+        float radius;
+        float density;
+        float species;
+        float strength;
+        float hardness;
+    };
+
+    MTL::Texture* getMetalTexture() const { return m_texture; }
+    bool isAuthored() const { return m_authored; }
+
+    // Encode a dab into commandBuffer (a copy of its rectangle, then pipeline, paintGrassDensity);
+    // false when it misses the mask
+    bool encodePaint(MTL::CommandBuffer* commandBuffer, MTL::ComputePipelineState* pipeline,
+                     const ComputeDispatch& dispatch, const Dab& dab);
+    // Bring the host copy (sampleAt, getCoverage) up to date with the painted texture; waits for the last dab
+    void syncHostCopy();
+
+    // Bilinear (density, species) at a world XZ position (matches the linear sampler of the kernel)
+    simd::float2 sampleAt(float x, float z) const;
+    // Mean density over the mask: the fraction of candidate blades that survive
+    float getCoverage() const;
+
+private:
+    static constexpr int kProceduralSize = 256;
+
+    void generateProcedural(uint32_t seed);
+    simd::float2 texel(int x, int z) const;
+
+    float m_halfSize;
+    int m_width;
+    int m_height;
+    std::vector<uint8_t> m_texels; // Row-major RG pairs
+    bool m_authored;
+    MTL::Texture* m_texture;
+    MTL::Texture* m_paintScratch;      // Texels under a dab before it (private, mask-sized)
+    MTL::CommandBuffer* m_lastPaint;   // Last dab's command buffer until the host copy caught up (or null)
+};
@@ -0,0 +1,248 @@
+#include "GrassField.hpp"
+#include "GrassDensityMap.hpp"
+#include "JobSystem.hpp"
+#include "TerrainHeightmap.hpp"
+#include <algorithm>
+#include <random>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+GrassField::GrassField(float halfSize, int cellsPerSide, float bladeRadius)
+    : m_halfSize(halfSize)
+    , m_cellsPerSide(std::max(1, cellsPerSide))
+    , m_cellSize(0.0f)
+    , m_bladeRadius(bladeRadius)
+{
+    m_cellSize = (2.0f * m_halfSize) / static_cast<float>(m_cellsPerSide);
+}
+
+int GrassField::cellIndexAt(float x, float z) const
+{
+    int cx = static_cast<int>((x + m_halfSize) / m_cellSize);
+    int cz = static_cast<int>((z + m_halfSize) / m_cellSize);
+    cx = std::clamp(cx, 0, m_cellsPerSide - 1);
+    cz = std::clamp(cz, 0, m_cellsPerSide - 1);
+    return cz * m_cellsPerSide + cx;
+}
+
+uint32_t GrassField::packAttributes(float hash, float tilt, float idlePhase, uint32_t flags)
+{
+    auto unorm8 = [](float v) -> uint32_t {
+        v = std::clamp(v, 0.0f, 1.0f);
+        return static_cast<uint32_t>(std::lround(v * 255.0f));
+    };
+    
+    const float twoPi = 6.28318f;
+    float phase01 = std::fmod(idlePhase, twoPi) / twoPi;
+    if (phase01 < 0.0f) {
+        phase01 += 1.0f;
+    }
+    
+    return unorm8(hash)
+         | (unorm8(tilt / INSTANCE_MAX_TILT * 0.5f + 0.5f) << 8)
+         | (unorm8(phase01) << 16)
+         | ((flags & 0xFFu) << 24);
+}
+
+InstanceData GrassField::packInstance(simd::float3 position, float rotation, float scale, uint32_t albedoVariant, uint32_t species,
+                                      uint32_t attributes) const
+{
+    auto unorm16 = [](float v) -> uint32_t {
+        v = std::clamp(v, 0.0f, 1.0f);
+        return static_cast<uint32_t>(std::lround(v * 65535.0f));
+    };
+    
+    float extent = 2.0f * m_halfSize;
+    float u = (position.x + m_halfSize) / extent;
+    float v = (position.z + m_halfSize) / extent;
+    
+    // Y as IEEE half (storage-only __fp16 conversion)
+    __fp16 halfY = static_cast<__fp16>(position.y);
+    uint16_t halfBits = 0;
+    std::memcpy(&halfBits, &halfY, sizeof(halfBits));
+    
+    // Wrap rotation into [0, 2*PI)
+    const float twoPi = 6.28318f;
+    float wrapped = std::fmod(rotation, twoPi);
+    if (wrapped < 0.0f) {
+        wrapped += twoPi;
+    }
+    
+    InstanceData instance;
+    instance.positionXZ = unorm16(u) | (unorm16(v) << 16);
+    instance.heightScale = static_cast<uint32_t>(halfBits) | (unorm16(scale / INSTANCE_MAX_SCALE) << 16);
+    instance.rotationType = (unorm16(wrapped / twoPi) & 0xFFFFu) | ((albedoVariant & 0xFFu) << 16) | ((species & 0xFFu) << 24);
+    instance.attributes = attributes;
+    return instance;
+}
+
+simd::float3 GrassField::unpackPosition(const InstanceData& instance) const
+{
+    float extent = 2.0f * m_halfSize;
+    float u = static_cast<float>(instance.positionXZ & 0xFFFFu) / 65535.0f;
+    float v = static_cast<float>(instance.positionXZ >> 16) / 65535.0f;
+    
+    uint16_t halfBits = static_cast<uint16_t>(instance.heightScale & 0xFFFFu);
+    __fp16 halfY;
+    std::memcpy(&halfY, &halfBits, sizeof(halfBits));
+    
+    return simd::make_float3(-m_halfSize + u * extent, static_cast<float>(halfY), -m_halfSize + v * extent);
+}
+
+void GrassField::generate(int instanceCount, uint32_t seed, const TerrainHeightmap& terrain,
+                          const GrassDensityMap* densityMap, JobSystem* jobs)
+{
+    // Blades are dealt to the cells in turn; within a cell they follow the shifted R2 sequence, so
+    // every prefix of the cell (in generation order, kept by buildCells) covers it evenly. Every cell
+    // draws from its own random stream, so the cells generate in parallel with the same result.
+    const int cellCount = getCellCount();
+    instanceCount = std::max(0, instanceCount);
+    std::vector<std::vector<BladeSample>> cellBlades(cellCount);
+
+    auto generateCell = [&](uint32_t cell) {
+        std::seed_seq cellSeed{ seed, cell };
+        std::mt19937 gen(cellSeed);
+        std::uniform_real_distribution<float> rotDist(0.0f, 360.0f);
+        std::uniform_real_distribution<float> scaleDist(0.8f, 1.2f);
+        std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+
+        float offsetU = unitDist(gen);
+        float offsetV = unitDist(gen);
+        int bladeCount = instanceCount / cellCount + (static_cast<int>(cell) < instanceCount % cellCount ? 1 : 0);
+        std::vector<BladeSample>& blades = cellBlades[cell];
+        blades.reserve(static_cast<size_t>(bladeCount));
+
+        for (int i = 0; i < bladeCount; ++i) {
+            BladeSample blade;
+
+            // Position: point i of the cell's progressive sequence, y on the terrain
+            float k = static_cast<float>(i);
+            float u = offsetU + k * GRASS_PROGRESSIVE_STEP_X;
+            float v = offsetV + k * GRASS_PROGRESSIVE_STEP_Y;
+            float x = -m_halfSize + (static_cast<float>(cell % m_cellsPerSide) + (u - std::floor(u))) * m_cellSize;
+            float z = -m_halfSize + (static_cast<float>(cell / m_cellsPerSide) + (v - std::floor(v))) * m_cellSize;
+            float y = terrain.heightAt(x, z) + GRASS_INSTANCE_ELEVATION;
+            blade.position = simd::make_float3(x, y, z);
+
+            // Rotation: Random rotation around Y-axis (0 to 360 degrees)
+            blade.rotation = rotDist(gen) * (3.14159265f / 180.0f);
+
+            // Scale: Random scale between 0.8 and 1.2 for variety
+            blade.scale = scaleDist(gen);
+
+            // Baked attributes: variation hash, ±15 degree tilt, idle phase, 10% withered yellow
+            float hash = unitDist(gen);
+            float tilt = (unitDist(gen) - 0.5f) * 2.0f * INSTANCE_MAX_TILT;
+            float idlePhase = unitDist(gen) * 6.28318f;
+            uint32_t flags = (unitDist(gen) > 0.9f) ? INSTANCE_FLAG_YELLOW : 0u;
+            blade.attributes = packAttributes(hash, tilt, idlePhase, flags);
+
+            // Albedo array slice
+            blade.albedoVariant = std::min(static_cast<uint32_t>(unitDist(gen) * GRASS_ALBEDO_VARIANT_COUNT), GRASS_ALBEDO_VARIANT_COUNT - 1u);
+
+            // Clover and flowers among the grass (same shares as the kernel)
+            blade.species = grassSpeciesFromUnit(unitDist(gen));
+
+            // Density mask: rejection sampling, and the species' dominant variant (same rule as the kernel)
+            if (densityMap) {
+                simd::float2 mask = densityMap->sampleAt(x, z);
+                float accept = unitDist(gen);
+                float dominant = unitDist(gen);
+                if (accept >= mask.x) {
+                    continue;
+                }
+                if (dominant < GRASS_SPECIES_DOMINANCE) {
+                    blade.albedoVariant = std::min(static_cast<uint32_t>(mask.y * GRASS_ALBEDO_VARIANT_COUNT), GRASS_ALBEDO_VARIANT_COUNT - 1u);
+                }
+            }
+            blades.push_back(blade);
+        }
+    };
+    if (jobs) {
+        jobs->parallelFor(static_cast<uint32_t>(cellCount), generateCell, kCellsPerJob);
+    } else {
+        for (int cell = 0; cell < cellCount; ++cell) {
+            generateCell(static_cast<uint32_t>(cell));
+        }
+    }
+
+    // Cell order, each cell in generation order
+    size_t total = 0;
+    for (const std::vector<BladeSample>& blades : cellBlades) {
+        total += blades.size();
+    }
+    std::vector<BladeSample> unsorted;
+    unsorted.reserve(total);
+    for (const std::vector<BladeSample>& blades : cellBlades) {
+        unsorted.insert(unsorted.end(), blades.begin(), blades.end());
+    }
+
+    buildCells(unsorted, terrain, jobs);
+}
+
+void GrassField::buildCells(const std::vector<BladeSample>& unsorted, const TerrainHeightmap& terrain, JobSystem* jobs)
+{
+    const int cellCount = getCellCount();
+
+    // Counting sort by cell: histogram, prefix sum, scatter
+    std::vector<uint32_t> cellOf(unsorted.size());
+    std::vector<uint32_t> counts(cellCount, 0);
+
+    for (size_t i = 0; i < unsorted.size(); ++i) {
+        cellOf[i] = static_cast<uint32_t>(cellIndexAt(unsorted[i].position.x, unsorted[i].position.z));
+        counts[cellOf[i]]++;
+    }
+
+    m_cells.assign(cellCount, GrassCell{});
+    uint32_t offset = 0;
+    for (int c = 0; c < cellCount; ++c) {
+        m_cells[c].firstInstance = offset;
+        m_cells[c].instanceCount = counts[c];
+        offset += counts[c];
+    }
+
+    m_instances.resize(unsorted.size());
+    std::vector<uint32_t> cursor(cellCount);
+    for (int c = 0; c < cellCount; ++c) {
+        cursor[c] = m_cells[c].firstInstance;
+    }
+    for (size_t i = 0; i < unsorted.size(); ++i) {
+        const BladeSample& blade = unsorted[i];
+        m_instances[cursor[cellOf[i]]++] = packInstance(blade.position, blade.rotation, blade.scale, blade.albedoVariant, blade.species,
+                                                        blade.attributes);
+    }
+
+    // Per-cell bounds: blade centers expanded by the blade radius.
+    // Empty cells keep the cell footprint (at the ground height of its center) so they still cull cheaply.
+    auto boundCell = [&](uint32_t c) {
+        GrassCell& cell = m_cells[c];
+        int cx = c % m_cellsPerSide;
+        int cz = c / m_cellsPerSide;
+
+        simd::float3 lo = simd::make_float3(FLT_MAX, FLT_MAX, FLT_MAX);
+        simd::float3 hi = simd::make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.instanceCount; ++i) {
+            simd::float3 p = unpackPosition(m_instances[i]);
+            lo = simd::min(lo, p);
+            hi = simd::max(hi, p);
+        }
+        if (cell.instanceCount == 0) {
+            float x0 = -m_halfSize + cx * m_cellSize;
+            float z0 = -m_halfSize + cz * m_cellSize;
+            float y = terrain.heightAt(x0 + 0.5f * m_cellSize, z0 + 0.5f * m_cellSize) + GRASS_INSTANCE_ELEVATION;
+            lo = simd::make_float3(x0, y, z0);
+            hi = simd::make_float3(x0 + m_cellSize, y, z0 + m_cellSize);
+        }
+
+        cell.boundsMin = simd::make_float4(lo - m_bladeRadius, 0.0f);
+        cell.boundsMax = simd::make_float4(hi + m_bladeRadius, 0.0f);
+    };
+    if (jobs) {
+        jobs->parallelFor(static_cast<uint32_t>(cellCount), boundCell, kCellsPerJob);
+    } else {
+        for (int c = 0; c < cellCount; ++c) {
+            boundCell(static_cast<uint32_t>(c));
+        }
+    }
+}
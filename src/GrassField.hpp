@@ -0,0 +1,64 @@
+#pragma once
+#include "ShaderTypes.h"
+#include <vector>
+#include <cstdint>
+
+class GrassDensityMap;
+class JobSystem;
+class TerrainHeightmap;
+
+// Grass instances bucketed into a fixed XZ grid of cells.
+// Instances are stored sorted by cell so every cell is a contiguous
+// [firstInstance, firstInstance + instanceCount) range with its own bounds.
+// Culling, LOD and streaming work per cell instead of per blade.
+class GrassField {
+public:
+    GrassField(float halfSize, int cellsPerSide, float bladeRadius);
+
+    // Scatter instanceCount candidate blades evenly over the cells (in progressive order within each
+    // cell), keep those the density map accepts (all without one), root them on the terrain and
+    // bucket them by cell. With a job system the cells are generated in parallel (same result).
+    void generate(int instanceCount, uint32_t seed, const TerrainHeightmap& terrain,
+                  const GrassDensityMap* densityMap = nullptr, JobSystem* jobs = nullptr);
+
+    const std::vector<InstanceData>& getInstances() const { return m_instances; }
+    const std::vector<GrassCell>& getCells() const { return m_cells; }
+
+    int getCellsPerSide() const { return m_cellsPerSide; }
+    int getCellCount() const { return m_cellsPerSide * m_cellsPerSide; }
+    float getCellSize() const { return m_cellSize; }
+    float getHalfSize() const { return m_halfSize; }
+
+    // Cell containing a world XZ position (clamped to the grid)
+    int cellIndexAt(float x, float z) const;
+
+    // Quantize a blade into the 16-byte InstanceData layout (see ShaderTypes.h)
+    InstanceData packInstance(simd::float3 position, float rotation, float scale, uint32_t albedoVariant, uint32_t species,
+                              uint32_t attributes) const;
+    // Pack baked attributes (matches packInstanceAttributes() in the shaders)
+    static uint32_t packAttributes(float hash, float tilt, float idlePhase, uint32_t flags);
+    // Decode the world position of a packed instance (matches instancePosition() in the shaders)
+    simd::float3 unpackPosition(const InstanceData& instance) const;
+
+private:
+    // Unquantized blade used during generation
+    struct BladeSample {
+        simd::float3 position;
+        float rotation;   // Radians around Y
+        float scale;
+        uint32_t albedoVariant;
+        uint32_t species;
+        uint32_t attributes; // Baked variation hash, tilt, idle phase and flags
+    };
+
+    static constexpr uint32_t kCellsPerJob = 16; // Grain of the parallel loops
+
+    void buildCells(const std::vector<BladeSample>& unsorted, const TerrainHeightmap& terrain, JobSystem* jobs);
+
+    float m_halfSize;        // Field spans [-halfSize, +halfSize] on X and Z
+    int m_cellsPerSide;      // Grid resolution
+    float m_cellSize;        // World size of one cell
+    float m_bladeRadius;     // Bounding radius added to cell bounds
+    std::vector<InstanceData> m_instances; // Sorted by cell
+    std::vector<GrassCell> m_cells;
+};
@@ -0,0 +1,184 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Compute shader for procedural grass placement
+// Writes the packed instance buffer and the cell table directly in GPU memory,
+// so startup cost does not grow with blade count and density changes need no CPU rebuild.
+
+// PCG hash (integer, stateless): good distribution from sequential inputs
+static uint pcgHash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Uniform float in [0, 1) from a hash value
+static float hashToUnit(uint h) {
+    return float(h >> 8) * (1.0 / 16777216.0);
+}
+
+// One threadgroup per cell. The cell's bladesPerCell candidates are placed in progressive order
+// inside its footprint (every prefix evenly spread, see GRASS_PROGRESSIVE_STEP_X) and rooted on the
+// terrain; the density mask rejects candidates, and the survivors are compacted in candidate order
+// to the front of the cell's slot range, so bare cells list no instances and the density LOD of
+// the cull pass can draw any prefix of a cell. Unused slots are cleared to zero-scale blades for the
+// passes that walk the instance buffer linearly. A dispatch covers a rectangle of cells (the whole
+// field, or the cells a density brush stroke touched).
+kernel void generateGrassInstances(
+    device InstanceData *instances [[buffer(GenerateBufferIndexInstances)]],
+    device GrassCell *cells [[buffer(GenerateBufferIndexCells)]],
+    constant GrassGenerateUniforms &params [[buffer(GenerateBufferIndexUniforms)]],
+    device atomic_uint *placedCount [[buffer(GenerateBufferIndexPlacedCount)]],
+    texture2d<float> heightmap [[texture(0)]],
+    texture2d<float> densityMap [[texture(1)]],
+    uint groupIndex [[threadgroup_position_in_grid]],
+    uint tid [[thread_index_in_threadgroup]],
+    uint threadsPerGroup [[threads_per_threadgroup]],
+    uint simdLane [[thread_index_in_simdgroup]],
+    uint simdIndex [[simdgroup_index_in_threadgroup]],
+    uint simdCount [[simdgroups_per_threadgroup]]
+) {
+    constexpr sampler densitySampler(filter::linear, address::clamp_to_edge);
+    threadgroup uint simdAccepted[32]; // Per-simdgroup survivors of the current batch
+
+    uint2 cellCoord = params.firstCell + uint2(groupIndex % params.cellSpan, groupIndex / params.cellSpan);
+    if (params.bladesPerCell == 0 || any(cellCoord >= params.cellsPerSide)) {
+        return;
+    }
+    uint cellIndex = cellCoord.y * params.cellsPerSide + cellCoord.x;
+
+    float2 cellSize = (params.fieldMaxXZ - params.fieldMinXZ) / float(params.cellsPerSide);
+    float2 cellMin = params.fieldMinXZ + float2(cellCoord) * cellSize;
+    uint firstSlot = cellIndex * params.bladesPerCell;
+    uint cellHash = pcgHash(cellIndex ^ pcgHash(params.seed ^ 0x9E3779B9u));
+    float2 cellOffset = float2(hashToUnit(cellHash), hashToUnit(pcgHash(cellHash)));
+
+    // Batches of one candidate per thread (the loop count is uniform across the threadgroup)
+    uint accepted = 0;
+    for (uint batch = 0; batch < params.bladesPerCell; batch += threadsPerGroup) {
+        uint candidate = batch + tid;
+        uint gid = firstSlot + candidate;
+
+        // Independent random streams per candidate
+        uint h0 = pcgHash(gid ^ pcgHash(params.seed));
+        uint h1 = pcgHash(h0);
+        uint h2 = pcgHash(h1);
+        uint h3 = pcgHash(h2);
+        uint h4 = pcgHash(h3);
+        uint h5 = pcgHash(h4);
+        uint h6 = pcgHash(h5);
+        uint h7 = pcgHash(h6);
+        uint h8 = pcgHash(h7);
+        uint h9 = pcgHash(h8);
+        uint h10 = pcgHash(h9);
+        uint h11 = pcgHash(h10);
+
+        float2 progressive = fract(cellOffset + float(candidate) * float2(GRASS_PROGRESSIVE_STEP_X, GRASS_PROGRESSIVE_STEP_Y));
+        float2 xz = cellMin + progressive * cellSize;
+        float2 uv = (xz - params.fieldMinXZ) / (params.fieldMaxXZ - params.fieldMinXZ);
+        float2 mask = params.useDensityMap != 0 ? densityMap.sample(densitySampler, uv).rg : float2(1.0, 0.0);
+        bool keep = candidate < params.bladesPerCell && hashToUnit(h9) < mask.r;
+
+        // Survivors before this thread: simdgroup prefix, then the lower simdgroups of the batch
+        uint simdOffset = simd_prefix_exclusive_sum(keep ? 1u : 0u);
+        uint simdTotal = simd_sum(keep ? 1u : 0u);
+        if (simdLane == 0) {
+            simdAccepted[simdIndex] = simdTotal;
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        uint offset = accepted + simdOffset;
+        uint batchTotal = 0;
+        for (uint i = 0; i < simdCount; ++i) {
+            offset += (i < simdIndex) ? simdAccepted[i] : 0u;
+            batchTotal += simdAccepted[i];
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        accepted += batchTotal;
+
+        if (keep) {
+            float rotation = hashToUnit(h2) * 6.28318;
+            float scale = mix(params.minScale, params.maxScale, hashToUnit(h3));
+
+            // Baked per-blade attributes (variation hash, tilt, idle phase, 10% withered yellow)
+            float tilt = (hashToUnit(h5) - 0.5) * 2.0 * INSTANCE_MAX_TILT;
+            uint flags = (hashToUnit(h7) > 0.9) ? INSTANCE_FLAG_YELLOW : 0u;
+            uint attributes = packInstanceAttributes(hashToUnit(h4), tilt, hashToUnit(h6) * 6.28318, flags);
+
+            // The species picks the dominant albedo variant of most blades on its texels
+            uint albedoVariant = h8 % GRASS_ALBEDO_VARIANT_COUNT;
+            if (params.useDensityMap != 0 && hashToUnit(h10) < GRASS_SPECIES_DOMINANCE) {
+                albedoVariant = min(uint(mask.g * float(GRASS_ALBEDO_VARIANT_COUNT)), uint(GRASS_ALBEDO_VARIANT_COUNT - 1));
+            }
+
+            // Clover and flowers are sprinkled through the grass (their own meshes and materials)
+            uint species = grassSpeciesFromUnit(hashToUnit(h11));
+
+            float y = terrainHeight(heightmap, xz, params.fieldMinXZ, params.fieldMaxXZ) + GRASS_INSTANCE_ELEVATION;
+            instances[firstSlot + offset] = packInstance(float3(xz.x, y, xz.y), rotation, scale, albedoVariant, species,
+                                                         attributes, params.fieldMinXZ, params.fieldMaxXZ);
+        }
+    }
+
+    // Clear the rejected tail of the slot range (zero scale: degenerate and skipped)
+    for (uint slot = accepted + tid; slot < params.bladesPerCell; slot += threadsPerGroup) {
+        InstanceData empty;
+        empty.positionXZ = 0;
+        empty.heightScale = 0;
+        empty.rotationType = 0;
+        empty.attributes = 0;
+        instances[firstSlot + slot] = empty;
+    }
+
+    // One thread writes the cell entry: survivor range, footprint bounds plus blade radius.
+    // Cells are terrain chunks, so the heights under the cell are its heightmap samples (the surface
+    // between them is bilinear and cannot leave their range).
+    if (tid == 0) {
+        uint2 firstSample = cellCoord * uint(TERRAIN_CHUNK_QUADS);
+        float2 heightRange = float2(INFINITY, -INFINITY);
+        for (uint sz = 0; sz <= TERRAIN_CHUNK_QUADS; ++sz) {
+            for (uint sx = 0; sx <= TERRAIN_CHUNK_QUADS; ++sx) {
+                float h = heightmap.read(firstSample + uint2(sx, sz)).r;
+                heightRange = float2(min(heightRange.x, h), max(heightRange.y, h));
+            }
+        }
+        heightRange += GRASS_INSTANCE_ELEVATION;
+
+        GrassCell cell;
+        cell.boundsMin = float4(cellMin.x - params.bladeRadius, heightRange.x - params.bladeRadius,
+                                cellMin.y - params.bladeRadius, 0.0);
+        cell.boundsMax = float4(cellMin.x + cellSize.x + params.bladeRadius, heightRange.y + params.bladeRadius,
+                                cellMin.y + cellSize.y + params.bladeRadius, 0.0);
+        cell.firstInstance = firstSlot;
+        cell.instanceCount = accepted;
+        cell.pad0 = 0;
+        cell.pad1 = 0;
+        uint previous = params.incremental != 0 ? cells[cellIndex].instanceCount : 0u;
+        cells[cellIndex] = cell;
+        atomic_fetch_add_explicit(placedCount, accepted - previous, memory_order_relaxed); // Wraps: adds a negative change
+    }
+}
+
+// Density / species brush: one thread per texel of the dab's rectangle blends the mask toward the
+// targets with a smooth falloff. RG8 textures cannot be read-write in a kernel, so the texels
+// come from a copy of the rectangle taken right before the dab.
+kernel void paintGrassDensity(
+    texture2d<float, access::read> previous [[texture(GrassPaintTextureIndexPrevious)]],
+    texture2d<float, access::write> mask [[texture(GrassPaintTextureIndexMask)]],
+    constant GrassPaintUniforms &params [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (any(gid >= params.size)) {
+        return;
+    }
+    uint2 texel = params.origin + gid;
+    float2 value = previous.read(gid).rg;
+    float distance = length(float2(texel) + 0.5 - params.center);
+    float weight = params.strength * (1.0 - smoothstep(params.hardness * params.radius, params.radius, distance));
+    value.r = mix(value.r, params.density, weight);
+    if (params.paintSpecies != 0) {
+        value.g = mix(value.g, params.species, weight);
+    }
+    mask.write(float4(value, 0.0, 1.0), texel);
+}
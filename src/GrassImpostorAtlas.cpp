@@ -0,0 +1,249 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE // Metal clip depth, as in Renderer.hpp
+#include "GrassImpostorAtlas.hpp"
+#include "PipelineArchive.hpp"
+#include "PipelineCache.hpp"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static constexpr MTL::PixelFormat kNormalFormat = MTL::PixelFormatRGBA8Unorm;
+static constexpr MTL::PixelFormat kBladeFormat = MTL::PixelFormatRGBA8Unorm;
+static constexpr MTL::PixelFormat kDepthFormat = MTL::PixelFormatR16Float;
+
+static simd::float4x4 toSimd(const glm::mat4& matrix)
+{
+    simd::float4x4 result;
+    std::memcpy(&result, glm::value_ptr(matrix), sizeof(result));
+    return result;
+}
+
+GrassImpostorAtlas::GrassImpostorAtlas(MTL::Device* device, MTL::Library* library, PipelineArchive* archive, float cellSize)
+    : m_device(device)
+    , m_bakePSO(nullptr)
+    , m_bakeDepthState(nullptr)
+    , m_normalTexture(nullptr)
+    , m_bladeTexture(nullptr)
+    , m_depthTexture(nullptr)
+    , m_bakeDepthBuffer(nullptr)
+    , m_calmWindField(nullptr)
+    , m_emptyInteractorBins(nullptr)
+    , m_uniforms()
+{
+    // Columns from grazing to steep; the cards clamp to the first and last
+    const float degrees[IMPOSTOR_ELEVATION_COUNT] = { 5.0f, 20.0f, 40.0f, 65.0f };
+    m_uniforms.elevations = simd::make_float4(glm::radians(degrees[0]), glm::radians(degrees[1]),
+                                              glm::radians(degrees[2]), glm::radians(degrees[3]));
+    // A cell seen along its diagonal, plus the blades leaning over its edges
+    m_uniforms.cardSize = cellSize * 1.4143f + 0.6f;
+
+    MTL::TextureUsage atlasUsage = MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead;
+    m_normalTexture = newAtlasTexture(kNormalFormat, atlasUsage, "normal");
+    m_bladeTexture = newAtlasTexture(kBladeFormat, atlasUsage, "blade");
+    m_depthTexture = newAtlasTexture(kDepthFormat, atlasUsage, "depth");
+    m_bakeDepthBuffer = newAtlasTexture(MTL::PixelFormatDepth32Float, MTL::TextureUsageRenderTarget, "z-buffer");
+
+    // Wind pointing along +X with no bend, in both slices of the field layout
+    MTL::TextureDescriptor* windDesc = MTL::TextureDescriptor::alloc()->init();
+    windDesc->setWidth(1);
+    windDesc->setHeight(1);
+    windDesc->setArrayLength(2);
+    windDesc->setPixelFormat(MTL::PixelFormatRGBA16Float);
+    windDesc->setTextureType(MTL::TextureType2DArray);
+    windDesc->setUsage(MTL::TextureUsageShaderRead);
+    windDesc->setStorageMode(MTL::StorageModeShared);
+    m_calmWindField = m_device->newTexture(windDesc);
+    windDesc->release();
+
+    if (m_calmWindField) {
+        const uint16_t calm[4] = { 0x3c00, 0, 0, 0 }; // Half (1, 0, 0, 0)
+        for (NS::UInteger slice = 0; slice < 2; ++slice) {
+            m_calmWindField->replaceRegion(MTL::Region::Make2D(0, 0, 1, 1), 0, slice, calm, sizeof(calm), sizeof(calm));
+        }
+    } else {
+        std::cerr << "Failed to create impostor bake wind field" << std::endl;
+    }
+
+    size_t binsSize = sizeof(InteractorBin) * INTERACTOR_BIN_GRID * INTERACTOR_BIN_GRID;
+    m_emptyInteractorBins = m_device->newBuffer(binsSize, MTL::ResourceStorageModeShared);
+    if (m_emptyInteractorBins) {
+        std::memset(m_emptyInteractorBins->contents(), 0, binsSize);
+    } else {
+        std::cerr << "Failed to create impostor bake interactor bins" << std::endl;
+    }
+
+    MTL::DepthStencilDescriptor* depthDesc = MTL::DepthStencilDescriptor::alloc()->init();
+    depthDesc->setDepthCompareFunction(MTL::CompareFunctionLess);
+    depthDesc->setDepthWriteEnabled(true);
+    m_bakeDepthState = m_device->newDepthStencilState(depthDesc);
+    depthDesc->release();
+
+    // Built once at setup, so synchronously (archive-backed like the compute pipelines)
+    MTL::Function* vertexFunction = PipelineCache::newFunction(library, "grassImpostorBakeVertex", {});
+    MTL::Function* fragmentFunction = PipelineCache::newFunction(library, "grassImpostorBakeFragment", {});
+    if (!vertexFunction || !fragmentFunction) {
+        std::cerr << "Failed to load impostor bake shader functions" << std::endl;
+        if (vertexFunction) vertexFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return;
+    }
+
+    MTL::RenderPipelineDescriptor* descriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    descriptor->setVertexFunction(vertexFunction);
+    descriptor->setFragmentFunction(fragmentFunction);
+    descriptor->colorAttachments()->object(0)->setPixelFormat(kNormalFormat);
+    descriptor->colorAttachments()->object(1)->setPixelFormat(kBladeFormat);
+    descriptor->colorAttachments()->object(2)->setPixelFormat(kDepthFormat);
+    descriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+    m_bakePSO = archive->newRenderPipeline(descriptor, "grassImpostorBake");
+
+    descriptor->release();
+    vertexFunction->release();
+    fragmentFunction->release();
+}
+
+GrassImpostorAtlas::~GrassImpostorAtlas()
+{
+    if (m_bakePSO) {
+        m_bakePSO->release();
+    }
+    if (m_bakeDepthState) {
+        m_bakeDepthState->release();
+    }
+    if (m_normalTexture) {
+        m_normalTexture->release();
+    }
+    if (m_bladeTexture) {
+        m_bladeTexture->release();
+    }
+    if (m_depthTexture) {
+        m_depthTexture->release();
+    }
+    if (m_bakeDepthBuffer) {
+        m_bakeDepthBuffer->release();
+    }
+    if (m_calmWindField) {
+        m_calmWindField->release();
+    }
+    if (m_emptyInteractorBins) {
+        m_emptyInteractorBins->release();
+    }
+}
+
+MTL::Texture* GrassImpostorAtlas::newAtlasTexture(MTL::PixelFormat format, MTL::TextureUsage usage, const char* what)
+{
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setWidth(IMPOSTOR_ELEVATION_COUNT * IMPOSTOR_FRAME_SIZE);
+    descriptor->setHeight(IMPOSTOR_VARIANT_COUNT * IMPOSTOR_FRAME_SIZE);
+    descriptor->setPixelFormat(format);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(usage);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+
+    MTL::Texture* texture = m_device->newTexture(descriptor);
+    descriptor->release();
+
+    if (!texture) {
+        std::cerr << "Failed to create impostor atlas " << what << " texture" << std::endl;
+    }
+    return texture;
+}
+
+void GrassImpostorAtlas::encodeBake(MTL::CommandBuffer* commandBuffer, const BakeSource& source)
+{
+    if (!isValid() || !m_bakeDepthBuffer || !m_calmWindField || !m_emptyInteractorBins || !m_bakeDepthState ||
+        !source.vertexBuffer || !source.indexBuffer || !source.instanceBuffer || !source.bladeTexture || !source.trampleMap) {
+        return;
+    }
+
+    // Uncovered texels stay zero: coverage 0 (the cards un-premultiply by it)
+    MTL::RenderPassDescriptor* passDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+    MTL::Texture* targets[3] = { m_normalTexture, m_bladeTexture, m_depthTexture };
+    for (NS::UInteger i = 0; i < 3; ++i) {
+        MTL::RenderPassColorAttachmentDescriptor* attachment = passDescriptor->colorAttachments()->object(i);
+        attachment->setTexture(targets[i]);
+        attachment->setLoadAction(MTL::LoadActionClear);
+        attachment->setStoreAction(MTL::StoreActionStore);
+        attachment->setClearColor(MTL::ClearColor(0.0, 0.0, 0.0, 0.0));
+    }
+    passDescriptor->depthAttachment()->setTexture(m_bakeDepthBuffer);
+    passDescriptor->depthAttachment()->setLoadAction(MTL::LoadActionClear);
+    passDescriptor->depthAttachment()->setStoreAction(MTL::StoreActionDontCare);
+    passDescriptor->depthAttachment()->setClearDepth(1.0);
+
+    MTL::RenderCommandEncoder* encoder = commandBuffer->renderCommandEncoder(passDescriptor);
+    passDescriptor->release();
+    if (!encoder) {
+        return;
+    }
+
+    encoder->setRenderPipelineState(m_bakePSO);
+    encoder->setDepthStencilState(m_bakeDepthState);
+    encoder->setCullMode(MTL::CullModeNone);
+    encoder->setVertexBuffer(source.vertexBuffer, 0, BufferIndexMeshPositions);
+    encoder->setVertexBuffer(source.instanceBuffer, 0, BufferIndexInstanceData);
+    encoder->setVertexBuffer(m_emptyInteractorBins, 0, BufferIndexInteractors);
+    encoder->setVertexBuffer(m_emptyInteractorBins, 0, BufferIndexInteractorBins);
+    encoder->setVertexTexture(source.trampleMap, TextureIndexTrampleMap);
+    encoder->setVertexTexture(m_calmWindField, TextureIndexWindField);
+    encoder->setFragmentTexture(source.bladeTexture, TextureIndexGrass);
+    encoder->setFragmentBytes(&m_uniforms, sizeof(GrassImpostorUniforms), BufferIndexImpostorUniforms);
+
+    // Bounds of the patch's field; no trample decay, flatten or density LOD in the bake
+    SceneConstants scene = {};
+    scene.groundMinXZ = source.fieldMinXZ;
+    scene.groundMaxXZ = source.fieldMaxXZ;
+    scene.grassMinXZ = source.fieldMinXZ;
+    scene.grassMaxXZ = source.fieldMaxXZ;
+    encoder->setVertexBytes(&scene, sizeof(SceneConstants), BufferIndexSceneConstants);
+
+    const float elevations[IMPOSTOR_ELEVATION_COUNT] = {
+        m_uniforms.elevations.x, m_uniforms.elevations.y, m_uniforms.elevations.z, m_uniforms.elevations.w
+    };
+    float halfSize = m_uniforms.cardSize * 0.5f;
+    glm::mat4 projection = glm::ortho(-halfSize, halfSize, -halfSize, halfSize,
+                                      kBakeDistance - halfSize, kBakeDistance + halfSize);
+
+    for (int variant = 0; variant < IMPOSTOR_VARIANT_COUNT; ++variant) {
+        if (source.instanceCount[variant] == 0) {
+            continue;
+        }
+        glm::vec3 center(source.center[variant].x, source.center[variant].y, source.center[variant].z);
+
+        for (int column = 0; column < IMPOSTOR_ELEVATION_COUNT; ++column) {
+            // Far along +Z at this elevation: the blades billboard toward the eye as they would toward a distant camera
+            glm::vec3 eye = center + glm::vec3(0.0f, std::sin(elevations[column]), std::cos(elevations[column])) * kBakeDistance;
+
+            // Deformation only reads the matrices, the clock and the trample window (bounds: scene constants)
+            Uniforms uniforms = {};
+            uniforms.viewMatrix = toSimd(glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f)));
+            uniforms.projectionMatrix = toSimd(projection);
+            uniforms.cameraPosition = simd::make_float3(eye.x, eye.y, eye.z);
+            uniforms.trampleWindowMinXZ = simd::make_float2(1.0e6f, 1.0e6f); // Far from every patch: untrampled
+            uniforms.trampleWindowSize = 1.0f;
+            encoder->setVertexBytes(&uniforms, sizeof(Uniforms), BufferIndexUniforms);
+            encoder->setFragmentBytes(&uniforms, sizeof(Uniforms), BufferIndexUniforms);
+
+            double originX = static_cast<double>(column * IMPOSTOR_FRAME_SIZE);
+            double originY = static_cast<double>(variant * IMPOSTOR_FRAME_SIZE);
+            MTL::Viewport viewport = { originX, originY, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE, 0.0, 1.0 };
+            encoder->setViewport(viewport);
+            encoder->setScissorRect(MTL::ScissorRect{ static_cast<NS::UInteger>(originX), static_cast<NS::UInteger>(originY),
+                                                      IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE });
+
+            encoder->drawIndexedPrimitives(
+                MTL::PrimitiveTypeTriangle,
+                NS::UInteger(source.indexCount),
+                MTL::IndexTypeUInt16,
+                source.indexBuffer,
+                NS::UInteger(source.indexStart * sizeof(uint16_t)),
+                NS::UInteger(source.instanceCount[variant]),
+                NS::Integer(source.baseVertex),
+                NS::UInteger(source.firstInstance[variant]));
+        }
+    }
+
+    encoder->endEncoding();
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "ShaderTypes.h"
+#include <cstdint>
+
+class PipelineArchive;
+
+// Baked far-field grass: IMPOSTOR_VARIANT_COUNT patches of real blades (one grass cell each),
+// rendered orthographically from IMPOSTOR_ELEVATION_COUNT view elevations into one atlas.
+// Blades billboard toward the camera, so a patch only changes with the elevation it is seen
+// from; the cards pick the two nearest elevation columns and blend them. Every frame stores the
+// lighting inputs rather than a color (normal, height along the blade, blade hash, withered
+// flag, depth behind the card), so the cards are lit like the blades they stand in for.
+class GrassImpostorAtlas {
+public:
+    // Patch blades to bake: LOD 0 strips of the instances in each variant's cell
+    struct BakeSource {
+        MTL::Buffer* vertexBuffer;
+        MTL::Buffer* indexBuffer;
+        uint32_t indexCount;   // LOD 0 mesh
+        uint32_t indexStart;
+        uint32_t baseVertex;
+        MTL::Buffer* instanceBuffer;
+        uint32_t firstInstance[IMPOSTOR_VARIANT_COUNT];
+        uint32_t instanceCount[IMPOSTOR_VARIANT_COUNT];
+        simd::float3 center[IMPOSTOR_VARIANT_COUNT]; // Patch center (the cell's bounds center)
+        MTL::Texture* bladeTexture;  // Alpha masks of the blade strips (2D array, one slice per albedo variant)
+        MTL::Texture* trampleMap;    // Bound for the shared blade deformation; never covers a patch
+        simd::float2 fieldMinXZ;     // Quantization bounds of the instances
+        simd::float2 fieldMaxXZ;
+    };
+
+    GrassImpostorAtlas(MTL::Device* device, MTL::Library* library, PipelineArchive* archive, float cellSize);
+    ~GrassImpostorAtlas();
+
+    // Render every (elevation, variant) frame of the atlas; the queue orders it before later frames
+    void encodeBake(MTL::CommandBuffer* commandBuffer, const BakeSource& source);
+
+    bool isValid() const { return m_bakePSO && m_normalTexture && m_bladeTexture && m_depthTexture; }
+    MTL::Texture* getNormalTexture() const { return m_normalTexture; }
+    MTL::Texture* getBladeTexture() const { return m_bladeTexture; }
+    MTL::Texture* getDepthTexture() const { return m_depthTexture; }
+    const GrassImpostorUniforms& getUniforms() const { return m_uniforms; }
+
+private:
+    static constexpr float kBakeDistance = 50.0f; // Eye distance of the bake views (blades billboard toward it)
+
+    MTL::Texture* newAtlasTexture(MTL::PixelFormat format, MTL::TextureUsage usage, const char* what);
+
+    MTL::Device* m_device;
+    MTL::RenderPipelineState* m_bakePSO;
+    MTL::DepthStencilState* m_bakeDepthState;
+    MTL::Texture* m_normalTexture;     // RGBA8: view-space normal * 0.5 + 0.5, a = coverage
+    MTL::Texture* m_bladeTexture;      // RGBA8: height along the blade, blade hash, withered flag
+    MTL::Texture* m_depthTexture;      // R16Float: meters behind the frame's front plane
+    MTL::Texture* m_bakeDepthBuffer;   // Z-buffer of the bake pass
+    MTL::Texture* m_calmWindField;     // 1x1 wind field without bend (patches are baked at rest)
+    MTL::Buffer* m_emptyInteractorBins; // Zeroed bins (and interactors): no flatten ring in a patch
+    GrassImpostorUniforms m_uniforms;
+};
@@ -0,0 +1,187 @@
+#include "GrassInstanceEditor.hpp"
+#include "UploadRing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+GrassInstanceEditor::GrassInstanceEditor(uint32_t cellCount, uint32_t cellCapacity)
+    : m_cellCapacity(std::max(cellCapacity, 1u))
+    , m_instanceCount(0)
+    , m_instances(static_cast<size_t>(cellCount) * std::max(cellCapacity, 1u))
+    , m_cells(cellCount)
+    , m_freeSlots(cellCount)
+    , m_dirtyRanges(cellCount, DirtyRange{ 0, 0 })
+    , m_cellDirty(cellCount, 0)
+{
+    std::memset(m_instances.data(), 0, m_instances.size() * sizeof(InstanceData));
+    std::memset(m_cells.data(), 0, m_cells.size() * sizeof(GrassCell));
+}
+
+bool GrassInstanceEditor::load(const InstanceData* instances, const GrassCell* cells)
+{
+    std::memset(m_instances.data(), 0, m_instances.size() * sizeof(InstanceData));
+    m_instanceCount = 0;
+    m_dirtyCells.clear();
+    std::fill(m_cellDirty.begin(), m_cellDirty.end(), 0);
+    for (uint32_t cell = 0; cell < getCellCount(); ++cell) {
+        const GrassCell& source = cells[cell];
+        if (source.instanceCount > m_cellCapacity) {
+            std::cerr << "Grass edits: cell " << cell << " holds " << source.instanceCount << " blades, more than its "
+                      << m_cellCapacity << " slots" << std::endl;
+            return false;
+        }
+        GrassCell& target = m_cells[cell];
+        target = source;
+        target.firstInstance = cell * m_cellCapacity;
+        std::memcpy(&m_instances[target.firstInstance], instances + source.firstInstance,
+                    source.instanceCount * sizeof(InstanceData));
+
+        // Empty slots inside the range (the generator's rejected candidates) are free from the start
+        std::vector<uint32_t>& freeSlots = m_freeSlots[cell];
+        freeSlots.clear();
+        for (uint32_t offset = 0; offset < target.instanceCount; ++offset) {
+            if (isEmpty(m_instances[target.firstInstance + offset])) {
+                freeSlots.push_back(offset);
+            } else {
+                m_instanceCount++;
+            }
+        }
+        // Trailing empty slots are not part of the range at all
+        while (target.instanceCount > 0 && !freeSlots.empty() && freeSlots.back() == target.instanceCount - 1) {
+            freeSlots.pop_back();
+            target.instanceCount--;
+        }
+        m_dirtyRanges[cell] = DirtyRange{ 0, 0 };
+    }
+    return true;
+}
+
+uint32_t GrassInstanceEditor::insert(uint32_t cell, const InstanceData& instance)
+{
+    if (cell >= getCellCount() || isEmpty(instance)) {
+        return kNoSlot;
+    }
+    GrassCell& entry = m_cells[cell];
+    std::vector<uint32_t>& freeSlots = m_freeSlots[cell];
+    uint32_t offset;
+    if (!freeSlots.empty()) {
+        offset = freeSlots.back();
+        freeSlots.pop_back();
+    } else if (entry.instanceCount < m_cellCapacity) {
+        offset = entry.instanceCount++;
+    } else {
+        return kNoSlot;
+    }
+    m_instances[entry.firstInstance + offset] = instance;
+    m_instanceCount++;
+    markDirty(cell, offset);
+    return entry.firstInstance + offset;
+}
+
+bool GrassInstanceEditor::remove(uint32_t slot)
+{
+    if (slot >= getSlotCount() || isEmpty(m_instances[slot])) {
+        return false;
+    }
+    uint32_t cell = cellOfSlot(slot);
+    GrassCell& entry = m_cells[cell];
+    uint32_t offset = slot - entry.firstInstance;
+    std::memset(&m_instances[slot], 0, sizeof(InstanceData));
+    m_instanceCount--;
+    markDirty(cell, offset);
+
+    // The last blade shortens the range (with the free slots it then ends on); others leave a hole
+    std::vector<uint32_t>& freeSlots = m_freeSlots[cell];
+    if (offset + 1 == entry.instanceCount) {
+        entry.instanceCount--;
+        while (entry.instanceCount > 0 && isEmpty(m_instances[entry.firstInstance + entry.instanceCount - 1])) {
+            entry.instanceCount--;
+        }
+        freeSlots.erase(std::remove_if(freeSlots.begin(), freeSlots.end(), [&](uint32_t free) {
+            return free >= entry.instanceCount;
+        }), freeSlots.end());
+    } else {
+        freeSlots.push_back(offset);
+    }
+    return true;
+}
+
+bool GrassInstanceEditor::modify(uint32_t slot, const InstanceData& instance)
+{
+    if (slot >= getSlotCount() || isEmpty(m_instances[slot])) {
+        return false;
+    }
+    if (isEmpty(instance)) {
+        return remove(slot);
+    }
+    m_instances[slot] = instance;
+    markDirty(cellOfSlot(slot), slot - m_cells[cellOfSlot(slot)].firstInstance);
+    return true;
+}
+
+void GrassInstanceEditor::includeBounds(uint32_t cell, simd::float3 boundsMin, simd::float3 boundsMax)
+{
+    if (cell >= getCellCount()) {
+        return;
+    }
+    GrassCell& entry = m_cells[cell];
+    entry.boundsMin = simd::make_float4(simd::min(entry.boundsMin.xyz, boundsMin), entry.boundsMin.w);
+    entry.boundsMax = simd::make_float4(simd::max(entry.boundsMax.xyz, boundsMax), entry.boundsMax.w);
+    markCellDirty(cell);
+}
+
+void GrassInstanceEditor::markDirty(uint32_t cell, uint32_t offset)
+{
+    DirtyRange& range = m_dirtyRanges[cell];
+    if (range.begin == range.end) {
+        range = DirtyRange{ offset, offset + 1 };
+    } else {
+        range.begin = std::min(range.begin, offset);
+        range.end = std::max(range.end, offset + 1);
+    }
+    markCellDirty(cell);
+}
+
+void GrassInstanceEditor::markCellDirty(uint32_t cell)
+{
+    if (!m_cellDirty[cell]) {
+        m_cellDirty[cell] = 1;
+        m_dirtyCells.push_back(cell);
+    }
+}
+
+size_t GrassInstanceEditor::flush(UploadRing* uploadRing, MTL::BlitCommandEncoder* blitEncoder, MTL::Buffer* instanceBuffer,
+                                  MTL::Buffer* cellBuffer, MTL::Buffer* bladeStateBuffer)
+{
+    if (m_dirtyCells.empty()) {
+        return 0;
+    }
+    size_t staged = 0;
+    uint32_t firstCell = m_dirtyCells.front();
+    uint32_t lastCell = firstCell;
+    for (uint32_t cell : m_dirtyCells) {
+        DirtyRange& range = m_dirtyRanges[cell];
+        uint32_t first = m_cells[cell].firstInstance + range.begin;
+        uint32_t count = range.end - range.begin;
+        if (count > 0) {
+            uploadRing->uploadBuffer(blitEncoder, instanceBuffer, first * sizeof(InstanceData), &m_instances[first],
+                                     count * sizeof(InstanceData));
+            if (bladeStateBuffer) {
+                blitEncoder->fillBuffer(bladeStateBuffer, NS::Range::Make(first * sizeof(BladeState), count * sizeof(BladeState)), 0);
+            }
+            staged += count * sizeof(InstanceData);
+        }
+        range = DirtyRange{ 0, 0 };
+        m_cellDirty[cell] = 0;
+        firstCell = std::min(firstCell, cell);
+        lastCell = std::max(lastCell, cell);
+    }
+
+    // Cell entries: one upload over the dirty span (a few bytes per cell)
+    uint32_t cellCount = lastCell - firstCell + 1;
+    uploadRing->uploadBuffer(blitEncoder, cellBuffer, firstCell * sizeof(GrassCell), &m_cells[firstCell],
+                             cellCount * sizeof(GrassCell));
+    staged += cellCount * sizeof(GrassCell);
+    m_dirtyCells.clear();
+    return staged;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "ShaderTypes.h"
+#include <cstdint>
+#include <vector>
+
+class UploadRing;
+
+// Runtime edits of the resident grass field (mowing, planting, erasing) on top of the cell grid.
+// The editor keeps a host copy of the instances in a slack layout: every cell owns a fixed range
+// of cellCapacity slots, its blades are the prefix [0, instanceCount) of it, and the slots that
+// removals leave inside the prefix are zeroed (zero scale: degenerate and skipped, like the
+// generator's rejected slots) and go on the cell's free list for the next insertion. Edits only
+// mark slot ranges dirty; flush() uploads those ranges and the changed cell entries through the
+// staging ring. The staged copies belong to their batch until it completes, so the host copy keeps
+// changing while frames in flight still read the previous contents, and no edit waits on the GPU.
+class GrassInstanceEditor {
+public:
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    GrassInstanceEditor(uint32_t cellCount, uint32_t cellCapacity);
+
+    // Take over a field: cell c's blades [firstInstance, firstInstance + instanceCount) of instances
+    // (at most cellCapacity of them; the bounds are kept). False when a cell does not fit.
+    bool load(const InstanceData* instances, const GrassCell* cells);
+
+    // Slot of the new blade, or kNoSlot when the cell is full
+    uint32_t insert(uint32_t cell, const InstanceData& instance);
+    bool remove(uint32_t slot);
+    bool modify(uint32_t slot, const InstanceData& instance); // Same cell: move blades across cells with remove + insert
+    // Grow a cell's bounds over new blades (planting); removals keep them (conservative)
+    void includeBounds(uint32_t cell, simd::float3 boundsMin, simd::float3 boundsMax);
+
+    // Upload the edits since the last flush (both buffers in the slack layout); blade states of the
+    // edited slots are reset to rest. Returns the bytes staged.
+    size_t flush(UploadRing* uploadRing, MTL::BlitCommandEncoder* blitEncoder, MTL::Buffer* instanceBuffer,
+                 MTL::Buffer* cellBuffer, MTL::Buffer* bladeStateBuffer);
+    bool hasPendingUploads() const { return !m_dirtyCells.empty(); }
+
+    static bool isEmpty(const InstanceData& instance) { return (instance.heightScale >> 16) == 0; }
+
+    uint32_t getCellCount() const { return static_cast<uint32_t>(m_cells.size()); }
+    uint32_t getCellCapacity() const { return m_cellCapacity; }
+    uint32_t getSlotCount() const { return static_cast<uint32_t>(m_instances.size()); }
+    uint32_t getInstanceCount() const { return m_instanceCount; } // Live blades
+    uint32_t cellOfSlot(uint32_t slot) const { return slot / m_cellCapacity; }
+    const std::vector<InstanceData>& getInstances() const { return m_instances; }
+    const std::vector<GrassCell>& getCells() const { return m_cells; } // Fixed size: pointers stay valid
+
+private:
+    struct DirtyRange {
+        uint32_t begin; // Slot offsets within the cell, [begin, end)
+        uint32_t end;
+    };
+
+    void markDirty(uint32_t cell, uint32_t offset);
+    void markCellDirty(uint32_t cell);
+
+    uint32_t m_cellCapacity;
+    uint32_t m_instanceCount;
+    std::vector<InstanceData> m_instances;            // cellCount * cellCapacity slots
+    std::vector<GrassCell> m_cells;                   // firstInstance = cell * cellCapacity
+    std::vector<std::vector<uint32_t>> m_freeSlots;   // Per cell: zeroed offsets below its instanceCount
+    std::vector<DirtyRange> m_dirtyRanges;            // Per cell (empty when begin == end)
+    std::vector<uint8_t> m_cellDirty;                 // Per cell: listed in m_dirtyCells
+    std::vector<uint32_t> m_dirtyCells;               // Cells with a dirty range or entry since the last flush
+};
@@ -0,0 +1,144 @@
+#include "GrassPalette.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Season keys. Summer is the original hand-tuned blade look: lush green gradients, a 30% mix
+// towards a fresher green by the blade hash and pale yellow-green withered tips
+static const GrassPalette::Style kSeasonStyles[GrassPalette::kSeasonCount] = {
+    // Spring: bright yellow-greens, white blossoms, little withering
+    { { { { 0.06f, 0.22f, 0.05f }, { 0.16f, 0.58f, 0.10f }, { 0.45f, 0.85f, 0.25f } },
+        { { 0.04f, 0.18f, 0.06f }, { 0.12f, 0.48f, 0.12f }, { 0.25f, 0.65f, 0.22f } },
+        { { 0.06f, 0.22f, 0.05f }, { 0.18f, 0.52f, 0.10f }, { 0.95f, 0.90f, 0.95f } } },
+      { 0.35f, 0.80f, 0.30f }, 0.35f, { 0.70f, 0.78f, 0.45f }, 0.25f, 0.0f },
+    // Summer
+    { { { { 0.05f, 0.20f, 0.05f }, { 0.10f, 0.50f, 0.10f }, { 0.30f, 0.75f, 0.25f } }, // Lush green blades
+        { { 0.03f, 0.16f, 0.06f }, { 0.08f, 0.40f, 0.12f }, { 0.16f, 0.55f, 0.22f } }, // Deep blue-green clover
+        { { 0.05f, 0.20f, 0.05f }, { 0.14f, 0.45f, 0.10f }, { 0.95f, 0.85f, 0.55f } } }, // Green stems, pale yellow heads
+      { 0.20f, 0.70f, 0.30f }, 0.30f, { 0.70f, 0.78f, 0.45f }, 0.45f, 0.0f },
+    // Autumn: olive and golden blades, rust flower heads, every blade browning at the tips
+    { { { { 0.06f, 0.16f, 0.04f }, { 0.28f, 0.42f, 0.10f }, { 0.62f, 0.58f, 0.22f } },
+        { { 0.05f, 0.14f, 0.05f }, { 0.18f, 0.34f, 0.10f }, { 0.38f, 0.45f, 0.16f } },
+        { { 0.06f, 0.16f, 0.04f }, { 0.30f, 0.38f, 0.10f }, { 0.85f, 0.45f, 0.15f } } },
+      { 0.45f, 0.50f, 0.15f }, 0.30f, { 0.78f, 0.60f, 0.30f }, 0.70f, 0.35f },
+    // Winter: desaturated straw and grey-green
+    { { { { 0.05f, 0.09f, 0.05f }, { 0.24f, 0.28f, 0.18f }, { 0.55f, 0.53f, 0.42f } },
+        { { 0.04f, 0.09f, 0.05f }, { 0.14f, 0.22f, 0.13f }, { 0.30f, 0.34f, 0.24f } },
+        { { 0.05f, 0.09f, 0.05f }, { 0.25f, 0.27f, 0.18f }, { 0.50f, 0.45f, 0.35f } } },
+      { 0.35f, 0.40f, 0.30f }, 0.20f, { 0.68f, 0.64f, 0.52f }, 0.65f, 0.50f },
+};
+
+static float smoothstep(float edge0, float edge1, float x)
+{
+    float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+GrassPalette::GrassPalette(MTL::Device* device, int slotCount)
+    : m_season(1.0f)
+    , m_version(1)
+{
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(MTL::PixelFormatRGBA16Float);
+    descriptor->setWidth(GRASS_PALETTE_WIDTH);
+    descriptor->setHeight(GRASS_PALETTE_HEIGHT);
+    descriptor->setDepth(GRASS_SPECIES_COUNT * 2);
+    descriptor->setTextureType(MTL::TextureType3D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+    for (int i = 0; i < slotCount; ++i) {
+        MTL::Texture* texture = device->newTexture(descriptor);
+        if (!texture) {
+            std::cerr << "Failed to create grass palette texture" << std::endl;
+        } else {
+            texture->setLabel(NS::String::string("Grass Palette", NS::UTF8StringEncoding));
+        }
+        m_textures.push_back(texture);
+        m_slotVersions.push_back(0);
+    }
+    descriptor->release();
+    bake(seasonStyle(m_season));
+}
+
+GrassPalette::~GrassPalette()
+{
+    for (MTL::Texture* texture : m_textures) {
+        if (texture) {
+            texture->release();
+        }
+    }
+}
+
+GrassPalette::Style GrassPalette::seasonStyle(float season)
+{
+    float wrapped = season - kSeasonCount * std::floor(season / kSeasonCount);
+    int first = std::min(static_cast<int>(wrapped), kSeasonCount - 1);
+    int second = (first + 1) % kSeasonCount;
+    float blend = wrapped - static_cast<float>(first);
+    const Style& a = kSeasonStyles[first];
+    const Style& b = kSeasonStyles[second];
+
+    Style style;
+    for (int species = 0; species < GRASS_SPECIES_COUNT; ++species) {
+        for (int stop = 0; stop < 3; ++stop) {
+            style.stops[species][stop] = simd::mix(a.stops[species][stop], b.stops[species][stop], blend);
+        }
+    }
+    style.freshColor = simd::mix(a.freshColor, b.freshColor, blend);
+    style.freshAmount = a.freshAmount + (b.freshAmount - a.freshAmount) * blend;
+    style.dryColor = simd::mix(a.dryColor, b.dryColor, blend);
+    style.dryAmount = a.dryAmount + (b.dryAmount - a.dryAmount) * blend;
+    style.healthyDryness = a.healthyDryness + (b.healthyDryness - a.healthyDryness) * blend;
+    return style;
+}
+
+void GrassPalette::setSeason(float season)
+{
+    if (season == m_season) {
+        return;
+    }
+    m_season = season;
+    bake(seasonStyle(season));
+}
+
+void GrassPalette::bake(const Style& style)
+{
+    // Texel centers sit on the table's edges: x = 0 is the root, x = width - 1 the tip (the odd
+    // width puts the middle stop on a texel), y spans the blade hash 0..1
+    m_texels.resize(static_cast<size_t>(GRASS_PALETTE_WIDTH) * GRASS_PALETTE_HEIGHT * GRASS_SPECIES_COUNT * 2 * 4);
+    uint16_t* texel = m_texels.data();
+    for (int slice = 0; slice < GRASS_SPECIES_COUNT * 2; ++slice) {
+        int species = slice / 2;
+        float dryness = (slice % 2) ? 1.0f : style.healthyDryness;
+        for (int y = 0; y < GRASS_PALETTE_HEIGHT; ++y) {
+            float variation = static_cast<float>(y) / static_cast<float>(GRASS_PALETTE_HEIGHT - 1);
+            for (int x = 0; x < GRASS_PALETTE_WIDTH; ++x) {
+                float t = static_cast<float>(x) / static_cast<float>(GRASS_PALETTE_WIDTH - 1);
+                const simd::float3* stops = style.stops[species];
+                simd::float3 color = t < 0.5f ? simd::mix(stops[0], stops[1], t * 2.0f)
+                                              : simd::mix(stops[1], stops[2], (t - 0.5f) * 2.0f);
+                color = simd::mix(color, style.freshColor, variation * style.freshAmount);
+                // Dryness shows more near the tips than the roots (so roots stay grounded)
+                color = simd::mix(color, style.dryColor, dryness * smoothstep(0.3f, 1.0f, t) * style.dryAmount);
+                // IEEE half (storage-only __fp16 conversion)
+                __fp16 values[4] = { static_cast<__fp16>(color.x), static_cast<__fp16>(color.y),
+                                     static_cast<__fp16>(color.z), static_cast<__fp16>(1.0f) };
+                std::memcpy(texel, values, sizeof(values));
+                texel += 4;
+            }
+        }
+    }
+    m_version++;
+}
+
+void GrassPalette::update(int slot)
+{
+    if (slot < 0 || slot >= getSlotCount() || !m_textures[slot] || m_slotVersions[slot] == m_version) {
+        return;
+    }
+    size_t bytesPerRow = static_cast<size_t>(GRASS_PALETTE_WIDTH) * 4 * sizeof(uint16_t);
+    m_textures[slot]->replaceRegion(MTL::Region::Make3D(0, 0, 0, GRASS_PALETTE_WIDTH, GRASS_PALETTE_HEIGHT, GRASS_SPECIES_COUNT * 2),
+                                    0, 0, m_texels.data(), bytesPerRow, bytesPerRow * GRASS_PALETTE_HEIGHT);
+    m_slotVersions[slot] = m_version;
+}
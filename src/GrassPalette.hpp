@@ -0,0 +1,52 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <simd/simd.h>
+#include <cstdint>
+#include <vector>
+#include "ShaderTypes.h"
+
+// Blade albedo lookup table: GRASS_PALETTE_WIDTH texels along the blade (root to tip) by
+// GRASS_PALETTE_HEIGHT rows of per-blade variation, with a fresh and a withered slice per species
+// (RGBA16Float, linear RGB). The grass fragment stages sample it once instead of evaluating the
+// gradient stops, the variation and the withered blend per fragment; a season or an art
+// direction change only rebakes the table.
+// Each frame in flight reads its own copy, so a new palette is baked into a slot the GPU is done
+// with (like the scene constants) and no frame waits for a change.
+class GrassPalette {
+public:
+    static constexpr int kSeasonCount = 4; // Spring, summer, autumn, winter
+
+    // Look of one season: the species' root / middle / tip stops, the fresh variation color the
+    // blade hash mixes towards, and the withered color blended in towards the tips
+    struct Style {
+        simd::float3 stops[GRASS_SPECIES_COUNT][3];
+        simd::float3 freshColor;
+        float freshAmount;    // Largest share of the fresh color (blade hash 1)
+        simd::float3 dryColor;
+        float dryAmount;      // Largest share of the dry color at withered tips
+        float healthyDryness; // Share of dryAmount healthy blades get too (late-season browning)
+    };
+
+    GrassPalette(MTL::Device* device, int slotCount);
+    ~GrassPalette();
+
+    // 0 spring, 1 summer (the default), 2 autumn, 3 winter; fractions blend neighbors and the
+    // cycle wraps. Takes effect in each slot at its next update()
+    void setSeason(float season);
+    float getSeason() const { return m_season; }
+    static Style seasonStyle(float season);
+
+    // Before a frame in slot is encoded (its previous frame completed): rebake a stale copy
+    void update(int slot);
+    MTL::Texture* getTexture(int slot) const { return m_textures[slot]; }
+    int getSlotCount() const { return static_cast<int>(m_textures.size()); }
+
+private:
+    void bake(const Style& style);
+
+    float m_season;
+    uint32_t m_version;                  // Bumped by every change of the baked texels
+    std::vector<uint16_t> m_texels;      // Half RGBA, slice-major
+    std::vector<MTL::Texture*> m_textures;
+    std::vector<uint32_t> m_slotVersions;
+};
@@ -0,0 +1,307 @@
+#include "GrassStreamer.hpp"
+#include "TerrainHeightmap.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+// Seed of one chunk's blades: every chunk is reproducible on its own, whatever the load order
+static uint32_t chunkSeed(int32_t x, int32_t z, uint32_t seed)
+{
+    uint32_t h = seed * 0x9E3779B9u;
+    h ^= static_cast<uint32_t>(x) * 0x85EBCA6Bu + 0x68E31DA4u + (h << 6) + (h >> 2);
+    h ^= static_cast<uint32_t>(z) * 0xC2B2AE35u + 0xB5297A4Du + (h << 6) + (h >> 2);
+    return h;
+}
+
+GrassStreamer::GrassStreamer(MTL::Device* device, const TerrainHeightmap* terrain, const Settings& settings,
+                             int frameCount, JobSystem* jobs)
+    : m_device(device)
+    , m_terrain(terrain)
+    , m_settings(settings)
+    , m_frameCount(std::clamp(frameCount, 1, kMaxFrames))
+    , m_chunksPerSide(std::max(1, static_cast<int>(std::ceil(2.0f * settings.worldHalfSize / settings.chunkSize))))
+    , m_packer(settings.worldHalfSize, 1, settings.bladeRadius)
+    , m_instanceBuffer(nullptr)
+    , m_cellBuffers{}
+    , m_cellCounts{}
+    , m_slotCount(0)
+    , m_uploadedBytes(0)
+    , m_residentVersion(0)
+    , m_windowFirstX(-1)
+    , m_windowFirstZ(-1)
+    , m_jobs(jobs)
+    , m_stopping(false)
+{
+    m_settings.windowChunks = std::clamp(m_settings.windowChunks, 1, m_chunksPerSide);
+    m_settings.bladesPerChunk = std::max(m_settings.bladesPerChunk, 1);
+
+    // Window plus its eviction margin, and the slots of up to two evicted rows per frame still in flight
+    uint32_t margin = static_cast<uint32_t>(m_settings.windowChunks + 2);
+    m_slotCount = margin * margin + static_cast<uint32_t>(m_frameCount) * 2 * margin;
+
+    size_t poolBytes = static_cast<size_t>(m_slotCount) * m_settings.bladesPerChunk * sizeof(InstanceData);
+    m_instanceBuffer = m_device->newBuffer(poolBytes, MTL::ResourceStorageModeShared);
+    for (int i = 0; i < m_frameCount; ++i) {
+        m_cellBuffers[i] = m_device->newBuffer(sizeof(GrassCell) * getMaxCellCount(), MTL::ResourceStorageModeShared);
+    }
+    if (!m_instanceBuffer || !m_cellBuffers[0]) {
+        std::cerr << "Failed to create grass streaming buffers" << std::endl;
+        return;
+    }
+
+    m_freeSlots.reserve(m_slotCount);
+    for (uint32_t slot = m_slotCount; slot > 0; --slot) {
+        m_freeSlots.push_back(slot - 1);
+    }
+}
+
+GrassStreamer::~GrassStreamer()
+{
+    // Queued jobs find no request left; running ones finish their chunk
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_requests.clear();
+    }
+    if (m_jobs) {
+        m_jobs->wait(m_generateJobs);
+    }
+
+    if (m_instanceBuffer) {
+        m_instanceBuffer->release();
+    }
+    for (MTL::Buffer* buffer : m_cellBuffers) {
+        if (buffer) {
+            buffer->release();
+        }
+    }
+}
+
+size_t GrassStreamer::getPendingChunkCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_inFlight.size();
+}
+
+bool GrassStreamer::inWorld(ChunkCoord coord) const
+{
+    return coord.first >= 0 && coord.second >= 0 && coord.first < m_chunksPerSide && coord.second < m_chunksPerSide;
+}
+
+void GrassStreamer::generateNext()
+{
+    // Requests cancelled by update() leave their job nothing to do
+    ChunkCoord coord;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || m_requests.empty()) {
+            return;
+        }
+        coord = m_requests.front();
+        m_requests.pop_front();
+    }
+
+    Generated generated = generate(coord);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished.push_back(std::move(generated));
+}
+
+GrassStreamer::Generated GrassStreamer::generate(ChunkCoord coord) const
+{
+    // Same distributions and progressive in-cell order as GrassField::generate(), stratified to the chunk
+    std::mt19937 gen(chunkSeed(coord.first, coord.second, m_settings.seed));
+    std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+    std::uniform_real_distribution<float> scaleDist(0.8f, 1.2f);
+    float offsetX = unitDist(gen);
+    float offsetZ = unitDist(gen);
+
+    float minX = -m_settings.worldHalfSize + static_cast<float>(coord.first) * m_settings.chunkSize;
+    float minZ = -m_settings.worldHalfSize + static_cast<float>(coord.second) * m_settings.chunkSize;
+
+    Generated generated;
+    generated.coord = coord;
+    generated.instances.resize(static_cast<size_t>(m_settings.bladesPerChunk));
+    generated.heightRange = simd::make_float2(FLT_MAX, -FLT_MAX);
+
+    for (size_t i = 0; i < generated.instances.size(); ++i) {
+        InstanceData& instance = generated.instances[i];
+        float u = offsetX + static_cast<float>(i) * GRASS_PROGRESSIVE_STEP_X;
+        float v = offsetZ + static_cast<float>(i) * GRASS_PROGRESSIVE_STEP_Y;
+        float x = minX + (u - std::floor(u)) * m_settings.chunkSize;
+        float z = minZ + (v - std::floor(v)) * m_settings.chunkSize;
+        float y = m_terrain->heightAt(x, z) + GRASS_INSTANCE_ELEVATION;
+        float rotation = unitDist(gen) * 6.28318f;
+        float scale = scaleDist(gen);
+
+        float hash = unitDist(gen);
+        float tilt = (unitDist(gen) - 0.5f) * 2.0f * INSTANCE_MAX_TILT;
+        float idlePhase = unitDist(gen) * 6.28318f;
+        uint32_t flags = (unitDist(gen) > 0.9f) ? INSTANCE_FLAG_YELLOW : 0u;
+        uint32_t albedoVariant = static_cast<uint32_t>(unitDist(gen) * GRASS_ALBEDO_VARIANT_COUNT) % GRASS_ALBEDO_VARIANT_COUNT;
+        uint32_t species = grassSpeciesFromUnit(unitDist(gen));
+
+        instance = m_packer.packInstance(simd::make_float3(x, y, z), rotation, scale, albedoVariant, species,
+                                         GrassField::packAttributes(hash, tilt, idlePhase, flags));
+        generated.heightRange.x = std::min(generated.heightRange.x, y);
+        generated.heightRange.y = std::max(generated.heightRange.y, y);
+    }
+
+    // The blades may miss the lowest and highest ground of the chunk: include a grid of terrain samples
+    const int kSamples = 5;
+    for (int sz = 0; sz < kSamples; ++sz) {
+        for (int sx = 0; sx < kSamples; ++sx) {
+            float x = minX + m_settings.chunkSize * static_cast<float>(sx) / static_cast<float>(kSamples - 1);
+            float z = minZ + m_settings.chunkSize * static_cast<float>(sz) / static_cast<float>(kSamples - 1);
+            float y = m_terrain->heightAt(x, z) + GRASS_INSTANCE_ELEVATION;
+            generated.heightRange.x = std::min(generated.heightRange.x, y);
+            generated.heightRange.y = std::max(generated.heightRange.y, y);
+        }
+    }
+    return generated;
+}
+
+void GrassStreamer::update(const simd::float3& cameraPosition, int slot)
+{
+    if (!isValid()) {
+        return;
+    }
+    slot %= m_frameCount;
+
+    // Frames that could read the slots evicted frameCount frames ago (in this ring slot) have completed
+    m_freeSlots.insert(m_freeSlots.end(), m_retiringSlots[slot].begin(), m_retiringSlots[slot].end());
+    m_retiringSlots[slot].clear();
+
+    // Window around the camera, kept inside the world
+    int window = m_settings.windowChunks;
+    int cameraX = static_cast<int>(std::floor((cameraPosition.x + m_settings.worldHalfSize) / m_settings.chunkSize));
+    int cameraZ = static_cast<int>(std::floor((cameraPosition.z + m_settings.worldHalfSize) / m_settings.chunkSize));
+    int firstX = std::clamp(cameraX - window / 2, 0, m_chunksPerSide - window);
+    int firstZ = std::clamp(cameraZ - window / 2, 0, m_chunksPerSide - window);
+    auto inWindow = [&](ChunkCoord coord, int margin) {
+        return coord.first >= firstX - margin && coord.first < firstX + window + margin &&
+               coord.second >= firstZ - margin && coord.second < firstZ + window + margin;
+    };
+
+    // Evict chunks past the margin; their slots retire with this frame
+    for (auto it = m_resident.begin(); it != m_resident.end();) {
+        if (inWindow(it->first, 1)) {
+            ++it;
+        } else {
+            m_retiringSlots[slot].push_back(it->second.slot);
+            it = m_resident.erase(it);
+            m_residentVersion++;
+        }
+    }
+
+    std::vector<Generated> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        finished.swap(m_finished);
+
+        // Queued chunks the camera has left behind are not generated
+        for (auto it = m_requests.begin(); it != m_requests.end();) {
+            if (inWindow(*it, 1)) {
+                ++it;
+            } else {
+                m_inFlight.erase(*it);
+                it = m_requests.erase(it);
+            }
+        }
+    }
+
+    // Copy finished chunks into free slots (none of them is referenced by a frame in flight)
+    m_uploadedBytes = 0;
+    std::vector<Generated> deferred;
+    uint32_t slotInstances = static_cast<uint32_t>(m_settings.bladesPerChunk);
+    for (Generated& generated : finished) {
+        if (!inWindow(generated.coord, 1)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_inFlight.erase(generated.coord);
+            continue;
+        }
+        if (m_freeSlots.empty()) {
+            deferred.push_back(std::move(generated)); // Retried once evicted slots retire
+            continue;
+        }
+        uint32_t poolSlot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+
+        // The whole slot is rewritten: the chunk's blades (never past the slot), zeroed after them, so
+        // nothing of the slot's previous chunk survives for a reader that goes past the cell's count
+        uint32_t instanceCount = std::min(static_cast<uint32_t>(generated.instances.size()), slotInstances);
+        InstanceData* slotData = static_cast<InstanceData*>(m_instanceBuffer->contents()) + static_cast<size_t>(poolSlot) * slotInstances;
+        std::memcpy(slotData, generated.instances.data(), instanceCount * sizeof(InstanceData));
+        std::memset(slotData + instanceCount, 0, (slotInstances - instanceCount) * sizeof(InstanceData));
+        m_uploadedBytes += instanceCount * sizeof(InstanceData);
+
+        float minX = -m_settings.worldHalfSize + static_cast<float>(generated.coord.first) * m_settings.chunkSize;
+        float minZ = -m_settings.worldHalfSize + static_cast<float>(generated.coord.second) * m_settings.chunkSize;
+        float radius = m_settings.bladeRadius;
+        Chunk chunk;
+        chunk.slot = poolSlot;
+        chunk.cell.boundsMin = simd::make_float4(minX - radius, generated.heightRange.x - radius, minZ - radius, 0.0f);
+        chunk.cell.boundsMax = simd::make_float4(minX + m_settings.chunkSize + radius, generated.heightRange.y + radius,
+                                                 minZ + m_settings.chunkSize + radius, 0.0f);
+        chunk.cell.firstInstance = poolSlot * slotInstances;
+        chunk.cell.instanceCount = instanceCount;
+        chunk.cell.pad0 = 0;
+        chunk.cell.pad1 = 0;
+        m_resident[generated.coord] = chunk;
+        m_residentVersion++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inFlight.erase(generated.coord);
+    }
+
+    // Request the missing window chunks nearest the camera first
+    std::vector<std::pair<int, ChunkCoord>> missing;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished.insert(m_finished.end(), std::make_move_iterator(deferred.begin()), std::make_move_iterator(deferred.end()));
+        for (int z = firstZ; z < firstZ + window; ++z) {
+            for (int x = firstX; x < firstX + window; ++x) {
+                ChunkCoord coord(x, z);
+                if (inWorld(coord) && !m_resident.count(coord) && !m_inFlight.count(coord)) {
+                    int dx = x - cameraX;
+                    int dz = z - cameraZ;
+                    missing.emplace_back(dx * dx + dz * dz, coord);
+                }
+            }
+        }
+        size_t requestCount = std::min(missing.size(), static_cast<size_t>(kMaxRequestsPerFrame));
+        std::partial_sort(missing.begin(), missing.begin() + requestCount, missing.end());
+        for (size_t i = 0; i < requestCount; ++i) {
+            m_requests.push_back(missing[i].second);
+            m_inFlight.insert(missing[i].second);
+        }
+        missing.resize(requestCount);
+    }
+    for (size_t i = 0; i < missing.size(); ++i) {
+        if (m_jobs) {
+            m_jobs->run([this] { generateNext(); }, &m_generateJobs, nullptr, true);
+        } else {
+            generateNext();
+        }
+    }
+
+    if (firstX != m_windowFirstX || firstZ != m_windowFirstZ) {
+        m_windowFirstX = firstX;
+        m_windowFirstZ = firstZ;
+        m_residentVersion++;
+    }
+
+    // This frame's cells: the resident chunks of the window (the margin ring stays resident, unlisted)
+    GrassCell* cells = static_cast<GrassCell*>(m_cellBuffers[slot]->contents());
+    uint32_t cellCount = 0;
+    for (const auto& item : m_resident) {
+        if (inWindow(item.first, 0)) {
+            cells[cellCount++] = item.second.cell;
+        }
+    }
+    m_cellCounts[slot] = cellCount;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "GrassField.hpp"
+#include "JobSystem.hpp"
+#include "ShaderTypes.h"
+#include <simd/simd.h>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+class TerrainHeightmap;
+
+// Grass for worlds much larger than one field: the world is cut into square chunks and only a
+// window of windowChunks x windowChunks around the camera is resident. Missing chunks are
+// generated as background jobs of the JobSystem (deterministic per chunk and seed, rooted on the terrain) and copied
+// into a fixed pool of chunk slots in one shared instance buffer; chunks that leave the window
+// (plus a one-chunk margin, so the camera can cross a border back and forth) are evicted and their
+// slot returns to the free list once the frames that may still read it have completed. Every
+// frame publishes the GrassCell list of the resident window chunks for the cull pass, so memory
+// and per-frame cost depend on the window, never on the world size.
+class GrassStreamer {
+public:
+    struct Settings {
+        float worldHalfSize;   // World spans [-worldHalfSize, +worldHalfSize] (also the quantization bounds)
+        float chunkSize;       // World size of one chunk (one GrassCell)
+        int windowChunks;      // Resident chunks per side around the camera
+        int bladesPerChunk;
+        float bladeRadius;     // Bounding radius added to chunk bounds
+        uint32_t seed;
+    };
+
+    GrassStreamer(MTL::Device* device, const TerrainHeightmap* terrain, const Settings& settings,
+                  int frameCount, JobSystem* jobs);
+    ~GrassStreamer(); // Waits for the chunks being generated (the GPU must be done with the buffers)
+
+    // Render thread, once per frame before culling: retire the slots freed frameCount frames ago,
+    // copy finished chunks into free slots, evict and request chunks for the camera's window and
+    // write the window's cell list into the slot's cell buffer
+    void update(const simd::float3& cameraPosition, int slot);
+
+    bool isValid() const { return m_instanceBuffer && m_cellBuffers[0]; }
+    MTL::Buffer* getInstanceBuffer() const { return m_instanceBuffer; }
+    MTL::Buffer* getCellBuffer(int slot) const { return m_cellBuffers[slot]; }
+    uint32_t getCellCount(int slot) const { return m_cellCounts[slot]; } // Resident window chunks listed in the slot
+    int getMaxCellCount() const { return m_settings.windowChunks * m_settings.windowChunks; }
+    simd::float2 getMinXZ() const { return simd::make_float2(-m_settings.worldHalfSize, -m_settings.worldHalfSize); }
+    simd::float2 getMaxXZ() const { return simd::make_float2(m_settings.worldHalfSize, m_settings.worldHalfSize); }
+    size_t getResidentChunkCount() const { return m_resident.size(); }
+    size_t getPendingChunkCount() const;
+    size_t getPoolBytes() const { return m_instanceBuffer ? m_instanceBuffer->length() : 0; }
+    size_t getUploadedBytes() const { return m_uploadedBytes; } // Chunk instances copied by the last update()
+    // Bumped whenever the listed cells change (a chunk copied in or evicted, the window moved)
+    uint64_t getResidentVersion() const { return m_residentVersion; }
+
+private:
+    static constexpr int kMaxFrames = 3;
+    static constexpr int kMaxRequestsPerFrame = 8; // New chunk requests queued per update()
+
+    typedef std::pair<int32_t, int32_t> ChunkCoord; // World chunk (x, z)
+
+    struct Chunk {
+        uint32_t slot;         // Pool slot holding the instances
+        GrassCell cell;        // Bounds and pool range
+    };
+    struct Generated {
+        ChunkCoord coord;
+        std::vector<InstanceData> instances;
+        simd::float2 heightRange; // Blade root heights
+    };
+
+    void generateNext(); // One background job per request
+    Generated generate(ChunkCoord coord) const;
+    bool inWorld(ChunkCoord coord) const;
+
+    MTL::Device* m_device;
+    const TerrainHeightmap* m_terrain;
+    Settings m_settings;
+    int m_frameCount;
+    int m_chunksPerSide;           // World chunks per side
+    GrassField m_packer;           // Quantizes blades over the world bounds
+
+    MTL::Buffer* m_instanceBuffer;                 // Pool: m_slotCount slots of bladesPerChunk instances (shared)
+    MTL::Buffer* m_cellBuffers[kMaxFrames];        // Window cell list per frame slot (shared)
+    uint32_t m_cellCounts[kMaxFrames];
+    uint32_t m_slotCount;
+    size_t m_uploadedBytes;
+    uint64_t m_residentVersion;
+    int m_windowFirstX;            // Window origin of the last update()
+    int m_windowFirstZ;
+
+    std::map<ChunkCoord, Chunk> m_resident;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint32_t> m_retiringSlots[kMaxFrames]; // Evicted in the frame of that ring slot
+
+    // Request queue (guarded by m_mutex); each request queues one job that generates the front one
+    JobSystem* m_jobs;
+    JobSystem::Counter m_generateJobs;
+    mutable std::mutex m_mutex;
+    std::deque<ChunkCoord> m_requests;
+    std::set<ChunkCoord> m_inFlight;               // Requested or generating, not yet copied
+    std::vector<Generated> m_finished;
+    bool m_stopping;
+};
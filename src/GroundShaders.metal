@@ -3,72 +3,270 @@
 
 using namespace metal;
 
+// Sparse ground texture (SparseGroundTexture): sampled instead of the tiled albedo, clamped to the
+// resident levels, with tile requests written back for the streamer
+constant bool sparseGroundValue [[function_constant(FunctionConstantIndexSparseGround)]];
+constant bool sparseGround = is_function_constant_defined(sparseGroundValue) && sparseGroundValue;
+
 // Ground vertex shader output
 struct GroundRasterizerData {
     float4 position [[position]];
-    float3 normal;
+    float3 normal [[function_constant(fullPrecisionShading)]];
+    half3 normalHalf [[function_constant(halfPrecisionShading)]]; // Same normal, half-precision pipelines
     float2 texcoord;
+    float3 worldPos; // Point light cluster and distances
+    float4 currentClip [[function_constant(writeMotionVectors)]]; // Unjittered clip position (motion vectors)
+    float4 previousClip [[function_constant(writeMotionVectors)]]; // Same point through last frame's camera
+    uint objectId [[flat, function_constant(writeObjectId)]]; // The terrain chunk (picking)
 };
 
+// Terrain chunk vertex shader: no vertex buffer. Each instance is one chunk of the grid (the
+// chunk list packs its index and LOD); vertex IDs enumerate the chunk's (quads + 1)^2 grid
+// vertices, followed by a second copy lowered by TERRAIN_SKIRT_DEPTH for the border skirts.
+// Every vertex of every LOD sits on a heightmap sample, so heights and normals are texel loads.
 vertex GroundRasterizerData groundVertexMain(
     uint vertexID [[vertex_id]],
-    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
-    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+    uint instanceID [[instance_id]],
+    constant uint *chunks [[buffer(BufferIndexTerrainChunks)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    texture2d<float> heightmap [[texture(TextureIndexTerrainHeight)]]
 ) {
     GroundRasterizerData out;
     
-    // Read vertex attributes
-    float3 position = vertices[vertexID].position;
-    float3 normal = vertices[vertexID].normal;
-    float2 texcoord = vertices[vertexID].texcoord;
+    uint chunk = chunks[instanceID] & 0xFFFFu;
+    uint lod = chunks[instanceID] >> 16;
+    uint quads = uint(TERRAIN_CHUNK_QUADS) >> lod;
+    uint rowVertices = quads + 1;
+    uint gridVertex = vertexID % (rowVertices * rowVertices);
+    bool skirt = vertexID >= rowVertices * rowVertices;
+    
+    // Heightmap texel under this vertex
+    uint2 chunkCoord = uint2(chunk % TERRAIN_CHUNKS_PER_SIDE, chunk / TERRAIN_CHUNKS_PER_SIDE);
+    uint2 texel = chunkCoord * uint(TERRAIN_CHUNK_QUADS) + uint2(gridVertex % rowVertices, gridVertex / rowVertices) * (1u << lod);
+    float2 extent = scene.groundMaxXZ - scene.groundMinXZ;
+    float spacing = extent.x / float(TERRAIN_HEIGHTMAP_SIZE - 1);
+    float2 xz = scene.groundMinXZ + float2(texel) * spacing;
+    float height = heightmap.read(texel).r;
+    float3 position = float3(xz.x, height - (skirt ? TERRAIN_SKIRT_DEPTH : 0.0), xz.y);
+    
+    // Normal from the neighbouring samples (central differences, clamped at the field edge)
+    int2 last = int2(TERRAIN_HEIGHTMAP_SIZE - 1);
+    float left = heightmap.read(uint2(clamp(int2(texel) - int2(1, 0), int2(0), last))).r;
+    float right = heightmap.read(uint2(clamp(int2(texel) + int2(1, 0), int2(0), last))).r;
+    float down = heightmap.read(uint2(clamp(int2(texel) - int2(0, 1), int2(0), last))).r;
+    float up = heightmap.read(uint2(clamp(int2(texel) + int2(0, 1), int2(0), last))).r;
+    float3 normal = normalize(float3(left - right, 2.0 * spacing, down - up));
+    
+    // Ground texture tiles GROUND_TEXTURE_TILING times across the field (v runs from +Z to -Z, like the old quad)
+    float2 local = (xz - scene.groundMinXZ) / extent;
+    float2 texcoord = float2(local.x, 1.0 - local.y) * GROUND_TEXTURE_TILING;
     
-    // Transform position: uniforms.projectionMatrix * uniforms.viewMatrix * float4(in.position, 1.0)
-    // The ground is static at (0,0,0) so we don't need a model matrix (vertices are in world space)
+    // Vertices are in world space (the terrain has no model matrix)
     out.position = uniforms.projectionMatrix * uniforms.viewMatrix * float4(position, 1.0);
     
+    // Static geometry: motion comes from the camera only
+    if (writeMotionVectors) {
+        out.currentClip = uniforms.unjitteredViewProjection * float4(position, 1.0);
+        out.previousClip = uniforms.prevViewProjection * float4(position, 1.0);
+    }
+    
     // Pass texcoord and normal to fragment
-    out.normal = normal;
+    if (halfPrecisionShading) {
+        out.normalHalf = half3(normal);
+    } else {
+        out.normal = normal;
+    }
     out.texcoord = texcoord;
+    out.worldPos = position;
+    if (writeObjectId) {
+        out.objectId = OBJECT_ID(ObjectIdKindGround, chunk);
+    }
     
     return out;
 }
 
-fragment float4 groundFragmentMain(
-    GroundRasterizerData in [[stage_in]],
-    texture2d<float> colorTexture [[texture(0)]],
-    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+// Two triangles per heightmap quad, as grid corner offsets
+constant uint2 kShadowQuadCorners[6] = { uint2(0, 0), uint2(1, 0), uint2(0, 1), uint2(1, 0), uint2(1, 1), uint2(0, 1) };
+
+// Sun shadow caster (ShadowMaps): the terrain at LOD 0 without skirts, one instance per chunk and
+// six vertices per quad. Cascades cache their depth, so the full-resolution grid is drawn only
+// when a cascade moves.
+vertex float4 groundShadowVertex(
+    uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
+    constant ShadowCasterUniforms &caster [[buffer(BufferIndexShadowCaster)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    texture2d<float> heightmap [[texture(TextureIndexTerrainHeight)]]
 ) {
-    // Define a constexpr sampler with repeat address mode (Crucial for tiling)
-    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::repeat);
-    
-    // Sample the texture color
-    float4 textureColor = colorTexture.sample(textureSampler, in.texcoord);
+    uint quad = vertexID / 6;
+    uint2 chunkCoord = uint2(instanceID % TERRAIN_CHUNKS_PER_SIDE, instanceID / TERRAIN_CHUNKS_PER_SIDE);
+    uint2 texel = chunkCoord * uint(TERRAIN_CHUNK_QUADS)
+                + uint2(quad % TERRAIN_CHUNK_QUADS, quad / TERRAIN_CHUNK_QUADS) + kShadowQuadCorners[vertexID % 6];
+    float spacing = (scene.groundMaxXZ.x - scene.groundMinXZ.x) / float(TERRAIN_HEIGHTMAP_SIZE - 1);
+    float2 xz = scene.groundMinXZ + float2(texel) * spacing;
+    return caster.viewProjection * float4(xz.x, heightmap.read(texel).r, xz.y, 1.0);
+}
+
+// Lit ground color at shading precision T (half on halfPrecisionShading pipelines)
+template <typename T>
+static vec<T, 4> shadeGround(float4 textureSample, vec<T, 3> interpolatedNormal, constant Uniforms &uniforms,
+                             constant SceneConstants &scene, float3 pointLight) {
+    typedef vec<T, 3> T3;
+    vec<T, 4> textureColor = vec<T, 4>(textureSample);
     
     // ============================================================================
     // 1. Tint Ground Green (Fake Integration with Grass)
     // ============================================================================
     // Blend dirt texture with dark green to create mossy forest floor look
     // This hides the intersection where grass blades touch the ground
-    float3 darkGreen = float3(0.1, 0.25, 0.1); // Dark green tint
-    float3 tintedColor = mix(textureColor.rgb, darkGreen, 0.8); // 80% green, 20% texture
+    T3 darkGreen = T3(0.1, 0.25, 0.1); // Dark green tint
+    T3 tintedColor = mix(textureColor.rgb, darkGreen, T(0.8)); // 80% green, 20% texture
     
     // Basic lighting: diffuse (dot product of normal & lightDirection) + ambient
-    float3 normal = normalize(in.normal);
-    float3 lightDir = normalize(uniforms.lightDirection);
+    T3 normal = normalize(interpolatedNormal);
+    T3 lightDir = T3(normalize(uniforms.lightDirection));
     
     // Calculate diffuse lighting
-    float NdotL = max(dot(normal, lightDir), 0.0);
+    T NdotL = max(dot(normal, lightDir), T(0.0));
     
     // Ambient level
-    float ambient = 0.4;
+    T ambient = T(0.4);
     
-    // Mix lighting
-    float3 lighting = uniforms.lightColor * (NdotL + ambient);
+    // Mix lighting (plus the point lights of the fragment's cluster)
+    T3 lighting = T3(scene.lightColor) * (NdotL + ambient) + T3(pointLight);
     
     // Apply lighting to tinted color
-    float4 finalColor = float4(tintedColor * lighting, textureColor.a);
+    return vec<T, 4>(tintedColor * lighting, textureColor.a);
+}
+
+// Sparse ground albedo at uv (0..1 over the field). The level the sampler wants is requested through
+// the feedback buffer (one pixel per dithered block; the CPU adds the ring around its tile and their
+// coarser parents);
+// the sample is clamped to the finest level resident under the pixel, so it never reads an
+// unmapped tile.
+static float4 sampleSparseGround(texture2d<float> sparseTexture, float2 uv, uint2 pixel,
+                                 constant SparseGroundUniforms &sparse, constant uchar *residency,
+                                 device uint *feedback) {
+    constexpr sampler sparseSampler(filter::linear, mip_filter::linear, address::clamp_to_edge);
+    uv = saturate(uv);
     
-    // No Alpha Discard (Ground is opaque)
-    return finalColor;
+    if (all(pixel % SPARSE_GROUND_FEEDBACK_CELL == 0)) {
+        float lod = sparseTexture.calculate_unclamped_lod(sparseSampler, uv);
+        uint level = uint(clamp(floor(lod), 0.0, float(sparse.levelCount - 1)));
+        if (level < sparse.pinnedLevel) {
+            uint tiles = max(sparse.tilesPerSide >> level, 1u);
+            uint2 tile = min(uint2(uv * float(tiles)), uint2(tiles - 1));
+            feedback[sparse.feedbackOffset[level] + tile.y * tiles + tile.x] = 1;
+        }
+    }
+    
+    uint2 baseTile = min(uint2(uv * float(sparse.tilesPerSide)), uint2(sparse.tilesPerSide - 1));
+    float minLevel = float(residency[baseTile.y * sparse.tilesPerSide + baseTile.x]);
+    return sparseTexture.sample(sparseSampler, uv, min_lod_clamp(minLevel));
 }
 
+// Trample strength under a ground fragment, bilinear between the map's texels (the blades read
+// them one by one, the soil would show the texel grid), and its gradient per meter. Where the
+// four texels lie in one summary tile, that tile's latest stamp rules out untouched ground with a
+// single read. Taps are clamped into the window, so the toroidal storage never wraps a far edge in.
+static float groundTrample(float2 worldXZ, constant Uniforms &uniforms, constant SceneConstants &scene,
+                           texture2d<float, access::read> trampleMap, texture2d<float, access::read> trampleSummary,
+                           thread float2 &gradient) {
+    gradient = float2(0.0);
+    if (!inTrampleWindow(worldXZ, uniforms.trampleWindowMinXZ, uniforms.trampleWindowSize)) {
+        return 0.0;
+    }
+    uint2 mapSize = uint2(trampleMap.get_width(), trampleMap.get_height());
+    float texelsPerMeter = trampleTexelsPerMeter(mapSize.x, uniforms.trampleWindowSize);
+    float2 texel = worldXZ * texelsPerMeter - 0.5;
+    int2 windowMin = trampleWorldTexel(uniforms.trampleWindowMinXZ + 0.5 / texelsPerMeter, texelsPerMeter);
+    int2 windowMax = windowMin + int2(mapSize) - 1;
+    int2 base = int2(floor(texel));
+    int2 lo = clamp(base, windowMin, windowMax);
+    int2 hi = clamp(base + 1, windowMin, windowMax);
+    
+    if (scene.trampleSummaryValid != 0) {
+        int2 tileLo = int2(floor(float2(lo) / float(TRAMPLE_SUMMARY_TILE)));
+        int2 tileHi = int2(floor(float2(hi) / float(TRAMPLE_SUMMARY_TILE)));
+        if (all(tileLo == tileHi)) {
+            uint2 summarySize = uint2(trampleSummary.get_width(), trampleSummary.get_height());
+            float latest = trampleSummary.read(trampleStorageTexel(tileLo, summarySize)).g;
+            if (trampleStrength(latest, uniforms.time, scene.trampleDecayRate) <= 0.0) {
+                return 0.0;
+            }
+        }
+    }
+    
+    float a = trampleStrength(trampleMap.read(trampleStorageTexel(lo, mapSize)).r, uniforms.time, scene.trampleDecayRate);
+    float b = trampleStrength(trampleMap.read(trampleStorageTexel(int2(hi.x, lo.y), mapSize)).r, uniforms.time, scene.trampleDecayRate);
+    float c = trampleStrength(trampleMap.read(trampleStorageTexel(int2(lo.x, hi.y), mapSize)).r, uniforms.time, scene.trampleDecayRate);
+    float d = trampleStrength(trampleMap.read(trampleStorageTexel(hi, mapSize)).r, uniforms.time, scene.trampleDecayRate);
+    float2 f = texel - float2(base);
+    gradient = float2(mix(b - a, d - c, f.y), mix(c - a, d - b, f.x)) * texelsPerMeter;
+    return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+}
+
+fragment SceneFragmentOut groundFragmentMain(
+    GroundRasterizerData in [[stage_in]],
+    texture2d<float> colorTexture [[texture(0)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    const device PointLight *pointLights [[buffer(BufferIndexPointLights)]],
+    const device LightCluster *lightClusters [[buffer(BufferIndexLightClusters)]],
+    texture2d<float, access::read> trampleMap [[texture(TextureIndexTrampleMap)]],
+    texture2d<float, access::read> trampleSummary [[texture(TextureIndexTrampleSummary)]],
+    texture2d<float> sparseTexture [[texture(TextureIndexSparseGround), function_constant(sparseGround)]],
+    constant SparseGroundUniforms &sparse [[buffer(BufferIndexSparseGround), function_constant(sparseGround)]],
+    constant uchar *residency [[buffer(BufferIndexSparseGroundResidency), function_constant(sparseGround)]],
+    device uint *feedback [[buffer(BufferIndexSparseGroundFeedback), function_constant(sparseGround)]]
+) {
+    // Define a constexpr sampler with repeat address mode (Crucial for tiling)
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::repeat);
+    
+    // Sample the texture color
+    float4 textureColor;
+    if (sparseGround) {
+        textureColor = sampleSparseGround(sparseTexture, in.texcoord / GROUND_TEXTURE_TILING, uint2(in.position.xy),
+                                          sparse, residency, feedback);
+    } else {
+        textureColor = colorTexture.sample(textureSampler, in.texcoord);
+    }
+    
+    // Point lights in float (positions and distances), like the blades
+    float3 normal;
+    if (halfPrecisionShading) {
+        normal = float3(in.normalHalf);
+    } else {
+        normal = in.normal;
+    }
+    
+    // Trampled soil: the footprint's slopes tilt the normal (the heightmap vertices are far
+    // coarser than its texels), and the pressed soil darkens with the blades' trample strength
+    float2 trampleGradient;
+    float trample = groundTrample(in.worldPos.xz, uniforms, scene, trampleMap, trampleSummary, trampleGradient);
+    normal = normalize(normal) + float3(trampleGradient.x, 0.0, trampleGradient.y) * GROUND_TRAMPLE_DEPTH;
+    float3 pointLight = clusteredPointLighting(in.worldPos, normalize(normal), false, uniforms, pointLights, lightClusters);
+    
+    float4 finalColor;
+    if (halfPrecisionShading) {
+        finalColor = float4(shadeGround<half>(textureColor, half3(normal), uniforms, scene, pointLight));
+    } else {
+        finalColor = shadeGround<float>(textureColor, normal, uniforms, scene, pointLight);
+    }
+    finalColor.rgb *= 1.0 - GROUND_TRAMPLE_DARKENING * trample;
+    
+    // No Alpha Discard (Ground is opaque)
+    SceneFragmentOut out;
+    out.color = finalColor;
+    if (writeMotionVectors) {
+        out.motion = motionVector(in.currentClip, in.previousClip);
+    }
+    if (writeTileDepth) {
+        out.tileDepth = in.position.z;
+    }
+    if (writeObjectId) {
+        out.objectId = in.objectId;
+    }
+    return out;
+}
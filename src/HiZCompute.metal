@@ -0,0 +1,67 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Compute shaders to build the hierarchical-Z (max depth) pyramid
+// Each Hi-Z texel stores the FARTHEST depth of the region it covers, so
+// "object nearest depth > Hi-Z depth" is a conservative occlusion test.
+
+// Max depth over a source footprint. Odd source sizes fold the last row/column into
+// the final destination texel so no source texel is ever skipped.
+static uint2 footprintEnd(uint2 gid, uint2 srcSize, uint2 dstSize) {
+    uint2 end = gid * 2 + 2;
+    if (gid.x == dstSize.x - 1) end.x = srcSize.x;
+    if (gid.y == dstSize.y - 1) end.y = srcSize.y;
+    return min(end, srcSize);
+}
+
+// Level 0: reduce the resolved scene depth into the first Hi-Z level (half resolution)
+kernel void buildHiZFromDepth(
+    depth2d<float, access::read> depthTexture [[texture(0)]],
+    texture2d<float, access::write> hiZLevel [[texture(1)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 dstSize = uint2(hiZLevel.get_width(), hiZLevel.get_height());
+    if (gid.x >= dstSize.x || gid.y >= dstSize.y) {
+        return;
+    }
+
+    uint2 srcSize = uint2(depthTexture.get_width(), depthTexture.get_height());
+    uint2 start = min(gid * 2, srcSize - 1);
+    uint2 end = footprintEnd(gid, srcSize, dstSize);
+
+    float maxDepth = 0.0;
+    for (uint y = start.y; y < end.y; ++y) {
+        for (uint x = start.x; x < end.x; ++x) {
+            maxDepth = max(maxDepth, depthTexture.read(uint2(x, y)));
+        }
+    }
+
+    hiZLevel.write(float4(maxDepth, 0.0, 0.0, 0.0), gid);
+}
+
+// Level N: 2x2 max reduction of level N-1 (bound as single-level texture views)
+kernel void downsampleHiZ(
+    texture2d<float, access::read> srcLevel [[texture(0)]],
+    texture2d<float, access::write> dstLevel [[texture(1)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 dstSize = uint2(dstLevel.get_width(), dstLevel.get_height());
+    if (gid.x >= dstSize.x || gid.y >= dstSize.y) {
+        return;
+    }
+
+    uint2 srcSize = uint2(srcLevel.get_width(), srcLevel.get_height());
+    uint2 start = min(gid * 2, srcSize - 1);
+    uint2 end = footprintEnd(gid, srcSize, dstSize);
+
+    float maxDepth = 0.0;
+    for (uint y = start.y; y < end.y; ++y) {
+        for (uint x = start.x; x < end.x; ++x) {
+            maxDepth = max(maxDepth, srcLevel.read(uint2(x, y)).r);
+        }
+    }
+
+    dstLevel.write(float4(maxDepth, 0.0, 0.0, 0.0), gid);
+}
@@ -0,0 +1,427 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "ImportedMesh.hpp"
+#include <tiny_obj_loader.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// Each LOD aims for this fraction of the previous LOD's triangles; the cluster grid grows from
+// kLodFirstCellResolution cells across the largest bounds extent until it gets there
+static constexpr float kLodTriangleRatio = 0.5f;
+static constexpr float kLodFirstCellResolution = 256.0f;
+static constexpr float kLodCellGrowth = 1.25f;
+// Post-transform cache modeled by the reordering (FIFO-ish LRU of recent vertices)
+static constexpr int kVertexCacheSize = 32;
+
+// Forsyth's linear-speed vertex cache optimisation: greedily emit the triangle whose vertices
+// score highest, where a vertex scores for sitting in the modeled cache (the last triangle's
+// three a fixed 0.75) and for having few triangles left (so islands finish instead of leaving
+// stragglers that reload their vertices later)
+static float vertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        score = cachePosition < 3 ? 0.75f
+                                  : std::pow(1.0f - float(cachePosition - 3) / float(kVertexCacheSize - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt(float(remainingTriangles));
+}
+
+static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Triangles around each vertex; live[v] of them are not emitted yet
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        ++offsets[index + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uint32_t v = indices[i];
+        adjacency[offsets[v] + live[v]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        scores[v] = vertexScore(-1, live[v]);
+    }
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    size_t scanCursor = 0;
+    int64_t best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (best < 0) {
+            // Nothing left around the cache: continue with the next triangle in input order
+            while (emitted[scanCursor]) {
+                ++scanCursor;
+            }
+            best = static_cast<int64_t>(scanCursor);
+        }
+
+        const uint32_t* triangle = &indices[best * 3];
+        emitted[best] = 1;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = triangle[k];
+            uint32_t* list = &adjacency[offsets[v]];
+            uint32_t* found = std::find(list, list + live[v], static_cast<uint32_t>(best));
+            *found = list[--live[v]];
+        }
+
+        // The triangle's vertices move to the front of the cache
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        for (size_t i = 0; i < nextCache.size(); ++i) {
+            uint32_t v = nextCache[i];
+            cachePosition[v] = i < static_cast<size_t>(kVertexCacheSize) ? static_cast<int>(i) : -1;
+            scores[v] = vertexScore(cachePosition[v], live[v]);
+        }
+
+        // Rescore the triangles touching the cache (and the vertices just evicted from it)
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : nextCache) {
+            for (uint32_t i = 0; i < live[v]; ++i) {
+                uint32_t t = adjacency[offsets[v] + i];
+                triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+                if (cachePosition[v] >= 0 && triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size() > static_cast<size_t>(kVertexCacheSize)) {
+            nextCache.resize(kVertexCacheSize);
+        }
+        cache.swap(nextCache);
+    }
+
+    indices.swap(result);
+}
+
+// Renumber vertices in the order the (cache-optimised) indices first use them, dropping unused ones
+static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+// Vertex clustering: vertices in one grid cell merge into their average; triangles whose
+// corners collapse into fewer than three cells disappear
+static void clusterSimplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                            simd::float3 boundsMin, float cellSize,
+                            std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+    std::unordered_map<uint64_t, uint32_t> cells;
+    std::vector<uint32_t> cellOf(vertices.size());
+    std::vector<float> weights;
+    outVertices.clear();
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        simd::float3 cell = simd::floor((vertices[v].position - boundsMin) / cellSize);
+        uint64_t key = (static_cast<uint64_t>(cell.x) & 0x1fffff) | ((static_cast<uint64_t>(cell.y) & 0x1fffff) << 21) |
+                       ((static_cast<uint64_t>(cell.z) & 0x1fffff) << 42);
+        auto inserted = cells.emplace(key, static_cast<uint32_t>(outVertices.size()));
+        if (inserted.second) {
+            Vertex merged = {};
+            outVertices.push_back(merged);
+            weights.push_back(0.0f);
+        }
+        uint32_t target = inserted.first->second;
+        outVertices[target].position += vertices[v].position;
+        outVertices[target].normal += vertices[v].normal;
+        outVertices[target].texcoord += vertices[v].texcoord;
+        weights[target] += 1.0f;
+        cellOf[v] = target;
+    }
+    for (size_t i = 0; i < outVertices.size(); ++i) {
+        outVertices[i].position /= weights[i];
+        outVertices[i].texcoord /= weights[i];
+        float length = simd::length(outVertices[i].normal);
+        outVertices[i].normal = length > 1e-6f ? outVertices[i].normal / length : simd::make_float3(0.0f, 1.0f, 0.0f);
+    }
+
+    outIndices.clear();
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = cellOf[indices[i]];
+        uint32_t b = cellOf[indices[i + 1]];
+        uint32_t c = cellOf[indices[i + 2]];
+        if (a != b && b != c && a != c) {
+            outIndices.push_back(a);
+            outIndices.push_back(b);
+            outIndices.push_back(c);
+        }
+    }
+}
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(info.st_size);
+    time = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+bool ImportedMesh::load(const std::string& objPath)
+{
+    uint64_t sourceSize = 0;
+    int64_t sourceTime = 0;
+    if (!sourceStamp(objPath, sourceSize, sourceTime)) {
+        std::cerr << "Mesh not found: " << objPath << std::endl;
+        return false;
+    }
+
+    std::string cachePath = objPath + ".vmesh";
+    if (loadCache(cachePath, sourceSize, sourceTime)) {
+        return true;
+    }
+    if (!importObj(objPath)) {
+        return false;
+    }
+    if (!saveCache(cachePath, sourceSize, sourceTime)) {
+        std::cerr << "Failed to write mesh cache " << cachePath << std::endl;
+    }
+    return true;
+}
+
+bool ImportedMesh::importObj(const std::string& objPath)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warning;
+    std::string error;
+    std::string directory = objPath.substr(0, objPath.find_last_of('/') + 1);
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, objPath.c_str(), directory.c_str(), true)) {
+        std::cerr << "Failed to load mesh " << objPath << ": " << error << std::endl;
+        return false;
+    }
+
+    // Weld the OBJ corners: one vertex per distinct (position, normal, texcoord) index triple
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::unordered_map<uint64_t, uint32_t> welded;
+    bool hasNormals = !attrib.normals.empty();
+    for (const tinyobj::shape_t& shape : shapes) {
+        for (const tinyobj::index_t& corner : shape.mesh.indices) {
+            uint64_t key = (static_cast<uint64_t>(corner.vertex_index + 1) << 42) |
+                           (static_cast<uint64_t>(corner.normal_index + 1) << 21) |
+                           static_cast<uint64_t>(corner.texcoord_index + 1);
+            auto inserted = welded.emplace(key, static_cast<uint32_t>(vertices.size()));
+            if (inserted.second) {
+                Vertex vertex = {};
+                const float* p = &attrib.vertices[3 * corner.vertex_index];
+                vertex.position = simd::make_float3(p[0], p[1], p[2]);
+                if (hasNormals && corner.normal_index >= 0) {
+                    const float* n = &attrib.normals[3 * corner.normal_index];
+                    vertex.normal = simd::make_float3(n[0], n[1], n[2]);
+                }
+                if (corner.texcoord_index >= 0) {
+                    // OBJ v runs bottom to top, Metal texture rows top to bottom
+                    const float* t = &attrib.texcoords[2 * corner.texcoord_index];
+                    vertex.texcoord = simd::make_float2(t[0], 1.0f - t[1]);
+                }
+                vertices.push_back(vertex);
+            }
+            indices.push_back(inserted.first->second);
+        }
+    }
+    if (indices.empty()) {
+        std::cerr << "Mesh has no triangles: " << objPath << std::endl;
+        return false;
+    }
+
+    // Files without normals get smooth area-weighted ones
+    if (!hasNormals) {
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            simd::float3 a = vertices[indices[i]].position;
+            simd::float3 faceNormal = simd::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+            for (int k = 0; k < 3; ++k) {
+                vertices[indices[i + k]].normal += faceNormal;
+            }
+        }
+    }
+    m_boundsMin = vertices[0].position;
+    m_boundsMax = vertices[0].position;
+    for (Vertex& vertex : vertices) {
+        float length = simd::length(vertex.normal);
+        vertex.normal = length > 1e-6f ? vertex.normal / length : simd::make_float3(0.0f, 1.0f, 0.0f);
+        m_boundsMin = simd::min(m_boundsMin, vertex.position);
+        m_boundsMax = simd::max(m_boundsMax, vertex.position);
+    }
+
+    m_vertices.clear();
+    m_indices.clear();
+    m_lods.clear();
+    if (vertices.size() > UINT16_MAX) {
+        std::cerr << "Mesh " << objPath << " has " << vertices.size() << " vertices (16-bit indices allow " << UINT16_MAX << ")" << std::endl;
+        return false;
+    }
+    appendLod(vertices, indices, 0.0f);
+
+    // Coarser LODs from the full mesh (not the previous LOD, so the errors do not accumulate)
+    simd::float3 extent = m_boundsMax - m_boundsMin;
+    float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    float cellSize = largest / kLodFirstCellResolution;
+    size_t previousTriangles = indices.size() / 3;
+    for (int lod = 1; lod < kMaxLods && largest > 0.0f; ++lod) {
+        size_t target = static_cast<size_t>(float(previousTriangles) * kLodTriangleRatio);
+        std::vector<Vertex> lodVertices;
+        std::vector<uint32_t> lodIndices;
+        do {
+            clusterSimplify(vertices, indices, m_boundsMin, cellSize, lodVertices, lodIndices);
+            cellSize *= kLodCellGrowth;
+        } while (lodIndices.size() / 3 > target && cellSize < largest);
+        size_t triangles = lodIndices.size() / 3;
+        if (triangles == 0 || triangles > target) {
+            break;
+        }
+        appendLod(lodVertices, lodIndices, cellSize / kLodCellGrowth);
+        previousTriangles = triangles;
+    }
+
+    std::cout << "Imported mesh " << objPath << ": " << m_lods.size() << " LODs, " << m_lods[0].indexCount / 3 << " triangles at LOD 0" << std::endl;
+    return true;
+}
+
+void ImportedMesh::appendLod(const std::vector<Vertex>& vertices, std::vector<uint32_t> indices, float clusterSize)
+{
+    std::vector<Vertex> lodVertices = vertices;
+    optimizeVertexCache(indices, lodVertices.size());
+    optimizeVertexFetch(lodVertices, indices);
+
+    Lod lod = {};
+    lod.indexStart = static_cast<uint32_t>(m_indices.size());
+    lod.indexCount = static_cast<uint32_t>(indices.size());
+    lod.baseVertex = static_cast<uint32_t>(m_vertices.size());
+    lod.vertexCount = static_cast<uint32_t>(lodVertices.size());
+    lod.clusterSize = clusterSize;
+    m_lods.push_back(lod);
+
+    m_vertices.insert(m_vertices.end(), lodVertices.begin(), lodVertices.end());
+    for (uint32_t index : indices) {
+        m_indices.push_back(static_cast<uint16_t>(index));
+    }
+}
+
+// Cache layout: header, bounds, Lod table, vertices, indices (host layout: the cache is a
+// per-machine build product, rebuilt whenever the version, the OBJ size or its mtime changes)
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t vertexStride;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+bool ImportedMesh::loadCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceTime)
+{
+    std::ifstream file(cachePath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    MeshCacheHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || header.magic != kMagic || header.version != kVersion || header.vertexStride != sizeof(Vertex) ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime ||
+        header.lodCount == 0 || header.lodCount > kMaxLods) {
+        return false;
+    }
+
+    std::vector<Lod> lods(header.lodCount);
+    std::vector<Vertex> vertices(header.vertexCount);
+    std::vector<uint16_t> indices(header.indexCount);
+    file.read(reinterpret_cast<char*>(lods.data()), static_cast<std::streamsize>(lods.size() * sizeof(Lod)));
+    file.read(reinterpret_cast<char*>(vertices.data()), static_cast<std::streamsize>(vertices.size() * sizeof(Vertex)));
+    file.read(reinterpret_cast<char*>(indices.data()), static_cast<std::streamsize>(indices.size() * sizeof(uint16_t)));
+    if (!file) {
+        std::cerr << "Truncated mesh cache " << cachePath << std::endl;
+        return false;
+    }
+    for (const Lod& lod : lods) {
+        if (lod.indexStart + lod.indexCount > indices.size() || lod.baseVertex + lod.vertexCount > vertices.size()) {
+            std::cerr << "Corrupt mesh cache " << cachePath << std::endl;
+            return false;
+        }
+    }
+
+    m_lods.swap(lods);
+    m_vertices.swap(vertices);
+    m_indices.swap(indices);
+    m_boundsMin = simd::make_float3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    m_boundsMax = simd::make_float3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    return true;
+}
+
+bool ImportedMesh::saveCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceTime) const
+{
+    std::ofstream file(cachePath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    MeshCacheHeader header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.vertexCount = static_cast<uint32_t>(m_vertices.size());
+    header.indexCount = static_cast<uint32_t>(m_indices.size());
+    header.lodCount = static_cast<uint32_t>(m_lods.size());
+    header.vertexStride = sizeof(Vertex);
+    std::memcpy(header.boundsMin, &m_boundsMin, sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax, &m_boundsMax, sizeof(header.boundsMax));
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_lods.data()), static_cast<std::streamsize>(m_lods.size() * sizeof(Lod)));
+    file.write(reinterpret_cast<const char*>(m_vertices.data()), static_cast<std::streamsize>(m_vertices.size() * sizeof(Vertex)));
+    file.write(reinterpret_cast<const char*>(m_indices.data()), static_cast<std::streamsize>(m_indices.size() * sizeof(uint16_t)));
+    return file.good();
+}
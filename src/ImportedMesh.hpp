@@ -0,0 +1,50 @@
+#pragma once
+#include "ShaderTypes.h"
+#include <simd/simd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Artist geometry (flowers, bushes, rocks) imported from an OBJ file into the Vertex layout of the
+// other static meshes. Import welds the OBJ corners into shared vertices, builds coarser LODs by
+// vertex clustering, reorders every LOD's triangles for the post-transform vertex cache (Forsyth)
+// and its vertices in first-use order for fetch locality. The result is written next to the OBJ
+// as a binary cache (path + ".vmesh") that later loads read directly, without parsing, while it
+// is newer than the OBJ it was built from.
+class ImportedMesh {
+public:
+    static constexpr int kMaxLods = 4;
+
+    // One LOD: a vertex range and the LOD-local uint16 indices into it (draw with baseVertex)
+    struct Lod {
+        uint32_t indexStart;
+        uint32_t indexCount;
+        uint32_t baseVertex;
+        uint32_t vertexCount;
+        float clusterSize; // Simplification grid cell in model units (0 at LOD 0)
+    };
+
+    // From the binary cache when it is current, otherwise by importing the OBJ (and caching it)
+    bool load(const std::string& objPath);
+
+    const std::vector<Vertex>& getVertices() const { return m_vertices; }
+    const std::vector<uint16_t>& getIndices() const { return m_indices; }
+    const std::vector<Lod>& getLods() const { return m_lods; }
+    simd::float3 getBoundsMin() const { return m_boundsMin; }
+    simd::float3 getBoundsMax() const { return m_boundsMax; }
+
+private:
+    static constexpr uint32_t kMagic = 0x48534d56; // "VMSH"
+    static constexpr uint32_t kVersion = 1;
+
+    bool importObj(const std::string& objPath);
+    bool loadCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceTime);
+    bool saveCache(const std::string& cachePath, uint64_t sourceSize, int64_t sourceTime) const;
+    void appendLod(const std::vector<Vertex>& vertices, std::vector<uint32_t> indices, float clusterSize);
+
+    std::vector<Vertex> m_vertices; // Every LOD's vertices, LOD 0 first
+    std::vector<uint16_t> m_indices;
+    std::vector<Lod> m_lods;
+    simd::float3 m_boundsMin = simd::make_float3(0.0f, 0.0f, 0.0f);
+    simd::float3 m_boundsMax = simd::make_float3(0.0f, 0.0f, 0.0f);
+};
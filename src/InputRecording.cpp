@@ -0,0 +1,133 @@
+#include "InputRecording.hpp"
+#include <fstream>
+#include <iostream>
+
+// Frame flags: mouse buttons in bits 0-2, then focus, then "window sizes follow"
+static constexpr uint8_t kFlagFocused = 1u << 3;
+static constexpr uint8_t kFlagSizes = 1u << 4;
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& file, T& value)
+{
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool InputRecording::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write input recording " << path << std::endl;
+        return false;
+    }
+
+    uint32_t header[4] = { kMagic, kVersion, seed, static_cast<uint32_t>(frames.size()) };
+    float pose[5] = { startPosition.x, startPosition.y, startPosition.z, startYaw, startPitch };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(pose), sizeof(pose));
+
+    const FramePacket* previous = nullptr;
+    for (const Frame& frame : frames) {
+        const FramePacket& input = frame.input;
+        bool sizesChanged = !previous || input.windowWidth != previous->windowWidth || input.windowHeight != previous->windowHeight ||
+                            input.framebufferWidth != previous->framebufferWidth || input.framebufferHeight != previous->framebufferHeight;
+        uint8_t flags = (input.focused ? kFlagFocused : 0) | (sizesChanged ? kFlagSizes : 0);
+        for (int button = 0; button < FramePacket::kMouseButtonCount; ++button) {
+            flags |= input.mouseButtons[button] ? static_cast<uint8_t>(1u << button) : 0;
+        }
+        uint16_t keyCount = static_cast<uint16_t>(input.keys.count());
+
+        writeValue(file, frame.deltaTime);
+        writeValue(file, frame.sceneTime);
+        writeValue(file, input.cursorX);
+        writeValue(file, input.cursorY);
+        writeValue(file, flags);
+        writeValue(file, keyCount);
+        for (int key = 0; key < FramePacket::kKeyCount; ++key) {
+            if (input.keys.test(static_cast<size_t>(key))) {
+                writeValue(file, static_cast<uint16_t>(key));
+            }
+        }
+        if (sizesChanged) {
+            int32_t sizes[4] = { input.windowWidth, input.windowHeight, input.framebufferWidth, input.framebufferHeight };
+            file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        }
+        previous = &input;
+    }
+
+    if (!file) {
+        std::cerr << "Failed to write input recording " << path << std::endl;
+        return false;
+    }
+    std::cout << "Input recording: wrote " << frames.size() << " frames to " << path << std::endl;
+    return true;
+}
+
+bool InputRecording::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open input recording " << path << std::endl;
+        return false;
+    }
+
+    uint32_t header[4] = {};
+    float pose[5] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    file.read(reinterpret_cast<char*>(pose), sizeof(pose));
+    if (!file || header[0] != kMagic || header[1] != kVersion) {
+        std::cerr << "Invalid input recording " << path << std::endl;
+        return false;
+    }
+
+    std::vector<Frame> loaded;
+    loaded.reserve(header[3]);
+    FramePacket input;
+    for (uint32_t i = 0; i < header[3]; ++i) {
+        Frame frame = {};
+        uint8_t flags = 0;
+        uint16_t keyCount = 0;
+        bool ok = readValue(file, frame.deltaTime) && readValue(file, frame.sceneTime) &&
+                  readValue(file, input.cursorX) && readValue(file, input.cursorY) &&
+                  readValue(file, flags) && readValue(file, keyCount);
+        input.keys.reset();
+        for (uint16_t k = 0; ok && k < keyCount; ++k) {
+            uint16_t key = 0;
+            ok = readValue(file, key) && key < FramePacket::kKeyCount;
+            if (ok) {
+                input.keys.set(key);
+            }
+        }
+        // Sizes carry over from the previous frame unless the flag says they changed
+        if (ok && (flags & kFlagSizes)) {
+            int32_t sizes[4] = {};
+            ok = static_cast<bool>(file.read(reinterpret_cast<char*>(sizes), sizeof(sizes)));
+            input.windowWidth = sizes[0];
+            input.windowHeight = sizes[1];
+            input.framebufferWidth = sizes[2];
+            input.framebufferHeight = sizes[3];
+        }
+        if (!ok) {
+            std::cerr << "Truncated input recording " << path << " (frame " << i << ")" << std::endl;
+            return false;
+        }
+        for (int button = 0; button < FramePacket::kMouseButtonCount; ++button) {
+            input.mouseButtons[button] = (flags & (1u << button)) != 0;
+        }
+        input.focused = (flags & kFlagFocused) != 0;
+        frame.input = input;
+        loaded.push_back(frame);
+    }
+
+    seed = header[2];
+    startPosition = glm::vec3(pose[0], pose[1], pose[2]);
+    startYaw = pose[3];
+    startPitch = pose[4];
+    frames.swap(loaded);
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "FramePacket.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per-frame input of a session for deterministic replay: every packet Renderer::update() saw,
+// its timestep and the scene time of the frame, plus the placement seed and the camera pose the
+// recording started from. Replaying a file in a renderer built with that seed repeats the same
+// camera path, key toggles and simulation clock, so a reported stutter can be profiled again.
+// Files store only the held keys of each frame, and the window sizes only when they change.
+class InputRecording {
+public:
+    struct Frame {
+        FramePacket input;
+        float deltaTime;
+        float sceneTime;              // Fixed time the replay draws the frame at
+    };
+
+    uint32_t seed = 0;                // Grass placement seed of the recorded renderer
+    glm::vec3 startPosition = glm::vec3(0.0f);
+    float startYaw = 0.0f;
+    float startPitch = 0.0f;
+    std::vector<Frame> frames;
+
+    void record(const FramePacket& input, float deltaTime, float sceneTime) { frames.push_back({ input, deltaTime, sceneTime }); }
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    static constexpr uint32_t kMagic = 0x4e494756; // "VGIN"
+    static constexpr uint32_t kVersion = 1;
+};
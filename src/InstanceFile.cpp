@@ -0,0 +1,182 @@
+#include "InstanceFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+InstanceFile::InstanceFile()
+    : m_mapping(nullptr)
+    , m_mappingSize(0)
+    , m_instanceBuffer(nullptr)
+    , m_cellBuffer(nullptr)
+    , m_cells(nullptr)
+    , m_instanceCount(0)
+    , m_cellsPerSide(0)
+    , m_halfSize(0.0f)
+{
+}
+
+InstanceFile::~InstanceFile()
+{
+    unload();
+}
+
+void InstanceFile::unload()
+{
+    // The no-copy buffers alias the mapping: drop them before the pages go away
+    if (m_instanceBuffer) {
+        m_instanceBuffer->release();
+        m_instanceBuffer = nullptr;
+    }
+    if (m_cellBuffer) {
+        m_cellBuffer->release();
+        m_cellBuffer = nullptr;
+    }
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+        m_mapping = nullptr;
+        m_mappingSize = 0;
+    }
+    m_cells = nullptr;
+    m_instanceCount = 0;
+    m_cellsPerSide = 0;
+}
+
+bool InstanceFile::write(const std::string& path, int cellsPerSide, float halfSize,
+                         const std::vector<InstanceData>& instances, const std::vector<GrassCell>& cells)
+{
+    if (cellsPerSide <= 0 || cells.size() != static_cast<size_t>(cellsPerSide) * cellsPerSide) {
+        std::cerr << "Instance file needs one cell per grid cell: " << path << std::endl;
+        return false;
+    }
+
+    Header header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.cellsPerSide = static_cast<uint32_t>(cellsPerSide);
+    header.instanceCount = static_cast<uint32_t>(instances.size());
+    header.halfSize = halfSize;
+    header.instanceStride = sizeof(InstanceData);
+    header.cellStride = sizeof(GrassCell);
+    header.cellOffset = alignUp(sizeof(Header), kSectionAlignment);
+    header.cellBytes = alignUp(cells.size() * sizeof(GrassCell), kSectionAlignment);
+    header.instanceOffset = header.cellOffset + header.cellBytes;
+    header.instanceBytes = alignUp(std::max<size_t>(instances.size(), 1) * sizeof(InstanceData), kSectionAlignment);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Failed to open instance file for writing: " << path << std::endl;
+        return false;
+    }
+
+    // Each section zero-padded to its page-aligned extent
+    std::vector<char> padding(kSectionAlignment, 0);
+    auto writeSection = [&](const void* data, uint64_t size, uint64_t paddedSize) {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        file.write(padding.data(), static_cast<std::streamsize>(paddedSize - size));
+    };
+    writeSection(&header, sizeof(Header), header.cellOffset);
+    writeSection(cells.data(), cells.size() * sizeof(GrassCell), header.cellBytes);
+    writeSection(instances.data(), instances.size() * sizeof(InstanceData), header.instanceBytes);
+
+    if (!file) {
+        std::cerr << "Failed to write instance file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool InstanceFile::load(MTL::Device* device, const std::string& path)
+{
+    unload();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open instance file: " << path << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_size) < sizeof(Header)) {
+        std::cerr << "Truncated instance file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    Header header;
+    if (pread(fd, &header, sizeof(Header), 0) != static_cast<ssize_t>(sizeof(Header))) {
+        std::cerr << "Truncated instance file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    if (header.magic != kMagic || header.version != kVersion
+        || header.instanceStride != sizeof(InstanceData) || header.cellStride != sizeof(GrassCell)) {
+        std::cerr << "Invalid instance file (unsupported version or layout): " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    // No-copy buffers need page-aligned pointers and lengths; the sections were laid out for
+    // 16 KB pages, which covers a 4 KB page host as well
+    uint64_t pageSize = static_cast<uint64_t>(getpagesize());
+    uint64_t cellCount = static_cast<uint64_t>(header.cellsPerSide) * header.cellsPerSide;
+    uint64_t fileEnd = header.instanceOffset + header.instanceBytes;
+    if (kSectionAlignment % pageSize != 0
+        || header.cellOffset % pageSize != 0 || header.cellBytes % pageSize != 0
+        || header.instanceOffset % pageSize != 0 || header.instanceBytes % pageSize != 0
+        || header.cellBytes < cellCount * sizeof(GrassCell)
+        || header.instanceBytes < static_cast<uint64_t>(header.instanceCount) * sizeof(InstanceData)
+        || header.instanceOffset < header.cellOffset + header.cellBytes
+        || fileEnd > static_cast<uint64_t>(info.st_size)) {
+        std::cerr << "Corrupt instance file (section layout): " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    // Private copy-on-write mapping: the GPU only reads, but Metal may touch the pages writable
+    void* mapping = mmap(nullptr, static_cast<size_t>(fileEnd), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file referenced
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map instance file: " << path << std::endl;
+        return false;
+    }
+    m_mapping = mapping;
+    m_mappingSize = static_cast<size_t>(fileEnd);
+
+    // The cell index is the only part read on the host: check its ranges stay inside the instances
+    const GrassCell* cells = reinterpret_cast<const GrassCell*>(static_cast<char*>(mapping) + header.cellOffset);
+    for (uint64_t cell = 0; cell < cellCount; ++cell) {
+        if (static_cast<uint64_t>(cells[cell].firstInstance) + cells[cell].instanceCount > header.instanceCount) {
+            std::cerr << "Corrupt instance file (cell " << cell << " range): " << path << std::endl;
+            unload();
+            return false;
+        }
+    }
+
+    m_cellBuffer = device->newBuffer(static_cast<char*>(mapping) + header.cellOffset, header.cellBytes,
+                                     MTL::ResourceStorageModeShared, nullptr);
+    m_instanceBuffer = device->newBuffer(static_cast<char*>(mapping) + header.instanceOffset, header.instanceBytes,
+                                         MTL::ResourceStorageModeShared, nullptr);
+    if (!m_cellBuffer || !m_instanceBuffer) {
+        std::cerr << "Failed to wrap instance file pages in buffers: " << path << std::endl;
+        unload();
+        return false;
+    }
+    m_cellBuffer->setLabel(NS::String::string("Grass Cells (file)", NS::UTF8StringEncoding));
+    m_instanceBuffer->setLabel(NS::String::string("Grass Instances (file)", NS::UTF8StringEncoding));
+
+    m_cells = cells;
+    m_instanceCount = header.instanceCount;
+    m_cellsPerSide = static_cast<int>(header.cellsPerSide);
+    m_halfSize = header.halfSize;
+    return true;
+}
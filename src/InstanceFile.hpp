@@ -0,0 +1,63 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "ShaderTypes.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary grass field authored offline: a header, the GrassCell index of the cell grid and the
+// cell-sorted packed InstanceData, each section starting on a page boundary and padded to whole
+// pages. load() maps the file and wraps both sections in no-copy shared buffers, so the GPU reads
+// the instances straight from the file pages; nothing is parsed or copied per instance, and pages
+// are only faulted in when first touched.
+class InstanceFile {
+public:
+    InstanceFile();
+    ~InstanceFile(); // Releases the buffers, then unmaps (the GPU must be done with them)
+
+    // Write instances sorted by cell with their cell index (GrassField layout)
+    static bool write(const std::string& path, int cellsPerSide, float halfSize,
+                      const std::vector<InstanceData>& instances, const std::vector<GrassCell>& cells);
+
+    bool load(MTL::Device* device, const std::string& path);
+
+    bool isValid() const { return m_instanceBuffer && m_cellBuffer; }
+    MTL::Buffer* getInstanceBuffer() const { return m_instanceBuffer; }
+    MTL::Buffer* getCellBuffer() const { return m_cellBuffer; }
+    const GrassCell* getCells() const { return m_cells; } // Mapped cell index (host view)
+    uint32_t getInstanceCount() const { return m_instanceCount; }
+    int getCellsPerSide() const { return m_cellsPerSide; }
+    int getCellCount() const { return m_cellsPerSide * m_cellsPerSide; }
+    float getHalfSize() const { return m_halfSize; }
+
+private:
+    static constexpr uint32_t kMagic = 0x46494756; // "VGIF"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kSectionAlignment = 16384; // Apple silicon page size (a multiple of 4 KB pages)
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t cellsPerSide;
+        uint32_t instanceCount;
+        float halfSize;
+        uint32_t instanceStride; // sizeof(InstanceData) the file was written with
+        uint32_t cellStride;     // sizeof(GrassCell)
+        uint32_t pad;
+        uint64_t cellOffset;     // Page-aligned section offsets and padded sizes
+        uint64_t cellBytes;
+        uint64_t instanceOffset;
+        uint64_t instanceBytes;
+    };
+
+    void unload();
+
+    void* m_mapping;
+    size_t m_mappingSize;
+    MTL::Buffer* m_instanceBuffer;
+    MTL::Buffer* m_cellBuffer;
+    const GrassCell* m_cells;
+    uint32_t m_instanceCount;
+    int m_cellsPerSide;
+    float m_halfSize;
+};
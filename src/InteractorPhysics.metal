@@ -0,0 +1,175 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Ground height and normal under a body (central differences over one heightmap texel)
+static float3 groundNormal(texture2d<float> heightmap, float2 xz, constant InteractorPhysicsUniforms &params) {
+    float spacing = (params.groundMaxXZ.x - params.groundMinXZ.x) / float(TERRAIN_HEIGHTMAP_SIZE - 1);
+    float dx = terrainHeight(heightmap, xz + float2(spacing, 0.0), params.groundMinXZ, params.groundMaxXZ)
+             - terrainHeight(heightmap, xz - float2(spacing, 0.0), params.groundMinXZ, params.groundMaxXZ);
+    float dz = terrainHeight(heightmap, xz + float2(0.0, spacing), params.groundMinXZ, params.groundMaxXZ)
+             - terrainHeight(heightmap, xz - float2(0.0, spacing), params.groundMinXZ, params.groundMaxXZ);
+    return normalize(float3(-dx, 2.0 * spacing, -dz));
+}
+
+// Rigid spheres and upright capsules rolling over the terrain, stepped in a single threadgroup
+// (one thread per body). The bodies live in a private buffer that never leaves the GPU; every
+// frame runs the fixed steps its simulation clock made due (none, one or a few, each of
+// deltaTime) and rewrites this frame's interactor array from the bodies, drawn alpha of the way
+// from the state before the last step to the state after it. The trample kernels and the
+// instanced body draw read that array as they read the scripted interactors, so the CPU touches
+// nothing per frame beyond the kinematic ball's position.
+kernel void simulateInteractors(
+    device InteractorBody *bodies [[buffer(InteractorPhysicsBufferIndexBodies)]],
+    device Interactor *interactors [[buffer(InteractorPhysicsBufferIndexInteractors)]],
+    constant InteractorPhysicsUniforms &params [[buffer(InteractorPhysicsBufferIndexUniforms)]],
+    texture2d<float> heightmap [[texture(0)]],
+    texture2d<float> densityMap [[texture(1)]],
+    uint tid [[thread_index_in_threadgroup]]
+) {
+    // Predicted state of every body (xyz = position, w = radius; half height, inverse mass;
+    // velocity), so each thread resolves its own contacts against the same snapshot
+    threadgroup float4 sharedPositions[MAX_INTERACTORS];
+    threadgroup float2 sharedShapes[MAX_INTERACTORS];
+    threadgroup float3 sharedVelocities[MAX_INTERACTORS];
+
+    uint bodyCount = min(params.bodyCount, uint(MAX_INTERACTORS));
+    bool active = tid < bodyCount;
+    float dt = params.deltaTime;
+
+    InteractorBody body = {};
+    if (active && params.reset != 0) {
+        // Spawn from the interactor array: its motion over the last frame becomes the velocity
+        Interactor spawn = interactors[tid];
+        body.position = spawn.position;
+        body.velocity = params.frameDeltaTime > 0.0 ? (spawn.position - spawn.prevPosition) / params.frameDeltaTime : float3(0.0);
+        body.radius = spawn.bodyRadius;
+        body.halfHeight = spawn.halfHeight;
+        float volume = body.radius * body.radius * (body.radius + 1.5 * body.halfHeight); // Up to 4/3 pi
+        body.inverseMass = (tid == 0 && params.kinematicBall != 0) ? 0.0 : 1.0 / max(volume, 1e-3);
+        body.footprintScale = spawn.radius / max(spawn.bodyRadius, 1e-3);
+        body.material = spawn.material;
+        body.previousPosition = spawn.position;
+        body.drawnPosition = spawn.prevPosition;
+    } else if (active) {
+        body = bodies[tid];
+    }
+
+    // Every thread runs every step (inactive ones publish empty bodies), so the barriers match
+    uint stepCount = params.reset != 0 ? 0 : params.stepCount;
+    for (uint step = 0; step < stepCount; ++step) {
+        if (active) {
+            body.previousPosition = body.position;
+            if (body.inverseMass == 0.0) {
+                float3 target = mix(params.kinematicStartPosition, params.kinematicPosition, float(step + 1) / float(stepCount));
+                body.velocity = dt > 0.0 ? (target - body.position) / dt : float3(0.0);
+                body.position = target;
+            } else {
+                // Semi-implicit Euler: gravity first, contacts then correct the predicted position
+                body.velocity.y -= params.gravity * dt;
+                body.position += body.velocity * dt;
+            }
+        }
+        sharedPositions[tid] = float4(active ? body.position : float3(0.0), active ? body.radius : 0.0);
+        sharedShapes[tid] = active ? float2(body.halfHeight, body.inverseMass) : float2(0.0);
+        sharedVelocities[tid] = active ? body.velocity : float3(0.0);
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+
+        if (active && body.inverseMass > 0.0) {
+            // Body contacts: closest points of the two vertical segments (a sphere is a segment of
+            // length 0), split by inverse mass so each side applies its share of the correction
+            float3 correction = float3(0.0);
+            float3 velocityChange = float3(0.0);
+            for (uint j = 0; j < bodyCount; ++j) {
+                float4 other = sharedPositions[j];
+                float2 otherShape = sharedShapes[j];
+                if (j == tid || other.w <= 0.0) {
+                    continue;
+                }
+                float3 offset = body.position - other.xyz;
+                float reach = body.halfHeight + otherShape.x;
+                offset.y = sign(offset.y) * max(abs(offset.y) - reach, 0.0);
+                float dist = length(offset);
+                float minDist = body.radius + other.w;
+                if (dist >= minDist || dist < 1e-5) {
+                    continue;
+                }
+                float3 normal = offset / dist;
+                float share = body.inverseMass / (body.inverseMass + otherShape.y);
+                correction += normal * (minDist - dist) * share;
+                float approach = dot(body.velocity - sharedVelocities[j], normal);
+                if (approach < 0.0) {
+                    velocityChange -= normal * approach * (1.0 + params.restitution) * share;
+                }
+            }
+            body.position += correction;
+            body.velocity += velocityChange;
+
+            // Ground contact against the heightmap: bounce along the terrain normal, then lose tangential
+            // speed to friction and to the grass the body rolls through (slopes keep it rolling downhill)
+            float bottom = body.radius + body.halfHeight;
+            float ground = terrainHeight(heightmap, body.position.xz, params.groundMinXZ, params.groundMaxXZ);
+            if (body.position.y - bottom < ground) {
+                float3 normal = groundNormal(heightmap, body.position.xz, params);
+                body.position.y = ground + bottom;
+
+                float normalSpeed = dot(body.velocity, normal);
+                float3 tangential = body.velocity - normalSpeed * normal;
+                normalSpeed = normalSpeed < 0.0 ? -normalSpeed * params.restitution : normalSpeed;
+
+                float density = 1.0;
+                if (params.useDensityMap != 0) {
+                    constexpr sampler densitySampler(filter::linear, address::clamp_to_edge);
+                    float2 uv = saturate((body.position.xz - params.groundMinXZ) / (params.groundMaxXZ - params.groundMinXZ));
+                    density = densityMap.sample(densitySampler, uv, level(0)).r;
+                }
+                float damping = exp(-(params.friction + params.grassDrag * density) * dt);
+                body.velocity = normalSpeed * normal + tangential * damping;
+            }
+
+            // Bounce off the edges of the ground
+            float2 minXZ = params.groundMinXZ + body.radius;
+            float2 maxXZ = params.groundMaxXZ - body.radius;
+            for (uint axis = 0; axis < 2; ++axis) {
+                uint component = axis == 0 ? 0 : 2;
+                if (body.position[component] < minXZ[axis]) {
+                    body.position[component] = minXZ[axis];
+                    body.velocity[component] = abs(body.velocity[component]) * params.restitution;
+                } else if (body.position[component] > maxXZ[axis]) {
+                    body.position[component] = maxXZ[axis];
+                    body.velocity[component] = -abs(body.velocity[component]) * params.restitution;
+                }
+            }
+        }
+
+        // The next step overwrites the snapshot
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+
+    if (!active) {
+        return;
+    }
+
+    // Drawn between the last two steps; the trail continues from last frame's drawn position
+    float3 drawn = mix(body.previousPosition, body.position, params.alpha);
+    float3 prevDrawn = body.drawnPosition;
+    body.drawnPosition = drawn;
+    bodies[tid] = body;
+
+    // The footprint fades out as the body leaves the ground, so airborne bodies do not trample
+    float bottom = body.radius + body.halfHeight;
+    float ground = terrainHeight(heightmap, drawn.xz, params.groundMinXZ, params.groundMaxXZ);
+    float clearance = max(drawn.y - bottom - ground, 0.0);
+    float contact = saturate(1.0 - clearance / max(body.radius, 1e-3));
+
+    Interactor interactor;
+    interactor.position = drawn;
+    interactor.prevPosition = prevDrawn;
+    interactor.radius = body.radius * body.footprintScale * contact;
+    interactor.falloff = interactor.radius * 0.35; // Same soft band as the scripted interactors
+    interactor.bodyRadius = body.radius;
+    interactor.halfHeight = body.halfHeight;
+    interactor.material = body.material;
+    interactors[tid] = interactor;
+}
@@ -0,0 +1,212 @@
+#include "JobSystem.hpp"
+#include <Foundation/Foundation.hpp>
+#include <algorithm>
+
+// The pool a worker thread belongs to and its deque (outside threads: none)
+static thread_local const JobSystem* t_pool = nullptr;
+static thread_local unsigned t_queue = 0;
+
+JobSystem::JobSystem(unsigned workerCount)
+    : m_queues(nullptr)
+    , m_queueCount(0)
+    , m_queued(0)
+    , m_stopping(false)
+{
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+    m_queueCount = workerCount + 1;
+    m_queues = new Queue[m_queueCount];
+    for (unsigned i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&JobSystem::workerMain, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+
+    // Without workers, whatever is left runs here
+    Task task;
+    while (take(task, m_queues[m_queueCount - 1], true)) {
+        execute(task);
+    }
+    delete[] m_queues;
+}
+
+JobSystem::Queue& JobSystem::callerQueue()
+{
+    return t_pool == this ? m_queues[t_queue] : m_queues[m_queueCount - 1];
+}
+
+void JobSystem::push(Queue& queue, Task task)
+{
+    // No workers (single core): nothing would ever take it
+    if (m_workers.empty() && !m_stopping) {
+        execute(task);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        m_queued.fetch_add(1, std::memory_order_release);
+    }
+
+    // Taking the sleep lock orders the push against a worker about to wait
+    { std::lock_guard<std::mutex> lock(m_sleepMutex); }
+    m_workAvailable.notify_one();
+}
+
+bool JobSystem::take(Task& task, Queue& own, bool allowBackground)
+{
+    // Newest first from the own deque: its data is likely still in this core's cache
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Oldest first from the others: the biggest piece of work left (in a split loop)
+    unsigned start = static_cast<unsigned>(&own - m_queues);
+    for (unsigned i = 1; i < m_queueCount; ++i) {
+        Queue& victim = m_queues[(start + i) % m_queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    if (allowBackground) {
+        std::lock_guard<std::mutex> lock(m_backgroundQueue.mutex);
+        if (!m_backgroundQueue.tasks.empty()) {
+            task = std::move(m_backgroundQueue.tasks.front());
+            m_backgroundQueue.tasks.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Task& task)
+{
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    task.job();
+    pool->release();
+    task.job = nullptr; // Captures go before the counter says done
+    finish(task.counter);
+}
+
+void JobSystem::finish(Counter* counter)
+{
+    if (!counter) {
+        return;
+    }
+
+    // The last job of the group releases the jobs held back by it. The lock keeps a wait()
+    // that sees the counter done from returning (and destroying it) before this is through.
+    std::vector<Counter::Held> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            released.swap(counter->m_held);
+        }
+    }
+    for (Counter::Held& held : released) {
+        push(held.background ? m_backgroundQueue : callerQueue(), { std::move(held.job), held.counter });
+    }
+}
+
+void JobSystem::run(Job job, Counter* counter, Counter* dependency, bool background)
+{
+    if (counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (!dependency->isDone()) {
+            dependency->m_held.push_back({ std::move(job), counter, background });
+            return;
+        }
+    }
+    push(background ? m_backgroundQueue : callerQueue(), { std::move(job), counter });
+}
+
+void JobSystem::wait(Counter& counter)
+{
+    Queue& own = callerQueue();
+    while (!counter.isDone()) {
+        Task task;
+        if (take(task, own, false)) {
+            execute(task);
+        } else {
+            std::this_thread::yield(); // The rest is running on other threads
+        }
+    }
+
+    // The finishing thread may still hold the counter's lock
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job, uint32_t grain)
+{
+    grain = std::max(grain, 1u);
+    if (count == 0) {
+        return;
+    }
+    if (count <= grain || m_workers.empty()) {
+        for (uint32_t index = 0; index < count; ++index) {
+            job(index);
+        }
+        return;
+    }
+
+    // Chunks after the first are queued for stealing; the caller starts on the first one
+    Counter counter;
+    for (uint32_t begin = grain; begin < count; begin += grain) {
+        uint32_t end = std::min(begin + grain, count);
+        run([&job, begin, end] {
+            for (uint32_t index = begin; index < end; ++index) {
+                job(index);
+            }
+        }, &counter);
+    }
+    for (uint32_t index = 0; index < grain; ++index) {
+        job(index);
+    }
+    wait(counter);
+}
+
+void JobSystem::workerMain(unsigned index)
+{
+    t_pool = this;
+    t_queue = index;
+    Queue& own = m_queues[index];
+    while (true) {
+        Task task;
+        if (take(task, own, true)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_workAvailable.wait(lock, [this] { return m_stopping || m_queued.load(std::memory_order_acquire) > 0; });
+        if (m_stopping && m_queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
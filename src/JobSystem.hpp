@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for the renderer's CPU work: instance generation, texture decodes, chunk
+// streaming and the scene's sub-encoders. Every worker owns a deque: jobs queued from a worker
+// go to its own deque and run newest first, idle workers steal the oldest job of another deque.
+// Threads outside the pool (render thread, main thread) share one more deque. Background jobs
+// (file decodes, chunk generation) sit in a separate queue that only idle workers take, so a
+// frame waiting on its own jobs never ends up running a slow decode. Counters track a group of
+// jobs and can hold other jobs back until the group is done (dependencies); wait() runs jobs
+// while it waits, so jobs may queue and wait for jobs of their own. Every job drains its own
+// autorelease pool, so jobs may create Metal objects.
+class JobSystem {
+public:
+    typedef std::function<void()> Job;
+
+    // Completion counter of a group of jobs: each run() on it adds one, each finished job takes
+    // one off. Must outlive its jobs (wait() for it before it goes out of scope).
+    class Counter {
+    public:
+        Counter() : m_pending(0) {}
+        bool isDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        struct Held {
+            Job job;
+            Counter* counter;
+            bool background;
+        };
+        std::atomic<uint32_t> m_pending;
+        std::mutex m_mutex;       // Guards m_held, and the last decrement against a returning wait()
+        std::vector<Held> m_held; // Jobs depending on this counter, queued once it is done
+    };
+
+    explicit JobSystem(unsigned workerCount = 0); // 0 = one per core besides the caller
+    ~JobSystem(); // Runs everything still queued, then stops the workers
+
+    // Queue job (on the calling thread's deque, or the background queue). counter (optional)
+    // counts it until it has run; dependency (optional) holds it back until that counter is done.
+    void run(Job job, Counter* counter = nullptr, Counter* dependency = nullptr, bool background = false);
+
+    // Blocks until counter is done, running queued (non-background) jobs meanwhile
+    void wait(Counter& counter);
+
+    // Runs job(0) .. job(count - 1) in chunks of grain indices, in any order and on any thread;
+    // the caller runs chunks too and returns once every index has run, like a plain loop
+    void parallelFor(uint32_t count, const std::function<void(uint32_t index)>& job, uint32_t grain = 1);
+
+    unsigned getWorkerCount() const { return static_cast<unsigned>(m_workers.size()); }
+
+private:
+    struct Task {
+        Job job;
+        Counter* counter;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerMain(unsigned index);
+    Queue& callerQueue();                                    // Deque of the calling thread
+    void push(Queue& queue, Task task);
+    bool take(Task& task, Queue& own, bool allowBackground); // Own deque, then steal, then background
+    void execute(Task& task);
+    void finish(Counter* counter);
+
+    std::vector<std::thread> m_workers;
+    Queue* m_queues;             // One per worker, then the one shared by outside threads
+    unsigned m_queueCount;
+    Queue m_backgroundQueue;
+    std::atomic<uint32_t> m_queued; // Tasks in any queue (wakes the workers)
+    std::mutex m_sleepMutex;
+    std::condition_variable m_workAvailable;
+    std::atomic<bool> m_stopping;
+};
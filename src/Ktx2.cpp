@@ -0,0 +1,267 @@
+#include "Ktx2.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace Ktx2 {
+
+static const uint8_t kIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static constexpr size_t kLevelIndexEntrySize = 24;
+static constexpr size_t kLevelAlignment = 16;   // Multiple of every supported block size and of 4
+
+// Data format descriptor color models and channel IDs (Khronos Data Format Specification)
+static constexpr uint32_t kModelRGBSDA = 1;
+static constexpr uint32_t kModelBC1A = 128;
+static constexpr uint32_t kModelBC3 = 130;
+static constexpr uint32_t kModelASTC = 162;
+
+uint32_t blockBytes(Format format)
+{
+    switch (format) {
+        case FormatRGBA8Unorm:   return 4;
+        case FormatBC1RGBAUnorm: return 8;
+        case FormatBC3Unorm:     return 16;
+        case FormatASTC4x4Unorm: return 16;
+    }
+    return 0;
+}
+
+bool isBlockCompressed(Format format)
+{
+    return format != FormatRGBA8Unorm;
+}
+
+size_t bytesPerRow(Format format, uint32_t width)
+{
+    uint32_t columns = isBlockCompressed(format) ? (width + 3) / 4 : width;
+    return static_cast<size_t>(columns) * blockBytes(format);
+}
+
+size_t levelSize(Format format, uint32_t width, uint32_t height)
+{
+    uint32_t rows = isBlockCompressed(format) ? (height + 3) / 4 : height;
+    return bytesPerRow(format, width) * rows;
+}
+
+static bool isSupported(uint32_t format)
+{
+    return format == FormatRGBA8Unorm || format == FormatBC1RGBAUnorm || format == FormatBC3Unorm || format == FormatASTC4x4Unorm;
+}
+
+template <typename T>
+static T readValue(const uint8_t* data, size_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+static void appendValue(std::vector<uint8_t>& out, T value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+size_t indexSize(const uint8_t* header)
+{
+    if (std::memcmp(header, kIdentifier, sizeof(kIdentifier)) != 0) {
+        return 0;
+    }
+    uint32_t levelCount = std::max(readValue<uint32_t>(header, 40), 1u);
+    if (levelCount > 32) {
+        return 0; // Past a full chain of a 2^32 image: not worth reading the index
+    }
+    return HeaderSize + levelCount * kLevelIndexEntrySize;
+}
+
+bool parseIndex(const uint8_t* index, size_t size, Format& format, std::vector<Level>& levels, std::string& error)
+{
+    if (size < HeaderSize || indexSize(index) == 0) {
+        error = "not a KTX2 file";
+        return false;
+    }
+
+    uint32_t vkFormat = readValue<uint32_t>(index, 12);
+    uint32_t width = readValue<uint32_t>(index, 20);
+    uint32_t height = readValue<uint32_t>(index, 24);
+    uint32_t depth = readValue<uint32_t>(index, 28);
+    uint32_t layerCount = readValue<uint32_t>(index, 32);
+    uint32_t faceCount = readValue<uint32_t>(index, 36);
+    uint32_t levelCount = std::max(readValue<uint32_t>(index, 40), 1u);
+    uint32_t supercompression = readValue<uint32_t>(index, 44);
+    if (!isSupported(vkFormat) || depth > 1 || layerCount > 1 || faceCount != 1 || supercompression != 0 || width == 0 || height == 0) {
+        error = "not an uncompressed-container 2D image in a supported format";
+        return false;
+    }
+    if (size < indexSize(index)) {
+        error = "truncated level index";
+        return false;
+    }
+    // Extra 1x1 levels would pass the size check below, and Metal rejects the mip count
+    uint32_t fullChain = 1;
+    while (fullChain < 32 && (std::max(width, height) >> fullChain) != 0) {
+        ++fullChain;
+    }
+    if (levelCount > fullChain) {
+        error = "more mip levels than a full chain";
+        return false;
+    }
+
+    format = static_cast<Format>(vkFormat);
+    levels.clear();
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        size_t entry = HeaderSize + level * kLevelIndexEntrySize;
+        uint64_t offset = readValue<uint64_t>(index, entry);
+        uint64_t length = readValue<uint64_t>(index, entry + 8);
+        uint32_t levelWidth = std::max(width >> level, 1u);
+        uint32_t levelHeight = std::max(height >> level, 1u);
+        if (length != levelSize(format, levelWidth, levelHeight)) {
+            error = "invalid mip level size";
+            return false;
+        }
+        levels.push_back({ levelWidth, levelHeight, static_cast<size_t>(offset), static_cast<size_t>(length) });
+    }
+    return true;
+}
+
+bool read(const std::string& path, Image& image, std::string& error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::vector<Level> levels;
+    if (!parseIndex(file.data(), file.size(), image.format, levels, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+
+    // Levels are packed into Image::data in level order
+    image.levels.clear();
+    image.data.clear();
+    for (const Level& level : levels) {
+        if (level.offset > file.size() || level.size > file.size() - level.offset) {
+            error = path + " is truncated";
+            return false;
+        }
+        image.levels.push_back({ level.width, level.height, image.data.size(), level.size });
+        image.data.insert(image.data.end(), file.begin() + level.offset, file.begin() + level.offset + level.size);
+    }
+    return true;
+}
+
+// Basic data format descriptor for the format (one descriptor block)
+static std::vector<uint8_t> dataFormatDescriptor(Format format)
+{
+    struct Sample {
+        uint32_t bitOffset;
+        uint32_t bitLength;
+        uint32_t channel;
+        uint32_t upper;
+    };
+    std::vector<Sample> samples;
+    uint32_t model = kModelRGBSDA;
+    uint32_t blockDimension = 0; // Texel block width - 1 / height - 1 in the low two bytes
+    switch (format) {
+        case FormatRGBA8Unorm:
+            samples = { { 0, 8, 0, 255 }, { 8, 8, 1, 255 }, { 16, 8, 2, 255 }, { 24, 8, 15, 255 } };
+            break;
+        case FormatBC1RGBAUnorm:
+            model = kModelBC1A;
+            blockDimension = 0x0303;
+            samples = { { 0, 64, 1, UINT32_MAX } }; // Alpha-present channel
+            break;
+        case FormatBC3Unorm:
+            model = kModelBC3;
+            blockDimension = 0x0303;
+            samples = { { 0, 64, 15, UINT32_MAX }, { 64, 64, 0, UINT32_MAX } };
+            break;
+        case FormatASTC4x4Unorm:
+            model = kModelASTC;
+            blockDimension = 0x0303;
+            samples = { { 0, 128, 0, UINT32_MAX } };
+            break;
+    }
+
+    uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<uint8_t> dfd;
+    appendValue<uint32_t>(dfd, 4 + blockSize);             // dfdTotalSize
+    appendValue<uint32_t>(dfd, 0);                         // Khronos vendor, basic descriptor type
+    appendValue<uint32_t>(dfd, 2 | (blockSize << 16));     // Version 2, block size
+    appendValue<uint32_t>(dfd, model | (1 << 8) | (1 << 16)); // BT.709 primaries, linear transfer, straight alpha
+    appendValue<uint32_t>(dfd, blockDimension);
+    appendValue<uint32_t>(dfd, blockBytes(format));        // bytesPlane0 (planes 1-7 unused)
+    appendValue<uint32_t>(dfd, 0);
+    for (const Sample& sample : samples) {
+        appendValue<uint32_t>(dfd, sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+        appendValue<uint32_t>(dfd, 0);                     // Sample position
+        appendValue<uint32_t>(dfd, 0);                     // Lower
+        appendValue<uint32_t>(dfd, sample.upper);
+    }
+    return dfd;
+}
+
+std::vector<uint8_t> serialize(const Image& image)
+{
+    uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+    std::vector<uint8_t> dfd = dataFormatDescriptor(image.format);
+    size_t dfdOffset = HeaderSize + levelCount * kLevelIndexEntrySize;
+
+    // Level data after the descriptor, smallest level first (the mip tail streams in first)
+    std::vector<uint64_t> levelOffsets(levelCount);
+    size_t cursor = dfdOffset + dfd.size();
+    for (uint32_t level = levelCount; level-- > 0;) {
+        cursor = (cursor + kLevelAlignment - 1) / kLevelAlignment * kLevelAlignment;
+        levelOffsets[level] = cursor;
+        cursor += image.levels[level].size;
+    }
+
+    std::vector<uint8_t> out(kIdentifier, kIdentifier + sizeof(kIdentifier));
+    appendValue<uint32_t>(out, image.format);
+    appendValue<uint32_t>(out, 1);                         // typeSize (bytes, block-compressed and 8-bit formats)
+    appendValue<uint32_t>(out, image.levels[0].width);
+    appendValue<uint32_t>(out, image.levels[0].height);
+    appendValue<uint32_t>(out, 0);                         // pixelDepth (2D)
+    appendValue<uint32_t>(out, 0);                         // layerCount (not an array)
+    appendValue<uint32_t>(out, 1);                         // faceCount
+    appendValue<uint32_t>(out, levelCount);
+    appendValue<uint32_t>(out, 0);                         // No supercompression
+    appendValue<uint32_t>(out, static_cast<uint32_t>(dfdOffset));
+    appendValue<uint32_t>(out, static_cast<uint32_t>(dfd.size()));
+    appendValue<uint32_t>(out, 0);                         // No key / value data
+    appendValue<uint32_t>(out, 0);
+    appendValue<uint64_t>(out, 0);                         // No supercompression global data
+    appendValue<uint64_t>(out, 0);
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        appendValue<uint64_t>(out, levelOffsets[level]);
+        appendValue<uint64_t>(out, image.levels[level].size);
+        appendValue<uint64_t>(out, image.levels[level].size);
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    for (uint32_t level = levelCount; level-- > 0;) {
+        out.resize(levelOffsets[level], 0);
+        const uint8_t* levelData = image.data.data() + image.levels[level].offset;
+        out.insert(out.end(), levelData, levelData + image.levels[level].size);
+    }
+    return out;
+}
+
+bool write(const std::string& path, const Image& image, std::string& error)
+{
+    if (image.levels.empty()) {
+        error = "no mip levels to write";
+        return false;
+    }
+    std::vector<uint8_t> out = serialize(image);
+    std::ofstream file(path, std::ios::binary);
+    if (!file || !file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()))) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace Ktx2
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal KTX2 container (Khronos KTX 2.0): one 2D image with a pre-baked mip chain, no
+// supercompression, no key / value data. Written by vegetation_texconv, read by TextureLoader.
+// Only the formats below are recognized; Metal support is checked by the loader.
+namespace Ktx2 {
+
+// VkFormat values stored in the header
+enum Format : uint32_t {
+    FormatRGBA8Unorm = 37,   // VK_FORMAT_R8G8B8A8_UNORM
+    FormatBC1RGBAUnorm = 133, // VK_FORMAT_BC1_RGBA_UNORM_BLOCK (opaque or 1-bit alpha)
+    FormatBC3Unorm = 137,    // VK_FORMAT_BC3_UNORM_BLOCK (interpolated alpha)
+    FormatASTC4x4Unorm = 157 // VK_FORMAT_ASTC_4x4_UNORM_BLOCK (e.g. from astcenc / toktx)
+};
+
+struct Level {
+    uint32_t width;
+    uint32_t height;
+    size_t offset;  // Into Image::data
+    size_t size;
+};
+
+struct Image {
+    Format format;
+    std::vector<Level> levels; // Level 0 = full resolution
+    std::vector<uint8_t> data;
+};
+
+uint32_t blockBytes(Format format);  // Bytes per 4x4 block (per texel for RGBA8)
+bool isBlockCompressed(Format format);
+size_t levelSize(Format format, uint32_t width, uint32_t height);
+size_t bytesPerRow(Format format, uint32_t width); // One row of blocks (or texels)
+
+// Bytes before the level index (identifier, header and section index)
+static constexpr size_t HeaderSize = 80;
+
+// Bytes of the header plus level index given the first HeaderSize bytes (0 if not KTX2, or if it
+// claims more levels than any 2D image has)
+size_t indexSize(const uint8_t* header);
+// Format and levels from the first indexSize() bytes; Level::offset is the file offset of the
+// level (for streaming straight from the file). False with the reason in error if unsupported.
+bool parseIndex(const uint8_t* index, size_t size, Format& format, std::vector<Level>& levels, std::string& error);
+
+// False (with the reason in error) when the file is missing, truncated or not a supported 2D image
+bool read(const std::string& path, Image& image, std::string& error);
+bool write(const std::string& path, const Image& image, std::string& error);
+std::vector<uint8_t> serialize(const Image& image); // Whole file contents written by write()
+
+} // namespace Ktx2
@@ -0,0 +1,48 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// One thread per froxel of the bound view: list the point lights whose sphere overlaps the
+// froxel's view-space box. Grass and ground fragments then only light from their own cluster
+// (clusteredPointLighting), so their cost follows the lights nearby, not the total count.
+kernel void buildLightClusters(
+    constant Uniforms &uniforms [[buffer(LightClusterBufferIndexUniforms)]],
+    const device PointLight *lights [[buffer(LightClusterBufferIndexLights)]],
+    device LightCluster *clusters [[buffer(LightClusterBufferIndexClusters)]],
+    uint3 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= LIGHT_CLUSTER_TILES_X || gid.y >= LIGHT_CLUSTER_TILES_Y || gid.z >= LIGHT_CLUSTER_SLICES) {
+        return;
+    }
+
+    // Tile edges in NDC, then per unit of view depth: x = depth * (ndc.x + P[2][0]) / P[0][0]
+    // (the jitter of the temporal pipelines sits in P[2][0] / P[2][1])
+    float4x4 projection = uniforms.projectionMatrix;
+    float2 scale = float2(projection[0][0], projection[1][1]);
+    float2 offset = float2(projection[2][0], projection[2][1]);
+    float2 tiles = float2(LIGHT_CLUSTER_TILES_X, LIGHT_CLUSTER_TILES_Y);
+    float2 slopeMin = (float2(gid.xy) / tiles * 2.0 - 1.0 + offset) / scale;
+    float2 slopeMax = (float2(gid.xy + 1) / tiles * 2.0 - 1.0 + offset) / scale;
+
+    // View-space box of the froxel (the camera looks down -z)
+    float nearDepth = gid.z == 0 ? 0.0 : lightClusterSliceDepth(gid.z, uniforms);
+    float farDepth = lightClusterSliceDepth(gid.z + 1, uniforms);
+    float3 boxMin = float3(min(slopeMin * nearDepth, slopeMin * farDepth), -farDepth);
+    float3 boxMax = float3(max(slopeMax * nearDepth, slopeMax * farDepth), -nearDepth);
+
+    LightCluster cluster;
+    cluster.count = 0;
+    uint lightCount = min(uniforms.pointLightCount, uint(MAX_POINT_LIGHTS));
+    for (uint i = 0; i < lightCount && cluster.count < LIGHT_CLUSTER_CAPACITY; ++i) {
+        PointLight light = lights[i];
+        float3 center = (uniforms.viewMatrix * float4(light.position, 1.0)).xyz;
+
+        // Sphere vs. box: distance from the center to the closest point of the box
+        float3 closest = clamp(center, boxMin, boxMax);
+        if (distance_squared(closest, center) <= light.radius * light.radius) {
+            cluster.indices[cluster.count++] = i;
+        }
+    }
+    clusters[(gid.z * LIGHT_CLUSTER_TILES_Y + gid.y) * LIGHT_CLUSTER_TILES_X + gid.x] = cluster;
+}
@@ -1,3 +1,16 @@
 #pragma once
 
-void* GetMetalLayerFromGLFW(void* glfwWindow);
\ No newline at end of file
+void* GetMetalLayerFromGLFW(void* glfwWindow);
+
+// Swapchain depth (2 or 3 drawables) and vsync of a CAMetalLayer (metal-cpp does not expose them)
+void ConfigureMetalLayer(void* metalLayer, int maximumDrawableCount, bool displaySyncEnabled);
+
+// CAMetalDisplayLink (macOS 14+): the system calls back on the thread that created the link, once
+// per display refresh, with the drawable to render and the times it is due on screen (host
+// seconds). CreateMetalDisplayLink returns nullptr where the link is unavailable; callers fall
+// back to nextDrawable(). RunMetalDisplayLink runs the thread's run loop for up to timeout seconds.
+typedef void (*MetalDisplayLinkCallback)(void* drawable, double targetTimestamp,
+                                         double targetPresentationTimestamp, void* userData);
+void* CreateMetalDisplayLink(void* metalLayer, MetalDisplayLinkCallback callback, void* userData);
+void RunMetalDisplayLink(void* displayLink, double timeout);
+void DestroyMetalDisplayLink(void* displayLink);
@@ -5,6 +5,7 @@
 #include <QuartzCore/QuartzCore.h>
 #include <Cocoa/Cocoa.h>
 #include <Metal/Metal.h>
+#include <objc/runtime.h>
 
 #include "MetalLayerBridge.h"
 
@@ -41,3 +42,55 @@ void* GetMetalLayerFromGLFW(void* glfwWindow) {
     return (void*)layer;
 }
 
+void ConfigureMetalLayer(void* metalLayer, int maximumDrawableCount, bool displaySyncEnabled) {
+    CAMetalLayer* layer = (CAMetalLayer*)metalLayer;
+    [layer setMaximumDrawableCount:(maximumDrawableCount <= 2 ? 2 : 3)];
+    [layer setDisplaySyncEnabled:displaySyncEnabled];
+}
+
+API_AVAILABLE(macos(14.0))
+@interface VegetationDisplayLinkTarget : NSObject <CAMetalDisplayLinkDelegate>
+@property (nonatomic, assign) MetalDisplayLinkCallback callback;
+@property (nonatomic, assign) void* userData;
+@end
+
+@implementation VegetationDisplayLinkTarget
+- (void)metalDisplayLink:(CAMetalDisplayLink*)link needsUpdate:(CAMetalDisplayLinkUpdate*)update {
+    self.callback((void*)update.drawable, update.targetTimestamp,
+                  update.targetPresentationTimestamp, self.userData);
+}
+@end
+
+void* CreateMetalDisplayLink(void* metalLayer, MetalDisplayLinkCallback callback, void* userData) {
+    if (@available(macOS 14.0, *)) {
+        VegetationDisplayLinkTarget* target = [[VegetationDisplayLinkTarget alloc] init];
+        target.callback = callback;
+        target.userData = userData;
+        
+        CAMetalDisplayLink* link = [[CAMetalDisplayLink alloc] initWithMetalLayer:(CAMetalLayer*)metalLayer];
+        link.delegate = target; // Weak: the link owns the target through the association instead
+        objc_setAssociatedObject(link, @selector(metalDisplayLink:needsUpdate:), target, OBJC_ASSOCIATION_RETAIN);
+        [target release];
+        [link addToRunLoop:[NSRunLoop currentRunLoop] forMode:NSDefaultRunLoopMode];
+        return (void*)link; // Owned by the caller until DestroyMetalDisplayLink
+    }
+    return nullptr;
+}
+
+void RunMetalDisplayLink(void* displayLink, double timeout) {
+    if (!displayLink) {
+        return;
+    }
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:[NSDate dateWithTimeIntervalSinceNow:timeout]];
+}
+
+void DestroyMetalDisplayLink(void* displayLink) {
+    if (@available(macOS 14.0, *)) {
+        if (displayLink) {
+            CAMetalDisplayLink* link = (CAMetalDisplayLink*)displayLink;
+            [link invalidate];
+            [link release];
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#include "NoiseTexture.hpp"
+#include <iostream>
+#include <vector>
+
+// PCG hash (matches pcgHash() in GrassGenerate.metal)
+static uint32_t pcgHash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+NoiseTexture::NoiseTexture(MTL::Device* device, uint32_t size, uint32_t seed)
+    : m_texture(nullptr)
+{
+    std::vector<uint8_t> values(static_cast<size_t>(size) * size);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<uint8_t>(pcgHash(static_cast<uint32_t>(i) ^ pcgHash(seed)) >> 24);
+    }
+
+    // No mipmaps: the lattice is sampled at level 0 (averaging it would flatten the noise)
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(MTL::PixelFormatR8Unorm);
+    descriptor->setWidth(size);
+    descriptor->setHeight(size);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+
+    m_texture = device->newTexture(descriptor);
+    descriptor->release();
+
+    if (!m_texture) {
+        std::cerr << "Failed to create noise texture" << std::endl;
+        return;
+    }
+    m_texture->replaceRegion(MTL::Region::Make2D(0, 0, size, size), 0, values.data(), size);
+}
+
+NoiseTexture::~NoiseTexture()
+{
+    if (m_texture) {
+        m_texture->release();
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <cstdint>
+
+// Tileable value-noise lattice shared by the shaders (see valueNoise() in ShaderTypes.h).
+// One independent random value per texel (R8Unorm); the shaders interpolate between texel
+// centers, so noise lookups are a single cached fetch instead of four sin hashes, and the
+// lattice wraps instead of losing precision at large world coordinates.
+class NoiseTexture {
+public:
+    NoiseTexture(MTL::Device* device, uint32_t size, uint32_t seed);
+    ~NoiseTexture();
+
+    MTL::Texture* getMetalTexture() const { return m_texture; }
+
+private:
+    MTL::Texture* m_texture;
+};
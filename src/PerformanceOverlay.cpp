@@ -0,0 +1,163 @@
+#include "PerformanceOverlay.hpp"
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_metal.h>
+#include <algorithm>
+
+PerformanceOverlay::PerformanceOverlay(GLFWwindow* window, MTL::Device* device, bool packetInput)
+    : m_window(window)
+    , m_historyOffset(0)
+    , m_interactive(false)
+    , m_cursorInteractive(false)
+    , m_packetInput(packetInput)
+    , m_input()
+    , m_inputDeltaTime(0.0f)
+{
+    std::fill(m_cpuHistory, m_cpuHistory + kHistorySize, 0.0f);
+    std::fill(m_gpuHistory, m_gpuHistory + kHistorySize, 0.0f);
+    
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui::StyleColorsDark();
+    ImGui::GetIO().IniFilename = nullptr; // Don't write imgui.ini next to the binary
+    
+    // Packet mode: no callbacks, they would feed ImGui from the window thread mid-frame
+    ImGui_ImplGlfw_InitForOther(window, !packetInput);
+    ImGui_ImplMetal_Init(device);
+}
+
+PerformanceOverlay::~PerformanceOverlay()
+{
+    ImGui_ImplMetal_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+}
+
+void PerformanceOverlay::applyCursorMode()
+{
+    bool interactive = m_interactive;
+    if (interactive != m_cursorInteractive) {
+        glfwSetInputMode(m_window, GLFW_CURSOR, interactive ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+        m_cursorInteractive = interactive;
+    }
+}
+
+void PerformanceOverlay::setInput(const FramePacket& input, float deltaTime)
+{
+    m_input = input;
+    m_inputDeltaTime = deltaTime;
+}
+
+bool PerformanceOverlay::render(const OverlayStats& stats, OverlaySettings& settings,
+                                MTL::RenderPassDescriptor* renderPassDescriptor,
+                                MTL::CommandBuffer* commandBuffer,
+                                MTL::RenderCommandEncoder* renderEncoder)
+{
+    m_cpuHistory[m_historyOffset] = stats.cpuFrameMs;
+    m_gpuHistory[m_historyOffset] = static_cast<float>(stats.gpu.frameMs);
+    m_historyOffset = (m_historyOffset + 1) % kHistorySize;
+    
+    ImGui_ImplMetal_NewFrame(renderPassDescriptor);
+    if (m_packetInput) {
+        // What ImGui_ImplGlfw_NewFrame() would query, from the window thread's packet
+        ImGuiIO& io = ImGui::GetIO();
+        io.DisplaySize = ImVec2(static_cast<float>(m_input.windowWidth), static_cast<float>(m_input.windowHeight));
+        if (m_input.windowWidth > 0 && m_input.windowHeight > 0) {
+            io.DisplayFramebufferScale = ImVec2(static_cast<float>(m_input.framebufferWidth) / m_input.windowWidth,
+                                                static_cast<float>(m_input.framebufferHeight) / m_input.windowHeight);
+        }
+        io.DeltaTime = m_inputDeltaTime > 0.0f ? m_inputDeltaTime : 1.0f / 60.0f;
+        io.AddFocusEvent(m_input.focused);
+        if (m_interactive && m_input.focused) {
+            io.AddMousePosEvent(static_cast<float>(m_input.cursorX), static_cast<float>(m_input.cursorY));
+        }
+        for (int button = 0; button < FramePacket::kMouseButtonCount; ++button) {
+            io.AddMouseButtonEvent(button, m_input.mouseButtons[button]);
+        }
+    } else {
+        ImGui_ImplGlfw_NewFrame();
+    }
+    ImGui::NewFrame();
+    
+    bool changed = false;
+    
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGui::Begin("Performance (F1: interact)");
+    
+    // Frame time graphs
+    ImGui::Text("CPU %.2f ms  |  GPU %.2f ms", stats.cpuFrameMs, stats.gpu.frameMs);
+    ImGui::PlotLines("CPU ms", m_cpuHistory, kHistorySize, m_historyOffset, nullptr, 0.0f, 33.3f, ImVec2(0.0f, 40.0f));
+    ImGui::PlotLines("GPU ms", m_gpuHistory, kHistorySize, m_historyOffset, nullptr, 0.0f, 33.3f, ImVec2(0.0f, 40.0f));
+    
+    // Per-pass GPU breakdown (trample row is the trample update cost)
+    if (ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen)) {
+        if (stats.gpu.perPass) {
+            for (int pass = 0; pass < GpuPassCount; ++pass) {
+                if (stats.gpu.passMs[pass] > 0.0) {
+                    ImGui::Text("%-8s %7.3f ms", GpuProfiler::passName(static_cast<GpuPass>(pass)), stats.gpu.passMs[pass]);
+                }
+            }
+        } else {
+            ImGui::TextDisabled("Timestamp counters unavailable");
+        }
+    }
+    
+    // Culling statistics
+    if (ImGui::CollapsingHeader("Grass", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("Blades: %u", stats.totalBlades);
+        if (stats.visibleBladesValid) {
+            uint32_t visible = 0;
+            for (int lod = 0; lod < GRASS_LOD_COUNT; ++lod) {
+                ImGui::Text("  LOD %d: %u", lod, stats.visibleBlades[lod]);
+                visible += stats.visibleBlades[lod];
+            }
+            uint32_t culled = (visible < stats.totalBlades) ? stats.totalBlades - visible : 0;
+            ImGui::Text("Visible: %u  Culled: %u", visible, culled);
+        } else {
+            ImGui::TextDisabled("Visible counts unavailable on this path");
+        }
+    }
+    
+    // Tracked categories against the device total, its budget and the system-wide limit
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    if (ImGui::CollapsingHeader("GPU memory")) {
+        for (int category = 0; category < GpuMemoryBudget::CategoryCount; ++category) {
+            ImGui::Text("%-14s %8.1f MB", GpuMemoryBudget::categoryName(static_cast<GpuMemoryBudget::Category>(category)),
+                        static_cast<double>(stats.gpuMemoryCategoryBytes[category]) * mb);
+        }
+        ImGui::Text("Budget %.0f MB of %.0f MB working set", static_cast<double>(stats.gpuMemoryBudgetBytes) * mb,
+                    static_cast<double>(stats.gpuWorkingSetBytes) * mb);
+    }
+    ImGui::Text("GPU memory: %.1f MB%s", static_cast<double>(stats.gpuMemoryBytes) * mb,
+                stats.gpuMemoryPressure ? " (over budget)" : "");
+    
+    // Live tuning
+    if (ImGui::CollapsingHeader("Settings", ImGuiTreeNodeFlags_DefaultOpen)) {
+        changed |= ImGui::SliderInt("Blades / cell", &settings.bladesPerCell, 1, settings.maxBladesPerCell);
+        changed |= ImGui::SliderFloat("LOD 0->1 (m)", &settings.lodDistances[0], 1.0f, settings.lodDistances[1]);
+        changed |= ImGui::SliderFloat("LOD 1->2 (m)", &settings.lodDistances[1], settings.lodDistances[0], 60.0f);
+        changed |= ImGui::SliderFloat("LOD fade (m)", &settings.lodFadeWidth, 0.0f, 5.0f);
+        changed |= ImGui::SliderFloat("Density LOD (m)", &settings.densityLodDistance, 0.0f, 40.0f);
+        changed |= ImGui::Checkbox("Hi-Z occlusion", &settings.hiZCulling);
+        if (settings.dynamicResolutionSupported) {
+            changed |= ImGui::Checkbox("Dynamic resolution (U)", &settings.dynamicResolution);
+            changed |= ImGui::SliderFloat("GPU budget (ms)", &settings.targetFrameMs, 4.0f, 33.3f);
+            ImGui::Text("Render scale: %.0f%%", stats.renderScale * 100.0f);
+        }
+        if (settings.temporalUpscalingSupported) {
+            changed |= ImGui::Checkbox("Temporal upscaling (M)", &settings.temporalUpscaling);
+        }
+        if (settings.temporalAntialiasingSupported) {
+            changed |= ImGui::Checkbox("Temporal antialiasing (F)", &settings.temporalAntialiasing);
+        }
+    }
+    
+    ImGui::End();
+    
+    ImGui::Render();
+    ImGui_ImplMetal_RenderDrawData(ImGui::GetDrawData(), commandBuffer, renderEncoder);
+    
+    return changed;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "GpuProfiler.hpp"
+#include "ShaderTypes.h"
+#include "FramePacket.hpp"
+#include "GpuMemoryBudget.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct GLFWwindow;
+
+// Read-only numbers shown by the overlay
+struct OverlayStats {
+    float cpuFrameMs;                         // CPU frame time (update + draw)
+    GpuTimings gpu;                           // Per-pass GPU times
+    uint32_t totalBlades;                     // Blades in the instance buffer
+    uint32_t visibleBlades[GRASS_LOD_COUNT];  // Per-LOD visible entries (crossfading blades count twice)
+    bool visibleBladesValid;                  // False when culling runs outside the compute pass
+    size_t gpuMemoryBytes;                    // MTL::Device::currentAllocatedSize()
+    size_t gpuMemoryCategoryBytes[GpuMemoryBudget::CategoryCount]; // Latest GpuMemoryBudget sample
+    size_t gpuMemoryBudgetBytes;
+    size_t gpuWorkingSetBytes;                // MTL::Device::recommendedMaxWorkingSetSize()
+    bool gpuMemoryPressure;                   // Caches shrunk to get back under the budget
+    float renderScale;                        // Dynamic resolution scale (1 = native)
+};
+
+// Values the overlay can edit live
+struct OverlaySettings {
+    int bladesPerCell;
+    int maxBladesPerCell;
+    float lodDistances[GRASS_LOD_COUNT - 1];
+    float lodFadeWidth;
+    float densityLodDistance;                 // Distance where cells start drawing fewer, wider blades (0 = off)
+    bool hiZCulling;
+    bool dynamicResolutionSupported;          // MetalFX spatial scaler available
+    bool dynamicResolution;
+    float targetFrameMs;                      // GPU frame time budget for dynamic resolution
+    bool temporalUpscalingSupported;          // MetalFX temporal scaler available
+    bool temporalUpscaling;                   // 1x + motion vectors + temporal scaler instead of 4x MSAA
+    bool temporalAntialiasingSupported;       // TAA resolve kernel and history targets exist
+    bool temporalAntialiasing;                // 1x + motion vectors + in-house TAA resolve instead of MSAA
+};
+
+// ImGui performance overlay (GLFW + Metal backends)
+class PerformanceOverlay {
+public:
+    // packetInput: mouse and display size come from setInput() (the overlay renders on a thread
+    // other than the window's) instead of GLFW callbacks and queries
+    PerformanceOverlay(GLFWwindow* window, MTL::Device* device, bool packetInput = false);
+    ~PerformanceOverlay();
+
+    // Build the UI and encode it into the current render pass. Returns true if settings changed.
+    bool render(const OverlayStats& stats, OverlaySettings& settings,
+                MTL::RenderPassDescriptor* renderPassDescriptor,
+                MTL::CommandBuffer* commandBuffer,
+                MTL::RenderCommandEncoder* renderEncoder);
+
+    // Interactive mode shows the cursor and routes the mouse to the UI; the cursor itself changes
+    // in applyCursorMode(), on the window thread
+    bool isInteractive() const { return m_interactive; }
+    void setInteractive(bool interactive) { m_interactive = interactive; }
+    void applyCursorMode();
+
+    // This frame's input in packet mode (ignored otherwise)
+    void setInput(const FramePacket& input, float deltaTime);
+
+private:
+    static constexpr int kHistorySize = 120;
+
+    GLFWwindow* m_window;
+    float m_cpuHistory[kHistorySize];   // CPU frame time ring (ms)
+    float m_gpuHistory[kHistorySize];   // GPU frame time ring (ms)
+    int m_historyOffset;
+    std::atomic<bool> m_interactive;
+    bool m_cursorInteractive;           // Cursor mode last applied (window thread)
+    bool m_packetInput;
+    FramePacket m_input;
+    float m_inputDeltaTime;
+};
@@ -0,0 +1,284 @@
+#include "PipelineArchive.hpp"
+#include <fstream>
+#include <iostream>
+
+PipelineArchive::PipelineArchive(MTL::Device* device, const std::string& path, const std::string& shippedPath)
+    : m_device(device)
+    , m_archive(nullptr)
+    , m_shippedArchive(nullptr)
+    , m_lookupArchives(nullptr)
+    , m_path(path)
+    , m_loaded(false)
+    , m_dirty(false)
+{
+    bool exists = std::ifstream(path).good();
+
+    MTL::BinaryArchiveDescriptor* descriptor = MTL::BinaryArchiveDescriptor::alloc()->init();
+    NS::Error* error = nullptr;
+
+    // Precompiled at build time on a GPU of another family (or another OS build) every lookup
+    // misses; the pipelines then compile at runtime into the local archive as before
+    if (!shippedPath.empty() && std::ifstream(shippedPath).good()) {
+        descriptor->setUrl(NS::URL::fileURLWithPath(NS::String::string(shippedPath.c_str(), NS::UTF8StringEncoding)));
+        m_shippedArchive = m_device->newBinaryArchive(descriptor, &error);
+        if (m_shippedArchive) {
+            std::cout << "Precompiled pipelines: " << shippedPath << std::endl;
+        } else {
+            logError("Ignoring precompiled pipelines", shippedPath, error);
+        }
+        descriptor->setUrl(nullptr);
+        error = nullptr;
+    }
+
+    if (exists) {
+        descriptor->setUrl(NS::URL::fileURLWithPath(NS::String::string(path.c_str(), NS::UTF8StringEncoding)));
+        m_archive = m_device->newBinaryArchive(descriptor, &error);
+        if (m_archive) {
+            m_loaded = true;
+        } else {
+            // Stale or from another OS/driver version: start over
+            logError("Discarding pipeline cache", path, error);
+            descriptor->setUrl(nullptr);
+        }
+    }
+
+    if (!m_archive) {
+        error = nullptr;
+        m_archive = m_device->newBinaryArchive(descriptor, &error);
+        if (!m_archive) {
+            logError("Failed to create pipeline cache", path, error);
+        }
+    }
+
+    descriptor->release();
+    std::cout << "Pipeline cache: " << (m_loaded ? "loaded " : "cold start, will write ") << path << std::endl;
+
+    // Lookups search the shipped archive first; only the local one records new pipelines
+    const NS::Object* archives[2];
+    NS::UInteger archiveCount = 0;
+    for (MTL::BinaryArchive* archive : { m_shippedArchive, m_archive }) {
+        if (archive) {
+            archives[archiveCount++] = archive;
+        }
+    }
+    if (archiveCount > 0) {
+        m_lookupArchives = NS::Array::array(archives, archiveCount);
+        m_lookupArchives->retain();
+    }
+    m_loaded = m_loaded || m_shippedArchive != nullptr;
+}
+
+PipelineArchive::~PipelineArchive()
+{
+    if (m_archive) {
+        m_archive->release();
+    }
+    if (m_shippedArchive) {
+        m_shippedArchive->release();
+    }
+    if (m_lookupArchives) {
+        m_lookupArchives->release();
+    }
+}
+
+void PipelineArchive::logError(const char* what, const std::string& label, NS::Error* error)
+{
+    if (error) {
+        std::cerr << what << " (" << label << "): " << error->localizedDescription()->utf8String() << std::endl;
+    } else {
+        std::cerr << what << " (" << label << ")" << std::endl;
+    }
+}
+
+void PipelineArchive::newRenderPipelineAsync(MTL::RenderPipelineDescriptor* descriptor, const char* label, RenderPipelineCallback callback)
+{
+    // Keep the descriptor alive for a possible recompile after an archive miss
+    descriptor->retain();
+    std::string name = label;
+
+    attachArchives(descriptor);
+
+    if (!m_loaded) {
+        compileRenderPipeline(descriptor, name, callback);
+        return;
+    }
+
+    m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss,
+        [this, descriptor, name, callback](MTL::RenderPipelineState* pso, MTL::RenderPipelineReflection*, NS::Error*) {
+            if (pso) {
+                pso->retain();
+                descriptor->release();
+                callback(pso);
+                return;
+            }
+            // Not in the archive (new permutation or changed shaders)
+            compileRenderPipeline(descriptor, name, callback);
+        });
+}
+
+void PipelineArchive::compileRenderPipeline(MTL::RenderPipelineDescriptor* descriptor, const std::string& label, RenderPipelineCallback callback)
+{
+    m_device->newRenderPipelineState(descriptor,
+        [this, descriptor, label, callback](MTL::RenderPipelineState* pso, NS::Error* error) {
+            if (pso) {
+                pso->retain();
+                std::lock_guard<std::mutex> lock(m_mutex);
+                NS::Error* archiveError = nullptr;
+                if (m_archive && m_archive->addRenderPipelineFunctions(descriptor, &archiveError)) {
+                    m_dirty = true;
+                } else if (m_archive) {
+                    logError("Failed to add pipeline to cache", label, archiveError);
+                }
+            } else {
+                logError("Failed to create render pipeline state", label, error);
+            }
+            descriptor->release();
+            callback(pso);
+        });
+}
+
+MTL::ComputePipelineState* PipelineArchive::newComputePipeline(MTL::Function* function, const char* label)
+{
+    MTL::ComputePipelineDescriptor* descriptor = MTL::ComputePipelineDescriptor::alloc()->init();
+    descriptor->setComputeFunction(function);
+    attachArchives(descriptor);
+
+    NS::Error* error = nullptr;
+    MTL::ComputePipelineState* pso = nullptr;
+    if (m_loaded) {
+        pso = m_device->newComputePipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss, nullptr, &error);
+    }
+
+    if (!pso) {
+        error = nullptr;
+        pso = m_device->newComputePipelineState(descriptor, MTL::PipelineOptionNone, nullptr, &error);
+        if (pso && m_archive) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            NS::Error* archiveError = nullptr;
+            if (m_archive->addComputePipelineFunctions(descriptor, &archiveError)) {
+                m_dirty = true;
+            } else {
+                logError("Failed to add pipeline to cache", label, archiveError);
+            }
+        } else if (!pso) {
+            logError("Failed to create compute pipeline", label, error);
+        }
+    }
+
+    descriptor->release();
+    return pso;
+}
+
+MTL::RenderPipelineState* PipelineArchive::newRenderPipeline(MTL::RenderPipelineDescriptor* descriptor, const char* label)
+{
+    attachArchives(descriptor);
+
+    NS::Error* error = nullptr;
+    MTL::RenderPipelineState* pso = nullptr;
+    if (m_loaded) {
+        pso = m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss, nullptr, &error);
+    }
+
+    if (!pso) {
+        error = nullptr;
+        pso = m_device->newRenderPipelineState(descriptor, &error);
+        if (pso && m_archive) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            NS::Error* archiveError = nullptr;
+            if (m_archive->addRenderPipelineFunctions(descriptor, &archiveError)) {
+                m_dirty = true;
+            } else {
+                logError("Failed to add pipeline to cache", label, archiveError);
+            }
+        } else if (!pso) {
+            logError("Failed to create render pipeline state", label, error);
+        }
+    }
+
+    return pso;
+}
+
+MTL::RenderPipelineState* PipelineArchive::newMeshPipeline(MTL::MeshRenderPipelineDescriptor* descriptor, const char* label)
+{
+    attachArchives(descriptor);
+
+    NS::Error* error = nullptr;
+    MTL::RenderPipelineState* pso = nullptr;
+    if (m_loaded) {
+        pso = m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss, nullptr, &error);
+    }
+
+    if (!pso) {
+        error = nullptr;
+        pso = m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionNone, nullptr, &error);
+        if (pso && m_archive) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            NS::Error* archiveError = nullptr;
+            if (m_archive->addMeshRenderPipelineFunctions(descriptor, &archiveError)) {
+                m_dirty = true;
+            } else {
+                logError("Failed to add pipeline to cache", label, archiveError);
+            }
+        } else if (!pso) {
+            logError("Failed to create mesh render pipeline state", label, error);
+        }
+    }
+
+    return pso;
+}
+
+MTL::RenderPipelineState* PipelineArchive::newTilePipeline(MTL::TileRenderPipelineDescriptor* descriptor, const char* label)
+{
+    attachArchives(descriptor);
+
+    NS::Error* error = nullptr;
+    MTL::RenderPipelineState* pso = nullptr;
+    if (m_loaded) {
+        pso = m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionFailOnBinaryArchiveMiss, nullptr, &error);
+    }
+
+    if (!pso) {
+        error = nullptr;
+        pso = m_device->newRenderPipelineState(descriptor, MTL::PipelineOptionNone, nullptr, &error);
+        if (pso && m_archive) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            NS::Error* archiveError = nullptr;
+            if (m_archive->addTileRenderPipelineFunctions(descriptor, &archiveError)) {
+                m_dirty = true;
+            } else {
+                logError("Failed to add pipeline to cache", label, archiveError);
+            }
+        } else if (!pso) {
+            logError("Failed to create tile render pipeline state", label, error);
+        }
+    }
+
+    return pso;
+}
+
+void PipelineArchive::serialize()
+{
+    if (!m_archive || !m_dirty) {
+        return;
+    }
+    if (serializeTo(m_path)) {
+        m_dirty = false;
+    }
+}
+
+bool PipelineArchive::serializeTo(const std::string& path)
+{
+    if (!m_archive) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    NS::Error* error = nullptr;
+    NS::URL* url = NS::URL::fileURLWithPath(NS::String::string(path.c_str(), NS::UTF8StringEncoding));
+    if (!m_archive->serializeToURL(url, &error)) {
+        logError("Failed to write pipeline cache", path, error);
+        return false;
+    }
+    std::cout << "Pipeline cache written to " << path << std::endl;
+    return true;
+}
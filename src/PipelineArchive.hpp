@@ -0,0 +1,57 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// MTL::BinaryArchive-backed pipeline creation.
+// On a warm start every pipeline is first looked up in the archive loaded from disk
+// (PipelineOptionFailOnBinaryArchiveMiss); misses and cold starts compile normally and
+// record the pipeline so serialize() can write the archive back for the next launch.
+// A shipped archive (default.metalarchive, built by the PrecompiledPipelines target) is
+// searched too, so a first launch on the GPU family it was built on compiles nothing.
+class PipelineArchive {
+public:
+    // Runs on a Metal completion thread; the pipeline is retained (nullptr on failure)
+    typedef std::function<void(MTL::RenderPipelineState*)> RenderPipelineCallback;
+
+    // path: the local archive read and rewritten across launches; shippedPath: read only (may be empty or missing)
+    PipelineArchive(MTL::Device* device, const std::string& path, const std::string& shippedPath = std::string());
+    ~PipelineArchive();
+
+    // Asynchronous render pipeline creation (the descriptor may be released after the call)
+    void newRenderPipelineAsync(MTL::RenderPipelineDescriptor* descriptor, const char* label, RenderPipelineCallback callback);
+    // Synchronous creation for pipelines needed during setup
+    MTL::ComputePipelineState* newComputePipeline(MTL::Function* function, const char* label);
+    MTL::RenderPipelineState* newRenderPipeline(MTL::RenderPipelineDescriptor* descriptor, const char* label);
+    MTL::RenderPipelineState* newMeshPipeline(MTL::MeshRenderPipelineDescriptor* descriptor, const char* label);
+    MTL::RenderPipelineState* newTilePipeline(MTL::TileRenderPipelineDescriptor* descriptor, const char* label);
+
+    // Write the archive if pipelines were added since it was loaded
+    void serialize();
+    // Write the local archive elsewhere (the build's precompilation step)
+    bool serializeTo(const std::string& path);
+
+    bool isWarm() const { return m_loaded; }
+
+private:
+    void compileRenderPipeline(MTL::RenderPipelineDescriptor* descriptor, const std::string& label, RenderPipelineCallback callback);
+    static void logError(const char* what, const std::string& label, NS::Error* error);
+    template <typename Descriptor>
+    void attachArchives(Descriptor* descriptor) const
+    {
+        if (m_lookupArchives) {
+            descriptor->setBinaryArchives(m_lookupArchives);
+        }
+    }
+
+    MTL::Device* m_device;
+    MTL::BinaryArchive* m_archive;         // Local: loaded from and written to m_path
+    MTL::BinaryArchive* m_shippedArchive;  // Precompiled with the build, never written
+    NS::Array* m_lookupArchives;           // Both, shipped first
+    std::string m_path;
+    bool m_loaded;                 // An archive came from disk (lookups may hit)
+    std::atomic<bool> m_dirty;     // Pipelines were added since loading
+    std::mutex m_mutex;            // Serializes archive updates from completion threads
+};
@@ -0,0 +1,279 @@
+#include "PipelineCache.hpp"
+#include "PipelineArchive.hpp"
+#include <iostream>
+#include <thread>
+#include <tuple>
+
+bool PipelineConstant::operator<(const PipelineConstant& other) const
+{
+    return std::tie(index, type, value) < std::tie(other.index, other.type, other.value);
+}
+
+bool PipelineConstant::operator==(const PipelineConstant& other) const
+{
+    return index == other.index && type == other.type && value == other.value;
+}
+
+bool PipelineKey::operator<(const PipelineKey& other) const
+{
+    return std::tie(vertexFunction, fragmentFunction, sampleCount, colorFormat, motionFormat, visibilityFormat, tileOutputFormat,
+                    tileDepthFormat, objectIdFormat, depthFormat, alphaToCoverage, blending, colorWrites, rasterization,
+                    supportIndirectCommandBuffers, maxVertexAmplificationCount, constants) <
+           std::tie(other.vertexFunction, other.fragmentFunction, other.sampleCount, other.colorFormat, other.motionFormat,
+                    other.visibilityFormat, other.tileOutputFormat, other.tileDepthFormat, other.objectIdFormat, other.depthFormat,
+                    other.alphaToCoverage, other.blending, other.colorWrites, other.rasterization, other.supportIndirectCommandBuffers,
+                    other.maxVertexAmplificationCount, other.constants);
+}
+
+PipelineCache::PipelineCache(MTL::Device* device, PipelineArchive* archive)
+    : m_device(device)
+    , m_archive(archive)
+    , m_library(nullptr)
+    , m_pending(0)
+    , m_generation(0)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+    // Builds still running write into the entries
+    while (m_pending.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+
+    for (auto& item : m_entries) {
+        if (item.second.pipeline) {
+            item.second.pipeline->release();
+        }
+    }
+    releaseRetired();
+    if (m_library) {
+        m_library->release();
+    }
+}
+
+MTL::RenderPipelineState* PipelineCache::get(const PipelineKey& key)
+{
+    Entry* entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& existing = m_entries[key];
+        if (existing.pipeline || existing.building || existing.failed || !m_library) {
+            return existing.pipeline;
+        }
+        entry = &existing;
+    }
+
+    // First request for this key: start building, serve nullptr meanwhile
+    build(key, *entry);
+    return nullptr;
+}
+
+void PipelineCache::setLibrary(MTL::Library* library, const std::set<std::string>* functions)
+{
+    std::vector<std::pair<PipelineKey, Entry*>> rebuild;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (library) {
+            library->retain();
+        }
+        if (m_library) {
+            m_library->release();
+        }
+        m_library = library;
+
+        for (auto& item : m_entries) {
+            if (!functions || functions->count(item.first.vertexFunction) || functions->count(item.first.fragmentFunction)) {
+                rebuild.emplace_back(item.first, &item.second);
+            }
+        }
+    }
+
+    if (!library) {
+        return;
+    }
+    for (auto& item : rebuild) {
+        build(item.first, *item.second);
+    }
+}
+
+void PipelineCache::releaseRetired()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (MTL::RenderPipelineState* pipeline : m_retired) {
+        pipeline->release();
+    }
+    m_retired.clear();
+}
+
+void PipelineCache::build(const PipelineKey& key, Entry& entry)
+{
+    uint32_t version;
+    MTL::Library* library;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        version = ++entry.version;
+        entry.building = true;
+        entry.failed = false;
+        library = m_library;
+        if (library) {
+            library->retain();
+        }
+    }
+
+    std::string label = labelFor(key);
+    MTL::RenderPipelineDescriptor* descriptor = nullptr;
+    MTL::Function* vertexFunction = nullptr;
+    MTL::Function* fragmentFunction = nullptr;
+
+    if (library) {
+        vertexFunction = newFunction(library, key.vertexFunction, key.constants);
+        if (!key.fragmentFunction.empty()) {
+            fragmentFunction = newFunction(library, key.fragmentFunction, key.constants);
+        }
+        library->release();
+    }
+
+    if (vertexFunction && (fragmentFunction || key.fragmentFunction.empty())) {
+        descriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+        descriptor->setVertexFunction(vertexFunction);
+        descriptor->setFragmentFunction(fragmentFunction);
+
+        MTL::RenderPipelineColorAttachmentDescriptor* colorAttachment = descriptor->colorAttachments()->object(0);
+        colorAttachment->setPixelFormat(key.colorFormat);
+        if (key.blending) {
+            colorAttachment->setBlendingEnabled(true);
+            colorAttachment->setRgbBlendOperation(MTL::BlendOperationAdd);
+            colorAttachment->setAlphaBlendOperation(MTL::BlendOperationAdd);
+            colorAttachment->setSourceRGBBlendFactor(MTL::BlendFactorSourceAlpha);
+            colorAttachment->setSourceAlphaBlendFactor(MTL::BlendFactorSourceAlpha);
+            colorAttachment->setDestinationRGBBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+            colorAttachment->setDestinationAlphaBlendFactor(MTL::BlendFactorOneMinusSourceAlpha);
+        }
+        if (key.motionFormat != MTL::PixelFormatInvalid) {
+            descriptor->colorAttachments()->object(1)->setPixelFormat(key.motionFormat);
+        }
+        if (key.visibilityFormat != MTL::PixelFormatInvalid) {
+            descriptor->colorAttachments()->object(2)->setPixelFormat(key.visibilityFormat);
+        }
+        if (key.tileOutputFormat != MTL::PixelFormatInvalid) {
+            descriptor->colorAttachments()->object(1)->setPixelFormat(key.tileOutputFormat);
+        }
+        if (key.tileDepthFormat != MTL::PixelFormatInvalid) {
+            descriptor->colorAttachments()->object(3)->setPixelFormat(key.tileDepthFormat);
+        }
+        if (key.objectIdFormat != MTL::PixelFormatInvalid) {
+            descriptor->colorAttachments()->object(4)->setPixelFormat(key.objectIdFormat);
+        }
+        if (!key.colorWrites) {
+            for (NS::UInteger i = 0; i < 5; ++i) {
+                descriptor->colorAttachments()->object(i)->setWriteMask(MTL::ColorWriteMaskNone);
+            }
+        }
+        descriptor->setDepthAttachmentPixelFormat(key.depthFormat);
+        descriptor->setSampleCount(key.sampleCount);
+        descriptor->setAlphaToCoverageEnabled(key.alphaToCoverage);
+        descriptor->setRasterizationEnabled(key.rasterization);
+        descriptor->setSupportIndirectCommandBuffers(key.supportIndirectCommandBuffers);
+        if (key.maxVertexAmplificationCount > 1) {
+            descriptor->setMaxVertexAmplificationCount(key.maxVertexAmplificationCount);
+        }
+    } else {
+        std::cerr << "Failed to load shader functions for pipeline " << label << std::endl;
+    }
+
+    if (vertexFunction) vertexFunction->release();
+    if (fragmentFunction) fragmentFunction->release();
+
+    if (!descriptor) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (entry.version == version) {
+            entry.building = false;
+            entry.failed = (entry.pipeline == nullptr);
+        }
+        m_generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    Entry* target = &entry;
+    m_archive->newRenderPipelineAsync(descriptor, label.c_str(), [this, target, version](MTL::RenderPipelineState* pipeline) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (target->version != version) {
+                // A newer build (library swap) superseded this one
+                if (pipeline) pipeline->release();
+            } else {
+                target->building = false;
+                target->failed = (!pipeline && !target->pipeline);
+                if (pipeline) {
+                    // Keep the old pipeline alive until frames using it have completed
+                    if (target->pipeline) m_retired.push_back(target->pipeline);
+                    target->pipeline = pipeline;
+                }
+            }
+        }
+        m_generation.fetch_add(1, std::memory_order_release);
+        m_pending.fetch_sub(1, std::memory_order_release);
+    });
+    descriptor->release();
+}
+
+MTL::Function* PipelineCache::newFunction(MTL::Library* library, const std::string& name, const std::vector<PipelineConstant>& constants)
+{
+    NS::String* functionName = NS::String::string(name.c_str(), NS::ASCIIStringEncoding);
+
+    // Always specialize (even with no values): functions declaring function constants need it
+    MTL::FunctionConstantValues* values = MTL::FunctionConstantValues::alloc()->init();
+    for (const PipelineConstant& constant : constants) {
+        if (constant.type == MTL::DataTypeBool) {
+            bool value = (constant.value != 0);
+            values->setConstantValue(&value, MTL::DataTypeBool, constant.index);
+        } else {
+            values->setConstantValue(&constant.value, MTL::DataTypeInt, constant.index);
+        }
+    }
+
+    NS::Error* error = nullptr;
+    MTL::Function* function = library->newFunction(functionName, values, &error);
+    if (!function) {
+        if (error) {
+            std::cerr << "Failed to specialize " << name << ": " << error->localizedDescription()->utf8String() << std::endl;
+        } else {
+            std::cerr << "Failed to specialize " << name << std::endl;
+        }
+    }
+
+    values->release();
+    return function;
+}
+
+std::string PipelineCache::labelFor(const PipelineKey& key)
+{
+    std::string label = key.vertexFunction + "/" + key.fragmentFunction + " x" + std::to_string(key.sampleCount);
+    if (key.motionFormat != MTL::PixelFormatInvalid) {
+        label += " +motion";
+    }
+    if (key.visibilityFormat != MTL::PixelFormatInvalid) {
+        label += " +visibility";
+    }
+    if (key.tileDepthFormat != MTL::PixelFormatInvalid) {
+        label += " +tilepost";
+    }
+    if (key.objectIdFormat != MTL::PixelFormatInvalid) {
+        label += " +objectid";
+    }
+    if (!key.colorWrites) {
+        label += " +depthonly";
+    }
+    if (!key.rasterization) {
+        label += " +norasterization";
+    }
+    if (key.maxVertexAmplificationCount > 1) {
+        label += " +views" + std::to_string(key.maxVertexAmplificationCount);
+    }
+    for (const PipelineConstant& constant : key.constants) {
+        label += " c" + std::to_string(constant.index) + "=" + std::to_string(constant.value);
+    }
+    return label;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+class PipelineArchive;
+
+// Function constant baked into a pipeline permutation (bool or int constants)
+struct PipelineConstant {
+    NS::UInteger index;
+    MTL::DataType type;       // MTL::DataTypeBool or MTL::DataTypeInt
+    int32_t value;
+
+    bool operator<(const PipelineConstant& other) const;
+    bool operator==(const PipelineConstant& other) const;
+};
+
+// Everything that distinguishes one render pipeline from another in this renderer
+struct PipelineKey {
+    std::string vertexFunction;
+    std::string fragmentFunction;              // Empty: no fragment stage (depth-only pipelines)
+    NS::UInteger sampleCount = 1;
+    MTL::PixelFormat colorFormat = MTL::PixelFormatBGRA8Unorm;
+    MTL::PixelFormat motionFormat = MTL::PixelFormatInvalid; // Color 1 (motion vectors); Invalid = none
+    MTL::PixelFormat visibilityFormat = MTL::PixelFormatInvalid; // Color 2 (grass visibility IDs); Invalid = none
+    MTL::PixelFormat tileOutputFormat = MTL::PixelFormatInvalid; // Color 1 written by the in-tile post (never with motion)
+    MTL::PixelFormat tileDepthFormat = MTL::PixelFormatInvalid;  // Color 3 (fragment depth for the in-tile post)
+    MTL::PixelFormat objectIdFormat = MTL::PixelFormatInvalid;   // Color 4 (picking object IDs); Invalid = none
+    MTL::PixelFormat depthFormat = MTL::PixelFormatDepth32Float;
+    bool alphaToCoverage = false;
+    bool blending = false;                     // Source-over alpha blending on color 0
+    bool colorWrites = true;                   // False: depth only (every color write mask cleared)
+    bool rasterization = true;                 // False: vertex stage only, primitives discarded before rasterization
+    bool supportIndirectCommandBuffers = true;
+    NS::UInteger maxVertexAmplificationCount = 1; // Views one draw can be amplified into (multi-view)
+    std::vector<PipelineConstant> constants;
+
+    bool operator<(const PipelineKey& other) const;
+};
+
+// Render pipelines built on demand from a PipelineKey. Identical keys share one pipeline,
+// creation is asynchronous (through the PipelineArchive) and setLibrary() rebuilds every
+// known pipeline in the background while the previous one keeps being returned.
+class PipelineCache {
+public:
+    PipelineCache(MTL::Device* device, PipelineArchive* archive);
+    ~PipelineCache();
+
+    // Current pipeline for the key, or nullptr while its first build is still running.
+    // The cache owns the result; it stays valid until releaseRetired() after a rebuild.
+    MTL::RenderPipelineState* get(const PipelineKey& key);
+
+    // Swap the shader library and rebuild every pipeline created so far (shader hot reload), or
+    // only those whose vertex or fragment function is in functions; the others keep their pipeline
+    void setLibrary(MTL::Library* library, const std::set<std::string>* functions = nullptr);
+
+    // Release pipelines replaced by rebuilds (only once the GPU no longer uses them)
+    void releaseRetired();
+
+    int pendingCount() const { return m_pending.load(std::memory_order_acquire); }
+    uint64_t generation() const { return m_generation.load(std::memory_order_acquire); } // Bumped by every finished build
+
+    // Function specialized with the constants; optional constants left out take their defaults
+    static MTL::Function* newFunction(MTL::Library* library, const std::string& name, const std::vector<PipelineConstant>& constants);
+
+private:
+    struct Entry {
+        MTL::RenderPipelineState* pipeline = nullptr;
+        uint32_t version = 0;     // Incremented per build request; stale results are dropped
+        bool building = false;
+        bool failed = false;      // Not retried until the library changes
+    };
+
+    void build(const PipelineKey& key, Entry& entry);
+    static std::string labelFor(const PipelineKey& key);
+
+    MTL::Device* m_device;
+    PipelineArchive* m_archive;
+    MTL::Library* m_library;
+    std::map<PipelineKey, Entry> m_entries;
+    std::vector<MTL::RenderPipelineState*> m_retired;
+    std::mutex m_mutex;           // Guards m_entries / m_retired against completion threads
+    std::atomic<int> m_pending;
+    std::atomic<uint64_t> m_generation;
+};
@@ -0,0 +1,245 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Post pass: the scene is shaded into linear HDR (RGBA16Float), then this full-screen draw
+// (vertexSkyFullscreen) applies depth fog, exposure and tone mapping once per pixel, for every
+// kind of geometry, however many fragments were overdrawn to produce it. Its output is the LDR
+// drawable or the MetalFX input. On Apple GPUs the 4x scene pass can run it in tile memory
+// instead (postFogToneMapTile below). In the TAA mode it reads the temporal resolve (also below)
+// instead of the scene color.
+
+// Fog Parameters (Gentler atmospheric perspective): it starts and reaches its cap at the scene
+// constants' fog distances (the quality presets move them; by default 12 and 40 meters, so grass
+// is clear close up and the edge of the field is hidden)
+constant float kFogMax = 0.75; // never fully overwrite the geometry
+
+// Fog color elevation: the atmosphere LUT row a little above the horizon
+constant float kFogElevationSin = 0.22;
+constant float kFogElevationCos = 0.9755;
+
+// Variable rasterization rate: the scene targets hold the rate map's physical layout, so screen
+// pixels are mapped into it before reading
+constant bool rasterizationRateMapValue [[function_constant(FunctionConstantIndexRasterizationRateMap)]];
+constant bool rasterizationRateMapped = is_function_constant_defined(rasterizationRateMapValue) && rasterizationRateMapValue;
+
+// Fog, exposure and tone mapping of one HDR scene color; position is the pixel in the view drawn
+// into viewRect (screen pixels, y down) and depth its scene depth
+static float3 fogAndToneMap(float3 color, float depth, float2 position, float4 viewRect,
+                            constant Uniforms &uniforms, constant SceneConstants &scene,
+                            texture2d<float> atmosphereLut) {
+    // Sky (nothing drawn here) takes no fog, only the exposure and tone map below
+    if (depth < 1.0) {
+        // World position of the pixel (pixels are y down), in the view drawn into this rectangle
+        float2 viewPixel = (position - viewRect.xy) / viewRect.zw;
+        float2 ndc = float2(viewPixel.x * 2.0 - 1.0, 1.0 - viewPixel.y * 2.0);
+        float4 world = uniforms.inverseViewProjection * float4(ndc, depth, 1.0);
+        float3 toPixel = world.xyz / world.w - uniforms.cameraPosition;
+
+        // ---------------------------------------------------------
+        // DISTANCE FOG (Before tone mapping for subtle atmospheric perspective)
+        // ---------------------------------------------------------
+        // Gentler exponential curve with cap to avoid full overwrite
+        float fogLin = saturate((length(toPixel) - scene.fogStartDistance) / (scene.fogEndDistance - scene.fogStartDistance));
+        float fogFactor = min(1.0 - exp(-fogLin * 1.2), kFogMax);
+
+        // Fog Color: the sky just above the horizon in this direction, so distant geometry fades
+        // into the atmosphere behind it (warmer toward a low sun)
+        float2 fogAzimuth = toPixel.xz / max(length(toPixel.xz), 1e-4);
+        float3 fogDir = float3(fogAzimuth * kFogElevationCos, kFogElevationSin).xzy;
+        color = mix(color, atmosphereColor(atmosphereLut, fogDir, uniforms.sunDirection), fogFactor);
+    }
+
+    // ---------------------------------------------------------
+    // EXPOSURE + TONE MAPPING (Lift midtones, keep highlights controlled)
+    // ---------------------------------------------------------
+    color *= POST_EXPOSURE;
+
+    // Simple Reinhard tone map per-channel
+    return color / (color + 1.0);
+}
+
+fragment float4 postFogToneMapFragment(
+    float4 position [[position]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    constant float4 &viewRect [[buffer(BufferIndexRenderSize)]], // Render pixels of the view (origin, size)
+    texture2d<float, access::read> sceneColor [[texture(PostTextureIndexSceneColor)]],
+    depth2d<float, access::read> sceneDepth [[texture(PostTextureIndexSceneDepth)]],
+    texture2d<float> atmosphereLut [[texture(TextureIndexAtmosphere)]],
+    constant rasterization_rate_map_data &rateMap [[buffer(BufferIndexRasterizationRateMap), function_constant(rasterizationRateMapped)]]
+) {
+    uint2 pixel = uint2(position.xy);
+    if (rasterizationRateMapped) {
+        rasterization_rate_map_decoder decoder(rateMap);
+        pixel = uint2(decoder.map_screen_to_physical_coordinates(position.xy));
+    }
+    float3 color = sceneColor.read(pixel).rgb;
+    float depth = sceneDepth.read(pixel);
+    return float4(fogAndToneMap(color, depth, position.xy, viewRect, uniforms, scene, atmosphereLut), 1.0);
+}
+
+// ---------------------------------------------------------
+// TEMPORAL ANTIALIASING RESOLVE
+// ---------------------------------------------------------
+// The 1x scene is rendered through a subpixel-jittered projection; each pixel blends its new
+// sample with last frame's resolve, fetched where the motion vector says the surface was. The
+// history is clipped to the color range of the pixel's 3x3 neighbourhood this frame (mean and
+// deviation in YCoCg), so ground uncovered by a swaying blade takes the new color at once instead
+// of ghosting. One thread per render pixel.
+
+// Width of the neighbourhood box in standard deviations (wider keeps more history, blurs more)
+constant float kTemporalClipGamma = 1.25;
+// Motion (render pixels per frame) at which the new sample's weight has doubled: moving blades
+// trade some antialiasing for less smearing
+constant float kTemporalMotionPixels = 4.0;
+
+static float3 rgbToYCoCg(float3 color) {
+    return float3(dot(color, float3(0.25, 0.5, 0.25)), dot(color, float3(0.5, 0.0, -0.5)), dot(color, float3(-0.25, 0.5, -0.25)));
+}
+
+static float3 yCoCgToRgb(float3 color) {
+    return float3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+// Blend weight of an HDR sample: bright sun glints on blade tips do not dominate the average
+static float temporalSampleWeight(float3 color) {
+    return 1.0 / (1.0 + max(color.r, max(color.g, color.b)));
+}
+
+kernel void resolveTemporalAntialiasing(
+    texture2d<float, access::read> sceneColor [[texture(TemporalTextureIndexColor)]],
+    texture2d<float, access::read> motion [[texture(TemporalTextureIndexMotion)]],
+    depth2d<float, access::read> sceneDepth [[texture(TemporalTextureIndexDepth)]],
+    texture2d<float, access::sample> history [[texture(TemporalTextureIndexHistory)]],
+    texture2d<float, access::write> output [[texture(TemporalTextureIndexOutput)]],
+    constant TemporalResolveUniforms &resolve [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (any(gid >= resolve.renderSize)) {
+        return;
+    }
+
+    // Neighbourhood moments, and the nearest neighbour's motion: on a blade edge the thin blade
+    // in front, not the ground behind it, decides where the pixel came from
+    int2 limit = int2(resolve.renderSize) - 1;
+    float3 current = sceneColor.read(gid).rgb;
+    float3 sum = 0.0;
+    float3 sumSquares = 0.0;
+    float nearestDepth = 1.0;
+    uint2 nearestPixel = gid;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            uint2 pixel = uint2(clamp(int2(gid) + int2(x, y), int2(0), limit));
+            float3 neighbour = rgbToYCoCg(sceneColor.read(pixel).rgb);
+            sum += neighbour;
+            sumSquares += neighbour * neighbour;
+            float depth = sceneDepth.read(pixel);
+            if (depth < nearestDepth) {
+                nearestDepth = depth;
+                nearestPixel = pixel;
+            }
+        }
+    }
+
+    float2 offset = motion.read(nearestPixel).xy;
+    float2 previousUV = (float2(gid) + 0.5) / float2(resolve.renderSize) + offset;
+    if (resolve.historyValid == 0 || any(previousUV < 0.0) || any(previousUV > 1.0)) {
+        output.write(float4(current, 1.0), gid);
+        return;
+    }
+
+    // Clip the history toward the box center rather than clamping per channel (no hue shifts)
+    constexpr sampler historySampler(filter::linear, address::clamp_to_edge);
+    float3 previous = rgbToYCoCg(history.sample(historySampler, previousUV * resolve.historyScale, level(0)).rgb);
+    float3 mean = sum / 9.0;
+    float3 extent = sqrt(max(sumSquares / 9.0 - mean * mean, 0.0)) * kTemporalClipGamma + 1e-4;
+    float3 fromMean = previous - mean;
+    float3 reach = abs(fromMean / extent);
+    float clip = max(reach.x, max(reach.y, reach.z));
+    previous = yCoCgToRgb(clip > 1.0 ? mean + fromMean / clip : previous);
+
+    float motionPixels = length(offset * float2(resolve.renderSize));
+    float blend = min(resolve.blend * (1.0 + motionPixels / kTemporalMotionPixels), 1.0);
+    float currentWeight = blend * temporalSampleWeight(current);
+    float previousWeight = (1.0 - blend) * temporalSampleWeight(previous);
+    float3 color = (current * currentWeight + previous * previousWeight) / max(currentWeight + previousWeight, 1e-5);
+    output.write(float4(color, 1.0), gid);
+}
+
+// ---------------------------------------------------------
+// IN-TILE POST (Apple GPUs)
+// ---------------------------------------------------------
+// The same fog and tone mapping as a tile stage at the end of the 4x scene pass, on the samples
+// still in tile memory: the scene fragments copy their depth into color(3) (tile functions cannot
+// read the depth attachment) and the result goes to color(1), which resolves into the output.
+// The HDR color is never stored, and each sample is tone mapped before the resolve averages them.
+struct SceneTileSample {
+    float4 color [[color(0)]];  // Linear HDR scene color
+    float4 output [[color(1)]]; // Fogged, tone-mapped color (the resolved attachment)
+    float depth [[color(3)]];   // Fragment depth, cleared to 1 (sky)
+};
+
+kernel void postFogToneMapTile(
+    imageblock<SceneTileSample, imageblock_layout_implicit> block,
+    ushort2 tilePixel [[thread_position_in_threadgroup]],
+    uint2 pixel [[thread_position_in_grid]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    constant float4 &viewRect [[buffer(BufferIndexRenderSize)]],
+    texture2d<float> atmosphereLut [[texture(TextureIndexAtmosphere)]]
+) {
+    // Once per distinct color of the pixel: only the pixels on an edge hold more than one
+    float2 position = float2(pixel) + 0.5;
+    ushort colorCount = block.get_num_colors(tilePixel);
+    for (ushort i = 0; i < colorCount; ++i) {
+        SceneTileSample entry = block.read(tilePixel, i, imageblock_data_rate::color);
+        entry.output = float4(fogAndToneMap(entry.color.rgb, entry.depth, position, viewRect, uniforms, scene, atmosphereLut), 1.0);
+        block.write(entry, tilePixel, i, imageblock_data_rate::color);
+    }
+}
+
+// ---------------------------------------------------------
+// OBJECT ID PICKING
+// ---------------------------------------------------------
+// Copies one pick region of the scene's object ID attachment into a shared buffer (one thread per
+// region pixel). Integer IDs do not resolve, so the MSAA scene is read at sample 0.
+static uint readObjectId(texture2d_ms<uint, access::read> ids, uint2 texel) {
+    return ids.read(texel, 0).r;
+}
+
+static uint readObjectId(texture2d<uint, access::read> ids, uint2 texel) {
+    return ids.read(texel).r;
+}
+
+template <typename ObjectIds>
+static void pickObjectIdRegion(ObjectIds ids, device uint *results, constant ObjectPickUniforms &pick, uint2 gid) {
+    if (gid.x >= pick.size.x || gid.y >= pick.size.y) {
+        return;
+    }
+    uint2 texel = uint2((float2(pick.origin + gid) + 0.5) * pick.scale);
+    uint id = OBJECT_ID(ObjectIdKindNone, 0);
+    if (all(texel < pick.limit)) {
+        id = readObjectId(ids, texel);
+    }
+    results[gid.y * pick.size.x + gid.x] = id;
+}
+
+kernel void pickObjectIds(
+    texture2d<uint, access::read> ids [[texture(0)]],
+    device uint *results [[buffer(PickBufferIndexResults)]],
+    constant ObjectPickUniforms &pick [[buffer(PickBufferIndexUniforms)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    pickObjectIdRegion(ids, results, pick, gid);
+}
+
+kernel void pickObjectIdsMultisampled(
+    texture2d_ms<uint, access::read> ids [[texture(0)]],
+    device uint *results [[buffer(PickBufferIndexResults)]],
+    constant ObjectPickUniforms &pick [[buffer(PickBufferIndexUniforms)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    pickObjectIdRegion(ids, results, pick, gid);
+}
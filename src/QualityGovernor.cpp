@@ -0,0 +1,130 @@
+#include "QualityGovernor.hpp"
+#include <algorithm>
+#include <iostream>
+
+QualityGovernor::QualityGovernor()
+    : m_thermalObserver(nullptr)
+    , m_powerObserver(nullptr)
+    , m_systemChanged(false)
+    , m_thermalState(NS::ProcessInfoThermalStateNominal)
+    , m_lowPowerMode(false)
+    , m_level(0)
+    , m_filteredGpuMs(0.0)
+    , m_overSince(-1.0)
+    , m_calmSince(-1.0)
+    , m_lastRaise(-1.0)
+    , m_stepUpDelay(kStepUpDelay)
+{
+    // Posted on whichever thread changed the state: only flag it, update() reads the new state
+    NS::ObserverFunction changed = [this](NS::Notification*) { m_systemChanged = true; };
+    NS::NotificationCenter* center = NS::NotificationCenter::defaultCenter();
+    m_thermalObserver = center->addObserver(NS::ProcessInfoThermalStateDidChangeNotification, nullptr, nullptr, changed);
+    m_powerObserver = center->addObserver(NS::ProcessInfoPowerStateDidChangeNotification, nullptr, nullptr, changed);
+    if (m_thermalObserver) {
+        m_thermalObserver->retain();
+    }
+    if (m_powerObserver) {
+        m_powerObserver->retain();
+    }
+    readSystemState();
+}
+
+QualityGovernor::~QualityGovernor()
+{
+    NS::NotificationCenter* center = NS::NotificationCenter::defaultCenter();
+    for (NS::Object* observer : { m_thermalObserver, m_powerObserver }) {
+        if (observer) {
+            center->removeObserver(observer);
+            observer->release();
+        }
+    }
+}
+
+void QualityGovernor::readSystemState()
+{
+    NS::ProcessInfo* processInfo = NS::ProcessInfo::processInfo();
+    m_thermalState = processInfo->thermalState();
+    m_lowPowerMode = processInfo->isLowPowerModeEnabled();
+}
+
+int QualityGovernor::systemFloor() const
+{
+    // Fair is where the fans (or the clocks, without fans) start to respond: get ahead of it
+    int floor = 0;
+    switch (m_thermalState) {
+        case NS::ProcessInfoThermalStateFair:
+            floor = 1;
+            break;
+        case NS::ProcessInfoThermalStateSerious:
+            floor = 2;
+            break;
+        case NS::ProcessInfoThermalStateCritical:
+            floor = kLevelCount - 1;
+            break;
+        default:
+            break;
+    }
+    return std::max(floor, m_lowPowerMode ? 1 : 0);
+}
+
+void QualityGovernor::setLevel(int level, double now)
+{
+    level = std::clamp(level, 0, kLevelCount - 1);
+    if (level > m_level && m_lastRaise >= 0.0 && now - m_lastRaise < kRelapseWindow) {
+        // The last step up did not hold: the next one waits longer
+        m_stepUpDelay = std::min(m_stepUpDelay * 2.0, kMaxStepUpDelay);
+    }
+    if (level < m_level) {
+        m_lastRaise = now;
+    }
+    m_level = level;
+    m_overSince = -1.0;
+    m_calmSince = -1.0;
+}
+
+bool QualityGovernor::update(double now, double gpuFrameMs, double targetFrameMs)
+{
+    int previous = m_level;
+    if (m_systemChanged.exchange(false)) {
+        readSystemState();
+    }
+    int floor = systemFloor();
+    if (m_level < floor) {
+        setLevel(floor, now);
+    }
+
+    // Frame budget: a sustained overrun drops a level, sustained headroom (and no pressure) raises one
+    if (gpuFrameMs > 0.0 && targetFrameMs > 0.0) {
+        m_filteredGpuMs = (m_filteredGpuMs <= 0.0) ? gpuFrameMs : m_filteredGpuMs + (gpuFrameMs - m_filteredGpuMs) * kFilter;
+        if (m_filteredGpuMs > targetFrameMs * kOverBudget) {
+            m_calmSince = -1.0;
+            if (m_overSince < 0.0) {
+                m_overSince = now;
+            } else if (now - m_overSince >= kStepDownDelay && m_level + 1 < kLevelCount) {
+                setLevel(m_level + 1, now);
+            }
+        } else if (m_filteredGpuMs < targetFrameMs * kHeadroom && m_level > floor) {
+            m_overSince = -1.0;
+            if (m_calmSince < 0.0) {
+                m_calmSince = now;
+            } else if (now - m_calmSince >= m_stepUpDelay) {
+                setLevel(m_level - 1, now);
+            }
+        } else {
+            m_overSince = -1.0;
+            m_calmSince = -1.0;
+        }
+    }
+    if (m_lastRaise >= 0.0 && now - m_lastRaise >= kMaxStepUpDelay) {
+        // Long stable since the last raise: back to the short wait
+        m_stepUpDelay = kStepUpDelay;
+        m_lastRaise = -1.0;
+    }
+
+    if (m_level == previous) {
+        return false;
+    }
+    std::cout << "Quality governor: level " << m_level << " (thermal state " << m_thermalState
+              << (m_lowPowerMode ? ", Low Power Mode" : "") << ", GPU " << m_filteredGpuMs << " ms)" << std::endl;
+    return true;
+}
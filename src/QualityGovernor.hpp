@@ -0,0 +1,65 @@
+#pragma once
+#include <Foundation/Foundation.hpp>
+#include <atomic>
+#include <cstdint>
+
+// Adaptive quality under sustained load (fanless Macs throttle after minutes at full clocks).
+// The governor watches the NS::ProcessInfo thermal state and Low Power Mode (through their
+// change notifications) and the measured GPU frame time, and picks a level of getStep(): each
+// level thins the grass nearer the camera (density LOD), caps the render scale and caps the
+// trample stamp rate. It steps down at once when macOS reports pressure and after a short
+// sustained overrun of the frame budget; it steps back up one level at a time, only after a long
+// calm spell with clear headroom, and waits longer each time a step up had to be taken back.
+class QualityGovernor {
+public:
+    static constexpr int kLevelCount = 4;
+
+    struct Step {
+        float densityLodScale; // On the density LOD distance (0, every blade, is left alone)
+        float renderScale;     // Render scale ceiling (upscaled by MetalFX)
+        float trampleRate;     // Trample steps per second at most (0 = uncapped)
+    };
+
+    QualityGovernor();
+    ~QualityGovernor();
+
+    // Per frame: the latest GPU frame time against the budget (wall time now, in seconds);
+    // true when the level changed
+    bool update(double now, double gpuFrameMs, double targetFrameMs);
+
+    int getLevel() const { return m_level; }
+    const Step& getStep() const { return kSteps[m_level]; }
+    NS::ProcessInfoThermalState getThermalState() const { return m_thermalState; }
+    bool isLowPowerMode() const { return m_lowPowerMode; }
+
+private:
+    static constexpr Step kSteps[kLevelCount] = {
+        { 1.0f, 1.0f, 0.0f },
+        { 0.8f, 0.85f, 30.0f },
+        { 0.6f, 0.7f, 20.0f },
+        { 0.45f, 0.5f, 15.0f },
+    };
+    static constexpr double kOverBudget = 1.1;      // Filtered GPU time above 110% of the budget...
+    static constexpr double kStepDownDelay = 2.0;   // ...for this long (s) drops a level
+    static constexpr double kHeadroom = 0.75;       // Below 75% of the budget...
+    static constexpr double kStepUpDelay = 10.0;    // ...for this long (s) with no pressure raises one
+    static constexpr double kMaxStepUpDelay = 120.0;
+    static constexpr double kRelapseWindow = 30.0;  // A drop this soon after a raise doubles the wait
+    static constexpr double kFilter = 0.05;         // Weight of the newest frame in the filtered time
+
+    void readSystemState();
+    int systemFloor() const; // Lowest level the thermal state and Low Power Mode allow
+    void setLevel(int level, double now);
+
+    NS::Object* m_thermalObserver;
+    NS::Object* m_powerObserver;
+    std::atomic<bool> m_systemChanged; // Set by the notifications (any thread), read per frame
+    NS::ProcessInfoThermalState m_thermalState;
+    bool m_lowPowerMode;
+    int m_level;
+    double m_filteredGpuMs;
+    double m_overSince;     // Wall time the budget overrun began (< 0: within budget)
+    double m_calmSince;     // Wall time the headroom began (< 0: no headroom)
+    double m_lastRaise;     // Wall time of the last step up (< 0: none yet)
+    double m_stepUpDelay;
+};
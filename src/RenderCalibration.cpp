@@ -0,0 +1,188 @@
+#include "RenderCalibration.hpp"
+#include "Renderer.hpp"
+#include "DynamicResolution.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static constexpr int kWarmupFrames = 30;     // Per probe: pipelines swapped in, Hi-Z history, timings resolving
+static constexpr int kMeasuredFrames = 90;
+static constexpr int kLowDensity = 32;       // Blades per cell of the low-density probe
+static constexpr int kMinBladesPerCell = 8;  // Floor when even Low at the smallest scale is too slow
+static constexpr float kHeadroom = 0.9f;     // Share of the target the picked settings may fill
+// Render scales tried below native resolution, and the lowest each preset may go to
+static constexpr float kRenderScales[] = { 1.0f, 0.85f, 0.75f, 0.6f, 0.5f };
+static constexpr float kMinRenderScale[RenderSettings::QualityCount] = { 0.5f, 0.75f, 1.0f, 1.0f };
+
+// Median GPU frame time of one probe along the bench orbit (0 when no timing resolved)
+static double measure(Renderer* renderer)
+{
+    renderer->waitForPipelines();
+    renderer->waitForTextures();
+    std::vector<double> samples;
+    samples.reserve(kMeasuredFrames);
+    for (int frame = 0; frame < kWarmupFrames + kMeasuredFrames; ++frame) {
+        float angle = 6.28318530718f * static_cast<float>(frame) / static_cast<float>(kWarmupFrames + kMeasuredFrames);
+        renderer->setCameraPose(glm::vec3(std::cos(angle) * 10.0f, 3.0f, std::sin(angle) * 10.0f),
+                                glm::degrees(angle) + 180.0f, -15.0f);
+        renderer->setFixedTime(static_cast<float>(frame) / 60.0f);
+        renderer->draw();
+        double gpuMs = renderer->getGpuTimings().frameMs;
+        if (frame >= kWarmupFrames && gpuMs > 0.0) {
+            samples.push_back(gpuMs);
+        }
+    }
+    renderer->waitUntilIdle();
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+std::string RenderCalibration::cachePath(MTL::Device* device)
+{
+    std::string name;
+    for (char c : std::string(device->name()->utf8String())) {
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            name += c;
+        } else if (!name.empty() && name.back() != '_') {
+            name += '_';
+        }
+    }
+    return "render_settings_" + name + ".cfg";
+}
+
+bool RenderCalibration::run(MTL::Device* device, int width, int height, float targetFrameMs, Result& result)
+{
+    // Probes around the High preset: fewer blades, a quarter of the pixels, 2x MSAA. Each one
+    // changes a single input, so the differences to the first give its cost.
+    const RenderSettings high;
+    Renderer* renderer = new Renderer(device, width, height, 1);
+    renderer->setGrassDensity(high.bladesPerCell);
+    double baseMs = measure(renderer);
+    double baseBlades = static_cast<double>(renderer->getGrassInstanceCount());
+    double basePixels = static_cast<double>(width) * static_cast<double>(height);
+    int baseBladesPerCell = renderer->getRenderSettings().bladesPerCell;
+
+    renderer->setGrassDensity(kLowDensity);
+    double lowDensityMs = measure(renderer);
+    double lowBlades = static_cast<double>(renderer->getGrassInstanceCount());
+    renderer->setGrassDensity(high.bladesPerCell);
+
+    int smallWidth = std::max(width / 2, 1);
+    int smallHeight = std::max(height / 2, 1);
+    renderer->resize(smallWidth, smallHeight);
+    double smallMs = measure(renderer);
+    double smallPixels = static_cast<double>(smallWidth) * static_cast<double>(smallHeight);
+    renderer->resize(width, height);
+
+    double msaa2xMs = 0.0;
+    if (renderer->setSceneSampleCount(2)) {
+        msaa2xMs = measure(renderer);
+    }
+    delete renderer;
+
+    if (baseMs <= 0.0 || lowDensityMs <= 0.0 || smallMs <= 0.0) {
+        std::cerr << "Calibration: GPU timings unavailable" << std::endl;
+        return false;
+    }
+
+    // Per-unit costs in ms (noise can make a difference negative: clamp to free)
+    double bladeMs = baseBlades > lowBlades ? std::max(baseMs - lowDensityMs, 0.0) / (baseBlades - lowBlades) : 0.0;
+    double pixelMs = std::max(baseMs - smallMs, 0.0) / (basePixels - smallPixels);
+    double pixelMs2x = msaa2xMs > 0.0 ? std::clamp(pixelMs - (baseMs - msaa2xMs) / basePixels, 0.0, pixelMs) : pixelMs;
+    double fixedMs = std::max(baseMs - bladeMs * baseBlades - pixelMs * basePixels, 0.0);
+    double bladesPerDensity = baseBlades / std::max(baseBladesPerCell, 1);
+
+    // The fit ignores the presets' cheaper shading, farther cards and TAA (costed at the sample
+    // count it replaces), so lower presets come out a little pessimistic
+    auto predict = [&](const RenderSettings& settings) {
+        double pixels = basePixels * settings.renderScale * settings.renderScale;
+        return fixedMs + bladeMs * bladesPerDensity * settings.bladesPerCell +
+               (settings.sampleCount == 2 ? pixelMs2x : pixelMs) * pixels;
+    };
+
+    // Highest preset at native resolution first; Medium and Low may also trade resolution
+    double budgetMs = targetFrameMs * kHeadroom;
+    bool upscaling = DynamicResolution::isSupported(device);
+    RenderSettings chosen = RenderSettings::preset(RenderSettings::QualityLow);
+    chosen.renderScale = upscaling ? kMinRenderScale[RenderSettings::QualityLow] : 1.0f;
+    bool fits = false;
+    for (int quality = RenderSettings::QualityUltra; quality >= RenderSettings::QualityLow && !fits; --quality) {
+        for (float scale : kRenderScales) {
+            if (scale < kMinRenderScale[quality] || (scale < 1.0f && !upscaling)) {
+                break;
+            }
+            RenderSettings candidate = RenderSettings::preset(static_cast<RenderSettings::Quality>(quality));
+            candidate.renderScale = scale;
+            if (predict(candidate) <= budgetMs) {
+                chosen = candidate;
+                fits = true;
+                break;
+            }
+        }
+    }
+
+    // Then the density the rest of the budget pays for, between the preset's and the next one's
+    int minBladesPerCell = fits ? chosen.bladesPerCell : kMinBladesPerCell;
+    int maxBladesPerCell = chosen.quality < RenderSettings::QualityUltra ?
+        RenderSettings::preset(static_cast<RenderSettings::Quality>(chosen.quality + 1)).bladesPerCell : chosen.bladesPerCell;
+    if (!fits) {
+        maxBladesPerCell = chosen.bladesPerCell;
+    }
+    RenderSettings bare = chosen;
+    bare.bladesPerCell = 0;
+    double bladeBudgetMs = budgetMs - predict(bare);
+    int bladesPerCell = maxBladesPerCell;
+    if (bladeMs > 0.0) {
+        bladesPerCell = static_cast<int>(std::max(bladeBudgetMs, 0.0) / (bladeMs * bladesPerDensity));
+    }
+    chosen.bladesPerCell = std::clamp(bladesPerCell, minBladesPerCell, maxBladesPerCell);
+
+    result.settings = chosen;
+    result.fixedMs = fixedMs;
+    result.bladeNs = bladeMs * 1e6;
+    result.pixelNs = pixelMs * 1e6;
+    result.pixelNs2x = pixelMs2x * 1e6;
+    result.predictedMs = predict(chosen);
+    return true;
+}
+
+bool RenderCalibration::loadOrCalibrate(MTL::Device* device, int width, int height, float targetFrameMs,
+                                        bool recalibrate, RenderSettings& settings)
+{
+    std::string path = cachePath(device);
+    if (!recalibrate && std::ifstream(path)) {
+        RenderSettings cached;
+        if (cached.load(path)) {
+            settings = cached;
+            std::cout << "Render settings: " << path << std::endl;
+            return true;
+        }
+    }
+
+    std::cout << "Calibrating " << device->name()->utf8String() << " at " << width << "x" << height
+              << " for " << targetFrameMs << " ms..." << std::endl;
+    Result result;
+    if (!run(device, width, height, targetFrameMs, result)) {
+        return false;
+    }
+
+    std::ostringstream header;
+    header << "Calibrated for " << device->name()->utf8String() << " at " << width << "x" << height
+           << ", target " << targetFrameMs << " ms (delete to recalibrate)\n"
+           << "fixed " << result.fixedMs << " ms, " << result.bladeNs << " ns/blade, " << result.pixelNs
+           << " ns/pixel at 4x (" << result.pixelNs2x << " at 2x), predicted " << result.predictedMs << " ms";
+    std::cout << "Calibration: " << RenderSettings::qualityName(result.settings.quality) << ", "
+              << result.settings.bladesPerCell << " blades/cell, scale " << result.settings.renderScale
+              << ", predicted " << result.predictedMs << " ms" << std::endl;
+    result.settings.save(path, header.str());
+    settings = result.settings;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "RenderSettings.hpp"
+#include <string>
+
+// First-launch GPU calibration: renders the benchmark orbit offscreen at a few densities, sizes
+// and sample counts, fits the GPU frame time as fixed + per blade + per pixel cost, and picks
+// the highest preset, render scale and blade count the fit says will hold the target frame time.
+// The result is saved per device name, so later launches only read the file back.
+class RenderCalibration {
+public:
+    struct Result {
+        RenderSettings settings;
+        double fixedMs = 0.0;          // Frame cost that depends on neither blades nor pixels
+        double bladeNs = 0.0;          // Per placed blade
+        double pixelNs = 0.0;          // Per scene pixel at 4x MSAA
+        double pixelNs2x = 0.0;        // Per scene pixel at 2x MSAA
+        double predictedMs = 0.0;      // Fitted frame time of settings
+    };
+
+    // "render_settings_<device name>.cfg" in the working directory
+    static std::string cachePath(MTL::Device* device);
+
+    // A few seconds of offscreen frames at width x height; false when the GPU timings never resolved
+    static bool run(MTL::Device* device, int width, int height, float targetFrameMs, Result& result);
+
+    // The device's cached settings, else a calibration written to the cache for the next launch;
+    // false (settings untouched) when neither worked
+    static bool loadOrCalibrate(MTL::Device* device, int width, int height, float targetFrameMs,
+                                bool recalibrate, RenderSettings& settings);
+};
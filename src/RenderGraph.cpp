@@ -0,0 +1,757 @@
+#include "RenderGraph.hpp"
+#include <algorithm>
+#include <iostream>
+
+RenderGraph::RenderGraph(MTL::Device* device, GpuProfiler* profiler, RenderTargetHeap* heap)
+    : m_device(device)
+    , m_profiler(profiler)
+    , m_breadcrumbs(nullptr)
+    , m_heap(heap)
+    , m_supportsMemoryless(false)
+    , m_resourceCount(0)
+    , m_passCount(0)
+    , m_frame(0)
+    , m_asyncQueue(nullptr)
+    , m_asyncDoneEvent(device->newSharedEvent())
+    , m_releaseEvent(device->newEvent())
+    , m_eventValue(0)
+    , m_releaseValue(0)
+    , m_frameEndValue(0)
+    , m_asyncWaitPass(-1)
+    , m_releasePass(-1)
+    , m_holdAsync(false)
+{
+    // Tile memory only exists on Apple GPUs
+    m_supportsMemoryless = m_device->supportsFamily(MTL::GPUFamilyApple1);
+}
+
+RenderGraph::~RenderGraph()
+{
+    releaseTransients();
+    for (MTL::Event* event : { static_cast<MTL::Event*>(m_asyncDoneEvent), m_releaseEvent }) {
+        if (event) {
+            event->release();
+        }
+    }
+}
+
+void RenderGraph::setAsyncComputeQueue(MTL::CommandQueue* queue)
+{
+    if (queue && (!m_asyncDoneEvent || !m_releaseEvent)) {
+        std::cerr << "RenderGraph: no events for the async compute queue, keeping every pass on the frame's" << std::endl;
+        queue = nullptr;
+    }
+    if (queue != m_asyncQueue) {
+        // Nothing released for the new queue yet: the next frame keeps every pass on its own buffer
+        m_asyncQueue = queue;
+        m_releaseValue = 0;
+        m_frameEndValue = 0;
+    }
+}
+
+void RenderGraph::reset()
+{
+    m_resourceCount = 0;
+    m_passCount = 0;
+    ++m_frame;
+    trimPool();
+}
+
+RenderGraphResource RenderGraph::addResource(const char* name)
+{
+    if (m_resourceCount == static_cast<int>(m_resources.size())) {
+        m_resources.emplace_back();
+    }
+    Resource& resource = m_resources[m_resourceCount];
+    resource = Resource();
+    resource.name = name;
+    resource.poolIndex = -1;
+    return static_cast<RenderGraphResource>(m_resourceCount++);
+}
+
+RenderGraphResource RenderGraph::importTexture(const char* name, MTL::Texture* texture, bool keepContents)
+{
+    RenderGraphResource handle = addResource(name);
+    Resource& resource = m_resources[handle];
+    resource.imported = true;
+    resource.keepContents = keepContents;
+    resource.texture = texture;
+    return handle;
+}
+
+RenderGraphResource RenderGraph::importBuffer(const char* name, MTL::Buffer* buffer)
+{
+    RenderGraphResource handle = addResource(name);
+    Resource& resource = m_resources[handle];
+    resource.imported = true;
+    resource.keepContents = true;
+    resource.buffer = buffer;
+    return handle;
+}
+
+RenderGraphResource RenderGraph::importIndirectCommandBuffer(const char* name, MTL::IndirectCommandBuffer* commands)
+{
+    RenderGraphResource handle = addResource(name);
+    Resource& resource = m_resources[handle];
+    resource.imported = true;
+    resource.keepContents = true;
+    resource.commands = commands;
+    return handle;
+}
+
+RenderGraphResource RenderGraph::createTexture(const char* name, const RenderGraphTextureDesc& desc)
+{
+    RenderGraphResource handle = addResource(name);
+    Resource& resource = m_resources[handle];
+    resource.imported = false;
+    resource.keepContents = false;
+    resource.desc = desc;
+    return handle;
+}
+
+int RenderGraph::addPass(const char* name, PassType type, GpuPass timing)
+{
+    if (m_passCount == static_cast<int>(m_passes.size())) {
+        m_passes.emplace_back();
+    }
+
+    // Reused slot: the read / write lists keep their capacity, the callbacks are replaced below
+    Pass& pass = m_passes[m_passCount];
+    pass.name = name;
+    pass.type = type;
+    pass.timing = timing;
+    pass.reads.clear();
+    pass.writes.clear();
+    for (int i = 0; i < kMaxColorAttachments; ++i) {
+        pass.colors[i] = RenderGraphAttachment();
+    }
+    pass.depth = RenderGraphAttachment();
+    pass.renderWidth = 0;
+    pass.renderHeight = 0;
+    pass.rateMap = nullptr;
+    pass.live = true;
+    pass.async = false;
+    pass.onAsyncQueue = false;
+    return m_passCount++;
+}
+
+int RenderGraph::addRenderPass(const char* name, GpuPass timing, RenderExecute execute)
+{
+    int pass = addPass(name, PassTypeRender, timing);
+    m_passes[pass].renderExecute = execute;
+    return pass;
+}
+
+int RenderGraph::addParallelRenderPass(const char* name, GpuPass timing, ParallelRenderExecute execute)
+{
+    int pass = addPass(name, PassTypeParallelRender, timing);
+    m_passes[pass].parallelRenderExecute = execute;
+    return pass;
+}
+
+int RenderGraph::addComputePass(const char* name, GpuPass timing, ComputeExecute execute)
+{
+    int pass = addPass(name, PassTypeCompute, timing);
+    m_passes[pass].computeExecute = execute;
+    return pass;
+}
+
+int RenderGraph::addBlitPass(const char* name, BlitExecute execute)
+{
+    int pass = addPass(name, PassTypeBlit, GpuPassCount);
+    m_passes[pass].blitExecute = execute;
+    return pass;
+}
+
+int RenderGraph::addCommandBufferPass(const char* name, CommandBufferExecute execute)
+{
+    int pass = addPass(name, PassTypeCommandBuffer, GpuPassCount);
+    m_passes[pass].commandBufferExecute = execute;
+    return pass;
+}
+
+bool RenderGraph::isValid(RenderGraphResource resource) const
+{
+    return resource >= 0 && resource < static_cast<RenderGraphResource>(m_resourceCount);
+}
+
+void RenderGraph::setAsync(int pass)
+{
+    if (pass >= 0 && pass < m_passCount && m_passes[pass].type == PassTypeCompute) {
+        m_passes[pass].async = true;
+    }
+}
+
+void RenderGraph::read(int pass, RenderGraphResource resource)
+{
+    if (!isValid(resource)) {
+        return;
+    }
+    m_passes[pass].reads.push_back(resource);
+    m_resources[resource].needsMemory = true;
+}
+
+void RenderGraph::write(int pass, RenderGraphResource resource)
+{
+    if (!isValid(resource)) {
+        return;
+    }
+    m_passes[pass].writes.push_back(resource);
+    m_resources[resource].needsMemory = true;
+}
+
+void RenderGraph::setColorAttachment(int pass, int index, const RenderGraphAttachment& attachment)
+{
+    if (index < 0 || index >= kMaxColorAttachments || !isValid(attachment.texture)) {
+        std::cerr << "RenderGraph: invalid color attachment " << index << " for pass " << m_passes[pass].name << std::endl;
+        return;
+    }
+    m_passes[pass].colors[index] = attachment;
+    m_passes[pass].writes.push_back(attachment.texture);
+    if (isValid(attachment.resolve)) {
+        m_passes[pass].writes.push_back(attachment.resolve);
+        m_resources[attachment.resolve].needsMemory = true;
+    }
+}
+
+void RenderGraph::setDepthAttachment(int pass, const RenderGraphAttachment& attachment)
+{
+    if (!isValid(attachment.texture)) {
+        std::cerr << "RenderGraph: invalid depth attachment for pass " << m_passes[pass].name << std::endl;
+        return;
+    }
+    m_passes[pass].depth = attachment;
+    m_passes[pass].writes.push_back(attachment.texture);
+    if (isValid(attachment.resolve)) {
+        m_passes[pass].writes.push_back(attachment.resolve);
+        m_resources[attachment.resolve].needsMemory = true;
+    }
+}
+
+void RenderGraph::setRenderArea(int pass, NS::UInteger width, NS::UInteger height)
+{
+    m_passes[pass].renderWidth = width;
+    m_passes[pass].renderHeight = height;
+}
+
+void RenderGraph::setRasterizationRateMap(int pass, MTL::RasterizationRateMap* map)
+{
+    m_passes[pass].rateMap = map;
+}
+
+MTL::Texture* RenderGraph::getTexture(RenderGraphResource resource) const
+{
+    return isValid(resource) ? m_resources[resource].texture : nullptr;
+}
+
+void RenderGraph::cullPasses()
+{
+    // Walk backwards: a pass is live when it writes an imported resource or something a live pass consumes.
+    // Attachments count as consumed too, since a later pass may load them.
+    m_needed.assign(m_resourceCount, false);
+    for (int i = m_passCount - 1; i >= 0; --i) {
+        Pass& pass = m_passes[i];
+        pass.live = pass.writes.empty(); // No declared outputs: nothing to reason about, keep it
+        for (RenderGraphResource resource : pass.writes) {
+            if (m_resources[resource].imported || m_needed[resource]) {
+                pass.live = true;
+                break;
+            }
+        }
+        if (!pass.live) {
+            continue;
+        }
+        for (RenderGraphResource resource : pass.reads) {
+            m_needed[resource] = true;
+        }
+        for (RenderGraphResource resource : pass.writes) {
+            m_needed[resource] = true;
+        }
+    }
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (int i = 0; i < m_resourceCount; ++i) {
+        m_resources[i].firstUse = -1;
+        m_resources[i].lastUse = -1;
+        m_resources[i].useCount = 0;
+    }
+
+    for (int i = 0; i < m_passCount; ++i) {
+        const Pass& pass = m_passes[i];
+        if (!pass.live) {
+            continue;
+        }
+        m_used.assign(pass.reads.begin(), pass.reads.end());
+        m_used.insert(m_used.end(), pass.writes.begin(), pass.writes.end());
+        std::sort(m_used.begin(), m_used.end());
+        m_used.erase(std::unique(m_used.begin(), m_used.end()), m_used.end());
+
+        for (RenderGraphResource index : m_used) {
+            Resource& resource = m_resources[index];
+            if (resource.firstUse < 0) {
+                resource.firstUse = i;
+            }
+            resource.lastUse = i;
+            resource.useCount++;
+        }
+    }
+}
+
+bool RenderGraph::acquireTransient(Resource& resource)
+{
+    // Only lives inside one render pass and is never sampled: keep it in tile memory
+    bool memoryless = m_supportsMemoryless && resource.useCount == 1 && !resource.needsMemory;
+    const RenderGraphTextureDesc& desc = resource.desc;
+
+    for (size_t i = 0; i < m_pool.size(); ++i) {
+        PooledTexture& pooled = m_pool[i];
+        if (pooled.inUse || pooled.memoryless != memoryless ||
+            pooled.desc.width != desc.width || pooled.desc.height != desc.height ||
+            pooled.desc.pixelFormat != desc.pixelFormat || pooled.desc.sampleCount != desc.sampleCount ||
+            pooled.desc.usage != desc.usage) {
+            continue;
+        }
+        pooled.inUse = true;
+        pooled.lastUsedFrame = m_frame;
+        resource.texture = pooled.texture;
+        resource.poolIndex = static_cast<int>(i);
+        return true;
+    }
+
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setWidth(desc.width);
+    descriptor->setHeight(desc.height);
+    descriptor->setPixelFormat(desc.pixelFormat);
+    descriptor->setTextureType(desc.sampleCount > 1 ? MTL::TextureType2DMultisample : MTL::TextureType2D);
+    descriptor->setSampleCount(desc.sampleCount);
+    descriptor->setUsage(MTL::TextureUsageRenderTarget | desc.usage);
+
+    // Memoryless textures take no memory; everything else goes into the shared heap so a
+    // resize reuses the space of the textures it replaces
+    MTL::Texture* texture = nullptr;
+    if (memoryless) {
+        descriptor->setStorageMode(MTL::StorageModeMemoryless);
+        texture = m_device->newTexture(descriptor);
+    } else if (m_heap) {
+        texture = m_heap->newTexture(descriptor);
+    } else {
+        descriptor->setStorageMode(MTL::StorageModePrivate);
+        texture = m_device->newTexture(descriptor);
+    }
+    descriptor->release();
+    if (!texture) {
+        std::cerr << "RenderGraph: failed to allocate transient texture " << resource.name << std::endl;
+        return false;
+    }
+
+    PooledTexture pooled;
+    pooled.desc = desc;
+    pooled.memoryless = memoryless;
+    pooled.texture = texture;
+    pooled.inUse = true;
+    pooled.lastUsedFrame = m_frame;
+    m_pool.push_back(pooled);
+
+    resource.texture = texture;
+    resource.poolIndex = static_cast<int>(m_pool.size() - 1);
+    return true;
+}
+
+void RenderGraph::releaseTransient(Resource& resource)
+{
+    // Later passes of this frame may alias the texture
+    if (resource.poolIndex >= 0) {
+        m_pool[resource.poolIndex].inUse = false;
+        resource.poolIndex = -1;
+    }
+}
+
+void RenderGraph::trimPool()
+{
+    for (size_t i = 0; i < m_pool.size();) {
+        if (!m_pool[i].inUse && m_frame - m_pool[i].lastUsedFrame > kPoolUnusedFramesBeforeRelease) {
+            m_pool[i].texture->release();
+            m_pool.erase(m_pool.begin() + static_cast<std::ptrdiff_t>(i));
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RenderGraph::releaseTransients()
+{
+    for (PooledTexture& pooled : m_pool) {
+        pooled.texture->release();
+    }
+    m_pool.clear();
+}
+
+MTL::RenderPassDescriptor* RenderGraph::passDescriptor(int renderPassIndex)
+{
+    while (static_cast<int>(m_passDescriptors.size()) <= renderPassIndex) {
+        m_passDescriptors.push_back(NS::TransferPtr(MTL::RenderPassDescriptor::alloc()->init()));
+    }
+
+    // Reset what an earlier pass in this slot may have set (encoders copy the descriptor, so
+    // last frame's command buffer does not care)
+    MTL::RenderPassDescriptor* descriptor = m_passDescriptors[renderPassIndex].get();
+    for (int i = 0; i < kMaxColorAttachments; ++i) {
+        MTL::RenderPassColorAttachmentDescriptor* color = descriptor->colorAttachments()->object(i);
+        color->setTexture(nullptr);
+        color->setResolveTexture(nullptr);
+    }
+    descriptor->depthAttachment()->setTexture(nullptr);
+    descriptor->depthAttachment()->setResolveTexture(nullptr);
+    descriptor->setRenderTargetWidth(0);
+    descriptor->setRenderTargetHeight(0);
+    descriptor->setRasterizationRateMap(nullptr);
+    descriptor->sampleBufferAttachments()->object(0)->setSampleBuffer(nullptr);
+    return descriptor;
+}
+
+void RenderGraph::configureAttachment(MTL::RenderPassAttachmentDescriptor* descriptor, const RenderGraphAttachment& attachment,
+                                      int passIndex)
+{
+    const Resource& resource = m_resources[attachment.texture];
+    descriptor->setTexture(resource.texture);
+
+    // Load only what an earlier pass (or an earlier frame) left behind
+    if (m_hasContents[attachment.texture]) {
+        descriptor->setLoadAction(MTL::LoadActionLoad);
+    } else {
+        descriptor->setLoadAction(attachment.clear ? MTL::LoadActionClear : MTL::LoadActionDontCare);
+    }
+
+    // Store only what a later pass (or the outside world) will look at
+    bool neededLater = resource.imported || resource.lastUse > passIndex;
+    if (isValid(attachment.resolve)) {
+        descriptor->setResolveTexture(m_resources[attachment.resolve].texture);
+        descriptor->setStoreAction(neededLater ? MTL::StoreActionStoreAndMultisampleResolve : MTL::StoreActionMultisampleResolve);
+        m_hasContents[attachment.resolve] = true;
+    } else {
+        descriptor->setStoreAction(neededLater ? MTL::StoreActionStore : MTL::StoreActionDontCare);
+    }
+    m_hasContents[attachment.texture] = neededLater;
+}
+
+void RenderGraph::encodePass(MTL::CommandBuffer* commandBuffer, int passIndex, int renderPassIndex)
+{
+    Pass& pass = m_passes[passIndex];
+    bool timed = m_profiler && pass.timing != GpuPassCount;
+    // Names the encoder in the per-encoder status of a failed command buffer
+    NS::String* label = m_breadcrumbs ? NS::String::string(pass.name, NS::UTF8StringEncoding) : nullptr;
+
+    if (pass.type == PassTypeRender || pass.type == PassTypeParallelRender) {
+        MTL::RenderPassDescriptor* descriptor = passDescriptor(renderPassIndex);
+        for (int i = 0; i < kMaxColorAttachments; ++i) {
+            const RenderGraphAttachment& attachment = pass.colors[i];
+            if (!isValid(attachment.texture)) {
+                continue;
+            }
+            MTL::RenderPassColorAttachmentDescriptor* color = descriptor->colorAttachments()->object(i);
+            configureAttachment(color, attachment, passIndex);
+            color->setClearColor(attachment.clearColor);
+        }
+        if (isValid(pass.depth.texture)) {
+            MTL::RenderPassDepthAttachmentDescriptor* depth = descriptor->depthAttachment();
+            configureAttachment(depth, pass.depth, passIndex);
+            depth->setClearDepth(pass.depth.clearDepth);
+        }
+        if (pass.renderWidth > 0 && pass.renderHeight > 0) {
+            descriptor->setRenderTargetWidth(pass.renderWidth);
+            descriptor->setRenderTargetHeight(pass.renderHeight);
+        }
+        if (pass.rateMap) {
+            descriptor->setRasterizationRateMap(pass.rateMap);
+        }
+        if (timed) {
+            m_profiler->attachRenderPass(descriptor, pass.timing);
+        }
+
+        if (pass.type == PassTypeParallelRender) {
+            MTL::ParallelRenderCommandEncoder* encoder = commandBuffer->parallelRenderCommandEncoder(descriptor);
+            if (encoder) {
+                if (label) {
+                    encoder->setLabel(label);
+                }
+                pass.parallelRenderExecute(encoder, descriptor);
+                encoder->endEncoding();
+            }
+        } else {
+            MTL::RenderCommandEncoder* encoder = commandBuffer->renderCommandEncoder(descriptor);
+            if (encoder) {
+                if (label) {
+                    encoder->setLabel(label);
+                }
+                pass.renderExecute(encoder, descriptor);
+                encoder->endEncoding();
+            }
+        }
+    } else if (pass.type == PassTypeCompute) {
+        MTL::ComputeCommandEncoder* encoder = timed ? m_profiler->computeEncoder(commandBuffer, pass.timing)
+                                                    : commandBuffer->computeCommandEncoder();
+        if (encoder) {
+            if (label) {
+                encoder->setLabel(label);
+            }
+            pass.computeExecute(encoder);
+            encoder->endEncoding();
+        }
+    } else if (pass.type == PassTypeBlit) {
+        MTL::BlitCommandEncoder* encoder = commandBuffer->blitCommandEncoder();
+        if (encoder) {
+            if (label) {
+                encoder->setLabel(label);
+            }
+            pass.blitExecute(encoder);
+            encoder->endEncoding();
+        }
+    } else {
+        pass.commandBufferExecute(commandBuffer);
+    }
+
+    for (RenderGraphResource resource : pass.writes) {
+        if (m_resources[resource].needsMemory) {
+            m_hasContents[resource] = true; // Written by a shader or resolved into
+        }
+    }
+}
+
+const MTL::Resource* RenderGraph::gpuResource(RenderGraphResource resource) const
+{
+    const Resource& entry = m_resources[resource];
+    if (entry.texture) {
+        return entry.texture;
+    }
+    return entry.buffer ? static_cast<const MTL::Resource*>(entry.buffer) : entry.commands;
+}
+
+bool RenderGraph::contains(const std::vector<const MTL::Resource*>& resources, const MTL::Resource* resource)
+{
+    return std::find(resources.begin(), resources.end(), resource) != resources.end();
+}
+
+bool RenderGraph::conflicts(const Pass& pass, const AccessList& other) const
+{
+    // Writes against anything the other side touched, reads against what it wrote
+    for (RenderGraphResource resource : pass.writes) {
+        if (contains(other.touched, gpuResource(resource))) {
+            return true;
+        }
+    }
+    for (RenderGraphResource resource : pass.reads) {
+        if (contains(other.written, gpuResource(resource))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RenderGraph::collectAccesses(const Pass& pass, AccessList& accesses) const
+{
+    for (const std::vector<RenderGraphResource>* list : { &pass.reads, &pass.writes }) {
+        for (RenderGraphResource resource : *list) {
+            const MTL::Resource* gpu = gpuResource(resource);
+            if (gpu && !contains(accesses.touched, gpu)) {
+                accesses.touched.push_back(gpu);
+            }
+            if (gpu && list == &pass.writes && !contains(accesses.written, gpu)) {
+                accesses.written.push_back(gpu);
+            }
+        }
+    }
+}
+
+bool RenderGraph::remember(const std::vector<const MTL::Resource*>& resources, std::vector<const MTL::Resource*>& known)
+{
+    bool allKnown = true;
+    for (const MTL::Resource* resource : resources) {
+        if (!std::binary_search(known.begin(), known.end(), resource)) {
+            known.insert(std::upper_bound(known.begin(), known.end(), resource), resource);
+            allKnown = false;
+        }
+    }
+    return allKnown;
+}
+
+MTL::CommandBuffer* RenderGraph::splitAsyncPasses()
+{
+    m_asyncWaitPass = -1;
+    m_releasePass = -1;
+    for (int i = 0; i < m_passCount; ++i) {
+        m_passes[i].onAsyncQueue = false;
+    }
+    if (!m_asyncQueue) {
+        return nullptr;
+    }
+
+    // An async pass writing what an earlier pass of the frame's buffer touched, or reading what
+    // it wrote, would race it, so it stays there; later passes then see it as a frame pass too.
+    // Shared reads are no hazard. Without last frame's release (first frame on this queue) or
+    // when held, everything stays.
+    m_mainAccesses.touched.clear();
+    m_mainAccesses.written.clear();
+    m_asyncAccesses.touched.clear();
+    m_asyncAccesses.written.clear();
+    bool anyAsync = false;
+    for (int i = 0; i < m_passCount; ++i) {
+        Pass& pass = m_passes[i];
+        if (!pass.live) {
+            continue;
+        }
+        bool async = pass.async && m_releaseValue != 0 && !m_holdAsync && !conflicts(pass, m_mainAccesses);
+        for (const std::vector<RenderGraphResource>* list : { &pass.reads, &pass.writes }) {
+            for (RenderGraphResource resource : *list) {
+                async = async && m_resources[resource].imported && gpuResource(resource);
+            }
+        }
+        pass.onAsyncQueue = async;
+        collectAccesses(pass, async ? m_asyncAccesses : m_mainAccesses);
+        anyAsync = anyAsync || async;
+    }
+
+    MTL::CommandBuffer* asyncCommandBuffer = nullptr;
+    if (anyAsync) {
+        // Same error reporting as the frame's command buffer (see GpuBreadcrumbs)
+        asyncCommandBuffer = m_breadcrumbs ? m_asyncQueue->commandBuffer(m_breadcrumbs->getCommandBufferDescriptor())
+                                           : m_asyncQueue->commandBuffer();
+    }
+    if (anyAsync && !asyncCommandBuffer) {
+        std::cerr << "RenderGraph: failed to create the async compute command buffer" << std::endl;
+        for (int i = 0; i < m_passCount; ++i) {
+            m_passes[i].onAsyncQueue = false;
+        }
+        anyAsync = false;
+    }
+
+    if (asyncCommandBuffer) {
+        // Accesses no async pass made before were not covered by last frame's release: wait for
+        // the end of last frame instead
+        bool known = remember(m_asyncAccesses.touched, m_asyncResources.touched);
+        known = remember(m_asyncAccesses.written, m_asyncResources.written) && known;
+        asyncCommandBuffer->setLabel(NS::String::string("Async compute", NS::UTF8StringEncoding));
+        asyncCommandBuffer->encodeWait(m_releaseEvent, known ? m_releaseValue : m_frameEndValue);
+    }
+
+    for (int i = 0; i < m_passCount; ++i) {
+        const Pass& pass = m_passes[i];
+        if (!pass.live || pass.onAsyncQueue) {
+            continue;
+        }
+        if (m_asyncWaitPass < 0 && anyAsync && conflicts(pass, m_asyncAccesses)) {
+            m_asyncWaitPass = i;
+        }
+        if (conflicts(pass, m_asyncResources)) {
+            m_releasePass = i;
+        }
+    }
+    return asyncCommandBuffer;
+}
+
+void RenderGraph::execute(MTL::CommandBuffer* commandBuffer)
+{
+    cullPasses();
+    computeLifetimes();
+    MTL::CommandBuffer* asyncCommandBuffer = splitAsyncPasses();
+    m_holdAsync = false;
+    uint64_t asyncDoneValue = asyncCommandBuffer ? ++m_eventValue : 0;
+    uint64_t releaseValue = m_asyncQueue ? ++m_eventValue : 0;
+
+    m_hasContents.assign(m_resourceCount, false);
+    for (int i = 0; i < m_resourceCount; ++i) {
+        m_hasContents[i] = m_resources[i].imported && m_resources[i].keepContents;
+    }
+
+    if (m_asyncQueue && m_releasePass < 0) {
+        commandBuffer->encodeSignalEvent(m_releaseEvent, releaseValue);
+    }
+    int renderPassIndex = 0;
+    for (int i = 0; i < m_passCount; ++i) {
+        if (!m_passes[i].live) {
+            continue;
+        }
+
+        // Transients come out of the pool just before their first pass
+        bool ready = true;
+        for (int r = 0; r < m_resourceCount; ++r) {
+            Resource& resource = m_resources[r];
+            if (!resource.imported && resource.firstUse == i && !acquireTransient(resource)) {
+                ready = false;
+            }
+        }
+
+        for (RenderGraphResource resource : m_passes[i].reads) {
+            if (!m_hasContents[resource]) {
+                std::cerr << "RenderGraph: pass " << m_passes[i].name << " reads " << m_resources[resource].name
+                          << " before it is written" << std::endl;
+            }
+        }
+
+        if (i == m_asyncWaitPass) {
+            commandBuffer->encodeWait(m_asyncDoneEvent, asyncDoneValue);
+        }
+        if (ready && m_passes[i].onAsyncQueue) {
+            if (m_breadcrumbs) {
+                m_breadcrumbs->markPass(asyncCommandBuffer, m_passes[i].name, GpuBreadcrumbs::LaneAsync);
+            }
+            encodePass(asyncCommandBuffer, i, renderPassIndex);
+        } else if (ready) {
+            if (m_breadcrumbs) {
+                m_breadcrumbs->markPass(commandBuffer, m_passes[i].name);
+            }
+            encodePass(commandBuffer, i, renderPassIndex);
+            if (m_passes[i].type == PassTypeRender || m_passes[i].type == PassTypeParallelRender) {
+                ++renderPassIndex;
+            }
+        } else {
+            std::cerr << "RenderGraph: skipping pass " << m_passes[i].name << std::endl;
+        }
+        if (i == m_releasePass) {
+            commandBuffer->encodeSignalEvent(m_releaseEvent, releaseValue);
+        }
+
+        // ...and go back right after their last one
+        for (int r = 0; r < m_resourceCount; ++r) {
+            Resource& resource = m_resources[r];
+            if (!resource.imported && resource.lastUse == i) {
+                releaseTransient(resource);
+            }
+        }
+    }
+    if (m_breadcrumbs) {
+        m_breadcrumbs->endPasses(commandBuffer);
+    }
+
+    if (asyncCommandBuffer && m_asyncWaitPass < 0) {
+        // Nothing of the frame depends on the async passes, but its completion still has to
+        // cover them (frame slot reuse)
+        commandBuffer->encodeWait(m_asyncDoneEvent, asyncDoneValue);
+    }
+    if (m_asyncQueue) {
+        m_releaseValue = releaseValue;
+        m_frameEndValue = ++m_eventValue;
+        commandBuffer->encodeSignalEvent(m_releaseEvent, m_frameEndValue);
+    }
+    if (asyncCommandBuffer) {
+        // Committed ahead of the frame's command buffer, which waits for it. A failed async
+        // command buffer never signals: release the frame from the CPU so it fails or finishes
+        // on its own instead of hanging on the wait.
+        if (m_breadcrumbs) {
+            m_breadcrumbs->endPasses(asyncCommandBuffer, GpuBreadcrumbs::LaneAsync);
+            m_breadcrumbs->watch(asyncCommandBuffer, GpuBreadcrumbs::LaneAsync);
+        }
+        MTL::SharedEvent* doneEvent = m_asyncDoneEvent;
+        asyncCommandBuffer->addCompletedHandler([doneEvent, asyncDoneValue](MTL::CommandBuffer* completed) {
+            if (completed->status() == MTL::CommandBufferStatusError && doneEvent->signaledValue() < asyncDoneValue) {
+                doneEvent->setSignaledValue(asyncDoneValue);
+            }
+        });
+        asyncCommandBuffer->encodeSignalEvent(m_asyncDoneEvent, asyncDoneValue);
+        if (m_profiler) {
+            m_profiler->addAsyncCommandBuffer(asyncCommandBuffer);
+        }
+        asyncCommandBuffer->commit();
+    }
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include <Foundation/NSSharedPtr.hpp>
+#include <Metal/Metal.hpp>
+#include "GpuBreadcrumbs.hpp"
+#include "GpuProfiler.hpp"
+#include "RenderTargetHeap.hpp"
+#include <functional>
+#include <vector>
+
+// Handle to a resource declared in the current frame's graph (-1 = none)
+typedef int RenderGraphResource;
+static constexpr RenderGraphResource kRenderGraphNone = -1;
+
+// Transient texture request; the graph allocates it from its pool for the passes that use it
+struct RenderGraphTextureDesc {
+    NS::UInteger width;
+    NS::UInteger height;
+    MTL::PixelFormat pixelFormat;
+    NS::UInteger sampleCount;
+    MTL::TextureUsage usage;      // Render target usage is implied
+};
+
+// Attachment of a render pass. Load/store actions are not given here: the graph picks them
+// from what earlier and later passes do with the texture.
+struct RenderGraphAttachment {
+    RenderGraphResource texture = kRenderGraphNone;
+    RenderGraphResource resolve = kRenderGraphNone; // MSAA resolve target
+    bool clear = true;            // Clear when the texture has no contents yet (false = fully overwritten, DontCare)
+    MTL::ClearColor clearColor = MTL::ClearColor(0.0, 0.0, 0.0, 1.0);
+    double clearDepth = 1.0;
+};
+
+// Small frame graph: passes declare the resources they read and write, the graph culls passes
+// whose results are never used, places transient attachments in a texture pool (memoryless when
+// they live inside a single render pass, otherwise sub-allocated from the render target heap)
+// and derives load/store actions. Passes run in declaration order. Pass and resource slots, the
+// bookkeeping arrays and one render pass descriptor per render pass are kept across frames, so a
+// frame with the same passes as the last one reuses them instead of rebuilding the graph (the
+// pass callbacks' std::function captures may still allocate).
+// With an async compute queue, compute passes marked setAsync() without a hazard (a write
+// against any access, a read against a write) on an earlier pass of the frame's command buffer
+// go into one command buffer of that queue instead, so they overlap the frame's independent
+// passes and the tail of the previous frame.
+class RenderGraph {
+public:
+    typedef std::function<void(MTL::RenderCommandEncoder*, MTL::RenderPassDescriptor*)> RenderExecute;
+    typedef std::function<void(MTL::ParallelRenderCommandEncoder*, MTL::RenderPassDescriptor*)> ParallelRenderExecute;
+    typedef std::function<void(MTL::ComputeCommandEncoder*)> ComputeExecute;
+    typedef std::function<void(MTL::BlitCommandEncoder*)> BlitExecute;
+    typedef std::function<void(MTL::CommandBuffer*)> CommandBufferExecute;
+
+    RenderGraph(MTL::Device* device, GpuProfiler* profiler, RenderTargetHeap* heap);
+    ~RenderGraph();
+
+    // Forget the previous frame's passes and resources (pooled textures and slots are kept)
+    void reset();
+
+    // Imported resources outlive the frame, so their final contents are always stored.
+    // keepContents: the texture holds meaningful data from earlier frames (loaded, not cleared).
+    RenderGraphResource importTexture(const char* name, MTL::Texture* texture, bool keepContents);
+    RenderGraphResource importBuffer(const char* name, MTL::Buffer* buffer);
+    RenderGraphResource importIndirectCommandBuffer(const char* name, MTL::IndirectCommandBuffer* commands);
+    RenderGraphResource createTexture(const char* name, const RenderGraphTextureDesc& desc);
+
+    // Pass creation; timing = GpuPassCount leaves the pass untimed
+    int addRenderPass(const char* name, GpuPass timing, RenderExecute execute);
+    // Render pass encoded through sub-encoders (created in execution order, filled on any thread)
+    int addParallelRenderPass(const char* name, GpuPass timing, ParallelRenderExecute execute);
+    int addComputePass(const char* name, GpuPass timing, ComputeExecute execute);
+    int addBlitPass(const char* name, BlitExecute execute);
+    // Work that creates its own encoders (e.g. MetalFX scalers); untimed
+    int addCommandBufferPass(const char* name, CommandBufferExecute execute);
+
+    // Pass declarations (shader reads/writes; attachments are declared separately)
+    void read(int pass, RenderGraphResource resource);
+    void write(int pass, RenderGraphResource resource);
+    void setColorAttachment(int pass, int index, const RenderGraphAttachment& attachment);
+    void setDepthAttachment(int pass, const RenderGraphAttachment& attachment);
+    // Compute pass that may run on the async compute queue: all its resources must be declared
+    // and imported (anything else keeps it on the frame's command buffer)
+    void setAsync(int pass);
+    // Render only the top-left width x height region of the attachments (dynamic resolution)
+    void setRenderArea(int pass, NS::UInteger width, NS::UInteger height);
+    // Rasterize through a rate map (variable rasterization rate): the attachments hold the
+    // map's physical layout, not screen pixels
+    void setRasterizationRateMap(int pass, MTL::RasterizationRateMap* map);
+
+    // Texture behind a handle (transients are only valid inside the passes that use them)
+    MTL::Texture* getTexture(RenderGraphResource resource) const;
+
+    // Cull, allocate transients and encode every live pass into the command buffer (the async
+    // passes into a command buffer of the async queue, committed here before commandBuffer is)
+    void execute(MTL::CommandBuffer* commandBuffer);
+
+    // Queue of the passes marked setAsync() (not retained; null = all passes on the frame's
+    // command buffer). The frame's first pass with a hazard against the async passes waits for
+    // them; its last pass with a hazard against anything an async pass ever accessed releases
+    // them to the next frame's async passes, which run as soon as that point is reached instead of waiting for the
+    // whole previous frame. Resources are compared by MTL object, not by handle.
+    void setAsyncComputeQueue(MTL::CommandQueue* queue);
+    // This frame keeps every pass on its command buffer, e.g. behind uploads of async pass
+    // inputs committed to the frame's queue outside the graph
+    void holdAsyncPasses() { m_holdAsync = true; }
+
+    // Release pooled textures (e.g. after a resize made them the wrong size)
+    void releaseTransients();
+
+    // Encoders are labelled with their pass names and the passes wrapped in breadcrumb markers
+    // (when enabled); null = neither
+    void setBreadcrumbs(GpuBreadcrumbs* breadcrumbs) { m_breadcrumbs = breadcrumbs; }
+
+private:
+    static constexpr int kMaxColorAttachments = 5;
+    static constexpr int kPoolUnusedFramesBeforeRelease = 8;
+
+    enum PassType { PassTypeRender, PassTypeParallelRender, PassTypeCompute, PassTypeBlit, PassTypeCommandBuffer };
+
+    struct Resource {
+        const char* name;         // String literal (kept, not copied)
+        bool imported;
+        bool keepContents;
+        MTL::Texture* texture;
+        MTL::Buffer* buffer;
+        MTL::IndirectCommandBuffer* commands;
+        RenderGraphTextureDesc desc;
+        int firstUse;             // First / last live pass touching the resource
+        int lastUse;
+        int useCount;             // Live passes touching the resource
+        bool needsMemory;         // Accessed by shaders or resolved into, so it cannot be memoryless
+        int poolIndex;
+    };
+
+    struct Pass {
+        const char* name;
+        PassType type;
+        GpuPass timing;
+        RenderExecute renderExecute;
+        ParallelRenderExecute parallelRenderExecute;
+        ComputeExecute computeExecute;
+        BlitExecute blitExecute;
+        CommandBufferExecute commandBufferExecute;
+        std::vector<RenderGraphResource> reads;
+        std::vector<RenderGraphResource> writes; // Includes attachments and resolve targets
+        RenderGraphAttachment colors[kMaxColorAttachments];
+        RenderGraphAttachment depth;
+        NS::UInteger renderWidth;   // 0 = full attachment size
+        NS::UInteger renderHeight;
+        MTL::RasterizationRateMap* rateMap; // Not retained: the caller keeps it alive for the frame
+        bool live;
+        bool async;                 // setAsync()
+        bool onAsyncQueue;          // Encoded into the async command buffer this frame
+    };
+
+    // Resources a set of passes touched (read or wrote) and wrote, by MTL object
+    struct AccessList {
+        std::vector<const MTL::Resource*> touched;
+        std::vector<const MTL::Resource*> written;
+    };
+
+    struct PooledTexture {
+        RenderGraphTextureDesc desc;
+        bool memoryless;
+        MTL::Texture* texture;
+        bool inUse;
+        uint64_t lastUsedFrame;
+    };
+
+    int addPass(const char* name, PassType type, GpuPass timing);
+    RenderGraphResource addResource(const char* name);
+    MTL::RenderPassDescriptor* passDescriptor(int renderPassIndex);
+    bool isValid(RenderGraphResource resource) const;
+    void cullPasses();
+    void computeLifetimes();
+    bool acquireTransient(Resource& resource);
+    void releaseTransient(Resource& resource);
+    void trimPool();
+    void configureAttachment(MTL::RenderPassAttachmentDescriptor* descriptor, const RenderGraphAttachment& attachment,
+                             int passIndex);
+    void encodePass(MTL::CommandBuffer* commandBuffer, int passIndex, int renderPassIndex);
+    const MTL::Resource* gpuResource(RenderGraphResource resource) const;
+    static bool contains(const std::vector<const MTL::Resource*>& resources, const MTL::Resource* resource);
+    bool conflicts(const Pass& pass, const AccessList& other) const;
+    void collectAccesses(const Pass& pass, AccessList& accesses) const;
+    // Add resources to the sorted known list; true when all of them were in it already
+    static bool remember(const std::vector<const MTL::Resource*>& resources, std::vector<const MTL::Resource*>& known);
+    MTL::CommandBuffer* splitAsyncPasses();
+
+    MTL::Device* m_device;
+    GpuProfiler* m_profiler;
+    GpuBreadcrumbs* m_breadcrumbs;
+    RenderTargetHeap* m_heap;
+    bool m_supportsMemoryless;
+    // Slots beyond the counts are last frames' declarations, reused by the next add*() calls
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    int m_resourceCount;
+    int m_passCount;
+    std::vector<PooledTexture> m_pool;
+    std::vector<NS::SharedPtr<MTL::RenderPassDescriptor>> m_passDescriptors; // By render pass order
+    std::vector<bool> m_needed;       // Scratch of cullPasses()
+    std::vector<bool> m_hasContents;  // Per resource while executing
+    std::vector<RenderGraphResource> m_used; // Scratch of computeLifetimes()
+    uint64_t m_frame;
+
+    // Async compute (see setAsyncComputeQueue())
+    MTL::CommandQueue* m_asyncQueue;
+    MTL::SharedEvent* m_asyncDoneEvent; // Signalled by the async command buffer (or the CPU when it fails), waited for by the frame's
+    MTL::Event* m_releaseEvent;      // Signalled by the frame's command buffer, waited for by the next async one
+    uint64_t m_eventValue;           // Last value handed out (both events only grow)
+    uint64_t m_releaseValue;         // Last frame's release and end signals (0 = none yet)
+    uint64_t m_frameEndValue;
+    int m_asyncWaitPass;             // This frame's first pass waiting for the async passes (-1 = none)
+    int m_releasePass;               // This frame's last pass conflicting with m_asyncResources (-1 = none)
+    bool m_holdAsync;                // holdAsyncPasses() since the last execute()
+    AccessList m_asyncResources;     // Ever accessed by an async pass (sorted)
+    AccessList m_asyncAccesses;      // Scratch of splitAsyncPasses(): this frame's async passes...
+    AccessList m_mainAccesses;       // ...and the frame's passes so far
+};
@@ -0,0 +1,269 @@
+#include "RenderSettings.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+static const char* const kQualityNames[RenderSettings::QualityCount] = { "low", "medium", "high", "ultra" };
+
+static std::string trim(const std::string& text)
+{
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+static bool parseInt(const std::string& value, int& out)
+{
+    char* end = nullptr;
+    long parsed = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0') {
+        return false;
+    }
+    out = static_cast<int>(parsed);
+    return true;
+}
+
+static bool parseFloat(const std::string& value, float& out)
+{
+    char* end = nullptr;
+    float parsed = std::strtof(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+        return false;
+    }
+    out = parsed;
+    return true;
+}
+
+static bool parseBool(const std::string& value, bool& out)
+{
+    if (value == "1" || value == "true" || value == "on") {
+        out = true;
+        return true;
+    }
+    if (value == "0" || value == "false" || value == "off") {
+        out = false;
+        return true;
+    }
+    return false;
+}
+
+RenderSettings RenderSettings::preset(Quality quality)
+{
+    // High is the default-constructed settings; the others scale the per-blade and per-pixel
+    // costs down (fewer, coarser blades, TAA instead of MSAA, lean half-precision shading, a
+    // smaller trample map) or up (denser field, farther LODs and cards, blade springs)
+    RenderSettings settings;
+    settings.quality = quality;
+    switch (quality) {
+    case QualityLow:
+        settings.bladesPerCell = 48;
+        settings.bladeSegments = 4;
+        settings.lodDistances[0] = 6.0f;
+        settings.lodDistances[1] = 13.0f;
+        settings.lodFadeWidth = 1.0f;
+        settings.densityLodDistance = 6.0f;
+        settings.impostorDistance = 14.0f;
+        settings.sampleCount = 2; // When TAA is turned off
+        settings.temporalAntialiasing = true;
+        settings.halfPrecision = true;
+        settings.contactShadows = false;
+        settings.translucency = false;
+        settings.windSheen = false;
+        settings.shadowMaps = false;
+        settings.fogStartDistance = 9.0f;
+        settings.fogEndDistance = 30.0f;
+        settings.trampleMapSize = 512;
+        settings.simulationScale = 0.5f;
+        break;
+    case QualityMedium:
+        settings.bladesPerCell = 80;
+        settings.bladeSegments = 5;
+        settings.lodDistances[0] = 7.0f;
+        settings.lodDistances[1] = 15.0f;
+        settings.lodFadeWidth = 1.25f;
+        settings.densityLodDistance = 8.0f;
+        settings.impostorDistance = 17.0f;
+        settings.halfPrecision = true;
+        settings.windSheen = false;
+        settings.fogStartDistance = 11.0f;
+        settings.fogEndDistance = 35.0f;
+        break;
+    case QualityUltra:
+        settings.bladesPerCell = 200;
+        settings.lodDistances[0] = 10.0f;
+        settings.lodDistances[1] = 24.0f;
+        settings.lodFadeWidth = 2.0f;
+        settings.densityLodDistance = 14.0f;
+        settings.impostorDistance = 28.0f;
+        settings.fogStartDistance = 14.0f;
+        settings.fogEndDistance = 48.0f;
+        settings.trampleMapSize = 2048;
+        settings.bladePhysicsRadius = 8.0f;
+        break;
+    default:
+        settings.quality = QualityHigh;
+        break;
+    }
+    return settings;
+}
+
+const char* RenderSettings::qualityName(Quality quality)
+{
+    return quality >= 0 && quality < QualityCount ? kQualityNames[quality] : "custom";
+}
+
+bool RenderSettings::parseQuality(const std::string& name, Quality& quality)
+{
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (int i = 0; i < QualityCount; ++i) {
+        if (lower == kQualityNames[i]) {
+            quality = static_cast<Quality>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RenderSettings::set(const std::string& key, const std::string& value)
+{
+    // Parsed into a copy, so a rejected value leaves every field as it was
+    RenderSettings next = *this;
+    bool parsed = false;
+    if (key == "quality") {
+        Quality quality;
+        parsed = parseQuality(value, quality);
+        if (parsed) {
+            next = preset(quality);
+        }
+    } else if (key == "bladesPerCell") {
+        parsed = parseInt(value, next.bladesPerCell) && next.bladesPerCell >= 1;
+    } else if (key == "bladeSegments") {
+        parsed = parseInt(value, next.bladeSegments) && next.bladeSegments >= 1;
+    } else if (key == "lodDistance0") {
+        parsed = parseFloat(value, next.lodDistances[0]) && next.lodDistances[0] > 0.0f;
+    } else if (key == "lodDistance1") {
+        parsed = parseFloat(value, next.lodDistances[1]) && next.lodDistances[1] > 0.0f;
+    } else if (key == "lodFadeWidth") {
+        parsed = parseFloat(value, next.lodFadeWidth) && next.lodFadeWidth >= 0.0f;
+    } else if (key == "densityLodDistance") {
+        parsed = parseFloat(value, next.densityLodDistance) && next.densityLodDistance >= 0.0f;
+    } else if (key == "impostors") {
+        parsed = parseBool(value, next.impostors);
+    } else if (key == "impostorDistance") {
+        parsed = parseFloat(value, next.impostorDistance) && next.impostorDistance > 0.0f;
+    } else if (key == "sampleCount") {
+        parsed = parseInt(value, next.sampleCount) && (next.sampleCount == 1 || next.sampleCount == 2 ||
+                                                        next.sampleCount == 4 || next.sampleCount == 8);
+    } else if (key == "temporalAntialiasing") {
+        parsed = parseBool(value, next.temporalAntialiasing);
+    } else if (key == "renderScale") {
+        parsed = parseFloat(value, next.renderScale) && next.renderScale >= 0.5f && next.renderScale <= 1.0f;
+    } else if (key == "halfPrecision") {
+        parsed = parseBool(value, next.halfPrecision);
+    } else if (key == "contactShadows") {
+        parsed = parseBool(value, next.contactShadows);
+    } else if (key == "translucency") {
+        parsed = parseBool(value, next.translucency);
+    } else if (key == "windSheen") {
+        parsed = parseBool(value, next.windSheen);
+    } else if (key == "shadowMaps") {
+        parsed = parseBool(value, next.shadowMaps);
+    } else if (key == "fogStartDistance") {
+        parsed = parseFloat(value, next.fogStartDistance) && next.fogStartDistance >= 0.0f;
+    } else if (key == "fogEndDistance") {
+        parsed = parseFloat(value, next.fogEndDistance) && next.fogEndDistance > 0.0f;
+    } else if (key == "trampleMapSize") {
+        parsed = parseInt(value, next.trampleMapSize) && next.trampleMapSize >= 256 && next.trampleMapSize <= 4096
+            && (next.trampleMapSize & (next.trampleMapSize - 1)) == 0;
+    } else if (key == "bladePhysicsRadius") {
+        parsed = parseFloat(value, next.bladePhysicsRadius) && next.bladePhysicsRadius >= 0.0f;
+    } else if (key == "simulationScale") {
+        parsed = parseFloat(value, next.simulationScale) && next.simulationScale > 0.0f;
+    }
+    if (!parsed) {
+        return false;
+    }
+    *this = next;
+    return true;
+}
+
+bool RenderSettings::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open render settings " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        size_t equals = line.find('=');
+        std::string key = equals == std::string::npos ? line : trim(line.substr(0, equals));
+        std::string value = equals == std::string::npos ? std::string() : trim(line.substr(equals + 1));
+        if (equals == std::string::npos || !set(key, value)) {
+            std::cerr << path << ":" << lineNumber << ": ignoring \"" << line << "\"" << std::endl;
+        }
+    }
+    return true;
+}
+
+bool RenderSettings::save(const std::string& path, const std::string& header) const
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    size_t begin = 0;
+    while (begin < header.size()) {
+        size_t end = header.find('\n', begin);
+        end = end == std::string::npos ? header.size() : end;
+        out << "# " << header.substr(begin, end - begin) << "\n";
+        begin = end + 1;
+    }
+    // The preset first: load() resets to it, then the fields override it one by one
+    out << "quality = " << qualityName(quality) << "\n";
+    out << "bladesPerCell = " << bladesPerCell << "\n";
+    out << "bladeSegments = " << bladeSegments << "\n";
+    out << "lodDistance0 = " << lodDistances[0] << "\n";
+    out << "lodDistance1 = " << lodDistances[1] << "\n";
+    out << "lodFadeWidth = " << lodFadeWidth << "\n";
+    out << "densityLodDistance = " << densityLodDistance << "\n";
+    out << "impostors = " << (impostors ? "true" : "false") << "\n";
+    out << "impostorDistance = " << impostorDistance << "\n";
+    out << "sampleCount = " << sampleCount << "\n";
+    out << "temporalAntialiasing = " << (temporalAntialiasing ? "true" : "false") << "\n";
+    out << "renderScale = " << renderScale << "\n";
+    out << "halfPrecision = " << (halfPrecision ? "true" : "false") << "\n";
+    out << "contactShadows = " << (contactShadows ? "true" : "false") << "\n";
+    out << "translucency = " << (translucency ? "true" : "false") << "\n";
+    out << "windSheen = " << (windSheen ? "true" : "false") << "\n";
+    out << "shadowMaps = " << (shadowMaps ? "true" : "false") << "\n";
+    out << "fogStartDistance = " << fogStartDistance << "\n";
+    out << "fogEndDistance = " << fogEndDistance << "\n";
+    out << "trampleMapSize = " << trampleMapSize << "\n";
+    out << "bladePhysicsRadius = " << bladePhysicsRadius << "\n";
+    out << "simulationScale = " << simulationScale << "\n";
+
+    if (!out) {
+        std::cerr << "Failed to write render settings " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+
+// Performance-relevant renderer settings in one place, so one binary fits hardware from an M1 Air
+// (Low) to an Ultra: quality presets plus individual overrides, loadable from a config file.
+// Renderer::applyRenderSettings() compares them with the live state and rebuilds only what a
+// change affects (the field for the density, the blade meshes for the segments, the trample
+// textures for their size, the scene pipelines for the sample count or TAA). Defaults are the High
+// preset, which is also what the renderer starts with.
+struct RenderSettings {
+    enum Quality {
+        QualityLow = 0,
+        QualityMedium,
+        QualityHigh,
+        QualityUltra,
+        QualityCount
+    };
+
+    Quality quality = QualityHigh;     // Preset the values started from
+    int bladesPerCell = 118;           // Grass density (generated fields only)
+    int bladeSegments = 7;             // Height segments of the nearest blade LOD (coarser LODs keep theirs, up to it)
+    float lodDistances[2] = { 8.0f, 18.0f }; // Blade LOD switch distances (meters)
+    float lodFadeWidth = 1.5f;         // Crossfade band around each switch
+    float densityLodDistance = 10.0f;  // Cells thin out past it (0 = every blade)
+    bool impostors = true;             // Far-field impostor cards
+    float impostorDistance = 20.0f;
+    int sampleCount = 4;               // MSAA samples of the scene pass (1, 2, 4 or 8; dithered coverage at 1 and 2)
+    bool temporalAntialiasing = false; // 1x scene pass resolved by TAA instead of sampleCount MSAA
+    float renderScale = 1.0f;          // Fixed render scale upscaled by MetalFX (0.5..1, 1 = native)
+    bool halfPrecision = false;        // Half-precision grass, ground and sky shading
+    bool contactShadows = true;        // Blade lighting features (Renderer::GrassShadingFeatures)
+    bool translucency = true;
+    bool windSheen = true;
+    bool shadowMaps = true;            // Sun shadow maps on the blades (cached cascades + interactor overlay)
+    float fogStartDistance = 12.0f;    // Post pass distance fog (meters)
+    float fogEndDistance = 40.0f;
+    int trampleMapSize = 1024;         // Texels per side of the trample map (power of two, 256..4096)
+    float bladePhysicsRadius = 0.0f;   // Blade springs around the camera (0 = stateless wind bend)
+    float simulationScale = 1.0f;      // Power policy scale on the fixed simulation rates
+
+    static RenderSettings preset(Quality quality);
+    static const char* qualityName(Quality quality);
+    static bool parseQuality(const std::string& name, Quality& quality); // "low", "medium", "high", "ultra"
+
+    // One override by its config key (the field names above; "quality" resets to that preset).
+    // False for an unknown key or a malformed or out-of-range value, leaving the settings unchanged.
+    bool set(const std::string& key, const std::string& value);
+
+    // "key = value" lines applied in order ('#' starts a comment), so a file usually opens with
+    // "quality = low" and overrides from there. A bad line is reported and skipped; false when
+    // the file cannot be read.
+    bool load(const std::string& path);
+    // Every field as a file load() reads back (header lines become '#' comments)
+    bool save(const std::string& path, const std::string& header = std::string()) const;
+};
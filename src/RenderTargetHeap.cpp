@@ -0,0 +1,84 @@
+#include "RenderTargetHeap.hpp"
+#include <iostream>
+
+RenderTargetHeap::RenderTargetHeap(MTL::Device* device)
+    : m_device(device)
+    , m_heapAllocations(0)
+{
+}
+
+RenderTargetHeap::~RenderTargetHeap()
+{
+    for (MTL::Heap* heap : m_heaps) {
+        heap->release();
+    }
+}
+
+MTL::Texture* RenderTargetHeap::newTexture(MTL::TextureDescriptor* descriptor)
+{
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    MTL::SizeAndAlign sizeAndAlign = m_device->heapTextureSizeAndAlign(descriptor);
+
+    for (MTL::Heap* heap : m_heaps) {
+        if (heap->maxAvailableSize(sizeAndAlign.align) >= sizeAndAlign.size) {
+            MTL::Texture* texture = heap->newTexture(descriptor);
+            if (texture) {
+                return texture;
+            }
+        }
+    }
+
+    // Twice the request so the replacement of a target still referenced by frames in flight fits too
+    MTL::Heap* heap = createHeap(sizeAndAlign.size * 2);
+    MTL::Texture* texture = heap ? heap->newTexture(descriptor) : nullptr;
+    if (!texture) {
+        texture = m_device->newTexture(descriptor);
+    }
+    return texture;
+}
+
+NS::UInteger RenderTargetHeap::getHeapBytes() const
+{
+    NS::UInteger bytes = 0;
+    for (MTL::Heap* heap : m_heaps) {
+        bytes += heap->size();
+    }
+    return bytes;
+}
+
+MTL::Heap* RenderTargetHeap::createHeap(NS::UInteger minimumSize)
+{
+    NS::UInteger size = kMinHeapSize;
+    while (size < minimumSize) {
+        size *= 2;
+    }
+
+    // Heaps that no longer hold anything are smaller than what is needed now: give them back
+    for (size_t i = 0; i < m_heaps.size();) {
+        if (m_heaps[i]->usedSize() == 0) {
+            m_heaps[i]->release();
+            m_heaps.erase(m_heaps.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+
+    MTL::HeapDescriptor* descriptor = MTL::HeapDescriptor::alloc()->init();
+    descriptor->setSize(size);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    // Keep automatic hazard tracking: the render graph relies on it between passes
+    descriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+
+    MTL::Heap* heap = m_device->newHeap(descriptor);
+    descriptor->release();
+
+    if (!heap) {
+        std::cerr << "Failed to create render target heap (" << (size >> 20) << " MB)" << std::endl;
+        return nullptr;
+    }
+
+    m_heaps.push_back(heap);
+    ++m_heapAllocations;
+    std::cout << "Render target heap: " << (size >> 20) << " MB (" << (getHeapBytes() >> 20) << " MB total)" << std::endl;
+    return heap;
+}
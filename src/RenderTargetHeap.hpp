@@ -0,0 +1,28 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <vector>
+
+// Private render targets placed in MTL::Heaps instead of individual device allocations.
+// Releasing a texture hands its range back to the heap, so resizes and resolution changes
+// recreate targets inside memory that is already allocated. A new heap (the only driver
+// allocation) is made only when no existing heap has room; heap sizes are power-of-two buckets.
+class RenderTargetHeap {
+public:
+    explicit RenderTargetHeap(MTL::Device* device);
+    ~RenderTargetHeap();
+
+    // Storage mode is forced to Private; falls back to a plain device texture if no heap can be made
+    MTL::Texture* newTexture(MTL::TextureDescriptor* descriptor);
+
+    NS::UInteger getHeapBytes() const;          // Memory reserved by all heaps
+    int getHeapAllocationCount() const { return m_heapAllocations; }
+
+private:
+    static constexpr NS::UInteger kMinHeapSize = 64ull * 1024 * 1024;
+
+    MTL::Heap* createHeap(NS::UInteger minimumSize);
+
+    MTL::Device* m_device;
+    std::vector<MTL::Heap*> m_heaps;
+    int m_heapAllocations;          // Heaps created so far (driver allocations)
+};
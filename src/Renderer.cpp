@@ -1,5 +1,41 @@
 #include "Renderer.hpp"
 #include "ShaderTypes.h"
+#include "GrassField.hpp"
+#include "PerformanceOverlay.hpp"
+#include "RenderGraph.hpp"
+#include "PipelineCache.hpp"
+#include "DynamicResolution.hpp"
+#include "QualityGovernor.hpp"
+#include "TemporalAntialiasing.hpp"
+#include "VariableRasterizationRate.hpp"
+#include "TrampleSnapshot.hpp"
+#include "ComputeDispatch.hpp"
+#include "NoiseTexture.hpp"
+#include "GrassPalette.hpp"
+#include "GrassImpostorAtlas.hpp"
+#include "ShadowMaps.hpp"
+#include "TerrainHeightmap.hpp"
+#include "ExternalControl.hpp"
+#include "TextureLoader.hpp"
+#include "UploadRing.hpp"
+#include "ResourceCache.hpp"
+#include "SparseGroundTexture.hpp"
+#include "ImportedMesh.hpp"
+#include "InstanceFile.hpp"
+#include "GrassInstanceEditor.hpp"
+#include "ShaderWatcher.hpp"
+#include "GrassStreamer.hpp"
+#include "GrassDensityMap.hpp"
+#include "JobSystem.hpp"
+#include "CpuCellCuller.hpp"
+#include "FrameCapture.hpp"
+#include "VideoRecorder.hpp"
+#include "TraceRecorder.hpp"
+#include "GpuResidency.hpp"
+#include "GpuMemoryBudget.hpp"
+#include "BufferHeap.hpp"
+#include "FramePacket.hpp"
+#include "InputRecording.hpp"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -11,19 +47,230 @@
 #include <random>
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <unistd.h>
 
-// Grass mesh configuration: vertical segments for smooth bending
-static constexpr int kGrassSegments = 7;                 // At least 7 height segments
-static constexpr int kGrassRows = kGrassSegments + 1;    // Rows of vertices
+// Vegetation species meshes (GRASS_SPECIES_*): vertical segments per LOD (near blades need smooth
+// bending) and the blade-local strip each LOD is built from (see appendBladeMesh)
+static constexpr int kGrassLodSegments[GRASS_SPECIES_COUNT][GRASS_LOD_COUNT] = {
+    { 7, 3, 1 }, // Grass blade
+    { 3, 2, 1 }, // Clover: short and wide
+    { 5, 2, 1 }  // Flowers: tall thin stems
+};
+struct GrassStripShape {
+    float halfWidth;
+    float height; // From the shared root at kGrassStripRootY
+};
+static constexpr GrassStripShape kGrassStripShapes[GRASS_SPECIES_COUNT] = {
+    { 0.25f, 0.70f },
+    { 0.28f, 0.30f },
+    { 0.16f, 0.75f }
+};
+static constexpr float kGrassStripRootY = -0.35f;
 static constexpr int kGrassVertsPerRow = 2;              // Left + right per row
-static constexpr int kGrassVertexCount = kGrassRows * kGrassVertsPerRow;
-static constexpr int kGrassIndicesPerSegment = 6;        // 2 triangles per segment
-static constexpr int kGrassIndexCount = kGrassSegments * kGrassIndicesPerSegment;
+
+static constexpr int maxGrassLod0Segments() {
+    int segments = 0;
+    for (int species = 0; species < GRASS_SPECIES_COUNT; ++species) {
+        segments = std::max(segments, kGrassLodSegments[species][0]);
+    }
+    return segments;
+}
+
+// Default MSAA sample count of the scene pass (RenderSettings::sampleCount; every MSAA scene
+// pipeline key, the mesh and tile pipelines and the scene targets use m_sceneSampleCount)
+static constexpr NS::UInteger kSceneSampleCount = 4;
+
+// First exponential light cluster slice ends here; slice 0 also covers everything closer
+static constexpr float kLightClusterNear = 0.25f;
+
+// Default post pass fog distances (RenderSettings::fogStartDistance / fogEndDistance)
+static constexpr float kFogStartDistance = 12.0f;
+static constexpr float kFogEndDistance = 40.0f;
+
+// Linear HDR scene color; the post pass fogs, exposes and tone maps it into the 8-bit output
+static constexpr MTL::PixelFormat kSceneColorFormat = MTL::PixelFormatRGBA16Float;
+
+// A frame slot wait longer than this logs the frames in flight (GpuBreadcrumbs::reportStalled)
+static constexpr double kGpuStallSeconds = 2.0;
+
+// Visibility-buffer grass IDs: (visible slot + 1, strip triangle), 0 = no blade
+static constexpr MTL::PixelFormat kGrassVisibilityFormat = MTL::PixelFormatRG32Uint;
+
+// In-tile post attachments of the 4x scene pass: the tone-mapped output (resolved into the
+// drawable, so its format) and the fragment depth the tile stage fogs by
+static constexpr MTL::PixelFormat kTilePostOutputFormat = MTL::PixelFormatBGRA8Unorm;
+static constexpr MTL::PixelFormat kTilePostDepthFormat = MTL::PixelFormatR32Float;
+
+// Picking object IDs (OBJECT_ID), 0 = nothing
+static constexpr MTL::PixelFormat kObjectIdFormat = MTL::PixelFormatR32Uint;
 
 // Scene size: shared constant for ground plane and grass field
 // Ground and grass will both span from -SCENE_SIZE to +SCENE_SIZE (total size = 2 * SCENE_SIZE)
 static constexpr float SCENE_SIZE = 15.0f;              // Half-size, so total scene is 30x30 (compact, high-density)
 
+// Tileable value-noise lattice (texels per side; one lattice cell per texel)
+static constexpr uint32_t kNoiseTextureSize = 256;
+static constexpr uint32_t kNoiseTextureSeed = 0x6e6f6973;
+
+// Optional artist mesh replacing the generated ball sphere (model units = meters, radius ~0.5)
+static constexpr const char* kBallMeshPath = "assets/meshes/ball.obj";
+// Authored production field (see InstanceFile); the scene generates its grass when absent
+static constexpr const char* kGrassFieldPath = "assets/fields/grass.vgif";
+// Authored density (R) / species (G) mask over the field; the procedural meadow when missing
+static constexpr const char* kGrassDensityMapPath = "assets/grass_density.png";
+
+// Pipelines precompiled by the build (PrecompiledPipelines target), shipped next to default.metallib
+static constexpr const char* kShippedPipelineArchivePath = "default.metalarchive";
+
+// Streamed tiles of the sparse ground texture mapped at once (the whole mip chain would take ~360 MB)
+static constexpr size_t kSparseGroundBudgetBytes = 32u << 20;
+
+// Frames between GPU memory samples (the listing walks every long-lived resource)
+static constexpr int kGpuMemorySampleInterval = 30;
+
+// Trample clipmap extent (meters around the camera); resolution and cost do not depend on the world size
+static constexpr float kTrampleWindowSize = 40.0f;
+// Default texels per side of the trample map over that window (RenderSettings::trampleMapSize)
+static constexpr int kTrampleMapSize = 1024;
+
+// Trample strength lost per second (~3 seconds recovery)
+static constexpr float kTrampleDecayRate = 0.35f;
+
+// Simulation rates (setSimulationRate(); 0 = once per frame): physics steps at a fixed 60 Hz, so
+// the bodies and blade springs behave the same at any display rate and a stalled frame cannot
+// tunnel bodies through the ground; trample stamps and the wind fluid follow the frames
+static constexpr float kDefaultSimulationRates[Renderer::SimulationSystemCount] = { 0.0f, 60.0f, 0.0f };
+
+// Interactor physics (setInteractorPhysics()): contact response of the rolling bodies
+static constexpr float kInteractorGravity = 9.81f;
+static constexpr float kInteractorFriction = 0.4f;
+static constexpr float kInteractorGrassDrag = 1.2f;
+static constexpr float kInteractorRestitution = 0.3f;
+
+// Wind fluid (setWindFluid()): pressure solver iterations (even, so the result lands in the first
+// pressure buffer and warm-starts the next step) and the look of the wakes and gusts
+static constexpr int kWindPressureIterations = 20;
+static constexpr float kWindAmbientSpeed = 2.0f;      // m/s along the procedural wind direction
+static constexpr float kWindFluidDissipation = 0.8f;
+static constexpr float kWindBendPerVelocity = 0.15f;
+static constexpr float kWindWakeStrength = 0.8f;
+static_assert(kWindPressureIterations % 2 == 0, "The pressure result must land in m_windPressureBuffers[0]");
+
+// Blade physics (setBladePhysics()): springs about 1 Hz that overshoot a little on recovery
+static constexpr float kBladePhysicsStiffness = 40.0f;
+static constexpr float kBladePhysicsDampingRatio = 0.3f;
+static constexpr float kBladePhysicsInteractorPush = 1.1f;
+
+// Default trample snapshot file (F5 saves, F9 loads)
+static const char* kTrampleSnapshotPath = "trample_snapshot.bin";
+
+// Batch rendering: images read back but not yet through their callbacks (bounds the staging memory)
+static constexpr size_t kBatchReadbacksInFlight = 8;
+
+// GPU captures from the F12 key (capture_0.gputrace, capture_1.gputrace, ...)
+static const char* kCapturePathPrefix = "capture_";
+
+// Grass density (blades per grid cell; ~30k blades by default for a lush Ghibli look in the compact 30x30 area)
+static constexpr int kGrassDefaultBladesPerCell = 118;
+static constexpr int kGrassMaxBladesPerCell = 512;
+static constexpr int kGrassDensityStep = 16;
+
+// Conservative blade bounding sphere radius for culling:
+// local half-height 0.35 and half-width 0.25, scaled by up to 1.2, rotated about the blade center
+// (the clover and flower strips reach no farther from it)
+static constexpr float kGrassBladeRadius = 0.55f;
+// Cell and chunk bounds: the blade radius at the widest density LOD (the per-blade cull widens its
+// sphere by each blade's own share, grassDensityLodRadius())
+static constexpr float kGrassCellBoundsRadius = kGrassBladeRadius + GRASS_BLADE_MAX_HALF_WIDTH * (1.0f / GRASS_DENSITY_LOD_MIN_FRACTION - 1.0f);
+
+// Streamed grass world (setGrassStreaming()): half-size in meters, quantized over it like the field
+static constexpr float kGrassStreamWorldHalfSize = 1024.0f;
+// Grass cell grid resolution (cells per side over the 2 * SCENE_SIZE field)
+static constexpr int kGrassCellsPerSide = 16;
+
+// Terrain chunks are the grass cells: a cell's ground heights are the samples of one chunk
+static_assert(kGrassCellsPerSide == TERRAIN_CHUNKS_PER_SIDE, "Terrain chunks must match the grass cell grid");
+
+// Terrain: heightmap seed (fixed, like the noise lattice) and chunk LOD switch distances (meters)
+static constexpr uint32_t kTerrainSeed = 0x68696c6c;
+static constexpr float kTerrainLodDistances[TERRAIN_LOD_COUNT - 1] = { 6.0f, 12.0f, 20.0f };
+
+// Scene ICB layout: sky, one ground command per terrain LOD, ball
+static constexpr NS::UInteger kSceneCommandGround = 1;
+static constexpr NS::UInteger kSceneCommandBall = kSceneCommandGround + TERRAIN_LOD_COUNT;
+
+// Instance buffer capacity: every cell at maximum density (the default per-blade buffer capacity;
+// a larger mapped instance file grows it, see ensureGrassInstanceCapacity())
+static constexpr int kGrassMaxInstanceCount = kGrassCellsPerSide * kGrassCellsPerSide * kGrassMaxBladesPerCell;
+
+// Edited field: free slots every cell keeps beyond its fullest cell's blades (plantGrass())
+static constexpr uint32_t kGrassEditSlack = 64;
+// Density brush: share of the radius painted at full strength (paintGrassDensity())
+static constexpr float kGrassBrushHardness = 0.5f;
+// Mouse density brush: radius in meters, mask blend per second held, pick reach and march step
+static constexpr float kGrassBrushRadius = 1.5f;
+static constexpr float kGrassBrushRate = 4.0f;
+static constexpr float kTerrainPickDistance = 60.0f;
+static constexpr float kTerrainPickStep = 0.25f;
+
+static_assert(sizeof(GrassDrawArguments) == sizeof(MTL::DrawIndexedPrimitivesIndirectArguments),
+              "GrassDrawArguments must match the Metal indirect argument layout");
+static_assert(sizeof(GrassImpostorDrawArguments) == sizeof(MTL::DrawPrimitivesIndirectArguments),
+              "GrassImpostorDrawArguments must match the Metal indirect argument layout");
+static_assert(sizeof(Uniforms) <= UNIFORMS_VIEW_STRIDE, "Per-view Uniforms copies overlap");
+
+// The mesh shader path emits GRASS_MESH_BLADES_PER_GROUP LOD 0 strips (of any species) per mesh threadgroup
+static_assert(GRASS_MESH_BLADES_PER_GROUP * (maxGrassLod0Segments() + 1) * kGrassVertsPerRow <= GRASS_MESH_MAX_VERTICES,
+              "Mesh grass vertex budget too small for LOD 0");
+static_assert(GRASS_MESH_BLADES_PER_GROUP * maxGrassLod0Segments() * 2 <= GRASS_MESH_MAX_PRIMITIVES,
+              "Mesh grass primitive budget too small for LOD 0");
+
+// Interactor at a given time: index 0 is the ball circling the center, the others stand in for
+// players / NPCs wandering on their own orbits (deterministic, so last frame's position is exact)
+static Interactor interactorAt(int index, float time, float prevTime) {
+    float orbitRadius = 3.0f;
+    float speed = 1.0f;
+    float phase = 0.0f;
+    float radius = 1.0f;
+    if (index > 0) {
+        orbitRadius = 2.0f + std::fmod(static_cast<float>(index) * 0.618034f, 1.0f) * (SCENE_SIZE - 3.0f);
+        speed = ((index & 1) ? 1.0f : -1.0f) * (0.4f + 0.1f * static_cast<float>(index % 5)) * 3.0f / orbitRadius;
+        phase = static_cast<float>(index) * 2.399963f; // Golden angle
+        radius = 0.5f + 0.1f * static_cast<float>(index % 6);
+    }
+    
+    // Orbits over the flat ground at -0.5f (draw() lifts the interactors onto the terrain)
+    auto positionAt = [&](float t) {
+        return simd::make_float3(sin(t * speed + phase) * orbitRadius, 0.0f, cos(t * speed + phase) * orbitRadius);
+    };
+    
+    // Bodies are half the footprint and rest on the ground (the ball: radius 0.5, center at 0.0)
+    float bodyRadius = radius * 0.5f;
+    
+    Interactor interactor;
+    interactor.position = positionAt(time);
+    interactor.prevPosition = positionAt(prevTime);
+    interactor.position.y = interactor.prevPosition.y = bodyRadius - 0.5f;
+    interactor.radius = radius;
+    interactor.falloff = radius * 0.35f; // Soft flatten band (Ghibli-like)
+    interactor.bodyRadius = bodyRadius;
+    interactor.halfHeight = 0.0f;
+    
+    // Glossy white ball; the stand-ins get muted colors of their own
+    static const simd::float3 kStandInColors[] = {
+        { 0.80f, 0.35f, 0.25f }, { 0.30f, 0.45f, 0.80f }, { 0.85f, 0.70f, 0.30f }, { 0.45f, 0.70f, 0.45f }, { 0.60f, 0.40f, 0.70f }
+    };
+    simd::float3 albedo = index == 0 ? simd::make_float3(0.9f, 0.9f, 0.9f) : kStandInColors[index % 5];
+    interactor.material = simd::make_float4(albedo.x, albedo.y, albedo.z, index == 0 ? 0.8f : 0.3f);
+    return interactor;
+}
+
 // Helper function to convert glm::mat4 to simd::float4x4
 static simd::float4x4 glmToSimd(const glm::mat4& glmMat) {
     simd::float4x4 simdMat;
@@ -39,10 +286,58 @@ static simd::float4x4 glmToSimd(const glm::mat4& glmMat) {
     return simdMat;
 }
 
+// Extract normalized frustum planes from a view-projection matrix (Gribb/Hartmann).
+// Planes point inward: a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+// The near plane uses the conservative -w <= z test so it holds for both depth conventions.
+static void extractFrustumPlanes(const glm::mat4& viewProj, simd::float4 planes[6]) {
+    glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+    glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+    glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+    glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+    
+    glm::vec4 rawPlanes[6] = {
+        row3 + row0, // Left
+        row3 - row0, // Right
+        row3 + row1, // Bottom
+        row3 - row1, // Top
+        row3 + row2, // Near
+        row3 - row2  // Far
+    };
+    
+    for (int i = 0; i < 6; ++i) {
+        float len = glm::length(glm::vec3(rawPlanes[i]));
+        glm::vec4 p = (len > 0.0f) ? rawPlanes[i] / len : rawPlanes[i];
+        planes[i] = simd::make_float4(p.x, p.y, p.z, p.w);
+    }
+}
+
 Renderer::Renderer(MTL::Device* device, CA::MetalLayer* layer)
+    : Renderer(device, layer, std::random_device{}())
+{
+}
+
+Renderer::Renderer(MTL::Device* device, CA::MetalLayer* layer, uint32_t grassSeed)
+    : Renderer(device, layer,
+               static_cast<int>(layer->drawableSize().width),
+               static_cast<int>(layer->drawableSize().height),
+               grassSeed)
+{
+}
+
+Renderer::Renderer(MTL::Device* device, int width, int height, uint32_t grassSeed)
+    : Renderer(device, nullptr, width, height, grassSeed)
+{
+}
+
+Renderer::Renderer(MTL::Device* device, CA::MetalLayer* layer, int width, int height, uint32_t grassSeed)
     : m_device(device)
     , m_metalLayer(layer)
     , m_commandQueue(nullptr)
+    , m_asyncComputeQueue(nullptr)
+    , m_asyncCompute(true)
+    , m_asyncUploadMark(0)
+    , m_outOfGraphCommandBuffers(0)
+    , m_asyncOutOfGraphMark(0)
     , m_pso(nullptr)
     , m_groundPSO(nullptr)
     , m_ballPSO(nullptr)
@@ -51,30 +346,371 @@ Renderer::Renderer(MTL::Device* device, CA::MetalLayer* layer)
     , m_indexBuffer(nullptr)
     , m_instanceBuffer(nullptr)
     , m_uniformBuffer(nullptr)
-    , m_groundVertexBuffer(nullptr)
+    , m_sceneConstantBuffer(nullptr)
+    , m_sceneConstantsVersion(0)
+    , m_fogStartDistance(kFogStartDistance)
+    , m_fogEndDistance(kFogEndDistance)
+    , m_frameIndex(0)
+    , m_frameSemaphore(nullptr)
+    , m_terrain(nullptr)
+    , m_terrainIndexBuffer(nullptr)
     , m_ballVertexBuffer(nullptr)
     , m_ballIndexBuffer(nullptr)
     , m_ballIndexCount(0)
     , m_depthStencilState(nullptr)
     , m_skyDepthStencilState(nullptr)
+    , m_fullscreenDepthStencilState(nullptr)
+    , m_grassEqualDepthState(nullptr)
     , m_depthTexture(nullptr)
-    , m_msaaColorTexture(nullptr)
-    , m_msaaDepthTexture(nullptr)
-    , m_texture(nullptr)
+    , m_offscreenColorTexture(nullptr)
+    , m_fixedTime(0.0f)
+    , m_useFixedTime(false)
+    , m_bufferHeap(nullptr)
+    , m_uploadRing(nullptr)
+    , m_textureLoader(nullptr)
+    , m_resourceCache(nullptr)
+    , m_grassAlbedoArray(nullptr)
     , m_groundTexture(nullptr)
+    , m_noiseTexture(nullptr)
+    , m_grassPalette(nullptr)
+    , m_sparseGround(nullptr)
+    , m_sparseGroundEnabled(false)
+    , m_prevBKeyState(false)
     , m_camera(nullptr)
+    , m_vertexAmplificationSupported(device->supportsVertexAmplificationCount(2))
     , m_firstMouse(true)
     , m_lastX(400.0f)
     , m_lastY(300.0f)
-    , m_trampleMapA(nullptr)
-    , m_trampleMapB(nullptr)
-    , m_trampleMapSwap(false)
+    , m_trampleMap(nullptr)
     , m_trampleComputePSO(nullptr)
+    , m_binInteractorsPSO(nullptr)
+    , m_interactors()
+    , m_interactorHandles()
+    , m_interactorCapsules(false)
+    , m_interactorBinBuffer(nullptr)
+    , m_interactorCount(1)
+    , m_frameInteractorBuffer(nullptr)
+    , m_externalControl(nullptr)
+    , m_externalFrame(nullptr)
+    , m_interactorPhysicsPSO(nullptr)
+    , m_interactorBodyBuffer(nullptr)
+    , m_interactorPhysicsEnabled(false)
+    , m_interactorPhysicsReset(true)
+    , m_prevPKeyState(false)
+    , m_bladePhysicsPSO(nullptr)
+    , m_bladeStateBuffer(nullptr)
+    , m_bladePhysicsRadius(0.0f)
+    , m_trampleClearPSO(nullptr)
+    , m_trampleWindowTexel(simd::make_int2(0, 0))
+    , m_trampleWindowValid(false)
+    , m_trampleSummary(nullptr)
+    , m_trampleSummaryMipViews()
+    , m_trampleDirtyTileBuffer(nullptr)
+    , m_trampleReducePSO(nullptr)
+    , m_trampleSummaryDownsamplePSO(nullptr)
+    , m_trampleSummaryEnabled(true)
+    , m_trampleStagingBuffer(nullptr)
+    , m_trampleSnapshot(nullptr)
+    , m_trampleSnapshotPath()
+    , m_trampleSavePending(false)
+    , m_trampleUploadPending(false)
+    , m_trampleTransferSlot(-1)
+    , m_trampleTransferIsReadback(false)
+    , m_trampleReadbackWindow(simd::make_int2(0, 0))
+    , m_trampleReadbackTime(0.0f)
+    , m_trampleFileJob(false)
+    , m_trampleQueryPSO(nullptr)
+    , m_trampleQueries()
+    , m_objectIds(false)
+    , m_objectIdsRequested(false)
+    , m_pickObjectIdsPSO(nullptr)
+    , m_pickObjectIdsMultisampledPSO(nullptr)
+    , m_prevF5KeyState(false)
+    , m_prevF9KeyState(false)
     , m_showTrampleMap(false)
     , m_prevTKeyState(false)
+    , m_windField(nullptr)
+    , m_windFieldPSO(nullptr)
+    , m_windAdvectPSO(nullptr)
+    , m_windSplatPSO(nullptr)
+    , m_windDivergencePSO(nullptr)
+    , m_windPressurePSO(nullptr)
+    , m_windProjectPSO(nullptr)
+    , m_windFieldFluidPSO(nullptr)
+    , m_windScratchBuffer(nullptr)
+    , m_windDivergenceBuffer(nullptr)
+    , m_windVelocityIndex(0)
+    , m_windFluidEnabled(false)
+    , m_windGusts()
+    , m_prevKKeyState(false)
+    , m_windGustPSO(nullptr)
+    , m_windGustBuffer(nullptr)
+    , m_windGustSpawns()
+    , m_windGustSpawned(0)
+    , m_windGustLives()
+    , m_atmosphereLut(nullptr)
+    , m_atmosphereLutPSO(nullptr)
+    , m_pointLights()
+    , m_lightClusterBuffer(nullptr)
+    , m_lightClusterPSO(nullptr)
+    , m_sunDirection(simd::normalize(simd::make_float3(1.0f, 1.0f, 0.5f)))
+    , m_sunColor(simd::make_float3(1.0f, 0.95f, 0.85f))
+    , m_atmosphereLutSun()
+    , m_atmosphereLutValid(false)
+    , m_cullComputePSO(nullptr)
+    , m_resetDrawArgsPSO(nullptr)
+    , m_visibleInstanceBuffer(nullptr)
+    , m_grassDrawArgsBuffer(nullptr)
+    , m_sortCellsPSO(nullptr)
+    , m_cellOrderBuffer(nullptr)
+    , m_frontToBackCells(true)
+    , m_grassWindPoses(true)
+    , m_lodFadeWidth(1.5f)
+    , m_grassDensityLodDistance(10.0f)
+    , m_grassBladeSegments(maxGrassLod0Segments())
+    , m_hiZFromDepthPSO(nullptr)
+    , m_hiZDownsamplePSO(nullptr)
+    , m_hiZTexture(nullptr)
+    , m_prevViewProj(1.0f)
+    , m_hiZValid(false)
+    , m_hiZCullingEnabled(true)
+    , m_grassField(nullptr)
+    , m_instanceFile(nullptr)
+    , m_grassEditor(nullptr)
+    , m_grassEditSeed(0)
+    , m_grassStreamer(nullptr)
+    , m_prevCKeyState(false)
+    , m_cpuCellCuller(new CpuCellCuller())
+    , m_cpuCellCulling(false)
+    , m_cpuCellsDirty(true)
+    , m_cpuCulledThisFrame(false)
+    , m_cpuCellReadbackBuffer(nullptr)
+    , m_cpuCellReadback(nullptr)
+    , m_prevXKeyState(false)
+    , m_cellBuffer(nullptr)
+    , m_generateGrassPSO(nullptr)
+    , m_paintGrassDensityPSO(nullptr)
+    , m_grassBladesPerCell(kGrassDefaultBladesPerCell)
+    , m_grassInstanceCount(0)
+    , m_grassInstanceCapacity(static_cast<uint32_t>(kGrassMaxInstanceCount))
+    , m_grassDensityMap(nullptr)
+    , m_grassDensityMapEnabled(true)
+    , m_grassPlacedCountBuffer(nullptr)
+    , m_grassSeed(grassSeed)
+    , m_prevDensityKeyState(false)
+    , m_prevBrushButtonState(false)
+    , m_meshGrassPSO(nullptr)
+    , m_impostorAtlas(nullptr)
+    , m_impostorBuffer(nullptr)
+    , m_impostorDrawArgsBuffer(nullptr)
+    , m_impostorsEnabled(true)
+    , m_impostorDistance(20.0f)
+    , m_impostorFadeWidth(4.0f)
+    , m_prevOKeyState(false)
+    , m_shadowMaps(nullptr)
+    , m_shadowMapsEnabled(true)
+    , m_shadowMapsActive(false)
+    , m_shadowOverlayActive(false)
+    , m_shadowRedraw()
+    , m_shadowStreamerVersion(0)
+    , m_grassVisibilitySupported(device->supportsFamily(MTL::GPUFamilyApple7))
+    , m_grassVisibilityEnabled(false)
+    , m_prevVKeyState(false)
+    , m_grassICB(nullptr)
+    , m_grassICBArgumentBuffer(nullptr)
+    , m_encodeGrassCommandsPSO(nullptr)
+    , m_useIndirectCommandBuffers(true)
+    , m_prevIKeyState(false)
+    , m_prevRKeyState(false)
+    , m_shaderWatcher(nullptr)
+    , m_prevLKeyState(false)
+    , m_profiler(nullptr)
+    , m_breadcrumbs(nullptr)
+    , m_frameSerial(0)
+    , m_frameCapture(nullptr)
+    , m_captureCount(0)
+    , m_prevF12KeyState(false)
+    , m_trace(nullptr)
+    , m_traceCount(0)
+    , m_prevF11KeyState(false)
+    , m_inputRecording(nullptr)
+    , m_inputRecordingCount(0)
+    , m_prevF10KeyState(false)
+    , m_videoRecorder(nullptr)
+    , m_videoCount(0)
+    , m_prevF8KeyState(false)
+    , m_readback(nullptr)
+    , m_screenshotCount(0)
+    , m_prevF7KeyState(false)
+    , m_targetHeap(nullptr)
+    , m_residency(nullptr)
+    , m_gpuMemory(nullptr)
+    , m_gpuMemorySampleFrame(0)
+    , m_resourceCacheBudget(0)
+    , m_gpuMemoryShrunk(false)
+    , m_computeDispatch(nullptr)
+    , m_powerPolicy()
+    , m_scenePaused(false)
+    , m_scenePauseStart(0.0)
+    , m_scenePausedTotal(0.0)
+    , m_inputActive(false)
+    , m_idleCursorX(0.0)
+    , m_idleCursorY(0.0)
+    , m_idleCameraPosition(0.0f)
+    , m_idleCameraYaw(0.0f)
+    , m_idleCameraPitch(0.0f)
+    , m_staticSince(-1.0)
+    , m_idle(false)
+    , m_prevZKeyState(false)
+    , m_jobSystem(nullptr)
+    , m_parallelEncoding(false)
+    , m_prevEKeyState(false)
+    , m_dynamicResolution(nullptr)
+    , m_qualityGovernor(nullptr)
+    , m_prevUKeyState(false)
+    , m_rasterizationRate(nullptr)
+    , m_prevYKeyState(false)
+    , m_tilePostPSO(nullptr)
+    , m_tilePostEnabled(true)
+    , m_prevQKeyState(false)
+    , m_temporalUpscaling(false)
+    , m_temporalRequested(false)
+    , m_prevMKeyState(false)
+    , m_temporalAntialiasing(nullptr)
+    , m_temporalResolvePSO(nullptr)
+    , m_temporalAntialiasingEnabled(false)
+    , m_temporalAntialiasingRequested(false)
+    , m_prevFKeyState(false)
+    , m_prevUniforms()
+    , m_prevUniformsValid(false)
+    , m_hiZUVScale(simd::make_float2(1.0f, 1.0f))
+    , m_renderGraph(nullptr)
+    , m_pipelineArchive(nullptr)
+    , m_pipelineCache(nullptr)
+    , m_sceneSampleCount(kSceneSampleCount)
+    , m_sceneSampleCountRequested(kSceneSampleCount)
+    , m_renderQuality(RenderSettings::QualityHigh)
+    , m_grassShadingFeatures()
+    , m_halfPrecisionShading(false)
+    , m_prevHKeyState(false)
+    , m_geometryBlades(false)
+    , m_prevGKeyState(false)
+    , m_grassDepthPrepass(false)
+    , m_prevNKeyState(false)
+    , m_pipelineGeneration(0)
+    , m_pipelinesReady(false)
+    , m_overlay(nullptr)
+    , m_prevF1KeyState(false)
+    , m_lastCameraUpdateNs(0)
+    , m_cpuFrameMs(0.0f)
+    , m_visibleBladeCountsValid(false)
+    , m_microbenchCullValid(false)
 {
-    // Create a CommandQueue
+    // Default LOD switch distances (meters from camera)
+    m_lodDistances[0] = 8.0f;
+    m_lodDistances[1] = 18.0f;
+    memset(&m_sceneConstants, 0, sizeof(m_sceneConstants));
+    memset(&m_microbenchCull, 0, sizeof(m_microbenchCull));
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_uniformBuffers[i] = nullptr;
+        m_sceneConstantBuffers[i] = nullptr;
+        m_sceneConstantSlotVersions[i] = 0;
+        m_interactorBuffers[i] = nullptr;
+        m_windGustPlacementBuffers[i] = nullptr;
+        m_windGustFlowBuffers[i] = nullptr;
+        m_pointLightBuffers[i] = nullptr;
+        m_trampleQueryPointBuffers[i] = nullptr;
+        m_trampleQueryResultBuffers[i] = nullptr;
+        m_objectPickResultBuffers[i] = nullptr;
+        m_terrainChunkBuffers[i] = nullptr;
+        m_sceneICBs[i] = nullptr;
+        m_cullStatsBuffers[i] = nullptr;
+        m_cullStatsPending[i] = false;
+        m_trampleTileCountBuffers[i] = nullptr;
+        m_grassResourceTables[i] = nullptr;
+    }
+    for (int i = 0; i < 2; ++i) {
+        m_windVelocityBuffers[i] = nullptr;
+        m_windPressureBuffers[i] = nullptr;
+    }
+    for (int i = 0; i < SimulationSystemCount; ++i) {
+        m_simulationRates[i] = kDefaultSimulationRates[i];
+    }
+    applySimulationRates();
+    m_frameSemaphore = dispatch_semaphore_create(kMaxFramesInFlight);
+    for (int lod = 0; lod < GRASS_LOD_COUNT; ++lod) {
+        m_visibleBladeCounts[lod] = 0;
+    }
+    for (int bucket = 0; bucket < GRASS_DRAW_BUCKET_COUNT; ++bucket) {
+        m_grassBucketIndexCount[bucket] = 0;
+        m_grassBucketIndexStart[bucket] = 0;
+        m_grassBucketBaseVertex[bucket] = 0;
+    }
+    for (int variant = 0; variant < GRASS_ALBEDO_VARIANT_COUNT; ++variant) {
+        m_grassAlbedoVariants[variant] = nullptr;
+        m_grassAlbedoLoaded[variant] = false;
+    }
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+        m_terrainLodIndexCount[lod] = 0;
+        m_terrainLodIndexStart[lod] = 0;
+        m_terrainLodChunkCount[lod] = 0;
+        m_terrainLodFirstChunk[lod] = 0;
+    }
+    
+    // Create a CommandQueue, and a second one for the async compute passes
     m_commandQueue = m_device->newCommandQueue();
+    m_asyncComputeQueue = m_device->newCommandQueue();
+    if (m_asyncComputeQueue) {
+        m_asyncComputeQueue->setLabel(NS::String::string("Async compute", NS::UTF8StringEncoding));
+    }
+    
+    // CPU work pool: instance generation, texture decodes, chunk streaming and parallel encoding
+    m_jobSystem = new JobSystem();
+    m_readback = new TextureReadback(m_device, m_jobSystem);
+    
+    // Static meshes and image textures are blitted into private storage from one staging ring,
+    // and shared by key through the resource cache
+    m_bufferHeap = new BufferHeap(m_device);
+    m_uploadRing = new UploadRing(m_device);
+    m_uploadRing->setBufferHeap(m_bufferHeap);
+    m_textureLoader = new TextureLoader(m_device, m_commandQueue, m_uploadRing, m_jobSystem);
+    m_resourceCache = new ResourceCache(m_textureLoader, m_uploadRing);
+    m_resourceCacheBudget = m_resourceCache->getBudget();
+    
+    // Per-pass GPU timestamps (one sample slice per in-flight frame)
+    m_profiler = new GpuProfiler(m_device, kMaxFramesInFlight);
+    m_breadcrumbs = new GpuBreadcrumbs(m_device, kMaxFramesInFlight);
+    m_frameCapture = new FrameCapture(m_commandQueue);
+    m_trace = new TraceRecorder();
+    m_profiler->setTraceRecorder(m_trace);
+    
+    // Frame graph: passes are declared per frame, transient attachments come from its pool
+    m_targetHeap = new RenderTargetHeap(m_device);
+    m_residency = new GpuResidency(m_device, m_commandQueue);
+    m_residency->addCommandQueue(m_asyncComputeQueue);
+    m_gpuMemory = new GpuMemoryBudget(m_device);
+    m_computeDispatch = new ComputeDispatch(m_device);
+    
+    // MetalFX upscaling (off until toggled); it writes the drawable, so the layer cannot be framebuffer-only
+    if (DynamicResolution::isSupported(m_device)) {
+        m_dynamicResolution = new DynamicResolution(m_device, m_targetHeap);
+        if (m_metalLayer) {
+            m_metalLayer->setFramebufferOnly(false);
+        }
+    }
+    // In-house TAA: history and motion targets are sized in resize(), like the MetalFX inputs
+    m_temporalAntialiasing = new TemporalAntialiasing(m_device, m_targetHeap, kSceneColorFormat);
+    if (VariableRasterizationRate::isSupported(m_device)) {
+        m_rasterizationRate = new VariableRasterizationRate(m_device);
+    }
+    m_renderGraph = new RenderGraph(m_device, m_profiler, m_targetHeap);
+    m_renderGraph->setBreadcrumbs(m_breadcrumbs);
+    m_renderGraph->setAsyncComputeQueue(m_asyncCompute ? m_asyncComputeQueue : nullptr);
+    
+    // Pipeline binaries from the previous launch (one archive per GPU) and the shipped ones
+    m_pipelineArchive = new PipelineArchive(m_device, "pipeline_cache_" + std::to_string(m_device->registryID()) + ".metalarchive",
+                                            kShippedPipelineArchivePath);
+    m_pipelineCache = new PipelineCache(m_device, m_pipelineArchive);
     
     // Initialize m_camera at (0, 1, 3)
     m_camera = new Camera(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, 0.0f);
@@ -82,34 +718,45 @@ Renderer::Renderer(MTL::Device* device, CA::MetalLayer* layer)
     // Build shaders and buffers
     buildShaders();
     buildBuffers();
+    buildGround(); // Grass is planted on the terrain heightmap
     buildInstanceBuffer();
     buildTextures();
-    buildGround();
     buildTrampleMaps();
+    setInteractorCount(m_interactorCount); // The ball, into the interactor store
+    buildWindField();
+    buildAtmosphereLut();
+    buildLightClusters();
+    buildCullingBuffers();
+    buildImpostors();
+    buildShadowMaps();
+    // The indirect command buffers reference the render pipelines, so they are encoded
+    // once the asynchronous builds finish (see finishPipelineBuild())
     
-    // Initialize MSAA textures with initial layer size
-    // Get drawable size from metal layer
-    CGSize drawableSize = m_metalLayer->drawableSize();
-    resize(static_cast<int>(drawableSize.width), static_cast<int>(drawableSize.height));
+    // Initialize MSAA textures with the initial layer (or offscreen) size
+    resize(width, height);
 }
 
 Renderer::~Renderer()
 {
+    // Wait for frames still in flight before releasing anything they use
+    if (m_frameSemaphore) {
+        for (int i = 0; i < kMaxFramesInFlight; ++i) {
+            dispatch_semaphore_wait(m_frameSemaphore, DISPATCH_TIME_FOREVER);
+        }
+        for (int i = 0; i < kMaxFramesInFlight; ++i) {
+            dispatch_semaphore_signal(m_frameSemaphore);
+        }
+    }
+    
     // Release resources if needed
     if (m_commandQueue) {
         m_commandQueue->release();
     }
-    if (m_pso) {
-        m_pso->release();
-    }
-    if (m_vertexBuffer) {
-        m_vertexBuffer->release();
-    }
-    if (m_indexBuffer) {
-        m_indexBuffer->release();
+    if (m_asyncComputeQueue) {
+        m_asyncComputeQueue->release();
     }
     if (m_instanceBuffer) {
-        m_instanceBuffer->release();
+        m_bufferHeap->release(m_instanceBuffer);
     }
     if (m_depthStencilState) {
         m_depthStencilState->release();
@@ -117,987 +764,6981 @@ Renderer::~Renderer()
     if (m_depthTexture) {
         m_depthTexture->release();
     }
-    if (m_texture) {
-        delete m_texture;
+    if (m_offscreenColorTexture) {
+        m_offscreenColorTexture->release();
+    }
+    // Joins the decode workers before the textures they fill go away
+    if (m_textureLoader) {
+        delete m_textureLoader;
+    }
+    // Image textures and static mesh buffers
+    if (m_resourceCache) {
+        delete m_resourceCache;
+    }
+    if (m_grassAlbedoArray) {
+        m_grassAlbedoArray->release();
+    }
+    // After the loader: waits for uploads still in flight
+    if (m_uploadRing) {
+        delete m_uploadRing;
     }
     if (m_camera) {
         delete m_camera;
     }
-    if (m_uniformBuffer) {
-        m_uniformBuffer->release();
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_uniformBuffers[i]) {
+            m_uniformBuffers[i]->release();
+        }
+        if (m_sceneConstantBuffers[i]) {
+            m_sceneConstantBuffers[i]->release();
+        }
+    }
+    m_uniformBuffer = nullptr;
+    if (m_frameSemaphore) {
+        dispatch_release(m_frameSemaphore);
     }
-    if (m_groundPSO) {
-        m_groundPSO->release();
+    if (m_terrain) {
+        delete m_terrain;
     }
-    if (m_groundVertexBuffer) {
-        m_groundVertexBuffer->release();
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_terrainChunkBuffers[i]) {
+            m_terrainChunkBuffers[i]->release();
+        }
     }
-    if (m_groundTexture) {
-        delete m_groundTexture;
+    if (m_noiseTexture) {
+        delete m_noiseTexture;
     }
-    if (m_ballPSO) {
-        m_ballPSO->release();
+    if (m_grassPalette) {
+        delete m_grassPalette;
     }
-    if (m_skyPSO) {
-        m_skyPSO->release();
+    if (m_sparseGround) {
+        delete m_sparseGround;
     }
     if (m_skyDepthStencilState) {
         m_skyDepthStencilState->release();
     }
-    if (m_trampleMapA) {
-        m_trampleMapA->release();
+    if (m_fullscreenDepthStencilState) {
+        m_fullscreenDepthStencilState->release();
     }
-    if (m_trampleMapB) {
-        m_trampleMapB->release();
+    if (m_grassEqualDepthState) {
+        m_grassEqualDepthState->release();
+    }
+    if (m_trampleMap) {
+        m_trampleMap->release();
     }
     if (m_trampleComputePSO) {
         m_trampleComputePSO->release();
     }
-    if (m_ballVertexBuffer) {
-        m_ballVertexBuffer->release();
+    if (m_binInteractorsPSO) {
+        m_binInteractorsPSO->release();
     }
-    if (m_ballIndexBuffer) {
-        m_ballIndexBuffer->release();
+    if (m_trampleClearPSO) {
+        m_trampleClearPSO->release();
     }
-}
-
-void Renderer::draw()
-{
-    // Get Drawable: Call m_metalLayer->nextDrawable() to get the current drawable. If it's null, return early.
-    CA::MetalDrawable* drawable = m_metalLayer->nextDrawable();
-    if (!drawable) {
-        return;
+    for (MTL::Texture* view : m_trampleSummaryMipViews) {
+        if (view) {
+            view->release();
+        }
     }
-    
-    // Create a CommandBuffer
-    MTL::CommandBuffer* commandBuffer = m_commandQueue->commandBuffer();
-    
-    // Create Descriptor: Create a new MTL::RenderPassDescriptor using MTL::RenderPassDescriptor::alloc()->init()
-    MTL::RenderPassDescriptor* renderPassDescriptor = MTL::RenderPassDescriptor::alloc()->init();
-    
-    // Setup Color Attachment with MSAA:
-    // Access renderPassDescriptor->colorAttachments()->object(0)
-    MTL::RenderPassColorAttachmentDescriptor* colorAttachment = renderPassDescriptor->colorAttachments()->object(0);
-    
-    // Render to MSAA texture (4x multisample)
-    if (m_msaaColorTexture) {
-        colorAttachment->setTexture(m_msaaColorTexture);
-        // Resolve to drawable texture
-        colorAttachment->setResolveTexture(drawable->texture());
-    } else {
-        // Fallback: render directly to drawable if MSAA texture not available
-        colorAttachment->setTexture(drawable->texture());
+    if (m_trampleSummary) {
+        m_trampleSummary->release();
     }
-    
-    // Set loadAction to MTL::LoadActionClear
-    colorAttachment->setLoadAction(MTL::LoadActionClear);
-    // Set clearColor to match fog color (0.4, 0.6, 0.9, 1.0) for seamless blending
-    renderPassDescriptor->colorAttachments()->object(0)->setClearColor(MTL::ClearColor(0.4, 0.6, 0.9, 1.0));
-    
-    // Set storeAction: Store and resolve if MSAA, otherwise just store
-    if (m_msaaColorTexture) {
-        colorAttachment->setStoreAction(MTL::StoreActionMultisampleResolve);
-    } else {
-        colorAttachment->setStoreAction(MTL::StoreActionStore);
-    }
-    
-    // Setup Depth Attachment with MSAA:
-    // Check if MSAA depth texture is available
-    if (m_msaaDepthTexture && m_depthTexture) {
-        // Access renderPassDescriptor->depthAttachment()
-        MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = renderPassDescriptor->depthAttachment();
-        // Render to MSAA depth texture
-        depthAttachment->setTexture(m_msaaDepthTexture);
-        // Resolve to non-MSAA depth texture
-        depthAttachment->setResolveTexture(m_depthTexture);
-        // Set loadAction to MTL::LoadActionClear
-        depthAttachment->setLoadAction(MTL::LoadActionClear);
-        // Set storeAction to resolve MSAA depth
-        depthAttachment->setStoreAction(MTL::StoreActionMultisampleResolve);
-        // Set clearDepth to 1.0
-        depthAttachment->setClearDepth(1.0);
-    } else if (m_depthTexture) {
-        // Fallback: use non-MSAA depth texture
-        MTL::RenderPassDepthAttachmentDescriptor* depthAttachment = renderPassDescriptor->depthAttachment();
-        depthAttachment->setTexture(m_depthTexture);
-        depthAttachment->setLoadAction(MTL::LoadActionClear);
-        depthAttachment->setStoreAction(MTL::StoreActionDontCare);
-        depthAttachment->setClearDepth(1.0);
-    }
-    
-    // Update Uniforms struct in m_uniformBuffer
-    if (m_uniformBuffer && m_camera) {
-        // Get drawable size for projection matrix
-        MTL::Texture* drawableTexture = drawable->texture();
-        float width = static_cast<float>(drawableTexture->width());
-        float height = static_cast<float>(drawableTexture->height());
-        
-        // Get view and projection matrices from camera
-        glm::mat4 viewMatrix = m_camera->getViewMatrix();
-        glm::mat4 projectionMatrix = m_camera->getProjectionMatrix(width, height);
-        
-        // Convert glm::mat4 to simd::float4x4 manually
-        Uniforms uniforms;
-        uniforms.viewMatrix = glmToSimd(viewMatrix);
-        uniforms.projectionMatrix = glmToSimd(projectionMatrix);
-        // Update uniforms.time before copying it to the buffer
-        uniforms.time = static_cast<float>(glfwGetTime());
-        
-        // Set uniforms.lightDirection. Use simd::normalize(simd::make_float3(1.0f, 1.0f, -1.0f)) (Simulating a sun from the side)
-        uniforms.lightDirection = simd::normalize(simd::make_float3(1.0f, 1.0f, -1.0f));
-        
-        // Set uniforms.lightColor. Use simd::make_float3(1.0f, 1.0f, 0.9f) (Warm sunlight)
-        uniforms.lightColor = simd::make_float3(1.0f, 1.0f, 0.9f);
-        
-        // Set uniforms.sunDirection for stylized foliage lighting (normalize(1.0, 1.0, 0.5))
-        uniforms.sunDirection = simd::normalize(simd::make_float3(1.0f, 1.0f, 0.5f));
-        
-        // Set uniforms.sunColor (bright warm sunlight)
-        uniforms.sunColor = simd::make_float3(1.0f, 0.95f, 0.85f);
-        
-        // Set uniforms.cameraPosition for cylindrical billboarding
-        glm::vec3 camPos = m_camera->position;
-        uniforms.cameraPosition = simd::make_float3(camPos.x, camPos.y, camPos.z);
-        
-        // Set interactor position (circular motion for demonstration)
-        float radius = 3.0f;
-        float speed = 1.0f;
-        float time = uniforms.time;
-        simd::float3 currentInteractorPos = simd::make_float3(
-            sin(time * speed) * radius,
-            0.0f,  // Ball Y position: ground is at -0.5f, ball radius is 0.5f, so center at 0.0f to touch ground
-            cos(time * speed) * radius
-        );
-        uniforms.interactorPos = currentInteractorPos;
-        uniforms.interactorRadius = 1.0f;
-        
-        // Trample map system: Set ball position and radius
-        uniforms.ballWorldPos = currentInteractorPos;
-        uniforms.ballRadius = uniforms.interactorRadius;
-        
-        // Ground bounds for world->UV mapping (matches SCENE_SIZE)
-        uniforms.groundMinXZ = simd::make_float2(-SCENE_SIZE, -SCENE_SIZE);
-        uniforms.groundMaxXZ = simd::make_float2(SCENE_SIZE, SCENE_SIZE);
-        
-        // Time step (delta time) - approximate from frame time
-        // For now, use a fixed small value (will be improved with proper delta time tracking)
-        static float lastTime = 0.0f;
-        float currentTime = uniforms.time;
-        uniforms.dt = (currentTime - lastTime > 0.0f) ? (currentTime - lastTime) : (1.0f / 60.0f); // Default to 60fps if no delta
-        lastTime = currentTime;
-        
-        // Trample decay rate (default: 0.35 for ~3 seconds recovery)
-        uniforms.trampleDecayRate = 0.35f;
-        
-        // Debug visualization toggle
-        uniforms.showTrampleMap = m_showTrampleMap ? 1.0f : 0.0f;
-        
-        // Soft interaction parameters (Ghibli-like)
-        uniforms.flattenBandWidth = uniforms.ballRadius * 0.35f;
-        uniforms.flattenStrength = 0.75f;
-        uniforms.contactShadowRadius = uniforms.ballRadius * 0.90f;
-        uniforms.contactShadowStrength = 0.55f;
-        
-        // Copy uniforms to buffer
-        void* uniformContents = m_uniformBuffer->contents();
-        memcpy(uniformContents, &uniforms, sizeof(Uniforms));
+    if (m_trampleDirtyTileBuffer) {
+        m_trampleDirtyTileBuffer->release();
     }
-    
-    // ============================================================
-    // UPDATE TRAMPLE MAP (Compute Shader)
-    // ============================================================
-    if (m_trampleComputePSO && m_trampleMapA && m_trampleMapB) {
-        // Create compute command encoder
-        MTL::ComputeCommandEncoder* computeEncoder = commandBuffer->computeCommandEncoder();
-        
-        if (computeEncoder) {
-            // Set compute pipeline
-            computeEncoder->setComputePipelineState(m_trampleComputePSO);
-            
-            // Determine input and output textures (ping-pong)
-            MTL::Texture* inputTexture = m_trampleMapSwap ? m_trampleMapB : m_trampleMapA;
-            MTL::Texture* outputTexture = m_trampleMapSwap ? m_trampleMapA : m_trampleMapB;
-            
-            // Set textures
-            computeEncoder->setTexture(inputTexture, 0);  // Input (read)
-            computeEncoder->setTexture(outputTexture, 1); // Output (write)
-            
-            // Set uniform buffer
-            computeEncoder->setBuffer(m_uniformBuffer, 0, 0);
-            
-            // Calculate threadgroup size (assuming 16x16 threads per group)
-            const int threadGroupSize = 16;
-            MTL::Size threadgroupSize = MTL::Size(threadGroupSize, threadGroupSize, 1);
-            MTL::Size threadgroupCount = MTL::Size(
-                (inputTexture->width() + threadGroupSize - 1) / threadGroupSize,
-                (inputTexture->height() + threadGroupSize - 1) / threadGroupSize,
-                1
-            );
-            
-            // Dispatch compute shader
-            computeEncoder->dispatchThreadgroups(threadgroupCount, threadgroupSize);
-            
-            // End encoding
-            computeEncoder->endEncoding();
-            computeEncoder->release();
-            
-            // Swap ping-pong buffers
-            m_trampleMapSwap = !m_trampleMapSwap;
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_trampleTileCountBuffers[i]) {
+            m_trampleTileCountBuffers[i]->release();
         }
     }
-    
-    // Encode & Commit: Use this manually created descriptor to create the encoder, draw primitives, present the drawable, and commit
-    // Create a RenderCommandEncoder
-    MTL::RenderCommandEncoder* renderEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
-    
-    // Pass 0: Sky (fullscreen gradient, always behind everything)
-    if (m_skyPSO && m_skyDepthStencilState) {
-        // Set sky pipeline state
-        renderEncoder->setRenderPipelineState(m_skyPSO);
-        
-        // Set sky depth stencil state (always pass, no write)
-        renderEncoder->setDepthStencilState(m_skyDepthStencilState);
-        
-        // Draw fullscreen triangle (no vertex buffer needed)
-        renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
-    }
-    
-    // Set depth stencil state (shared for all other passes)
-    renderEncoder->setDepthStencilState(m_depthStencilState);
-    
-    // Pass 1: Ground
-
-    if (m_groundPSO && m_groundVertexBuffer && m_groundTexture && m_groundTexture->getMetalTexture()) {
-        // Explicit Binding: Set the correct PSO
-        renderEncoder->setRenderPipelineState(m_groundPSO);
-        
-        // Explicit Binding: Bind the ground vertex buffer
-        renderEncoder->setVertexBuffer(m_groundVertexBuffer, 0, BufferIndexMeshPositions);
-        
-        // Explicit Binding: Bind the uniform buffer (for both vertex and fragment shaders)
-        renderEncoder->setVertexBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
-        renderEncoder->setFragmentBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
-        
-        // Explicit Binding: Bind the ground texture
-        renderEncoder->setFragmentTexture(m_groundTexture->getMetalTexture(), 0);
-        
-        // Draw the ground (6 vertices = 2 triangles)
-        renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(6));
-    } else {
-        std::cerr << "Warning: Ground rendering skipped - missing resources" << std::endl;
+    if (m_trampleReducePSO) {
+        m_trampleReducePSO->release();
     }
-    
-    // Pass 2: Grass
-    
-    // Explicit Binding: Set the correct PSO
-    renderEncoder->setRenderPipelineState(m_pso);
-    
-    // Explicit Binding: Re-bind Vertex Buffer
-    renderEncoder->setVertexBuffer(m_vertexBuffer, 0, BufferIndexMeshPositions);
-    
-    // Explicit Binding: Bind Instance Buffer
-    renderEncoder->setVertexBuffer(m_instanceBuffer, 0, BufferIndexInstanceData);
-    
-    // Explicit Binding: Bind Uniform Buffer
-    renderEncoder->setVertexBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
-    
-    // Explicit Binding: Bind Grass Texture
-    renderEncoder->setFragmentTexture(m_texture->getMetalTexture(), TextureIndexGrass);
-    
-    // Bind Trample Map to grass shader
-    MTL::Texture* currentTrampleMap = m_trampleMapSwap ? m_trampleMapA : m_trampleMapB;
-    if (currentTrampleMap) {
-        renderEncoder->setFragmentTexture(currentTrampleMap, TextureIndexTrampleMap);
+    if (m_trampleSummaryDownsamplePSO) {
+        m_trampleSummaryDownsamplePSO->release();
     }
-    
-    // Draw Instanced Grass
-    renderEncoder->drawIndexedPrimitives(
-        MTL::PrimitiveTypeTriangle,
-        NS::UInteger(kGrassIndexCount),
-        MTL::IndexTypeUInt16,
-        m_indexBuffer,
-        NS::UInteger(0),
-        NS::UInteger(30000));
-    
-    // Pass 3: Ball (Interactor Visualization)
-    if (m_ballPSO && m_ballVertexBuffer && m_ballIndexBuffer && m_ballIndexCount > 0) {
-        // Set ball pipeline state
-        renderEncoder->setRenderPipelineState(m_ballPSO);
-        
-        // Set depth stencil state (standard read/write)
-        renderEncoder->setDepthStencilState(m_depthStencilState);
-        
-        // Set vertex buffer (ball mesh)
-        renderEncoder->setVertexBuffer(m_ballVertexBuffer, 0, BufferIndexMeshPositions);
-        
-        // Set uniform buffer
-        renderEncoder->setVertexBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
-        renderEncoder->setFragmentBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
-        
-        // Draw ball
-        renderEncoder->drawIndexedPrimitives(
-            MTL::PrimitiveTypeTriangle,
-            NS::UInteger(m_ballIndexCount),
-            MTL::IndexTypeUInt16,
-            m_ballIndexBuffer,
-            NS::UInteger(0));
+    if (m_windField) {
+        m_windField->release();
     }
-    
-    // End encoding
-    renderEncoder->endEncoding();
-    
-    // Present the drawable
-    commandBuffer->presentDrawable(drawable);
-    
-    // Commit the command buffer
-    commandBuffer->commit();
-    
-    // Memory Management: Release the descriptor (created with alloc()->init(), so we need to release it)
-    renderPassDescriptor->release();
-    drawable->release();
-}
-
-void Renderer::buildShaders()
-{
-    // Load the library from Shaders.metal (using device->newDefaultLibrary())
-    NS::Error* error = nullptr;
-    MTL::Library* library = m_device->newDefaultLibrary();
-    
-    if (!library) {
-        std::cerr << "Failed to load default Metal library" << std::endl;
-        return;
+    if (m_windFieldPSO) {
+        m_windFieldPSO->release();
     }
-    
-    // Get "vertexMain" and "fragmentMain" functions
-    NS::String* vertexFunctionName = NS::String::string("vertexMain", NS::ASCIIStringEncoding);
-    NS::String* fragmentFunctionName = NS::String::string("fragmentMain", NS::ASCIIStringEncoding);
-    
-    MTL::Function* vertexFunction = library->newFunction(vertexFunctionName);
-    MTL::Function* fragmentFunction = library->newFunction(fragmentFunctionName);
-    
-    if (!vertexFunction || !fragmentFunction) {
-        std::cerr << "Failed to load shader functions" << std::endl;
-        if (vertexFunction) vertexFunction->release();
-        if (fragmentFunction) fragmentFunction->release();
-        library->release();
-        return;
+    for (MTL::ComputePipelineState* pso : { m_windAdvectPSO, m_windSplatPSO, m_windDivergencePSO, m_windPressurePSO,
+                                            m_windProjectPSO, m_windFieldFluidPSO, m_windGustPSO }) {
+        if (pso) {
+            pso->release();
+        }
     }
-    
-    // Create a MTL::RenderPipelineDescriptor
-    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-    
-    // Set vertex/fragment functions
-    pipelineDescriptor->setVertexFunction(vertexFunction);
-    pipelineDescriptor->setFragmentFunction(fragmentFunction);
-    
-    // Set colorAttachments[0].pixelFormat to MTLPixelFormatBGRA8Unorm
-    MTL::RenderPipelineColorAttachmentDescriptor* colorAttachment = pipelineDescriptor->colorAttachments()->object(0);
-    colorAttachment->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    
-    // Set depth pixel format
-    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-    
-    // Enable 4x MSAA for grass rendering
-    pipelineDescriptor->setSampleCount(4);
-    
-    // Enable Alpha-to-Coverage for smooth grass edges
-    pipelineDescriptor->setAlphaToCoverageEnabled(true);
-    
-    // Create m_pso using device->newRenderPipelineState. Handle errors if any.
-    m_pso = m_device->newRenderPipelineState(pipelineDescriptor, &error);
-    
-    if (!m_pso) {
-        if (error) {
-            NS::String* errorString = error->localizedDescription();
-            std::cerr << "Failed to create render pipeline state: " << errorString->utf8String() << std::endl;
-            errorString->release();
-        } else {
-            std::cerr << "Failed to create render pipeline state" << std::endl;
+    for (MTL::Buffer* buffer : { m_windVelocityBuffers[0], m_windVelocityBuffers[1], m_windScratchBuffer,
+                                 m_windPressureBuffers[0], m_windPressureBuffers[1], m_windDivergenceBuffer,
+                                 m_windGustBuffer }) {
+        if (buffer) {
+            buffer->release();
         }
     }
-    
-    // Release resources (keep library for ground shaders)
-    vertexFunction->release();
-    fragmentFunction->release();
-    vertexFunctionName->release();
-    fragmentFunctionName->release();
-    
-    // Load Ground Shaders
-    NS::String* groundVertexFunctionName = NS::String::string("groundVertexMain", NS::ASCIIStringEncoding);
-    NS::String* groundFragmentFunctionName = NS::String::string("groundFragmentMain", NS::ASCIIStringEncoding);
-    
-    MTL::Function* groundVertexFunction = library->newFunction(groundVertexFunctionName);
-    MTL::Function* groundFragmentFunction = library->newFunction(groundFragmentFunctionName);
-    
-    if (!groundVertexFunction || !groundFragmentFunction) {
-        std::cerr << "Failed to load ground shader functions" << std::endl;
-        if (groundVertexFunction) groundVertexFunction->release();
-        if (groundFragmentFunction) groundFragmentFunction->release();
-        groundVertexFunctionName->release();
-        groundFragmentFunctionName->release();
-        library->release();
-        pipelineDescriptor->release();
-        return;
+    if (m_atmosphereLut) {
+        m_atmosphereLut->release();
     }
-    
-    // Create ground pipeline descriptor
-    MTL::RenderPipelineDescriptor* groundPipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-    groundPipelineDescriptor->setVertexFunction(groundVertexFunction);
-    groundPipelineDescriptor->setFragmentFunction(groundFragmentFunction);
-    
-    // Set color attachment pixel format
-    MTL::RenderPipelineColorAttachmentDescriptor* groundColorAttachment = groundPipelineDescriptor->colorAttachments()->object(0);
-    groundColorAttachment->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    
-    // Set depth pixel format
-    groundPipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-    
-    // Enable 4x MSAA for ground rendering (optional, but consistent)
-    groundPipelineDescriptor->setSampleCount(4);
-    
-    // Create m_groundPSO
-    m_groundPSO = m_device->newRenderPipelineState(groundPipelineDescriptor, &error);
-    
-    if (!m_groundPSO) {
-        if (error) {
-            NS::String* errorString = error->localizedDescription();
-            std::cerr << "Failed to create ground render pipeline state: " << errorString->utf8String() << std::endl;
-            errorString->release();
-        } else {
-            std::cerr << "Failed to create ground render pipeline state" << std::endl;
-        }
+    if (m_atmosphereLutPSO) {
+        m_atmosphereLutPSO->release();
     }
-    
-    // Release ground shader resources
-    groundVertexFunction->release();
-    groundFragmentFunction->release();
-    groundPipelineDescriptor->release();
-    groundVertexFunctionName->release();
-    groundFragmentFunctionName->release();
-    
-    // Load Ball Shaders
-    NS::String* ballVertexFunctionName = NS::String::string("vertexBall", NS::ASCIIStringEncoding);
-    NS::String* ballFragmentFunctionName = NS::String::string("fragmentBall", NS::ASCIIStringEncoding);
-    
-    MTL::Function* ballVertexFunction = library->newFunction(ballVertexFunctionName);
-    MTL::Function* ballFragmentFunction = library->newFunction(ballFragmentFunctionName);
-    
-    if (!ballVertexFunction || !ballFragmentFunction) {
-        std::cerr << "Failed to load ball shader functions" << std::endl;
-        if (ballVertexFunction) ballVertexFunction->release();
-        if (ballFragmentFunction) ballFragmentFunction->release();
-        ballVertexFunctionName->release();
-        ballFragmentFunctionName->release();
-    } else {
-        // Create ball pipeline descriptor
-        MTL::RenderPipelineDescriptor* ballPipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-        ballPipelineDescriptor->setVertexFunction(ballVertexFunction);
-        ballPipelineDescriptor->setFragmentFunction(ballFragmentFunction);
-        
-        // Set color attachment pixel format
-        MTL::RenderPipelineColorAttachmentDescriptor* ballColorAttachment = ballPipelineDescriptor->colorAttachments()->object(0);
-        ballColorAttachment->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-        
-        // Set depth pixel format
-        ballPipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-        
-        // Enable 4x MSAA for consistency
-        ballPipelineDescriptor->setSampleCount(4);
-        
-        // Create m_ballPSO
-        m_ballPSO = m_device->newRenderPipelineState(ballPipelineDescriptor, &error);
-        
-        if (!m_ballPSO) {
-            if (error) {
-                NS::String* errorString = error->localizedDescription();
-                std::cerr << "Failed to create ball render pipeline state: " << errorString->utf8String() << std::endl;
-                errorString->release();
-            } else {
-                std::cerr << "Failed to create ball render pipeline state" << std::endl;
-            }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_pointLightBuffers[i]) {
+            m_pointLightBuffers[i]->release();
         }
-        
-        // Release ball shader resources
-        ballVertexFunction->release();
-        ballFragmentFunction->release();
-        ballPipelineDescriptor->release();
-        ballVertexFunctionName->release();
-        ballFragmentFunctionName->release();
     }
-    
-    // Load Sky Shaders
-    MTL::Library* skyLibrary = m_device->newDefaultLibrary();
-    if (skyLibrary) {
-        NS::String* skyVertexFunctionName = NS::String::string("vertexSkyFullscreen", NS::ASCIIStringEncoding);
-        NS::String* skyFragmentFunctionName = NS::String::string("fragmentSkyGradient", NS::ASCIIStringEncoding);
-        
-        MTL::Function* skyVertexFunction = skyLibrary->newFunction(skyVertexFunctionName);
-        MTL::Function* skyFragmentFunction = skyLibrary->newFunction(skyFragmentFunctionName);
-        
-        if (!skyVertexFunction || !skyFragmentFunction) {
-            std::cerr << "Failed to load sky shader functions" << std::endl;
-            if (skyVertexFunction) skyVertexFunction->release();
-            if (skyFragmentFunction) skyFragmentFunction->release();
-            skyVertexFunctionName->release();
-            skyFragmentFunctionName->release();
-        } else {
-            // Create sky pipeline descriptor
-            MTL::RenderPipelineDescriptor* skyPipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-            skyPipelineDescriptor->setVertexFunction(skyVertexFunction);
-            skyPipelineDescriptor->setFragmentFunction(skyFragmentFunction);
-            
-            // Set color attachment pixel format (match existing PSOs)
-            MTL::RenderPipelineColorAttachmentDescriptor* skyColorAttachment = skyPipelineDescriptor->colorAttachments()->object(0);
-            skyColorAttachment->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-            
-            // Set depth pixel format (same as others, but we'll disable depth test for sky)
-            skyPipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
-            
-            // No MSAA for sky (fullscreen triangle, no need)
-            skyPipelineDescriptor->setSampleCount(1);
-            
-            // Create m_skyPSO
-            m_skyPSO = m_device->newRenderPipelineState(skyPipelineDescriptor, &error);
-            
-            if (!m_skyPSO) {
-                if (error) {
-                    NS::String* errorString = error->localizedDescription();
-                    std::cerr << "Failed to create sky render pipeline state: " << errorString->utf8String() << std::endl;
-                    errorString->release();
-                } else {
-                    std::cerr << "Failed to create sky render pipeline state" << std::endl;
-                }
+    if (m_lightClusterBuffer) {
+        m_lightClusterBuffer->release();
+    }
+    if (m_lightClusterPSO) {
+        m_lightClusterPSO->release();
+    }
+    delete m_externalControl;
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        for (MTL::Buffer* buffer : { m_interactorBuffers[i], m_windGustPlacementBuffers[i], m_windGustFlowBuffers[i] }) {
+            if (buffer) {
+                buffer->release();
             }
-            
-            // Release sky shader resources
-            skyVertexFunction->release();
-            skyFragmentFunction->release();
-            skyPipelineDescriptor->release();
-            skyVertexFunctionName->release();
-            skyFragmentFunctionName->release();
         }
-        
-        skyLibrary->release();
     }
-    
-    // Release library and pipeline descriptor
-    library->release();
-    pipelineDescriptor->release();
-    
-    // Create a MTL::DepthStencilDescriptor
-    MTL::DepthStencilDescriptor* depthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
-    
-    // Set depthCompareFunction to MTL::CompareFunctionLess
-    depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
-    
-    // Set depthWriteEnabled to true
-    depthStencilDescriptor->setDepthWriteEnabled(true);
-    
-    // Create m_depthStencilState using device->newDepthStencilState
-    m_depthStencilState = m_device->newDepthStencilState(depthStencilDescriptor);
-    
-    if (!m_depthStencilState) {
-        std::cerr << "Failed to create depth stencil state" << std::endl;
+    if (m_interactorBinBuffer) {
+        m_interactorBinBuffer->release();
     }
-    
-    // Release descriptor
+    if (m_interactorPhysicsPSO) {
+        m_interactorPhysicsPSO->release();
+    }
+    if (m_interactorBodyBuffer) {
+        m_interactorBodyBuffer->release();
+    }
+    if (m_bladePhysicsPSO) {
+        m_bladePhysicsPSO->release();
+    }
+    if (m_bladeStateBuffer) {
+        m_bladeStateBuffer->release();
+    }
+    if (m_trampleStagingBuffer) {
+        m_trampleStagingBuffer->release();
+    }
+    if (m_trampleQueryPSO) {
+        m_trampleQueryPSO->release();
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_trampleQueryPointBuffers[i]) {
+            m_trampleQueryPointBuffers[i]->release();
+        }
+        if (m_trampleQueryResultBuffers[i]) {
+            m_trampleQueryResultBuffers[i]->release();
+        }
+        if (m_objectPickResultBuffers[i]) {
+            m_objectPickResultBuffers[i]->release();
+        }
+    }
+    if (m_pickObjectIdsPSO) {
+        m_pickObjectIdsPSO->release();
+    }
+    if (m_pickObjectIdsMultisampledPSO) {
+        m_pickObjectIdsMultisampledPSO->release();
+    }
+    if (m_temporalResolvePSO) {
+        m_temporalResolvePSO->release();
+    }
+    if (m_cullComputePSO) {
+        m_cullComputePSO->release();
+    }
+    if (m_resetDrawArgsPSO) {
+        m_resetDrawArgsPSO->release();
+    }
+    if (m_visibleInstanceBuffer) {
+        m_bufferHeap->release(m_visibleInstanceBuffer);
+    }
+    if (m_grassDrawArgsBuffer) {
+        m_grassDrawArgsBuffer->release();
+    }
+    if (m_sortCellsPSO) {
+        m_sortCellsPSO->release();
+    }
+    if (m_cellOrderBuffer) {
+        m_cellOrderBuffer->release();
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_grassResourceTables[i]) {
+            m_grassResourceTables[i]->release();
+        }
+    }
+    if (m_hiZFromDepthPSO) {
+        m_hiZFromDepthPSO->release();
+    }
+    if (m_hiZDownsamplePSO) {
+        m_hiZDownsamplePSO->release();
+    }
+    releaseHiZPyramid();
+    if (m_cellBuffer) {
+        m_bufferHeap->release(m_cellBuffer);
+    }
+    if (m_cpuCellReadback) {
+        m_cpuCellReadback->release();
+    }
+    if (m_cpuCellReadbackBuffer) {
+        m_cpuCellReadbackBuffer->release();
+    }
+    delete m_cpuCellCuller;
+    if (m_grassField) {
+        delete m_grassField;
+    }
+    if (m_grassStreamer) {
+        delete m_grassStreamer;
+    }
+    if (m_instanceFile) {
+        delete m_instanceFile; // After m_instanceBuffer / m_cellBuffer, which alias its pages
+    }
+    if (m_grassEditor) {
+        delete m_grassEditor;
+    }
+    if (m_generateGrassPSO) {
+        m_generateGrassPSO->release();
+    }
+    if (m_paintGrassDensityPSO) {
+        m_paintGrassDensityPSO->release();
+    }
+    if (m_grassDensityMap) {
+        delete m_grassDensityMap;
+    }
+    if (m_grassPlacedCountBuffer) {
+        m_grassPlacedCountBuffer->release();
+    }
+    if (m_tilePostPSO) {
+        m_tilePostPSO->release();
+    }
+    if (m_meshGrassPSO) {
+        m_meshGrassPSO->release();
+    }
+    if (m_impostorAtlas) {
+        delete m_impostorAtlas;
+    }
+    if (m_shadowMaps) {
+        delete m_shadowMaps;
+    }
+    if (m_impostorBuffer) {
+        m_impostorBuffer->release();
+    }
+    if (m_impostorDrawArgsBuffer) {
+        m_impostorDrawArgsBuffer->release();
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_sceneICBs[i]) {
+            m_sceneICBs[i]->release();
+        }
+    }
+    if (m_grassICB) {
+        m_grassICB->release();
+    }
+    if (m_grassICBArgumentBuffer) {
+        m_grassICBArgumentBuffer->release();
+    }
+    if (m_encodeGrassCommandsPSO) {
+        m_encodeGrassCommandsPSO->release();
+    }
+    if (m_renderGraph) {
+        delete m_renderGraph;
+    }
+    if (m_shaderWatcher) {
+        delete m_shaderWatcher;
+    }
+    if (m_pipelineCache) {
+        delete m_pipelineCache; // Owns the scene render pipelines; waits for builds in flight
+    }
+    if (m_pipelineArchive) {
+        delete m_pipelineArchive;
+    }
+    if (m_profiler) {
+        delete m_profiler;
+    }
+    if (m_breadcrumbs) {
+        delete m_breadcrumbs;
+    }
+    if (m_frameCapture) {
+        delete m_frameCapture;
+    }
+    if (m_videoRecorder) {
+        delete m_videoRecorder; // Flushes a recording still running
+    }
+    if (m_readback) {
+        delete m_readback; // Runs the callbacks of completed frames first (needs the job system)
+    }
+    if (m_residency) {
+        delete m_residency; // Drops the set's references to the resources released around it
+    }
+    if (m_gpuMemory) {
+        delete m_gpuMemory;
+    }
+    if (m_trace) {
+        delete m_trace;
+    }
+    if (m_inputRecording) {
+        delete m_inputRecording;
+    }
+    if (m_overlay) {
+        delete m_overlay;
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_cullStatsBuffers[i]) {
+            m_cullStatsBuffers[i]->release();
+        }
+    }
+    if (m_rasterizationRate) {
+        delete m_rasterizationRate;
+    }
+    if (m_dynamicResolution) {
+        delete m_dynamicResolution;
+    }
+    if (m_qualityGovernor) {
+        delete m_qualityGovernor;
+    }
+    if (m_temporalAntialiasing) {
+        delete m_temporalAntialiasing;
+    }
+    if (m_targetHeap) {
+        delete m_targetHeap; // After every texture placed in it
+    }
+    if (m_jobSystem) {
+        delete m_jobSystem;
+    }
+    if (m_trampleSnapshot) {
+        delete m_trampleSnapshot; // After a snapshot load job that may still set it
+    }
+    if (m_computeDispatch) {
+        delete m_computeDispatch;
+    }
+    if (m_bufferHeap) {
+        delete m_bufferHeap; // After every buffer placed in it
+    }
+}
+
+void Renderer::attachOverlay(GLFWwindow* window, bool packetInput)
+{
+    if (!m_overlay && window) {
+        m_overlay = new PerformanceOverlay(window, m_device, packetInput);
+    }
+}
+
+void Renderer::setFixedTime(float time)
+{
+    m_fixedTime = time;
+    m_useFixedTime = true;
+}
+
+bool Renderer::setExternalControl(const std::string& name)
+{
+    // Frames in flight may still draw from the current channel's slots
+    waitUntilIdle();
+    delete m_externalControl;
+    m_externalControl = nullptr;
+    m_externalFrame = nullptr;
+    m_frameInteractorBuffer = m_interactorBuffers[m_frameIndex];
+    if (name.empty()) {
+        std::cout << "External control: OFF" << std::endl;
+        return true;
+    }
+    
+    m_externalControl = new ExternalControl(name, m_device);
+    if (!m_externalControl->isValid()) {
+        delete m_externalControl;
+        m_externalControl = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Renderer::setInteractorCount(int count)
+{
+    count = std::clamp(count, 1, MAX_INTERACTORS);
+    int previous = static_cast<int>(m_interactors.size());
+    if (count != previous) {
+        m_interactorPhysicsReset = true; // New bodies need their initial state
+    }
+    // Removed from the end, so no record moves. They are zeroed in every slot (radius 0 stamps and
+    // bins nothing), so the frames already in flight with the old count stop trampling with them too
+    while (static_cast<int>(m_interactorHandles.size()) > count) {
+        m_interactors.remove(m_interactorHandles.back());
+        m_interactorHandles.pop_back();
+    }
+    for (int i = 0; count < previous && i < kMaxFramesInFlight; ++i) {
+        if (m_interactorBuffers[i]) {
+            Interactor* interactors = static_cast<Interactor*>(m_interactorBuffers[i]->contents());
+            std::memset(interactors + count, 0, sizeof(Interactor) * (previous - count));
+        }
+    }
+    // New ones start where their orbit begins; the next scripted frame writes both streams out
+    while (static_cast<int>(m_interactorHandles.size()) < count) {
+        int index = static_cast<int>(m_interactorHandles.size());
+        Interactor start = interactorAt(index, 0.0f, 0.0f);
+        m_interactorHandles.push_back(m_interactors.add({ start.position, start.prevPosition, start.radius }, scriptedShape(index)));
+    }
+    m_interactorCount = count;
+}
+
+Renderer::InteractorShape Renderer::scriptedShape(int index) const
+{
+    // Under physics every third stand-in is an upright capsule (a player / NPC) instead of a sphere
+    Interactor interactor = interactorAt(index, 0.0f, 0.0f);
+    InteractorShape shape = { interactor.falloff, interactor.bodyRadius, interactor.halfHeight, interactor.material };
+    if (m_interactorCapsules && index > 0 && index % 3 == 2) {
+        shape.halfHeight = shape.bodyRadius;
+    }
+    return shape;
+}
+
+void Renderer::setInteractorPhysics(bool enabled)
+{
+    if (enabled && !m_interactorPhysicsPSO) {
+        std::cerr << "Interactor physics unavailable (no simulation pipeline)" << std::endl;
+        enabled = false;
+    }
+    if (enabled && !m_interactorPhysicsEnabled) {
+        m_interactorPhysicsReset = true;
+        m_simulationClocks[SimulationPhysics].setRate(m_simulationClocks[SimulationPhysics].getRate());
+    }
+    m_interactorPhysicsEnabled = enabled;
+}
+
+bool Renderer::setBladePhysics(float radius)
+{
+    if (radius <= 0.0f) {
+        m_bladePhysicsRadius = 0.0f;
+        return true;
+    }
+    if (!m_bladePhysicsPSO) {
+        std::cerr << "Blade physics unavailable (no simulation pipeline)" << std::endl;
+        return false;
+    }
+    if (!m_bladeStateBuffer) {
+        // One state per blade of the largest field, at rest (zero bend and velocity)
+        m_bladeStateBuffer = m_device->newBuffer(sizeof(BladeState) * m_grassInstanceCapacity, MTL::ResourceStorageModePrivate);
+        if (!m_bladeStateBuffer) {
+            std::cerr << "Failed to create blade state buffer" << std::endl;
+            return false;
+        }
+        MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+        MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+        if (blitEncoder) {
+            blitEncoder->fillBuffer(m_bladeStateBuffer, NS::Range::Make(0, m_bladeStateBuffer->length()), 0);
+            blitEncoder->endEncoding();
+        }
+        commandBuffer->commit();
+    }
+    m_bladePhysicsRadius = radius;
+    return true;
+}
+
+void Renderer::setParallelEncoding(bool enabled)
+{
+    m_parallelEncoding = enabled;
+}
+
+MTL::CommandBuffer* Renderer::newOutOfGraphCommandBuffer()
+{
+    ++m_outOfGraphCommandBuffers;
+    return m_commandQueue->commandBuffer();
+}
+
+void Renderer::setAsyncCompute(bool enabled)
+{
+    m_asyncCompute = enabled && m_asyncComputeQueue;
+    m_renderGraph->setAsyncComputeQueue(m_asyncCompute ? m_asyncComputeQueue : nullptr);
+}
+
+bool Renderer::captureFrames(int frameCount, const std::string& path)
+{
+    return m_frameCapture->request(frameCount, path);
+}
+
+void Renderer::setCaptureTrigger(double thresholdMs, int frameCount, const std::string& directory)
+{
+    m_frameCapture->setAutoTrigger(thresholdMs, frameCount, directory);
+}
+
+bool Renderer::startVideoRecording(const std::string& path, double framesPerSecond)
+{
+    if (!m_depthTexture) {
+        return false;
+    }
+    if (!m_videoRecorder) {
+        m_videoRecorder = new VideoRecorder(m_device);
+    }
+    // The copy reads the drawable (drawables already handed out stay framebuffer-only and are skipped)
+    if (m_metalLayer) {
+        m_metalLayer->setFramebufferOnly(false);
+    }
+    // Frames come out at the output size and format: the drawable's, or the offscreen target's
+    MTL::PixelFormat format = m_metalLayer ? m_metalLayer->pixelFormat() : MTL::PixelFormatBGRA8Unorm;
+    return m_videoRecorder->start(path, static_cast<uint32_t>(m_depthTexture->width()), static_cast<uint32_t>(m_depthTexture->height()),
+                                  format, framesPerSecond);
+}
+
+void Renderer::stopVideoRecording()
+{
+    if (isVideoRecording()) {
+        // The encoder consumes every surface submitted by frames in flight first
+        waitUntilIdle();
+        m_videoRecorder->stop();
+    }
+}
+
+bool Renderer::isVideoRecording() const
+{
+    return m_videoRecorder && m_videoRecorder->isRecording();
+}
+
+bool Renderer::readbackRenderTarget(ReadbackTarget target, int level, TextureReadback::Callback callback)
+{
+    if (!callback || level < 0) {
+        return false;
+    }
+    if (target == ReadbackTargetOutput && m_metalLayer) {
+        m_metalLayer->setFramebufferOnly(false); // Drawables handed out earlier cannot be copied
+    }
+    m_pendingReadbacks.push_back({ target, level, std::move(callback), 0 });
+    return true;
+}
+
+bool Renderer::saveRenderTarget(ReadbackTarget target, int level, const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    return readbackRenderTarget(target, level, [path, hasExtension](const ReadbackImage& image) {
+        std::string file = hasExtension ? path : path + readbackImageExtension(image.pixelFormat);
+        if (writeReadbackImage(image, file)) {
+            std::cout << "Saved " << file << " (" << image.width << "x" << image.height << ")" << std::endl;
+        }
+    });
+}
+
+void Renderer::waitForReadbacks()
+{
+    waitUntilIdle();
+    m_readback->waitForCallbacks();
+}
+
+void Renderer::setTraceRecording(bool enabled)
+{
+    if (enabled && !m_trace->isEnabled()) {
+        m_trace->clear();
+    }
+    m_trace->setEnabled(enabled);
+}
+
+bool Renderer::isTraceRecording() const
+{
+    return m_trace->isEnabled();
+}
+
+bool Renderer::writeTrace(const std::string& path) const
+{
+    return m_trace->write(path);
+}
+
+void Renderer::startInputRecording()
+{
+    if (m_inputRecording) {
+        return;
+    }
+    m_inputRecording = new InputRecording();
+    m_inputRecording->seed = m_grassSeed;
+    m_inputRecording->startPosition = m_camera->position;
+    m_inputRecording->startYaw = m_camera->yaw;
+    m_inputRecording->startPitch = m_camera->pitch;
+    m_firstMouse = true; // The first recorded frame moves nothing, live and in the replay
+    std::cout << "Input recording: ON (seed " << m_grassSeed << ")" << std::endl;
+}
+
+bool Renderer::stopInputRecording(const std::string& path)
+{
+    if (!m_inputRecording) {
+        return false;
+    }
+    bool written = m_inputRecording->save(path);
+    delete m_inputRecording;
+    m_inputRecording = nullptr;
+    return written;
+}
+
+void Renderer::beginInputReplay(const InputRecording& recording)
+{
+    if (recording.seed != m_grassSeed) {
+        std::cerr << "Replaying a recording of seed " << recording.seed << " in a field of seed " << m_grassSeed
+                  << ": the camera path repeats, the grass does not" << std::endl;
+    }
+    setCameraPose(recording.startPosition, recording.startYaw, recording.startPitch);
+    m_firstMouse = true;
+}
+
+static const char* const kMicrobenchNames[Renderer::MicrobenchCount] = {
+    "trampleStamp", "cull", "generate", "grassVertex", "grassFragment"
+};
+static constexpr int kMicrobenchWarmup = 4;       // Untimed command buffers per run (clocks ramping up)
+static constexpr int kMicrobenchDefaultLayers = 8; // Full-screen layers of the fragment stack without a size
+
+const char* Renderer::microbenchName(Microbenchmark kind)
+{
+    return kind >= 0 && kind < MicrobenchCount ? kMicrobenchNames[kind] : "unknown";
+}
+
+bool Renderer::runMicrobenchmark(Microbenchmark kind, int size, int samples, MicrobenchResult& result)
+{
+    NS::SharedPtr<NS::AutoreleasePool> pool = NS::TransferPtr(NS::AutoreleasePool::alloc()->init());
+    result = MicrobenchResult();
+    
+    // A new trample map size needs one frame to place its window and stamp into it
+    if (kind == MicrobenchTrampleStamp && size > 0 && size != getTrampleMapSize()) {
+        if (!setTrampleMapSize(size)) {
+            return false;
+        }
+        draw();
+    }
+    // Every workload reads what the last frame left in its slot (m_frameIndex)
+    waitUntilIdle();
+    
+    MTL::Buffer* interactorBuffer = m_frameInteractorBuffer;
+    CullUniforms cullUniforms = m_microbenchCull;
+    cullUniforms.hiZEnabled = 0; // Last frame's depth is not rebuilt into the pyramid
+    NS::UInteger footprint = 0;
+    int layers = size > 0 ? size : kMicrobenchDefaultLayers;
+    
+    // Draws go into targets of their own at the scene's size and sample count, through the
+    // scene's grass permutation
+    MTL::RenderPipelineState* pipeline = nullptr;
+    MTL::RenderPassDescriptor* passDescriptor = nullptr;
+    MTL::Texture* colorTarget = nullptr;
+    MTL::Texture* depthTarget = nullptr;
+    MTL::Buffer* drawArgsCopy = nullptr;
+    
+    if (kind == MicrobenchTrampleStamp) {
+        if (!m_trampleComputePSO || !m_trampleMap || !m_trampleDirtyTileBuffer || !interactorBuffer || !m_uniformBuffer) {
+            std::cerr << "Microbenchmark " << microbenchName(kind) << ": trample map unavailable" << std::endl;
+            return false;
+        }
+        footprint = trampleFootprint(static_cast<float>(getTrampleMapSize()) / kTrampleWindowSize);
+        result.items = static_cast<uint64_t>(footprint) * footprint * static_cast<uint64_t>(m_interactorCount);
+    } else if (kind == MicrobenchCull || kind == MicrobenchGrassVertex) {
+        if (!m_microbenchCullValid || !m_cullComputePSO || !m_resetDrawArgsPSO) {
+            std::cerr << "Microbenchmark " << microbenchName(kind) << ": the last frame did not run the compute cull" << std::endl;
+            return false;
+        }
+        result.items = cullUniforms.instanceCount;
+    } else if (kind == MicrobenchGenerate) {
+        if (!m_generateGrassPSO || !m_instanceBuffer || !m_grassField || m_grassEditor) {
+            std::cerr << "Microbenchmark " << microbenchName(kind) << ": GPU generation unavailable" << std::endl;
+            return false;
+        }
+        result.items = static_cast<uint64_t>(m_grassBladesPerCell) * m_grassField->getCellCount();
+    } else if (kind != MicrobenchGrassFragment) {
+        return false;
+    }
+    
+    if (kind == MicrobenchGrassVertex || kind == MicrobenchGrassFragment) {
+        // Only color 0 and depth are attached: drop the scene pass's in-tile post and object ID outputs
+        PipelineKey key = msaaPipelineKeys(m_sceneSampleCount).grass;
+        key.supportIndirectCommandBuffers = false;
+        key.tileOutputFormat = MTL::PixelFormatInvalid;
+        key.tileDepthFormat = MTL::PixelFormatInvalid;
+        key.objectIdFormat = MTL::PixelFormatInvalid;
+        key.constants.erase(std::remove_if(key.constants.begin(), key.constants.end(), [](const PipelineConstant& constant) {
+            return constant.index == FunctionConstantIndexWriteTileDepth || constant.index == FunctionConstantIndexWriteObjectId;
+        }), key.constants.end());
+        if (kind == MicrobenchGrassVertex) {
+            key.fragmentFunction = "";
+            key.rasterization = false;
+        } else {
+            key.vertexFunction = "grassOverdrawVertex";
+        }
+        pipeline = m_pipelineCache->get(key);
+        if (!pipeline) {
+            waitForPipelines();
+            pipeline = m_pipelineCache->get(key);
+        }
+        if (!pipeline || !m_depthTexture || !m_fullscreenDepthStencilState) {
+            std::cerr << "Microbenchmark " << microbenchName(kind) << ": pipeline unavailable" << std::endl;
+            return false;
+        }
+        
+        MTL::TextureDescriptor* targetDescriptor = MTL::TextureDescriptor::texture2DDescriptor(
+            kSceneColorFormat, m_depthTexture->width(), m_depthTexture->height(), false);
+        targetDescriptor->setTextureType(m_sceneSampleCount > 1 ? MTL::TextureType2DMultisample : MTL::TextureType2D);
+        targetDescriptor->setSampleCount(m_sceneSampleCount);
+        targetDescriptor->setUsage(MTL::TextureUsageRenderTarget);
+        targetDescriptor->setStorageMode(MTL::StorageModePrivate);
+        colorTarget = m_device->newTexture(targetDescriptor);
+        targetDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
+        depthTarget = m_device->newTexture(targetDescriptor);
+        
+        passDescriptor = MTL::RenderPassDescriptor::alloc()->init();
+        passDescriptor->colorAttachments()->object(0)->setTexture(colorTarget);
+        passDescriptor->colorAttachments()->object(0)->setLoadAction(MTL::LoadActionClear);
+        passDescriptor->colorAttachments()->object(0)->setStoreAction(MTL::StoreActionDontCare);
+        passDescriptor->depthAttachment()->setTexture(depthTarget);
+        passDescriptor->depthAttachment()->setLoadAction(MTL::LoadActionClear);
+        passDescriptor->depthAttachment()->setStoreAction(MTL::StoreActionDontCare);
+        passDescriptor->depthAttachment()->setClearDepth(1.0);
+        if (kind == MicrobenchGrassFragment) {
+            result.items = static_cast<uint64_t>(colorTarget->width()) * colorTarget->height() * static_cast<uint64_t>(layers);
+        } else {
+            drawArgsCopy = m_device->newBuffer(sizeof(GrassDrawArguments) * GRASS_DRAW_BUCKET_COUNT, MTL::ResourceStorageModeShared);
+        }
+    }
+    
+    auto encodeRepetitions = [&](MTL::CommandBuffer* commandBuffer) {
+        if (kind == MicrobenchGenerate) {
+            for (int i = 0; i < kMicrobenchRepeats; ++i) {
+                encodeGrassGeneration(commandBuffer);
+            }
+        } else if (kind == MicrobenchTrampleStamp || kind == MicrobenchCull) {
+            // Dispatches in a serial compute encoder run in order, like in the frame
+            MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
+            if (kind == MicrobenchTrampleStamp) {
+                encoder->setComputePipelineState(m_trampleComputePSO);
+                encoder->setTexture(m_trampleMap, 0);
+                encoder->setBuffer(m_uniformBuffer, 0, TrampleBufferIndexUniforms);
+                encoder->setBuffer(interactorBuffer, 0, TrampleBufferIndexInteractors);
+                encoder->setBuffer(m_trampleDirtyTileBuffer, 0, TrampleBufferIndexDirtyTiles);
+            }
+            for (int i = 0; i < kMicrobenchRepeats; ++i) {
+                if (kind == MicrobenchTrampleStamp) {
+                    m_computeDispatch->dispatch(encoder, m_trampleComputePSO, MTL::Size(footprint, footprint, static_cast<NS::UInteger>(m_interactorCount)));
+                } else {
+                    encodeGrassCull(encoder, cullUniforms, false, false, cullUniforms.cellOrderEnabled != 0);
+                }
+            }
+            encoder->endEncoding();
+        } else {
+            MTL::RenderCommandEncoder* encoder = commandBuffer->renderCommandEncoder(passDescriptor);
+            encoder->setDepthStencilState(kind == MicrobenchGrassFragment ? m_fullscreenDepthStencilState : m_depthStencilState);
+            encoder->setCullMode(MTL::CullModeNone);
+            for (int i = 0; i < kMicrobenchRepeats; ++i) {
+                if (kind == MicrobenchGrassVertex) {
+                    encodeGrassInstances(encoder, pipeline, false, true, 0);
+                } else {
+                    // Layer after layer over every pixel: always passing depth, no writes
+                    encoder->setRenderPipelineState(pipeline);
+                    encoder->setVertexBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
+                    encoder->setFragmentBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
+                    encoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+                    bindGrassResources(encoder, MTL::RenderStageFragment);
+                    encoder->drawPrimitives(MTL::PrimitiveTypeTriangleStrip, NS::UInteger(0), NS::UInteger(4), NS::UInteger(layers));
+                }
+            }
+            encoder->endEncoding();
+        }
+    };
+    
+    std::vector<double> timings;
+    bool ok = true;
+    for (int sample = 0; sample < kMicrobenchWarmup + samples && ok; ++sample) {
+        MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+        encodeRepetitions(commandBuffer);
+        if (drawArgsCopy && sample == kMicrobenchWarmup + samples - 1) {
+            MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+            blitEncoder->copyFromBuffer(m_grassDrawArgsBuffer, 0, drawArgsCopy, 0, sizeof(GrassDrawArguments) * GRASS_DRAW_BUCKET_COUNT);
+            blitEncoder->endEncoding();
+        }
+        commandBuffer->commit();
+        commandBuffer->waitUntilCompleted();
+        if (commandBuffer->status() != MTL::CommandBufferStatusCompleted) {
+            std::cerr << "Microbenchmark " << microbenchName(kind) << ": command buffer failed" << std::endl;
+            ok = false;
+        } else if (sample >= kMicrobenchWarmup) {
+            timings.push_back((commandBuffer->GPUEndTime() - commandBuffer->GPUStartTime()) * 1000.0 / kMicrobenchRepeats);
+        }
+    }
+    
+    // Vertex invocations of the indirect draws (index counts times the visible blades)
+    if (ok && drawArgsCopy) {
+        const GrassDrawArguments* args = static_cast<const GrassDrawArguments*>(drawArgsCopy->contents());
+        result.items = 0;
+        for (int bucket = 0; bucket < GRASS_DRAW_BUCKET_COUNT; ++bucket) {
+            result.items += static_cast<uint64_t>(args[bucket].indexCount) * args[bucket].instanceCount;
+        }
+    }
+    if (passDescriptor) {
+        passDescriptor->release();
+    }
+    if (colorTarget) {
+        colorTarget->release();
+    }
+    if (depthTarget) {
+        depthTarget->release();
+    }
+    if (drawArgsCopy) {
+        drawArgsCopy->release();
+    }
+    if (!ok || timings.empty()) {
+        return false;
+    }
+    
+    std::sort(timings.begin(), timings.end());
+    result.medianMs = timings[timings.size() / 2];
+    result.minMs = timings.front();
+    result.maxMs = timings.back();
+    result.samples = static_cast<int>(timings.size());
+    return true;
+}
+
+double Renderer::getCpuCellCullMs() const
+{
+    return m_cpuCulledThisFrame ? m_cpuCellCuller->getLastCullMs() : 0.0;
+}
+
+void Renderer::setSimulationRate(SimulationSystem system, float rateHz)
+{
+    if (system >= 0 && system < SimulationSystemCount) {
+        m_simulationRates[system] = std::max(rateHz, 0.0f);
+        applySimulationRates();
+    }
+}
+
+float Renderer::getSimulationRate(SimulationSystem system) const
+{
+    return (system >= 0 && system < SimulationSystemCount) ? m_simulationRates[system] : 0.0f;
+}
+
+void Renderer::applySimulationRates()
+{
+    float scale = std::max(m_powerPolicy.simulationScale, 0.01f);
+    float trampleCap = m_qualityGovernor ? m_qualityGovernor->getStep().trampleRate : 0.0f;
+    for (int i = 0; i < SimulationSystemCount; ++i) {
+        float rate = m_simulationRates[i] * scale;
+        if (i == SimulationTrample && trampleCap > 0.0f) {
+            rate = rate > 0.0f ? std::min(rate, trampleCap) : trampleCap; // Per-frame stamping becomes the cap
+        }
+        if (rate != m_simulationClocks[i].getRate()) {
+            m_simulationClocks[i].setRate(rate); // Restarts the clock: only on a change
+        }
+    }
+}
+
+void Renderer::setPowerPolicy(const PowerPolicy& policy)
+{
+    m_powerPolicy = policy;
+    applySimulationRates();
+}
+
+void Renderer::setGpuBreadcrumbs(bool enabled)
+{
+    m_breadcrumbs->setEnabled(enabled);
+}
+
+bool Renderer::isGpuBreadcrumbs() const
+{
+    return m_breadcrumbs->isEnabled();
+}
+
+void Renderer::setQualityGovernor(bool enabled)
+{
+    if (enabled == (m_qualityGovernor != nullptr)) {
+        return;
+    }
+    if (enabled) {
+        m_qualityGovernor = new QualityGovernor();
+    } else {
+        delete m_qualityGovernor;
+        m_qualityGovernor = nullptr;
+    }
+    applyQualityGovernorStep();
+    std::cout << "Quality governor: " << (enabled ? "ON" : "OFF") << std::endl;
+}
+
+int Renderer::getQualityGovernorLevel() const
+{
+    return m_qualityGovernor ? m_qualityGovernor->getLevel() : 0;
+}
+
+void Renderer::applyQualityGovernorStep()
+{
+    // The density LOD is read per frame (grassDensityLodDistance()); the rest is pushed here
+    if (m_dynamicResolution) {
+        m_dynamicResolution->setScaleLimit(m_qualityGovernor ? m_qualityGovernor->getStep().renderScale : 1.0f);
+    }
+    applySimulationRates();
+}
+
+float Renderer::grassDensityLodDistance() const
+{
+    return m_qualityGovernor ? m_grassDensityLodDistance * m_qualityGovernor->getStep().densityLodScale : m_grassDensityLodDistance;
+}
+
+void Renderer::setScenePaused(bool paused)
+{
+    if (paused == m_scenePaused) {
+        return;
+    }
+    double now = glfwGetTime();
+    if (paused) {
+        m_scenePauseStart = now;
+    } else {
+        m_scenePausedTotal += now - m_scenePauseStart;
+    }
+    m_scenePaused = paused;
+}
+
+float Renderer::sceneTime() const
+{
+    if (m_useFixedTime) {
+        return m_fixedTime;
+    }
+    double wallTime = m_scenePaused ? m_scenePauseStart : glfwGetTime();
+    return static_cast<float>(wallTime - m_scenePausedTotal);
+}
+
+double Renderer::presentInterval()
+{
+    // Static frame: the camera pose is unchanged and no input arrived (keys, buttons, cursor motion
+    // or a new external control frame). The scene clock need not stand: a running one keeps the
+    // wind and the interactors animating at the idle rate until the user comes back
+    double now = glfwGetTime();
+    bool cameraStatic = m_camera && m_camera->position == m_idleCameraPosition &&
+                        m_camera->yaw == m_idleCameraYaw && m_camera->pitch == m_idleCameraPitch;
+    bool sceneStatic = cameraStatic && !m_inputActive && !m_useFixedTime;
+    if (m_camera) {
+        m_idleCameraPosition = m_camera->position;
+        m_idleCameraYaw = m_camera->yaw;
+        m_idleCameraPitch = m_camera->pitch;
+    }
+    if (!sceneStatic) {
+        m_staticSince = -1.0;
+    } else if (m_staticSince < 0.0) {
+        m_staticSince = now;
+    }
+    
+    bool idle = m_powerPolicy.idleFrameRate > 0.0f && m_staticSince >= 0.0 && now - m_staticSince >= m_powerPolicy.idleDelay;
+    if (idle != m_idle) {
+        m_idle = idle;
+        std::cout << "Power policy: " << (idle ? "idle" : "active") << std::endl;
+    }
+    
+    float frameRate = m_powerPolicy.maxFrameRate;
+    if (m_powerPolicy.lowPowerFrameRate > 0.0f && NS::ProcessInfo::processInfo()->isLowPowerModeEnabled()) {
+        frameRate = frameRate > 0.0f ? std::min(frameRate, m_powerPolicy.lowPowerFrameRate) : m_powerPolicy.lowPowerFrameRate;
+    }
+    if (m_idle) {
+        frameRate = frameRate > 0.0f ? std::min(frameRate, m_powerPolicy.idleFrameRate) : m_powerPolicy.idleFrameRate;
+    }
+    return frameRate > 0.0f ? 1.0 / frameRate : 0.0;
+}
+
+bool Renderer::setWindFluid(bool enabled)
+{
+    if (enabled && !(m_windAdvectPSO && m_windSplatPSO && m_windDivergencePSO && m_windPressurePSO && m_windProjectPSO &&
+                     m_windFieldFluidPSO)) {
+        std::cerr << "Wind fluid unavailable (no fluid pipelines)" << std::endl;
+        return false;
+    }
+    if (enabled && !m_windScratchBuffer && !buildWindFluid()) {
+        return false;
+    }
+    m_windFluidEnabled = enabled;
+    return true;
+}
+
+SceneHandle Renderer::addWindGust(const simd::float2& position, const simd::float2& velocity, float radius, float duration)
+{
+    if (m_windGusts.size() >= WIND_MAX_GUSTS || radius <= 0.0f || duration <= 0.0f) {
+        return SceneHandle();
+    }
+    WindGustPlacement placement = { position, radius, sceneTime() + duration };
+    WindGustFlow flow = { velocity };
+    return m_windGusts.add(placement, flow);
+}
+
+bool Renderer::removeWindGust(SceneHandle handle)
+{
+    return m_windGusts.remove(handle);
+}
+
+void Renderer::spawnWindGust(const WindGustParticle& gust)
+{
+    if (!m_windGustPSO || !m_windGustBuffer || m_windGustSpawns.size() >= WIND_MAX_GUST_SPAWNS ||
+        gust.radius <= 0.0f || gust.lifetime <= 0.0f) {
+        return;
+    }
+    WindGustSpawn spawn = {};
+    spawn.particle = gust;
+    spawn.slot = m_windGustSpawned++ % WIND_MAX_GUST_PARTICLES;
+    m_windGustSpawns.push_back(spawn);
+}
+
+int Renderer::getLiveWindGustCount() const
+{
+    return static_cast<int>(std::count_if(m_windGustLives.begin(), m_windGustLives.end(), [](float life) { return life > 0.0f; }));
+}
+
+bool Renderer::isBladePhysicsActive() const
+{
+    // Streamed chunks reuse pool slots, so per-instance state would carry over between chunks
+    return m_bladePhysicsRadius > 0.0f && m_bladePhysicsPSO && m_bladeStateBuffer && !m_grassStreamer && m_cellBuffer;
+}
+
+MTL::Buffer* Renderer::grassBladeStateBuffer() const
+{
+    // The grass stages only read the states when uniforms.bladePhysicsRadius is set; without
+    // them the instances stand in for the binding
+    return m_bladeStateBuffer ? m_bladeStateBuffer : grassInstanceBuffer();
+}
+
+Interactor Renderer::scriptedInteractor(int index, float time, float prevTime) const
+{
+    Interactor interactor = interactorAt(index, time, prevTime);
+    if (m_terrain) {
+        // Terrain height relative to the flat ground the orbits are defined over
+        interactor.position.y += m_terrain->heightAt(interactor.position.x, interactor.position.z) + 0.5f;
+        interactor.prevPosition.y += m_terrain->heightAt(interactor.prevPosition.x, interactor.prevPosition.z) + 0.5f;
+    }
+    return interactor;
+}
+
+Interactor Renderer::interactorShape(int index) const
+{
+    // Radii do not depend on the motion, so the scripted ones hold for the GPU-simulated interactors
+    // as well; external radii are clamped to the INTERACTOR_MIN_RADIUS..MAX range as their frame is polled
+    return m_externalFrame ? m_externalFrame->interactors[index] : interactorAt(index, 0.0f, 0.0f);
+}
+
+NS::UInteger Renderer::trampleFootprint(float texelsPerMeter) const
+{
+    // Footprint of the largest interactor; each one anchors its own copy on the GPU
+    float maxRadius = 0.0f;
+    for (int i = 0; i < m_interactorCount; ++i) {
+        maxRadius = std::max(maxRadius, interactorShape(i).radius);
+    }
+    return static_cast<NS::UInteger>(std::ceil(2.0f * maxRadius * texelsPerMeter)) + 2;
+}
+
+bool Renderer::saveTrampleSnapshot(const std::string& path)
+{
+    if (!m_trampleMap || m_trampleSavePending || m_trampleUploadPending || m_trampleTransferSlot >= 0 ||
+        m_trampleFileJob.load(std::memory_order_acquire)) {
+        return false;
+    }
+    m_trampleSnapshotPath = path;
+    m_trampleSavePending = true;
+    return true;
+}
+
+bool Renderer::loadTrampleSnapshot(const std::string& path)
+{
+    if (!m_trampleMap || m_trampleSavePending || m_trampleUploadPending || m_trampleTransferSlot >= 0 ||
+        m_trampleFileJob.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (m_trampleSnapshot) {
+        delete m_trampleSnapshot;
+        m_trampleSnapshot = nullptr;
+    }
+    
+    // The render thread leaves m_trampleSnapshot and the upload flag alone until the job clears the flag
+    m_trampleFileJob.store(true, std::memory_order_relaxed);
+    m_jobSystem->run([this, path]() {
+        TrampleSnapshot* snapshot = new TrampleSnapshot();
+        if (snapshot->load(path)) {
+            m_trampleSnapshot = snapshot;
+            m_trampleUploadPending = true;
+        } else {
+            delete snapshot;
+        }
+        m_trampleFileJob.store(false, std::memory_order_release);
+    }, nullptr, nullptr, true);
+    return true;
+}
+
+bool Renderer::queryTrample(const std::vector<simd::float2>& points, TrampleQueryCallback callback)
+{
+    if (points.size() > kTrampleQueryCapacity) {
+        std::cerr << "Trample query of " << points.size() << " points exceeds " << kTrampleQueryCapacity << std::endl;
+        return false;
+    }
+    m_trampleQueries.push_back({ points, callback });
+    return true;
+}
+
+void Renderer::setObjectIds(bool enabled)
+{
+    m_objectIdsRequested = enabled;
+    if (!enabled) {
+        // Never read: nothing will write the attachment they wait for
+        for (const ObjectPick& pick : m_objectPicks) {
+            if (pick.callback) {
+                pick.callback({}, 0, 0);
+            }
+        }
+        m_objectPicks.clear();
+    }
+    
+    // Compiled in the background; draw() swaps them in (applyObjectIds)
+    if (enabled != m_objectIds) {
+        ScenePipelineKeys keys = objectIdPipelineKeys(m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys, enabled);
+        for (const PipelineKey* key : { &keys.grass, &keys.ground, &keys.ball, &keys.sky, &keys.impostor }) {
+            m_pipelineCache->get(*key);
+        }
+    }
+}
+
+bool Renderer::pickObjects(int x, int y, int width, int height, ObjectPickCallback callback)
+{
+    if (!m_objectIdsRequested) {
+        std::cerr << "Object pick needs object IDs (setObjectIds)" << std::endl;
+        return false;
+    }
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || static_cast<size_t>(width) * static_cast<size_t>(height) > kObjectPickCapacity) {
+        std::cerr << "Object pick of " << width << "x" << height << " pixels at " << x << "," << y
+                  << " is empty or exceeds " << kObjectPickCapacity << std::endl;
+        return false;
+    }
+    ObjectPick pick;
+    pick.region.origin = simd::make_uint2(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+    pick.region.size = simd::make_uint2(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    pick.region.scale = simd::make_float2(1.0f, 1.0f);
+    pick.region.limit = simd::make_uint2(0, 0);
+    pick.callback = callback;
+    m_objectPicks.push_back(pick);
+    return true;
+}
+
+bool Renderer::ensureTrampleStagingBuffer()
+{
+    if (!m_trampleStagingBuffer && m_trampleMap) {
+        size_t size = sizeof(float) * m_trampleMap->width() * m_trampleMap->height();
+        m_trampleStagingBuffer = m_device->newBuffer(size, MTL::ResourceStorageModeShared);
+        if (!m_trampleStagingBuffer) {
+            std::cerr << "Failed to create trample staging buffer" << std::endl;
+        }
+    }
+    return m_trampleStagingBuffer != nullptr;
+}
+
+void Renderer::setCameraPose(const glm::vec3& position, float yaw, float pitch)
+{
+    if (m_camera) {
+        m_camera->setPose(position, yaw, pitch);
+    }
+}
+
+bool Renderer::renderBatch(const std::vector<BatchView>& views, const BatchCallback& callback)
+{
+    if (m_metalLayer) {
+        std::cerr << "Batch rendering needs a headless renderer" << std::endl;
+        return false;
+    }
+    if (!callback) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < views.size(); ++i) {
+        const BatchView& view = views[i];
+        setCameraPose(view.position, view.yaw, view.pitch);
+        setFixedTime(view.time);
+        if (view.cameraCut) {
+            // The previous depth would occlude blades this camera sees
+            m_hiZValid = false;
+            m_prevUniformsValid = false;
+            if (m_dynamicResolution) {
+                m_dynamicResolution->resetHistory();
+            }
+            m_temporalAntialiasing->resetHistory();
+        }
+        // Waits only while the callbacks fall behind the GPU
+        m_readback->waitForBuffers(kBatchReadbacksInFlight);
+        readbackRenderTarget(ReadbackTargetOutput, 0, [&callback, i](const ReadbackImage& image) {
+            callback(i, image);
+        });
+        draw();
+    }
+    m_pendingReadbacks.clear(); // A view draw() could not render would call back after we return
+    waitForReadbacks();
+    return true;
+}
+
+bool Renderer::setViews(const std::vector<RenderView>& views)
+{
+    if (views.size() > MAX_RENDER_VIEWS) {
+        std::cerr << "At most " << MAX_RENDER_VIEWS << " views per frame" << std::endl;
+        return false;
+    }
+    for (const RenderView& view : views) {
+        if (view.viewport.z <= 0.0f || view.viewport.w <= 0.0f || view.viewport.x < 0.0f || view.viewport.y < 0.0f ||
+            view.viewport.x + view.viewport.z > 1.0f || view.viewport.y + view.viewport.w > 1.0f) {
+            std::cerr << "View viewport outside the output" << std::endl;
+            return false;
+        }
+    }
+    
+    // Motion vector history belongs to the previous set of views
+    m_views = views;
+    m_prevUniformsValid = false;
+    m_temporalAntialiasing->resetHistory();
+    
+    // Amplified grass: built in the background, views draw one grass pass each until then
+    if (m_views.size() > 1 && m_vertexAmplificationSupported) {
+        m_pipelineCache->get(m_temporalRequested ? m_temporalPipelineKeys.grassMultiView : m_msaaPipelineKeys.grassMultiView);
+    }
+    return true;
+}
+
+bool Renderer::finishPipelineBuild()
+{
+    // Nothing finished since the last check, or builds still running (a shader reload keeps
+    // drawing with the previous pipelines until every replacement is in)
+    uint64_t generation = m_pipelineCache->generation();
+    if (generation == m_pipelineGeneration || m_pipelineCache->pendingCount() > 0) {
+        return m_pipelinesReady;
+    }
+    
+    const ScenePipelineKeys& keys = m_temporalUpscaling ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    MTL::RenderPipelineState* grass = m_pipelineCache->get(keys.grass);
+    MTL::RenderPipelineState* ground = m_pipelineCache->get(keys.ground);
+    MTL::RenderPipelineState* ball = m_pipelineCache->get(keys.ball);
+    MTL::RenderPipelineState* sky = m_pipelineCache->get(keys.sky);
+    
+    // Only pipelines of the other scene mode finished: nothing to swap. A new grass shading
+    // permutation is not referenced by the scene ICBs, so it is swapped in without draining the GPU.
+    if (m_pipelinesReady && ground == m_groundPSO && ball == m_ballPSO && sky == m_skyPSO) {
+        if (grass) {
+            m_pso = grass;
+        }
+        m_pipelineArchive->serialize();
+        m_pipelineGeneration = generation;
+        return true;
+    }
+    
+    m_pso = grass;
+    m_groundPSO = ground;
+    m_ballPSO = ball;
+    m_skyPSO = sky;
+    
+    if (!m_pipelinesReady) {
+        // First complete set: encode the ICBs that reference the pipelines
+        buildIndirectCommandBuffers();
+    } else {
+        // Hot swap: frames in flight may still execute the old pipelines through the scene ICBs
+        waitUntilIdle();
+        encodeSceneICBs();
+        m_pipelineCache->releaseRetired();
+        std::cout << "Shaders reloaded" << std::endl;
+    }
+    
+    m_pipelineArchive->serialize();
+    m_pipelineGeneration = generation;
+    m_pipelinesReady = true;
+    return true;
+}
+
+void Renderer::applyTemporalUpscaling()
+{
+    // Only the resolve changed (temporal scaler <-> TAA): the scene pipelines stay as they are
+    if (m_temporalRequested != m_temporalUpscaling) {
+        // Built on first request: keep the current scene mode until all four pipelines exist
+        const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+        MTL::RenderPipelineState* grass = m_pipelineCache->get(keys.grass);
+        MTL::RenderPipelineState* ground = m_pipelineCache->get(keys.ground);
+        MTL::RenderPipelineState* ball = m_pipelineCache->get(keys.ball);
+        MTL::RenderPipelineState* sky = m_pipelineCache->get(keys.sky);
+        if (!grass || !ground || !ball || !sky) {
+            return;
+        }
+        
+        // Frames in flight still execute the current pipelines through the scene ICBs
+        waitUntilIdle();
+        m_pso = grass;
+        m_groundPSO = ground;
+        m_ballPSO = ball;
+        m_skyPSO = sky;
+        encodeSceneICBs();
+    }
+    
+    m_temporalUpscaling = m_temporalRequested;
+    m_temporalAntialiasingEnabled = m_temporalUpscaling && m_temporalAntialiasingRequested;
+    if (m_dynamicResolution) {
+        m_dynamicResolution->setTemporal(m_temporalUpscaling && !m_temporalAntialiasingEnabled);
+    }
+    m_temporalAntialiasing->resetHistory();
+    if (m_temporalAntialiasingEnabled) {
+        std::cout << "Temporal antialiasing: ON" << std::endl;
+    } else {
+        std::cout << "Temporal upscaling: " << (m_temporalUpscaling ? "ON" : "OFF") << std::endl;
+    }
+}
+
+Renderer::ScenePipelineKeys Renderer::msaaPipelineKeys(NS::UInteger sampleCount) const
+{
+    ScenePipelineKeys keys = m_msaaPipelineKeys;
+    for (PipelineKey* key : { &keys.grass, &keys.ground, &keys.ball, &keys.sky, &keys.impostor,
+                              &keys.grassMultiView, &keys.grassPrepass }) {
+        key->sampleCount = sampleCount;
+    }
+    
+    // The alpha-to-coverage keys dither their opacity onto the coverage levels of the sample count
+    PipelineConstant coverage = { FunctionConstantIndexCoverageSamples, MTL::DataTypeInt, static_cast<int32_t>(sampleCount) };
+    for (PipelineKey* key : { &keys.grass, &keys.impostor, &keys.grassMultiView, &keys.grassPrepass }) {
+        key->constants.erase(std::remove_if(key->constants.begin(), key->constants.end(), [](const PipelineConstant& constant) {
+            return constant.index == FunctionConstantIndexCoverageSamples;
+        }), key->constants.end());
+        key->constants.push_back(coverage);
+        std::sort(key->constants.begin(), key->constants.end());
+    }
+    return keys;
+}
+
+void Renderer::applySceneSampleCount()
+{
+    // Built on request: keep the current sample count until the scene pipelines exist at the new one
+    ScenePipelineKeys keys = msaaPipelineKeys(m_sceneSampleCountRequested);
+    MTL::RenderPipelineState* grass = m_pipelineCache->get(keys.grass);
+    MTL::RenderPipelineState* ground = m_pipelineCache->get(keys.ground);
+    MTL::RenderPipelineState* ball = m_pipelineCache->get(keys.ball);
+    MTL::RenderPipelineState* sky = m_pipelineCache->get(keys.sky);
+    if (!grass || !ground || !ball || !sky || !m_pipelineCache->get(keys.impostor)) {
+        return;
+    }
+    
+    // Frames in flight still execute the current pipelines through the scene ICBs
+    waitUntilIdle();
+    m_msaaPipelineKeys = keys;
+    m_sceneSampleCount = m_sceneSampleCountRequested;
+    if (!m_temporalUpscaling) {
+        m_pso = grass;
+        m_groundPSO = ground;
+        m_ballPSO = ball;
+        m_skyPSO = sky;
+        encodeSceneICBs();
+    }
+    
+    // The mesh grass and in-tile post pipelines are built for the pass sample count too
+    MTL::Library* library = m_device->newDefaultLibrary();
+    if (library) {
+        if (m_meshGrassPSO) {
+            buildMeshGrassPipeline(library);
+        }
+        if (m_tilePostPSO) {
+            buildTilePostPipeline(library);
+        }
+        library->release();
+    }
+    std::cout << "Scene MSAA: " << m_sceneSampleCount << "x" << std::endl;
+}
+
+Renderer::ScenePipelineKeys Renderer::objectIdPipelineKeys(const ScenePipelineKeys& keys, bool enabled) const
+{
+    // Every pipeline of the scene pass declares the attachment; the sky and the impostor cards name
+    // no object and leave it as they found it
+    ScenePipelineKeys result = keys;
+    for (PipelineKey* key : { &result.grass, &result.ground, &result.ball, &result.sky, &result.impostor,
+                              &result.grassMultiView, &result.grassPrepass }) {
+        key->objectIdFormat = enabled ? kObjectIdFormat : MTL::PixelFormatInvalid;
+    }
+    for (PipelineKey* key : { &result.grass, &result.ground, &result.ball, &result.grassMultiView, &result.grassPrepass }) {
+        key->constants.erase(std::remove_if(key->constants.begin(), key->constants.end(), [](const PipelineConstant& constant) {
+            return constant.index == FunctionConstantIndexWriteObjectId;
+        }), key->constants.end());
+        if (enabled) {
+            key->constants.push_back({ FunctionConstantIndexWriteObjectId, MTL::DataTypeBool, 1 });
+            std::sort(key->constants.begin(), key->constants.end());
+        }
+    }
+    return result;
+}
+
+void Renderer::applyObjectIds()
+{
+    // Built on request: keep the current attachments until the scene pipelines exist with the other set
+    ScenePipelineKeys msaaKeys = objectIdPipelineKeys(m_msaaPipelineKeys, m_objectIdsRequested);
+    ScenePipelineKeys temporalKeys = objectIdPipelineKeys(m_temporalPipelineKeys, m_objectIdsRequested);
+    const ScenePipelineKeys& keys = m_temporalUpscaling ? temporalKeys : msaaKeys;
+    MTL::RenderPipelineState* grass = m_pipelineCache->get(keys.grass);
+    MTL::RenderPipelineState* ground = m_pipelineCache->get(keys.ground);
+    MTL::RenderPipelineState* ball = m_pipelineCache->get(keys.ball);
+    MTL::RenderPipelineState* sky = m_pipelineCache->get(keys.sky);
+    if (!grass || !ground || !ball || !sky || !m_pipelineCache->get(keys.impostor)) {
+        return;
+    }
+    
+    // Frames in flight still execute the current pipelines through the scene ICBs
+    waitUntilIdle();
+    m_msaaPipelineKeys = msaaKeys;
+    m_temporalPipelineKeys = temporalKeys;
+    m_pso = grass;
+    m_groundPSO = ground;
+    m_ballPSO = ball;
+    m_skyPSO = sky;
+    encodeSceneICBs();
+    
+    m_objectIds = m_objectIdsRequested;
+    std::cout << "Object IDs: " << (m_objectIds ? "ON" : "OFF") << std::endl;
+}
+
+void Renderer::reloadShaders()
+{
+    MTL::Library* library = m_device->newDefaultLibrary();
+    if (!library) {
+        std::cerr << "Failed to reload default Metal library" << std::endl;
+        return;
+    }
+    
+    // Rebuilds every cached render pipeline in the background; finishPipelineBuild() swaps them in
+    m_pipelineCache->setLibrary(library);
+    library->release();
+}
+
+bool Renderer::setShaderHotReload(bool enabled)
+{
+    if (enabled == (m_shaderWatcher != nullptr)) {
+        return true;
+    }
+    if (!enabled) {
+        delete m_shaderWatcher;
+        m_shaderWatcher = nullptr;
+        std::cout << "Shader hot reload: OFF" << std::endl;
+        return true;
+    }
+#ifdef VEGETATION_SHADER_SOURCE_DIR
+    // AIR and reloaded metallibs go next to the executable's working directory
+    m_shaderWatcher = new ShaderWatcher(m_device, VEGETATION_SHADER_SOURCE_DIR, "shader_reload");
+    return true;
+#else
+    std::cerr << "Shader hot reload needs VEGETATION_SHADER_SOURCE_DIR (the shader source tree)" << std::endl;
+    return false;
+#endif
+}
+
+void Renderer::applyShaderHotReload()
+{
+    std::set<std::string> functions;
+    MTL::Library* library = m_shaderWatcher->takeLibrary(functions);
+    if (!library) {
+        return;
+    }
+    
+    // Only the pipelines built from recompiled functions; finishPipelineBuild() swaps them in (and
+    // drains the GPU before re-encoding the scene ICBs) once they are all compiled
+    m_pipelineCache->setLibrary(library, &functions);
+    library->release();
+}
+
+void Renderer::waitForPipelines()
+{
+    while (m_pipelineCache->pendingCount() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    finishPipelineBuild();
+}
+
+bool Renderer::precompilePipelines(const std::string& path)
+{
+    // Every permutation the settings can select: shading features, precision, blade mode and
+    // ground texture mode, in each scene pass configuration with and without the object-ID
+    // attachment, plus the rate-mapped post pass and the shadow casters. The trample debug tint
+    // stays a runtime compile (debug view only), like the mesh and in-tile post pipelines at
+    // sample counts other than the current one.
+    GrassShadingFeatures features = m_grassShadingFeatures;
+    bool halfPrecision = m_halfPrecisionShading;
+    bool geometryBlades = m_geometryBlades;
+    bool sparseGround = m_sparseGroundEnabled;
+    
+    // Scene pass configurations: 0 = temporal (1x with motion vectors), else the MSAA sample count
+    std::vector<NS::UInteger> sampleCounts = { 0 };
+    for (NS::UInteger sampleCount : { 1u, 2u, 4u, 8u }) {
+        if (m_device->supportsTextureSampleCount(sampleCount)) {
+            sampleCounts.push_back(sampleCount);
+        }
+    }
+    
+    for (int permutation = 0; permutation < 64; ++permutation) {
+        m_grassShadingFeatures.contactShadows = (permutation & 1) != 0;
+        m_grassShadingFeatures.translucency = (permutation & 2) != 0;
+        m_grassShadingFeatures.windSheen = (permutation & 4) != 0;
+        m_halfPrecisionShading = (permutation & 8) != 0;
+        m_geometryBlades = (permutation & 16) != 0;
+        m_sparseGroundEnabled = (permutation & 32) != 0;
+        updateShadingPipelineKeys();
+        
+        for (NS::UInteger sampleCount : sampleCounts) {
+            ScenePipelineKeys sceneKeys = sampleCount == 0 ? m_temporalPipelineKeys : msaaPipelineKeys(sampleCount);
+            for (bool objectIds : { false, true }) {
+                ScenePipelineKeys keys = objectIdPipelineKeys(sceneKeys, objectIds);
+                for (const PipelineKey* key : { &keys.grass, &keys.ground, &keys.ball, &keys.sky, &keys.grassVisibility,
+                                                &keys.grassShade, &keys.impostor, &keys.grassPrepass }) {
+                    m_pipelineCache->get(*key);
+                }
+                if (m_vertexAmplificationSupported) {
+                    m_pipelineCache->get(keys.grassMultiView);
+                }
+            }
+        }
+    }
+    
+    // Built on first use otherwise: the dynamic rasterization-rate post pass and the shadow casters
+    m_pipelineCache->get(m_postPipelineKey);
+    m_pipelineCache->get(m_postRateMappedPipelineKey);
+    if (m_shadowMaps) {
+        for (const PipelineKey* key : { &m_grassShadowPipelineKey, &m_terrainShadowPipelineKey, &m_interactorShadowPipelineKey }) {
+            m_pipelineCache->get(*key);
+        }
+    }
+    
+    m_grassShadingFeatures = features;
+    m_halfPrecisionShading = halfPrecision;
+    m_geometryBlades = geometryBlades;
+    m_sparseGroundEnabled = sparseGround;
+    updateShadingPipelineKeys();
+    waitForPipelines();
+    return m_pipelineArchive->serializeTo(path);
+}
+
+void Renderer::waitForTextures()
+{
+    m_textureLoader->waitUntilLoaded();
+}
+
+void Renderer::setResourceCacheBudget(size_t bytes)
+{
+    // While memory pressure holds the cache below its budget, the new one applies once it clears
+    m_resourceCacheBudget = bytes;
+    if (!m_gpuMemoryShrunk || bytes < m_resourceCache->getBudget()) {
+        m_resourceCache->setBudget(bytes);
+    }
+}
+
+void Renderer::setGpuMemoryBudget(size_t bytes)
+{
+    m_gpuMemory->setBudgetBytes(bytes);
+    m_gpuMemorySampleFrame = kGpuMemorySampleInterval; // Check against it with the next frame
+}
+
+size_t Renderer::getResourceCacheBytes() const
+{
+    return m_resourceCache->getResidentBytes();
+}
+
+BufferHeap::Stats Renderer::getBufferHeapStats() const
+{
+    return m_bufferHeap->getStats();
+}
+
+void Renderer::waitUntilIdle()
+{
+    // Take every ring slot (each is released by a completed frame), then hand them back
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        dispatch_semaphore_wait(m_frameSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        dispatch_semaphore_signal(m_frameSemaphore);
+    }
+}
+
+bool Renderer::setDynamicResolution(bool enabled, float targetFrameMs)
+{
+    if (!m_dynamicResolution) {
+        return !enabled;
+    }
+    m_dynamicResolution->setTargetFrameMs(targetFrameMs);
+    m_dynamicResolution->setFixedScale(0.0f);
+    m_dynamicResolution->setEnabled(enabled);
+    return true;
+}
+
+bool Renderer::setFixedRenderScale(float scale)
+{
+    if (!m_dynamicResolution) {
+        return scale >= 1.0f;
+    }
+    if (scale >= 1.0f) {
+        // Back to native unless the budget controller was running
+        if (m_dynamicResolution->getFixedScale() > 0.0f) {
+            m_dynamicResolution->setFixedScale(0.0f);
+            m_dynamicResolution->setEnabled(false);
+        }
+        return true;
+    }
+    m_dynamicResolution->setFixedScale(scale);
+    m_dynamicResolution->setEnabled(true);
+    return true;
+}
+
+bool Renderer::setTemporalUpscaling(bool enabled)
+{
+    if (enabled && !(m_dynamicResolution && m_dynamicResolution->isTemporalAvailable())) {
+        return false;
+    }
+    // Off while TAA resolves the temporal pass: nothing to change
+    if (!enabled && m_temporalAntialiasingRequested) {
+        return true;
+    }
+    m_temporalAntialiasingRequested = false;
+    requestTemporalScenePass(enabled);
+    return true;
+}
+
+bool Renderer::setTemporalAntialiasing(bool enabled)
+{
+    if (enabled && !(m_temporalResolvePSO && m_temporalAntialiasing->isAvailable())) {
+        return false;
+    }
+    // Off while the temporal scaler resolves the temporal pass: nothing to change
+    if (!enabled && !m_temporalAntialiasingRequested) {
+        return true;
+    }
+    m_temporalAntialiasingRequested = enabled;
+    requestTemporalScenePass(enabled);
+    return true;
+}
+
+void Renderer::requestTemporalScenePass(bool temporal)
+{
+    m_temporalRequested = temporal;
+    
+    // Start building the requested mode's pipelines now; draw() switches once they exist
+    const ScenePipelineKeys& keys = temporal ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    m_pipelineCache->get(keys.grass);
+    m_pipelineCache->get(keys.ground);
+    m_pipelineCache->get(keys.ball);
+    m_pipelineCache->get(keys.sky);
+    if (m_grassVisibilityEnabled) {
+        m_pipelineCache->get(keys.grassVisibility);
+        m_pipelineCache->get(keys.grassShade);
+    }
+}
+
+bool Renderer::setGrassVisibilityShading(bool enabled)
+{
+    if (enabled && !m_grassVisibilitySupported) {
+        return false;
+    }
+    m_grassVisibilityEnabled = enabled;
+    
+    // Start building the pipelines of the requested scene mode; draw() uses them once they exist
+    if (enabled) {
+        const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+        m_pipelineCache->get(keys.grassVisibility);
+        m_pipelineCache->get(keys.grassShade);
+    }
+    std::cout << "Visibility-buffer grass: " << (enabled ? "ON" : "OFF") << std::endl;
+    return true;
+}
+
+bool Renderer::setVariableRasterizationRate(bool enabled, float targetFrameMs)
+{
+    if (!m_rasterizationRate) {
+        return !enabled;
+    }
+    m_rasterizationRate->setTargetFrameMs(targetFrameMs);
+    m_rasterizationRate->setEnabled(enabled);
+    
+    // Built in the background; the scene stays at full rate until it exists
+    if (enabled) {
+        m_pipelineCache->get(m_postRateMappedPipelineKey);
+    }
+    return true;
+}
+
+bool Renderer::isVariableRasterizationRateEnabled() const
+{
+    return m_rasterizationRate && m_rasterizationRate->isEnabled();
+}
+
+bool Renderer::setInTilePost(bool enabled)
+{
+    if (!m_tilePostPSO) {
+        return !enabled;
+    }
+    // The 4x pipelines keep the tile attachments either way: only the frame's passes change
+    m_tilePostEnabled = enabled;
+    return true;
+}
+
+bool Renderer::setShadowMaps(bool enabled)
+{
+    if (!m_shadowMaps) {
+        return !enabled;
+    }
+    // Off, the cascades keep their depth but nothing draws into them: redraw on the way back
+    if (enabled && !m_shadowMapsEnabled) {
+        m_shadowMaps->invalidate();
+    }
+    m_shadowMapsEnabled = enabled;
+    std::cout << "Shadow maps: " << (enabled ? "ON" : "OFF") << std::endl;
+    return true;
+}
+
+float Renderer::getRenderScale() const
+{
+    return (m_dynamicResolution && m_dynamicResolution->isScaling()) ? m_dynamicResolution->getScale() : 1.0f;
+}
+
+GpuTimings Renderer::getGpuTimings() const
+{
+    return m_profiler->getTimings();
+}
+
+void Renderer::draw(CA::MetalDrawable* providedDrawable)
+{
+    // Everything the frame autoreleases (command buffer, encoders, drawable) is freed when it
+    // returns, whichever loop calls it
+    NS::SharedPtr<NS::AutoreleasePool> pool = NS::TransferPtr(NS::AutoreleasePool::alloc()->init());
+    
+    // Swap in the textures decoded since the last frame (their mips are generated ahead of this frame)
+    m_textureLoader->update();
+    
+    // Pick up finished pipeline builds (before taking a ring slot: a shader swap drains the GPU)
+    if (m_shaderWatcher) {
+        applyShaderHotReload();
+    }
+    bool pipelinesReady = finishPipelineBuild();
+    if (pipelinesReady && (m_temporalRequested != m_temporalUpscaling ||
+                           m_temporalAntialiasingRequested != m_temporalAntialiasingEnabled)) {
+        applyTemporalUpscaling();
+    }
+    if (pipelinesReady && m_sceneSampleCountRequested != m_sceneSampleCount) {
+        applySceneSampleCount();
+    }
+    if (pipelinesReady && m_objectIdsRequested != m_objectIds) {
+        applyObjectIds();
+    }
+    
+    // Wait for a free uniform slot: the GPU may still be reading the buffers of the last kMaxFramesInFlight frames
+    // (a GPU hang shows up here: the frames in flight are logged once, then the wait goes on)
+    uint64_t waitStart = TraceRecorder::now();
+    if (dispatch_semaphore_wait(m_frameSemaphore, dispatch_time(DISPATCH_TIME_NOW, static_cast<int64_t>(kGpuStallSeconds * NSEC_PER_SEC))) != 0) {
+        m_breadcrumbs->reportStalled(kGpuStallSeconds);
+        dispatch_semaphore_wait(m_frameSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    m_trace->complete("Frame slot wait", waitStart, TraceRecorder::now());
+    
+    // Get Drawable: Call m_metalLayer->nextDrawable() to get the current drawable (unless a display
+    // link handed one in). If it's null, return early.
+    // Headless renderers resolve into their offscreen texture instead
+    // (autoreleased; held until the command buffer is committed)
+    NS::SharedPtr<CA::MetalDrawable> drawable;
+    MTL::Texture* targetTexture = m_offscreenColorTexture;
+    if (providedDrawable) {
+        drawable = NS::RetainPtr(providedDrawable);
+    } else if (m_metalLayer) {
+        uint64_t drawableStart = TraceRecorder::now();
+        drawable = NS::RetainPtr(m_metalLayer->nextDrawable());
+        m_trace->complete("Drawable wait", drawableStart, TraceRecorder::now());
+    }
+    if (m_metalLayer || providedDrawable) {
+        if (!drawable) {
+            dispatch_semaphore_signal(m_frameSemaphore);
+            return;
+        }
+        targetTexture = drawable->texture();
+    }
+    if (!targetTexture) {
+        dispatch_semaphore_signal(m_frameSemaphore);
+        return;
+    }
+    
+    // Advance the uniform ring; this slot is no longer in use by the GPU
+    m_frameIndex = (m_frameIndex + 1) % kMaxFramesInFlight;
+    m_uniformBuffer = m_uniformBuffers[m_frameIndex];
+    m_profiler->beginFrame(m_frameIndex);
+    m_breadcrumbs->beginFrame(m_frameIndex, ++m_frameSerial);
+    
+    // External control: this slot draws the channel's newest frame, its interactor array bound
+    // where it lies; the frame the slot drew before goes back to the producer
+    m_frameInteractorBuffer = m_interactorBuffers[m_frameIndex];
+    m_interactorCount = static_cast<int>(m_interactors.size());
+    m_externalFrame = nullptr;
+    if (m_externalControl) {
+        const ExternalControlFrame* frame = nullptr;
+        MTL::Buffer* frameBuffer = nullptr;
+        bool fresh = false;
+        if (m_externalControl->poll(m_frameIndex, frame, frameBuffer, fresh) && frameBuffer) {
+            m_externalFrame = frame;
+            m_frameInteractorBuffer = frameBuffer;
+            m_inputActive = m_inputActive || fresh; // A driven scene is not idle
+            m_interactorCount = std::clamp(static_cast<int>(frame->interactorCount), 1, MAX_INTERACTORS);
+            // New gusts blow once, when their frame first arrives: into the fluid, or as stationary
+            // gust particles without it
+            for (uint32_t i = 0; fresh && i < std::min(frame->gustCount, static_cast<uint32_t>(WIND_MAX_GUSTS)); ++i) {
+                if (m_windFluidEnabled) {
+                    addWindGust(frame->gusts[i].position, frame->gusts[i].velocity, frame->gusts[i].radius, frame->gustDurations[i]);
+                } else {
+                    WindGustParticle gust = {};
+                    gust.position = frame->gusts[i].position;
+                    gust.wind = frame->gusts[i].velocity;
+                    gust.radius = frame->gusts[i].radius;
+                    gust.lifetime = frame->gustDurations[i];
+                    spawnWindGust(gust);
+                }
+            }
+        }
+    }
+    
+    // The GPU is done with this slot, so its copy of last use's draw arguments is readable
+    if (m_cullStatsPending[m_frameIndex] && m_cullStatsBuffers[m_frameIndex]) {
+        const GrassDrawArguments* args = static_cast<const GrassDrawArguments*>(m_cullStatsBuffers[m_frameIndex]->contents());
+        for (int lod = 0; lod < GRASS_LOD_COUNT; ++lod) {
+            m_visibleBladeCounts[lod] = 0;
+            for (int species = 0; species < GRASS_SPECIES_COUNT; ++species) {
+                m_visibleBladeCounts[lod] += args[species * GRASS_LOD_COUNT + lod].instanceCount;
+            }
+        }
+        m_cullStatsPending[m_frameIndex] = false;
+        m_trace->counter("Visible blades", static_cast<double>(std::accumulate(m_visibleBladeCounts, m_visibleBladeCounts + GRASS_LOD_COUNT, 0ull)));
+    }
+    
+    // And its count of trample summary tiles re-reduced
+    if (m_trampleTileCountBuffers[m_frameIndex]) {
+        uint32_t* updatedTiles = static_cast<uint32_t*>(m_trampleTileCountBuffers[m_frameIndex]->contents());
+        m_trace->counter("Trample tiles updated", static_cast<double>(*updatedTiles));
+        *updatedTiles = 0;
+    }
+    
+    // Same for the trample staging buffer: a readback from this slot is compressed and written by a
+    // background job, which holds the staging buffer (and every other transfer) until it is done
+    if (m_trampleTransferSlot == m_frameIndex) {
+        if (m_trampleTransferIsReadback) {
+            MTL::Buffer* staging = m_trampleStagingBuffer;
+            staging->retain();
+            uint32_t mapSize = static_cast<uint32_t>(m_trampleMap->width());
+            simd::int2 window = m_trampleReadbackWindow;
+            float time = m_trampleReadbackTime;
+            std::string path = m_trampleSnapshotPath;
+            m_trampleFileJob.store(true, std::memory_order_relaxed);
+            m_jobSystem->run([this, staging, mapSize, window, time, path]() {
+                TrampleSnapshot snapshot;
+                snapshot.capture(static_cast<const float*>(staging->contents()), mapSize, window, time, kTrampleDecayRate);
+                if (snapshot.save(path)) {
+                    std::cout << "Trample snapshot saved to " << path << " (" << snapshot.getTrampledTexelCount()
+                              << " trampled texels)" << std::endl;
+                }
+                staging->release();
+                m_trampleFileJob.store(false, std::memory_order_release);
+            }, nullptr, nullptr, true);
+        }
+        m_trampleTransferSlot = -1;
+    }
+    
+    // Trample queries evaluated by this slot's last frame: hand the results back
+    if (!m_trampleQueriesInFlight[m_frameIndex].empty()) {
+        const float* results = static_cast<const float*>(m_trampleQueryResultBuffers[m_frameIndex]->contents());
+        for (const TrampleQuery& query : m_trampleQueriesInFlight[m_frameIndex]) {
+            std::vector<float> strengths(results, results + query.points.size());
+            results += query.points.size();
+            if (query.callback) {
+                query.callback(strengths);
+            }
+        }
+        m_trampleQueriesInFlight[m_frameIndex].clear();
+    }
+    
+    // Object picks read by this slot's last frame: hand the IDs back
+    if (!m_objectPicksInFlight[m_frameIndex].empty()) {
+        const uint32_t* results = static_cast<const uint32_t*>(m_objectPickResultBuffers[m_frameIndex]->contents());
+        for (const ObjectPick& pick : m_objectPicksInFlight[m_frameIndex]) {
+            size_t count = static_cast<size_t>(pick.region.size.x) * pick.region.size.y;
+            std::vector<uint32_t> ids(results, results + count);
+            results += count;
+            if (pick.callback) {
+                pick.callback(ids, pick.region.size.x, pick.region.size.y);
+            }
+        }
+        m_objectPicksInFlight[m_frameIndex].clear();
+    }
+    
+    // Quality governor first: a new level's scale ceiling applies to this frame's region
+    if (m_qualityGovernor) {
+        double targetFrameMs = m_dynamicResolution ? m_dynamicResolution->getTargetFrameMs() : 1000.0 / 60.0;
+        if (m_qualityGovernor->update(glfwGetTime(), m_profiler->getTimings().frameMs, targetFrameMs)) {
+            applyQualityGovernorStep();
+        }
+    }
+    
+    // Dynamic resolution: pick this frame's render region from the latest GPU frame time.
+    // Temporal upscaling renders 1x with a jittered projection, whatever the region size; so does
+    // TAA, whose own resolve replaces the temporal scaler (the region is then upscaled spatially).
+    bool temporal = m_temporalUpscaling;
+    bool taa = temporal && m_temporalAntialiasingEnabled;
+    // One sample per pixel (temporal modes or 1x MSAA): the scene pass draws straight into the
+    // HDR color and the resolved depth, with nothing to resolve
+    bool singleSample = temporal || m_sceneSampleCount == 1;
+    bool upscale = m_dynamicResolution && m_dynamicResolution->isActive();
+    NS::UInteger renderWidth = targetTexture->width();
+    NS::UInteger renderHeight = targetTexture->height();
+    simd::float2 jitter = simd::make_float2(0.0f, 0.0f);
+    if (upscale) {
+        if (m_dynamicResolution->isEnabled()) {
+            m_dynamicResolution->update(m_profiler->getTimings().frameMs);
+        }
+        renderWidth = m_dynamicResolution->getRenderWidth();
+        renderHeight = m_dynamicResolution->getRenderHeight();
+        jitter = m_dynamicResolution->nextJitter();
+    }
+    if (taa) {
+        jitter = m_temporalAntialiasing->beginFrame(renderWidth, renderHeight);
+    }
+    
+    // Resources created or replaced since the last frame (density changes, resizes, loaded
+    // textures) join the residency set before anything binds them
+    syncResidency();
+    updateGpuMemoryBudget();
+    m_grassPalette->update(m_frameIndex);
+    writeGrassResourceTable();
+    
+    // Brush edits since the last frame, queued ahead of it
+    if (m_grassEditor && m_grassEditor->hasPendingUploads()) {
+        flushGrassEdits();
+    }
+    
+    // A requested or triggered GPU capture starts with this frame's command buffer
+    m_frameCapture->beginFrame(m_profiler->getTimings().frameMs);
+    
+    // Create a CommandBuffer
+    uint64_t encodeStart = TraceRecorder::now();
+    MTL::CommandBuffer* commandBuffer = m_commandQueue->commandBuffer(m_breadcrumbs->getCommandBufferDescriptor());
+    
+    // Late latch: move the camera with the newest input now that the slot and drawable waits are behind
+    if (m_inputLatch && m_camera) {
+        FramePacket latched;
+        uint64_t latchNs = TraceRecorder::now();
+        if (m_inputLatch(latched)) {
+            float latchDelta = m_lastCameraUpdateNs ? static_cast<float>(latchNs - m_lastCameraUpdateNs) * 1e-9f : 0.0f;
+            updateCamera(latched, std::min(latchDelta, 0.25f));
+        }
+        m_lastCameraUpdateNs = latchNs;
+    }
+    
+    // Trample clipmap window for this frame (first world texel; the map wraps around it)
+    NS::UInteger trampleMapSize = m_trampleMap ? m_trampleMap->width() : 1;
+    float trampleTexelsPerMeter = static_cast<float>(trampleMapSize) / kTrampleWindowSize;
+    simd::int2 trampleWindowTexel = m_trampleWindowTexel;
+    if (m_camera) {
+        int half = static_cast<int>(trampleMapSize / 2);
+        trampleWindowTexel = simd::make_int2(static_cast<int>(std::floor(m_camera->position.x * trampleTexelsPerMeter)) - half,
+                                             static_cast<int>(std::floor(m_camera->position.z * trampleTexelsPerMeter)) - half);
+    }
+    
+    // Views of this frame: the main camera over the render region, or the views of setViews()
+    // (viewports in render pixels, projections at the aspect of their share of the output)
+    glm::mat4 viewMatrices[MAX_RENDER_VIEWS];
+    glm::mat4 projectionMatrices[MAX_RENDER_VIEWS]; // Unjittered
+    glm::mat4 jitteredProjections[MAX_RENDER_VIEWS]; // Temporal modes: shifted by this frame's jitter
+    glm::vec3 viewPositions[MAX_RENDER_VIEWS];
+    MTL::Viewport viewports[MAX_RENDER_VIEWS];
+    MTL::ScissorRect scissorRects[MAX_RENDER_VIEWS];
+    uint32_t viewCount = 0;
+    if (m_camera) {
+        float outputWidth = static_cast<float>(targetTexture->width());
+        float outputHeight = static_cast<float>(targetTexture->height());
+        size_t requestedCount = m_views.empty() ? 1 : m_views.size();
+        for (size_t i = 0; i < requestedCount; ++i) {
+            simd::float4 rect = m_views.empty() ? simd::make_float4(0.0f, 0.0f, 1.0f, 1.0f) : m_views[i].viewport;
+            Camera camera = *m_camera;
+            if (!m_views.empty() && !m_views[i].followCamera) {
+                camera.setPose(m_views[i].position, m_views[i].yaw, m_views[i].pitch);
+            }
+            viewMatrices[viewCount] = camera.getViewMatrix();
+            projectionMatrices[viewCount] = camera.getProjectionMatrix(outputWidth * rect.z, outputHeight * rect.w);
+            viewPositions[viewCount] = camera.position;
+            
+            NS::UInteger x = static_cast<NS::UInteger>(rect.x * static_cast<float>(renderWidth));
+            NS::UInteger y = static_cast<NS::UInteger>(rect.y * static_cast<float>(renderHeight));
+            NS::UInteger right = std::min(static_cast<NS::UInteger>(std::lround((rect.x + rect.z) * static_cast<float>(renderWidth))), renderWidth);
+            NS::UInteger bottom = std::min(static_cast<NS::UInteger>(std::lround((rect.y + rect.w) * static_cast<float>(renderHeight))), renderHeight);
+            viewports[viewCount] = { static_cast<double>(x), static_cast<double>(y), static_cast<double>(right - x),
+                                     static_cast<double>(bottom - y), 0.0, 1.0 };
+            scissorRects[viewCount] = { x, y, right - x, bottom - y };
+            
+            // Jitter is in render pixels (y down); shift clip space by it across the view's viewport
+            glm::vec2 jitterClip(2.0f * jitter.x / static_cast<float>(std::max<NS::UInteger>(right - x, 1)),
+                                 -2.0f * jitter.y / static_cast<float>(std::max<NS::UInteger>(bottom - y, 1)));
+            jitteredProjections[viewCount] = temporal ? camera.getProjectionMatrix(outputWidth * rect.z, outputHeight * rect.w, jitterClip)
+                                                      : projectionMatrices[viewCount];
+            ++viewCount;
+        }
+    }
+    
+    // Variable rasterization rate: lower rates over the rows where the ground in front of the
+    // camera is past the fog distances, and toward the edges. Native resolution, one view: the
+    // MetalFX inputs, the TAA resolve and history (whose reprojection needs a layout that stays put
+    // from frame to frame), the visibility-buffer shading and next frame's Hi-Z read the scene
+    // targets as screen pixels.
+    MTL::RasterizationRateMap* rateMap = nullptr;
+    MTL::RenderPipelineState* postRateMappedPSO = nullptr;
+    if (m_rasterizationRate && m_rasterizationRate->isEnabled() && !upscale && !temporal && viewCount == 1 &&
+        !m_grassVisibilityEnabled && !m_objectIds) {
+        glm::mat4 viewProj = projectionMatrices[0] * viewMatrices[0];
+        glm::vec3 forward = -glm::vec3(viewMatrices[0][0][2], viewMatrices[0][1][2], viewMatrices[0][2][2]);
+        glm::vec2 flatForward = glm::vec2(forward.x, forward.z);
+        auto groundRow = [&](float distance) {
+            if (glm::length(flatForward) < 1e-3f) {
+                return -1.0f; // Straight down: no fogged ground on screen
+            }
+            glm::vec2 xz = glm::vec2(viewPositions[0].x, viewPositions[0].z) + glm::normalize(flatForward) * distance;
+            float height = m_terrain ? m_terrain->heightAt(xz.x, xz.y) : 0.0f;
+            glm::vec4 clip = viewProj * glm::vec4(xz.x, height, xz.y, 1.0f);
+            return clip.w > 0.0f ? 0.5f - 0.5f * clip.y / clip.w : -1.0f;
+        };
+        m_rasterizationRate->update(m_profiler->getTimings().frameMs, groundRow(m_fogStartDistance), groundRow(m_fogEndDistance));
+        postRateMappedPSO = m_pipelineCache->get(m_postRateMappedPipelineKey);
+        if (postRateMappedPSO && m_rasterizationRate->parameterBuffer(m_frameIndex)) {
+            rateMap = m_rasterizationRate->getMap();
+        }
+    }
+    
+    // Page the chunks around the camera in and out before this frame's cell list is culled (and
+    // the shadow cascades pick their casters)
+    if (m_grassStreamer && m_camera) {
+        m_grassStreamer->update(simd::make_float3(m_camera->position.x, m_camera->position.y, m_camera->position.z), m_frameIndex);
+        m_trace->counter("Streaming bytes", static_cast<double>(m_grassStreamer->getUploadedBytes()));
+    }
+    if (viewCount > 0) {
+        prepareShadowMaps(viewPositions[0]);
+    }
+    
+    updateSceneConstants();
+    
+    // Update Uniforms struct in m_uniformBuffer (one copy per view, UNIFORMS_VIEW_STRIDE apart)
+    if (m_uniformBuffer && m_frameInteractorBuffer && viewCount > 0) {
+        TraceRecorder::Scope uniformScope(m_trace, "Uniforms");
+        // View 0's camera; the loop below writes every view's own
+        glm::mat4 viewMatrix = viewMatrices[0];
+        glm::mat4 projectionMatrix = projectionMatrices[0];
+        
+        // Convert glm::mat4 to simd::float4x4 manually
+        Uniforms uniforms;
+        uniforms.viewMatrix = glmToSimd(viewMatrix);
+        uniforms.projectionMatrix = glmToSimd(projectionMatrix);
+        uniforms.inverseViewProjection = glmToSimd(glm::inverse(projectionMatrix * viewMatrix));
+        // Update uniforms.time before copying it to the buffer
+        uniforms.time = sceneTime();
+        
+        // Simulation steps due this frame (trample, physics and wind each run on their own clock)
+        for (SimulationClock& clock : m_simulationClocks) {
+            clock.advance(uniforms.time);
+        }
+        
+        // Set uniforms.lightDirection. Use simd::normalize(simd::make_float3(1.0f, 1.0f, -1.0f)) (Simulating a sun from the side)
+        uniforms.lightDirection = simd::normalize(simd::make_float3(1.0f, 1.0f, -1.0f));
+        
+        // Sun for stylized foliage lighting, the sky and the fog (setSun(); default normalize(1.0, 1.0, 0.5))
+        uniforms.sunDirection = m_sunDirection;
+        
+        // Sun color (default: bright warm sunlight)
+        uniforms.sunColor = m_sunColor;
+        
+        // Set uniforms.cameraPosition for cylindrical billboarding
+        glm::vec3 camPos = viewPositions[0];
+        uniforms.cameraPosition = simd::make_float3(camPos.x, camPos.y, camPos.z);
+        
+        // Interactors (circular motion for demonstration); the ball is interactor 0. With physics
+        // the GPU writes them from its bodies, and the CPU only provides the spawn state on a reset.
+        // An external control frame is drawn as it is
+        float prevTime = m_prevUniformsValid ? m_prevUniforms[0].time : uniforms.time;
+        bool physics = m_interactorPhysicsEnabled && m_interactorPhysicsPSO && m_interactorBodyBuffer && !m_externalFrame;
+        // The motion stream changes every frame; the shapes only when the physics spawn switches
+        // the capsules on or off, so only then do they go out again
+        if (!m_externalFrame && (!physics || m_interactorPhysicsReset)) {
+            if (m_interactorCapsules != physics) {
+                m_interactorCapsules = physics;
+                for (size_t i = 0; i < m_interactorHandles.size(); ++i) {
+                    m_interactors.updateCold(m_interactorHandles[i], scriptedShape(static_cast<int>(i)));
+                }
+            }
+            for (int i = 0; i < m_interactorCount; ++i) {
+                Interactor interactor = scriptedInteractor(i, uniforms.time, prevTime);
+                InteractorMotion motion = { interactor.position, interactor.prevPosition, interactor.radius };
+                if (physics && i > 0) {
+                    // Stand-ins drop from a few meters up (capsules by their half height more), keeping their orbit's speed
+                    float lift = 1.5f + 0.5f * static_cast<float>(i % 4);
+                    if (i % 3 == 2) {
+                        lift += interactor.bodyRadius;
+                    }
+                    motion.position.y += lift;
+                    motion.prevPosition.y += lift;
+                }
+                m_interactors.updateHot(m_interactorHandles[i], motion);
+            }
+            m_interactors.uploadRecords<Interactor>(m_frameIndex, m_interactorBuffers[m_frameIndex], MAX_INTERACTORS);
+        }
+        uniforms.interactorCount = static_cast<uint32_t>(m_interactorCount);
+        
+        // Point lights: the lights changed since this slot's last frame go into its copy, clustered
+        // up to the fog end (lights past it are fogged out)
+        bool pointLights = !m_pointLights.empty() && m_pointLightBuffers[m_frameIndex] && m_lightClusterBuffer && m_lightClusterPSO;
+        m_pointLights.upload(m_frameIndex, m_pointLightBuffers[m_frameIndex], MAX_POINT_LIGHTS);
+        uniforms.pointLightCount = pointLights ? static_cast<uint32_t>(m_pointLights.size()) : 0;
+        uniforms.lightClusterNear = kLightClusterNear;
+        uniforms.lightClusterFar = m_fogEndDistance;
+        
+        // Sun shadow maps (prepareShadowMaps()): the overlay only holds something with interactors
+        uniforms.shadowMapCount = m_shadowMapsActive ? SHADOW_MAP_COUNT : 0;
+        uniforms.shadowOverlayActive = m_shadowOverlayActive ? 1 : 0;
+        for (int map = 0; map < SHADOW_MAP_COUNT; ++map) {
+            uniforms.shadowDepthBias[map] = m_shadowMaps ? m_shadowMaps->getDepthBias(map) : 0.0f;
+            uniforms.shadowViewProjection[map] = glmToSimd(m_shadowMaps ? m_shadowMaps->getViewProjection(map) : glm::mat4(1.0f));
+        }
+        
+        uniforms.bladePhysicsCenter = uniforms.cameraPosition;
+        uniforms.bladePhysicsRadius = isBladePhysicsActive() ? m_bladePhysicsRadius : 0.0f;
+        
+        // Trample window: centred on the camera, snapped to whole texels
+        uniforms.trampleWindowMinXZ = simd::make_float2(static_cast<float>(trampleWindowTexel.x),
+                                                       static_cast<float>(trampleWindowTexel.y)) / trampleTexelsPerMeter;
+        uniforms.trampleWindowSize = kTrampleWindowSize;
+        
+        // Every view knows all cameras (density LOD widening by the nearest one)
+        uniforms.viewCount = viewCount;
+        for (uint32_t v = 0; v < viewCount; ++v) {
+            uniforms.viewCameraPositions[v] = simd::make_float4(viewPositions[v].x, viewPositions[v].y, viewPositions[v].z, 0.0f);
+        }
+        
+        // Per view: its camera and its own motion vector history (first frame: no motion)
+        uint8_t* uniformContents = static_cast<uint8_t*>(m_uniformBuffer->contents());
+        for (uint32_t v = 0; v < viewCount; ++v) {
+            Uniforms viewUniforms = uniforms;
+            glm::mat4 viewProjection = jitteredProjections[v];
+            viewUniforms.viewIndex = v;
+            viewUniforms.viewMatrix = glmToSimd(viewMatrices[v]);
+            viewUniforms.projectionMatrix = glmToSimd(viewProjection);
+            viewUniforms.inverseViewProjection = glmToSimd(glm::inverse(viewProjection * viewMatrices[v]));
+            viewUniforms.cameraPosition = simd::make_float3(viewPositions[v].x, viewPositions[v].y, viewPositions[v].z);
+            viewUniforms.unjitteredViewProjection = glmToSimd(projectionMatrices[v] * viewMatrices[v]);
+            
+            const Uniforms& previous = m_prevUniformsValid ? m_prevUniforms[v] : viewUniforms;
+            viewUniforms.prevViewProjection = previous.unjitteredViewProjection;
+            viewUniforms.prevCameraPosition = previous.cameraPosition;
+            viewUniforms.prevTime = previous.time;
+            m_prevUniforms[v] = viewUniforms;
+            
+            // Copy uniforms to buffer
+            memcpy(uniformContents + v * UNIFORMS_VIEW_STRIDE, &viewUniforms, sizeof(Uniforms));
+        }
+        m_prevUniformsValid = true;
+    }
+    
+    // ============================================================
+    // FRAME GRAPH
+    // ============================================================
+    // Passes declare what they read and write; the graph picks load/store actions,
+    // keeps the MSAA targets in tile memory and drops passes whose output nobody uses
+    RenderGraph& graph = *m_renderGraph;
+    graph.reset();
+    
+    RenderGraphResource target = graph.importTexture("Target", targetTexture, false);
+    // Next frame's Hi-Z source; single-sample passes render depth into it directly (cleared, not loaded)
+    RenderGraphResource resolvedDepth = graph.importTexture("ResolvedDepth", m_depthTexture, !singleSample);
+    RenderGraphResource trampleMap = graph.importTexture("TrampleMap", m_trampleMap, true);
+    RenderGraphResource hiZ = graph.importTexture("HiZ", m_hiZTexture, false);
+    RenderGraphResource visibleInstances = graph.importBuffer("VisibleInstances", m_visibleInstanceBuffer);
+    RenderGraphResource drawArguments = graph.importBuffer("GrassDrawArguments", m_grassDrawArgsBuffer);
+    RenderGraphResource impostors = graph.importBuffer("GrassImpostors", m_impostorBuffer);
+    RenderGraphResource impostorDrawArguments = graph.importBuffer("GrassImpostorDrawArguments", m_impostorDrawArgsBuffer);
+    // The field and the GPU-encoded grass draws (the field is written outside the graph)
+    RenderGraphResource grassInstances = grassInstanceBuffer() ? graph.importBuffer("GrassInstances", grassInstanceBuffer()) : kRenderGraphNone;
+    RenderGraphResource grassCells = grassCellBuffer() ? graph.importBuffer("GrassCells", grassCellBuffer()) : kRenderGraphNone;
+    RenderGraphResource cellOrder = m_cellOrderBuffer ? graph.importBuffer("GrassCellOrder", m_cellOrderBuffer) : kRenderGraphNone;
+    RenderGraphResource grassCommands = m_grassICB ? graph.importIndirectCommandBuffer("GrassCommands", m_grassICB) : kRenderGraphNone;
+    RenderGraphResource scaledColor = upscale
+        ? graph.importTexture("ScaledColor", m_dynamicResolution->getColorTexture(), false) // MetalFX input
+        : kRenderGraphNone;
+    RenderGraphResource motionVectors = temporal
+        ? graph.importTexture("MotionVectors", taa ? m_temporalAntialiasing->getMotionTexture() : m_dynamicResolution->getMotionTexture(), false)
+        : kRenderGraphNone;
+    
+    // Resolved HDR scene color, read once per pixel by the post pass (single-sample passes draw into it directly)
+    RenderGraphTextureDesc sceneHDRDesc = { targetTexture->width(), targetTexture->height(), kSceneColorFormat, 1, MTL::TextureUsageShaderRead };
+    RenderGraphResource sceneHDR = graph.createTexture("SceneHDR", sceneHDRDesc);
+    
+    // MSAA targets (single-sample passes draw straight into the 1x HDR color and the resolved depth instead)
+    RenderGraphResource sceneColor = kRenderGraphNone;
+    RenderGraphResource sceneDepth = kRenderGraphNone;
+    if (!singleSample) {
+        RenderGraphTextureDesc sceneColorDesc = { targetTexture->width(), targetTexture->height(), kSceneColorFormat, m_sceneSampleCount, MTL::TextureUsageUnknown };
+        RenderGraphTextureDesc sceneDepthDesc = { targetTexture->width(), targetTexture->height(), MTL::PixelFormatDepth32Float, m_sceneSampleCount, MTL::TextureUsageUnknown };
+        sceneColor = graph.createTexture("SceneColorMSAA", sceneColorDesc);
+        sceneDepth = graph.createTexture("SceneDepthMSAA", sceneDepthDesc);
+    }
+    
+    // ============================================================
+    // BIN INTERACTORS + STAMP TRAMPLE MAP (Compute Shader)
+    // ============================================================
+    // Bins list the interactors reaching each trample tile (read by the grass shaders);
+    // decay is analytic (stamp time per texel), so only the interactor footprints are dispatched.
+    // The map is a toroidal clipmap: when the window scrolls, the storage of the texels that left
+    // it is reused by the ones that entered, and only those strips are cleared
+    MTL::Buffer* interactorBuffer = m_frameInteractorBuffer;
+    RenderGraphResource interactors = graph.importBuffer("Interactors", interactorBuffer);
+    
+    // Interactor physics: one step of the rigid bodies, written into this frame's interactor array
+    // before the trample kernels and the body draw read it (no CPU copy of the bodies exists)
+    if (m_interactorPhysicsEnabled && m_interactorPhysicsPSO && m_interactorBodyBuffer && interactorBuffer && m_uniformBuffer &&
+        m_terrain && m_terrain->getMetalTexture() && !m_externalFrame) {
+        // Steps due on the physics clock; the kinematic ball moves along its script across them
+        const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+        const SimulationClock& physicsClock = m_simulationClocks[SimulationPhysics];
+        int physicsSteps = physicsClock.getStepCount();
+        float stepsStart = physicsClock.getTime() - static_cast<float>(physicsSteps) * physicsClock.getStep();
+        InteractorPhysicsUniforms physics;
+        physics.kinematicPosition = scriptedInteractor(0, physicsClock.getTime(), physicsClock.getTime()).position;
+        physics.kinematicStartPosition = scriptedInteractor(0, stepsStart, stepsStart).position;
+        physics.groundMinXZ = m_sceneConstants.groundMinXZ;
+        physics.groundMaxXZ = m_sceneConstants.groundMaxXZ;
+        physics.deltaTime = physicsClock.getStep();
+        physics.frameDeltaTime = std::clamp(frameUniforms->time - frameUniforms->prevTime, 0.0f, SimulationClock::kMaxVariableStep);
+        physics.alpha = physicsClock.getAlpha();
+        physics.stepCount = static_cast<uint32_t>(physicsSteps);
+        physics.gravity = kInteractorGravity;
+        physics.friction = kInteractorFriction;
+        physics.grassDrag = kInteractorGrassDrag;
+        physics.restitution = kInteractorRestitution;
+        physics.bodyCount = static_cast<uint32_t>(m_interactorCount);
+        physics.reset = m_interactorPhysicsReset ? 1u : 0u;
+        physics.kinematicBall = 1u;
+        MTL::Texture* heightmap = m_terrain->getMetalTexture();
+        MTL::Texture* densityMap = m_grassDensityMap ? m_grassDensityMap->getMetalTexture() : nullptr;
+        physics.useDensityMap = (m_grassDensityMapEnabled && densityMap) ? 1u : 0u;
+        
+        int physicsPass = graph.addComputePass("InteractorPhysics", GpuPassPhysics, [this, interactorBuffer, physics, heightmap, densityMap](MTL::ComputeCommandEncoder* computeEncoder) {
+            computeEncoder->setComputePipelineState(m_interactorPhysicsPSO);
+            computeEncoder->setBuffer(m_interactorBodyBuffer, 0, InteractorPhysicsBufferIndexBodies);
+            computeEncoder->setBuffer(interactorBuffer, 0, InteractorPhysicsBufferIndexInteractors);
+            computeEncoder->setBytes(&physics, sizeof(physics), InteractorPhysicsBufferIndexUniforms);
+            computeEncoder->setTexture(heightmap, 0);
+            computeEncoder->setTexture(densityMap ? densityMap : heightmap, 1); // Unread without a mask
+            
+            // One threadgroup: every body's contacts read the others from threadgroup memory
+            computeEncoder->dispatchThreadgroups(MTL::Size(1, 1, 1), MTL::Size(MAX_INTERACTORS, 1, 1));
+        });
+        graph.write(physicsPass, graph.importBuffer("InteractorBodies", m_interactorBodyBuffer));
+        graph.write(physicsPass, interactors);
+        graph.setAsync(physicsPass);
+        m_interactorPhysicsReset = false;
+        m_interactors.markAllDirty(); // The step rewrites whole records: the scripted frames after it upload everything
+    }
+    
+    // Loaded snapshot: replaces the whole map, laid out for this frame's window (so nothing scrolls in)
+    if (!m_trampleFileJob.load(std::memory_order_acquire) && m_trampleUploadPending && m_trampleSnapshot && m_trampleMap &&
+        m_uniformBuffer && ensureTrampleStagingBuffer()) {
+        const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+        m_trampleSnapshot->restore(static_cast<float*>(m_trampleStagingBuffer->contents()), static_cast<uint32_t>(trampleMapSize),
+                                   trampleWindowTexel, frameUniforms->time, kTrampleDecayRate);
+        m_trampleWindowTexel = trampleWindowTexel;
+        m_trampleWindowValid = true;
+        
+        int uploadPass = graph.addBlitPass("TrampleUpload", [this, trampleMapSize](MTL::BlitCommandEncoder* blitEncoder) {
+            blitEncoder->copyFromBuffer(m_trampleStagingBuffer, 0, sizeof(float) * trampleMapSize, sizeof(float) * trampleMapSize * trampleMapSize,
+                                        MTL::Size(trampleMapSize, trampleMapSize, 1), m_trampleMap, 0, 0, MTL::Origin(0, 0, 0));
+            // Every texel changed: the next summary update re-reduces every tile
+            if (m_trampleDirtyTileBuffer) {
+                blitEncoder->fillBuffer(m_trampleDirtyTileBuffer, NS::Range::Make(0, m_trampleDirtyTileBuffer->length()), 1);
+            }
+        });
+        graph.read(uploadPass, graph.importBuffer("TrampleStaging", m_trampleStagingBuffer));
+        graph.write(uploadPass, trampleMap);
+        if (m_trampleDirtyTileBuffer) {
+            graph.write(uploadPass, graph.importBuffer("TrampleDirtyTiles", m_trampleDirtyTileBuffer));
+        }
+        m_trampleUploadPending = false;
+        m_trampleTransferSlot = m_frameIndex;
+        m_trampleTransferIsReadback = false;
+        std::cout << "Trample snapshot loaded (" << m_trampleSnapshot->getTrampledTexelCount() << " trampled texels)" << std::endl;
+    }
+    
+    RenderGraphResource interactorBins = graph.importBuffer("InteractorBins", m_interactorBinBuffer);
+    RenderGraphResource trampleSummary = graph.importTexture("TrampleSummary", m_trampleSummary, true);
+    bool updateTrampleSummary = false;
+    if (m_trampleComputePSO && m_binInteractorsPSO && m_trampleClearPSO && m_trampleMap && m_interactorBinBuffer && m_trampleDirtyTileBuffer &&
+        interactorBuffer && m_uniformBuffer) {
+        // Newly exposed columns and rows (first world texel, size); a jump past the window clears all of it
+        int mapSize = static_cast<int>(trampleMapSize);
+        simd::int4 clearRegions[2];
+        int clearRegionCount = 0;
+        simd::int2 scroll = trampleWindowTexel - m_trampleWindowTexel;
+        bool jumped = std::abs(scroll.x) >= mapSize || std::abs(scroll.y) >= mapSize;
+        if (m_trampleWindowValid && jumped) {
+            clearRegions[clearRegionCount++] = simd::make_int4(trampleWindowTexel.x, trampleWindowTexel.y, mapSize, mapSize);
+        } else if (m_trampleWindowValid) { // The first window finds the map cleared at creation
+            if (scroll.x != 0) {
+                int x = scroll.x > 0 ? m_trampleWindowTexel.x + mapSize : trampleWindowTexel.x;
+                clearRegions[clearRegionCount++] = simd::make_int4(x, trampleWindowTexel.y, std::abs(scroll.x), mapSize);
+            }
+            if (scroll.y != 0) {
+                int y = scroll.y > 0 ? m_trampleWindowTexel.y + mapSize : trampleWindowTexel.y;
+                clearRegions[clearRegionCount++] = simd::make_int4(trampleWindowTexel.x, y, mapSize, std::abs(scroll.y));
+            }
+        }
+        m_trampleWindowTexel = trampleWindowTexel;
+        m_trampleWindowValid = true;
+        
+        NS::UInteger footprint = trampleFootprint(trampleTexelsPerMeter);
+        NS::UInteger interactorCount = static_cast<NS::UInteger>(m_interactorCount);
+        
+        // Whole query batches that fit this frame's buffers (the rest wait for the next frame)
+        uint32_t queryPointCount = 0;
+        MTL::Buffer* queryPoints = m_trampleQueryPointBuffers[m_frameIndex];
+        MTL::Buffer* queryResults = m_trampleQueryResultBuffers[m_frameIndex];
+        if (m_trampleQueryPSO && queryPoints && queryResults) {
+            size_t taken = 0;
+            simd::float2* points = static_cast<simd::float2*>(queryPoints->contents());
+            while (taken < m_trampleQueries.size() && queryPointCount + m_trampleQueries[taken].points.size() <= kTrampleQueryCapacity) {
+                const std::vector<simd::float2>& batch = m_trampleQueries[taken].points;
+                std::copy(batch.begin(), batch.end(), points + queryPointCount);
+                queryPointCount += static_cast<uint32_t>(batch.size());
+                m_trampleQueriesInFlight[m_frameIndex].push_back(std::move(m_trampleQueries[taken]));
+                ++taken;
+            }
+            m_trampleQueries.erase(m_trampleQueries.begin(), m_trampleQueries.begin() + taken);
+        }
+        
+        // Tiles written while the summary is off stay flagged, so turning it on again catches up
+        updateTrampleSummary = m_trampleSummaryEnabled && m_trampleSummary && !m_trampleSummaryMipViews.empty() &&
+                               m_trampleReducePSO && m_trampleSummaryDownsamplePSO && m_trampleTileCountBuffers[m_frameIndex];
+        
+        // Stamps follow the trample clock (bins follow every frame: the grass shaders read them)
+        bool stampTrample = m_simulationClocks[SimulationTrample].getStepCount() > 0;
+        
+        int tramplePass = graph.addComputePass("Trample", GpuPassTrample, [this, interactorBuffer, footprint, interactorCount, clearRegions, clearRegionCount,
+                                                                           queryPoints, queryResults, queryPointCount, updateTrampleSummary, stampTrample](MTL::ComputeCommandEncoder* computeEncoder) {
+            // Clear the scrolled-in strips first (dispatches in one encoder run in order)
+            computeEncoder->setTexture(m_trampleMap, 0);
+            computeEncoder->setBuffer(m_trampleDirtyTileBuffer, 0, TrampleBufferIndexDirtyTiles);
+            if (clearRegionCount > 0) {
+                computeEncoder->setComputePipelineState(m_trampleClearPSO);
+            }
+            for (int i = 0; i < clearRegionCount; ++i) {
+                computeEncoder->setBytes(&clearRegions[i], sizeof(simd::int4), TrampleBufferIndexClearRegion);
+                m_computeDispatch->dispatch(computeEncoder, m_trampleClearPSO, MTL::Size(
+                    static_cast<NS::UInteger>(clearRegions[i].z), static_cast<NS::UInteger>(clearRegions[i].w), 1));
+            }
+            
+            computeEncoder->setBuffer(m_uniformBuffer, 0, TrampleBufferIndexUniforms);
+            computeEncoder->setBuffer(m_sceneConstantBuffer, 0, TrampleBufferIndexSceneConstants);
+            computeEncoder->setBuffer(interactorBuffer, 0, TrampleBufferIndexInteractors);
+            
+            // One thread per bin
+            computeEncoder->setComputePipelineState(m_binInteractorsPSO);
+            computeEncoder->setBuffer(m_interactorBinBuffer, 0, TrampleBufferIndexBins);
+            m_computeDispatch->dispatch(computeEncoder, m_binInteractorsPSO, MTL::Size(INTERACTOR_BIN_GRID, INTERACTOR_BIN_GRID, 1));
+            
+            // Stamp in place: texels outside every footprint keep their stamp time
+            computeEncoder->setComputePipelineState(m_trampleComputePSO);
+            
+            // One thread per footprint texel, one grid slice per interactor
+            if (stampTrample) {
+                m_computeDispatch->dispatch(computeEncoder, m_trampleComputePSO, MTL::Size(footprint, footprint, interactorCount));
+            }
+            
+            // Summary: re-reduce the flagged tiles (one threadgroup each), then rebuild the small upper levels
+            if (updateTrampleSummary) {
+                MTL::Texture* baseLevel = m_trampleSummaryMipViews[0];
+                computeEncoder->setComputePipelineState(m_trampleReducePSO);
+                computeEncoder->setTexture(baseLevel, 1);
+                computeEncoder->setBuffer(m_trampleTileCountBuffers[m_frameIndex], 0, TrampleBufferIndexUpdatedTiles);
+                computeEncoder->dispatchThreadgroups(MTL::Size(baseLevel->width(), baseLevel->height(), 1),
+                    ComputeDispatch::threadgroupSize(m_trampleReducePSO, MTL::Size(TRAMPLE_SUMMARY_TILE, TRAMPLE_SUMMARY_TILE, 1)));
+                
+                computeEncoder->setComputePipelineState(m_trampleSummaryDownsamplePSO);
+                for (size_t level = 1; level < m_trampleSummaryMipViews.size(); ++level) {
+                    MTL::Texture* dst = m_trampleSummaryMipViews[level];
+                    computeEncoder->setTexture(m_trampleSummaryMipViews[level - 1], 0);
+                    computeEncoder->setTexture(dst, 1);
+                    m_computeDispatch->dispatch(computeEncoder, m_trampleSummaryDownsamplePSO, MTL::Size(dst->width(), dst->height(), 1));
+                }
+                computeEncoder->setTexture(m_trampleMap, 0);
+            }
+            
+            // CPU queries see this frame's stamps (one thread per point)
+            if (queryPointCount > 0) {
+                computeEncoder->setComputePipelineState(m_trampleQueryPSO);
+                computeEncoder->setBuffer(queryPoints, 0, TrampleBufferIndexQueryPoints);
+                computeEncoder->setBuffer(queryResults, 0, TrampleBufferIndexQueryResults);
+                computeEncoder->setBytes(&queryPointCount, sizeof(queryPointCount), TrampleBufferIndexQueryCount);
+                m_computeDispatch->dispatch(computeEncoder, m_trampleQueryPSO, MTL::Size(queryPointCount, 1, 1));
+            }
+        });
+        graph.read(tramplePass, interactors);
+        graph.setAsync(tramplePass);
+        graph.write(tramplePass, trampleMap);
+        graph.write(tramplePass, interactorBins);
+        graph.write(tramplePass, graph.importBuffer("TrampleDirtyTiles", m_trampleDirtyTileBuffer));
+        if (updateTrampleSummary) {
+            graph.write(tramplePass, trampleSummary);
+            graph.write(tramplePass, graph.importBuffer("TrampleUpdatedTiles", m_trampleTileCountBuffers[m_frameIndex]));
+        }
+        if (queryPointCount > 0) {
+            graph.write(tramplePass, graph.importBuffer("TrampleQueryResults", queryResults));
+        }
+    }
+    
+    // Snapshot readback: copy this frame's stamps into shared memory; compressed and written
+    // once the slot comes around again, so the render loop never waits for the GPU
+    if (m_trampleSavePending && m_trampleMap && m_uniformBuffer && m_trampleTransferSlot < 0 &&
+        !m_trampleFileJob.load(std::memory_order_acquire) && ensureTrampleStagingBuffer()) {
+        int readbackPass = graph.addBlitPass("TrampleReadback", [this, trampleMapSize](MTL::BlitCommandEncoder* blitEncoder) {
+            blitEncoder->copyFromTexture(m_trampleMap, 0, 0, MTL::Origin(0, 0, 0), MTL::Size(trampleMapSize, trampleMapSize, 1),
+                                         m_trampleStagingBuffer, 0, sizeof(float) * trampleMapSize, sizeof(float) * trampleMapSize * trampleMapSize);
+        });
+        graph.read(readbackPass, trampleMap);
+        graph.write(readbackPass, graph.importBuffer("TrampleStaging", m_trampleStagingBuffer));
+        m_trampleReadbackWindow = m_trampleWindowTexel;
+        m_trampleReadbackTime = static_cast<const Uniforms*>(m_uniformBuffer->contents())->time;
+        m_trampleSavePending = false;
+        m_trampleTransferSlot = m_frameIndex;
+        m_trampleTransferIsReadback = true;
+    }
+    
+    // Wind at this frame's and last frame's clock, sampled by every blade vertex stage; gust
+    // particles step first and add to either wind model
+    RenderGraphResource windField = graph.importTexture("WindField", m_windField, true);
+    RenderGraphResource windGusts = m_windGustBuffer ? graph.importBuffer("WindGusts", m_windGustBuffer) : kRenderGraphNone;
+    WindGustUniforms gustUniforms = prepareWindGusts();
+    if (m_windFluidEnabled && m_windField && m_windGustBuffer && m_noiseTexture && m_uniformBuffer && interactorBuffer) {
+        // Fluid steps due on the wind clock, each: advect (+ gusts), interactor wakes, divergence,
+        // pressure, projection; then the procedural wind plus the latest (slice 0) and the
+        // step before's (slice 1) velocity
+        const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+        const SimulationClock& windClock = m_simulationClocks[SimulationWind];
+        int windSteps = windClock.getStepCount();
+        WindFluidUniforms fluid = {};
+        fluid.ambientVelocity = simd::normalize(simd::make_float2(1.0f, 0.5f)) * kWindAmbientSpeed; // grassWind() direction
+        fluid.deltaTime = windClock.getStep();
+        fluid.frameDeltaTime = std::clamp(frameUniforms->time - frameUniforms->prevTime, 0.0f, SimulationClock::kMaxVariableStep);
+        fluid.cellSize = (m_sceneConstants.groundMaxXZ.x - m_sceneConstants.groundMinXZ.x) / static_cast<float>(WIND_FIELD_SIZE - 1);
+        fluid.dissipation = kWindFluidDissipation;
+        fluid.bendPerVelocity = kWindBendPerVelocity;
+        fluid.wakeStrength = kWindWakeStrength;
+        fluid.interactorCount = static_cast<uint32_t>(m_interactorCount);
+        
+        // Expired emitters drop out (from the back: a removal moves the last one into the hole); the
+        // slot's arrays then take only the emitters added or moved since it was last written
+        for (size_t i = m_windGusts.size(); i > 0; --i) {
+            if (m_windGusts.hot()[i - 1].endTime <= frameUniforms->time) {
+                m_windGusts.remove(m_windGusts.handleAt(i - 1));
+            }
+        }
+        MTL::Buffer* gustPlacements = m_windGustPlacementBuffers[m_frameIndex];
+        MTL::Buffer* gustFlows = m_windGustFlowBuffers[m_frameIndex];
+        m_windGusts.uploadHot(m_frameIndex, gustPlacements, WIND_MAX_GUSTS);
+        m_windGusts.uploadCold(m_frameIndex, gustFlows, WIND_MAX_GUSTS);
+        fluid.gustCount = (gustPlacements && gustFlows) ? static_cast<uint32_t>(std::min<size_t>(m_windGusts.size(), WIND_MAX_GUSTS)) : 0;
+        
+        // Footprint of the largest interactor reach in cells (like the trample stamp)
+        float maxReach = 0.0f;
+        for (int i = 0; i < m_interactorCount; ++i) {
+            Interactor interactor = interactorShape(i);
+            maxReach = std::max(maxReach, interactor.radius + interactor.falloff);
+        }
+        NS::UInteger footprint = static_cast<NS::UInteger>(std::ceil(2.0f * maxReach / fluid.cellSize)) + 2;
+        
+        // Steps ping-pong the two velocity buffers; without a step both slices read the latest
+        int firstIndex = m_windVelocityIndex;
+        m_windVelocityIndex = (m_windVelocityIndex + windSteps) % 2;
+        MTL::Buffer* current = m_windVelocityBuffers[m_windVelocityIndex];
+        MTL::Buffer* previous = windSteps > 0 ? m_windVelocityBuffers[1 - m_windVelocityIndex] : current;
+        int windPass = graph.addComputePass("Wind", GpuPassWind, [this, fluid, gustUniforms, windSteps, firstIndex, previous, current, interactorBuffer, footprint,
+                                                                    gustPlacements, gustFlows](MTL::ComputeCommandEncoder* computeEncoder) {
+            MTL::Size grid(WIND_FIELD_SIZE, WIND_FIELD_SIZE, 1);
+            encodeWindGusts(computeEncoder, gustUniforms);
+            computeEncoder->setBuffer(m_uniformBuffer, 0, WindBufferIndexUniforms);
+            computeEncoder->setBuffer(m_sceneConstantBuffer, 0, WindBufferIndexSceneConstants);
+            computeEncoder->setBytes(&fluid, sizeof(fluid), WindBufferIndexFluid);
+            computeEncoder->setBuffer(interactorBuffer, 0, WindBufferIndexInteractors);
+            computeEncoder->setBuffer(gustPlacements, 0, WindBufferIndexGustPlacements);
+            computeEncoder->setBuffer(gustFlows, 0, WindBufferIndexGustFlows);
+            
+            for (int step = 0; step < windSteps; ++step) {
+                MTL::Buffer* stepIn = m_windVelocityBuffers[(firstIndex + step) % 2];
+                MTL::Buffer* stepOut = m_windVelocityBuffers[(firstIndex + step + 1) % 2];
+                
+                computeEncoder->setComputePipelineState(m_windAdvectPSO);
+                computeEncoder->setBuffer(stepIn, 0, WindBufferIndexVelocityIn);
+                computeEncoder->setBuffer(m_windScratchBuffer, 0, WindBufferIndexVelocityOut);
+                m_computeDispatch->dispatch(computeEncoder, m_windAdvectPSO, grid);
+                
+                // One grid slice per interactor, into the advected velocity
+                computeEncoder->setComputePipelineState(m_windSplatPSO);
+                m_computeDispatch->dispatch(computeEncoder, m_windSplatPSO, MTL::Size(footprint, footprint, static_cast<NS::UInteger>(fluid.interactorCount)));
+                
+                computeEncoder->setComputePipelineState(m_windDivergencePSO);
+                computeEncoder->setBuffer(m_windScratchBuffer, 0, WindBufferIndexVelocityIn);
+                computeEncoder->setBuffer(m_windDivergenceBuffer, 0, WindBufferIndexDivergence);
+                m_computeDispatch->dispatch(computeEncoder, m_windDivergencePSO, grid);
+                
+                computeEncoder->setComputePipelineState(m_windPressurePSO);
+                for (int i = 0; i < kWindPressureIterations; ++i) {
+                    computeEncoder->setBuffer(m_windPressureBuffers[i % 2], 0, WindBufferIndexPressureIn);
+                    computeEncoder->setBuffer(m_windPressureBuffers[(i + 1) % 2], 0, WindBufferIndexPressureOut);
+                    m_computeDispatch->dispatch(computeEncoder, m_windPressurePSO, grid);
+                }
+                
+                computeEncoder->setComputePipelineState(m_windProjectPSO);
+                computeEncoder->setBuffer(m_windPressureBuffers[0], 0, WindBufferIndexPressureIn);
+                computeEncoder->setBuffer(stepOut, 0, WindBufferIndexVelocityOut);
+                m_computeDispatch->dispatch(computeEncoder, m_windProjectPSO, grid);
+            }
+            
+            computeEncoder->setComputePipelineState(m_windFieldFluidPSO);
+            computeEncoder->setTexture(m_windField, 0);
+            computeEncoder->setTexture(m_noiseTexture->getMetalTexture(), 1);
+            computeEncoder->setBuffer(previous, 0, WindBufferIndexVelocityIn);
+            computeEncoder->setBuffer(current, 0, WindBufferIndexVelocityOut);
+            m_computeDispatch->dispatch(computeEncoder, m_windFieldFluidPSO, grid);
+        });
+        graph.read(windPass, interactors);
+        graph.write(windPass, windField);
+        graph.write(windPass, windGusts);
+        graph.write(windPass, graph.importBuffer("WindVelocity", current));
+        if (windSteps > 0) {
+            graph.write(windPass, graph.importBuffer("WindVelocityPrevious", previous));
+            graph.write(windPass, graph.importBuffer("WindScratch", m_windScratchBuffer));
+            graph.write(windPass, graph.importBuffer("WindDivergence", m_windDivergenceBuffer));
+            graph.write(windPass, graph.importBuffer("WindPressure0", m_windPressureBuffers[0]));
+            graph.write(windPass, graph.importBuffer("WindPressure1", m_windPressureBuffers[1]));
+        }
+        graph.setAsync(windPass);
+    } else if (m_windFieldPSO && m_windField && m_windGustBuffer && m_noiseTexture && m_uniformBuffer) {
+        int windPass = graph.addComputePass("Wind", GpuPassWind, [this, gustUniforms](MTL::ComputeCommandEncoder* computeEncoder) {
+            encodeWindGusts(computeEncoder, gustUniforms);
+            computeEncoder->setComputePipelineState(m_windFieldPSO);
+            computeEncoder->setTexture(m_windField, 0);
+            computeEncoder->setTexture(m_noiseTexture->getMetalTexture(), 1);
+            computeEncoder->setBuffer(m_uniformBuffer, 0, WindBufferIndexUniforms);
+            computeEncoder->setBuffer(m_sceneConstantBuffer, 0, WindBufferIndexSceneConstants);
+            m_computeDispatch->dispatch(computeEncoder, m_windFieldPSO, MTL::Size(WIND_FIELD_SIZE, WIND_FIELD_SIZE, 1));
+        });
+        graph.write(windPass, windField);
+        graph.write(windPass, windGusts);
+        graph.setAsync(windPass);
+    }
+    
+    // Blade springs of the cells within the simulation radius (after the wind and the interactor
+    // bins they respond to)
+    RenderGraphResource bladeStates = isBladePhysicsActive() ? graph.importBuffer("BladeStates", m_bladeStateBuffer) : kRenderGraphNone;
+    if (isBladePhysicsActive() && m_windField && m_uniformBuffer && interactorBuffer && m_interactorBinBuffer) {
+        const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+        simd::float2 center = simd::make_float2(frameUniforms->bladePhysicsCenter.x, frameUniforms->bladePhysicsCenter.z);
+        float cellSize = 2.0f * SCENE_SIZE / static_cast<float>(kGrassCellsPerSide);
+        
+        // Cells whose rectangle reaches into the radius, one threadgroup each
+        uint32_t cellList[kGrassCellsPerSide * kGrassCellsPerSide];
+        uint32_t cellCount = 0;
+        for (int z = 0; z < kGrassCellsPerSide; ++z) {
+            for (int x = 0; x < kGrassCellsPerSide; ++x) {
+                simd::float2 cellMin = simd::make_float2(-SCENE_SIZE + x * cellSize, -SCENE_SIZE + z * cellSize);
+                simd::float2 closest = simd::clamp(center, cellMin, cellMin + cellSize);
+                if (simd::distance(closest, center) < m_bladePhysicsRadius) {
+                    cellList[cellCount++] = static_cast<uint32_t>(z * kGrassCellsPerSide + x);
+                }
+            }
+        }
+        
+        // Steps of the physics clock, like the interactor bodies
+        int bladeSteps = m_simulationClocks[SimulationPhysics].getStepCount();
+        BladePhysicsUniforms physics;
+        physics.deltaTime = m_simulationClocks[SimulationPhysics].getStep();
+        physics.stiffness = kBladePhysicsStiffness;
+        physics.dampingRatio = kBladePhysicsDampingRatio;
+        physics.interactorPush = kBladePhysicsInteractorPush;
+        physics.cellCount = cellCount;
+        
+        if (cellCount > 0 && bladeSteps > 0) {
+            int bladePass = graph.addComputePass("BladePhysics", GpuPassBlades, [this, interactorBuffer, physics, cellList, cellCount, bladeSteps](MTL::ComputeCommandEncoder* computeEncoder) {
+                computeEncoder->setComputePipelineState(m_bladePhysicsPSO);
+                computeEncoder->setBuffer(m_uniformBuffer, 0, BladePhysicsBufferIndexUniforms);
+                computeEncoder->setBuffer(m_sceneConstantBuffer, 0, BladePhysicsBufferIndexSceneConstants);
+                computeEncoder->setBuffer(m_instanceBuffer, 0, BladePhysicsBufferIndexInstances);
+                computeEncoder->setBuffer(m_cellBuffer, 0, BladePhysicsBufferIndexCells);
+                computeEncoder->setBuffer(m_bladeStateBuffer, 0, BladePhysicsBufferIndexStates);
+                computeEncoder->setBuffer(interactorBuffer, 0, BladePhysicsBufferIndexInteractors);
+                computeEncoder->setBuffer(m_interactorBinBuffer, 0, BladePhysicsBufferIndexBins);
+                computeEncoder->setBytes(&physics, sizeof(physics), BladePhysicsBufferIndexParams);
+                computeEncoder->setBytes(cellList, sizeof(uint32_t) * cellCount, BladePhysicsBufferIndexCellList);
+                computeEncoder->setTexture(m_windField, 0);
+                
+                // The threads of a cell's group stride over its blades; steps run in encoding order
+                for (int step = 0; step < bladeSteps; ++step) {
+                    computeEncoder->dispatchThreadgroups(MTL::Size(cellCount, 1, 1),
+                        ComputeDispatch::threadgroupSize(m_bladePhysicsPSO, MTL::Size(256, 1, 1)));
+                }
+            });
+            graph.read(bladePass, windField);
+            graph.read(bladePass, interactorBins);
+            graph.read(bladePass, interactors);
+            graph.read(bladePass, graph.importBuffer("BladeInstances", m_instanceBuffer));
+            graph.read(bladePass, graph.importBuffer("BladeCells", m_cellBuffer));
+            graph.write(bladePass, bladeStates);
+            graph.setAsync(bladePass);
+        }
+    }
+    
+    // Atmosphere LUT: rebuilt only on the first frame and after setSun() moved the sun
+    RenderGraphResource atmosphereLut = graph.importTexture("AtmosphereLut", m_atmosphereLut, true);
+    bool sunChanged = !simd::all(m_atmosphereLutSun.sunDirection == m_sunDirection) ||
+                      !simd::all(m_atmosphereLutSun.sunColor == m_sunColor);
+    if (m_atmosphereLutPSO && m_atmosphereLut && (!m_atmosphereLutValid || sunChanged)) {
+        m_atmosphereLutSun.sunDirection = m_sunDirection;
+        m_atmosphereLutSun.sunColor = m_sunColor;
+        AtmosphereUniforms atmosphereUniforms = m_atmosphereLutSun;
+        int atmospherePass = graph.addComputePass("Atmosphere", GpuPassAtmosphere, [this, atmosphereUniforms](MTL::ComputeCommandEncoder* computeEncoder) {
+            computeEncoder->setComputePipelineState(m_atmosphereLutPSO);
+            computeEncoder->setTexture(m_atmosphereLut, 0);
+            computeEncoder->setBytes(&atmosphereUniforms, sizeof(AtmosphereUniforms), AtmosphereBufferIndexUniforms);
+            m_computeDispatch->dispatch(computeEncoder, m_atmosphereLutPSO, MTL::Size(ATMOSPHERE_LUT_WIDTH, ATMOSPHERE_LUT_HEIGHT, 1));
+        });
+        graph.write(atmospherePass, atmosphereLut);
+        m_atmosphereLutValid = true;
+    }
+    
+    // Point light clusters: each view's froxel grid lists the lights that reach it
+    RenderGraphResource lightClusters = graph.importBuffer("LightClusters", m_lightClusterBuffer);
+    RenderGraphResource pointLightList = graph.importBuffer("PointLights", m_pointLightBuffers[m_frameIndex]);
+    if (!m_pointLights.empty() && m_pointLightBuffers[m_frameIndex] && m_lightClusterBuffer && m_lightClusterPSO) {
+        int lightPass = graph.addComputePass("LightClusters", GpuPassLights, [this, viewCount](MTL::ComputeCommandEncoder* computeEncoder) {
+            computeEncoder->setComputePipelineState(m_lightClusterPSO);
+            computeEncoder->setBuffer(m_pointLightBuffers[m_frameIndex], 0, LightClusterBufferIndexLights);
+            for (uint32_t v = 0; v < viewCount; ++v) {
+                computeEncoder->setBuffer(m_uniformBuffer, v * UNIFORMS_VIEW_STRIDE, LightClusterBufferIndexUniforms);
+                computeEncoder->setBuffer(m_lightClusterBuffer, v * sizeof(LightCluster) * LIGHT_CLUSTER_COUNT, LightClusterBufferIndexClusters);
+                m_computeDispatch->dispatch(computeEncoder, m_lightClusterPSO,
+                                            MTL::Size(LIGHT_CLUSTER_TILES_X, LIGHT_CLUSTER_TILES_Y, LIGHT_CLUSTER_SLICES));
+            }
+        });
+        graph.read(lightPass, pointLightList);
+        graph.write(lightPass, lightClusters);
+    }
+    
+    // Sparse ground texture: map the tiles the completed frame in this slot asked for (and drop the
+    // least recently used ones past the budget), then fill them from the ground albedo. update()
+    // may move the texture to a heap sized for a new budget, so it runs before the import
+    RenderGraphResource sparseGround = kRenderGraphNone;
+    bool useSparseGround = m_sparseGround && m_sparseGround->isValid();
+    if (useSparseGround) {
+        if (m_sparseGroundEnabled) {
+            m_sparseGround->update(m_frameIndex);
+        }
+        sparseGround = graph.importTexture("SparseGround", m_sparseGround->getTexture(), true);
+        if (m_sparseGroundEnabled && m_sparseGround->hasPendingUpdates() && m_groundTexture->getMetalTexture() && m_noiseTexture) {
+            int sparsePass = graph.addCommandBufferPass("SparseGround", [this](MTL::CommandBuffer* sparseCommandBuffer) {
+                m_sparseGround->encodeUpdates(sparseCommandBuffer, m_groundTexture->getMetalTexture(), m_noiseTexture->getMetalTexture(),
+                                              simd::make_float2(-SCENE_SIZE, -SCENE_SIZE), simd::make_float2(SCENE_SIZE, SCENE_SIZE));
+            });
+            graph.write(sparsePass, sparseGround);
+        }
+    }
+    
+    // ============================================================
+    // GPU FRUSTUM CULLING (Compute Shader)
+    // ============================================================
+    // Compacts visible instance indices and writes the indirect draw arguments for the grass pass
+    // On mesh-shader hardware the object stage does the culling, so only the uniforms are needed
+    // (visibility-buffer grass keeps the compute path: its shade pass reads the visible list)
+    bool useIndirectGrassDraw = false;
+    bool useMeshGrassDraw = false;
+    bool useGrassVisibility = false;
+    // The scene ICBs bind view 0's uniforms: several views draw explicitly
+    bool useSceneICB = m_useIndirectCommandBuffers && m_sceneICBs[m_frameIndex] != nullptr && viewCount == 1;
+    
+    // Terrain chunk LODs for this frame's camera
+    glm::vec3 terrainCamera = m_camera->position;
+    selectTerrainLods(simd::make_float3(terrainCamera.x, terrainCamera.y, terrainCamera.z));
+    if (useSceneICB) {
+        encodeTerrainCommands(m_sceneICBs[m_frameIndex]);
+        encodeInteractorCommand(m_sceneICBs[m_frameIndex]);
+    }
+    bool useGrassICB = false;
+    CullUniforms cullUniforms;
+    
+    // Visibility-buffer pipelines of this frame's scene mode, built on first use (forward shading until then)
+    const ScenePipelineKeys& sceneKeys = temporal ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    MTL::RenderPipelineState* grassVisibilityPSO = m_grassVisibilityEnabled ? m_pipelineCache->get(sceneKeys.grassVisibility) : nullptr;
+    MTL::RenderPipelineState* grassShadePSO = m_grassVisibilityEnabled ? m_pipelineCache->get(sceneKeys.grassShade) : nullptr;
+    bool grassVisibilityReady = pipelinesReady && grassVisibilityPSO && grassShadePSO && m_depthTexture && viewCount == 1 &&
+                                !m_objectIds;
+    
+    // Far-field cards are listed by the compute cull pass; blades cover the whole field until their pipeline exists
+    MTL::RenderPipelineState* impostorPSO = m_impostorsEnabled ? m_pipelineCache->get(sceneKeys.impostor) : nullptr;
+    bool useImpostors = pipelinesReady && impostorPSO && m_impostorAtlas && m_impostorAtlas->isValid() &&
+                        m_impostorBuffer && m_impostorDrawArgsBuffer;
+    
+    // Sun shadow maps (prepareShadowMaps()): the cascades that moved redraw their static casters,
+    // the overlay takes this frame's interactor bodies; the others keep their depth
+    RenderGraphResource shadowMapResources[SHADOW_MAP_COUNT];
+    for (int map = 0; map < SHADOW_MAP_COUNT; ++map) {
+        static const char* kShadowMapNames[SHADOW_MAP_COUNT] = { "ShadowCascade0", "ShadowCascade1", "ShadowOverlay" };
+        shadowMapResources[map] = kRenderGraphNone;
+        if (!m_shadowMapsActive) {
+            continue;
+        }
+        bool redraw = map == ShadowMaps::kOverlay ? m_shadowOverlayActive : m_shadowRedraw[map];
+        shadowMapResources[map] = graph.importTexture(kShadowMapNames[map], m_shadowMaps->getTexture(map), !redraw);
+        if (!redraw) {
+            continue;
+        }
+        int shadowPass = graph.addRenderPass(map == ShadowMaps::kOverlay ? "ShadowOverlay" : "ShadowCascade",
+                                             map == ShadowMaps::kOverlay ? GpuPassShadows : GpuPassCount,
+                                             [this, map, interactorBuffer](MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPassDescriptor*) {
+            encodeShadowMap(renderEncoder, map, interactorBuffer);
+        });
+        RenderGraphAttachment shadowDepth;
+        shadowDepth.texture = shadowMapResources[map];
+        graph.setDepthAttachment(shadowPass, shadowDepth);
+        if (map == ShadowMaps::kOverlay) {
+            graph.read(shadowPass, interactors);
+        } else {
+            m_shadowMaps->markDrawn(map);
+        }
+        if (m_shadowMaps->castsGrass(map)) {
+            graph.read(shadowPass, grassInstances);
+        }
+    }
+    
+    m_microbenchCullValid = false;
+    if (!m_cpuCellCulling && m_cullComputePSO && m_resetDrawArgsPSO && m_visibleInstanceBuffer && m_grassDrawArgsBuffer && grassCellBuffer() && m_grassField && m_camera && m_uniformBuffer) {
+        // Every view's frustum: cells and blades are kept inside any of them and tagged with the
+        // views they are visible in
+        glm::mat4 viewProj = projectionMatrices[0] * viewMatrices[0];
+        for (uint32_t v = 0; v < viewCount; ++v) {
+            extractFrustumPlanes(projectionMatrices[v] * viewMatrices[v], cullUniforms.frustumPlanes + 6 * v);
+            cullUniforms.viewCameraPositions[v] = simd::make_float4(viewPositions[v].x, viewPositions[v].y, viewPositions[v].z, 0.0f);
+        }
+        cullUniforms.viewCount = viewCount;
+        glm::vec3 camPos = viewPositions[0];
+        cullUniforms.cameraPosition = simd::make_float3(camPos.x, camPos.y, camPos.z);
+        cullUniforms.lodDistances = simd::make_float4(m_lodDistances[0], m_lodDistances[1], 0.0f, 0.0f);
+        for (int bucket = 0; bucket < GRASS_DRAW_BUCKET_COUNT; ++bucket) {
+            cullUniforms.bucketMeshes[bucket] = simd::make_uint4(m_grassBucketIndexCount[bucket], m_grassBucketIndexStart[bucket],
+                                                                 m_grassBucketBaseVertex[bucket], 0);
+        }
+        cullUniforms.fieldMinXZ = m_grassStreamer ? m_grassStreamer->getMinXZ() : simd::make_float2(-SCENE_SIZE, -SCENE_SIZE);
+        cullUniforms.fieldMaxXZ = m_grassStreamer ? m_grassStreamer->getMaxXZ() : simd::make_float2(SCENE_SIZE, SCENE_SIZE);
+        cullUniforms.instanceCount = m_grassInstanceCount;
+        cullUniforms.cellCount = grassCellCount();
+        cullUniforms.bucketCapacity = m_grassInstanceCapacity;
+        cullUniforms.bladeRadius = kGrassBladeRadius;
+        cullUniforms.lodFadeWidth = m_lodFadeWidth;
+        
+        // Hi-Z occlusion uses last frame's depth, so test against last frame's view-projection
+        // (one view only: the depth target holds every view's viewport)
+        bool useHiZ = m_hiZCullingEnabled && m_hiZValid && m_hiZTexture && m_hiZFromDepthPSO && m_hiZDownsamplePSO && viewCount == 1;
+        cullUniforms.prevViewProjection = glmToSimd(m_prevViewProj);
+        cullUniforms.hiZSize = m_hiZTexture
+            ? simd::make_float2(static_cast<float>(m_hiZTexture->width()), static_cast<float>(m_hiZTexture->height()))
+            : simd::make_float2(1.0f, 1.0f);
+        cullUniforms.hiZMipCount = m_hiZTexture ? static_cast<uint32_t>(m_hiZTexture->mipmapLevelCount()) : 1;
+        cullUniforms.hiZEnabled = useHiZ ? 1 : 0;
+        cullUniforms.hiZUVScale = m_hiZUVScale;
+        
+        // Trample culling evaluates the decay at this frame's clock
+        const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+        cullUniforms.trampleWindowMinXZ = frameUniforms->trampleWindowMinXZ;
+        cullUniforms.trampleWindowSize = frameUniforms->trampleWindowSize;
+        cullUniforms.time = frameUniforms->time;
+        cullUniforms.trampleDecayRate = m_sceneConstants.trampleDecayRate;
+        cullUniforms.trampleSummaryMipCount = m_trampleSummary ? static_cast<uint32_t>(m_trampleSummary->mipmapLevelCount()) : 1;
+        cullUniforms.trampleSummaryEnabled = updateTrampleSummary ? 1 : 0;
+        cullUniforms.impostorEnabled = useImpostors ? 1 : 0;
+        cullUniforms.impostorDistance = m_impostorDistance;
+        cullUniforms.impostorFadeWidth = m_impostorFadeWidth;
+        cullUniforms.densityLodDistance = grassDensityLodDistance();
+        
+        // Cells nearest first (the field and the streaming window both fit one sort threadgroup)
+        bool sortCells = m_frontToBackCells && m_sortCellsPSO && m_cellOrderBuffer &&
+                         cullUniforms.cellCount <= GRASS_CELL_SORT_CAPACITY;
+        cullUniforms.cellOrderEnabled = sortCells ? 1 : 0;
+        cullUniforms.impostorsOnly = 0;
+        
+        // Mesh pipeline is 4x MSAA only, has no object ID output, walks the field's instances, not
+        // cells, and culls for view 0 alone; impostor cards still come from the cells (below)
+        useMeshGrassDraw = (m_meshGrassPSO != nullptr) && !temporal && !grassVisibilityReady && !m_grassStreamer &&
+                           viewCount == 1 && !m_objectIds;
+        useGrassICB = useSceneICB && !useMeshGrassDraw && m_grassICB && m_encodeGrassCommandsPSO;
+        if (useMeshGrassDraw && useImpostors) {
+            // The cell pass alone lists the far cells' cards; the object stage fades their blades out
+            CullUniforms impostorUniforms = cullUniforms;
+            impostorUniforms.impostorsOnly = 1;
+            impostorUniforms.hiZEnabled = 0;
+            int impostorPass = graph.addComputePass("ImpostorCull", GpuPassCull, [this, impostorUniforms](MTL::ComputeCommandEncoder* cullEncoder) {
+                encodeGrassCull(cullEncoder, impostorUniforms, false, false, false);
+            });
+            // Everything encodeGrassCull() binds, though the cells return before the blade lists
+            if (updateTrampleSummary) {
+                graph.read(impostorPass, trampleSummary);
+            }
+            graph.read(impostorPass, hiZ);
+            graph.read(impostorPass, trampleMap);
+            graph.read(impostorPass, grassInstances);
+            graph.read(impostorPass, grassCells);
+            if (cellOrder != kRenderGraphNone) {
+                graph.read(impostorPass, cellOrder);
+            }
+            graph.read(impostorPass, visibleInstances);
+            graph.write(impostorPass, drawArguments);
+            graph.write(impostorPass, impostorDrawArguments);
+            graph.write(impostorPass, impostors);
+            graph.setAsync(impostorPass);
+        }
+        if (!useMeshGrassDraw) {
+            int cullPass = graph.addComputePass("Cull", GpuPassCull, [this, &cullUniforms, useHiZ, useGrassICB, sortCells](MTL::ComputeCommandEncoder* cullEncoder) {
+                encodeGrassCull(cullEncoder, cullUniforms, useHiZ, useGrassICB, sortCells);
+            });
+            if (useHiZ) {
+                graph.read(cullPass, resolvedDepth);
+                graph.write(cullPass, hiZ);
+            }
+            graph.read(cullPass, trampleMap);
+            if (updateTrampleSummary) {
+                graph.read(cullPass, trampleSummary);
+            }
+            graph.read(cullPass, grassInstances);
+            graph.read(cullPass, grassCells);
+            if (sortCells) {
+                graph.write(cullPass, cellOrder);
+            }
+            graph.write(cullPass, visibleInstances);
+            graph.write(cullPass, drawArguments);
+            graph.write(cullPass, impostorDrawArguments); // Reset every frame
+            if (useImpostors) {
+                graph.write(cullPass, impostors);
+            }
+            if (useGrassICB) {
+                graph.write(cullPass, grassCommands);
+            }
+            graph.setAsync(cullPass);
+            useIndirectGrassDraw = true;
+            useGrassVisibility = grassVisibilityReady;
+            m_microbenchCull = cullUniforms;
+            m_microbenchCullValid = true;
+            
+            // Copy the draw arguments for the overlay's visible/culled counts
+            if ((m_overlay || m_trace->isEnabled()) && m_cullStatsBuffers[m_frameIndex]) {
+                MTL::Buffer* cullStatsBuffer = m_cullStatsBuffers[m_frameIndex];
+                int statsPass = graph.addBlitPass("CullStats", [this, cullStatsBuffer](MTL::BlitCommandEncoder* blitEncoder) {
+                    blitEncoder->copyFromBuffer(m_grassDrawArgsBuffer, 0, cullStatsBuffer, 0,
+                                                sizeof(GrassDrawArguments) * GRASS_DRAW_BUCKET_COUNT);
+                });
+                graph.read(statsPass, drawArguments);
+                graph.write(statsPass, graph.importBuffer("CullStats", cullStatsBuffer));
+                m_cullStatsPending[m_frameIndex] = true;
+            }
+        }
+        m_visibleBladeCountsValid = useIndirectGrassDraw;
+        
+        // This frame's depth (resolved into m_depthTexture below) feeds next frame's Hi-Z
+        m_prevViewProj = viewProj;
+    }
+    
+    // CPU cell culling: without the compute pass the grass pass draws the visible cells' instance
+    // ranges instead of the whole field
+    m_cpuCulledThisFrame = false;
+    if (!useIndirectGrassDraw && !useMeshGrassDraw && m_camera) {
+        updateCpuCells();
+        if (m_cpuCellCuller->getCellCount() > 0) {
+            simd::float4 planes[6 * MAX_RENDER_VIEWS];
+            for (uint32_t v = 0; v < viewCount; ++v) {
+                extractFrustumPlanes(projectionMatrices[v] * viewMatrices[v], planes + 6 * v);
+            }
+            m_cpuCellCuller->cull(planes, viewCount);
+            m_cpuCulledThisFrame = true;
+            m_trace->counter("Visible blades", static_cast<double>(m_cpuCellCuller->getVisibleInstanceCount()));
+        }
+    }
+    
+    // ============================================================
+    // SCENE (ground, grass, ball, sky in one render encoder, shaded into linear HDR)
+    // ============================================================
+    // Static passes from the indirect command buffer: only encoder-level state is set per frame
+    MTL::IndirectCommandBuffer* sceneICB = useSceneICB ? m_sceneICBs[m_frameIndex] : nullptr;
+    
+    // Several views: each draws into its viewport with its own uniforms (offset into the buffer);
+    // grass goes through vertex amplification, two views per draw, once that pipeline is built
+    MTL::RenderPipelineState* grassMultiViewPSO = (viewCount > 1 && m_vertexAmplificationSupported)
+        ? m_pipelineCache->get(sceneKeys.grassMultiView) : nullptr;
+    // Dynamic resolution draws into the top-left render region only
+    auto setView = [&](MTL::RenderCommandEncoder* renderEncoder, uint32_t view) {
+        if (upscale || viewCount > 1 || rateMap) {
+            renderEncoder->setViewport(viewports[view]);
+        }
+        if (viewCount > 1) {
+            renderEncoder->setScissorRect(scissorRects[view]);
+        }
+    };
+    
+    // Encoder state every segment below starts from (once per encoder)
+    auto beginSceneEncoder = [&](MTL::RenderCommandEncoder* renderEncoder) {
+        if (sceneICB) {
+            renderEncoder->useResource(m_uniformBuffer, MTL::ResourceUsageRead);
+            renderEncoder->useResource(m_terrainChunkBuffers[m_frameIndex], MTL::ResourceUsageRead);
+            renderEncoder->useResource(m_terrainIndexBuffer, MTL::ResourceUsageRead);
+            renderEncoder->useResource(m_ballVertexBuffer, MTL::ResourceUsageRead);
+            renderEncoder->useResource(m_ballIndexBuffer, MTL::ResourceUsageRead);
+            if (m_externalFrame) {
+                renderEncoder->useResource(m_frameInteractorBuffer, MTL::ResourceUsageRead); // Outside the residency set
+            }
+            if (m_pointLightBuffers[m_frameIndex] && m_lightClusterBuffer) {
+                renderEncoder->useResource(m_pointLightBuffers[m_frameIndex], MTL::ResourceUsageRead);
+                renderEncoder->useResource(m_lightClusterBuffer, MTL::ResourceUsageRead);
+            }
+            if (useSparseGround) {
+                renderEncoder->useResource(m_sparseGround->getUniformBuffer(m_frameIndex), MTL::ResourceUsageRead);
+                renderEncoder->useResource(m_sparseGround->getFeedbackBuffer(m_frameIndex), MTL::ResourceUsageWrite);
+            }
+        }
+        
+        // Set depth stencil state (shared for all passes but the sky)
+        renderEncoder->setDepthStencilState(m_depthStencilState);
+        
+        // The last view's viewport, where the serial encoder is left after the ground
+        setView(renderEncoder, viewCount - 1);
+    };
+    
+    // The scene in draw order, split into segments that each depend only on the state above:
+    // the serial path runs them back to back in one encoder, the parallel path gives each its own
+    // sub-encoder filled on a worker thread
+    std::vector<SceneSegment>& sceneSegments = m_sceneSegments;
+    sceneSegments.clear();
+    
+    // Pass 1: Ground
+    sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+        m_profiler->sampleDraw(renderEncoder, GpuPassGround, true);
+
+        for (uint32_t view = 0; view < viewCount; ++view) {
+            setView(renderEncoder, view);
+            NS::UInteger uniformOffset = view * UNIFORMS_VIEW_STRIDE;
+            if (sceneICB) {
+                // Textures cannot be set from an indirect command, so bind them on the encoder
+                renderEncoder->setVertexTexture(m_terrain->getMetalTexture(), TextureIndexTerrainHeight);
+                renderEncoder->setFragmentTexture(m_groundTexture->getMetalTexture(), 0);
+                renderEncoder->setFragmentTexture(m_trampleMap, TextureIndexTrampleMap);
+                renderEncoder->setFragmentTexture(m_trampleSummary, TextureIndexTrampleSummary);
+                if (useSparseGround) {
+                    renderEncoder->setFragmentTexture(m_sparseGround->getTexture(), TextureIndexSparseGround);
+                }
+                renderEncoder->executeCommandsInBuffer(sceneICB, NS::Range::Make(kSceneCommandGround, TERRAIN_LOD_COUNT));
+            } else if (m_groundPSO && m_terrain && m_terrain->getMetalTexture() && m_terrainIndexBuffer &&
+                       m_terrainChunkBuffers[m_frameIndex] && m_groundTexture && m_groundTexture->getMetalTexture()) {
+                // Explicit Binding: Set the correct PSO
+                renderEncoder->setRenderPipelineState(m_groundPSO);
+                
+                // Explicit Binding: Bind this frame's chunk list and the heightmap the vertices are read from
+                renderEncoder->setVertexBuffer(m_terrainChunkBuffers[m_frameIndex], 0, BufferIndexTerrainChunks);
+                renderEncoder->setVertexTexture(m_terrain->getMetalTexture(), TextureIndexTerrainHeight);
+                
+                // Explicit Binding: Bind the view's uniforms (for both vertex and fragment shaders)
+                renderEncoder->setVertexBuffer(m_uniformBuffer, uniformOffset, BufferIndexUniforms);
+                renderEncoder->setFragmentBuffer(m_uniformBuffer, uniformOffset, BufferIndexUniforms);
+                renderEncoder->setVertexBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+                renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+                renderEncoder->setFragmentBuffer(m_pointLightBuffers[m_frameIndex], 0, BufferIndexPointLights);
+                renderEncoder->setFragmentBuffer(m_lightClusterBuffer, 0, BufferIndexLightClusters);
+                
+                // Explicit Binding: Bind the ground texture, and the trample map and summary the blades are flattened by
+                renderEncoder->setFragmentTexture(m_groundTexture->getMetalTexture(), 0);
+                renderEncoder->setFragmentTexture(m_trampleMap, TextureIndexTrampleMap);
+                renderEncoder->setFragmentTexture(m_trampleSummary, TextureIndexTrampleSummary);
+                
+                // Sparse ground: bound whenever it exists, since a sparse ground pipeline may still be
+                // in use for a few frames after the mode is switched off
+                if (useSparseGround) {
+                    renderEncoder->setFragmentTexture(m_sparseGround->getTexture(), TextureIndexSparseGround);
+                    renderEncoder->setFragmentBuffer(m_sparseGround->getUniformBuffer(m_frameIndex), 0, BufferIndexSparseGround);
+                    renderEncoder->setFragmentBuffer(m_sparseGround->getUniformBuffer(m_frameIndex), m_sparseGround->getResidencyOffset(),
+                                                     BufferIndexSparseGroundResidency);
+                    renderEncoder->setFragmentBuffer(m_sparseGround->getFeedbackBuffer(m_frameIndex), 0, BufferIndexSparseGroundFeedback);
+                }
+                
+                // Draw the ground: one instanced draw per terrain LOD (one instance per chunk)
+                for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+                    if (m_terrainLodChunkCount[lod] == 0) {
+                        continue;
+                    }
+                    renderEncoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, m_terrainLodIndexCount[lod], MTL::IndexTypeUInt16,
+                                                         m_terrainIndexBuffer, m_terrainLodIndexStart[lod] * sizeof(uint16_t),
+                                                         m_terrainLodChunkCount[lod], 0, m_terrainLodFirstChunk[lod]);
+                }
+            } else {
+                std::cerr << "Warning: Ground rendering skipped - missing resources" << std::endl;
+            }
+        }
+        
+        m_profiler->sampleDraw(renderEncoder, GpuPassGround, false);
+    });
+    
+    // Pass 2: Grass (drawn by the visibility pass below in visibility-buffer mode)
+    if (!useGrassVisibility && useMeshGrassDraw) {
+        sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, true);
+            
+            // Mesh shader path: object stage culls and picks LODs, mesh stage emits the strips
+            renderEncoder->setRenderPipelineState(m_meshGrassPSO);
+            renderEncoder->setObjectBuffer(m_instanceBuffer, 0, CullBufferIndexInstances);
+            renderEncoder->setObjectBytes(&cullUniforms, sizeof(CullUniforms), CullBufferIndexUniforms);
+            renderEncoder->setMeshBuffer(m_vertexBuffer, 0, BufferIndexMeshPositions);
+            renderEncoder->setMeshBuffer(m_instanceBuffer, 0, BufferIndexInstanceData);
+            renderEncoder->setMeshBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
+            renderEncoder->setMeshBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            renderEncoder->setMeshBytes(&cullUniforms, sizeof(CullUniforms), BufferIndexCullUniforms);
+            renderEncoder->setMeshBuffer(interactorBuffer, 0, BufferIndexInteractors);
+            renderEncoder->setMeshBuffer(m_interactorBinBuffer, 0, BufferIndexInteractorBins);
+            renderEncoder->setMeshBuffer(grassBladeStateBuffer(), 0, BufferIndexBladeStates);
+            bindGrassResources(renderEncoder, MTL::RenderStageFragment); // fragmentMain reads the table
+            
+            // Object stage culls trampled blades, mesh stage flattens the rest
+            if (m_trampleMap) {
+                renderEncoder->setObjectTexture(m_trampleMap, CullTextureIndexTrampleMap);
+                renderEncoder->setMeshTexture(m_trampleMap, TextureIndexTrampleMap);
+            }
+            renderEncoder->setMeshTexture(m_windField, TextureIndexWindField);
+            
+            NS::UInteger objectGroups = (m_grassInstanceCount + GRASS_MESH_OBJECT_THREADS - 1) / GRASS_MESH_OBJECT_THREADS;
+            renderEncoder->drawMeshThreadgroups(
+                MTL::Size(objectGroups, 1, 1),
+                MTL::Size(GRASS_MESH_OBJECT_THREADS, 1, 1),
+                MTL::Size(GRASS_MESH_MAX_VERTICES, 1, 1));
+            
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, false);
+        });
+    } else if (!useGrassVisibility && grassMultiViewPSO) {
+        sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, true);
+            
+            // Vertex amplification: one draw per pair of views, amplification i renders view
+            // first + i into viewport i of the pair (the odd view out draws unamplified)
+            MTL::VertexAmplificationViewMapping viewMappings[2] = { { 0, 0 }, { 1, 0 } };
+            for (uint32_t first = 0; first < viewCount; first += 2) {
+                uint32_t amplification = std::min(viewCount - first, 2u);
+                renderEncoder->setViewports(viewports + first, amplification);
+                renderEncoder->setScissorRects(scissorRects + first, amplification);
+                renderEncoder->setVertexAmplificationCount(amplification, viewMappings);
+                encodeGrassInstances(renderEncoder, grassMultiViewPSO, false, useIndirectGrassDraw,
+                                     first * UNIFORMS_VIEW_STRIDE);
+            }
+            renderEncoder->setVertexAmplificationCount(1, nullptr);
+            
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, false);
+        });
+    } else if (!useGrassVisibility) {
+        // Classic path: instanced strips fed by the compute cull pass, once per view; one segment
+        // per species (its LOD buckets), except for the unculled fallback, which draws one bucket
+        int speciesSegments = useIndirectGrassDraw ? GRASS_SPECIES_COUNT : 1;
+        
+        // Depth prepass: every bucket into depth first, then the species segments shade only the
+        // nearest blade of each sample (single-pass while the prepass pipeline is compiling)
+        MTL::RenderPipelineState* grassPrepassPSO = m_grassDepthPrepass ? m_pipelineCache->get(sceneKeys.grassPrepass) : nullptr;
+        if (grassPrepassPSO) {
+            sceneSegments.push_back([&, grassPrepassPSO](MTL::RenderCommandEncoder* renderEncoder) {
+                m_profiler->sampleDraw(renderEncoder, GpuPassGrass, true);
+                renderEncoder->setDepthStencilState(m_depthStencilState);
+                for (uint32_t view = 0; view < viewCount; ++view) {
+                    setView(renderEncoder, view);
+                    encodeGrassInstances(renderEncoder, grassPrepassPSO, useGrassICB, useIndirectGrassDraw,
+                                         view * UNIFORMS_VIEW_STRIDE, 0, GRASS_DRAW_BUCKET_COUNT);
+                }
+            });
+        }
+        bool grassPrepassed = grassPrepassPSO != nullptr;
+        for (int species = 0; species < speciesSegments; ++species) {
+            sceneSegments.push_back([&, species, speciesSegments, grassPrepassed](MTL::RenderCommandEncoder* renderEncoder) {
+                if (species == 0 && !grassPrepassed) {
+                    m_profiler->sampleDraw(renderEncoder, GpuPassGrass, true);
+                }
+                if (grassPrepassed) {
+                    renderEncoder->setDepthStencilState(m_grassEqualDepthState);
+                }
+                for (uint32_t view = 0; view < viewCount; ++view) {
+                    setView(renderEncoder, view);
+                    encodeGrassInstances(renderEncoder, m_pso, useGrassICB, useIndirectGrassDraw,
+                                         view * UNIFORMS_VIEW_STRIDE, species * GRASS_LOD_COUNT,
+                                         speciesSegments > 1 ? GRASS_LOD_COUNT : GRASS_DRAW_BUCKET_COUNT);
+                }
+                if (species == speciesSegments - 1) {
+                    m_profiler->sampleDraw(renderEncoder, GpuPassGrass, false);
+                }
+            });
+        }
+    }
+    
+    // Pass 2b: Far-field impostor cards (one 4-vertex strip per cell listed by the cull pass)
+    if ((useIndirectGrassDraw || useMeshGrassDraw) && useImpostors) {
+        sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+            m_profiler->sampleDraw(renderEncoder, GpuPassImpostors, true);
+            const GrassImpostorUniforms& impostorUniforms = m_impostorAtlas->getUniforms();
+            renderEncoder->setRenderPipelineState(impostorPSO);
+            renderEncoder->setDepthStencilState(m_depthStencilState);
+            renderEncoder->setVertexBuffer(m_impostorBuffer, 0, BufferIndexImpostors);
+            renderEncoder->setVertexBytes(&impostorUniforms, sizeof(GrassImpostorUniforms), BufferIndexImpostorUniforms);
+            renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            renderEncoder->setFragmentBuffer(interactorBuffer, 0, BufferIndexInteractors);
+            renderEncoder->setFragmentBuffer(m_interactorBinBuffer, 0, BufferIndexInteractorBins);
+            renderEncoder->setFragmentBuffer(m_pointLightBuffers[m_frameIndex], 0, BufferIndexPointLights);
+            renderEncoder->setFragmentBuffer(m_lightClusterBuffer, 0, BufferIndexLightClusters);
+            renderEncoder->setFragmentTexture(m_impostorAtlas->getNormalTexture(), TextureIndexImpostorNormal);
+            renderEncoder->setFragmentTexture(m_impostorAtlas->getBladeTexture(), TextureIndexImpostorBlade);
+            renderEncoder->setFragmentTexture(m_impostorAtlas->getDepthTexture(), TextureIndexImpostorDepth);
+            renderEncoder->setFragmentTexture(m_noiseTexture->getMetalTexture(), TextureIndexNoise);
+            renderEncoder->setFragmentTexture(m_grassPalette->getTexture(m_frameIndex), TextureIndexGrassPalette);
+            for (uint32_t view = 0; view < viewCount; ++view) {
+                setView(renderEncoder, view);
+                renderEncoder->setVertexBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->setFragmentBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangleStrip, m_impostorDrawArgsBuffer, NS::UInteger(0));
+            }
+            m_profiler->sampleDraw(renderEncoder, GpuPassImpostors, false);
+        });
+    }
+    
+    // Pass 3: Interactor bodies (one instanced draw of the ball mesh, placed from the interactor buffer)
+    sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+        m_profiler->sampleDraw(renderEncoder, GpuPassBall, true);
+        if (sceneICB) {
+            renderEncoder->setDepthStencilState(m_depthStencilState);
+            renderEncoder->executeCommandsInBuffer(sceneICB, NS::Range::Make(kSceneCommandBall, 1));
+        } else if (m_ballPSO && m_ballVertexBuffer && m_ballIndexBuffer && m_ballIndexCount > 0) {
+            // Set ball pipeline state
+            renderEncoder->setRenderPipelineState(m_ballPSO);
+            
+            // Set depth stencil state (standard read/write)
+            renderEncoder->setDepthStencilState(m_depthStencilState);
+            
+            // Set vertex buffers (ball mesh, this frame's interactors)
+            renderEncoder->setVertexBuffer(m_ballVertexBuffer, 0, BufferIndexMeshPositions);
+            renderEncoder->setVertexBuffer(interactorBuffer, 0, BufferIndexInteractors);
+            
+            for (uint32_t view = 0; view < viewCount; ++view) {
+                setView(renderEncoder, view);
+                
+                // Set the view's uniforms
+                renderEncoder->setVertexBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->setFragmentBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                
+                // Draw every interactor
+                renderEncoder->drawIndexedPrimitives(
+                    MTL::PrimitiveTypeTriangle,
+                    NS::UInteger(m_ballIndexCount),
+                    MTL::IndexTypeUInt16,
+                    m_ballIndexBuffer,
+                    NS::UInteger(0),
+                    NS::UInteger(m_interactorCount));
+            }
+        }
+        
+        m_profiler->sampleDraw(renderEncoder, GpuPassBall, false);
+    });
+    
+    // Pass 4: Sky (fullscreen at the far plane, last: only the pixels nothing else covered are shaded)
+    sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+        m_profiler->sampleDraw(renderEncoder, GpuPassSky, true);
+        if (sceneICB && m_atmosphereLut) {
+            renderEncoder->setDepthStencilState(m_skyDepthStencilState);
+            renderEncoder->setFragmentTexture(m_atmosphereLut, TextureIndexAtmosphere);
+            renderEncoder->executeCommandsInBuffer(sceneICB, NS::Range::Make(0, 1));
+        } else if (m_skyPSO && m_skyDepthStencilState && m_atmosphereLut) {
+            // Set sky pipeline state
+            renderEncoder->setRenderPipelineState(m_skyPSO);
+            
+            // Set sky depth stencil state (far-plane test, no write)
+            renderEncoder->setDepthStencilState(m_skyDepthStencilState);
+            
+            // View rays come from the uniforms, colors from the atmosphere LUT
+            renderEncoder->setFragmentTexture(m_atmosphereLut, TextureIndexAtmosphere);
+            
+            // Draw a fullscreen triangle per view, clipped to its viewport (no vertex buffer needed)
+            for (uint32_t view = 0; view < viewCount; ++view) {
+                setView(renderEncoder, view);
+                renderEncoder->setVertexBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->setFragmentBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+            }
+        }
+        
+        m_profiler->sampleDraw(renderEncoder, GpuPassSky, false);
+    });
+    
+    // In-tile post (after every draw): fog and tone map the samples the pass leaves in tile memory,
+    // into the attachment that resolves into the drawable. Native resolution and one view without a
+    // rate map, so the output is in screen pixels; visibility-buffer grass is shaded after the scene
+    // pass, so it keeps the post pass (and so do object IDs: the tile pipeline has no ID attachment).
+    // The output reaches the drawable through a multisample resolve, so 1x keeps the post pass too.
+    bool useTilePost = m_tilePostPSO && m_tilePostEnabled && pipelinesReady && !singleSample && !upscale && viewCount == 1 &&
+                       !rateMap && !useGrassVisibility && !m_objectIds && m_atmosphereLut &&
+                       targetTexture->pixelFormat() == kTilePostOutputFormat;
+    if (useTilePost) {
+        sceneSegments.push_back([&](MTL::RenderCommandEncoder* renderEncoder) {
+            const MTL::Viewport& viewport = viewports[0];
+            simd::float4 viewRect = simd::make_float4(static_cast<float>(viewport.originX), static_cast<float>(viewport.originY),
+                                                      static_cast<float>(viewport.width), static_cast<float>(viewport.height));
+            renderEncoder->setRenderPipelineState(m_tilePostPSO);
+            renderEncoder->setTileBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
+            renderEncoder->setTileBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            renderEncoder->setTileBytes(&viewRect, sizeof(viewRect), BufferIndexRenderSize);
+            renderEncoder->setTileTexture(m_atmosphereLut, TextureIndexAtmosphere);
+            renderEncoder->dispatchThreadsPerTile(MTL::Size(renderEncoder->tileWidth(), renderEncoder->tileHeight(), 1));
+        });
+    }
+    
+    // Render pipelines still compiling: the pass only clears, so the window shows up immediately
+    int scenePass = -1;
+    if (m_parallelEncoding && m_jobSystem && pipelinesReady) {
+        // Sub-encoders run on the GPU in the order they are created, whichever thread fills them
+        scenePass = graph.addParallelRenderPass("Scene", GpuPassScene, [&](MTL::ParallelRenderCommandEncoder* parallelEncoder, MTL::RenderPassDescriptor*) {
+            std::vector<MTL::RenderCommandEncoder*>& segmentEncoders = m_sceneSegmentEncoders;
+            segmentEncoders.resize(sceneSegments.size());
+            for (size_t i = 0; i < sceneSegments.size(); ++i) {
+                segmentEncoders[i] = parallelEncoder->renderCommandEncoder();
+            }
+            m_jobSystem->parallelFor(static_cast<uint32_t>(sceneSegments.size()), [&](uint32_t segment) {
+                MTL::RenderCommandEncoder* renderEncoder = segmentEncoders[segment];
+                if (!renderEncoder) {
+                    return;
+                }
+                beginSceneEncoder(renderEncoder);
+                sceneSegments[segment](renderEncoder);
+                renderEncoder->endEncoding();
+            });
+        });
+    } else {
+        scenePass = graph.addRenderPass("Scene", GpuPassScene, [&](MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPassDescriptor*) {
+            if (!pipelinesReady) {
+                return;
+            }
+            beginSceneEncoder(renderEncoder);
+            for (const auto& segment : sceneSegments) {
+                segment(renderEncoder);
+            }
+        });
+    }
+    
+    // MSAA HDR color resolved for the post pass (left in tile memory by the in-tile post);
+    // clear color matches the fog for seamless blending
+    RenderGraphAttachment colorAttachment;
+    colorAttachment.texture = singleSample ? sceneHDR : sceneColor;
+    colorAttachment.resolve = (singleSample || useTilePost) ? kRenderGraphNone : sceneHDR;
+    colorAttachment.clearColor = MTL::ClearColor(0.4, 0.6, 0.9, 1.0);
+    graph.setColorAttachment(scenePass, 0, colorAttachment);
+    
+    // In-tile post attachments, declared whenever the 4x pipelines carry them: the tone-mapped
+    // output (written by the tile stage, resolved into the drawable) and the fragment depth, cleared
+    // to the far plane so the sky passes through. Frames on the post pass never store either.
+    if (m_tilePostPSO && !temporal) {
+        RenderGraphTextureDesc tileOutputDesc = { targetTexture->width(), targetTexture->height(), kTilePostOutputFormat, m_sceneSampleCount, MTL::TextureUsageUnknown };
+        RenderGraphTextureDesc tileDepthDesc = { targetTexture->width(), targetTexture->height(), kTilePostDepthFormat, m_sceneSampleCount, MTL::TextureUsageUnknown };
+        RenderGraphAttachment tileOutputAttachment;
+        tileOutputAttachment.texture = graph.createTexture("TilePostOutputMSAA", tileOutputDesc);
+        tileOutputAttachment.resolve = useTilePost ? target : kRenderGraphNone;
+        tileOutputAttachment.clear = false;
+        graph.setColorAttachment(scenePass, 1, tileOutputAttachment);
+        
+        RenderGraphAttachment tileDepthAttachment;
+        tileDepthAttachment.texture = graph.createTexture("TilePostDepthMSAA", tileDepthDesc);
+        tileDepthAttachment.clearColor = MTL::ClearColor(1.0, 0.0, 0.0, 0.0);
+        graph.setColorAttachment(scenePass, 3, tileDepthAttachment);
+    }
+    
+    // Temporal mode: motion vectors in color 1 (the sky writes none and keeps the cleared zero)
+    if (temporal) {
+        RenderGraphAttachment motionAttachment;
+        motionAttachment.texture = motionVectors;
+        motionAttachment.clearColor = MTL::ClearColor(0.0, 0.0, 0.0, 0.0);
+        graph.setColorAttachment(scenePass, 1, motionAttachment);
+    }
+    
+    // Object IDs in color 4, at the pass sample count (cleared to nothing for the sky). Stored only
+    // on frames that pick: otherwise the IDs never leave tile memory
+    MTL::ComputePipelineState* pickPSO = singleSample ? m_pickObjectIdsPSO : m_pickObjectIdsMultisampledPSO;
+    MTL::Buffer* pickResults = m_objectPickResultBuffers[m_frameIndex];
+    bool usePicks = m_objectIds && pipelinesReady && pickPSO && pickResults && !m_objectPicks.empty();
+    RenderGraphResource objectIds = kRenderGraphNone;
+    if (m_objectIds) {
+        RenderGraphTextureDesc objectIdDesc = { targetTexture->width(), targetTexture->height(), kObjectIdFormat,
+                                                temporal ? 1 : m_sceneSampleCount,
+                                                usePicks ? MTL::TextureUsageShaderRead : MTL::TextureUsageUnknown };
+        objectIds = graph.createTexture("ObjectIds", objectIdDesc);
+        RenderGraphAttachment objectIdAttachment;
+        objectIdAttachment.texture = objectIds;
+        objectIdAttachment.clearColor = MTL::ClearColor(0.0, 0.0, 0.0, 0.0);
+        graph.setColorAttachment(scenePass, 4, objectIdAttachment);
+    }
+    
+    // MSAA depth, resolved every frame: the post pass fogs by it (and so do next frame's Hi-Z
+    // occlusion and the visibility-buffer grass depth test).
+    // Single-sample passes (the temporal scaler always reads depth) render into m_depthTexture.
+    bool resolveDepth = m_depthTexture != nullptr;
+    RenderGraphAttachment depthAttachment;
+    depthAttachment.texture = singleSample ? resolvedDepth : sceneDepth;
+    depthAttachment.resolve = (resolveDepth && !singleSample) ? resolvedDepth : kRenderGraphNone;
+    depthAttachment.clearDepth = 1.0;
+    graph.setDepthAttachment(scenePass, depthAttachment);
+    m_hiZValid = resolveDepth && !rateMap; // A rate-mapped depth is not in screen pixels
+    if (rateMap) {
+        graph.setRasterizationRateMap(scenePass, rateMap);
+    }
+    
+    graph.read(scenePass, trampleMap);
+    graph.read(scenePass, trampleSummary);
+    graph.read(scenePass, windField);
+    graph.read(scenePass, atmosphereLut);
+    graph.read(scenePass, interactorBins);
+    graph.read(scenePass, bladeStates);
+    graph.read(scenePass, pointLightList);
+    graph.read(scenePass, lightClusters);
+    for (RenderGraphResource shadowMap : shadowMapResources) {
+        graph.read(scenePass, shadowMap);
+    }
+    if (useSparseGround) {
+        graph.read(scenePass, sparseGround);
+    }
+    graph.read(scenePass, grassInstances);
+    graph.read(scenePass, grassCells);
+    if (useIndirectGrassDraw) {
+        graph.read(scenePass, visibleInstances);
+        graph.read(scenePass, drawArguments);
+    }
+    if (useGrassICB) {
+        graph.read(scenePass, grassCommands);
+    }
+    if ((useIndirectGrassDraw || useMeshGrassDraw) && useImpostors) {
+        graph.read(scenePass, impostors);
+        graph.read(scenePass, impostorDrawArguments);
+    }
+    if (upscale) {
+        graph.setRenderArea(scenePass, renderWidth, renderHeight);
+    }
+    
+    // ============================================================
+    // OBJECT ID PICKING (requested regions of the ID attachment)
+    // ============================================================
+    // Whole regions that fit this frame's buffer (the rest wait for the next frame), one dispatch
+    // each; output pixels map into the render region of a dynamic-resolution frame
+    if (usePicks) {
+        std::vector<ObjectPick>* picks = &m_objectPicksInFlight[m_frameIndex];
+        size_t pixelCount = 0;
+        size_t taken = 0;
+        while (taken < m_objectPicks.size()) {
+            ObjectPick& pick = m_objectPicks[taken];
+            size_t pixels = static_cast<size_t>(pick.region.size.x) * pick.region.size.y;
+            if (pixelCount + pixels > kObjectPickCapacity) {
+                break;
+            }
+            pick.region.scale = simd::make_float2(static_cast<float>(renderWidth) / static_cast<float>(targetTexture->width()),
+                                                  static_cast<float>(renderHeight) / static_cast<float>(targetTexture->height()));
+            pick.region.limit = simd::make_uint2(static_cast<uint32_t>(renderWidth), static_cast<uint32_t>(renderHeight));
+            picks->push_back(std::move(pick));
+            pixelCount += pixels;
+            ++taken;
+        }
+        m_objectPicks.erase(m_objectPicks.begin(), m_objectPicks.begin() + taken);
+        
+        int pickPass = graph.addComputePass("ObjectPick", GpuPassCount, [this, &graph, objectIds, pickPSO, pickResults, picks](MTL::ComputeCommandEncoder* computeEncoder) {
+            computeEncoder->setComputePipelineState(pickPSO);
+            computeEncoder->setTexture(graph.getTexture(objectIds), 0);
+            NS::UInteger offset = 0;
+            for (const ObjectPick& pick : *picks) {
+                computeEncoder->setBuffer(pickResults, offset, PickBufferIndexResults);
+                computeEncoder->setBytes(&pick.region, sizeof(ObjectPickUniforms), PickBufferIndexUniforms);
+                m_computeDispatch->dispatch(computeEncoder, pickPSO, MTL::Size(pick.region.size.x, pick.region.size.y, 1));
+                offset += sizeof(uint32_t) * pick.region.size.x * pick.region.size.y;
+            }
+        });
+        graph.read(pickPass, objectIds);
+        graph.write(pickPass, graph.importBuffer("ObjectPickResults", pickResults));
+    }
+    
+    // ============================================================
+    // VISIBILITY-BUFFER GRASS (blade IDs, then lighting once per pixel)
+    // ============================================================
+    // 1x over the resolved scene: the blades write only their IDs (and motion), the last one
+    // standing per pixel is lit by a full-screen draw, so overdraw costs vertex and ID work only.
+    // MSAA mode loses multisampled blade edges here (alpha test, 1x depth from sample 0).
+    if (useGrassVisibility) {
+        int visibilityPass = graph.addRenderPass("GrassVisibility", GpuPassGrassVisibility, [&](MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPassDescriptor*) {
+            if (upscale) {
+                MTL::Viewport viewport = { 0.0, 0.0, static_cast<double>(renderWidth), static_cast<double>(renderHeight), 0.0, 1.0 };
+                renderEncoder->setViewport(viewport);
+            }
+            
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, true);
+            renderEncoder->setDepthStencilState(m_depthStencilState);
+            renderEncoder->setFragmentBytes(&cullUniforms, sizeof(CullUniforms), BufferIndexCullUniforms);
+            encodeGrassInstances(renderEncoder, grassVisibilityPSO, useGrassICB, useIndirectGrassDraw, 0);
+            m_profiler->sampleDraw(renderEncoder, GpuPassGrass, false);
+            
+            // Full-screen shade: the triangle comes back from the IDs and the same blade buffers
+            simd::float2 renderSize = simd::make_float2(static_cast<float>(renderWidth), static_cast<float>(renderHeight));
+            renderEncoder->setRenderPipelineState(grassShadePSO);
+            renderEncoder->setDepthStencilState(m_fullscreenDepthStencilState);
+            renderEncoder->setFragmentBuffer(m_vertexBuffer, 0, BufferIndexMeshPositions);
+            renderEncoder->setFragmentBuffer(grassInstanceBuffer(), 0, BufferIndexInstanceData);
+            renderEncoder->setFragmentBuffer(m_uniformBuffer, 0, BufferIndexUniforms);
+            renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            renderEncoder->setFragmentBuffer(m_visibleInstanceBuffer, 0, BufferIndexVisibleInstances);
+            renderEncoder->setFragmentBuffer(m_indexBuffer, 0, BufferIndexGrassIndices);
+            renderEncoder->setFragmentBuffer(grassBladeStateBuffer(), 0, BufferIndexBladeStates);
+            renderEncoder->setFragmentBuffer(m_pointLightBuffers[m_frameIndex], 0, BufferIndexPointLights);
+            renderEncoder->setFragmentBuffer(m_lightClusterBuffer, 0, BufferIndexLightClusters);
+            renderEncoder->setFragmentBytes(&renderSize, sizeof(renderSize), BufferIndexRenderSize);
+            renderEncoder->setFragmentTexture(m_trampleMap, TextureIndexTrampleMap);
+            renderEncoder->setFragmentTexture(m_windField, TextureIndexWindField);
+            renderEncoder->setFragmentTexture(m_noiseTexture->getMetalTexture(), TextureIndexNoise);
+            renderEncoder->setFragmentTexture(m_grassPalette->getTexture(m_frameIndex), TextureIndexGrassPalette);
+            for (int map = 0; m_shadowMaps && map < SHADOW_MAP_COUNT; ++map) {
+                renderEncoder->setFragmentTexture(m_shadowMaps->getTexture(map), TextureIndexShadowMaps + map);
+            }
+            renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+        });
+        
+        RenderGraphAttachment visibilityColor;
+        visibilityColor.texture = sceneHDR;
+        graph.setColorAttachment(visibilityPass, 0, visibilityColor);
+        if (temporal) {
+            RenderGraphAttachment visibilityMotion;
+            visibilityMotion.texture = motionVectors;
+            graph.setColorAttachment(visibilityPass, 1, visibilityMotion);
+        }
+        
+        // IDs live only inside this pass (memoryless where supported)
+        RenderGraphTextureDesc idsDesc = { targetTexture->width(), targetTexture->height(), kGrassVisibilityFormat, 1, MTL::TextureUsageUnknown };
+        RenderGraphAttachment visibilityIDs;
+        visibilityIDs.texture = graph.createTexture("GrassVisibilityIDs", idsDesc);
+        visibilityIDs.clearColor = MTL::ClearColor(0.0, 0.0, 0.0, 0.0);
+        graph.setColorAttachment(visibilityPass, 2, visibilityIDs);
+        
+        RenderGraphAttachment visibilityDepth;
+        visibilityDepth.texture = resolvedDepth;
+        graph.setDepthAttachment(visibilityPass, visibilityDepth);
+        
+        graph.read(visibilityPass, trampleMap);
+        graph.read(visibilityPass, windField);
+        graph.read(visibilityPass, interactorBins);
+        graph.read(visibilityPass, bladeStates);
+        graph.read(visibilityPass, pointLightList);
+        graph.read(visibilityPass, lightClusters);
+        for (RenderGraphResource shadowMap : shadowMapResources) {
+            graph.read(visibilityPass, shadowMap);
+        }
+        graph.read(visibilityPass, grassInstances);
+        graph.read(visibilityPass, visibleInstances);
+        graph.read(visibilityPass, drawArguments);
+        if (useGrassICB) {
+            graph.read(visibilityPass, grassCommands);
+        }
+        if (upscale) {
+            graph.setRenderArea(visibilityPass, renderWidth, renderHeight);
+        }
+    }
+    
+    // Next frame's Hi-Z only covers this frame's render region
+    m_hiZUVScale = simd::make_float2(static_cast<float>(renderWidth) / static_cast<float>(targetTexture->width()),
+                                     static_cast<float>(renderHeight) / static_cast<float>(targetTexture->height()));
+    
+    // ============================================================
+    // TEMPORAL ANTIALIASING RESOLVE (TAA mode)
+    // ============================================================
+    // The jittered 1x scene color blended with last frame's resolve along the motion vectors;
+    // the post pass fogs and tone maps the result instead of the scene color
+    RenderGraphResource postSource = sceneHDR;
+    if (taa && pipelinesReady && m_temporalResolvePSO) {
+        RenderGraphResource history = graph.importTexture("TemporalHistory", m_temporalAntialiasing->getHistoryTexture(), true);
+        RenderGraphResource resolved = graph.importTexture("TemporalResolved", m_temporalAntialiasing->getOutputTexture(), false);
+        int resolvePass = graph.addComputePass("TemporalResolve", GpuPassTemporalResolve, [this, &graph, sceneHDR](MTL::ComputeCommandEncoder* computeEncoder) {
+            m_temporalAntialiasing->encodeResolve(computeEncoder, m_temporalResolvePSO, *m_computeDispatch,
+                                                  graph.getTexture(sceneHDR), m_depthTexture);
+        });
+        graph.read(resolvePass, sceneHDR);
+        graph.read(resolvePass, motionVectors);
+        graph.read(resolvePass, resolvedDepth);
+        graph.read(resolvePass, history);
+        graph.write(resolvePass, resolved);
+        postSource = resolved;
+    }
+    
+    // ============================================================
+    // POST (depth fog, exposure and tone mapping once per pixel)
+    // ============================================================
+    // HDR scene color into the 8-bit drawable, or into the MetalFX input at render resolution
+    // (the scalers take tone-mapped color). Sky pixels pass through untouched.
+    // Skipped when the in-tile post already resolved the scene into the drawable.
+    MTL::RenderPipelineState* postPSO = m_pipelineCache->get(m_postPipelineKey);
+    if (!useTilePost) {
+        int postPass = graph.addRenderPass("Post", GpuPassPost, [&](MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPassDescriptor*) {
+            // Still compiling: the pass only clears the output
+            if (!pipelinesReady || !postPSO || !m_depthTexture || !m_atmosphereLut) {
+                return;
+            }
+            if (rateMap) {
+                // The scene targets hold the rate map's physical layout
+                renderEncoder->setRenderPipelineState(postRateMappedPSO);
+                renderEncoder->setFragmentBuffer(m_rasterizationRate->parameterBuffer(m_frameIndex), 0, BufferIndexRasterizationRateMap);
+            } else {
+                renderEncoder->setRenderPipelineState(postPSO);
+            }
+            renderEncoder->setFragmentTexture(graph.getTexture(postSource), PostTextureIndexSceneColor);
+            renderEncoder->setFragmentTexture(m_depthTexture, PostTextureIndexSceneDepth);
+            renderEncoder->setFragmentTexture(m_atmosphereLut, TextureIndexAtmosphere);
+            renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+            
+            // Once per view: its pixels are fogged from its own camera
+            for (uint32_t view = 0; view < viewCount; ++view) {
+                if (upscale || viewCount > 1) {
+                    renderEncoder->setViewport(viewports[view]);
+                }
+                const MTL::Viewport& viewport = viewports[view];
+                simd::float4 viewRect = simd::make_float4(static_cast<float>(viewport.originX), static_cast<float>(viewport.originY),
+                                                          static_cast<float>(viewport.width), static_cast<float>(viewport.height));
+                renderEncoder->setFragmentBuffer(m_uniformBuffer, view * UNIFORMS_VIEW_STRIDE, BufferIndexUniforms);
+                renderEncoder->setFragmentBytes(&viewRect, sizeof(viewRect), BufferIndexRenderSize);
+                renderEncoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3));
+            }
+        });
+        
+        RenderGraphAttachment postColor;
+        postColor.texture = upscale ? scaledColor : target;
+        postColor.clearColor = MTL::ClearColor(0.4, 0.6, 0.9, 1.0);
+        graph.setColorAttachment(postPass, 0, postColor);
+        graph.read(postPass, postSource);
+        graph.read(postPass, resolvedDepth);
+        graph.read(postPass, atmosphereLut);
+        if (upscale) {
+            graph.setRenderArea(postPass, renderWidth, renderHeight);
+        }
+    }
+    
+    // ============================================================
+    // UPSCALE (MetalFX spatial or temporal) + OVERLAY at output resolution
+    // ============================================================
+    if (upscale) {
+        bool temporalScaler = temporal && !taa;
+        MTL::Texture* upscaleDepth = temporalScaler ? m_depthTexture : nullptr;
+        int upscalePass = graph.addCommandBufferPass("Upscale", [this, upscaleDepth, targetTexture](MTL::CommandBuffer* upscaleCommandBuffer) {
+            m_dynamicResolution->encodeUpscale(upscaleCommandBuffer, upscaleDepth, targetTexture);
+        });
+        graph.read(upscalePass, scaledColor);
+        if (temporalScaler) {
+            graph.read(upscalePass, resolvedDepth);
+            graph.read(upscalePass, motionVectors);
+        }
+        graph.write(upscalePass, target);
+    }
+    
+    // Video recording: the finished frame, before the overlay, is copied into a free encoder
+    // surface (the overlapping region if the output was resized while recording)
+    double videoTime = m_useFixedTime ? m_fixedTime : glfwGetTime();
+    bool videoReadable = m_videoRecorder && !targetTexture->framebufferOnly();
+    MTL::Texture* videoSurface = videoReadable ? m_videoRecorder->acquireFrame(videoTime) : nullptr;
+    if (videoSurface) {
+        int videoPass = graph.addBlitPass("VideoCopy", [targetTexture, videoSurface](MTL::BlitCommandEncoder* blitEncoder) {
+            MTL::Size size = MTL::Size::Make(std::min(targetTexture->width(), videoSurface->width()),
+                                             std::min(targetTexture->height(), videoSurface->height()), 1);
+            blitEncoder->copyFromTexture(targetTexture, 0, 0, MTL::Origin::Make(0, 0, 0), size, videoSurface, 0, 0, MTL::Origin::Make(0, 0, 0));
+            if (videoSurface->storageMode() == MTL::StorageModeManaged) {
+                blitEncoder->synchronizeResource(videoSurface);
+            }
+        });
+        graph.read(videoPass, target);
+    }
+    
+    // Render target readbacks requested since the last frame, before the overlay. A drawable the
+    // layer handed out before the request is still framebuffer-only: the output copy waits for
+    // one created since (the swapchain's depth at most; past that the copy fails and says so)
+    std::vector<PendingReadback> readbacks;
+    std::vector<PendingReadback> deferredReadbacks;
+    for (PendingReadback& readback : m_pendingReadbacks) {
+        bool deferred = readback.target == ReadbackTargetOutput && targetTexture->framebufferOnly() &&
+                        readback.deferrals++ < kMaxFramesInFlight + 1;
+        (deferred ? deferredReadbacks : readbacks).push_back(std::move(readback));
+    }
+    m_pendingReadbacks.swap(deferredReadbacks);
+    if (!readbacks.empty()) {
+        int readbackPass = graph.addBlitPass("Readback", [this, targetTexture, readbacks](MTL::BlitCommandEncoder* blitEncoder) {
+            for (const PendingReadback& readback : readbacks) {
+                MTL::Texture* texture = readback.target == ReadbackTargetOutput ? targetTexture
+                    : readback.target == ReadbackTargetDepth ? m_depthTexture
+                    : readback.target == ReadbackTargetTrampleMap ? m_trampleMap : m_hiZTexture;
+                m_readback->encode(blitEncoder, texture, static_cast<NS::UInteger>(readback.level), readback.callback);
+            }
+        });
+        graph.read(readbackPass, target);
+        graph.read(readbackPass, resolvedDepth);
+        graph.read(readbackPass, trampleMap);
+        graph.read(readbackPass, hiZ);
+    }
+    
+    // Overlay in its own pass on the final 8-bit output, after the post pass and the upscale
+    // (output resolution; the overlay pipelines only have color 0)
+    if (m_overlay) {
+        int overlayPass = graph.addRenderPass("Overlay", GpuPassCount, [this, commandBuffer](MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPassDescriptor* renderPassDescriptor) {
+            renderOverlay(renderPassDescriptor, commandBuffer, renderEncoder);
+        });
+        RenderGraphAttachment overlayAttachment;
+        overlayAttachment.texture = target;
+        graph.setColorAttachment(overlayPass, 0, overlayAttachment);
+    }
+    
+    // Uploads and rebuilds committed since the last frame (grass edits, regenerated fields,
+    // texture batches) are ordered with the frame's queue only: keep the async passes reading
+    // them behind them for this frame
+    if (m_uploadRing->getCommittedBytes() != m_asyncUploadMark || m_outOfGraphCommandBuffers != m_asyncOutOfGraphMark) {
+        m_asyncUploadMark = m_uploadRing->getCommittedBytes();
+        m_asyncOutOfGraphMark = m_outOfGraphCommandBuffers;
+        graph.holdAsyncPasses();
+    }
+    graph.execute(commandBuffer);
+    m_trace->complete("Encode", encodeStart, TraceRecorder::now());
+    
+    // The segments reference this frame's locals; the vector keeps its capacity for the next frame
+    sceneSegments.clear();
+    
+    // Present the drawable, held on screen for the power policy's frame interval: the drawable
+    // queue then fills and nextDrawable() throttles both the CPU and the GPU
+    if (drawable) {
+        double interval = presentInterval();
+        if (interval > 0.0) {
+            commandBuffer->presentDrawableAfterMinimumDuration(drawable.get(), interval);
+        } else {
+            commandBuffer->presentDrawable(drawable.get());
+        }
+    }
+    
+    // Hand the recorded surface to the encoder once the copy completes (before the slot is released,
+    // so waitUntilIdle() also waits for the submission)
+    if (videoSurface) {
+        m_videoRecorder->submitFrame(commandBuffer);
+    }
+    m_readback->submit(commandBuffer);
+    
+    // Resolve this frame's timestamps, then release its uniform slot (handlers run in order)
+    m_profiler->endFrame(commandBuffer);
+    m_breadcrumbs->watch(commandBuffer);
+    dispatch_semaphore_t frameSemaphore = m_frameSemaphore;
+    commandBuffer->addCompletedHandler([frameSemaphore](MTL::CommandBuffer*) {
+        dispatch_semaphore_signal(frameSemaphore);
+    });
+    
+    // Buffer ranges released since the last frame are reused once this frame completes
+    m_bufferHeap->commit(commandBuffer);
+    
+    // Commit the command buffer
+    uint64_t commitStart = TraceRecorder::now();
+    commandBuffer->commit();
+    m_trace->complete("Commit", commitStart, TraceRecorder::now());
+    m_frameCapture->endFrame();
+}
+
+void Renderer::syncResidency()
+{
+    if (!m_residency || !m_residency->isSupported()) {
+        return;
+    }
+    
+    // Everything that outlives a frame: meshes, instances and cells, textures, simulation state,
+    // per-slot rings and render targets. Pointers are listed as they are now, so replaced
+    // resources drop out and their successors come in with the same sync.
+    std::vector<const MTL::Allocation*>& list = m_residentAllocations;
+    list.clear();
+    list.insert(list.end(), {
+        m_vertexBuffer, m_indexBuffer, m_instanceBuffer, m_cellBuffer, m_grassPlacedCountBuffer,
+        m_terrainIndexBuffer, m_ballVertexBuffer, m_ballIndexBuffer,
+        m_depthTexture, m_offscreenColorTexture, m_hiZTexture, m_grassAlbedoArray,
+        m_trampleMap, m_trampleSummary, m_trampleDirtyTileBuffer, m_trampleStagingBuffer,
+        m_interactorBinBuffer, m_interactorBodyBuffer, m_bladeStateBuffer,
+        m_windField, m_windScratchBuffer, m_windDivergenceBuffer, m_windGustBuffer, m_atmosphereLut, m_lightClusterBuffer,
+        m_visibleInstanceBuffer, m_grassDrawArgsBuffer, m_cellOrderBuffer, m_cpuCellReadbackBuffer,
+        m_impostorBuffer, m_impostorDrawArgsBuffer, m_grassICB, m_grassICBArgumentBuffer,
+    });
+    for (int i = 0; i < 2; ++i) {
+        list.push_back(m_windVelocityBuffers[i]);
+        list.push_back(m_windPressureBuffers[i]);
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        list.insert(list.end(), {
+            m_uniformBuffers[i], m_sceneConstantBuffers[i], m_terrainChunkBuffers[i], m_trampleTileCountBuffers[i],
+            m_trampleQueryPointBuffers[i], m_trampleQueryResultBuffers[i], m_interactorBuffers[i],
+            m_pointLightBuffers[i], m_cullStatsBuffers[i], m_sceneICBs[i], m_objectPickResultBuffers[i],
+            m_windGustPlacementBuffers[i], m_windGustFlowBuffers[i],
+        });
+        if (m_grassStreamer) {
+            list.push_back(m_grassStreamer->getCellBuffer(i));
+        }
+        if (m_sparseGround) {
+            // The sparse texture's tiles are mapped by the sparse heap, not listed here
+            list.push_back(m_sparseGround->getUniformBuffer(i));
+            list.push_back(m_sparseGround->getFeedbackBuffer(i));
+        }
+    }
+    if (m_grassStreamer) {
+        list.push_back(m_grassStreamer->getInstanceBuffer()); // Chunks stream into fixed slots of this pool
+    }
+    if (m_terrain) {
+        list.push_back(m_terrain->getMetalTexture());
+    }
+    if (m_grassDensityMap) {
+        list.push_back(m_grassDensityMap->getMetalTexture());
+    }
+    if (m_noiseTexture) {
+        list.push_back(m_noiseTexture->getMetalTexture());
+    }
+    for (int i = 0; i < m_grassPalette->getSlotCount(); ++i) {
+        list.push_back(m_grassPalette->getTexture(i));
+    }
+    if (m_groundTexture) {
+        list.push_back(m_groundTexture->getMetalTexture()); // Placeholder, then the loaded image
+    }
+    if (m_impostorAtlas) {
+        list.insert(list.end(), { m_impostorAtlas->getNormalTexture(), m_impostorAtlas->getBladeTexture(),
+                                  m_impostorAtlas->getDepthTexture() });
+    }
+    for (int map = 0; m_shadowMaps && map < SHADOW_MAP_COUNT; ++map) {
+        list.push_back(m_shadowMaps->getTexture(map));
+    }
+    m_residency->sync(list);
+}
+
+void Renderer::updateGpuMemoryBudget()
+{
+    if (m_gpuMemory->hasSample() && ++m_gpuMemorySampleFrame < kGpuMemorySampleInterval) {
+        return;
+    }
+    m_gpuMemorySampleFrame = 0;
+    
+    // The resources syncResidency() lists, by category; size-dependent targets live in the target
+    // heap and count as its reserved size, heap-placed buffers as their own size plus the heap's
+    // unused part
+    GpuMemoryBudget& memory = *m_gpuMemory;
+    memory.begin();
+    for (const MTL::Resource* resource : { m_instanceBuffer, m_cellBuffer, m_grassPlacedCountBuffer,
+                                           m_visibleInstanceBuffer, m_grassDrawArgsBuffer, m_cellOrderBuffer,
+                                           m_cpuCellReadbackBuffer, m_impostorBuffer, m_impostorDrawArgsBuffer,
+                                           m_grassICBArgumentBuffer }) {
+        memory.add(GpuMemoryBudget::CategoryInstances, resource);
+    }
+    memory.add(GpuMemoryBudget::CategoryInstances, m_grassICB);
+    for (const MTL::Resource* resource : { m_vertexBuffer, m_indexBuffer, m_terrainIndexBuffer,
+                                           m_ballVertexBuffer, m_ballIndexBuffer }) {
+        memory.add(GpuMemoryBudget::CategoryMeshes, resource);
+    }
+    for (const MTL::Resource* resource : { m_grassAlbedoArray, m_atmosphereLut }) {
+        memory.add(GpuMemoryBudget::CategoryTextures, resource);
+    }
+    if (m_terrain) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_terrain->getMetalTexture());
+    }
+    if (m_grassDensityMap) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_grassDensityMap->getMetalTexture());
+    }
+    if (m_noiseTexture) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_noiseTexture->getMetalTexture());
+    }
+    if (m_groundTexture) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_groundTexture->getMetalTexture());
+    }
+    for (int i = 0; i < m_grassPalette->getSlotCount(); ++i) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_grassPalette->getTexture(i));
+    }
+    if (m_impostorAtlas) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_impostorAtlas->getNormalTexture());
+        memory.add(GpuMemoryBudget::CategoryTextures, m_impostorAtlas->getBladeTexture());
+        memory.add(GpuMemoryBudget::CategoryTextures, m_impostorAtlas->getDepthTexture());
+    }
+    for (int map = 0; m_shadowMaps && map < SHADOW_MAP_COUNT; ++map) {
+        memory.add(GpuMemoryBudget::CategoryTextures, m_shadowMaps->getTexture(map));
+    }
+    memory.addBytes(GpuMemoryBudget::CategoryRenderTargets, static_cast<size_t>(m_targetHeap->getHeapBytes()));
+    for (const MTL::Resource* resource : { m_trampleMap, m_trampleSummary }) {
+        memory.add(GpuMemoryBudget::CategoryTrample, resource);
+    }
+    for (const MTL::Resource* resource : { m_trampleDirtyTileBuffer, m_trampleStagingBuffer }) {
+        memory.add(GpuMemoryBudget::CategoryTrample, resource);
+    }
+    for (const MTL::Resource* resource : { m_interactorBinBuffer, m_interactorBodyBuffer, m_bladeStateBuffer,
+                                           m_windScratchBuffer, m_windDivergenceBuffer, m_windVelocityBuffers[0],
+                                           m_windVelocityBuffers[1], m_windPressureBuffers[0], m_windPressureBuffers[1],
+                                           m_windGustBuffer, m_lightClusterBuffer }) {
+        memory.add(GpuMemoryBudget::CategorySimulation, resource);
+    }
+    memory.add(GpuMemoryBudget::CategorySimulation, m_windField);
+    if (m_grassStreamer) {
+        memory.add(GpuMemoryBudget::CategoryStreaming, m_grassStreamer->getInstanceBuffer());
+    }
+    if (m_sparseGround) {
+        memory.addBytes(GpuMemoryBudget::CategoryStreaming, m_sparseGround->getHeapBytes()); // What the heap holds, mapped or not
+    }
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        for (const MTL::Resource* resource : { m_trampleTileCountBuffers[i], m_trampleQueryPointBuffers[i],
+                                               m_trampleQueryResultBuffers[i], m_interactorBuffers[i], m_pointLightBuffers[i] }) {
+            memory.add(GpuMemoryBudget::CategoryTrample, resource);
+        }
+        memory.add(GpuMemoryBudget::CategoryInstances, m_cullStatsBuffers[i]);
+        memory.add(GpuMemoryBudget::CategoryInstances, m_sceneICBs[i]);
+        for (const MTL::Resource* resource : { m_uniformBuffers[i], m_sceneConstantBuffers[i], m_terrainChunkBuffers[i],
+                                               m_objectPickResultBuffers[i] }) {
+            memory.add(GpuMemoryBudget::CategoryOther, resource);
+        }
+        memory.add(GpuMemoryBudget::CategorySimulation, m_windGustPlacementBuffers[i]);
+        memory.add(GpuMemoryBudget::CategorySimulation, m_windGustFlowBuffers[i]);
+        if (m_grassStreamer) {
+            memory.add(GpuMemoryBudget::CategoryStreaming, m_grassStreamer->getCellBuffer(i));
+        }
+        if (m_sparseGround) {
+            memory.add(GpuMemoryBudget::CategoryStreaming, m_sparseGround->getUniformBuffer(i));
+            memory.add(GpuMemoryBudget::CategoryStreaming, m_sparseGround->getFeedbackBuffer(i));
+        }
+    }
+    BufferHeap::Stats heapStats = m_bufferHeap->getStats();
+    memory.addBytes(GpuMemoryBudget::CategoryOther, static_cast<size_t>(heapStats.heapBytes - heapStats.blockBytes));
+    memory.end();
+    
+    m_trace->counter("GPU memory MB", static_cast<double>(memory.getAllocatedBytes()) / (1024.0 * 1024.0));
+    m_trace->counter("GPU memory tracked MB", static_cast<double>(memory.getTrackedBytes()) / (1024.0 * 1024.0));
+    m_trace->counter("GPU memory budget MB", static_cast<double>(memory.getBudgetBytes()) / (1024.0 * 1024.0));
+    
+    // Under pressure, evict before the system-wide limit: unreferenced cached assets first, then
+    // streamed ground tiles for whatever the cache could not free. Both stay cut while the
+    // pressure holds and get their set budgets back once it clears
+    if (memory.isUnderPressure()) {
+        size_t over = memory.getOverBudgetBytes();
+        if (over == 0) {
+            return;
+        }
+        size_t cacheBytes = m_resourceCache->getResidentBytes();
+        m_resourceCache->setBudget(cacheBytes > over ? cacheBytes - over : 0);
+        size_t freed = cacheBytes - m_resourceCache->getResidentBytes();
+        if (m_sparseGround && freed < over) {
+            size_t streamed = std::min(m_sparseGround->getBudgetBytes(), m_sparseGround->getResidentBytes());
+            m_sparseGround->setBudgetBytes(streamed > over - freed ? streamed - (over - freed) : 0);
+        }
+        if (!m_gpuMemoryShrunk) {
+            std::cerr << "GPU memory over budget (" << memory.getAllocatedBytes() / (1024 * 1024) << " of "
+                      << memory.getBudgetBytes() / (1024 * 1024) << " MB), shrinking the resource caches" << std::endl;
+        }
+        m_gpuMemoryShrunk = true;
+    } else if (m_gpuMemoryShrunk) {
+        m_resourceCache->setBudget(m_resourceCacheBudget);
+        if (m_sparseGround) {
+            m_sparseGround->setBudgetBytes(m_sparseGround->getMaxBudgetBytes());
+        }
+        m_gpuMemoryShrunk = false;
+    }
+}
+
+void Renderer::buildShaders()
+{
+    // Load the library once (every .metal file is linked into default.metallib)
+    MTL::Library* library = m_device->newDefaultLibrary();
+    
+    if (!library) {
+        std::cerr << "Failed to load default Metal library" << std::endl;
+        return;
+    }
+    
+    // Scene render pipelines come from the descriptor-keyed cache: they build asynchronously
+    // and are rebuilt in the background by reloadShaders()
+    m_pipelineCache->setLibrary(library);
+    
+    // Grass: 4x MSAA with alpha-to-coverage for smooth blade edges
+    m_msaaPipelineKeys.grass.vertexFunction = "vertexMain";
+    m_msaaPipelineKeys.grass.fragmentFunction = "fragmentMain";
+    m_msaaPipelineKeys.grass.sampleCount = m_sceneSampleCount;
+    m_msaaPipelineKeys.grass.alphaToCoverage = true;
+    
+    // Ground and ball: opaque, same attachments
+    m_msaaPipelineKeys.ground.vertexFunction = "groundVertexMain";
+    m_msaaPipelineKeys.ground.fragmentFunction = "groundFragmentMain";
+    m_msaaPipelineKeys.ground.sampleCount = m_sceneSampleCount;
+    
+    m_msaaPipelineKeys.ball.vertexFunction = "vertexBall";
+    m_msaaPipelineKeys.ball.fragmentFunction = "fragmentBall";
+    m_msaaPipelineKeys.ball.sampleCount = m_sceneSampleCount;
+    
+    // Sky: fullscreen triangle at the far plane, drawn last into the same MSAA pass, so it needs the pass sample count
+    m_msaaPipelineKeys.sky.vertexFunction = "vertexSky";
+    m_msaaPipelineKeys.sky.fragmentFunction = "fragmentSkyGradient";
+    m_msaaPipelineKeys.sky.sampleCount = m_sceneSampleCount;
+    
+    // Temporal upscaling: 1x, motion vectors in color 1, grass alpha-tested instead of
+    // alpha-to-coverage (the temporal scaler antialiases). Built when the mode is first requested.
+    // Visibility-buffer grass: a 1x pass after the scene pass (blade IDs in color 2, then one
+    // full-screen lighting draw); built when the mode is first requested
+    m_msaaPipelineKeys.grassVisibility.vertexFunction = "vertexMain";
+    m_msaaPipelineKeys.grassVisibility.fragmentFunction = "grassVisibilityFragment";
+    m_msaaPipelineKeys.grassVisibility.visibilityFormat = kGrassVisibilityFormat;
+    m_msaaPipelineKeys.grassVisibility.constants.push_back({ FunctionConstantIndexWriteGrassVisibility, MTL::DataTypeBool, 1 });
+    
+    m_msaaPipelineKeys.grassShade.vertexFunction = "vertexSkyFullscreen";
+    m_msaaPipelineKeys.grassShade.fragmentFunction = "grassShadeFragment";
+    m_msaaPipelineKeys.grassShade.visibilityFormat = kGrassVisibilityFormat;
+    m_msaaPipelineKeys.grassShade.supportIndirectCommandBuffers = false;
+    
+    // Far-field impostor cards: drawn after the grass, fading through alpha-to-coverage like the blades
+    m_msaaPipelineKeys.impostor.vertexFunction = "grassImpostorVertex";
+    m_msaaPipelineKeys.impostor.fragmentFunction = "grassImpostorFragment";
+    m_msaaPipelineKeys.impostor.sampleCount = m_sceneSampleCount;
+    m_msaaPipelineKeys.impostor.alphaToCoverage = true;
+    m_msaaPipelineKeys.impostor.supportIndirectCommandBuffers = false;
+    
+    // Every scene pipeline shades into the HDR color target
+    for (PipelineKey* key : { &m_msaaPipelineKeys.grass, &m_msaaPipelineKeys.ground,
+                              &m_msaaPipelineKeys.ball, &m_msaaPipelineKeys.sky,
+                              &m_msaaPipelineKeys.grassVisibility, &m_msaaPipelineKeys.grassShade,
+                              &m_msaaPipelineKeys.impostor }) {
+        key->colorFormat = kSceneColorFormat;
+    }
+    
+    m_temporalPipelineKeys = m_msaaPipelineKeys;
+    for (PipelineKey* key : { &m_temporalPipelineKeys.grass, &m_temporalPipelineKeys.ground,
+                              &m_temporalPipelineKeys.ball, &m_temporalPipelineKeys.sky,
+                              &m_temporalPipelineKeys.grassVisibility, &m_temporalPipelineKeys.grassShade,
+                              &m_temporalPipelineKeys.impostor }) {
+        key->sampleCount = 1;
+        key->motionFormat = DynamicResolution::kMotionFormat;
+        key->constants.push_back({ FunctionConstantIndexWriteMotionVectors, MTL::DataTypeBool, 1 });
+    }
+    m_temporalPipelineKeys.grass.alphaToCoverage = false;
+    m_temporalPipelineKeys.impostor.alphaToCoverage = false;
+    
+    // In-tile post: every pipeline drawn into the 4x scene pass carries its output and depth
+    // attachments, whether or not a frame runs the tile stage (the pass always declares them)
+    buildTilePostPipeline(library);
+    if (m_tilePostPSO) {
+        for (PipelineKey* key : { &m_msaaPipelineKeys.grass, &m_msaaPipelineKeys.ground, &m_msaaPipelineKeys.ball,
+                                  &m_msaaPipelineKeys.sky, &m_msaaPipelineKeys.impostor }) {
+            key->tileOutputFormat = kTilePostOutputFormat;
+            key->tileDepthFormat = kTilePostDepthFormat;
+            key->constants.push_back({ FunctionConstantIndexWriteTileDepth, MTL::DataTypeBool, 1 });
+        }
+    }
+    updateShadingPipelineKeys();
+    m_msaaPipelineKeys = msaaPipelineKeys(m_sceneSampleCount); // The coverage dither constant
+    
+    // Request them now so they compile while the rest of the scene is set up
+    m_pipelineCache->get(m_msaaPipelineKeys.grass);
+    m_pipelineCache->get(m_msaaPipelineKeys.ground);
+    m_pipelineCache->get(m_msaaPipelineKeys.ball);
+    m_pipelineCache->get(m_msaaPipelineKeys.sky);
+    m_pipelineCache->get(m_msaaPipelineKeys.impostor);
+    
+    // Post pass: 1x full-screen draw into the 8-bit output, no depth attachment
+    m_postPipelineKey.vertexFunction = "vertexSkyFullscreen";
+    m_postPipelineKey.fragmentFunction = "postFogToneMapFragment";
+    m_postPipelineKey.depthFormat = MTL::PixelFormatInvalid;
+    m_postPipelineKey.supportIndirectCommandBuffers = false;
+    m_pipelineCache->get(m_postPipelineKey);
+    m_postRateMappedPipelineKey = m_postPipelineKey;
+    m_postRateMappedPipelineKey.constants = { { FunctionConstantIndexRasterizationRateMap, MTL::DataTypeBool, 1 } };
+    
+    // Mesh shader grass pipeline where the GPU supports object/mesh stages (classic path stays as fallback)
+    if (m_device->supportsFamily(MTL::GPUFamilyApple7) || m_device->supportsFamily(MTL::GPUFamilyMac2)) {
+        buildMeshGrassPipeline(library);
+    }
+    
+    // Create a MTL::DepthStencilDescriptor
+    MTL::DepthStencilDescriptor* depthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    
+    // Set depthCompareFunction to MTL::CompareFunctionLess
+    depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
+    
+    // Set depthWriteEnabled to true
+    depthStencilDescriptor->setDepthWriteEnabled(true);
+    
+    // Create m_depthStencilState using device->newDepthStencilState
+    m_depthStencilState = m_device->newDepthStencilState(depthStencilDescriptor);
+    
+    if (!m_depthStencilState) {
+        std::cerr << "Failed to create depth stencil state" << std::endl;
+    }
+    
+    // Release descriptor
     depthStencilDescriptor->release();
     
-    // Create Sky Depth Stencil State (always pass, no write - sky always behind)
-    MTL::DepthStencilDescriptor* skyDepthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
-    skyDepthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionAlways); // Always pass
-    skyDepthStencilDescriptor->setDepthWriteEnabled(false); // Don't write depth
+    // Create Sky Depth Stencil State (drawn last at the far plane: passes only on the cleared depth)
+    MTL::DepthStencilDescriptor* skyDepthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
+    skyDepthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLessEqual);
+    skyDepthStencilDescriptor->setDepthWriteEnabled(false); // Don't write depth
+    
+    m_skyDepthStencilState = m_device->newDepthStencilState(skyDepthStencilDescriptor);
+    
+    if (!m_skyDepthStencilState) {
+        std::cerr << "Failed to create sky depth stencil state" << std::endl;
+    }
+    
+    // Full-screen shading passes (always pass, no write)
+    skyDepthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionAlways);
+    m_fullscreenDepthStencilState = m_device->newDepthStencilState(skyDepthStencilDescriptor);
+    
+    if (!m_fullscreenDepthStencilState) {
+        std::cerr << "Failed to create full-screen depth stencil state" << std::endl;
+    }
+    
+    // Grass shading after its depth prepass: only the blade that won each sample passes
+    skyDepthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionEqual);
+    m_grassEqualDepthState = m_device->newDepthStencilState(skyDepthStencilDescriptor);
+    
+    if (!m_grassEqualDepthState) {
+        std::cerr << "Failed to create grass equal depth stencil state" << std::endl;
+    }
+    
+    skyDepthStencilDescriptor->release();
+    
+    // Load Trample Compute Shader
+    m_trampleComputePSO = buildComputePipeline(library, "stampTrampleMap");
+    m_binInteractorsPSO = buildComputePipeline(library, "binInteractors");
+    m_interactorPhysicsPSO = buildComputePipeline(library, "simulateInteractors");
+    m_bladePhysicsPSO = buildComputePipeline(library, "simulateBlades");
+    if (m_interactorPhysicsPSO && m_interactorPhysicsPSO->maxTotalThreadsPerThreadgroup() < MAX_INTERACTORS) {
+        std::cerr << "Interactor physics needs " << MAX_INTERACTORS << " threads per threadgroup" << std::endl;
+        m_interactorPhysicsPSO->release();
+        m_interactorPhysicsPSO = nullptr;
+    }
+    m_trampleClearPSO = buildComputePipeline(library, "clearTrampleRegion");
+    m_trampleQueryPSO = buildComputePipeline(library, "queryTrampleStrength");
+    m_trampleReducePSO = buildComputePipeline(library, "reduceTrampleTiles");
+    m_trampleSummaryDownsamplePSO = buildComputePipeline(library, "downsampleTrampleSummary");
+    
+    // Load Wind Field Shader
+    m_windFieldPSO = buildComputePipeline(library, "updateWindField");
+    m_windAdvectPSO = buildComputePipeline(library, "advectWindFluid");
+    m_windSplatPSO = buildComputePipeline(library, "splatWindInteractors");
+    m_windDivergencePSO = buildComputePipeline(library, "windFluidDivergence");
+    m_windPressurePSO = buildComputePipeline(library, "windFluidPressure");
+    m_windProjectPSO = buildComputePipeline(library, "windFluidProject");
+    m_windFieldFluidPSO = buildComputePipeline(library, "updateWindFieldFluid");
+    m_windGustPSO = buildComputePipeline(library, "stepWindGusts");
+    
+    // Load Atmosphere LUT Shader
+    m_atmosphereLutPSO = buildComputePipeline(library, "buildAtmosphereLut");
+
+    // Load Light Cluster Shader
+    m_lightClusterPSO = buildComputePipeline(library, "buildLightClusters");
+    
+    // Load Culling Compute Shaders
+    m_cullComputePSO = buildComputePipeline(library, "cullGrassInstances");
+    m_resetDrawArgsPSO = buildComputePipeline(library, "resetGrassDrawArguments");
+    
+    // Load Hi-Z Compute Shaders
+    m_hiZFromDepthPSO = buildComputePipeline(library, "buildHiZFromDepth");
+    m_hiZDownsamplePSO = buildComputePipeline(library, "downsampleHiZ");
+    
+    // Load Object ID Pick Shaders
+    m_pickObjectIdsPSO = buildComputePipeline(library, "pickObjectIds");
+    m_pickObjectIdsMultisampledPSO = buildComputePipeline(library, "pickObjectIdsMultisampled");
+    
+    // Load Temporal Antialiasing Resolve Shader
+    m_temporalResolvePSO = buildComputePipeline(library, "resolveTemporalAntialiasing");
+    
+    // Load Procedural Grass Generation Shader
+    m_generateGrassPSO = buildComputePipeline(library, "generateGrassInstances");
+    m_paintGrassDensityPSO = buildComputePipeline(library, "paintGrassDensity");
+    
+    // Load Indirect Command Encoding Shader
+    m_encodeGrassCommandsPSO = buildComputePipeline(library, "encodeGrassDrawCommands");
+    
+    // Front-to-back cell order: one threadgroup holds every cell
+    m_sortCellsPSO = buildComputePipeline(library, "sortGrassCellsByDistance");
+    if (m_sortCellsPSO && m_sortCellsPSO->maxTotalThreadsPerThreadgroup() < GRASS_CELL_SORT_CAPACITY) {
+        std::cerr << "Cell sort needs " << GRASS_CELL_SORT_CAPACITY << " threads per threadgroup" << std::endl;
+        m_sortCellsPSO->release();
+        m_sortCellsPSO = nullptr;
+    }
+    
+    library->release();
+}
+
+void Renderer::buildMeshGrassPipeline(MTL::Library* library)
+{
+    // Specialized with the grass shading features, blade mode and precision only: the mesh path never
+    // writes motion vectors (the mesh and fragment stages must agree on the interpolant precision)
+    std::vector<PipelineConstant> fragmentConstants = grassFeatureConstants();
+    fragmentConstants.push_back(halfPrecisionConstant());
+    fragmentConstants.push_back(geometryBladesConstant());
+    if (m_tilePostPSO) {
+        fragmentConstants.push_back({ FunctionConstantIndexWriteTileDepth, MTL::DataTypeBool, 1 });
+    }
+    fragmentConstants.push_back({ FunctionConstantIndexCoverageSamples, MTL::DataTypeInt, static_cast<int32_t>(m_sceneSampleCount) });
+    MTL::Function* objectFunction = PipelineCache::newFunction(library, "grassObjectMain", {});
+    MTL::Function* meshFunction = PipelineCache::newFunction(library, "grassMeshMain",
+                                                             { halfPrecisionConstant(), geometryBladesConstant() });
+    MTL::Function* fragmentFunction = PipelineCache::newFunction(library, "fragmentMain", fragmentConstants);
+    
+    if (!objectFunction || !meshFunction || !fragmentFunction) {
+        std::cerr << "Failed to load mesh grass shader functions" << std::endl;
+        if (objectFunction) objectFunction->release();
+        if (meshFunction) meshFunction->release();
+        if (fragmentFunction) fragmentFunction->release();
+        return;
+    }
+    
+    // Same attachments, MSAA and alpha-to-coverage (textured blades only) as the classic grass pipeline
+    MTL::MeshRenderPipelineDescriptor* meshDescriptor = MTL::MeshRenderPipelineDescriptor::alloc()->init();
+    meshDescriptor->setObjectFunction(objectFunction);
+    meshDescriptor->setMeshFunction(meshFunction);
+    meshDescriptor->setFragmentFunction(fragmentFunction);
+    meshDescriptor->colorAttachments()->object(0)->setPixelFormat(kSceneColorFormat);
+    if (m_tilePostPSO) {
+        meshDescriptor->colorAttachments()->object(1)->setPixelFormat(kTilePostOutputFormat);
+        meshDescriptor->colorAttachments()->object(3)->setPixelFormat(kTilePostDepthFormat);
+    }
+    meshDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+    meshDescriptor->setRasterSampleCount(m_sceneSampleCount);
+    meshDescriptor->setAlphaToCoverageEnabled(!m_geometryBlades);
+    
+    // Synchronous (metal-cpp has no asynchronous mesh pipeline overload), but archive-backed
+    MTL::RenderPipelineState* pipeline = m_pipelineArchive->newMeshPipeline(meshDescriptor, "grassMesh");
+    
+    if (pipeline && m_meshGrassPSO) {
+        // New shading permutation: frames in flight may still draw with the old one
+        waitUntilIdle();
+        m_meshGrassPSO->release();
+        m_meshGrassPSO = pipeline;
+    } else if (pipeline) {
+        m_meshGrassPSO = pipeline;
+        std::cout << "Using mesh shader grass path" << std::endl;
+    }
+    
+    objectFunction->release();
+    meshFunction->release();
+    fragmentFunction->release();
+    meshDescriptor->release();
+}
+
+void Renderer::buildTilePostPipeline(MTL::Library* library)
+{
+    // Tile shaders and implicit imageblocks: A11 and later (every Apple silicon Mac)
+    if (!m_device->supportsFamily(MTL::GPUFamilyApple4)) {
+        return;
+    }
+    MTL::Function* tileFunction = PipelineCache::newFunction(library, "postFogToneMapTile", {});
+    if (!tileFunction) {
+        std::cerr << "Failed to load in-tile post shader function" << std::endl;
+        return;
+    }
+    
+    // The color attachments and sample count of the 4x scene pass; one thread per tile pixel
+    MTL::TileRenderPipelineDescriptor* descriptor = MTL::TileRenderPipelineDescriptor::alloc()->init();
+    descriptor->setTileFunction(tileFunction);
+    descriptor->setRasterSampleCount(m_sceneSampleCount);
+    descriptor->setThreadgroupSizeMatchesTileSize(true);
+    descriptor->colorAttachments()->object(0)->setPixelFormat(kSceneColorFormat);
+    descriptor->colorAttachments()->object(1)->setPixelFormat(kTilePostOutputFormat);
+    descriptor->colorAttachments()->object(3)->setPixelFormat(kTilePostDepthFormat);
+    
+    // Synchronous and archive-backed, like the mesh pipeline
+    MTL::RenderPipelineState* pipeline = m_pipelineArchive->newTilePipeline(descriptor, "postFogToneMapTile");
+    if (pipeline && m_tilePostPSO) {
+        // New sample count (the GPU has drained)
+        m_tilePostPSO->release();
+        m_tilePostPSO = pipeline;
+    } else if (pipeline) {
+        m_tilePostPSO = pipeline;
+        std::cout << "Using in-tile post" << std::endl;
+    }
+    
+    tileFunction->release();
+    descriptor->release();
+}
+
+std::vector<PipelineConstant> Renderer::grassFeatureConstants() const
+{
+    return {
+        { FunctionConstantIndexTrampleDebug, MTL::DataTypeBool, m_showTrampleMap ? 1 : 0 },
+        { FunctionConstantIndexContactShadows, MTL::DataTypeBool, m_grassShadingFeatures.contactShadows ? 1 : 0 },
+        { FunctionConstantIndexTranslucency, MTL::DataTypeBool, m_grassShadingFeatures.translucency ? 1 : 0 },
+        { FunctionConstantIndexWindSheen, MTL::DataTypeBool, m_grassShadingFeatures.windSheen ? 1 : 0 },
+    };
+}
+
+PipelineConstant Renderer::halfPrecisionConstant() const
+{
+    return { FunctionConstantIndexHalfPrecision, MTL::DataTypeBool, m_halfPrecisionShading ? 1 : 0 };
+}
+
+PipelineConstant Renderer::geometryBladesConstant() const
+{
+    return { FunctionConstantIndexGeometryBlades, MTL::DataTypeBool, m_geometryBlades ? 1 : 0 };
+}
+
+PipelineConstant Renderer::sparseGroundConstant() const
+{
+    return { FunctionConstantIndexSparseGround, MTL::DataTypeBool, m_sparseGroundEnabled ? 1 : 0 };
+}
+
+void Renderer::updateShadingPipelineKeys()
+{
+    // Replace constants by index, keeping the list sorted so equal permutations always compare
+    // equal whatever the order the constants were added in
+    auto replaceConstants = [](PipelineKey& key, const std::vector<PipelineConstant>& constants) {
+        for (const PipelineConstant& replacement : constants) {
+            key.constants.erase(std::remove_if(key.constants.begin(), key.constants.end(), [&](const PipelineConstant& constant) {
+                return constant.index == replacement.index;
+            }), key.constants.end());
+        }
+        key.constants.insert(key.constants.end(), constants.begin(), constants.end());
+        std::sort(key.constants.begin(), key.constants.end());
+    };
+    
+    // Blade lighting features on the keys running it; the blade mode on the keys deforming blades;
+    // precision on every shading key but the ball and the sky (its LUT lookup has no half variant);
+    // the ground texture mode on the ground
+    std::vector<PipelineConstant> features = grassFeatureConstants();
+    std::vector<PipelineConstant> bladeMode = { geometryBladesConstant() };
+    std::vector<PipelineConstant> precision = { halfPrecisionConstant() };
+    std::vector<PipelineConstant> groundMode = { sparseGroundConstant() };
+    for (ScenePipelineKeys* keys : { &m_msaaPipelineKeys, &m_temporalPipelineKeys }) {
+        replaceConstants(keys->grass, features);
+        replaceConstants(keys->grassShade, features);
+        replaceConstants(keys->impostor, features);
+        for (PipelineKey* key : { &keys->grass, &keys->grassVisibility, &keys->grassShade }) {
+            replaceConstants(*key, bladeMode);
+        }
+        for (PipelineKey* key : { &keys->grass, &keys->ground, &keys->grassVisibility, &keys->grassShade,
+                                  &keys->impostor }) {
+            replaceConstants(*key, precision);
+        }
+        replaceConstants(keys->ground, groundMode);
+    }
+    
+    // Geometry blades are opaque: only the textured MSAA blades fade through coverage
+    m_msaaPipelineKeys.grass.alphaToCoverage = !m_geometryBlades;
+    
+    // Multi-view grass: the same permutation, amplified (drawn explicitly, never from an ICB)
+    for (ScenePipelineKeys* keys : { &m_msaaPipelineKeys, &m_temporalPipelineKeys }) {
+        keys->grassMultiView = keys->grass;
+        keys->grassMultiView.maxVertexAmplificationCount = 2;
+        keys->grassMultiView.supportIndirectCommandBuffers = false;
+    }
+    
+    // Grass depth prepass: the same vertex permutation (the ICB inherits it too), coverage only;
+    // opaque geometry blades need no fragment stage
+    for (ScenePipelineKeys* keys : { &m_msaaPipelineKeys, &m_temporalPipelineKeys }) {
+        keys->grassPrepass = keys->grass;
+        keys->grassPrepass.fragmentFunction = m_geometryBlades ? "" : "grassDepthPrepassFragment";
+        keys->grassPrepass.colorWrites = false;
+    }
+}
+
+void Renderer::updateGrassPermutation()
+{
+    updateShadingPipelineKeys();
+    
+    // Built in the background; finishPipelineBuild() swaps the grass pipeline in once it exists
+    const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    m_pipelineCache->get(keys.grass);
+    if (m_views.size() > 1 && m_vertexAmplificationSupported) {
+        m_pipelineCache->get(keys.grassMultiView);
+    }
+    if (m_grassDepthPrepass) {
+        m_pipelineCache->get(keys.grassPrepass);
+    }
+    if (m_grassVisibilityEnabled) {
+        m_pipelineCache->get(keys.grassShade);
+    }
+    if (m_impostorsEnabled) {
+        m_pipelineCache->get(keys.impostor);
+    }
+    
+    // The mesh pipeline has no asynchronous path: rebuilt here
+    if (m_meshGrassPSO) {
+        MTL::Library* library = m_device->newDefaultLibrary();
+        if (library) {
+            buildMeshGrassPipeline(library);
+            library->release();
+        }
+    }
+}
+
+void Renderer::setGrassShadingFeatures(const GrassShadingFeatures& features)
+{
+    m_grassShadingFeatures = features;
+    updateGrassPermutation();
+}
+
+void Renderer::setGeometryBlades(bool enabled)
+{
+    m_geometryBlades = enabled;
+    updateGrassPermutation();
+    
+    const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    if (m_grassVisibilityEnabled) {
+        m_pipelineCache->get(keys.grassVisibility);
+    }
+}
+
+void Renderer::setGrassDepthPrepass(bool enabled)
+{
+    m_grassDepthPrepass = enabled;
+    
+    // Built in the background; grass stays single-pass until it exists
+    if (m_grassDepthPrepass) {
+        const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+        m_pipelineCache->get(keys.grassPrepass);
+    }
+}
+
+void Renderer::setSun(const simd::float3& direction, const simd::float3& color)
+{
+    m_sunDirection = simd::normalize(direction);
+    m_sunColor = color;
+}
+
+void Renderer::setPointLights(const std::vector<PointLight>& lights)
+{
+    size_t count = lights.size();
+    if (count > MAX_POINT_LIGHTS) {
+        std::cerr << "Point lights: " << count << " requested, keeping the first " << MAX_POINT_LIGHTS << std::endl;
+        count = MAX_POINT_LIGHTS;
+    }
+    m_pointLights.assign(lights.data(), count);
+}
+
+SceneHandle Renderer::addPointLight(const PointLight& light)
+{
+    if (m_pointLights.size() >= MAX_POINT_LIGHTS) {
+        std::cerr << "Point lights: all " << MAX_POINT_LIGHTS << " in use" << std::endl;
+        return SceneHandle();
+    }
+    return m_pointLights.add(light);
+}
+
+bool Renderer::updatePointLight(SceneHandle handle, const PointLight& light)
+{
+    return m_pointLights.update(handle, light);
+}
+
+bool Renderer::removePointLight(SceneHandle handle)
+{
+    return m_pointLights.remove(handle);
+}
+
+float Renderer::getGroundHeight(float x, float z) const
+{
+    return m_terrain ? m_terrain->heightAt(x, z) : 0.0f;
+}
+
+bool Renderer::pickTerrain(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, glm::vec3& hit) const
+{
+    glm::vec3 dir = glm::normalize(direction);
+    auto above = [&](float t) {
+        glm::vec3 p = origin + dir * t;
+        return p.y - getGroundHeight(p.x, p.z);
+    };
+    
+    // March to the first sample below the ground, then bisect the crossing within that step
+    float previous = 0.0f;
+    if (above(previous) < 0.0f) {
+        return false;
+    }
+    for (float t = kTerrainPickStep; t <= maxDistance; t += kTerrainPickStep) {
+        glm::vec3 p = origin + dir * t;
+        if (std::fabs(p.x) > SCENE_SIZE || std::fabs(p.z) > SCENE_SIZE) {
+            return false;
+        }
+        if (above(t) >= 0.0f) {
+            previous = t;
+            continue;
+        }
+        float low = previous;
+        float high = t;
+        for (int i = 0; i < 8; ++i) {
+            float mid = 0.5f * (low + high);
+            (above(mid) >= 0.0f ? low : high) = mid;
+        }
+        hit = origin + dir * high;
+        return true;
+    }
+    return false;
+}
+
+void Renderer::setHalfPrecisionShading(bool enabled)
+{
+    m_halfPrecisionShading = enabled;
+    updateGrassPermutation();
+    
+    // The ground is drawn through the scene ICBs: swapped in with a full hot swap once built
+    const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    m_pipelineCache->get(keys.ground);
+    if (m_grassVisibilityEnabled) {
+        m_pipelineCache->get(keys.grassVisibility);
+    }
+    std::cout << "Half-precision shading: " << (enabled ? "ON" : "OFF") << std::endl;
+}
+
+MTL::ComputePipelineState* Renderer::buildComputePipeline(MTL::Library* library, const char* functionName)
+{
+    if (!library) {
+        return nullptr;
+    }
+    
+    NS::String* name = NS::String::string(functionName, NS::ASCIIStringEncoding);
+    MTL::Function* function = library->newFunction(name);
+    
+    if (!function) {
+        std::cerr << "Failed to load " << functionName << " function" << std::endl;
+        return nullptr;
+    }
+    
+    // Compute pipelines stay synchronous: grass generation runs during setup
+    MTL::ComputePipelineState* pso = m_pipelineArchive->newComputePipeline(function, functionName);
+    
+    function->release();
+    return pso;
+}
+
+// Append one blade strip of a species shape with the given number of height segments.
+// Indices are local to the strip; the bucket's draw supplies baseVertex.
+static void appendBladeMesh(int segments, const GrassStripShape& shape, std::vector<Vertex>& vertices, std::vector<uint16_t>& indices)
+{
+    // Coordinate system for a single blade in local space:
+    //  - Y from kGrassStripRootY (root) up by the shape's height (tip)
+    //  - X is half-width; we taper from a wider base to a very thin tip
+    //  - Z stays 0 in local space; billboarding handles facing the camera
+    //
+    // We generate (segments + 1) rows, each with left and right vertices.
+    // UV.y goes from 1.0 at the bottom to 0.0 at the top.
+
+    // Fix texture distortion: Use rectangular strip (or very slightly tapered)
+    // The texture alpha defines the shape, NOT the mesh geometry
+    // Making it rectangular prevents texture squeezing at the top
+    const float baseWidth = shape.halfWidth; // Slightly wider base
+    const float tipWidth = shape.halfWidth;  // SAME as base width - rectangular strip (no pinching)
+
+    const int rows = segments + 1;
+
+    for (int row = 0; row < rows; ++row) {
+        float t = static_cast<float>(row) / static_cast<float>(segments); // 0 bottom -> 1 top
+
+        // Rectangular strip: constant width (or very slight taper if tipWidth < baseWidth)
+        // Since baseWidth == tipWidth, this creates a perfect rectangle
+        float width = baseWidth + (tipWidth - baseWidth) * t; // Linear interpolation (or constant if equal)
+        float halfWidth = width;
+
+        // Grass blades span -0.35 .. +0.35; every species shares the root
+        float y = kGrassStripRootY + t * shape.height;
+        float uvY = 1.0f - t;              // 1 at bottom, 0 at top
+
+        // Left vertex
+        Vertex left;
+        left.position = { -halfWidth, y, 0.0f };
+        left.normal   = { 0.0f, 1.0f, 0.0f };
+        left.texcoord = { 0.0f, uvY };
+        vertices.push_back(left);
+
+        // Right vertex
+        Vertex right;
+        right.position = { halfWidth, y, 0.0f };
+        right.normal   = { 0.0f, 1.0f, 0.0f };
+        right.texcoord = { 1.0f, uvY };
+        vertices.push_back(right);
+    }
+
+    // Each vertical segment becomes 2 triangles.
+    // Row r has vertices (Lr, Rr) = (2r, 2r+1)
+    // Row r+1 has (Lr1, Rr1) = (2(r+1), 2(r+1)+1)
+    // Triangles: (Lr, Rr, Lr1) and (Rr, Rr1, Lr1)
+    for (int seg = 0; seg < segments; ++seg) {
+        uint16_t Lr  = static_cast<uint16_t>(seg * kGrassVertsPerRow + 0);
+        uint16_t Rr  = static_cast<uint16_t>(seg * kGrassVertsPerRow + 1);
+        uint16_t Lr1 = static_cast<uint16_t>((seg + 1) * kGrassVertsPerRow + 0);
+        uint16_t Rr1 = static_cast<uint16_t>((seg + 1) * kGrassVertsPerRow + 1);
+
+        // First triangle
+        indices.push_back(Lr);
+        indices.push_back(Rr);
+        indices.push_back(Lr1);
+
+        // Second triangle
+        indices.push_back(Rr);
+        indices.push_back(Rr1);
+        indices.push_back(Lr1);
+    }
+}
+
+void Renderer::buildBladeMeshes(MTL::BlitCommandEncoder* uploadEncoder)
+{
+    // Build every species' blade LODs into one shared vertex/index buffer pair (one mesh per draw bucket).
+    // More height segments up close make the bending in the vertex shader look smooth and organic;
+    // distant blades covering a few pixels use the coarser strips. Lower quality settings cap the
+    // segments of every LOD (the cull and mesh passes read the counts back from the buckets).
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+
+    for (int species = 0; species < GRASS_SPECIES_COUNT; ++species) {
+        for (int lod = 0; lod < GRASS_LOD_COUNT; ++lod) {
+            int bucket = species * GRASS_LOD_COUNT + lod;
+            m_grassBucketBaseVertex[bucket] = static_cast<uint32_t>(vertices.size());
+            m_grassBucketIndexStart[bucket] = static_cast<uint32_t>(indices.size());
+            appendBladeMesh(std::min(kGrassLodSegments[species][lod], m_grassBladeSegments), kGrassStripShapes[species], vertices, indices);
+            m_grassBucketIndexCount[bucket] = static_cast<uint32_t>(indices.size()) - m_grassBucketIndexStart[bucket];
+        }
+    }
+
+    // Keyed by the cap, so switching back to an earlier one finds its meshes still cached
+    std::string suffix = m_grassBladeSegments == maxGrassLod0Segments() ? "" : "." + std::to_string(m_grassBladeSegments);
+    size_t vertexDataSize = vertices.size() * sizeof(Vertex);
+    m_vertexBuffer = m_resourceCache->acquireBuffer("grassBlade.vertices" + suffix, uploadEncoder, vertices.data(), vertexDataSize);
+    
+    if (!m_vertexBuffer) {
+        std::cerr << "Failed to create vertex buffer" << std::endl;
+    }
+    
+    size_t indexDataSize = indices.size() * sizeof(uint16_t);
+    m_indexBuffer = m_resourceCache->acquireBuffer("grassBlade.indices" + suffix, uploadEncoder, indices.data(), indexDataSize);
+    
+    if (!m_indexBuffer) {
+        std::cerr << "Failed to create index buffer" << std::endl;
+    }
+}
+
+void Renderer::buildBuffers()
+{
+    // Static meshes live in private memory; the blits are queued ahead of the first frame
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    
+    buildBladeMeshes(uploadEncoder);
+    
+    // Create the per-frame uniform ring (CPU writes slot N+1 while the GPU reads slot N), with room
+    // for every view's copy
+    size_t uniformDataSize = UNIFORMS_VIEW_STRIDE * MAX_RENDER_VIEWS;
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_uniformBuffers[i] = m_device->newBuffer(uniformDataSize, MTL::ResourceStorageModeShared);
+        
+        if (!m_uniformBuffers[i]) {
+            std::cerr << "Failed to create uniform buffer" << std::endl;
+        }
+    }
+    m_uniformBuffer = m_uniformBuffers[0];
+    
+    // Scene constants: one copy per ring slot, so a change never overwrites a copy the GPU still reads
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_sceneConstantBuffers[i] = m_device->newBuffer(sizeof(SceneConstants), MTL::ResourceStorageModeShared);
+        
+        if (!m_sceneConstantBuffers[i]) {
+            std::cerr << "Failed to create scene constant buffer" << std::endl;
+        }
+    }
+    m_sceneConstantBuffer = m_sceneConstantBuffers[0];
+    
+    // Ball mesh: artist geometry from assets/meshes/ball.obj when present (LOD 0 of the import,
+    // read from its binary cache after the first run), else the generated sphere
+    std::vector<Vertex> ballVertices;
+    std::vector<uint16_t> ballIndices;
+    ImportedMesh importedBall;
+    if (access(kBallMeshPath, R_OK) == 0 && importedBall.load(kBallMeshPath)) {
+        const ImportedMesh::Lod& lod = importedBall.getLods()[0];
+        ballVertices.assign(importedBall.getVertices().begin() + lod.baseVertex,
+                            importedBall.getVertices().begin() + lod.baseVertex + lod.vertexCount);
+        ballIndices.assign(importedBall.getIndices().begin() + lod.indexStart,
+                           importedBall.getIndices().begin() + lod.indexStart + lod.indexCount);
+    } else {
+        createSphereMesh(0.5f, 64, 32, ballVertices, ballIndices);
+    }
+    
+    // Create ball vertex buffer
+    size_t ballVertexDataSize = ballVertices.size() * sizeof(Vertex);
+    m_ballVertexBuffer = m_resourceCache->acquireBuffer("ball.vertices", uploadEncoder, ballVertices.data(), ballVertexDataSize);
+    
+    if (!m_ballVertexBuffer) {
+        std::cerr << "Failed to create ball vertex buffer" << std::endl;
+    }
+    
+    // Create ball index buffer
+    m_ballIndexCount = ballIndices.size();
+    size_t ballIndexDataSize = ballIndices.size() * sizeof(uint16_t);
+    m_ballIndexBuffer = m_resourceCache->acquireBuffer("ball.indices", uploadEncoder, ballIndices.data(), ballIndexDataSize);
+    
+    if (!m_ballIndexBuffer) {
+        std::cerr << "Failed to create ball index buffer" << std::endl;
+    }
+    
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+}
+
+void Renderer::buildInstanceBuffer()
+{
+    // Grid description shared by the GPU generator and the CPU fallback (m_grassSeed set at construction)
+    m_grassField = new GrassField(SCENE_SIZE, kGrassCellsPerSide, kGrassCellBoundsRadius);
+    m_grassDensityMap = new GrassDensityMap(m_device, SCENE_SIZE, m_grassSeed, kGrassDensityMapPath);
+    
+    // Production scenes map their authored field instead of generating one
+    if (access(kGrassFieldPath, R_OK) == 0 && loadGrassInstances(kGrassFieldPath)) {
+        return;
+    }
+    
+    if (m_generateGrassPSO) {
+        // GPU path: instances and cells live in private memory sized for the maximum density
+        // and are (re)written by the generation kernel
+        m_instanceBuffer = m_bufferHeap->newBuffer(sizeof(InstanceData) * kGrassMaxInstanceCount);
+        m_cellBuffer = m_bufferHeap->newBuffer(sizeof(GrassCell) * m_grassField->getCellCount());
+        m_grassPlacedCountBuffer = m_device->newBuffer(sizeof(uint32_t), MTL::ResourceStorageModeShared);
+        
+        if (!m_instanceBuffer || !m_cellBuffer || !m_grassPlacedCountBuffer) {
+            std::cerr << "Failed to create grass instance/cell buffers" << std::endl;
+            return;
+        }
+        
+        generateGrassOnGPU();
+        return;
+    }
+    
+    // CPU fallback: scatter blades over the terrain (kept by the density mask) and bucket them into the cell grid
+    int instanceCount = m_grassBladesPerCell * m_grassField->getCellCount();
+    m_grassField->generate(instanceCount, m_grassSeed, *m_terrain, m_grassDensityMapEnabled ? m_grassDensityMap : nullptr, m_jobSystem);
+    m_grassInstanceCount = static_cast<uint32_t>(m_grassField->getInstances().size());
+    m_cpuCellsDirty = true;
+    
+    const std::vector<InstanceData>& instances = m_grassField->getInstances();
+    const std::vector<GrassCell>& cells = m_grassField->getCells();
+    
+    // Create m_instanceBuffer (cell-sorted instances) and m_cellBuffer (per-cell bounds and
+    // instance ranges) in private memory
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    
+    size_t instanceDataSize = instances.size() * sizeof(InstanceData);
+    m_instanceBuffer = m_uploadRing->newPrivateBuffer(uploadEncoder, instances.data(), instanceDataSize);
+    
+    if (!m_instanceBuffer) {
+        std::cerr << "Failed to create instance buffer" << std::endl;
+    }
+    
+    size_t cellDataSize = cells.size() * sizeof(GrassCell);
+    m_cellBuffer = m_uploadRing->newPrivateBuffer(uploadEncoder, cells.data(), cellDataSize);
+    
+    if (!m_cellBuffer) {
+        std::cerr << "Failed to create grass cell buffer" << std::endl;
+    }
+    
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+}
+
+bool Renderer::encodeGrassGeneration(MTL::CommandBuffer* commandBuffer, int firstCell, int lastCell)
+{
+    if (!m_generateGrassPSO || !m_instanceBuffer || !m_cellBuffer || !m_grassPlacedCountBuffer || !m_grassField
+        || !m_terrain || !m_terrain->getMetalTexture()) {
+        return false;
+    }
+    bool useDensityMap = m_grassDensityMapEnabled && m_grassDensityMap && m_grassDensityMap->getMetalTexture();
+    
+    GrassGenerateUniforms params;
+    params.fieldMinXZ = simd::make_float2(-SCENE_SIZE, -SCENE_SIZE);
+    params.fieldMaxXZ = simd::make_float2(SCENE_SIZE, SCENE_SIZE);
+    params.seed = m_grassSeed;
+    params.cellsPerSide = static_cast<uint32_t>(m_grassField->getCellsPerSide());
+    params.bladesPerCell = static_cast<uint32_t>(m_grassBladesPerCell);
+    params.bladeRadius = kGrassCellBoundsRadius;
+    params.minScale = 0.8f;
+    params.maxScale = 1.2f;
+    params.useDensityMap = useDensityMap ? 1u : 0u;
+    
+    // Cell rectangle from its corners (either order)
+    int cellsPerSide = m_grassField->getCellsPerSide();
+    bool wholeField = lastCell < 0;
+    if (wholeField) {
+        firstCell = 0;
+        lastCell = m_grassField->getCellCount() - 1;
+    }
+    int x0 = std::min(firstCell % cellsPerSide, lastCell % cellsPerSide);
+    int z0 = std::min(firstCell / cellsPerSide, lastCell / cellsPerSide);
+    int x1 = std::max(firstCell % cellsPerSide, lastCell % cellsPerSide);
+    int z1 = std::max(firstCell / cellsPerSide, lastCell / cellsPerSide);
+    params.firstCell = simd::make_uint2(static_cast<uint32_t>(x0), static_cast<uint32_t>(z0));
+    params.cellSpan = static_cast<uint32_t>(x1 - x0 + 1);
+    params.incremental = wholeField ? 0u : 1u;
+    NS::UInteger groupCount = static_cast<NS::UInteger>(x1 - x0 + 1) * static_cast<NS::UInteger>(z1 - z0 + 1);
+    
+    MTL::BlitCommandEncoder* blitEncoder = wholeField ? commandBuffer->blitCommandEncoder() : nullptr;
+    if (blitEncoder) {
+        blitEncoder->fillBuffer(m_grassPlacedCountBuffer, NS::Range::Make(0, sizeof(uint32_t)), 0);
+        blitEncoder->endEncoding();
+    }
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
+    
+    if (encoder) {
+        encoder->setComputePipelineState(m_generateGrassPSO);
+        encoder->setBuffer(m_instanceBuffer, 0, GenerateBufferIndexInstances);
+        encoder->setBuffer(m_cellBuffer, 0, GenerateBufferIndexCells);
+        encoder->setBytes(&params, sizeof(GrassGenerateUniforms), GenerateBufferIndexUniforms);
+        encoder->setBuffer(m_grassPlacedCountBuffer, 0, GenerateBufferIndexPlacedCount);
+        encoder->setTexture(m_terrain->getMetalTexture(), 0);
+        encoder->setTexture(useDensityMap ? m_grassDensityMap->getMetalTexture() : m_terrain->getMetalTexture(), 1);
+        
+        // One threadgroup per cell, sized for its candidates (the kernel strides over the rest)
+        MTL::Size threadgroupSize = ComputeDispatch::threadgroupSize(m_generateGrassPSO,
+            MTL::Size(static_cast<NS::UInteger>(params.bladesPerCell), 1, 1));
+        encoder->dispatchThreadgroups(MTL::Size(groupCount, 1, 1), threadgroupSize);
+        encoder->endEncoding();
+    }
+    return true;
+}
+
+void Renderer::generateGrassOnGPU()
+{
+    // The kernel rewrites every slot in place (and an edited field's buffers are replaced), so
+    // frames in flight must be done reading the current contents first
+    waitUntilIdle();
+    uint32_t instanceCount = static_cast<uint32_t>(m_grassBladesPerCell) * static_cast<uint32_t>(m_grassField->getCellCount());
+    if (m_grassEditor && m_instanceBuffer && m_instanceBuffer->length() < sizeof(InstanceData) * instanceCount) {
+        // The slack layout was sized for the edited field's fullest cell: back to the generation's own size
+        MTL::Buffer* instanceBuffer = m_bufferHeap->newBuffer(sizeof(InstanceData) * m_grassInstanceCapacity);
+        if (!instanceBuffer) {
+            std::cerr << "Failed to create the grass instance buffer" << std::endl;
+            return;
+        }
+        m_bufferHeap->release(m_instanceBuffer);
+        m_instanceBuffer = instanceBuffer;
+    }
+    
+    // Own command buffer: the queue runs it before any later frame reads the buffers
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    if (!encodeGrassGeneration(commandBuffer)) {
+        return;
+    }
+    discardGrassEdits(); // The kernel rewrites every slot
+    encodeCpuCellReadback(commandBuffer);
+    commandBuffer->commit();
+    m_grassInstanceCount = instanceCount;
+    m_cpuCellsDirty = true;
+}
+
+void Renderer::encodeCpuCellReadback(MTL::CommandBuffer* commandBuffer)
+{
+    // Taken once this command buffer completes (updateCpuCells)
+    size_t cellDataSize = sizeof(GrassCell) * m_grassField->getCellCount();
+    if (!m_cpuCellReadbackBuffer) {
+        m_cpuCellReadbackBuffer = m_device->newBuffer(cellDataSize, MTL::ResourceStorageModeShared);
+    }
+    MTL::BlitCommandEncoder* readbackEncoder = m_cpuCellReadbackBuffer ? commandBuffer->blitCommandEncoder() : nullptr;
+    if (readbackEncoder) {
+        readbackEncoder->copyFromBuffer(m_cellBuffer, 0, m_cpuCellReadbackBuffer, 0, cellDataSize);
+        readbackEncoder->endEncoding();
+        if (m_cpuCellReadback) {
+            m_cpuCellReadback->release();
+        }
+        m_cpuCellReadback = commandBuffer->retain();
+    }
+}
+
+int Renderer::paintGrassDensity(simd::float2 center, float radius, float density, float species, float strength)
+{
+    if (!m_paintGrassDensityPSO || !m_generateGrassPSO || !m_grassDensityMap || !m_grassField) {
+        std::cerr << "Grass density painting requires the GPU generation and brush kernels" << std::endl;
+        return 0;
+    }
+    if (m_instanceFile) {
+        std::cerr << "Grass placement is fixed by the mapped instance file" << std::endl;
+        return 0;
+    }
+    if (!m_grassDensityMapEnabled) {
+        std::cerr << "Grass density painting needs the density map (setGrassDensityMapEnabled)" << std::endl;
+        return 0;
+    }
+    
+    GrassDensityMap::Dab dab;
+    dab.center = center;
+    dab.radius = radius;
+    dab.density = density;
+    dab.species = species;
+    dab.strength = strength;
+    dab.hardness = kGrassBrushHardness;
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    if (!m_grassDensityMap->encodePaint(commandBuffer, m_paintGrassDensityPSO, *m_computeDispatch, dab)) {
+        return 0;
+    }
+    
+    // An edited field is in the slack layout: place all of it again at the next command buffer
+    if (m_grassEditor) {
+        commandBuffer->commit();
+        generateGrassOnGPU();
+        bakeGrassImpostors();
+        return m_grassField->getCellCount();
+    }
+    
+    // Cells whose candidates may sample the painted texels (the kernel's bilinear taps reach half a texel beyond)
+    float reach = radius + SCENE_SIZE / static_cast<float>(m_grassDensityMap->getMetalTexture()->width());
+    int firstCell = m_grassField->cellIndexAt(center.x - reach, center.y - reach);
+    int lastCell = m_grassField->cellIndexAt(center.x + reach, center.y + reach);
+    encodeGrassGeneration(commandBuffer, firstCell, lastCell);
+    encodeCpuCellReadback(commandBuffer);
+    commandBuffer->commit();
+    m_cpuCellsDirty = true;
+    int cellsPerSide = m_grassField->getCellsPerSide();
+    
+    // Impostor patches are baked from one cell each: bake again (queued after the generation) if the dab placed one of them
+    for (int variant = 0; variant < IMPOSTOR_VARIANT_COUNT; ++variant) {
+        int cell = impostorSourceCell(variant);
+        if (cell % cellsPerSide >= firstCell % cellsPerSide && cell % cellsPerSide <= lastCell % cellsPerSide &&
+            cell / cellsPerSide >= firstCell / cellsPerSide && cell / cellsPerSide <= lastCell / cellsPerSide) {
+            bakeGrassImpostors();
+            break;
+        }
+    }
+    return (lastCell % cellsPerSide - firstCell % cellsPerSide + 1) * (lastCell / cellsPerSide - firstCell / cellsPerSide + 1);
+}
+
+bool Renderer::loadGrassInstances(const std::string& path)
+{
+    InstanceFile* instanceFile = new InstanceFile();
+    if (!instanceFile->load(m_device, path)) {
+        delete instanceFile;
+        return false;
+    }
+    
+    // The cull, impostor and trample paths assume the scene's cell grid
+    if (instanceFile->getCellsPerSide() != kGrassCellsPerSide || instanceFile->getHalfSize() != SCENE_SIZE) {
+        std::cerr << "Instance file " << path << " does not fit the scene (" << instanceFile->getCellsPerSide()
+                  << " cells per side; expected " << kGrassCellsPerSide << ")" << std::endl;
+        delete instanceFile;
+        return false;
+    }
+    // The file's own buffers hold its blades; the per-blade lists grow to the count in its header
+    if (!ensureGrassInstanceCapacity(instanceFile->getInstanceCount())) {
+        delete instanceFile;
+        return false;
+    }
+    
+    // Frames in flight may still read the current buffers
+    if (m_instanceBuffer || m_cellBuffer) {
+        waitUntilIdle();
+    }
+    if (m_instanceBuffer) {
+        m_bufferHeap->release(m_instanceBuffer);
+    }
+    if (m_cellBuffer) {
+        m_bufferHeap->release(m_cellBuffer);
+    }
+    if (m_instanceFile) {
+        delete m_instanceFile;
+    }
+    discardGrassEdits();
+    
+    m_instanceFile = instanceFile;
+    m_instanceBuffer = m_instanceFile->getInstanceBuffer()->retain();
+    m_cellBuffer = m_instanceFile->getCellBuffer()->retain();
+    m_grassInstanceCount = m_instanceFile->getInstanceCount();
+    m_cpuCellsDirty = true;
+    if (m_impostorAtlas) {
+        bakeGrassImpostors(); // Patches come from the new cells
+    }
+    std::cout << "Grass instances: " << m_grassInstanceCount << " blades mapped from " << path << std::endl;
+    return true;
+}
+
+bool Renderer::exportGrassInstances(const std::string& path) const
+{
+    if (!m_terrain) {
+        return false;
+    }
+    
+    // Generated on the host with the scene's seed and density, in the layout the GPU path writes
+    GrassField field(SCENE_SIZE, kGrassCellsPerSide, kGrassCellBoundsRadius);
+    if (m_grassDensityMapEnabled && m_grassDensityMap) {
+        m_grassDensityMap->syncHostCopy(); // Brush dabs are painted on the GPU
+    }
+    field.generate(m_grassBladesPerCell * field.getCellCount(), m_grassSeed, *m_terrain,
+                   m_grassDensityMapEnabled ? m_grassDensityMap : nullptr, m_jobSystem);
+    if (!InstanceFile::write(path, field.getCellsPerSide(), field.getHalfSize(), field.getInstances(), field.getCells())) {
+        return false;
+    }
+    std::cout << "Grass instances: wrote " << field.getInstances().size() << " blades to " << path << std::endl;
+    return true;
+}
+
+bool Renderer::beginGrassEditing()
+{
+    if (m_grassEditor) {
+        return true;
+    }
+    if (m_grassStreamer) {
+        std::cerr << "Grass edits need the resident field (streaming is on)" << std::endl;
+        return false;
+    }
+    if (!m_grassField || !m_instanceBuffer || !m_cellBuffer || !m_terrain) {
+        return false;
+    }
+    
+    // Host copy of the field as the GPU last wrote it (generation or frames in flight may still be running)
+    waitUntilIdle();
+    size_t cellCount = static_cast<size_t>(m_grassField->getCellCount());
+    std::vector<InstanceData> instances;
+    std::vector<GrassCell> cells;
+    if (m_instanceFile) {
+        const InstanceData* mapped = static_cast<const InstanceData*>(m_instanceFile->getInstanceBuffer()->contents());
+        instances.assign(mapped, mapped + m_instanceFile->getInstanceCount());
+        cells.assign(m_instanceFile->getCells(), m_instanceFile->getCells() + cellCount);
+    } else if (!m_generateGrassPSO) {
+        instances = m_grassField->getInstances();
+        cells = m_grassField->getCells();
+    } else {
+        // GPU placement lives in private memory: copy it back once
+        MTL::Buffer* instanceReadback = m_device->newBuffer(std::max<size_t>(sizeof(InstanceData) * m_grassInstanceCount, 1),
+                                                            MTL::ResourceStorageModeShared);
+        MTL::Buffer* cellReadback = m_device->newBuffer(sizeof(GrassCell) * cellCount, MTL::ResourceStorageModeShared);
+        bool ok = instanceReadback && cellReadback;
+        if (ok) {
+            MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+            MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+            if (m_grassInstanceCount > 0) {
+                blitEncoder->copyFromBuffer(m_instanceBuffer, 0, instanceReadback, 0, sizeof(InstanceData) * m_grassInstanceCount);
+            }
+            blitEncoder->copyFromBuffer(m_cellBuffer, 0, cellReadback, 0, sizeof(GrassCell) * cellCount);
+            blitEncoder->endEncoding();
+            commandBuffer->commit();
+            commandBuffer->waitUntilCompleted();
+            ok = commandBuffer->status() == MTL::CommandBufferStatusCompleted;
+        }
+        if (ok) {
+            const InstanceData* copied = static_cast<const InstanceData*>(instanceReadback->contents());
+            const GrassCell* copiedCells = static_cast<const GrassCell*>(cellReadback->contents());
+            instances.assign(copied, copied + m_grassInstanceCount);
+            cells.assign(copiedCells, copiedCells + cellCount);
+        }
+        if (instanceReadback) {
+            instanceReadback->release();
+        }
+        if (cellReadback) {
+            cellReadback->release();
+        }
+        if (!ok) {
+            std::cerr << "Grass edits: failed to read the generated field back" << std::endl;
+            return false;
+        }
+    }
+    
+    // Every cell gets the fullest cell's blades plus the slack, within the instance buffer's capacity
+    uint32_t fullest = 0;
+    for (const GrassCell& cell : cells) {
+        fullest = std::max(fullest, cell.instanceCount);
+    }
+    uint32_t capacity = std::max(std::min(fullest + kGrassEditSlack, static_cast<uint32_t>(kGrassMaxBladesPerCell)), fullest);
+    if (!ensureGrassInstanceCapacity(static_cast<uint32_t>(cellCount) * capacity)) {
+        return false;
+    }
+    GrassInstanceEditor* editor = new GrassInstanceEditor(static_cast<uint32_t>(cellCount), capacity);
+    if (!editor->load(instances.data(), cells.data())) {
+        delete editor;
+        return false;
+    }
+    
+    // Own buffers in the slack layout (a mapped field's are read-only file pages, the CPU fallback's exactly sized)
+    MTL::Buffer* instanceBuffer = m_bufferHeap->newBuffer(sizeof(InstanceData) * cellCount * capacity);
+    MTL::Buffer* cellBuffer = m_bufferHeap->newBuffer(sizeof(GrassCell) * cellCount);
+    if (!instanceBuffer || !cellBuffer) {
+        std::cerr << "Grass edits: failed to create the instance/cell buffers" << std::endl;
+        if (instanceBuffer) {
+            m_bufferHeap->release(instanceBuffer);
+        }
+        if (cellBuffer) {
+            m_bufferHeap->release(cellBuffer);
+        }
+        delete editor;
+        return false;
+    }
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    m_uploadRing->uploadBuffer(uploadEncoder, instanceBuffer, 0, editor->getInstances().data(),
+                               editor->getInstances().size() * sizeof(InstanceData));
+    m_uploadRing->uploadBuffer(uploadEncoder, cellBuffer, 0, editor->getCells().data(), cellCount * sizeof(GrassCell));
+    if (m_bladeStateBuffer) {
+        uploadEncoder->fillBuffer(m_bladeStateBuffer, NS::Range::Make(0, m_bladeStateBuffer->length()), 0); // Blades moved slots
+    }
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+    
+    m_bufferHeap->release(m_instanceBuffer);
+    m_bufferHeap->release(m_cellBuffer);
+    if (m_instanceFile) {
+        delete m_instanceFile;
+        m_instanceFile = nullptr;
+    }
+    if (m_cpuCellReadback) {
+        m_cpuCellReadback->release(); // Completed above; the editor holds the cells now
+        m_cpuCellReadback = nullptr;
+    }
+    m_instanceBuffer = instanceBuffer;
+    m_cellBuffer = cellBuffer;
+    m_grassEditor = editor;
+    m_grassInstanceCount = editor->getSlotCount();
+    m_cpuCellsDirty = true;
+    bakeGrassImpostors(); // Patch ranges moved
+    std::cout << "Grass edits: " << editor->getInstanceCount() << " blades in " << capacity << " slots per cell" << std::endl;
+    return true;
+}
+
+void Renderer::discardGrassEdits()
+{
+    if (m_grassEditor) {
+        delete m_grassEditor;
+        m_grassEditor = nullptr;
+        m_cpuCellsDirty = true;
+    }
+}
+
+void Renderer::flushGrassEdits()
+{
+    // Own command buffer: queued before the frame that draws the edits, while frames already in
+    // flight keep reading the buffers' previous contents (the staged copies belong to this batch)
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+    m_grassEditor->flush(m_uploadRing, blitEncoder, m_instanceBuffer, m_cellBuffer, m_bladeStateBuffer);
+    blitEncoder->endEncoding();
+    m_uploadRing->commit(commandBuffer);
+    commandBuffer->commit();
+    m_cpuCellsDirty = true;
+}
+
+std::vector<uint32_t> Renderer::grassSlotsInRadius(simd::float2 center, float radius) const
+{
+    std::vector<uint32_t> slots;
+    int cellsPerSide = m_grassField->getCellsPerSide();
+    int lo = m_grassField->cellIndexAt(center.x - radius, center.y - radius);
+    int hi = m_grassField->cellIndexAt(center.x + radius, center.y + radius);
+    const std::vector<InstanceData>& instances = m_grassEditor->getInstances();
+    for (int cz = lo / cellsPerSide; cz <= hi / cellsPerSide; ++cz) {
+        for (int cx = lo % cellsPerSide; cx <= hi % cellsPerSide; ++cx) {
+            const GrassCell& cell = m_grassEditor->getCells()[cz * cellsPerSide + cx];
+            for (uint32_t slot = cell.firstInstance; slot < cell.firstInstance + cell.instanceCount; ++slot) {
+                if (GrassInstanceEditor::isEmpty(instances[slot])) {
+                    continue;
+                }
+                simd::float3 position = m_grassField->unpackPosition(instances[slot]);
+                simd::float2 offset = simd::make_float2(position.x, position.z) - center;
+                if (simd::dot(offset, offset) <= radius * radius) {
+                    slots.push_back(slot);
+                }
+            }
+        }
+    }
+    return slots;
+}
+
+int Renderer::plantGrass(simd::float2 center, float radius, int count)
+{
+    if (count <= 0 || !beginGrassEditing()) {
+        return 0;
+    }
+    
+    // Blades drawn like GrassField::generate does (uniform over the disc, clipped to the field)
+    std::seed_seq brushSeed{ m_grassSeed, ++m_grassEditSeed };
+    std::mt19937 gen(brushSeed);
+    std::uniform_real_distribution<float> unitDist(0.0f, 1.0f);
+    int planted = 0;
+    for (int i = 0; i < count; ++i) {
+        float r = radius * std::sqrt(unitDist(gen));
+        float angle = unitDist(gen) * 6.28318f;
+        float x = center.x + r * std::cos(angle);
+        float z = center.y + r * std::sin(angle);
+        float rotation = unitDist(gen) * 6.28318f;
+        float scale = 0.8f + 0.4f * unitDist(gen);
+        float hash = unitDist(gen);
+        float tilt = (unitDist(gen) - 0.5f) * 2.0f * INSTANCE_MAX_TILT;
+        float idlePhase = unitDist(gen) * 6.28318f;
+        uint32_t flags = (unitDist(gen) > 0.9f) ? INSTANCE_FLAG_YELLOW : 0u;
+        uint32_t albedoVariant = std::min(static_cast<uint32_t>(unitDist(gen) * GRASS_ALBEDO_VARIANT_COUNT), GRASS_ALBEDO_VARIANT_COUNT - 1u);
+        uint32_t species = grassSpeciesFromUnit(unitDist(gen));
+        if (std::fabs(x) > SCENE_SIZE || std::fabs(z) > SCENE_SIZE) {
+            continue;
+        }
+        
+        simd::float3 position = simd::make_float3(x, m_terrain->heightAt(x, z) + GRASS_INSTANCE_ELEVATION, z);
+        uint32_t cell = static_cast<uint32_t>(m_grassField->cellIndexAt(x, z));
+        InstanceData instance = m_grassField->packInstance(position, rotation, scale, albedoVariant, species,
+                                                           GrassField::packAttributes(hash, tilt, idlePhase, flags));
+        if (m_grassEditor->insert(cell, instance) == GrassInstanceEditor::kNoSlot) {
+            continue; // Cell full
+        }
+        simd::float3 extent = simd::make_float3(kGrassCellBoundsRadius, kGrassCellBoundsRadius, kGrassCellBoundsRadius);
+        m_grassEditor->includeBounds(cell, position - extent, position + extent);
+        planted++;
+    }
+    return planted;
+}
+
+int Renderer::eraseGrass(simd::float2 center, float radius)
+{
+    if (!beginGrassEditing()) {
+        return 0;
+    }
+    std::vector<uint32_t> slots = grassSlotsInRadius(center, radius);
+    for (uint32_t slot : slots) {
+        m_grassEditor->remove(slot);
+    }
+    return static_cast<int>(slots.size());
+}
+
+int Renderer::mowGrass(simd::float2 center, float radius, float scale)
+{
+    if (!beginGrassEditing()) {
+        return 0;
+    }
+    
+    // Rewrite the unorm16 scale in place (the position and its half height stay)
+    uint32_t maxScaleBits = static_cast<uint32_t>(std::clamp(scale / INSTANCE_MAX_SCALE, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    int mown = 0;
+    for (uint32_t slot : grassSlotsInRadius(center, radius)) {
+        InstanceData instance = m_grassEditor->getInstances()[slot];
+        uint32_t scaleBits = instance.heightScale >> 16;
+        if (scaleBits <= maxScaleBits) {
+            continue;
+        }
+        instance.heightScale = (instance.heightScale & 0xFFFFu) | (maxScaleBits << 16);
+        m_grassEditor->modify(slot, instance); // Zero scale erases
+        mown++;
+    }
+    return mown;
+}
+
+MTL::Buffer* Renderer::grassInstanceBuffer() const
+{
+    return m_grassStreamer ? m_grassStreamer->getInstanceBuffer() : m_instanceBuffer;
+}
+
+MTL::Buffer* Renderer::grassCellBuffer() const
+{
+    return m_grassStreamer ? m_grassStreamer->getCellBuffer(m_frameIndex) : m_cellBuffer;
+}
+
+uint32_t Renderer::grassCellCount() const
+{
+    if (m_grassStreamer) {
+        return m_grassStreamer->getCellCount(m_frameIndex);
+    }
+    return m_grassField ? static_cast<uint32_t>(m_grassField->getCellCount()) : 0;
+}
+
+void Renderer::updateCpuCells()
+{
+    // Streamed cells are rewritten into the frame's shared slot every frame
+    if (m_grassStreamer) {
+        MTL::Buffer* cellBuffer = m_grassStreamer->getCellBuffer(m_frameIndex);
+        m_cpuCellCuller->setCells(cellBuffer ? static_cast<const GrassCell*>(cellBuffer->contents()) : nullptr,
+                                  m_grassStreamer->getCellCount(m_frameIndex));
+        return;
+    }
+    if (!m_cpuCellsDirty) {
+        return;
+    }
+    
+    if (m_grassEditor) {
+        m_cpuCellCuller->setCells(m_grassEditor->getCells().data(), m_grassEditor->getCellCount());
+    } else if (m_instanceFile) {
+        m_cpuCellCuller->setCells(m_instanceFile->getCells(), static_cast<uint32_t>(m_instanceFile->getCellCount()));
+    } else if (m_cpuCellReadback) {
+        // GPU placement: wait for its copy (drawing the whole field meanwhile)
+        MTL::CommandBufferStatus status = m_cpuCellReadback->status();
+        if (status != MTL::CommandBufferStatusCompleted && status != MTL::CommandBufferStatusError) {
+            return;
+        }
+        bool completed = status == MTL::CommandBufferStatusCompleted;
+        m_cpuCellReadback->release();
+        m_cpuCellReadback = nullptr;
+        if (!completed) {
+            std::cerr << "Grass cell readback failed; CPU culling draws the whole field" << std::endl;
+            m_cpuCellCuller->setCells(nullptr, 0);
+        } else {
+            m_cpuCellCuller->setCells(static_cast<const GrassCell*>(m_cpuCellReadbackBuffer->contents()),
+                                      static_cast<uint32_t>(m_grassField->getCellCount()));
+        }
+    } else if (m_grassField && !m_generateGrassPSO) {
+        m_cpuCellCuller->setCells(m_grassField->getCells().data(), static_cast<uint32_t>(m_grassField->getCells().size()));
+    } else {
+        m_cpuCellCuller->setCells(nullptr, 0);
+    }
+    m_cpuCellsDirty = false;
+}
+
+void Renderer::prepareShadowMaps(const glm::vec3& cameraPosition)
+{
+    m_shadowMapsActive = false;
+    m_shadowOverlayActive = false;
+    for (bool& redraw : m_shadowRedraw) {
+        redraw = false;
+    }
+    if (!m_shadowMaps || !m_shadowMapsEnabled) {
+        return;
+    }
+    
+    // Planted, removed or regenerated blades, or other streamed chunks: the cached depth is stale
+    bool castersChanged = m_cpuCellsDirty;
+    if (m_grassStreamer) {
+        castersChanged = m_grassStreamer->getResidentVersion() != m_shadowStreamerVersion;
+        m_shadowStreamerVersion = m_grassStreamer->getResidentVersion();
+    }
+    if (castersChanged) {
+        m_shadowMaps->invalidate();
+    }
+    m_shadowMaps->update(cameraPosition, glm::vec3(m_sunDirection.x, m_sunDirection.y, m_sunDirection.z));
+    
+    // A stale cascade redraws once its pipelines exist (and cascade 0 once the culler has the
+    // cells); until every cascade matches its projection the receivers stay unshadowed
+    MTL::RenderPipelineState* terrainPSO = m_pipelineCache->get(m_terrainShadowPipelineKey);
+    MTL::RenderPipelineState* grassPSO = m_pipelineCache->get(m_grassShadowPipelineKey);
+    bool ready = true;
+    for (int cascade = 0; cascade < SHADOW_CASCADE_COUNT; ++cascade) {
+        if (!m_shadowMaps->needsRedraw(cascade)) {
+            continue;
+        }
+        bool drawable = terrainPSO && m_terrain;
+        if (drawable && m_shadowMaps->castsGrass(cascade)) {
+            // The cells inside the cascade, copied out before the view cull reuses the culler
+            updateCpuCells();
+            drawable = grassPSO && grassInstanceBuffer() && m_cpuCellCuller->getCellCount() > 0;
+            m_shadowCasterRanges.clear();
+            if (drawable) {
+                simd::float4 planes[6];
+                extractFrustumPlanes(m_shadowMaps->getViewProjection(cascade), planes);
+                m_cpuCellCuller->cull(planes, 1);
+                for (const CpuCellCuller::Range& range : m_cpuCellCuller->getVisibleRanges()) {
+                    m_shadowCasterRanges.push_back(simd::make_uint2(range.firstInstance, range.instanceCount));
+                }
+            }
+        }
+        m_shadowRedraw[cascade] = drawable;
+        ready = ready && drawable;
+    }
+    m_shadowMapsActive = ready;
+    m_shadowOverlayActive = ready && m_interactorCount > 0 && m_ballVertexBuffer && m_ballIndexBuffer && m_ballIndexCount > 0 &&
+                            m_pipelineCache->get(m_interactorShadowPipelineKey);
+}
+
+void Renderer::encodeShadowMap(MTL::RenderCommandEncoder* encoder, int map, MTL::Buffer* interactorBuffer)
+{
+    static constexpr float kShadowSlopeBias = 1.5f; // Depth bias per unit of depth slope (grazing terrain)
+    
+    ShadowCasterUniforms caster;
+    caster.viewProjection = glmToSimd(m_shadowMaps->getViewProjection(map));
+    for (int species = 0; species < GRASS_SPECIES_COUNT; ++species) {
+        caster.bladeShapes[species] = simd::make_float4(kGrassStripShapes[species].halfWidth, kGrassStripRootY,
+                                                        kGrassStripShapes[species].height, 0.0f);
+    }
+    
+    // Both faces cast (blades are single triangles, the terrain is seen from below at low sun)
+    encoder->setDepthStencilState(m_depthStencilState);
+    encoder->setCullMode(MTL::CullModeNone);
+    encoder->setDepthBias(0.0f, kShadowSlopeBias, 0.0f);
+    encoder->setVertexBytes(&caster, sizeof(caster), BufferIndexShadowCaster);
+    
+    if (map == ShadowMaps::kOverlay) {
+        MTL::RenderPipelineState* interactorPSO = m_pipelineCache->get(m_interactorShadowPipelineKey);
+        if (!interactorPSO || !interactorBuffer) {
+            return;
+        }
+        encoder->setRenderPipelineState(interactorPSO);
+        encoder->setVertexBuffer(m_ballVertexBuffer, 0, BufferIndexMeshPositions);
+        encoder->setVertexBuffer(interactorBuffer, 0, BufferIndexInteractors);
+        encoder->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(m_ballIndexCount), MTL::IndexTypeUInt16,
+                                       m_ballIndexBuffer, NS::UInteger(0), NS::UInteger(m_interactorCount));
+        return;
+    }
+    
+    // Terrain: every chunk at LOD 0, six vertices per quad
+    MTL::RenderPipelineState* terrainPSO = m_pipelineCache->get(m_terrainShadowPipelineKey);
+    if (!terrainPSO) {
+        return;
+    }
+    encoder->setRenderPipelineState(terrainPSO);
+    encoder->setVertexBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+    encoder->setVertexTexture(m_terrain->getMetalTexture(), TextureIndexTerrainHeight);
+    encoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(TERRAIN_CHUNK_QUADS * TERRAIN_CHUNK_QUADS * 6),
+                            NS::UInteger(TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNKS_PER_SIDE));
+    
+    // Blades at rest: one triangle per instance slot of each listed cell run
+    MTL::RenderPipelineState* grassPSO = m_pipelineCache->get(m_grassShadowPipelineKey);
+    if (!m_shadowMaps->castsGrass(map) || !grassPSO) {
+        return;
+    }
+    encoder->setRenderPipelineState(grassPSO);
+    encoder->setVertexBuffer(grassInstanceBuffer(), 0, BufferIndexInstanceData);
+    for (const simd::uint2& range : m_shadowCasterRanges) {
+        if (range.y > 0) {
+            encoder->drawPrimitives(MTL::PrimitiveTypeTriangle, NS::UInteger(0), NS::UInteger(3), NS::UInteger(range.y),
+                                    NS::UInteger(range.x));
+        }
+    }
+}
+
+bool Renderer::setGrassStreaming(bool enabled)
+{
+    if (enabled == (m_grassStreamer != nullptr)) {
+        return true;
+    }
+    
+    // Frames in flight may still read the pool (or the cell list of the other source)
+    waitUntilIdle();
+    if (m_grassStreamer) {
+        delete m_grassStreamer;
+        m_grassStreamer = nullptr;
+    }
+    if (!enabled) {
+        std::cout << "Grass streaming: OFF" << std::endl;
+        return true;
+    }
+    if (!m_terrain) {
+        return false;
+    }
+    
+    // Chunks are field cells, and the window holds as many as the field: the cull, visible list
+    // and impostor buffers sized for the field fit the window unchanged
+    GrassStreamer::Settings settings;
+    settings.worldHalfSize = kGrassStreamWorldHalfSize;
+    settings.chunkSize = 2.0f * SCENE_SIZE / static_cast<float>(kGrassCellsPerSide);
+    settings.windowChunks = kGrassCellsPerSide;
+    settings.bladesPerChunk = m_grassBladesPerCell;
+    settings.bladeRadius = kGrassCellBoundsRadius;
+    settings.seed = m_grassSeed;
+    m_grassStreamer = new GrassStreamer(m_device, m_terrain, settings, kMaxFramesInFlight, m_jobSystem);
+    if (!m_grassStreamer->isValid()) {
+        delete m_grassStreamer;
+        m_grassStreamer = nullptr;
+        return false;
+    }
+    std::cout << "Grass streaming: ON (" << 2.0f * kGrassStreamWorldHalfSize << " m world, "
+              << m_grassStreamer->getPoolBytes() / (1024 * 1024) << " MB chunk pool)" << std::endl;
+    return true;
+}
+
+size_t Renderer::getGrassStreamingResidentChunks() const
+{
+    return m_grassStreamer ? m_grassStreamer->getResidentChunkCount() : 0;
+}
+
+void Renderer::setGrassDensity(int bladesPerCell)
+{
+    bladesPerCell = std::clamp(bladesPerCell, 1, kGrassMaxBladesPerCell);
+    if (bladesPerCell == m_grassBladesPerCell) {
+        return;
+    }
+    
+    if (m_instanceFile) {
+        std::cerr << "Grass density is fixed by the mapped instance file" << std::endl;
+        return;
+    }
+    
+    if (!m_generateGrassPSO) {
+        std::cerr << "Grass density changes require the GPU generation kernel" << std::endl;
+        return;
+    }
+    
+    m_grassBladesPerCell = bladesPerCell;
+    generateGrassOnGPU();
+    bakeGrassImpostors(); // The patches are cells of the field
+    if (m_grassStreamer) {
+        // Chunk slots are sized for the density: restart streaming with the new one
+        setGrassStreaming(false);
+        setGrassStreaming(true);
+    }
+    std::cout << "Grass density: " << m_grassBladesPerCell << " blades/cell (" << m_grassInstanceCount << " blades)" << std::endl;
+}
+
+uint32_t Renderer::getGrassPlacedCount() const
+{
+    // The GPU path keeps one slot per candidate and counts the survivors; the other sources are exact
+    if (m_grassEditor) {
+        return m_grassEditor->getInstanceCount();
+    }
+    if (m_grassPlacedCountBuffer && !m_instanceFile) {
+        return *static_cast<const uint32_t*>(m_grassPlacedCountBuffer->contents());
+    }
+    return m_grassInstanceCount;
+}
+
+void Renderer::setGrassDensityMapEnabled(bool enabled)
+{
+    if (enabled == m_grassDensityMapEnabled) {
+        return;
+    }
+    if (m_instanceFile) {
+        std::cerr << "Grass placement is fixed by the mapped instance file" << std::endl;
+        return;
+    }
+    if (!m_generateGrassPSO) {
+        std::cerr << "Grass placement changes require the GPU generation kernel" << std::endl;
+        return;
+    }
+    
+    m_grassDensityMapEnabled = enabled;
+    generateGrassOnGPU();
+    bakeGrassImpostors(); // The patches are cells of the field
+    std::cout << "Grass density map: " << (enabled ? "ON" : "OFF") << std::endl;
+}
+
+bool Renderer::applyRenderSettings(const RenderSettings& settings)
+{
+    // Only what differs is touched, so re-applying the same settings rebuilds nothing
+    RenderSettings current = getRenderSettings();
+    bool applied = true;
+    
+    if (settings.bladesPerCell != current.bladesPerCell) {
+        setGrassDensity(settings.bladesPerCell);
+        applied = applied && m_grassBladesPerCell == settings.bladesPerCell;
+    }
+    if (settings.bladeSegments != current.bladeSegments) {
+        applied = setGrassBladeSegments(settings.bladeSegments) && applied;
+    }
+    m_lodDistances[0] = std::max(settings.lodDistances[0], 0.0f);
+    m_lodDistances[1] = std::max(settings.lodDistances[1], m_lodDistances[0]);
+    m_lodFadeWidth = std::max(settings.lodFadeWidth, 0.0f);
+    setGrassDensityLod(settings.densityLodDistance);
+    if (settings.impostors != current.impostors || settings.impostorDistance != current.impostorDistance) {
+        setGrassImpostors(settings.impostors, settings.impostorDistance);
+    }
+    
+    // Shading permutation and sample count: built in the background, swapped in once ready
+    if (settings.halfPrecision != current.halfPrecision) {
+        setHalfPrecisionShading(settings.halfPrecision);
+    }
+    if (settings.contactShadows != current.contactShadows || settings.translucency != current.translucency ||
+        settings.windSheen != current.windSheen) {
+        GrassShadingFeatures features;
+        features.contactShadows = settings.contactShadows;
+        features.translucency = settings.translucency;
+        features.windSheen = settings.windSheen;
+        setGrassShadingFeatures(features);
+    }
+    if (settings.shadowMaps != current.shadowMaps) {
+        applied = setShadowMaps(settings.shadowMaps) && applied;
+    }
+    if (settings.sampleCount != current.sampleCount) {
+        applied = setSceneSampleCount(settings.sampleCount) && applied;
+    }
+    if (settings.temporalAntialiasing != current.temporalAntialiasing) {
+        applied = setTemporalAntialiasing(settings.temporalAntialiasing) && applied;
+    }
+    if (settings.renderScale != current.renderScale) {
+        applied = setFixedRenderScale(settings.renderScale) && applied;
+    }
+    setFogDistances(settings.fogStartDistance, settings.fogEndDistance);
+    
+    // Simulation
+    if (settings.trampleMapSize != current.trampleMapSize) {
+        applied = setTrampleMapSize(settings.trampleMapSize) && applied;
+    }
+    if (settings.bladePhysicsRadius != current.bladePhysicsRadius) {
+        applied = setBladePhysics(settings.bladePhysicsRadius) && applied;
+    }
+    if (settings.simulationScale != current.simulationScale) {
+        PowerPolicy policy = m_powerPolicy;
+        policy.simulationScale = settings.simulationScale;
+        setPowerPolicy(policy);
+    }
+    
+    m_renderQuality = settings.quality;
+    std::cout << "Render settings: " << RenderSettings::qualityName(settings.quality)
+              << (applied ? "" : " (not every setting could be applied)") << std::endl;
+    return applied;
+}
+
+RenderSettings Renderer::getRenderSettings() const
+{
+    RenderSettings settings;
+    settings.quality = m_renderQuality;
+    settings.bladesPerCell = m_grassBladesPerCell;
+    settings.bladeSegments = m_grassBladeSegments;
+    settings.lodDistances[0] = m_lodDistances[0];
+    settings.lodDistances[1] = m_lodDistances[1];
+    settings.lodFadeWidth = m_lodFadeWidth;
+    settings.densityLodDistance = m_grassDensityLodDistance;
+    settings.impostors = m_impostorsEnabled;
+    settings.impostorDistance = m_impostorDistance;
+    settings.sampleCount = static_cast<int>(m_sceneSampleCountRequested);
+    settings.temporalAntialiasing = m_temporalAntialiasingRequested;
+    settings.renderScale = m_dynamicResolution && m_dynamicResolution->getFixedScale() > 0.0f ?
+        m_dynamicResolution->getFixedScale() : 1.0f;
+    settings.halfPrecision = m_halfPrecisionShading;
+    settings.contactShadows = m_grassShadingFeatures.contactShadows;
+    settings.translucency = m_grassShadingFeatures.translucency;
+    settings.windSheen = m_grassShadingFeatures.windSheen;
+    settings.shadowMaps = m_shadowMapsEnabled;
+    settings.fogStartDistance = m_fogStartDistance;
+    settings.fogEndDistance = m_fogEndDistance;
+    settings.trampleMapSize = getTrampleMapSize();
+    settings.bladePhysicsRadius = m_bladePhysicsRadius;
+    settings.simulationScale = m_powerPolicy.simulationScale;
+    return settings;
+}
+
+bool Renderer::setSceneSampleCount(int sampleCount)
+{
+    // 1x draws straight into the resolved targets; 1x and 2x dither the alpha-to-coverage opacity
+    if (sampleCount != 1 && sampleCount != 2 && sampleCount != 4 && sampleCount != 8) {
+        std::cerr << "Scene sample count must be 1, 2, 4 or 8" << std::endl;
+        return false;
+    }
+    if (!m_device->supportsTextureSampleCount(static_cast<NS::UInteger>(sampleCount))) {
+        std::cerr << sampleCount << "x MSAA unsupported on this device" << std::endl;
+        return false;
+    }
+    
+    // Compiled in the background; draw() swaps them in (applySceneSampleCount)
+    m_sceneSampleCountRequested = static_cast<NS::UInteger>(sampleCount);
+    if (m_sceneSampleCountRequested != m_sceneSampleCount) {
+        ScenePipelineKeys keys = msaaPipelineKeys(m_sceneSampleCountRequested);
+        for (const PipelineKey* key : { &keys.grass, &keys.ground, &keys.ball, &keys.sky, &keys.impostor }) {
+            m_pipelineCache->get(*key);
+        }
+    }
+    return true;
+}
+
+bool Renderer::setGrassBladeSegments(int segments)
+{
+    segments = std::clamp(segments, 1, maxGrassLod0Segments());
+    if (segments == m_grassBladeSegments) {
+        return true;
+    }
+    
+    // Frames in flight still draw the current meshes with the bucket ranges of this frame
+    waitUntilIdle();
+    MTL::Buffer* previousVertices = m_vertexBuffer;
+    MTL::Buffer* previousIndices = m_indexBuffer;
+    int previousSegments = m_grassBladeSegments;
+    
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    m_grassBladeSegments = segments;
+    buildBladeMeshes(uploadEncoder);
+    bool built = m_vertexBuffer && m_indexBuffer;
+    if (!built) {
+        // Back to the previous meshes (still cached: acquired again without an upload)
+        for (MTL::Buffer* buffer : { m_vertexBuffer, m_indexBuffer }) {
+            if (buffer) {
+                m_resourceCache->release(buffer);
+            }
+        }
+        m_grassBladeSegments = previousSegments;
+        buildBladeMeshes(uploadEncoder);
+    }
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+    
+    // The old entries stay cached (evictable) while unreferenced
+    for (MTL::Buffer* buffer : { previousVertices, previousIndices }) {
+        if (buffer) {
+            m_resourceCache->release(buffer);
+        }
+    }
+    if (!built) {
+        return false;
+    }
+    bakeGrassImpostors(); // The cards are baked from the nearest blade mesh
+    std::cout << "Grass blade segments: " << m_grassBladeSegments << std::endl;
+    return true;
+}
+
+bool Renderer::setTrampleMapSize(int size)
+{
+    if (size < 256 || size > 4096 || (size & (size - 1)) != 0) {
+        std::cerr << "Trample map size must be a power of two from 256 to 4096" << std::endl;
+        return false;
+    }
+    if (size == getTrampleMapSize()) {
+        return true;
+    }
+    // A snapshot transfer in flight reads or writes the current map through the staging buffer
+    if (m_trampleSavePending || m_trampleUploadPending || m_trampleTransferSlot >= 0 || m_trampleFileJob.load(std::memory_order_acquire)) {
+        std::cerr << "Trample snapshot in progress; keeping the trample map size" << std::endl;
+        return false;
+    }
+    
+    // Frames in flight still stamp and sample the current map; the new one starts untrampled
+    waitUntilIdle();
+    int previousSize = getTrampleMapSize();
+    if (!buildTrampleTextures(size)) {
+        if (previousSize > 0) {
+            buildTrampleTextures(previousSize);
+        }
+        return false;
+    }
+    std::cout << "Trample map: " << size << "x" << size << std::endl;
+    return true;
+}
+
+int Renderer::getTrampleMapSize() const
+{
+    return m_trampleMap ? static_cast<int>(m_trampleMap->width()) : 0;
+}
+
+void Renderer::setFogDistances(float start, float end)
+{
+    // Scene constants: reaches the post pass with the next frame
+    m_fogStartDistance = std::max(start, 0.0f);
+    m_fogEndDistance = std::max(end, m_fogStartDistance + 1.0f);
+}
+
+void Renderer::renderOverlay(MTL::RenderPassDescriptor* renderPassDescriptor, MTL::CommandBuffer* commandBuffer,
+                             MTL::RenderCommandEncoder* renderEncoder)
+{
+    if (!m_overlay) {
+        return;
+    }
+    
+    OverlayStats stats;
+    stats.cpuFrameMs = m_cpuFrameMs;
+    stats.gpu = m_profiler->getTimings();
+    stats.totalBlades = getGrassPlacedCount();
+    for (int lod = 0; lod < GRASS_LOD_COUNT; ++lod) {
+        stats.visibleBlades[lod] = m_visibleBladeCounts[lod];
+    }
+    stats.visibleBladesValid = m_visibleBladeCountsValid;
+    stats.gpuMemoryBytes = static_cast<size_t>(m_device->currentAllocatedSize());
+    for (int category = 0; category < GpuMemoryBudget::CategoryCount; ++category) {
+        stats.gpuMemoryCategoryBytes[category] = m_gpuMemory->getBytes(static_cast<GpuMemoryBudget::Category>(category));
+    }
+    stats.gpuMemoryBudgetBytes = m_gpuMemory->getBudgetBytes();
+    stats.gpuWorkingSetBytes = m_gpuMemory->getWorkingSetBytes();
+    stats.gpuMemoryPressure = m_gpuMemoryShrunk;
+    stats.renderScale = getRenderScale();
+    
+    OverlaySettings settings;
+    settings.bladesPerCell = m_grassBladesPerCell;
+    settings.maxBladesPerCell = kGrassMaxBladesPerCell;
+    settings.lodDistances[0] = m_lodDistances[0];
+    settings.lodDistances[1] = m_lodDistances[1];
+    settings.lodFadeWidth = m_lodFadeWidth;
+    settings.densityLodDistance = m_grassDensityLodDistance;
+    settings.hiZCulling = m_hiZCullingEnabled;
+    settings.dynamicResolutionSupported = (m_dynamicResolution != nullptr);
+    settings.dynamicResolution = m_dynamicResolution && m_dynamicResolution->isEnabled();
+    settings.targetFrameMs = m_dynamicResolution ? m_dynamicResolution->getTargetFrameMs() : 0.0f;
+    settings.temporalUpscalingSupported = m_dynamicResolution && m_dynamicResolution->isTemporalAvailable();
+    settings.temporalUpscaling = m_temporalRequested && !m_temporalAntialiasingRequested;
+    settings.temporalAntialiasingSupported = m_temporalResolvePSO && m_temporalAntialiasing->isAvailable();
+    settings.temporalAntialiasing = m_temporalAntialiasingRequested;
+    
+    if (m_overlay->render(stats, settings, renderPassDescriptor, commandBuffer, renderEncoder)) {
+        setGrassDensity(settings.bladesPerCell);
+        m_lodDistances[0] = settings.lodDistances[0];
+        m_lodDistances[1] = settings.lodDistances[1];
+        m_lodFadeWidth = settings.lodFadeWidth;
+        m_grassDensityLodDistance = settings.densityLodDistance;
+        m_hiZCullingEnabled = settings.hiZCulling;
+        if (m_dynamicResolution) {
+            if (settings.dynamicResolution != m_dynamicResolution->isEnabled()) {
+                m_dynamicResolution->setEnabled(settings.dynamicResolution);
+            }
+            m_dynamicResolution->setTargetFrameMs(settings.targetFrameMs);
+        }
+        if (settings.temporalUpscaling != (m_temporalRequested && !m_temporalAntialiasingRequested)) {
+            setTemporalUpscaling(settings.temporalUpscaling);
+        } else if (settings.temporalAntialiasing != m_temporalAntialiasingRequested) {
+            setTemporalAntialiasing(settings.temporalAntialiasing);
+        }
+    }
+}
+
+void Renderer::resize(int width, int height)
+{
+    // Update metal layer drawable size
+    if (m_metalLayer) {
+        m_metalLayer->setDrawableSize(CGSizeMake(static_cast<CGFloat>(width), static_cast<CGFloat>(height)));
+    }
+    
+    // Release old textures first: their heap space is reused by the new ones below
+    if (m_depthTexture) {
+        m_depthTexture->release();
+        m_depthTexture = nullptr;
+    }
+    if (m_offscreenColorTexture) {
+        m_offscreenColorTexture->release();
+        m_offscreenColorTexture = nullptr;
+    }
+    releaseHiZPyramid();
+    
+    // Pooled MSAA targets have the old size (frames in flight keep their own references)
+    if (m_renderGraph) {
+        m_renderGraph->releaseTransients();
+    }
+    
+    // The rate map covers the full-resolution scene targets
+    if (m_rasterizationRate) {
+        m_rasterizationRate->resize(width, height);
+    }
+    
+    // MetalFX scaler and its input are tied to the output size
+    if (m_dynamicResolution) {
+        m_dynamicResolution->resize(width, height);
+        // Fall back to MSAA (switched at the next draw) if the temporal inputs could not be recreated
+        if (m_temporalRequested && !m_temporalAntialiasingRequested && !m_dynamicResolution->isTemporalAvailable()) {
+            setTemporalUpscaling(false);
+        }
+    }
+    m_temporalAntialiasing->resize(width, height);
+    if (m_temporalAntialiasingRequested && !m_temporalAntialiasing->isAvailable()) {
+        setTemporalAntialiasing(false);
+    }
+    
+    // Headless: resolve target standing in for the drawable
+    if (!m_metalLayer) {
+        MTL::TextureDescriptor* offscreenDescriptor = MTL::TextureDescriptor::alloc()->init();
+        offscreenDescriptor->setWidth(width);
+        offscreenDescriptor->setHeight(height);
+        offscreenDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+        offscreenDescriptor->setTextureType(MTL::TextureType2D);
+        offscreenDescriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead |
+                                      (m_dynamicResolution ? m_dynamicResolution->getOutputUsage() : MTL::TextureUsageUnknown));
+        offscreenDescriptor->setStorageMode(MTL::StorageModePrivate);
+        
+        m_offscreenColorTexture = m_targetHeap->newTexture(offscreenDescriptor);
+        if (!m_offscreenColorTexture) {
+            std::cerr << "Failed to create offscreen color texture" << std::endl;
+        }
+        offscreenDescriptor->release();
+    }
+    
+    // The 4x MSAA color/depth targets are transient render graph textures (see draw())
+    
+    // Create resolve Depth Texture (non-multisample, for resolve target)
+    MTL::TextureDescriptor* depthDescriptor = MTL::TextureDescriptor::alloc()->init();
+    depthDescriptor->setWidth(width);
+    depthDescriptor->setHeight(height);
+    depthDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
+    depthDescriptor->setTextureType(MTL::TextureType2D);
+    // ShaderRead: the resolved depth feeds the Hi-Z pyramid next frame (and the temporal scaler)
+    depthDescriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead |
+                              (m_dynamicResolution ? m_dynamicResolution->getDepthUsage() : MTL::TextureUsageUnknown));
+    depthDescriptor->setStorageMode(MTL::StorageModePrivate);
     
-    m_skyDepthStencilState = m_device->newDepthStencilState(skyDepthStencilDescriptor);
+    m_depthTexture = m_targetHeap->newTexture(depthDescriptor);
+    if (!m_depthTexture) {
+        std::cerr << "Failed to create depth texture" << std::endl;
+    }
+    depthDescriptor->release();
     
-    if (!m_skyDepthStencilState) {
-        std::cerr << "Failed to create sky depth stencil state" << std::endl;
+    // Rebuild the Hi-Z pyramid for the new size (old depth is gone, so skip occlusion for one frame)
+    buildHiZPyramid(width, height);
+    m_hiZValid = false;
+}
+
+void Renderer::buildHiZPyramid(int width, int height)
+{
+    releaseHiZPyramid();
+    
+    // Level 0 is half the depth resolution; each level halves again down to 1x1
+    int hiZWidth = std::max(1, (width + 1) / 2);
+    int hiZHeight = std::max(1, (height + 1) / 2);
+    int maxDimension = std::max(hiZWidth, hiZHeight);
+    int mipCount = static_cast<int>(std::floor(std::log2(static_cast<double>(maxDimension)))) + 1;
+    
+    MTL::TextureDescriptor* hiZDescriptor = MTL::TextureDescriptor::alloc()->init();
+    hiZDescriptor->setWidth(hiZWidth);
+    hiZDescriptor->setHeight(hiZHeight);
+    hiZDescriptor->setPixelFormat(MTL::PixelFormatR32Float);
+    hiZDescriptor->setTextureType(MTL::TextureType2D);
+    hiZDescriptor->setMipmapLevelCount(mipCount);
+    hiZDescriptor->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite | MTL::TextureUsagePixelFormatView);
+    hiZDescriptor->setStorageMode(MTL::StorageModePrivate);
+    
+    m_hiZTexture = m_targetHeap->newTexture(hiZDescriptor);
+    hiZDescriptor->release();
+    
+    if (!m_hiZTexture) {
+        std::cerr << "Failed to create Hi-Z texture" << std::endl;
+        return;
     }
     
-    skyDepthStencilDescriptor->release();
+    // Single-level views so each reduction step reads level N-1 and writes level N
+    for (int level = 0; level < mipCount; ++level) {
+        MTL::Texture* view = m_hiZTexture->newTextureView(
+            MTL::PixelFormatR32Float,
+            MTL::TextureType2D,
+            NS::Range::Make(level, 1),
+            NS::Range::Make(0, 1));
+        m_hiZMipViews.push_back(view);
+    }
+}
+
+void Renderer::releaseHiZPyramid()
+{
+    for (MTL::Texture* view : m_hiZMipViews) {
+        if (view) {
+            view->release();
+        }
+    }
+    m_hiZMipViews.clear();
     
-    // Load Trample Compute Shader
-    MTL::Library* computeLibrary = m_device->newDefaultLibrary();
-    if (computeLibrary) {
-        NS::String* computeFunctionName = NS::String::string("updateTrampleMap", NS::ASCIIStringEncoding);
-        MTL::Function* computeFunction = computeLibrary->newFunction(computeFunctionName);
-        
-        if (computeFunction) {
-            // Create compute pipeline
-            NS::Error* computeError = nullptr;
-            m_trampleComputePSO = m_device->newComputePipelineState(computeFunction, &computeError);
-            
-            if (!m_trampleComputePSO) {
-                if (computeError) {
-                    NS::String* errorString = computeError->localizedDescription();
-                    std::cerr << "Failed to create trample compute pipeline: " << errorString->utf8String() << std::endl;
-                    errorString->release();
-                } else {
-                    std::cerr << "Failed to create trample compute pipeline" << std::endl;
-                }
+    if (m_hiZTexture) {
+        m_hiZTexture->release();
+        m_hiZTexture = nullptr;
+    }
+}
+
+void Renderer::updateSceneConstants()
+{
+    // Built every frame (cheap), copied only when something differs: ground bounds (matches
+    // SCENE_SIZE; streamed blades are quantized over the whole world), tuning and materials
+    SceneConstants constants;
+    memset(&constants, 0, sizeof(constants)); // Padding too, so the memcmp below sees only the values
+    constants.lightColor = simd::make_float3(1.0f, 1.0f, 0.9f); // Warm sunlight
+    constants.groundMinXZ = simd::make_float2(-SCENE_SIZE, -SCENE_SIZE);
+    constants.groundMaxXZ = simd::make_float2(SCENE_SIZE, SCENE_SIZE);
+    constants.grassMinXZ = m_grassStreamer ? m_grassStreamer->getMinXZ() : constants.groundMinXZ;
+    constants.grassMaxXZ = m_grassStreamer ? m_grassStreamer->getMaxXZ() : constants.groundMaxXZ;
+    constants.grassDensityLodDistance = m_cullComputePSO ? grassDensityLodDistance() : 0.0f; // Unculled draws keep every blade
+    
+    // Trample decay rate (default: 0.35 for ~3 seconds recovery)
+    constants.trampleDecayRate = kTrampleDecayRate;
+    // Same condition as the trample pass's summary update (tiles stamped while it is off catch up)
+    constants.trampleSummaryValid = (m_trampleSummaryEnabled && m_trampleSummary && !m_trampleSummaryMipViews.empty() &&
+                                     m_trampleReducePSO && m_trampleSummaryDownsamplePSO) ? 1 : 0;
+    
+    // Soft interaction parameters (Ghibli-like)
+    constants.flattenStrength = 0.75f;
+    constants.contactShadowRadiusScale = 0.90f;
+    constants.contactShadowStrength = 0.55f;
+    
+    constants.fogStartDistance = m_fogStartDistance;
+    constants.fogEndDistance = m_fogEndDistance;
+    
+    // Wind pose table (a few dozen sin / cos); the near LOD keeps the procedural bend
+    constants.windPoseDistance = m_grassWindPoses ? m_lodDistances[0] : 0.0f;
+    for (int i = 0; i < GRASS_WIND_POSE_COUNT; ++i) {
+        float angle = (2.0f * static_cast<float>(i) / static_cast<float>(GRASS_WIND_POSE_COUNT - 1) - 1.0f) * GRASS_WIND_POSE_MAX_ANGLE;
+        constants.windPoses[i] = simd::make_float2(std::sin(angle), 1.0f - std::cos(angle));
+    }
+    
+    if (m_sceneConstantsVersion == 0 || memcmp(&constants, &m_sceneConstants, sizeof(SceneConstants)) != 0) {
+        m_sceneConstants = constants;
+        m_sceneConstantsVersion++;
+    }
+    
+    // The slot's previous frame has completed (ring semaphore), so its copy can be rewritten
+    m_sceneConstantBuffer = m_sceneConstantBuffers[m_frameIndex];
+    if (m_sceneConstantBuffer && m_sceneConstantSlotVersions[m_frameIndex] != m_sceneConstantsVersion) {
+        memcpy(m_sceneConstantBuffer->contents(), &m_sceneConstants, sizeof(SceneConstants));
+        m_sceneConstantSlotVersions[m_frameIndex] = m_sceneConstantsVersion;
+    }
+}
+
+void Renderer::writeGrassResourceTable()
+{
+    MTL::Buffer* tableBuffer = m_grassResourceTables[m_frameIndex];
+    m_grassTableResources.clear();
+    if (!tableBuffer) {
+        return;
+    }
+    
+    MTL::Buffer* bladeStates = grassBladeStateBuffer();
+    MTL::Texture* noise = m_noiseTexture ? m_noiseTexture->getMetalTexture() : nullptr;
+    MTL::Buffer* buffers[] = { m_vertexBuffer, grassInstanceBuffer(), m_visibleInstanceBuffer,
+                               m_frameInteractorBuffer, m_interactorBinBuffer, bladeStates,
+                               m_pointLightBuffers[m_frameIndex], m_lightClusterBuffer };
+    MTL::Texture* shadowMaps[SHADOW_MAP_COUNT] = {};
+    for (int map = 0; m_shadowMaps && map < SHADOW_MAP_COUNT; ++map) {
+        shadowMaps[map] = m_shadowMaps->getTexture(map);
+    }
+    MTL::Texture* textures[] = { m_trampleMap, m_windField, m_grassAlbedoArray, noise, m_grassPalette->getTexture(m_frameIndex),
+                                 shadowMaps[0], shadowMaps[1], shadowMaps[2] };
+    
+    GrassResourceTable* table = static_cast<GrassResourceTable*>(tableBuffer->contents());
+    uint64_t* addresses[] = { &table->vertices, &table->instances, &table->visibleInstances,
+                              &table->interactors, &table->interactorBins, &table->bladeStates,
+                              &table->pointLights, &table->lightClusters };
+    uint64_t* textureIDs[] = { &table->trampleMap, &table->windField, &table->albedo, &table->noise, &table->palette,
+                               &table->shadowMaps[0], &table->shadowMaps[1], &table->shadowMaps[2] };
+    for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+        *addresses[i] = buffers[i] ? buffers[i]->gpuAddress() : 0;
+        if (buffers[i]) {
+            m_grassTableResources.push_back(buffers[i]);
+        }
+    }
+    for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); ++i) {
+        *textureIDs[i] = textures[i] ? textures[i]->gpuResourceID()._impl : 0;
+        if (textures[i]) {
+            m_grassTableResources.push_back(textures[i]);
+        }
+    }
+}
+
+void Renderer::bindGrassResources(MTL::RenderCommandEncoder* encoder, MTL::RenderStages stages) const
+{
+    MTL::Buffer* tableBuffer = m_grassResourceTables[m_frameIndex];
+    if (stages & MTL::RenderStageVertex) {
+        encoder->setVertexBuffer(tableBuffer, 0, BufferIndexGrassResources);
+    }
+    if (stages & MTL::RenderStageFragment) {
+        encoder->setFragmentBuffer(tableBuffer, 0, BufferIndexGrassResources);
+    }
+    // Referenced through the table only: residency and hazard tracking need them declared
+    if (!m_grassTableResources.empty()) {
+        encoder->useResources(m_grassTableResources.data(), m_grassTableResources.size(), MTL::ResourceUsageRead, stages);
+    }
+}
+
+void Renderer::encodeGrassInstances(MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPipelineState* pipeline,
+                                    bool useGrassICB, bool useIndirectGrassDraw,
+                                    NS::UInteger uniformOffset, int firstBucket, int bucketCount)
+{
+    // Explicit Binding: Set the correct PSO
+    renderEncoder->setRenderPipelineState(pipeline);
+    
+    // Explicit Binding: Bind the view's Uniform Buffer (the first of an amplified pair)
+    renderEncoder->setVertexBuffer(m_uniformBuffer, uniformOffset, BufferIndexUniforms);
+    renderEncoder->setFragmentBuffer(m_uniformBuffer, uniformOffset, BufferIndexUniforms);
+    renderEncoder->setVertexBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+    renderEncoder->setFragmentBuffer(m_sceneConstantBuffer, 0, BufferIndexSceneConstants);
+    
+    // Everything else (meshes, instances, visible list, interactors, blade states, point lights,
+    // trample map, wind field, albedo and noise) comes from the frame's resource table
+    bindGrassResources(renderEncoder, MTL::RenderStageVertex | MTL::RenderStageFragment);
+    
+    // Draw Instanced Grass
+    if (useGrassICB) {
+        // Per-bucket draws were encoded by the GPU after culling
+        renderEncoder->useResource(m_indexBuffer, MTL::ResourceUsageRead);
+        renderEncoder->executeCommandsInBuffer(m_grassICB, NS::Range::Make(firstBucket, bucketCount));
+    } else if (useIndirectGrassDraw) {
+        // One indirect draw per species and LOD; mesh range and instance count come from the cull pass
+        for (int bucket = firstBucket; bucket < firstBucket + bucketCount; ++bucket) {
+            renderEncoder->drawIndexedPrimitives(
+                MTL::PrimitiveTypeTriangle,
+                MTL::IndexTypeUInt16,
+                m_indexBuffer,
+                NS::UInteger(0),
+                m_grassDrawArgsBuffer,
+                NS::UInteger(bucket * sizeof(GrassDrawArguments)));
+        }
+    } else if (firstBucket == 0 && m_cpuCulledThisFrame) {
+        // CPU-culled: one draw per run of visible cells, LOD 0 (the identity region, from each
+        // run's first instance)
+        for (const CpuCellCuller::Range& range : m_cpuCellCuller->getVisibleRanges()) {
+            if (range.firstInstance >= m_grassInstanceCapacity) {
+                continue;
             }
-            
-            computeFunction->release();
+            uint32_t instanceCount = std::min(range.instanceCount, m_grassInstanceCapacity - range.firstInstance);
+            renderEncoder->drawIndexedPrimitives(
+                MTL::PrimitiveTypeTriangle,
+                NS::UInteger(m_grassBucketIndexCount[0]),
+                MTL::IndexTypeUInt16,
+                m_indexBuffer,
+                NS::UInteger(m_grassBucketIndexStart[0] * sizeof(uint16_t)),
+                NS::UInteger(instanceCount),
+                NS::Integer(m_grassBucketBaseVertex[0]),
+                NS::UInteger(identityVisibleBase() + range.firstInstance));
+        }
+    } else if (firstBucket == 0) {
+        // Fallback: draw every instance with the grass blade's LOD 0 (through the identity region)
+        renderEncoder->drawIndexedPrimitives(
+            MTL::PrimitiveTypeTriangle,
+            NS::UInteger(m_grassBucketIndexCount[0]),
+            MTL::IndexTypeUInt16,
+            m_indexBuffer,
+            NS::UInteger(m_grassBucketIndexStart[0] * sizeof(uint16_t)),
+            NS::UInteger(m_grassInstanceCount),
+            NS::Integer(m_grassBucketBaseVertex[0]),
+            NS::UInteger(identityVisibleBase()));
+    }
+}
+
+void Renderer::encodeGrassCull(MTL::ComputeCommandEncoder* cullEncoder, const CullUniforms& cullUniforms,
+                               bool useHiZ, bool useGrassICB, bool sortCells)
+{
+    // Build the Hi-Z pyramid from the previous frame's resolved depth
+    if (useHiZ) {
+        encodeHiZBuild(cullEncoder);
+    }
+    
+    // Reset per-bucket draw arguments (dispatches in a serial compute encoder run in order)
+    cullEncoder->setComputePipelineState(m_resetDrawArgsPSO);
+    cullEncoder->setBuffer(m_grassDrawArgsBuffer, 0, CullBufferIndexDrawArguments);
+    cullEncoder->setBuffer(m_impostorDrawArgsBuffer, 0, CullBufferIndexImpostorDrawArguments);
+    cullEncoder->setBytes(&cullUniforms, sizeof(CullUniforms), CullBufferIndexUniforms);
+    m_computeDispatch->dispatch(cullEncoder, m_resetDrawArgsPSO, MTL::Size(GRASS_DRAW_BUCKET_COUNT, 1, 1));
+    
+    // Sort the cells by distance to the nearest camera
+    if (sortCells) {
+        cullEncoder->setComputePipelineState(m_sortCellsPSO);
+        cullEncoder->setBuffer(grassCellBuffer(), 0, CullBufferIndexCells);
+        cullEncoder->setBuffer(m_cellOrderBuffer, 0, CullBufferIndexCellOrder);
+        cullEncoder->dispatchThreadgroups(MTL::Size(1, 1, 1), MTL::Size(GRASS_CELL_SORT_CAPACITY, 1, 1));
+    }
+    
+    // Cull every cell, then the blades of surviving cells, appending them to their species and LOD bucket
+    cullEncoder->setComputePipelineState(m_cullComputePSO);
+    cullEncoder->setBuffer(grassInstanceBuffer(), 0, CullBufferIndexInstances);
+    cullEncoder->setBuffer(grassCellBuffer(), 0, CullBufferIndexCells);
+    cullEncoder->setBuffer(m_visibleInstanceBuffer, 0, CullBufferIndexVisibleInstances);
+    cullEncoder->setBuffer(m_grassDrawArgsBuffer, 0, CullBufferIndexDrawArguments);
+    cullEncoder->setBuffer(m_impostorBuffer, 0, CullBufferIndexImpostors);
+    cullEncoder->setBuffer(m_impostorDrawArgsBuffer, 0, CullBufferIndexImpostorDrawArguments);
+    cullEncoder->setBuffer(m_cellOrderBuffer, 0, CullBufferIndexCellOrder);
+    cullEncoder->setBytes(&cullUniforms, sizeof(CullUniforms), CullBufferIndexUniforms);
+    cullEncoder->setTexture(m_hiZTexture, CullTextureIndexHiZ);
+    cullEncoder->setTexture(m_trampleMap, CullTextureIndexTrampleMap);
+    cullEncoder->setTexture(m_trampleSummary, CullTextureIndexTrampleSummary);
+    
+    // One threadgroup per cell, sized for the blades of a cell (the kernel strides over the rest)
+    MTL::Size threadgroupSize = ComputeDispatch::threadgroupSize(m_cullComputePSO,
+        MTL::Size(static_cast<NS::UInteger>(m_grassBladesPerCell), 1, 1));
+    MTL::Size threadgroupCount = MTL::Size(std::max(cullUniforms.cellCount, 1u), 1, 1);
+    cullEncoder->dispatchThreadgroups(threadgroupCount, threadgroupSize);
+    
+    // Write the per-bucket grass draws into the indirect command buffer
+    if (useGrassICB) {
+        cullEncoder->setComputePipelineState(m_encodeGrassCommandsPSO);
+        cullEncoder->setBuffer(m_grassICBArgumentBuffer, 0, CullBufferIndexGrassCommands);
+        cullEncoder->setBuffer(m_grassDrawArgsBuffer, 0, CullBufferIndexDrawArguments);
+        cullEncoder->setBuffer(m_indexBuffer, 0, CullBufferIndexGrassIndices);
+        cullEncoder->useResource(m_grassICB, MTL::ResourceUsageWrite);
+        m_computeDispatch->dispatch(cullEncoder, m_encodeGrassCommandsPSO, MTL::Size(GRASS_DRAW_BUCKET_COUNT, 1, 1));
+    }
+}
+
+void Renderer::encodeHiZBuild(MTL::ComputeCommandEncoder* encoder)
+{
+    if (!encoder || !m_depthTexture || m_hiZMipViews.empty()) {
+        return;
+    }
+    
+    for (size_t level = 0; level < m_hiZMipViews.size(); ++level) {
+        MTL::Texture* dst = m_hiZMipViews[level];
+        MTL::ComputePipelineState* pipeline = level == 0 ? m_hiZFromDepthPSO : m_hiZDownsamplePSO;
+        
+        encoder->setComputePipelineState(pipeline);
+        if (level == 0) {
+            // Level 0: reduce the resolved depth buffer
+            encoder->setTexture(m_depthTexture, 0);
         } else {
-            std::cerr << "Failed to load updateTrampleMap function" << std::endl;
+            // Level N: reduce level N-1
+            encoder->setTexture(m_hiZMipViews[level - 1], 0);
         }
+        encoder->setTexture(dst, 1);
         
-        computeFunctionName->release();
-        computeLibrary->release();
+        m_computeDispatch->dispatch(encoder, pipeline, MTL::Size(dst->width(), dst->height(), 1));
+    }
+}
+
+void Renderer::buildTextures()
+{
+    // Image textures decode on the loader's workers; until then the blades use a transparent
+    // placeholder (nothing drawn) and the ground a flat soil color
+    // Note: Make sure to check path. Since we copy assets to bin, relative path "assets/grass_albedo.png" should work.
+    // Grass albedo variants: each loads as its own texture, and every load rebuilds the 2D array
+    // the blades sample by their variant index; until the first one is in, a transparent
+    // placeholder array is bound
+    MTL::TextureDescriptor* placeholderDescriptor = MTL::TextureDescriptor::alloc()->init();
+    placeholderDescriptor->setTextureType(MTL::TextureType2DArray);
+    placeholderDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    placeholderDescriptor->setWidth(1);
+    placeholderDescriptor->setHeight(1);
+    placeholderDescriptor->setArrayLength(GRASS_ALBEDO_VARIANT_COUNT);
+    placeholderDescriptor->setUsage(MTL::TextureUsageShaderRead);
+    placeholderDescriptor->setStorageMode(MTL::StorageModeShared);
+    m_grassAlbedoArray = m_device->newTexture(placeholderDescriptor);
+    placeholderDescriptor->release();
+    if (m_grassAlbedoArray) {
+        uint32_t transparent = 0;
+        for (int slice = 0; slice < GRASS_ALBEDO_VARIANT_COUNT; ++slice) {
+            m_grassAlbedoArray->replaceRegion(MTL::Region::Make2D(0, 0, 1, 1), 0, slice, &transparent, sizeof(transparent), sizeof(transparent));
+        }
     } else {
-        std::cerr << "Failed to load default library for compute shader" << std::endl;
+        std::cerr << "Failed to create grass albedo placeholder" << std::endl;
+    }
+    
+    for (int variant = 0; variant < GRASS_ALBEDO_VARIANT_COUNT; ++variant) {
+        std::string base = variant == 0 ? "assets/grass_albedo" : "assets/grass_albedo_" + std::to_string(variant + 1);
+        m_grassAlbedoVariants[variant] = m_resourceCache->acquireTexture({ base + ".ktx2.lz4", base + ".ktx2", base + ".png" }, 0x00000000u,
+                                                                         [this, variant](Texture*, bool loaded) {
+            if (!loaded) {
+                return; // Logged by the loader; the variant keeps its transparent slice
+            }
+            std::cout << "Successfully loaded grass texture " << variant + 1 << std::endl;
+            m_grassAlbedoLoaded[variant] = true;
+            buildGrassAlbedoArray();
+        });
     }
+    
+    // Create m_groundTexture instance (ground)
+    // Try the compressed KTX2 (CompressedTextures target, LZ4 copy first), then PNG, then JPG as fallback
+    // (the sparse ground tiles are generated from it, so they are regenerated once it arrives)
+    m_groundTexture = m_resourceCache->acquireTexture({ "assets/ground_albedo.ktx2.lz4", "assets/ground_albedo.ktx2", "assets/ground_albedo.png", "assets/ground_albedo.jpg" }, 0xff2e4a5au, [this](Texture*, bool loaded) {
+        if (!loaded) {
+            return; // Logged by the loader; the tiles keep the placeholder color
+        }
+        std::cout << "Successfully loaded ground texture" << std::endl;
+        if (m_sparseGround) {
+            m_sparseGround->invalidate();
+        }
+    });
+    
+    // Shared noise lattice (wind field, low-frequency grass tint); fixed seed, so the look does
+    // not depend on the placement seed
+    m_noiseTexture = new NoiseTexture(m_device, kNoiseTextureSize, kNoiseTextureSeed);
+    
+    // Blade colors (species gradients, variation, withered tips) of the default season
+    m_grassPalette = new GrassPalette(m_device, kMaxFramesInFlight);
 }
 
-void Renderer::buildBuffers()
+void Renderer::buildGrassAlbedoArray()
 {
-    // Define a vertical strip for a blade of grass with multiple height segments.
-    // This increases geometric detail so bending in the vertex shader looks smooth and organic.
-    //
-    // Coordinate system for a single blade in local space:
-    //  - Y from -0.5 (root) to +0.5 (tip)
-    //  - X is half-width; we taper from a wider base to a very thin tip
-    //  - Z stays 0 in local space; billboarding handles facing the camera
-    //
-    // We generate kGrassRows rows, each with left and right vertices.
-    // UV.y goes from 1.0 at the bottom to 0.0 at the top.
+    // Slices share one size and format: variants not loaded yet (or not matching the first
+    // loaded one) repeat it until they arrive
+    int reference = -1;
+    for (int variant = 0; variant < GRASS_ALBEDO_VARIANT_COUNT && reference < 0; ++variant) {
+        if (m_grassAlbedoLoaded[variant]) {
+            reference = variant;
+        }
+    }
+    if (reference < 0) {
+        return;
+    }
+    MTL::Texture* referenceTexture = m_grassAlbedoVariants[reference]->getMetalTexture();
+    
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setTextureType(MTL::TextureType2DArray);
+    descriptor->setPixelFormat(referenceTexture->pixelFormat());
+    descriptor->setWidth(referenceTexture->width());
+    descriptor->setHeight(referenceTexture->height());
+    descriptor->setMipmapLevelCount(referenceTexture->mipmapLevelCount());
+    descriptor->setArrayLength(GRASS_ALBEDO_VARIANT_COUNT);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    MTL::Texture* albedoArray = m_device->newTexture(descriptor);
+    descriptor->release();
+    if (!albedoArray) {
+        std::cerr << "Failed to create grass albedo array" << std::endl;
+        return;
+    }
+    
+    // Queued after the loader's uploads, ahead of the next frame
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+    bool allLoaded = true;
+    for (int slice = 0; slice < GRASS_ALBEDO_VARIANT_COUNT; ++slice) {
+        MTL::Texture* source = m_grassAlbedoLoaded[slice] ? m_grassAlbedoVariants[slice]->getMetalTexture() : referenceTexture;
+        if (source->pixelFormat() != referenceTexture->pixelFormat() || source->width() != referenceTexture->width() ||
+            source->height() != referenceTexture->height() || source->mipmapLevelCount() != referenceTexture->mipmapLevelCount()) {
+            std::cerr << "Grass albedo variant " << slice + 1 << " does not match variant " << reference + 1 << ", reusing it" << std::endl;
+            source = referenceTexture;
+        }
+        allLoaded = allLoaded && m_grassAlbedoLoaded[slice];
+        blitEncoder->copyFromTexture(source, 0, 0, albedoArray, slice, 0, 1, referenceTexture->mipmapLevelCount());
+    }
+    blitEncoder->endEncoding();
+    commandBuffer->commit();
+    
+    // Frames in flight keep the previous array alive (their command buffers retain it)
+    if (m_grassAlbedoArray) {
+        m_grassAlbedoArray->release();
+    }
+    m_grassAlbedoArray = albedoArray;
+    
+    // The array holds the finished copies (the blit is queued): the 2D variants may be evicted
+    if (allLoaded) {
+        for (int variant = 0; variant < GRASS_ALBEDO_VARIANT_COUNT; ++variant) {
+            m_resourceCache->release(m_grassAlbedoVariants[variant]);
+            m_grassAlbedoVariants[variant] = nullptr;
+        }
+    }
+    
+    // The impostor patches are re-baked with the new alpha masks
+    bakeGrassImpostors();
+}
 
-    // Fix texture distortion: Use rectangular strip (or very slightly tapered)
-    // The texture alpha defines the shape, NOT the mesh geometry
-    // Making it rectangular prevents texture squeezing at the top
-    const float baseWidth = 0.25f;   // Slightly wider base
-    const float tipWidth = 0.25f;    // SAME as base width - rectangular strip (no pinching)
-    const float heightScale = 0.7f;  // Reduce height by 30% (0.7 = 70% of original)
+void Renderer::buildGround()
+{
+    // Heightmap shared by the terrain chunks, the grass generation and the interactors
+    m_terrain = new TerrainHeightmap(m_device, SCENE_SIZE, kTerrainSeed);
+    
+    // One index list per LOD over a chunk's (quads + 1)^2 grid vertices, plus skirts from the border
+    // vertices down to their copies (vertex index + (quads + 1)^2, see groundVertexMain). The vertex
+    // shader places every vertex from its index, so the chunks need no vertex buffer.
+    std::vector<uint16_t> indices;
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+        uint16_t quads = static_cast<uint16_t>(TERRAIN_CHUNK_QUADS >> lod);
+        uint16_t rowVertices = quads + 1;
+        uint16_t skirtOffset = rowVertices * rowVertices;
+        m_terrainLodIndexStart[lod] = static_cast<uint32_t>(indices.size());
+        
+        for (uint16_t z = 0; z < quads; ++z) {
+            for (uint16_t x = 0; x < quads; ++x) {
+                uint16_t i0 = z * rowVertices + x;
+                uint16_t i1 = i0 + 1;
+                uint16_t i2 = i0 + rowVertices;
+                uint16_t i3 = i2 + 1;
+                indices.insert(indices.end(), { i0, i2, i1, i1, i2, i3 });
+            }
+        }
+        
+        // Border edges: z = 0 row, z = quads row, x = 0 column, x = quads column
+        for (uint16_t i = 0; i < quads; ++i) {
+            uint16_t edges[4][2] = {
+                { i, static_cast<uint16_t>(i + 1) },
+                { static_cast<uint16_t>(quads * rowVertices + i), static_cast<uint16_t>(quads * rowVertices + i + 1) },
+                { static_cast<uint16_t>(i * rowVertices), static_cast<uint16_t>((i + 1) * rowVertices) },
+                { static_cast<uint16_t>(i * rowVertices + quads), static_cast<uint16_t>((i + 1) * rowVertices + quads) }
+            };
+            for (const auto& edge : edges) {
+                uint16_t a = edge[0];
+                uint16_t b = edge[1];
+                indices.insert(indices.end(), { a, b, static_cast<uint16_t>(a + skirtOffset),
+                                                b, static_cast<uint16_t>(b + skirtOffset), static_cast<uint16_t>(a + skirtOffset) });
+            }
+        }
+        m_terrainLodIndexCount[lod] = static_cast<uint32_t>(indices.size()) - m_terrainLodIndexStart[lod];
+    }
+    
+    size_t indexDataSize = indices.size() * sizeof(uint16_t);
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    m_terrainIndexBuffer = m_resourceCache->acquireBuffer("terrain.indices", uploadEncoder, indices.data(), indexDataSize);
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+    if (!m_terrainIndexBuffer) {
+        std::cerr << "Failed to create terrain index buffer" << std::endl;
+    }
+    
+    // Chunk lists are rewritten every frame, so each in-flight frame has its own
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_terrainChunkBuffers[i] = m_device->newBuffer(sizeof(uint32_t) * TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNKS_PER_SIDE,
+                                                       MTL::ResourceStorageModeShared);
+        if (!m_terrainChunkBuffers[i]) {
+            std::cerr << "Failed to create terrain chunk buffer" << std::endl;
+        }
+    }
+}
 
-    Vertex vertices[kGrassVertexCount];
+void Renderer::selectTerrainLods(const simd::float3& cameraPosition)
+{
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+        m_terrainLodChunkCount[lod] = 0;
+    }
+    MTL::Buffer* chunkBuffer = m_terrainChunkBuffers[m_frameIndex];
+    if (!m_terrain || !chunkBuffer) {
+        return;
+    }
+    
+    // LOD by distance from the camera to the chunk's center on the terrain
+    const float chunkSize = 2.0f * SCENE_SIZE / static_cast<float>(TERRAIN_CHUNKS_PER_SIDE);
+    uint32_t chunkLods[TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNKS_PER_SIDE];
+    for (uint32_t chunk = 0; chunk < TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNKS_PER_SIDE; ++chunk) {
+        float x = -SCENE_SIZE + (static_cast<float>(chunk % TERRAIN_CHUNKS_PER_SIDE) + 0.5f) * chunkSize;
+        float z = -SCENE_SIZE + (static_cast<float>(chunk / TERRAIN_CHUNKS_PER_SIDE) + 0.5f) * chunkSize;
+        simd::float3 center = simd::make_float3(x, m_terrain->heightAt(x, z), z);
+        float distance = simd::length(center - cameraPosition);
+        
+        uint32_t lod = 0;
+        while (lod < TERRAIN_LOD_COUNT - 1 && distance > kTerrainLodDistances[lod]) {
+            ++lod;
+        }
+        chunkLods[chunk] = lod;
+        m_terrainLodChunkCount[lod]++;
+    }
+    
+    // Group the list by LOD so each LOD is one instanced draw
+    uint32_t cursor[TERRAIN_LOD_COUNT];
+    uint32_t offset = 0;
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+        m_terrainLodFirstChunk[lod] = offset;
+        cursor[lod] = offset;
+        offset += m_terrainLodChunkCount[lod];
+    }
+    uint32_t* chunks = static_cast<uint32_t*>(chunkBuffer->contents());
+    for (uint32_t chunk = 0; chunk < TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNKS_PER_SIDE; ++chunk) {
+        chunks[cursor[chunkLods[chunk]]++] = chunk | (chunkLods[chunk] << 16);
+    }
+}
 
-    for (int row = 0; row < kGrassRows; ++row) {
-        float t = static_cast<float>(row) / static_cast<float>(kGrassSegments); // 0 bottom -> 1 top
+void Renderer::encodeTerrainCommands(MTL::IndirectCommandBuffer* sceneICB)
+{
+    // The slot's ICB is not in flight (the ring semaphore waited for it), so its ground commands can
+    // follow this frame's chunk list; empty LODs are reset to no-ops
+    for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+        MTL::IndirectRenderCommand* ground = sceneICB->indirectRenderCommand(kSceneCommandGround + lod);
+        if (m_terrainLodChunkCount[lod] == 0) {
+            ground->reset();
+            continue;
+        }
+        ground->setRenderPipelineState(m_groundPSO);
+        ground->setVertexBuffer(m_terrainChunkBuffers[m_frameIndex], 0, BufferIndexTerrainChunks);
+        ground->setVertexBuffer(m_uniformBuffers[m_frameIndex], 0, BufferIndexUniforms);
+        ground->setFragmentBuffer(m_uniformBuffers[m_frameIndex], 0, BufferIndexUniforms);
+        ground->setVertexBuffer(m_sceneConstantBuffers[m_frameIndex], 0, BufferIndexSceneConstants);
+        ground->setFragmentBuffer(m_sceneConstantBuffers[m_frameIndex], 0, BufferIndexSceneConstants);
+        ground->setFragmentBuffer(m_pointLightBuffers[m_frameIndex], 0, BufferIndexPointLights);
+        ground->setFragmentBuffer(m_lightClusterBuffer, 0, BufferIndexLightClusters);
+        if (m_sparseGround && m_sparseGround->isValid()) {
+            ground->setFragmentBuffer(m_sparseGround->getUniformBuffer(m_frameIndex), 0, BufferIndexSparseGround);
+            ground->setFragmentBuffer(m_sparseGround->getUniformBuffer(m_frameIndex), m_sparseGround->getResidencyOffset(),
+                                      BufferIndexSparseGroundResidency);
+            ground->setFragmentBuffer(m_sparseGround->getFeedbackBuffer(m_frameIndex), 0, BufferIndexSparseGroundFeedback);
+        }
+        ground->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, m_terrainLodIndexCount[lod], MTL::IndexTypeUInt16,
+                                      m_terrainIndexBuffer, m_terrainLodIndexStart[lod] * sizeof(uint16_t),
+                                      m_terrainLodChunkCount[lod], 0, m_terrainLodFirstChunk[lod]);
+    }
+}
 
-        // Rectangular strip: constant width (or very slight taper if tipWidth < baseWidth)
-        // Since baseWidth == tipWidth, this creates a perfect rectangle
-        float width = baseWidth + (tipWidth - baseWidth) * t; // Linear interpolation (or constant if equal)
-        float halfWidth = width;
+void Renderer::encodeInteractorCommand(MTL::IndirectCommandBuffer* sceneICB)
+{
+    // Like the ground commands: the slot's ICB is not in flight, so its instance count can follow
+    // this frame's interactors
+    MTL::IndirectRenderCommand* ball = sceneICB->indirectRenderCommand(kSceneCommandBall);
+    ball->setRenderPipelineState(m_ballPSO);
+    ball->setVertexBuffer(m_ballVertexBuffer, 0, BufferIndexMeshPositions);
+    ball->setVertexBuffer(m_uniformBuffers[m_frameIndex], 0, BufferIndexUniforms);
+    ball->setVertexBuffer(m_frameInteractorBuffer, 0, BufferIndexInteractors);
+    ball->setFragmentBuffer(m_uniformBuffers[m_frameIndex], 0, BufferIndexUniforms);
+    ball->drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, m_ballIndexCount, MTL::IndexTypeUInt16,
+                                m_ballIndexBuffer, 0, static_cast<NS::UInteger>(m_interactorCount), 0, 0);
+}
 
-        // Reduced height: -0.35 .. +0.35 (30% shorter than original -0.5 .. +0.5)
-        float y = (-0.5f + t * 1.0f) * heightScale;  // Apply height reduction
-        float uvY = 1.0f - t;              // 1 at bottom, 0 at top
+void Renderer::buildTrampleMaps()
+{
+    // Interactors are written by the CPU every frame (one array per in-flight frame), or by the
+    // physics step when it runs; the bodies and the bins are written and read on the GPU only
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_interactorBuffers[i] = m_device->newBuffer(sizeof(Interactor) * MAX_INTERACTORS, MTL::ResourceStorageModeShared);
+        if (!m_interactorBuffers[i]) {
+            std::cerr << "Failed to create interactor buffer" << std::endl;
+        }
+    }
+    // Trample query batches, one pair per in-flight frame (read back by the CPU)
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_trampleQueryPointBuffers[i] = m_device->newBuffer(sizeof(simd::float2) * kTrampleQueryCapacity, MTL::ResourceStorageModeShared);
+        m_trampleQueryResultBuffers[i] = m_device->newBuffer(sizeof(float) * kTrampleQueryCapacity, MTL::ResourceStorageModeShared);
+        if (!m_trampleQueryPointBuffers[i] || !m_trampleQueryResultBuffers[i]) {
+            std::cerr << "Failed to create trample query buffers" << std::endl;
+        }
+    }
+    // Object pick results, one per in-flight frame (read back by the CPU)
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_objectPickResultBuffers[i] = m_device->newBuffer(sizeof(uint32_t) * kObjectPickCapacity, MTL::ResourceStorageModeShared);
+        if (!m_objectPickResultBuffers[i]) {
+            std::cerr << "Failed to create object pick buffer" << std::endl;
+        }
+    }
+    m_interactorBinBuffer = m_device->newBuffer(sizeof(InteractorBin) * INTERACTOR_BIN_GRID * INTERACTOR_BIN_GRID, MTL::ResourceStorageModePrivate);
+    if (!m_interactorBinBuffer) {
+        std::cerr << "Failed to create interactor bin buffer" << std::endl;
+    }
+    m_interactorBodyBuffer = m_device->newBuffer(sizeof(InteractorBody) * MAX_INTERACTORS, MTL::ResourceStorageModePrivate);
+    if (!m_interactorBodyBuffer) {
+        std::cerr << "Failed to create interactor body buffer" << std::endl;
+    }
+    // Summary tiles re-reduced per frame (read back for the trace)
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_trampleTileCountBuffers[i] = m_device->newBuffer(sizeof(uint32_t), MTL::ResourceStorageModeShared);
+        if (!m_trampleTileCountBuffers[i]) {
+            std::cerr << "Failed to create trample tile count buffer" << std::endl;
+            continue;
+        }
+        *static_cast<uint32_t*>(m_trampleTileCountBuffers[i]->contents()) = 0;
+    }
+    
+    // The map itself is resized by the quality settings (setTrampleMapSize)
+    buildTrampleTextures(kTrampleMapSize);
+}
 
-        // Left vertex
-        int leftIndex = row * kGrassVertsPerRow + 0;
-        vertices[leftIndex].position = { -halfWidth, y, 0.0f };
-        vertices[leftIndex].normal   = { 0.0f, 1.0f, 0.0f };
-        vertices[leftIndex].texcoord = { 0.0f, uvY };
+bool Renderer::buildTrampleTextures(int size)
+{
+    // size x size stamp times (R32Float: seconds need more precision than half)
+    // One texture stamped in place: the kernel only writes (access::write), so there is no
+    // ping-pong copy and no dependency on read_write texture support for the format
+    releaseTrampleTextures();
+    
+    MTL::TextureDescriptor* textureDesc = MTL::TextureDescriptor::alloc()->init();
+    textureDesc->setWidth(size);
+    textureDesc->setHeight(size);
+    textureDesc->setPixelFormat(MTL::PixelFormatR32Float);
+    textureDesc->setTextureType(MTL::TextureType2D);
+    // RenderTarget: cleared once with a render pass below
+    textureDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite | MTL::TextureUsageRenderTarget);
+    textureDesc->setStorageMode(MTL::StorageModePrivate);
+    
+    m_trampleMap = m_device->newTexture(textureDesc);
+    textureDesc->release();
+    
+    if (!m_trampleMap) {
+        std::cerr << "Failed to create trample map texture" << std::endl;
+        return false;
+    }
+    
+    // Nothing trampled yet: every texel holds a stamp time far in the past
+    MTL::RenderPassDescriptor* clearPass = MTL::RenderPassDescriptor::renderPassDescriptor();
+    MTL::RenderPassColorAttachmentDescriptor* clearAttachment = clearPass->colorAttachments()->object(0);
+    clearAttachment->setTexture(m_trampleMap);
+    clearAttachment->setLoadAction(MTL::LoadActionClear);
+    clearAttachment->setStoreAction(MTL::StoreActionStore);
+    clearAttachment->setClearColor(MTL::ClearColor(TRAMPLE_NEVER_STAMPED, 0.0, 0.0, 1.0));
+    
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    MTL::RenderCommandEncoder* encoder = commandBuffer->renderCommandEncoder(clearPass);
+    if (encoder) {
+        encoder->endEncoding();
+    }
+    commandBuffer->commit();
+    
+    // Summary pyramid: RG32Float (min, max) stamp time per 32x32-texel tile, then 2x2 per level
+    // down to 1x1. Written only by compute, so its contents start undefined: every tile starts flagged
+    const int summarySize = size / TRAMPLE_SUMMARY_TILE;
+    const int summaryMipCount = static_cast<int>(std::log2(static_cast<double>(summarySize))) + 1;
+    
+    MTL::TextureDescriptor* summaryDesc = MTL::TextureDescriptor::alloc()->init();
+    summaryDesc->setWidth(summarySize);
+    summaryDesc->setHeight(summarySize);
+    summaryDesc->setPixelFormat(MTL::PixelFormatRG32Float);
+    summaryDesc->setTextureType(MTL::TextureType2D);
+    summaryDesc->setMipmapLevelCount(summaryMipCount);
+    summaryDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite | MTL::TextureUsagePixelFormatView);
+    summaryDesc->setStorageMode(MTL::StorageModePrivate);
+    
+    m_trampleSummary = m_device->newTexture(summaryDesc);
+    summaryDesc->release();
+    
+    if (!m_trampleSummary) {
+        std::cerr << "Failed to create trample summary texture" << std::endl;
+        return false;
+    }
+    for (int level = 0; level < summaryMipCount; ++level) {
+        m_trampleSummaryMipViews.push_back(m_trampleSummary->newTextureView(
+            MTL::PixelFormatRG32Float,
+            MTL::TextureType2D,
+            NS::Range::Make(level, 1),
+            NS::Range::Make(0, 1)));
+    }
+    
+    size_t dirtyTileSize = sizeof(uint32_t) * summarySize * summarySize;
+    m_trampleDirtyTileBuffer = m_device->newBuffer(dirtyTileSize, MTL::ResourceStorageModeShared);
+    if (!m_trampleDirtyTileBuffer) {
+        std::cerr << "Failed to create trample dirty tile buffer" << std::endl;
+        return false;
+    }
+    std::fill_n(static_cast<uint32_t*>(m_trampleDirtyTileBuffer->contents()), summarySize * summarySize, 1u);
+    
+    return true;
+}
 
-        // Right vertex
-        int rightIndex = row * kGrassVertsPerRow + 1;
-        vertices[rightIndex].position = { halfWidth, y, 0.0f };
-        vertices[rightIndex].normal   = { 0.0f, 1.0f, 0.0f };
-        vertices[rightIndex].texcoord = { 1.0f, uvY };
+void Renderer::releaseTrampleTextures()
+{
+    // The staging buffer is sized for the map: the next transfer makes a new one
+    for (MTL::Texture* view : m_trampleSummaryMipViews) {
+        if (view) {
+            view->release();
+        }
     }
+    m_trampleSummaryMipViews.clear();
+    if (m_trampleSummary) {
+        m_trampleSummary->release();
+        m_trampleSummary = nullptr;
+    }
+    if (m_trampleMap) {
+        m_trampleMap->release();
+        m_trampleMap = nullptr;
+    }
+    if (m_trampleDirtyTileBuffer) {
+        m_trampleDirtyTileBuffer->release();
+        m_trampleDirtyTileBuffer = nullptr;
+    }
+    if (m_trampleStagingBuffer) {
+        m_trampleStagingBuffer->release();
+        m_trampleStagingBuffer = nullptr;
+    }
+}
 
-    // Create m_vertexBuffer using device->newBuffer with the data size and MTL::ResourceStorageModeShared
-    size_t vertexDataSize = sizeof(vertices);
-    m_vertexBuffer = m_device->newBuffer(vertexDataSize, MTL::ResourceStorageModeShared);
+void Renderer::buildWindField()
+{
+    // Direction and bend strength at two clocks; half precision is plenty for both
+    MTL::TextureDescriptor* windDesc = MTL::TextureDescriptor::alloc()->init();
+    windDesc->setWidth(WIND_FIELD_SIZE);
+    windDesc->setHeight(WIND_FIELD_SIZE);
+    windDesc->setArrayLength(2);
+    windDesc->setPixelFormat(MTL::PixelFormatRGBA16Float);
+    windDesc->setTextureType(MTL::TextureType2DArray);
+    windDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    windDesc->setStorageMode(MTL::StorageModePrivate);
     
-    if (m_vertexBuffer) {
-        // Copy vertex data to buffer
-        void* bufferContents = m_vertexBuffer->contents();
-        memcpy(bufferContents, vertices, vertexDataSize);
-    } else {
-        std::cerr << "Failed to create vertex buffer" << std::endl;
-        return;
+    // Written every frame before any blade samples it, so it needs no initial contents
+    m_windField = m_device->newTexture(windDesc);
+    windDesc->release();
+    
+    if (!m_windField) {
+        std::cerr << "Failed to create wind field texture" << std::endl;
     }
     
-    // Create index buffer for the strip: each vertical segment becomes 2 triangles.
-    // Row r has vertices (Lr, Rr) = (2r, 2r+1)
-    // Row r+1 has (Lr1, Rr1) = (2(r+1), 2(r+1)+1)
-    // Triangles: (Lr, Rr, Lr1) and (Rr, Rr1, Lr1)
-    uint16_t indices[kGrassIndexCount];
+    // Gust particle slots: only slots written by a spawn are ever read, so no initial contents
+    m_windGustBuffer = m_device->newBuffer(sizeof(WindGustParticle) * WIND_MAX_GUST_PARTICLES, MTL::ResourceStorageModePrivate);
+    if (!m_windGustBuffer) {
+        std::cerr << "Failed to create wind gust buffer" << std::endl;
+    }
+    m_windGustLives.assign(WIND_MAX_GUST_PARTICLES, 0.0f);
+}
 
-    int idx = 0;
-    for (int seg = 0; seg < kGrassSegments; ++seg) {
-        uint16_t Lr  = static_cast<uint16_t>(seg * kGrassVertsPerRow + 0);
-        uint16_t Rr  = static_cast<uint16_t>(seg * kGrassVertsPerRow + 1);
-        uint16_t Lr1 = static_cast<uint16_t>((seg + 1) * kGrassVertsPerRow + 0);
-        uint16_t Rr1 = static_cast<uint16_t>((seg + 1) * kGrassVertsPerRow + 1);
+WindGustUniforms Renderer::prepareWindGusts()
+{
+    // The slots age by the frame time on both sides, so the CPU knows when the last one is gone
+    // and the step and the per-texel sum can be skipped. A particle dead this frame still shows
+    // in the previous slice, so it counts once more
+    WindGustUniforms gusts = {};
+    if (!m_uniformBuffer || !m_windGustBuffer) {
+        m_windGustSpawns.clear();
+        return gusts;
+    }
+    const Uniforms* frameUniforms = static_cast<const Uniforms*>(m_uniformBuffer->contents());
+    gusts.deltaTime = std::clamp(frameUniforms->time - frameUniforms->prevTime, 0.0f, SimulationClock::kMaxVariableStep);
+    gusts.bendPerVelocity = kWindBendPerVelocity;
+    bool live = !m_windGustSpawns.empty();
+    for (float& life : m_windGustLives) {
+        live = live || life > 0.0f;
+        if (life > 0.0f) {
+            life -= gusts.deltaTime;
+        }
+    }
+    for (const WindGustSpawn& spawn : m_windGustSpawns) {
+        gusts.spawns[gusts.spawnCount++] = spawn;
+        m_windGustLives[spawn.slot] = spawn.particle.lifetime;
+    }
+    m_windGustSpawns.clear();
+    gusts.particleCount = live ? std::min<uint32_t>(m_windGustSpawned, WIND_MAX_GUST_PARTICLES) : 0;
+    return gusts;
+}
 
-        // First triangle
-        indices[idx++] = Lr;
-        indices[idx++] = Rr;
-        indices[idx++] = Lr1;
+void Renderer::encodeWindGusts(MTL::ComputeCommandEncoder* computeEncoder, const WindGustUniforms& gusts)
+{
+    // Bound for the wind field kernels too, which skip the sum without particles
+    computeEncoder->setBytes(&gusts, sizeof(gusts), WindBufferIndexGustUniforms);
+    computeEncoder->setBuffer(m_windGustBuffer, 0, WindBufferIndexGusts);
+    if (gusts.particleCount > 0) {
+        computeEncoder->setComputePipelineState(m_windGustPSO);
+        m_computeDispatch->dispatch(computeEncoder, m_windGustPSO, MTL::Size(gusts.particleCount, 1, 1));
+    }
+}
 
-        // Second triangle
-        indices[idx++] = Rr;
-        indices[idx++] = Rr1;
-        indices[idx++] = Lr1;
+bool Renderer::buildWindFluid()
+{
+    // Velocities and pressures start at rest; all of them stay on the GPU
+    size_t cellCount = static_cast<size_t>(WIND_FIELD_SIZE) * WIND_FIELD_SIZE;
+    for (int i = 0; i < 2; ++i) {
+        m_windVelocityBuffers[i] = m_device->newBuffer(sizeof(simd::float2) * cellCount, MTL::ResourceStorageModePrivate);
+        m_windPressureBuffers[i] = m_device->newBuffer(sizeof(float) * cellCount, MTL::ResourceStorageModePrivate);
+    }
+    m_windScratchBuffer = m_device->newBuffer(sizeof(simd::float2) * cellCount, MTL::ResourceStorageModePrivate);
+    m_windDivergenceBuffer = m_device->newBuffer(sizeof(float) * cellCount, MTL::ResourceStorageModePrivate);
+    if (!m_windVelocityBuffers[0] || !m_windVelocityBuffers[1] || !m_windPressureBuffers[0] || !m_windPressureBuffers[1] ||
+        !m_windScratchBuffer || !m_windDivergenceBuffer) {
+        std::cerr << "Failed to create wind fluid buffers" << std::endl;
+        return false;
     }
     
-    size_t indexDataSize = sizeof(indices);
-    m_indexBuffer = m_device->newBuffer(indexDataSize, MTL::ResourceStorageModeShared);
-    
-    if (m_indexBuffer) {
-        // Copy index data to buffer
-        void* indexBufferContents = m_indexBuffer->contents();
-        memcpy(indexBufferContents, indices, indexDataSize);
-    } else {
-        std::cerr << "Failed to create index buffer" << std::endl;
+    // Gust emitter arrays, one pair per in-flight frame (written by the CPU, dirty ranges only)
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_windGustPlacementBuffers[i] = m_device->newBuffer(sizeof(WindGustPlacement) * WIND_MAX_GUSTS, MTL::ResourceStorageModeShared);
+        m_windGustFlowBuffers[i] = m_device->newBuffer(sizeof(WindGustFlow) * WIND_MAX_GUSTS, MTL::ResourceStorageModeShared);
+        if (!m_windGustPlacementBuffers[i] || !m_windGustFlowBuffers[i]) {
+            std::cerr << "Failed to create wind gust emitter buffers" << std::endl;
+            return false;
+        }
     }
+    m_windGusts.markAllDirty();
     
-    // Create uniform buffer
-    size_t uniformDataSize = sizeof(Uniforms);
-    m_uniformBuffer = m_device->newBuffer(uniformDataSize, MTL::ResourceStorageModeShared);
-    
-    if (!m_uniformBuffer) {
-        std::cerr << "Failed to create uniform buffer" << std::endl;
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* blitEncoder = commandBuffer->blitCommandEncoder();
+    if (blitEncoder) {
+        for (MTL::Buffer* buffer : { m_windVelocityBuffers[0], m_windVelocityBuffers[1], m_windPressureBuffers[0], m_windPressureBuffers[1] }) {
+            blitEncoder->fillBuffer(buffer, NS::Range::Make(0, buffer->length()), 0);
+        }
+        blitEncoder->endEncoding();
     }
+    commandBuffer->commit();
+    return true;
+}
+
+void Renderer::buildAtmosphereLut()
+{
+    // Smooth in both axes, so half precision and a bilinear lookup are plenty
+    MTL::TextureDescriptor* lutDesc = MTL::TextureDescriptor::alloc()->init();
+    lutDesc->setWidth(ATMOSPHERE_LUT_WIDTH);
+    lutDesc->setHeight(ATMOSPHERE_LUT_HEIGHT);
+    lutDesc->setPixelFormat(MTL::PixelFormatRGBA16Float);
+    lutDesc->setTextureType(MTL::TextureType2D);
+    lutDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    lutDesc->setStorageMode(MTL::StorageModePrivate);
     
-    // Generate ball (sphere) mesh
-    std::vector<Vertex> ballVertices;
-    std::vector<uint16_t> ballIndices;
-    createSphereMesh(0.5f, 64, 32, ballVertices, ballIndices);
-    
-    // Create ball vertex buffer
-    size_t ballVertexDataSize = ballVertices.size() * sizeof(Vertex);
-    m_ballVertexBuffer = m_device->newBuffer(ballVertexDataSize, MTL::ResourceStorageModeShared);
+    // Written by the first frame's atmosphere pass before the sky or the grass sample it
+    m_atmosphereLut = m_device->newTexture(lutDesc);
+    lutDesc->release();
     
-    if (m_ballVertexBuffer) {
-        void* ballBufferContents = m_ballVertexBuffer->contents();
-        memcpy(ballBufferContents, ballVertices.data(), ballVertexDataSize);
-    } else {
-        std::cerr << "Failed to create ball vertex buffer" << std::endl;
+    if (!m_atmosphereLut) {
+        std::cerr << "Failed to create atmosphere LUT" << std::endl;
+    }
+}
+
+void Renderer::buildLightClusters()
+{
+    // Light lists are rewritten by the CPU every frame, one copy per frame in flight
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_pointLightBuffers[i] = m_device->newBuffer(sizeof(PointLight) * MAX_POINT_LIGHTS, MTL::ResourceStorageModeShared);
+        if (!m_pointLightBuffers[i]) {
+            std::cerr << "Failed to create point light buffer" << std::endl;
+        }
+    }
+    // Rebuilt by the light cluster pass before the scene reads it, one grid per view
+    m_lightClusterBuffer = m_device->newBuffer(sizeof(LightCluster) * LIGHT_CLUSTER_COUNT * MAX_RENDER_VIEWS, MTL::ResourceStorageModePrivate);
+    if (!m_lightClusterBuffer) {
+        std::cerr << "Failed to create light cluster buffer" << std::endl;
+    }
+}
+
+bool Renderer::buildVisibleInstanceBuffer()
+{
+    // Visible instance list: one region per species and LOD bucket, each sized for the worst case (everything
+    // visible at the instance capacity), and one more after them seeded with the identity mapping (read by the
+    // CPU-culled and direct draws, which the cull pass never overwrites). Only the GPU reads and writes it
+    // after the seed, so it lives in private memory and the seed goes through the staging ring.
+    size_t visibleDataSize = sizeof(VisibleInstance) * m_grassInstanceCapacity * (GRASS_DRAW_BUCKET_COUNT + 1);
+    m_visibleInstanceBuffer = m_bufferHeap->newBuffer(visibleDataSize);
+    if (!m_visibleInstanceBuffer) {
+        std::cerr << "Failed to create visible instance buffer" << std::endl;
+        return false;
     }
     
-    // Create ball index buffer
-    m_ballIndexCount = ballIndices.size();
-    size_t ballIndexDataSize = ballIndices.size() * sizeof(uint16_t);
-    m_ballIndexBuffer = m_device->newBuffer(ballIndexDataSize, MTL::ResourceStorageModeShared);
+    std::vector<VisibleInstance> identity(m_grassInstanceCapacity);
+    for (uint32_t i = 0; i < m_grassInstanceCapacity; ++i) {
+        identity[i].instanceID = i;
+        identity[i].lodFade = 1.0f;
+        identity[i].viewMask = ~0u;
+    }
+    MTL::CommandBuffer* uploadCommandBuffer = newOutOfGraphCommandBuffer();
+    MTL::BlitCommandEncoder* uploadEncoder = uploadCommandBuffer->blitCommandEncoder();
+    m_uploadRing->uploadBuffer(uploadEncoder, m_visibleInstanceBuffer, sizeof(VisibleInstance) * identityVisibleBase(),
+                               identity.data(), identity.size() * sizeof(VisibleInstance));
+    uploadEncoder->endEncoding();
+    m_uploadRing->commit(uploadCommandBuffer);
+    uploadCommandBuffer->commit();
+    return true;
+}
+
+bool Renderer::ensureGrassInstanceCapacity(uint32_t count)
+{
+    if (count <= m_grassInstanceCapacity) {
+        return true;
+    }
     
-    if (m_ballIndexBuffer) {
-        void* ballIndexBufferContents = m_ballIndexBuffer->contents();
-        memcpy(ballIndexBufferContents, ballIndices.data(), ballIndexDataSize);
-    } else {
-        std::cerr << "Failed to create ball index buffer" << std::endl;
+    // Frames in flight index the current lists; blade states restart at rest in the larger buffer
+    waitUntilIdle();
+    uint32_t previousCapacity = m_grassInstanceCapacity;
+    if (m_visibleInstanceBuffer) {
+        m_bufferHeap->release(m_visibleInstanceBuffer);
+        m_visibleInstanceBuffer = nullptr;
+    }
+    m_grassInstanceCapacity = count;
+    if (!buildVisibleInstanceBuffer()) {
+        m_grassInstanceCapacity = previousCapacity;
+        buildVisibleInstanceBuffer();
+        return false;
     }
+    if (m_bladeStateBuffer) {
+        m_bladeStateBuffer->release();
+        m_bladeStateBuffer = nullptr;
+        float radius = m_bladePhysicsRadius;
+        m_bladePhysicsRadius = 0.0f;
+        setBladePhysics(radius);
+    }
+    std::cout << "Grass instance capacity: " << previousCapacity << " -> " << count << " blades" << std::endl;
+    return true;
 }
 
-void Renderer::buildInstanceBuffer()
+void Renderer::buildCullingBuffers()
 {
-    const int instanceCount = 30000;  // High density for lush Ghibli look in compact 30x30 area
+    buildVisibleInstanceBuffer();
     
-    // Initialize random number generator
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    // Use SCENE_SIZE to match ground plane dimensions
-    // Grass positions range from -SCENE_SIZE to +SCENE_SIZE
-    std::uniform_real_distribution<float> posDist(-SCENE_SIZE, SCENE_SIZE);
-    std::uniform_real_distribution<float> rotDist(0.0f, 360.0f);
-    std::uniform_real_distribution<float> scaleDist(0.8f, 1.2f);
+    // Shared per-frame copies of the draw arguments (overlay statistics)
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_cullStatsBuffers[i] = m_device->newBuffer(sizeof(GrassDrawArguments) * GRASS_DRAW_BUCKET_COUNT, MTL::ResourceStorageModeShared);
+    }
     
-    // Generate 10,000 InstanceData structs
-    InstanceData instances[instanceCount];
+    // Indirect draw arguments, one per bucket (GPU-only, written by the cull pass every frame)
+    m_grassDrawArgsBuffer = m_device->newBuffer(sizeof(GrassDrawArguments) * GRASS_DRAW_BUCKET_COUNT, MTL::ResourceStorageModePrivate);
     
-    for (int i = 0; i < instanceCount; ++i) {
-        // Position: Random x and z within scene bounds (from -SCENE_SIZE to +SCENE_SIZE). y is 0.
-        float x = posDist(gen);
-        float z = posDist(gen);
-        float y = 0.0f;
-        
-        // Rotation: Random rotation around Y-axis (0 to 360 degrees)
-        float rotationY = glm::radians(rotDist(gen));
-        
-        // Scale: Random scale between 0.8 and 1.2 for variety
-        float scale = scaleDist(gen);
-        
-        // Construct a float4x4 model matrix from these transform values (Translate * Rotate * Scale)
-        // Using GLM for matrix math
-        glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z));
-        glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), rotationY, glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 scaling = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale));
-        
-        // Combine: Translate * Rotate * Scale
-        glm::mat4 modelMatrix = translation * rotation * scaling;
-        
-        // Convert GLM matrix to simd::float4x4
-        simd::float4x4 simdMatrix;
-        const float* glmData = glm::value_ptr(modelMatrix);
-        simdMatrix.columns[0] = simd::float4{glmData[0], glmData[1], glmData[2], glmData[3]};
-        simdMatrix.columns[1] = simd::float4{glmData[4], glmData[5], glmData[6], glmData[7]};
-        simdMatrix.columns[2] = simd::float4{glmData[8], glmData[9], glmData[10], glmData[11]};
-        simdMatrix.columns[3] = simd::float4{glmData[12], glmData[13], glmData[14], glmData[15]};
-        
-        instances[i].modelMatrix = simdMatrix;
+    if (!m_grassDrawArgsBuffer) {
+        std::cerr << "Failed to create grass draw arguments buffer" << std::endl;
     }
     
-    // Create m_instanceBuffer (MTL::Buffer) and copy data to it
-    size_t instanceDataSize = sizeof(instances);
-    m_instanceBuffer = m_device->newBuffer(instanceDataSize, MTL::ResourceStorageModeShared);
+    // Front-to-back cull order, rewritten by the sort kernel every frame
+    m_cellOrderBuffer = m_device->newBuffer(sizeof(uint32_t) * GRASS_CELL_SORT_CAPACITY, MTL::ResourceStorageModePrivate);
     
-    if (m_instanceBuffer) {
-        // Copy instance data to buffer
-        void* instanceBufferContents = m_instanceBuffer->contents();
-        memcpy(instanceBufferContents, instances, instanceDataSize);
-    } else {
-        std::cerr << "Failed to create instance buffer" << std::endl;
+    if (!m_cellOrderBuffer) {
+        std::cerr << "Failed to create grass cell order buffer" << std::endl;
     }
-}
-
-void Renderer::resize(int width, int height)
-{
-    // Update metal layer drawable size
-    m_metalLayer->setDrawableSize(CGSizeMake(static_cast<CGFloat>(width), static_cast<CGFloat>(height)));
     
-    // Release old textures
-    if (m_depthTexture) {
-        m_depthTexture->release();
-        m_depthTexture = nullptr;
+    // Bindless grass resource tables: GPU addresses and texture IDs in a plain buffer need tier 2
+    // argument buffers
+    if (m_device->argumentBuffersSupport() < MTL::ArgumentBuffersTier2) {
+        std::cerr << "Warning: the grass resource table needs tier 2 argument buffers" << std::endl;
     }
-    if (m_msaaColorTexture) {
-        m_msaaColorTexture->release();
-        m_msaaColorTexture = nullptr;
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        m_grassResourceTables[i] = m_device->newBuffer(sizeof(GrassResourceTable), MTL::ResourceStorageModeShared);
+        if (!m_grassResourceTables[i]) {
+            std::cerr << "Failed to create grass resource table" << std::endl;
+        }
     }
-    if (m_msaaDepthTexture) {
-        m_msaaDepthTexture->release();
-        m_msaaDepthTexture = nullptr;
+}
+
+void Renderer::buildImpostors()
+{
+    if (!m_grassField) {
+        return;
     }
     
-    // Create MSAA Color Texture (4x multisample)
-    MTL::TextureDescriptor* msaaColorDescriptor = MTL::TextureDescriptor::alloc()->init();
-    msaaColorDescriptor->setWidth(width);
-    msaaColorDescriptor->setHeight(height);
-    msaaColorDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    msaaColorDescriptor->setTextureType(MTL::TextureType2DMultisample);
-    msaaColorDescriptor->setSampleCount(4);
-    msaaColorDescriptor->setUsage(MTL::TextureUsageRenderTarget);
-    msaaColorDescriptor->setStorageMode(MTL::StorageModePrivate);
+    // One card per cell at most; draw arguments reset and counted by the cull pass
+    m_impostorBuffer = m_device->newBuffer(sizeof(GrassImpostor) * m_grassField->getCellCount(), MTL::ResourceStorageModePrivate);
+    m_impostorDrawArgsBuffer = m_device->newBuffer(sizeof(GrassImpostorDrawArguments), MTL::ResourceStorageModePrivate);
     
-    m_msaaColorTexture = m_device->newTexture(msaaColorDescriptor);
-    if (!m_msaaColorTexture) {
-        std::cerr << "Failed to create MSAA color texture" << std::endl;
+    if (!m_impostorBuffer || !m_impostorDrawArgsBuffer) {
+        std::cerr << "Failed to create grass impostor buffers" << std::endl;
+        return;
     }
-    msaaColorDescriptor->release();
     
-    // Create MSAA Depth Texture (4x multisample)
-    MTL::TextureDescriptor* msaaDepthDescriptor = MTL::TextureDescriptor::alloc()->init();
-    msaaDepthDescriptor->setWidth(width);
-    msaaDepthDescriptor->setHeight(height);
-    msaaDepthDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
-    msaaDepthDescriptor->setTextureType(MTL::TextureType2DMultisample);
-    msaaDepthDescriptor->setSampleCount(4);
-    msaaDepthDescriptor->setUsage(MTL::TextureUsageRenderTarget);
-    msaaDepthDescriptor->setStorageMode(MTL::StorageModePrivate);
-    
-    m_msaaDepthTexture = m_device->newTexture(msaaDepthDescriptor);
-    if (!m_msaaDepthTexture) {
-        std::cerr << "Failed to create MSAA depth texture" << std::endl;
+    MTL::Library* library = m_device->newDefaultLibrary();
+    if (!library) {
+        std::cerr << "Failed to load default Metal library" << std::endl;
+        return;
     }
-    msaaDepthDescriptor->release();
+    m_impostorAtlas = new GrassImpostorAtlas(m_device, library, m_pipelineArchive, m_grassField->getCellSize());
+    library->release();
     
-    // Create resolve Depth Texture (non-multisample, for resolve target)
-    MTL::TextureDescriptor* depthDescriptor = MTL::TextureDescriptor::alloc()->init();
-    depthDescriptor->setWidth(width);
-    depthDescriptor->setHeight(height);
-    depthDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
-    depthDescriptor->setTextureType(MTL::TextureType2D);
-    depthDescriptor->setUsage(MTL::TextureUsageRenderTarget);
-    depthDescriptor->setStorageMode(MTL::StorageModePrivate);
+    bakeGrassImpostors();
+}
+
+void Renderer::buildShadowMaps()
+{
+    m_shadowMaps = new ShadowMaps(m_device);
+    if (!m_shadowMaps->isValid()) {
+        delete m_shadowMaps;
+        m_shadowMaps = nullptr;
+        return;
+    }
     
-    m_depthTexture = m_device->newTexture(depthDescriptor);
-    if (!m_depthTexture) {
-        std::cerr << "Failed to create depth texture" << std::endl;
+    // Depth only (no fragment stage), drawn directly rather than from the ICBs
+    PipelineKey casterKey;
+    casterKey.colorFormat = MTL::PixelFormatInvalid;
+    casterKey.depthFormat = ShadowMaps::kDepthFormat;
+    casterKey.supportIndirectCommandBuffers = false;
+    m_grassShadowPipelineKey = casterKey;
+    m_grassShadowPipelineKey.vertexFunction = "grassShadowVertex";
+    m_terrainShadowPipelineKey = casterKey;
+    m_terrainShadowPipelineKey.vertexFunction = "groundShadowVertex";
+    m_interactorShadowPipelineKey = casterKey;
+    m_interactorShadowPipelineKey.vertexFunction = "interactorShadowVertex";
+    for (const PipelineKey* key : { &m_grassShadowPipelineKey, &m_terrainShadowPipelineKey, &m_interactorShadowPipelineKey }) {
+        m_pipelineCache->get(*key);
     }
-    depthDescriptor->release();
 }
 
-void Renderer::buildTextures()
+void Renderer::bakeGrassImpostors()
 {
-    // Create m_texture instance (grass)
-    // Note: Make sure to check path. Since we copy assets to bin, relative path "assets/grass_albedo.png" should work.
-    try {
-        m_texture = new Texture(m_device, m_commandQueue, "assets/grass_albedo.png");
-        std::cout << "Successfully loaded grass texture" << std::endl;
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to load grass texture: " << e.what() << std::endl;
-        m_texture = nullptr;
+    if (!m_impostorAtlas || !m_impostorAtlas->isValid() || !m_grassField || !m_instanceBuffer || !m_grassAlbedoArray) {
+        return;
     }
     
-    // Create m_groundTexture instance (ground)
-    // Try PNG first, then JPG as fallback
-    try {
-        m_groundTexture = new Texture(m_device, m_commandQueue, "assets/ground_albedo.png");
-        std::cout << "Successfully loaded ground texture (PNG)" << std::endl;
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to load ground texture (PNG): " << e.what() << std::endl;
-        try {
-            m_groundTexture = new Texture(m_device, m_commandQueue, "assets/ground_albedo.jpg");
-            std::cout << "Successfully loaded ground texture (JPG)" << std::endl;
-        } catch (const std::exception& e2) {
-            std::cerr << "Failed to load ground texture (JPG): " << e2.what() << std::endl;
-            m_groundTexture = nullptr;
+    GrassImpostorAtlas::BakeSource source;
+    source.vertexBuffer = m_vertexBuffer;
+    source.indexBuffer = m_indexBuffer;
+    source.indexCount = m_grassBucketIndexCount[0];
+    source.indexStart = m_grassBucketIndexStart[0];
+    source.baseVertex = m_grassBucketBaseVertex[0];
+    source.instanceBuffer = m_instanceBuffer;
+    source.bladeTexture = m_grassAlbedoArray;
+    source.trampleMap = m_trampleMap;
+    source.fieldMinXZ = simd::make_float2(-SCENE_SIZE, -SCENE_SIZE);
+    source.fieldMaxXZ = simd::make_float2(SCENE_SIZE, SCENE_SIZE);
+    
+    // Patches from cells spread across the field; GPU-generated cells hold a fixed slot range (the
+    // slots the density mask left empty are zero-scale blades), the CPU fallback keeps its cells on the host, a mapped field reads its cell index
+    // and an edited field its slack layout
+    int cellsPerSide = m_grassField->getCellsPerSide();
+    float cellSize = m_grassField->getCellSize();
+    const std::vector<GrassCell>& cells = m_grassField->getCells();
+    for (int variant = 0; variant < IMPOSTOR_VARIANT_COUNT; ++variant) {
+        int cell = impostorSourceCell(variant);
+        if (m_grassEditor) {
+            source.firstInstance[variant] = m_grassEditor->getCells()[cell].firstInstance;
+            source.instanceCount[variant] = m_grassEditor->getCells()[cell].instanceCount;
+        } else if (m_instanceFile) {
+            source.firstInstance[variant] = m_instanceFile->getCells()[cell].firstInstance;
+            source.instanceCount[variant] = m_instanceFile->getCells()[cell].instanceCount;
+        } else if (cells.empty()) {
+            source.firstInstance[variant] = static_cast<uint32_t>(cell * m_grassBladesPerCell);
+            source.instanceCount[variant] = static_cast<uint32_t>(m_grassBladesPerCell);
+        } else {
+            source.firstInstance[variant] = cells[cell].firstInstance;
+            source.instanceCount[variant] = cells[cell].instanceCount;
         }
+        // Same center as the cell bounds the cull pass places the card at
+        simd::float2 heightRange = m_terrain->heightRange((cell % cellsPerSide) * TERRAIN_CHUNK_QUADS,
+                                                          (cell / cellsPerSide) * TERRAIN_CHUNK_QUADS, TERRAIN_CHUNK_QUADS);
+        source.center[variant] = simd::make_float3(-SCENE_SIZE + (static_cast<float>(cell % cellsPerSide) + 0.5f) * cellSize,
+                                                   0.5f * (heightRange.x + heightRange.y) + GRASS_INSTANCE_ELEVATION,
+                                                   -SCENE_SIZE + (static_cast<float>(cell / cellsPerSide) + 0.5f) * cellSize);
     }
+    
+    // Own command buffer, after the generation dispatch that wrote the instances
+    MTL::CommandBuffer* commandBuffer = newOutOfGraphCommandBuffer();
+    m_impostorAtlas->encodeBake(commandBuffer, source);
+    commandBuffer->commit();
 }
 
-void Renderer::buildGround()
+int Renderer::impostorSourceCell(int variant) const
+{
+    return (2 * variant + 1) * m_grassField->getCellCount() / (2 * IMPOSTOR_VARIANT_COUNT);
+}
+
+void Renderer::setGrassSeason(float season)
+{
+    // Baked now; each frame slot uploads it once its previous frame is done with the old copy
+    m_grassPalette->setSeason(season);
+}
+
+float Renderer::getGrassSeason() const
+{
+    return m_grassPalette->getSeason();
+}
+
+void Renderer::setGrassImpostors(bool enabled, float distance)
+{
+    m_impostorsEnabled = enabled;
+    m_impostorDistance = std::max(distance, m_impostorFadeWidth * 0.5f);
+}
+
+void Renderer::setSparseGroundTexture(bool enabled)
 {
-    // Define vertices for a large quad (Plane) centered at (0,0,0)
-    // Size: Uses SCENE_SIZE constant (From -SCENE_SIZE to +SCENE_SIZE)
-    // Y-Position: -0.5f (Slightly below the grass roots so grass sticks into it)
-    // Normals: Point Straight Up (0, 1, 0)
-    // UVs: Scale them! Instead of 0..1, use 0..20.0f. This will tile the texture 20 times.
+    // Heap and texture are created on first use (a fixed SPARSE_GROUND_SIZE texture, budget-bound pages)
+    if (enabled && !m_sparseGround && SparseGroundTexture::isSupported(m_device)) {
+        MTL::Library* library = m_device->newDefaultLibrary();
+        if (library) {
+            m_sparseGround = new SparseGroundTexture(m_device, library, m_pipelineArchive, m_computeDispatch,
+                                                     kMaxFramesInFlight, kSparseGroundBudgetBytes);
+            library->release();
+        } else {
+            std::cerr << "Failed to load default Metal library" << std::endl;
+        }
+    }
+    if (enabled && !(m_sparseGround && m_sparseGround->isValid())) {
+        std::cerr << "Sparse ground texture not supported on this device" << std::endl;
+        enabled = false;
+    }
+    if (enabled == m_sparseGroundEnabled) {
+        return;
+    }
     
-    // Use 6 vertices (2 triangles) directly to avoid managing a separate index buffer for the ground
-    Vertex groundVertices[6] = {
-        // First triangle
-        { {-SCENE_SIZE, -0.5f, -SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {0.0f, 20.0f} },   // Bottom-Left
-        { { SCENE_SIZE, -0.5f, -SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {20.0f, 20.0f} },  // Bottom-Right
-        { {-SCENE_SIZE, -0.5f,  SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f} },   // Top-Left
-        
-        // Second triangle
-        { { SCENE_SIZE, -0.5f, -SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {20.0f, 20.0f} },  // Bottom-Right
-        { { SCENE_SIZE, -0.5f,  SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {20.0f, 0.0f} },   // Top-Right
-        { {-SCENE_SIZE, -0.5f,  SCENE_SIZE}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f} }     // Top-Left
-    };
+    m_sparseGroundEnabled = enabled;
+    updateShadingPipelineKeys();
     
-    // Create m_groundVertexBuffer with this data
-    size_t groundVertexDataSize = sizeof(groundVertices);
-    m_groundVertexBuffer = m_device->newBuffer(groundVertexDataSize, MTL::ResourceStorageModeShared);
+    // Drawn through the scene ICBs: swapped in with a full hot swap once built
+    const ScenePipelineKeys& keys = m_temporalRequested ? m_temporalPipelineKeys : m_msaaPipelineKeys;
+    m_pipelineCache->get(keys.ground);
+    std::cout << "Sparse ground texture: " << (enabled ? "ON" : "OFF") << std::endl;
+}
+
+size_t Renderer::getSparseGroundResidentBytes() const
+{
+    return m_sparseGround ? m_sparseGround->getResidentBytes() : 0;
+}
+
+void Renderer::encodeSceneICBs()
+{
+    // Re-encoded after shader reloads: drop the ICBs that point at the old pipelines
+    for (int i = 0; i < kMaxFramesInFlight; ++i) {
+        if (m_sceneICBs[i]) {
+            m_sceneICBs[i]->release();
+            m_sceneICBs[i] = nullptr;
+        }
+    }
     
-    if (m_groundVertexBuffer) {
-        // Copy vertex data to buffer
-        void* bufferContents = m_groundVertexBuffer->contents();
-        memcpy(bufferContents, groundVertices, groundVertexDataSize);
-    } else {
-        std::cerr << "Failed to create ground vertex buffer" << std::endl;
+    // Static passes: sky (0), ground (one per terrain LOD), ball. Every command sets its own pipeline and
+    // buffers, so one ICB is encoded per uniform ring slot and only touched again when a pipeline
+    // changes; the ground commands are the exception and follow each frame's chunk LODs
+    // (encodeTerrainCommands).
+    if (m_skyPSO && m_groundPSO && m_ballPSO && m_terrainIndexBuffer && m_groundTexture && m_groundTexture->getMetalTexture() &&
+        m_ballVertexBuffer && m_ballIndexBuffer && m_ballIndexCount > 0) {
+        MTL::IndirectCommandBufferDescriptor* sceneDescriptor = MTL::IndirectCommandBufferDescriptor::alloc()->init();
+        sceneDescriptor->setCommandTypes(MTL::IndirectCommandTypeDraw | MTL::IndirectCommandTypeDrawIndexed);
+        sceneDescriptor->setInheritPipelineState(false);
+        sceneDescriptor->setInheritBuffers(false);
+        sceneDescriptor->setMaxVertexBufferBindCount(BufferIndexSceneConstants + 1);
+        sceneDescriptor->setMaxFragmentBufferBindCount(BufferIndexLightClusters + 1); // Ground: uniforms, scene constants, point lights and the sparse texture buffers
+        
+        for (int i = 0; i < kMaxFramesInFlight; ++i) {
+            if (!m_uniformBuffers[i]) {
+                continue;
+            }
+            
+            m_sceneICBs[i] = m_device->newIndirectCommandBuffer(sceneDescriptor, kSceneCommandBall + 1, MTL::ResourceStorageModePrivate);
+            if (!m_sceneICBs[i]) {
+                std::cerr << "Failed to create scene indirect command buffer" << std::endl;
+                continue;
+            }
+            
+            // Sky: command 0, executed after the ball (see the scene pass)
+            MTL::IndirectRenderCommand* sky = m_sceneICBs[i]->indirectRenderCommand(0);
+            sky->setRenderPipelineState(m_skyPSO);
+            sky->setVertexBuffer(m_uniformBuffers[i], 0, BufferIndexUniforms);
+            sky->setFragmentBuffer(m_uniformBuffers[i], 0, BufferIndexUniforms);
+            sky->drawPrimitives(MTL::PrimitiveTypeTriangle, 0, 3, 1, 0);
+            
+            // Ground commands start empty until a frame lists its chunks
+            for (int lod = 0; lod < TERRAIN_LOD_COUNT; ++lod) {
+                m_sceneICBs[i]->indirectRenderCommand(kSceneCommandGround + lod)->reset();
+            }
+            
+            // The interactor command follows each frame's interactor count (encodeInteractorCommand)
+            m_sceneICBs[i]->indirectRenderCommand(kSceneCommandBall)->reset();
+        }
+        
+        sceneDescriptor->release();
     }
 }
 
-void Renderer::buildTrampleMaps()
+void Renderer::buildIndirectCommandBuffers()
 {
-    // Create 1024x1024 single-channel textures for ping-pong trample map
-    const int trampleMapSize = 1024;
+    encodeSceneICBs();
     
-    MTL::TextureDescriptor* textureDesc = MTL::TextureDescriptor::alloc()->init();
-    textureDesc->setWidth(trampleMapSize);
-    textureDesc->setHeight(trampleMapSize);
-    textureDesc->setPixelFormat(MTL::PixelFormatR16Float);
-    textureDesc->setTextureType(MTL::TextureType2D);
-    textureDesc->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
-    textureDesc->setStorageMode(MTL::StorageModePrivate);
+    // Grass: one indexed draw per species and LOD, written by encodeGrassDrawCommands once the cull pass has
+    // produced the instance counts. Pipeline and buffers are inherited from the render encoder.
+    if (!m_encodeGrassCommandsPSO || !m_indexBuffer) {
+        return;
+    }
+    
+    MTL::IndirectCommandBufferDescriptor* grassDescriptor = MTL::IndirectCommandBufferDescriptor::alloc()->init();
+    grassDescriptor->setCommandTypes(MTL::IndirectCommandTypeDrawIndexed);
+    grassDescriptor->setInheritPipelineState(true);
+    grassDescriptor->setInheritBuffers(true);
     
-    // Create ping-pong textures
-    m_trampleMapA = m_device->newTexture(textureDesc);
-    m_trampleMapB = m_device->newTexture(textureDesc);
+    m_grassICB = m_device->newIndirectCommandBuffer(grassDescriptor, GRASS_DRAW_BUCKET_COUNT, MTL::ResourceStorageModePrivate);
+    grassDescriptor->release();
     
-    if (!m_trampleMapA || !m_trampleMapB) {
-        std::cerr << "Failed to create trample map textures" << std::endl;
+    if (!m_grassICB) {
+        std::cerr << "Failed to create grass indirect command buffer" << std::endl;
+        return;
     }
     
-    // Initialize both textures to zero (no trampling initially)
-    // We'll need to clear them using a compute shader or render pass
-    // For now, they start at zero by default
+    // Argument buffer so the kernel can address the ICB
+    MTL::Library* library = m_device->newDefaultLibrary();
+    if (!library) {
+        return;
+    }
+    NS::String* functionName = NS::String::string("encodeGrassDrawCommands", NS::ASCIIStringEncoding);
+    MTL::Function* function = library->newFunction(functionName);
+    if (function) {
+        MTL::ArgumentEncoder* argumentEncoder = function->newArgumentEncoder(CullBufferIndexGrassCommands);
+        m_grassICBArgumentBuffer = m_device->newBuffer(argumentEncoder->encodedLength(), MTL::ResourceStorageModeShared);
+        if (m_grassICBArgumentBuffer) {
+            argumentEncoder->setArgumentBuffer(m_grassICBArgumentBuffer, 0);
+            argumentEncoder->setIndirectCommandBuffer(m_grassICB, 0);
+        } else {
+            std::cerr << "Failed to create grass ICB argument buffer" << std::endl;
+        }
+        argumentEncoder->release();
+        function->release();
+    }
+    library->release();
     
-    textureDesc->release();
+    // Without the argument buffer the GPU cannot encode; fall back to plain indirect draws
+    if (!m_grassICBArgumentBuffer) {
+        m_grassICB->release();
+        m_grassICB = nullptr;
+    }
 }
 
 void Renderer::createSphereMesh(float radius, int radialSegments, int verticalSegments,
@@ -1170,36 +7811,353 @@ void Renderer::createSphereMesh(float radius, int radialSegments, int verticalSe
 
 void Renderer::update(GLFWwindow* window, float deltaTime)
 {
-    if (!window || !m_camera) {
+    if (!window) {
+        return;
+    }
+    update(FramePacket::sample(window), deltaTime);
+    applyWindowState();
+}
+
+void Renderer::setInputLatch(InputLatch latch)
+{
+    m_inputLatch = latch;
+    m_lastCameraUpdateNs = 0;
+}
+
+void Renderer::applyWindowState()
+{
+    if (m_overlay) {
+        m_overlay->applyCursorMode();
+    }
+}
+
+void Renderer::update(const FramePacket& input, float deltaTime)
+{
+    if (!m_camera) {
         return;
     }
     
-    // Handle keyboard input (WASD)
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        m_camera->processKeyboard('W', deltaTime);
+    TraceRecorder::Scope updateScope(m_trace, "Update");
+    if (m_inputRecording) {
+        // Without its own toggle key, so the replay does not start a recording of its own
+        FramePacket recorded = input;
+        recorded.keys.reset(GLFW_KEY_F10);
+        m_inputRecording->record(recorded, deltaTime, sceneTime());
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        m_camera->processKeyboard('S', deltaTime);
+    m_cpuFrameMs = deltaTime * 1000.0f;
+    m_inputActive = input.keys.any() || input.mouseButtons[0] || input.mouseButtons[1] || input.mouseButtons[2] ||
+                    input.cursorX != m_idleCursorX || input.cursorY != m_idleCursorY;
+    m_idleCursorX = input.cursorX;
+    m_idleCursorY = input.cursorY;
+    if (m_overlay) {
+        m_overlay->setInput(input, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        m_camera->processKeyboard('A', deltaTime);
+    
+    // Toggle overlay interaction (F1): frees the cursor and pauses mouse look
+    bool currentF1KeyState = input.keyDown(GLFW_KEY_F1);
+    if (m_overlay && currentF1KeyState && !m_prevF1KeyState) {
+        m_overlay->setInteractive(!m_overlay->isInteractive());
+        m_firstMouse = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        m_camera->processKeyboard('D', deltaTime);
+    m_prevF1KeyState = currentF1KeyState;
+    
+    // Camera motion, unless draw() latches it later
+    if (!m_inputLatch) {
+        updateCamera(input, deltaTime);
     }
     
+    // Pause the scene clock (Z key): freezes the idle frames too
+    bool currentZKeyState = input.keyDown(GLFW_KEY_Z);
+    if (currentZKeyState && !m_prevZKeyState) {
+        setScenePaused(!m_scenePaused);
+        std::cout << "Scene clock: " << (m_scenePaused ? "PAUSED" : "RUNNING") << std::endl;
+    }
+    m_prevZKeyState = currentZKeyState;
+    
     // Toggle trample map visualization (T key)
-    bool currentTKeyState = (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS);
+    bool currentTKeyState = input.keyDown(GLFW_KEY_T);
     if (currentTKeyState && !m_prevTKeyState) {
         // T key was just pressed (toggle)
         m_showTrampleMap = !m_showTrampleMap;
+        updateGrassPermutation();
         std::cout << "Trample map visualization: " << (m_showTrampleMap ? "ON" : "OFF") << std::endl;
     }
     m_prevTKeyState = currentTKeyState;
     
-    // Handle mouse movement
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
+    // Toggle parallel scene encoding (E key)
+    bool currentEKeyState = input.keyDown(GLFW_KEY_E);
+    if (currentEKeyState && !m_prevEKeyState) {
+        setParallelEncoding(!m_parallelEncoding);
+        std::cout << "Parallel encoding: " << (m_parallelEncoding ? "ON" : "OFF") << std::endl;
+    }
+    m_prevEKeyState = currentEKeyState;
+    
+    // Toggle CPU cell culling (X key)
+    bool currentXKeyState = input.keyDown(GLFW_KEY_X);
+    if (currentXKeyState && !m_prevXKeyState) {
+        setCpuCellCulling(!m_cpuCellCulling);
+        std::cout << "CPU cell culling: " << (m_cpuCellCulling ? "ON" : "OFF") << std::endl;
+    }
+    m_prevXKeyState = currentXKeyState;
+    
+    // Toggle the wind fluid (K key); J blows a gust from the camera along its view: into the
+    // fluid when it runs, otherwise as gust particles that travel downwind and fade
+    bool currentKKeyState = input.keyDown(GLFW_KEY_K);
+    if (currentKKeyState && !m_prevKKeyState && setWindFluid(!m_windFluidEnabled)) {
+        std::cout << "Wind fluid: " << (m_windFluidEnabled ? "ON" : "OFF") << std::endl;
+    }
+    m_prevKKeyState = currentKKeyState;
+    if (input.keyDown(GLFW_KEY_J)) {
+        glm::vec2 forward = glm::normalize(glm::vec2(m_camera->front.x, m_camera->front.z) + glm::vec2(1e-4f, 0.0f));
+        glm::vec2 origin = glm::vec2(m_camera->position.x, m_camera->position.z) + forward * 2.0f;
+        if (m_windFluidEnabled) {
+            addWindGust(simd::make_float2(origin.x, origin.y), simd::make_float2(forward.x, forward.y) * 6.0f, 2.5f, 0.1f);
+        } else {
+            WindGustParticle gust = {};
+            gust.position = simd::make_float2(origin.x, origin.y);
+            gust.drift = simd::make_float2(forward.x, forward.y) * 8.0f;
+            gust.wind = simd::make_float2(forward.x, forward.y) * 6.0f;
+            gust.radius = 2.5f;
+            gust.growth = 1.5f;
+            gust.drag = 0.8f;
+            gust.lifetime = 1.5f;
+            spawnWindGust(gust);
+        }
+    }
+    
+    // Toggle GPU interactor physics (P key): the stand-ins respawn as falling rigid bodies
+    bool currentPKeyState = input.keyDown(GLFW_KEY_P);
+    if (currentPKeyState && !m_prevPKeyState) {
+        setInteractorPhysics(!m_interactorPhysicsEnabled);
+        std::cout << "Interactor physics: " << (m_interactorPhysicsEnabled ? "ON" : "OFF") << std::endl;
+    }
+    m_prevPKeyState = currentPKeyState;
+    
+    // Toggle indirect command buffer encoding (I key)
+    bool currentIKeyState = input.keyDown(GLFW_KEY_I);
+    if (currentIKeyState && !m_prevIKeyState) {
+        m_useIndirectCommandBuffers = !m_useIndirectCommandBuffers;
+        std::cout << "Indirect command buffers: " << (m_useIndirectCommandBuffers ? "ON" : "OFF") << std::endl;
+    }
+    m_prevIKeyState = currentIKeyState;
+    
+    // Dynamic resolution with MetalFX upscaling (U key)
+    bool currentUKeyState = input.keyDown(GLFW_KEY_U);
+    if (m_dynamicResolution && currentUKeyState && !m_prevUKeyState) {
+        m_dynamicResolution->setEnabled(!m_dynamicResolution->isEnabled());
+        std::cout << "Dynamic resolution: " << (m_dynamicResolution->isEnabled() ? "ON" : "OFF") << std::endl;
+    }
+    m_prevUKeyState = currentUKeyState;
+    
+    // Variable rasterization rate (Y key)
+    bool currentYKeyState = input.keyDown(GLFW_KEY_Y);
+    if (m_rasterizationRate && currentYKeyState && !m_prevYKeyState) {
+        setVariableRasterizationRate(!m_rasterizationRate->isEnabled(), m_rasterizationRate->getTargetFrameMs());
+        std::cout << "Variable rasterization rate: " << (m_rasterizationRate->isEnabled() ? "ON" : "OFF") << std::endl;
+    }
+    m_prevYKeyState = currentYKeyState;
+    
+    // In-tile post (Q key)
+    bool currentQKeyState = input.keyDown(GLFW_KEY_Q);
+    if (m_tilePostPSO && currentQKeyState && !m_prevQKeyState) {
+        setInTilePost(!m_tilePostEnabled);
+        std::cout << "In-tile post: " << (m_tilePostEnabled ? "ON" : "OFF") << std::endl;
+    }
+    m_prevQKeyState = currentQKeyState;
+    
+    // Trample snapshot (F5 saves, F9 loads)
+    bool currentF5KeyState = input.keyDown(GLFW_KEY_F5);
+    if (currentF5KeyState && !m_prevF5KeyState && !saveTrampleSnapshot(kTrampleSnapshotPath)) {
+        std::cout << "Trample snapshot transfer already in progress" << std::endl;
+    }
+    m_prevF5KeyState = currentF5KeyState;
+    
+    bool currentF9KeyState = input.keyDown(GLFW_KEY_F9);
+    if (currentF9KeyState && !m_prevF9KeyState) {
+        loadTrampleSnapshot(kTrampleSnapshotPath);
+    }
+    m_prevF9KeyState = currentF9KeyState;
+    
+    // GPU capture of the next frame (F12)
+    bool currentF12KeyState = input.keyDown(GLFW_KEY_F12);
+    if (currentF12KeyState && !m_prevF12KeyState) {
+        captureFrames(1, kCapturePathPrefix + std::to_string(m_captureCount++));
+    }
+    m_prevF12KeyState = currentF12KeyState;
+    
+    // Trace recording (F11 starts, the next F11 writes trace_N.json)
+    bool currentF11KeyState = input.keyDown(GLFW_KEY_F11);
+    if (currentF11KeyState && !m_prevF11KeyState) {
+        if (isTraceRecording()) {
+            setTraceRecording(false);
+            writeTrace("trace_" + std::to_string(m_traceCount++) + ".json");
+        } else {
+            setTraceRecording(true);
+            std::cout << "Trace recording: ON" << std::endl;
+        }
+    }
+    m_prevF11KeyState = currentF11KeyState;
+    
+    // Screenshot of the output (F7 writes screenshot_N.png once the frame completes)
+    bool currentF7KeyState = input.keyDown(GLFW_KEY_F7);
+    if (currentF7KeyState && !m_prevF7KeyState) {
+        saveRenderTarget(ReadbackTargetOutput, 0, "screenshot_" + std::to_string(m_screenshotCount++));
+    }
+    m_prevF7KeyState = currentF7KeyState;
+    
+    // Video recording (F8 starts, the next F8 writes video_N.hevc)
+    bool currentF8KeyState = input.keyDown(GLFW_KEY_F8);
+    if (currentF8KeyState && !m_prevF8KeyState) {
+        if (isVideoRecording()) {
+            stopVideoRecording();
+        } else {
+            startVideoRecording("video_" + std::to_string(m_videoCount++));
+        }
+    }
+    m_prevF8KeyState = currentF8KeyState;
+    
+    // Input recording (F10 starts, the next F10 writes input_N.vgin)
+    bool currentF10KeyState = input.keyDown(GLFW_KEY_F10);
+    if (currentF10KeyState && !m_prevF10KeyState) {
+        if (isInputRecording()) {
+            stopInputRecording("input_" + std::to_string(m_inputRecordingCount++) + ".vgin");
+        } else {
+            startInputRecording();
+        }
+    }
+    m_prevF10KeyState = currentF10KeyState;
+    
+    // Temporal upscaling instead of 4x MSAA (M key); switched once its pipelines are built
+    bool currentMKeyState = input.keyDown(GLFW_KEY_M);
+    bool temporalScaler = m_temporalRequested && !m_temporalAntialiasingRequested;
+    if (currentMKeyState && !m_prevMKeyState && !setTemporalUpscaling(!temporalScaler)) {
+        std::cout << "Temporal upscaling not supported on this device" << std::endl;
+    }
+    m_prevMKeyState = currentMKeyState;
+    
+    // Temporal antialiasing instead of MSAA (F key), the same way
+    bool currentFKeyState = input.keyDown(GLFW_KEY_F);
+    if (currentFKeyState && !m_prevFKeyState && !setTemporalAntialiasing(!m_temporalAntialiasingRequested)) {
+        std::cout << "Temporal antialiasing unavailable" << std::endl;
+    }
+    m_prevFKeyState = currentFKeyState;
+    
+    // Visibility-buffer grass shading (V key)
+    bool currentVKeyState = input.keyDown(GLFW_KEY_V);
+    if (currentVKeyState && !m_prevVKeyState && !setGrassVisibilityShading(!m_grassVisibilityEnabled)) {
+        std::cout << "Visibility-buffer grass not supported on this device" << std::endl;
+    }
+    m_prevVKeyState = currentVKeyState;
+    
+    // Half-precision shading (H key)
+    bool currentHKeyState = input.keyDown(GLFW_KEY_H);
+    if (currentHKeyState && !m_prevHKeyState) {
+        setHalfPrecisionShading(!m_halfPrecisionShading);
+    }
+    m_prevHKeyState = currentHKeyState;
+    
+    // Tapered geometry blades instead of the alpha-tested texture (G key)
+    bool currentGKeyState = input.keyDown(GLFW_KEY_G);
+    if (currentGKeyState && !m_prevGKeyState) {
+        setGeometryBlades(!m_geometryBlades);
+        std::cout << "Geometry blades: " << (m_geometryBlades ? "ON" : "OFF") << std::endl;
+    }
+    m_prevGKeyState = currentGKeyState;
+    
+    // Grass depth prepass (N key)
+    bool currentNKeyState = input.keyDown(GLFW_KEY_N);
+    if (currentNKeyState && !m_prevNKeyState) {
+        setGrassDepthPrepass(!m_grassDepthPrepass);
+        std::cout << "Grass depth prepass: " << (m_grassDepthPrepass ? "ON" : "OFF") << std::endl;
+    }
+    m_prevNKeyState = currentNKeyState;
+    
+    // Far-field grass impostors (O key)
+    bool currentOKeyState = input.keyDown(GLFW_KEY_O);
+    if (currentOKeyState && !m_prevOKeyState) {
+        setGrassImpostors(!m_impostorsEnabled, m_impostorDistance);
+        std::cout << "Grass impostors: " << (m_impostorsEnabled ? "ON" : "OFF") << std::endl;
+    }
+    m_prevOKeyState = currentOKeyState;
+    
+    // Sparse virtual ground texture (B key)
+    bool currentBKeyState = input.keyDown(GLFW_KEY_B);
+    if (currentBKeyState && !m_prevBKeyState) {
+        setSparseGroundTexture(!m_sparseGroundEnabled);
+    }
+    m_prevBKeyState = currentBKeyState;
+    
+    // Reload shaders from default.metallib (R key); pipelines are swapped in once rebuilt
+    bool currentRKeyState = input.keyDown(GLFW_KEY_R);
+    if (currentRKeyState && !m_prevRKeyState) {
+        reloadShaders();
+    }
+    m_prevRKeyState = currentRKeyState;
+    
+    // World-scale grass streaming around the camera (C key)
+    bool currentCKeyState = input.keyDown(GLFW_KEY_C);
+    if (currentCKeyState && !m_prevCKeyState) {
+        setGrassStreaming(!m_grassStreamer);
+    }
+    m_prevCKeyState = currentCKeyState;
+    
+    // Watch the shader sources and hot reload edits (L key)
+    bool currentLKeyState = input.keyDown(GLFW_KEY_L);
+    if (currentLKeyState && !m_prevLKeyState) {
+        setShaderHotReload(!m_shaderWatcher);
+    }
+    m_prevLKeyState = currentLKeyState;
+    
+    // Grass density ([ / ] keys): regenerated on the GPU, no CPU rebuild
+    bool densityDown = input.keyDown(GLFW_KEY_LEFT_BRACKET);
+    bool densityUp = input.keyDown(GLFW_KEY_RIGHT_BRACKET);
+    bool currentDensityKeyState = densityDown || densityUp;
+    if (currentDensityKeyState && !m_prevDensityKeyState) {
+        setGrassDensity(m_grassBladesPerCell + (densityUp ? kGrassDensityStep : -kGrassDensityStep));
+    }
+    m_prevDensityKeyState = currentDensityKeyState;
+    
+    // Density brush (left mouse paints grass in, right paints it out) at the terrain under the view
+    // center; the overlay owns the mouse in interactive mode. The first stroke turns the mask on.
+    bool paintIn = input.mouseButtons[0];
+    bool paintOut = input.mouseButtons[1];
+    bool currentBrushButtonState = (paintIn || paintOut) && !(m_overlay && m_overlay->isInteractive());
+    if (currentBrushButtonState && m_grassDensityMap && !m_instanceFile) {
+        if (!m_prevBrushButtonState && !m_grassDensityMapEnabled) {
+            setGrassDensityMapEnabled(true);
+        }
+        glm::vec3 hit;
+        if (m_grassDensityMapEnabled && pickTerrain(m_camera->position, m_camera->front, kTerrainPickDistance, hit)) {
+            paintGrassDensity(simd::make_float2(hit.x, hit.z), kGrassBrushRadius, paintIn ? 1.0f : 0.0f, -1.0f,
+                              std::min(1.0f, kGrassBrushRate * deltaTime));
+        }
+    }
+    m_prevBrushButtonState = currentBrushButtonState;
+}
+
+void Renderer::updateCamera(const FramePacket& input, float deltaTime)
+{
+    // Handle keyboard input (WASD)
+    if (input.keyDown(GLFW_KEY_W)) {
+        m_camera->processKeyboard('W', deltaTime);
+    }
+    if (input.keyDown(GLFW_KEY_S)) {
+        m_camera->processKeyboard('S', deltaTime);
+    }
+    if (input.keyDown(GLFW_KEY_A)) {
+        m_camera->processKeyboard('A', deltaTime);
+    }
+    if (input.keyDown(GLFW_KEY_D)) {
+        m_camera->processKeyboard('D', deltaTime);
+    }
+    
+    // Handle mouse movement (the overlay owns the mouse in interactive mode)
+    if (m_overlay && m_overlay->isInteractive()) {
+        return;
+    }
+    
+    double xpos = input.cursorX;
+    double ypos = input.cursorY;
     
     if (m_firstMouse) {
         m_lastX = static_cast<float>(xpos);
@@ -5,21 +5,518 @@
 #include "Texture.hpp"
 #include "Camera.hpp"
 #include "ShaderTypes.h"
+#include "GpuProfiler.hpp"
+#include "RenderGraph.hpp"
+#include "PipelineArchive.hpp"
+#include "PipelineCache.hpp"
+#include "RenderSettings.hpp"
+#include "SimulationClock.hpp"
+#include "BufferHeap.hpp"
+#include "SceneStore.hpp"
+#include "TextureReadback.hpp"
+#include <dispatch/dispatch.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
 
 struct GLFWwindow;
+struct FramePacket;
+class GrassField;
+class GrassDensityMap;
+class GrassInstanceEditor;
+class InstanceFile;
+class PerformanceOverlay;
+class DynamicResolution;
+class QualityGovernor;
+class TemporalAntialiasing;
+class VariableRasterizationRate;
+class TrampleSnapshot;
+class ComputeDispatch;
+class GpuMemoryBudget;
+class InputRecording;
+class NoiseTexture;
+class GrassPalette;
+class GrassImpostorAtlas;
+class ShadowMaps;
+class SparseGroundTexture;
+class ShaderWatcher;
+class GrassStreamer;
+class TerrainHeightmap;
+class TextureLoader;
+class UploadRing;
+class ResourceCache;
+class JobSystem;
+class CpuCellCuller;
+class FrameCapture;
+class VideoRecorder;
+class TraceRecorder;
+class ExternalControl;
+struct ExternalControlFrame;
+class GpuResidency;
 
 class Renderer {
 public:
     Renderer(MTL::Device* device, CA::MetalLayer* layer);
+    // Windowed with a fixed placement seed (input replays)
+    Renderer(MTL::Device* device, CA::MetalLayer* layer, uint32_t grassSeed);
+    // Headless: renders into an owned offscreen texture with a fixed placement seed (benchmarks)
+    Renderer(MTL::Device* device, int width, int height, uint32_t grassSeed);
     ~Renderer();
 
-    void draw();
+    // drawable: one handed out by a display link; without it draw() waits in nextDrawable()
+    void draw(CA::MetalDrawable* drawable = nullptr);
     void resize(int width, int height);
-    void update(GLFWwindow* window, float deltaTime);
+    void update(GLFWwindow* window, float deltaTime); // Samples the window, then update(packet) and applyWindowState()
+    void update(const FramePacket& input, float deltaTime); // Any thread (the render thread); no GLFW calls
+    void applyWindowState(); // Window thread: cursor mode changes requested by update()
+    void setGrassDensity(int bladesPerCell); // Regenerate the field on the GPU with a new density
+    GpuTimings getGpuTimings() const;        // Latest per-pass GPU times (resolved asynchronously)
+    // GPU capture of the command queue into a .gputrace document (F12 captures one frame);
+    // needs MTL_CAPTURE_ENABLED=1. The trigger captures frameCount frames into directory whenever
+    // the GPU frame time exceeds thresholdMs (0 disables).
+    bool captureFrames(int frameCount, const std::string& path);
+    void setCaptureTrigger(double thresholdMs, int frameCount, const std::string& directory);
+    // Chrome trace of CPU scopes, GPU passes and counters (F11 starts, and stops into trace_N.json);
+    // writeTrace() dumps the ring at any time, while recording or after
+    void setTraceRecording(bool enabled);
+    bool isTraceRecording() const;
+    bool writeTrace(const std::string& path) const;
+    // GPU fault and hang diagnostics (GpuBreadcrumbs): a failed frame command buffer always logs
+    // its error and the state of each encoder; breadcrumbs (off by default: one blit encoder per
+    // pass boundary) add how far each pass got, to those reports and to the one logged when no
+    // frame completes for a few seconds
+    void setGpuBreadcrumbs(bool enabled);
+    bool isGpuBreadcrumbs() const;
+    // Input recording of every update() packet and timestep (F10 starts, and stops into
+    // input_N.vgin). A replay restores the recording's start pose, then feeds its frames to
+    // update() at setFixedTime(frame.sceneTime) in a renderer built with recording.seed.
+    void startInputRecording();
+    bool stopInputRecording(const std::string& path);
+    bool isInputRecording() const { return m_inputRecording != nullptr; }
+    void beginInputReplay(const InputRecording& recording);
+    // Hardware video recording of the output frames, overlay excluded, at framesPerSecond of the
+    // scene clock (F8 starts, and stops into video_N.hevc): one GPU copy per recorded frame into
+    // an encoder surface, frames dropped rather than waited for when the encoder falls behind.
+    // See VideoRecorder; path gets .hevc / .h264 when it has no extension.
+    bool startVideoRecording(const std::string& path, double framesPerSecond = 60.0);
+    void stopVideoRecording();
+    bool isVideoRecording() const;
+    // Asynchronous readback of a render target at the end of the next drawn frame: copied into a
+    // pooled shared buffer on that frame's command buffer, then callback runs on a background job
+    // once the frame completes (see TextureReadback). The output is read before the overlay, from
+    // the first frame whose drawable is copyable (the request turns framebufferOnly off); level
+    // picks the Hi-Z mip. saveRenderTarget() writes it there (PNG for the output, EXR for the
+    // float targets, the extension appended when missing); F7 saves screenshot_N.png.
+    enum ReadbackTarget {
+        ReadbackTargetOutput = 0, // Final 8-bit color
+        ReadbackTargetDepth,      // Resolved depth (Depth32Float)
+        ReadbackTargetTrampleMap, // Stamp times of the trample clipmap (R32Float)
+        ReadbackTargetHiZ,        // Hi-Z pyramid level (R32Float, previous frame's depth)
+    };
+    bool readbackRenderTarget(ReadbackTarget target, int level, TextureReadback::Callback callback);
+    bool saveRenderTarget(ReadbackTarget target, int level, const std::string& path);
+    void waitForReadbacks(); // Until the callbacks of every frame drawn so far have returned
+    
+    // Object IDs for picking and selection (editors): while on, the grass, ground and ball
+    // pipelines also write the object under each sample (OBJECT_ID: kind and index) into an
+    // R32Uint scene attachment, in the same scene pass; the sky and impostor cards keep what lies
+    // behind them. Switched once its pipelines are built, like the temporal mode; the mesh shader
+    // and visibility-buffer grass, the in-tile post and the rasterization rate map stay off
+    // meanwhile. pickObjects() reads the output pixels [x, x + width) x [y, y + height) of the next
+    // frame's IDs: a small compute copy on that frame's command buffer, separate from the color
+    // output, handed to callback (row by row) inside draw() once the frame completed (render
+    // thread, a few frames later). False when the region exceeds kObjectPickCapacity pixels or IDs
+    // are off; picks still queued when IDs are turned off get an empty result.
+    typedef std::function<void(const std::vector<uint32_t>& ids, uint32_t width, uint32_t height)> ObjectPickCallback;
+    static constexpr size_t kObjectPickCapacity = 4096; // Pixels read back per frame
+    void setObjectIds(bool enabled);
+    bool isObjectIds() const { return m_objectIdsRequested; }
+    bool pickObjects(int x, int y, int width, int height, ObjectPickCallback callback);
+    
+    // Shader microbenchmarks (bench --microbench): one GPU workload repeated on the state of the
+    // last drawn frame, kMicrobenchRepeats times per command buffer of its own, and timed by the
+    // command buffers' GPU start and end timestamps, so a shader change is measured without the
+    // rest of the frame. Draw a few frames first; the renderer is idle when a run returns.
+    enum Microbenchmark {
+        MicrobenchTrampleStamp = 0, // stampTrampleMap for every interactor; size = trample map texels per side
+        MicrobenchCull,             // cullGrassInstances over the field from the last frame's cameras (no Hi-Z)
+        MicrobenchGenerate,         // generateGrassInstances of the whole field
+        MicrobenchGrassVertex,      // vertexMain over the last frame's visible blades, rasterization discarded
+        MicrobenchGrassFragment,    // fragmentMain over size full-screen layers (fixed overdraw)
+        MicrobenchCount
+    };
+    struct MicrobenchResult {
+        double medianMs = 0.0;      // GPU time of one repetition
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        int samples = 0;            // Command buffers timed
+        uint64_t items = 0;         // Per repetition: texels stamped, blades or cells, vertex invocations, fragments
+    };
+    static constexpr int kMicrobenchRepeats = 16;
+    static const char* microbenchName(Microbenchmark kind);
+    // samples command buffers after a few untimed ones; false when the workload is unavailable
+    // (its pipeline missing, or the last frame did not run the compute cull)
+    bool runMicrobenchmark(Microbenchmark kind, int size, int samples, MicrobenchResult& result);
+    // Create the ImGui performance overlay for this window; packetInput: its input comes from the
+    // packets passed to update() instead of GLFW callbacks (renderer on its own thread)
+    void attachOverlay(GLFWwindow* window, bool packetInput = false);
+    void setFixedTime(float time);           // Drive uniforms.time explicitly instead of glfwGetTime()
+    void setCameraPose(const glm::vec3& position, float yaw, float pitch);
+    
+    // Batch offscreen rendering (dataset generation, headless renderers only): the views are
+    // drawn back to back with the usual frames in flight, and each output streams out through
+    // readbackRenderTarget() to callback(index, image) on a background job (any order, possibly
+    // concurrently). The field, culling buffers, trample map and simulations carry over from
+    // view to view (times should not decrease for the trample trails); a camera cut drops what
+    // belongs to the previous camera (Hi-Z occlusion, motion vectors, temporal history), so
+    // sequences of nearby views clear it. Returns once every callback has run.
+    struct BatchView {
+        glm::vec3 position = glm::vec3(0.0f);
+        float yaw = 0.0f;
+        float pitch = 0.0f;
+        float time = 0.0f;       // Scene time (setFixedTime)
+        bool cameraCut = true;   // Unrelated to the previous view
+    };
+    typedef std::function<void(size_t index, const ReadbackImage& image)> BatchCallback;
+    bool renderBatch(const std::vector<BatchView>& views, const BatchCallback& callback);
+    
+    // Multi-view rendering (split screen, minimap / overview cameras): each view is a camera drawn
+    // into a rectangle of the output. The grass is culled once against all of their frustums, the
+    // trample, wind and streaming updates are shared (they follow the main camera, like the
+    // terrain LODs), and the grass of two views goes out in one draw through vertex amplification
+    // where the GPU supports it. The mesh shader and visibility-buffer grass, the indirect command
+    // buffers and Hi-Z occlusion culling serve a single view; several views draw without them.
+    struct RenderView {
+        glm::vec3 position = glm::vec3(0.0f, 1.0f, 3.0f);
+        float yaw = -90.0f;
+        float pitch = 0.0f;
+        simd::float4 viewport = simd::make_float4(0.0f, 0.0f, 1.0f, 1.0f); // Normalized x, y, width, height (y down)
+        bool followCamera = false; // Use the main camera's pose (moved by update() / setCameraPose())
+    };
+    bool setViews(const std::vector<RenderView>& views); // Empty = the main camera alone; false past MAX_RENDER_VIEWS
+    size_t getViewCount() const { return m_views.empty() ? 1 : m_views.size(); }
+    void waitUntilIdle();                    // Block until every committed frame has completed
+    void waitForPipelines();                 // Block until the asynchronous pipeline builds have finished
+    // Build every scene pipeline permutation and write the pipeline archive to path (the build's
+    // PrecompiledPipelines step, run from a directory without a pipeline cache); false on failure
+    bool precompilePipelines(const std::string& path);
+    void waitForTextures();                  // Block until the asynchronous texture loads are swapped in
+    void setResourceCacheBudget(size_t bytes); // Unreferenced cached textures / meshes are evicted past this
+    size_t getResourceCacheBytes() const;    // Resident size of the loaded cached resources
+    // Per-category GPU memory of the latest sample (every kGpuMemorySampleInterval frames) against
+    // the device; past the budget the resource cache and sparse ground tiles shrink until it recovers
+    const GpuMemoryBudget& getGpuMemory() const { return *m_gpuMemory; }
+    void setGpuMemoryBudget(size_t bytes);   // 0 = a share of the device's recommended working set
+    BufferHeap::Stats getBufferHeapStats() const; // Heap placement of the meshes, instances and cells
+    bool setDynamicResolution(bool enabled, float targetFrameMs); // False when MetalFX is unavailable
+    // Fixed MetalFX render scale instead of the budget controller (1 = native); false without MetalFX
+    bool setFixedRenderScale(float scale);
+    bool setTemporalUpscaling(bool enabled); // False when the temporal scaler is unavailable; applied once its pipelines exist
+    // Temporal antialiasing (F key) instead of MSAA: the 1x jittered scene pass of the temporal
+    // mode, resolved by the in-house TAA kernel instead of the MetalFX scaler (so it also works
+    // without MetalFX; dynamic resolution then upscales spatially). Exclusive with temporal
+    // upscaling (enabling one turns the other off); applied once the pipelines exist
+    bool setTemporalAntialiasing(bool enabled);
+    bool isTemporalAntialiasing() const { return m_temporalAntialiasingRequested; }
+    float getRenderScale() const;            // Current dynamic resolution scale (1 = native)
+    // Variable rasterization rate (Y key): the scene pass shades fogged rows and screen edges at a
+    // lower rate, as far as the GPU frame time at targetFrameMs needs. Native-resolution single
+    // view only (dynamic resolution, visibility-buffer grass and extra views keep full rate);
+    // false when the device has no rate maps
+    bool setVariableRasterizationRate(bool enabled, float targetFrameMs);
+    bool isVariableRasterizationRateEnabled() const;
+    // In-tile post (Q key): on Apple GPUs the 4x scene pass fogs and tone maps its samples in tile
+    // memory and resolves them straight into the output, so no HDR color is stored for a post
+    // pass. Native-resolution single view only, without a rate map or visibility-buffer grass
+    // (those frames keep the post pass); false when the GPU has no tile shaders
+    bool setInTilePost(bool enabled);
+    bool isInTilePostEnabled() const { return m_tilePostEnabled && m_tilePostPSO; }
+    // Sun shadow maps on the blades (see ShadowMaps): cached cascades of the terrain and the
+    // blades at rest, plus a per-frame overlay of the interactor bodies that replaces their blob
+    // shadows where it reaches. False when the maps could not be created
+    bool setShadowMaps(bool enabled);
+    bool isShadowMapsEnabled() const { return m_shadowMapsEnabled && m_shadowMaps; }
+    void setInteractorCount(int count);      // Ball plus count - 1 wandering stand-ins for gameplay interactors
+    int getInteractorCount() const { return m_interactorCount; }
+    void setInteractorPhysics(bool enabled); // GPU rigid bodies (stand-ins dropped onto the terrain) instead of the scripted orbits
+    bool isInteractorPhysicsEnabled() const { return m_interactorPhysicsEnabled; }
+    // External control (see ExternalControl): another process drives the interactors and blows
+    // wind gusts through the POSIX shared memory object name. Its latest frame replaces the
+    // scripted orbits and the interactor physics, and sets the interactor count; until the first
+    // frame arrives the scripted interactors stay. Empty name = detach. False when unavailable.
+    bool setExternalControl(const std::string& name);
+    bool isExternalControlAttached() const { return m_externalControl != nullptr; }
+    // Blade physics: blades within radius meters of the camera keep a spring state (tip bend and
+    // velocity) stepped by a compute pass; 0 = stateless wind bend. False when unavailable; the
+    // state is ignored while grass is streamed
+    bool setBladePhysics(float radius);
+    float getBladePhysicsRadius() const { return m_bladePhysicsRadius; }
+    
+    // Wind fluid (K key): a stable-fluids velocity grid over the ground, driven by the interactors
+    // and by gust emitters, adds wakes and gusts to the procedural wind. False when unavailable
+    bool setWindFluid(bool enabled);
+    bool isWindFluidEnabled() const { return m_windFluidEnabled; }
+    // Blow velocity (m/s, world XZ) into the fluid within radius meters of position for duration
+    // seconds; invalid handle past WIND_MAX_GUSTS live emitters. Emitters live in a SceneArrayStore
+    // (placement and flow arrays), so a frame uploads only the emitters added or removed since
+    SceneHandle addWindGust(const simd::float2& position, const simd::float2& velocity, float radius, float duration);
+    bool removeWindGust(SceneHandle handle); // Stops it early (false once it has expired)
+    // Gust particle (J key, gameplay events: downdrafts, blasts): simulated on the GPU and summed
+    // into the wind field with or without the fluid, so blades pay nothing per live gust. Up to
+    // WIND_MAX_GUST_SPAWNS per frame; beyond WIND_MAX_GUST_PARTICLES live ones the oldest is replaced
+    void spawnWindGust(const WindGustParticle& gust);
+    int getLiveWindGustCount() const; // Spawned particles whose lifetime has not run out
+    
+    // Simulation rates: each system steps at a fixed rate on its own clock, independent of the
+    // display rate (e.g. trample stamps at 30 Hz on low-end machines); 0 = once per frame by the
+    // frame delta. Interactor bodies are drawn interpolated between their last two steps.
+    enum SimulationSystem {
+        SimulationTrample = 0, // Trample stamps (bins, decay and the grass follow every frame)
+        SimulationPhysics,     // Interactor bodies and blade springs
+        SimulationWind,        // Wind fluid (the procedural wind is evaluated per frame)
+        SimulationSystemCount
+    };
+    void setSimulationRate(SimulationSystem system, float rateHz);
+    float getSimulationRate(SimulationSystem system) const; // As set (before the power policy's scale)
+    
+    // Runtime quality settings (RenderSettings presets and overrides). Only what differs from the
+    // live state is rebuilt: the density, LODs, impostors, shading permutation, fog, blade springs
+    // and power scale go through their setters; the blade meshes and the trample textures are
+    // rebuilt once the GPU has drained (the trample history restarts); a new sample count or TAA
+    // swaps the scene pipelines once they are built, like the temporal mode. False when a part
+    // could not be applied (it keeps its current value).
+    bool applyRenderSettings(const RenderSettings& settings);
+    RenderSettings getRenderSettings() const; // Live values, changes by keys and the overlay included
+    bool setSceneSampleCount(int sampleCount); // 1, 2, 4 or 8 (false when the device lacks it)
+    int getSceneSampleCount() const { return static_cast<int>(m_sceneSampleCountRequested); }
+    bool setGrassBladeSegments(int segments);  // Height segments of the nearest blade LOD (1 to 7)
+    int getGrassBladeSegments() const { return m_grassBladeSegments; }
+    bool setTrampleMapSize(int size);          // Texels per side: power of two, 256 to 4096
+    int getTrampleMapSize() const;
+    void setFogDistances(float start, float end);
+    
+    // Power-aware frame policy (laptops on battery; the quality presets set it). Frames are
+    // presented no faster than maxFrameRate (lowPowerFrameRate while macOS Low Power Mode is on)
+    // and the fixed simulation rates are scaled by simulationScale (per-frame systems keep
+    // following the frames). Once the user has been away for idleDelay seconds - the camera stands
+    // still, no key or button is held, the cursor rests and no external control frame arrives -
+    // frames drop to idleFrameRate (the scene clock keeps running unless paused with Z). Frame
+    // rates of 0 leave the display rate. Without a layer (headless) only the scale applies.
+    struct PowerPolicy {
+        float maxFrameRate = 0.0f;
+        float lowPowerFrameRate = 30.0f;
+        float simulationScale = 1.0f;
+        float idleFrameRate = 5.0f;
+        float idleDelay = 0.5f;
+    };
+    void setPowerPolicy(const PowerPolicy& policy);
+    const PowerPolicy& getPowerPolicy() const { return m_powerPolicy; }
+    bool isIdle() const { return m_idle; }
+    void setScenePaused(bool paused); // Freeze the scene clock (uniforms.time); the camera still moves
+    bool isScenePaused() const { return m_scenePaused; }
+    
+    // Thermal / power quality governor (QualityGovernor): under macOS thermal pressure, Low Power
+    // Mode or a sustained GPU overrun of the dynamic resolution budget (60 Hz without it), steps
+    // thin the density LOD, cap the render scale and cap the trample rate on top of the live
+    // settings (getRenderSettings() keeps reporting those); calm spells step back up. Off in the
+    // renderer; the demo turns it on unless --no-governor is given.
+    void setQualityGovernor(bool enabled);
+    bool isQualityGovernorEnabled() const { return m_qualityGovernor != nullptr; }
+    int getQualityGovernorLevel() const; // 0 = full quality
+    
+    // Late latching: with a latch set, update() leaves the camera alone and draw() asks the latch
+    // for the newest input once it holds a frame slot and a drawable, then moves the camera just
+    // before the uniforms are written, so mouse look skips the drawable wait. The latch fills in
+    // the newest packet and returns false while it has none. Called on the drawing thread.
+    typedef std::function<bool(FramePacket&)> InputLatch;
+    void setInputLatch(InputLatch latch);
+    
+    // Parallel scene encoding (E key): ground, each grass species, impostors, interactors and sky
+    // are filled into sub-encoders of one parallel render pass by the job system's workers
+    void setParallelEncoding(bool enabled);
+    bool isParallelEncodingEnabled() const { return m_parallelEncoding; }
+    // Async compute (on by default): interactor physics, trample, wind, blade physics and the cull
+    // run on a second command queue, overlapping the frame's independent passes and the tail of
+    // the previous frame (see RenderGraph::setAsyncComputeQueue)
+    void setAsyncCompute(bool enabled);
+    bool isAsyncComputeEnabled() const { return m_asyncCompute; }
+    // CPU cell culling (X key): the grass cells are frustum-culled on the CPU (NEON) instead of by
+    // the compute cull pass, and the visible cells' instance ranges drawn directly at LOD0
+    void setCpuCellCulling(bool enabled) { m_cpuCellCulling = enabled; }
+    bool isCpuCellCullingEnabled() const { return m_cpuCellCulling; }
+    double getCpuCellCullMs() const; // Last frame's cull time (0 when the GPU culls)
+    // Front-to-back cells (on by default): the compute cull visits the cells nearest first, so
+    // near blades lead their draws and reject the far blades behind them at the depth test
+    void setFrontToBackCells(bool enabled) { m_frontToBackCells = enabled; }
+    bool isFrontToBackCellsEnabled() const { return m_frontToBackCells; }
+    // Baked wind poses (on by default): blades past the first LOD distance bend through a baked
+    // pose table instead of the procedural rotation (and the blade simulation, which stays nearer)
+    void setGrassWindPoses(bool enabled) { m_grassWindPoses = enabled; }
+    bool isGrassWindPosesEnabled() const { return m_grassWindPoses; }
+    // Snapshots of the resident trample window (not the world beyond it): the readback, quantization,
+    // compression and file I/O run off the render thread; false while another transfer is in flight
+    bool saveTrampleSnapshot(const std::string& path); // Asynchronous readback, written a few frames later
+    bool loadTrampleSnapshot(const std::string& path); // Read on a worker, copied into the map by a later frame
+    void setTrampleSummaryEnabled(bool enabled) { m_trampleSummaryEnabled = enabled; } // Whole-cell trample test in the cull pass
+    bool isTrampleSummaryEnabled() const { return m_trampleSummaryEnabled; }
+    bool setGrassVisibilityShading(bool enabled); // False when the GPU lacks framebuffer fetch / primitive IDs; used once its pipelines exist
+    bool isGrassVisibilityShading() const { return m_grassVisibilityEnabled; }
+    
+    // Optional blade lighting features, compiled into the grass pipelines (leaner permutations
+    // for lower quality presets); the new permutation is swapped in once it is built
+    struct GrassShadingFeatures {
+        bool contactShadows = true; // Contact and blob shadows under the interactors
+        bool translucency = true;   // Backlit tip translucency
+        bool windSheen = true;      // Brightness lift on wind-bent tips
+    };
+    void setGrassShadingFeatures(const GrassShadingFeatures& features);
+    const GrassShadingFeatures& getGrassShadingFeatures() const { return m_grassShadingFeatures; }
+    
+    // Half-precision variants of the grass, ground and sky shading (H key); swapped in once built
+    void setHalfPrecisionShading(bool enabled);
+    bool isHalfPrecisionShading() const { return m_halfPrecisionShading; }
+    
+    // Tapered blade geometry with procedural color instead of the alpha-tested texture (G key):
+    // the grass pipelines run opaque without alpha-to-coverage; swapped in once built
+    void setGeometryBlades(bool enabled);
+    bool isGeometryBlades() const { return m_geometryBlades; }
+    
+    // Depth prepass of the classic grass path (N key): the blades go through depth once with the
+    // alpha test only, then the grass pass shades with an equal depth test, so overlapping blades
+    // are shaded once per sample. Off by default (it pays the vertex work twice); single-pass
+    // until the prepass pipeline is built
+    void setGrassDepthPrepass(bool enabled);
+    bool isGrassDepthPrepassEnabled() const { return m_grassDepthPrepass; }
+    
+    // Sun driving the blade lighting, the sky and the fog; the atmosphere LUT is rebuilt on the
+    // next frame only when it differs from the one the LUT was built for
+    void setSun(const simd::float3& direction, const simd::float3& color);
+    
+    // Point lights (fireflies, lanterns) lighting the grass and the ground; past MAX_POINT_LIGHTS
+    // they are dropped. A cluster pass lists the lights of every froxel of each view, so shading
+    // cost follows the lights near a fragment, not the total. Lights live in a SceneStore: each
+    // frame uploads only the lights added, moved or removed since its buffer was last written.
+    void setPointLights(const std::vector<PointLight>& lights); // Replaces every light (earlier handles become invalid)
+    SceneHandle addPointLight(const PointLight& light);         // Invalid handle past MAX_POINT_LIGHTS
+    bool updatePointLight(SceneHandle handle, const PointLight& light);
+    bool removePointLight(SceneHandle handle);
+    size_t getPointLightCount() const { return m_pointLights.size(); }
+    float getGroundHeight(float x, float z) const; // Terrain height at a world XZ position (placing lights, props)
+    // First terrain point along a ray within maxDistance meters (brush and prop placement); false on a miss
+    bool pickTerrain(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, glm::vec3& hit) const;
+    
+    // Far-field impostors (O key): cells past distance meters draw one baked card instead of
+    // their blades, crossfading over a band around it (compute culling path only)
+    void setGrassImpostors(bool enabled, float distance);
+    bool isGrassImpostorsEnabled() const { return m_impostorsEnabled; }
+    float getGrassImpostorDistance() const { return m_impostorDistance; }
+    
+    // Density LOD: past distance meters cells draw a shrinking, evenly spread prefix of their
+    // blades, widened to keep the coverage (0 = every blade)
+    void setGrassDensityLod(float distance) { m_grassDensityLodDistance = distance > 0.0f ? distance : 0.0f; }
+    float getGrassDensityLodDistance() const { return m_grassDensityLodDistance; }
+    
+    // Season of the blade palette: 0 spring, 1 summer (default), 2 autumn, 3 winter; fractions
+    // blend neighboring seasons and the cycle wraps. Only rebakes the small palette LUT, so it can
+    // change every frame without a pipeline switch or a GPU wait
+    void setGrassSeason(float season);
+    float getGrassSeason() const;
+    
+    // Sparse virtual ground texture (B key): the ground samples one unique texture over the field,
+    // streamed tile by tile from shader feedback within a fixed page budget (Apple GPU family 6+;
+    // the tiled albedo stays in use elsewhere); the ground permutation is swapped in once built
+    void setSparseGroundTexture(bool enabled);
+    bool isSparseGroundTexture() const { return m_sparseGroundEnabled; }
+    size_t getSparseGroundResidentBytes() const; // Mapped pages (0 when unsupported)
+    
+    // Development shader hot reload (L key): edited .metal sources are recompiled in the background
+    // and the render pipelines built from them swapped in at a frame boundary. Needs the source tree
+    // (VEGETATION_SHADER_SOURCE_DIR) and the Metal command-line tools.
+    bool setShaderHotReload(bool enabled);
+    bool isShaderHotReload() const { return m_shaderWatcher != nullptr; }
+    
+    // World-scale grass streaming (C key): instead of the static field, a window of cell-sized chunks
+    // around the camera is generated on worker threads and paged through a fixed pool, over a
+    // kilometer-scale world. The ground and heightmap still cover the field only (blades beyond it
+    // stand on its edge height).
+    bool setGrassStreaming(bool enabled);
+    bool isGrassStreaming() const { return m_grassStreamer != nullptr; }
+    size_t getGrassStreamingResidentChunks() const;
+    
+    // Trample strength (0..1) at world XZ points, in the order given. Evaluated on the GPU with the
+    // next frame's stamps; the callback runs inside draw() once that frame has completed (render
+    // thread, a few frames later). False when the batch exceeds kTrampleQueryCapacity points.
+    typedef std::function<void(const std::vector<float>& strengths)> TrampleQueryCallback;
+    static constexpr size_t kTrampleQueryCapacity = 4096; // Points evaluated per frame
+    bool queryTrample(const std::vector<simd::float2>& points, TrampleQueryCallback callback);
+    uint32_t getGrassInstanceCount() const { return m_grassInstanceCount; }
+    // Blades the density mask kept (of the instance slots above); read back once generation completed
+    uint32_t getGrassPlacedCount() const;
+    // Place blades by the density / species mask (assets/grass_density.png or the procedural meadow)
+    // instead of uniformly; needs the GPU generation kernel
+    void setGrassDensityMapEnabled(bool enabled);
+    bool isGrassDensityMapEnabled() const { return m_grassDensityMapEnabled; }
+    // Replace the generated field with an authored InstanceFile (mapped, not copied); false when the
+    // file is unreadable or its grid does not match the scene's. Density is fixed while one is mapped.
+    bool loadGrassInstances(const std::string& path);
+    // Write the field the scene would generate (seed, current density) as an InstanceFile
+    bool exportGrassInstances(const std::string& path) const;
+    // Brush edits of the resident field within radius meters of a world XZ point: plant up to count
+    // new blades, erase blades, or cut them down to at most scale (mowing; 0 erases). The first edit takes the
+    // field over into an editable copy (one wait for the GPU); later edits only upload the slots they
+    // touch, ahead of the next frame. Regenerating the field (density, placement) discards the edits.
+    // Each returns the blades affected; 0 while streaming.
+    int plantGrass(simd::float2 center, float radius, int count);
+    int eraseGrass(simd::float2 center, float radius);
+    int mowGrass(simd::float2 center, float radius, float scale);
+    bool isGrassEdited() const { return m_grassEditor != nullptr; }
+    // Density / species brush: one dab within radius meters of a world XZ point (e.g. under the
+    // cursor) blends the mask toward density and species (species < 0 keeps it) by strength, on the
+    // GPU, and the generation kernel places only the cells the dab touched again, in the same
+    // command buffer. Needs the kernel and the density map; an edited field is regenerated whole
+    // (dropping the edits). Returns the cells placed again.
+    int paintGrassDensity(simd::float2 center, float radius, float density, float species, float strength);
 
 private:
+    static constexpr int kMaxFramesInFlight = 3; // Frames the CPU may encode ahead of the GPU
+    void updateCamera(const FramePacket& input, float deltaTime); // WASD and mouse look
+
+    // Batch of points submitted through queryTrample()
+    struct TrampleQuery {
+        std::vector<simd::float2> points;
+        TrampleQueryCallback callback;
+    };
+    
+    // Region submitted through pickObjects() (origin and size in output pixels; the rest is set
+    // by the frame that reads it)
+    struct ObjectPick {
+        ObjectPickUniforms region;
+        ObjectPickCallback callback;
+    };
+    
+    // Pipelines drawn in the scene pass (one set per scene pass configuration)
+    struct ScenePipelineKeys {
+        PipelineKey grass;
+        PipelineKey ground;
+        PipelineKey ball;
+        PipelineKey sky;
+        PipelineKey grassVisibility; // Visibility-buffer grass: blade IDs into color 2
+        PipelineKey grassShade;      // Visibility-buffer grass: full-screen lighting from the IDs
+        PipelineKey impostor;        // Far-field grass cards
+        PipelineKey grassMultiView;  // grass amplified into two views per draw
+        PipelineKey grassPrepass;    // grass coverage into depth only, no color writes
+    };
+
+    Renderer(MTL::Device* device, CA::MetalLayer* layer, int width, int height, uint32_t grassSeed);
+
     MTL::Device* m_device;
     MTL::CommandQueue* m_commandQueue;
+    MTL::CommandQueue* m_asyncComputeQueue; // Simulation and cull passes of the render graph
+    bool m_asyncCompute;
+    uint64_t m_asyncUploadMark; // Upload ring bytes committed as of the last frame
+    uint64_t m_outOfGraphCommandBuffers; // newOutOfGraphCommandBuffer() calls so far
+    uint64_t m_asyncOutOfGraphMark;      // ...as of the last frame
     CA::MetalLayer* m_metalLayer; 
     MTL::RenderPipelineState* m_pso; // Grass pipeline state
     MTL::RenderPipelineState* m_groundPSO; // Ground pipeline state
@@ -28,39 +525,541 @@ private:
     MTL::Buffer* m_vertexBuffer;     // Vertex data buffer
     MTL::Buffer* m_indexBuffer;      // Index data buffer
     MTL::Buffer* m_instanceBuffer;   // Instance data buffer
-    MTL::Buffer* m_uniformBuffer;    // Uniform data buffer
-    MTL::Buffer* m_groundVertexBuffer; // Ground vertex data buffer
+    MTL::Buffer* m_uniformBuffer;    // Uniform buffer of the frame being encoded (points into the ring)
+    MTL::Buffer* m_uniformBuffers[kMaxFramesInFlight]; // Per-frame uniform ring
+    MTL::Buffer* m_sceneConstantBuffer; // Scene constants of the frame being encoded (points into the ring)
+    MTL::Buffer* m_sceneConstantBuffers[kMaxFramesInFlight]; // Per-slot copies, rewritten only after a change
+    SceneConstants m_sceneConstants;  // Current values (CPU side)
+    uint64_t m_sceneConstantsVersion; // Bumped whenever m_sceneConstants changes
+    uint64_t m_sceneConstantSlotVersions[kMaxFramesInFlight]; // Version each copy holds (0 = never written)
+    float m_fogStartDistance;        // Post pass fog (SceneConstants), meters
+    float m_fogEndDistance;
+    int m_frameIndex;                // Current slot in the uniform ring
+    dispatch_semaphore_t m_frameSemaphore; // Counts free ring slots; signalled when a frame completes
+    TerrainHeightmap* m_terrain;     // Ground heights (terrain chunks, grass roots, interactors)
+    MTL::Buffer* m_terrainIndexBuffer; // Grid + skirt triangles of one chunk at every terrain LOD
+    MTL::Buffer* m_terrainChunkBuffers[kMaxFramesInFlight]; // Chunks drawn per frame, grouped by LOD
+    uint32_t m_terrainLodIndexCount[TERRAIN_LOD_COUNT];
+    uint32_t m_terrainLodIndexStart[TERRAIN_LOD_COUNT];
+    uint32_t m_terrainLodChunkCount[TERRAIN_LOD_COUNT]; // This frame's chunks per LOD
+    uint32_t m_terrainLodFirstChunk[TERRAIN_LOD_COUNT]; // First slot of each LOD in the chunk list
     MTL::Buffer* m_ballVertexBuffer; // Ball vertex data buffer
     MTL::Buffer* m_ballIndexBuffer;  // Ball index data buffer
     NS::UInteger m_ballIndexCount;   // Ball index count
     MTL::DepthStencilState* m_depthStencilState;
-    MTL::DepthStencilState* m_skyDepthStencilState; // Sky depth state (always pass, no write)
+    MTL::DepthStencilState* m_skyDepthStencilState; // Sky depth state (far plane, only where nothing was drawn; no write)
+    MTL::DepthStencilState* m_fullscreenDepthStencilState; // Full-screen shading passes (always pass, no write)
+    MTL::DepthStencilState* m_grassEqualDepthState; // Grass shading after its depth prepass (equal, no write)
     MTL::Texture* m_depthTexture;    // Depth texture (resolve target)
-    MTL::Texture* m_msaaColorTexture; // MSAA color render target
-    MTL::Texture* m_msaaDepthTexture; // MSAA depth render target
-    Texture* m_texture;               // Grass texture
-    Texture* m_groundTexture;         // Ground texture
+    MTL::Texture* m_offscreenColorTexture; // Resolve target when there is no layer (headless)
+    float m_fixedTime;                // Animation time when m_useFixedTime is set
+    bool m_useFixedTime;
+    BufferHeap* m_bufferHeap;         // Placement heaps of the private meshes, instances and cells
+    UploadRing* m_uploadRing;         // Staging for uploads into private buffers and textures
+    TextureLoader* m_textureLoader;   // Decodes the image textures off the render thread
+    ResourceCache* m_resourceCache;   // Owns the image textures and static meshes (shared by key)
+    Texture* m_grassAlbedoVariants[GRASS_ALBEDO_VARIANT_COUNT]; // Cache references held until copied into the array
+    bool m_grassAlbedoLoaded[GRASS_ALBEDO_VARIANT_COUNT];
+    MTL::Texture* m_grassAlbedoArray; // Grass alpha masks, one slice per variant (transparent placeholder until loaded)
+    Texture* m_groundTexture;         // Ground texture (a placeholder until loaded)
+    NoiseTexture* m_noiseTexture;     // Value-noise lattice shared by the shaders (valueNoise())
+    GrassPalette* m_grassPalette;     // Blade albedo LUT, one copy per frame in flight
+    SparseGroundTexture* m_sparseGround; // Streamed ground albedo (nullptr without sparse texture support)
+    bool m_sparseGroundEnabled;       // Baked into the ground keys
+    bool m_prevBKeyState;
     Camera* m_camera;                 // Camera
+    std::vector<RenderView> m_views;  // setViews() (empty = m_camera over the whole output)
+    bool m_vertexAmplificationSupported; // Two views per draw
     
     // Trample map system
-    MTL::Texture* m_trampleMapA;      // Ping-pong texture A
-    MTL::Texture* m_trampleMapB;      // Ping-pong texture B
-    bool m_trampleMapSwap;            // Current ping-pong state (false = A is current, true = B is current)
-    MTL::ComputePipelineState* m_trampleComputePSO; // Compute pipeline for trample map update
-    bool m_showTrampleMap;            // Debug toggle to visualize trample map
+    MTL::Texture* m_trampleMap;       // Stamp time per texel (strength decays analytically when sampled)
+    MTL::ComputePipelineState* m_trampleComputePSO; // Compute pipeline stamping the interactor footprints
+    MTL::ComputePipelineState* m_binInteractorsPSO; // Lists the interactors overlapping each trample tile
+    MTL::ComputePipelineState* m_trampleClearPSO; // Clears the strips the clipmap window scrolls onto
+    simd::int2 m_trampleWindowTexel;  // First world texel of the window the map currently holds
+    bool m_trampleWindowValid;        // False until the first frame places the window
+    
+    // Trample summary pyramid (min / max stamp time per tile, then 2x2 per level), kept up to date
+    // by re-reducing only the tiles the map kernels flagged
+    MTL::Texture* m_trampleSummary;
+    std::vector<MTL::Texture*> m_trampleSummaryMipViews; // One single-level view per mip (compute targets)
+    MTL::Buffer* m_trampleDirtyTileBuffer; // uint per base-level tile, set when its texels are written
+    MTL::Buffer* m_trampleTileCountBuffers[kMaxFramesInFlight]; // Tiles re-reduced per frame (shared, read back for the trace)
+    MTL::ComputePipelineState* m_trampleReducePSO;
+    MTL::ComputePipelineState* m_trampleSummaryDownsamplePSO;
+    bool m_trampleSummaryEnabled;
+    
+    // Trample snapshots: readbacks and uploads share one staging buffer, one transfer at a time
+    MTL::Buffer* m_trampleStagingBuffer; // Shared copy of the map (created on first use)
+    TrampleSnapshot* m_trampleSnapshot; // Snapshot being saved, or waiting to be uploaded
+    std::string m_trampleSnapshotPath; // Destination of the pending save
+    bool m_trampleSavePending;        // Readback requested, not yet encoded
+    bool m_trampleUploadPending;      // m_trampleSnapshot waits to be copied into the map
+    int m_trampleTransferSlot;        // Frame slot whose copy uses the staging buffer (-1 = none)
+    bool m_trampleTransferIsReadback; // That copy reads the map back (else it uploads)
+    simd::int2 m_trampleReadbackWindow; // Window and clock the readback was taken at
+    float m_trampleReadbackTime;
+    std::atomic<bool> m_trampleFileJob; // A background job compresses and writes, or reads and decodes, a snapshot
+    
+    // Asynchronous CPU trample queries (points and results per in-flight frame)
+    MTL::ComputePipelineState* m_trampleQueryPSO;
+    MTL::Buffer* m_trampleQueryPointBuffers[kMaxFramesInFlight];
+    MTL::Buffer* m_trampleQueryResultBuffers[kMaxFramesInFlight];
+    std::vector<TrampleQuery> m_trampleQueries; // Submitted, not encoded yet
+    std::vector<TrampleQuery> m_trampleQueriesInFlight[kMaxFramesInFlight]; // Evaluated by that slot's frame, in buffer order
+    
+    // Object ID picking (setObjectIds)
+    bool m_objectIds;                     // The scene pipelines write the ID attachment
+    bool m_objectIdsRequested;            // Mode to switch to once its pipelines are built
+    MTL::ComputePipelineState* m_pickObjectIdsPSO;             // 1x ID attachment (temporal mode)
+    MTL::ComputePipelineState* m_pickObjectIdsMultisampledPSO; // MSAA ID attachment (sample 0)
+    MTL::Buffer* m_objectPickResultBuffers[kMaxFramesInFlight];
+    std::vector<ObjectPick> m_objectPicks; // Submitted, not encoded yet
+    std::vector<ObjectPick> m_objectPicksInFlight[kMaxFramesInFlight]; // Read by that slot's frame, in buffer order
+    bool m_prevF5KeyState;
+    bool m_prevF9KeyState;
+    // Scripted interactors as SceneArrayStore streams: the motion is rewritten every frame, the
+    // shape only when it changes (added, capsules under physics). The shaders, the physics step and
+    // the external control frames share whole Interactor records, so both streams are uploaded
+    // into the slot's records, each from its own dirty range
+    struct InteractorMotion {
+        simd::float3 position;
+        simd::float3 prevPosition;
+        float radius;
+        void writeTo(Interactor& record) const
+        {
+            record.position = position;
+            record.prevPosition = prevPosition;
+            record.radius = radius;
+        }
+    };
+    struct InteractorShape {
+        float falloff;
+        float bodyRadius;
+        float halfHeight;
+        simd::float4 material;
+        void writeTo(Interactor& record) const
+        {
+            record.falloff = falloff;
+            record.bodyRadius = bodyRadius;
+            record.halfHeight = halfHeight;
+            record.material = material;
+        }
+    };
+    SceneArrayStore<InteractorMotion, InteractorShape, kMaxFramesInFlight> m_interactors;
+    std::vector<SceneHandle> m_interactorHandles; // Handle of scripted interactor i (removed from the end)
+    bool m_interactorCapsules;        // The shapes hold the capsules of the physics spawn
+    MTL::Buffer* m_interactorBuffers[kMaxFramesInFlight]; // Per-frame Interactor arrays (ball first)
+    MTL::Buffer* m_frameInteractorBuffer; // This frame's: its m_interactorBuffers entry or the external frame in place
+    ExternalControl* m_externalControl;   // Shared memory channel of an external simulation (or null)
+    const ExternalControlFrame* m_externalFrame; // Frame this frame draws (null = scripted / physics interactors)
+    MTL::Buffer* m_interactorBinBuffer; // InteractorBin per trample tile, rebuilt every frame
+    int m_interactorCount;            // Interactors in this frame's array (the store's, or the external frame's)
+    MTL::ComputePipelineState* m_interactorPhysicsPSO; // Steps the interactor bodies and rewrites the frame's interactors
+    MTL::Buffer* m_interactorBodyBuffer; // InteractorBody per interactor, GPU-only state across frames (private)
+    bool m_interactorPhysicsEnabled;
+    bool m_interactorPhysicsReset;    // Respawn the bodies from the scripted interactors next frame
+    bool m_prevPKeyState;
+    MTL::ComputePipelineState* m_bladePhysicsPSO; // Steps the blade springs of the cells near the camera
+    MTL::Buffer* m_bladeStateBuffer;  // BladeState per instance slot, created by the first setBladePhysics() (private)
+    float m_bladePhysicsRadius;       // Simulation radius around the camera (0 = off)
+    bool m_showTrampleMap;            // Debug toggle to visualize trample map (grass pipeline permutation)
     bool m_prevTKeyState;             // Previous T key state for toggle detection
     
+    // Wind field (grassWind() per texel over the ground, sampled at every blade root)
+    MTL::Texture* m_windField;        // WIND_FIELD_SIZE^2 RGBA16Float; slice 0 this frame, slice 1 last frame
+    MTL::ComputePipelineState* m_windFieldPSO;
+    
+    // Wind fluid (velocity perturbation per wind field texel, private buffers created on first use)
+    MTL::ComputePipelineState* m_windAdvectPSO;
+    MTL::ComputePipelineState* m_windSplatPSO;
+    MTL::ComputePipelineState* m_windDivergencePSO;
+    MTL::ComputePipelineState* m_windPressurePSO;
+    MTL::ComputePipelineState* m_windProjectPSO;
+    MTL::ComputePipelineState* m_windFieldFluidPSO; // Procedural wind plus the fluid into the wind field
+    MTL::Buffer* m_windVelocityBuffers[2]; // float2 per cell: last frame's / this frame's result
+    MTL::Buffer* m_windScratchBuffer;  // Advected, not yet projected velocity
+    MTL::Buffer* m_windPressureBuffers[2]; // Jacobi ping-pong (warm-started across frames)
+    MTL::Buffer* m_windDivergenceBuffer;
+    int m_windVelocityIndex;          // m_windVelocityBuffers entry holding the latest velocity
+    bool m_windFluidEnabled;
+    SceneArrayStore<WindGustPlacement, WindGustFlow, kMaxFramesInFlight> m_windGusts; // Gust emitters
+    MTL::Buffer* m_windGustPlacementBuffers[kMaxFramesInFlight]; // Per-frame emitter arrays (shared)
+    MTL::Buffer* m_windGustFlowBuffers[kMaxFramesInFlight];
+    bool m_prevKKeyState;
+    
+    // Wind gust particles (private slots, stepped and splatted in the Wind pass)
+    MTL::ComputePipelineState* m_windGustPSO;
+    MTL::Buffer* m_windGustBuffer;    // WindGustParticle per slot
+    std::vector<WindGustSpawn> m_windGustSpawns; // Spawned since the last Wind pass
+    uint32_t m_windGustSpawned;       // Particles ever spawned: the next slot, oldest first
+    std::vector<float> m_windGustLives; // Per slot: lifetime left, aged by the same steps as the GPU
+    
+    // Clustered point lights: the CPU list goes into one array per in-flight frame, and the cluster
+    // pass rewrites the froxel lists (LIGHT_CLUSTER_COUNT per view) on frames with lights
+    SceneStore<PointLight, kMaxFramesInFlight> m_pointLights;
+    MTL::Buffer* m_pointLightBuffers[kMaxFramesInFlight];
+    MTL::Buffer* m_lightClusterBuffer; // LightCluster per froxel and view (private)
+    MTL::ComputePipelineState* m_lightClusterPSO;
+    
+    // Atmosphere LUT (sky and fog color by view direction), rebuilt when the sun changes
+    MTL::Texture* m_atmosphereLut;    // ATMOSPHERE_LUT_WIDTH x ATMOSPHERE_LUT_HEIGHT RGBA16Float
+    MTL::ComputePipelineState* m_atmosphereLutPSO;
+    simd::float3 m_sunDirection;      // Current sun (uniforms.sunDirection / sunColor)
+    simd::float3 m_sunColor;
+    AtmosphereUniforms m_atmosphereLutSun; // Sun the LUT was last built for
+    bool m_atmosphereLutValid;        // LUT built for m_atmosphereLutSun
+    
+    // GPU culling system
+    MTL::ComputePipelineState* m_cullComputePSO;      // Frustum cull + compaction kernel
+    MTL::ComputePipelineState* m_resetDrawArgsPSO;    // Resets the indirect draw arguments
+    MTL::Buffer* m_visibleInstanceBuffer;             // Compacted visible instance indices
+    MTL::Buffer* m_grassDrawArgsBuffer;               // Indirect draw arguments (GrassDrawArguments per LOD)
+    MTL::ComputePipelineState* m_sortCellsPSO;        // Orders the cells front to back before the cull
+    MTL::Buffer* m_cellOrderBuffer;                   // Cell indices nearest first (GPU-only)
+    bool m_frontToBackCells;
+    bool m_grassWindPoses;                            // SceneConstants::windPoseDistance at the first LOD distance
+    
+    // Bindless grass resources: one GrassResourceTable per frame slot (shared), bound once per
+    // encoder; the resources it references are declared with one useResources() call
+    MTL::Buffer* m_grassResourceTables[kMaxFramesInFlight];
+    std::vector<MTL::Resource*> m_grassTableResources; // Referenced by this frame's table
+    
+    // Blade LOD system (all LOD meshes share m_vertexBuffer / m_indexBuffer)
+    uint32_t m_grassBucketIndexCount[GRASS_DRAW_BUCKET_COUNT]; // Index count per species LOD mesh
+    uint32_t m_grassBucketIndexStart[GRASS_DRAW_BUCKET_COUNT]; // First index per species LOD mesh
+    uint32_t m_grassBucketBaseVertex[GRASS_DRAW_BUCKET_COUNT]; // First vertex per species LOD mesh
+    float m_lodDistances[GRASS_LOD_COUNT - 1];        // LOD switch distances (meters)
+    float m_lodFadeWidth;                             // Crossfade band width around each switch
+    float m_grassDensityLodDistance;                  // Cells thin out to a prefix of their blades past it (0 = off)
+    int m_grassBladeSegments;                         // Height segments cap of the blade meshes (LOD 0 of the tallest species)
+    
+    // Hi-Z occlusion culling (built from last frame's resolved depth)
+    MTL::ComputePipelineState* m_hiZFromDepthPSO;     // Depth -> Hi-Z level 0
+    MTL::ComputePipelineState* m_hiZDownsamplePSO;    // Hi-Z level N-1 -> level N
+    MTL::Texture* m_hiZTexture;                       // R32Float max-depth pyramid
+    std::vector<MTL::Texture*> m_hiZMipViews;         // Single-level views for the reduction
+    glm::mat4 m_prevViewProj;                         // View-projection of the frame in m_depthTexture
+    bool m_hiZValid;                                  // m_depthTexture holds depth for m_prevViewProj
+    bool m_hiZCullingEnabled;                         // Runtime toggle for occlusion culling
+    
+    // Spatial cell grid (instances sorted by cell)
+    GrassField* m_grassField;                         // CPU-side grid and instances
+    MTL::Buffer* m_cellBuffer;                        // GrassCell array (bounds + instance ranges)
+    InstanceFile* m_instanceFile;                     // Mapped authored field backing both buffers (or null)
+    GrassInstanceEditor* m_grassEditor;               // Edited field in its slack layout (or null), see plantGrass()
+    uint32_t m_grassEditSeed;                         // Random stream of planted blades
+    GrassStreamer* m_grassStreamer;                   // Streamed world chunks replacing the field (or null)
+    bool m_prevCKeyState;
+    
+    // CPU fallback of the cull pass, used when the compute cull is unavailable or with
+    // setCpuCellCulling(true). GPU-placed cells are private, so they are copied back once per
+    // placement (m_cpuCellReadback completes, then the culler takes them); streamed cells are
+    // taken from the frame's shared buffer every frame.
+    CpuCellCuller* m_cpuCellCuller;
+    bool m_cpuCellCulling;
+    bool m_cpuCellsDirty;                             // Culler's cells are stale (field rebuilt)
+    bool m_cpuCulledThisFrame;                        // The grass pass draws the culler's ranges
+    MTL::Buffer* m_cpuCellReadbackBuffer;             // Shared copy of the GPU-placed cells
+    MTL::CommandBuffer* m_cpuCellReadback;            // Placement command buffer filling it (retained)
+    bool m_prevXKeyState;
+    
+    // Procedural placement (GPU-side, fixed blade count per cell)
+    MTL::ComputePipelineState* m_generateGrassPSO;    // Writes instances + cells from seed/density
+    MTL::ComputePipelineState* m_paintGrassDensityPSO; // Density / species brush dabs
+    int m_grassBladesPerCell;                         // Current density
+    uint32_t m_grassInstanceCount;                    // Instance slots currently in m_instanceBuffer
+    uint32_t m_grassInstanceCapacity;                 // Blades the visible list regions and blade states hold
+    GrassDensityMap* m_grassDensityMap;               // Density / species mask read by the placement
+    bool m_grassDensityMapEnabled;
+    MTL::Buffer* m_grassPlacedCountBuffer;            // Blades accepted by the last GPU generation (shared)
+    uint32_t m_grassSeed;                             // Placement seed
+    bool m_prevDensityKeyState;                       // Previous [ / ] key state for step detection
+    bool m_prevBrushButtonState;                      // Left / right mouse button held last frame (density brush)
+    
+    // Mesh shader grass path (object stage culls, mesh stage emits strips); null = classic path
+    MTL::RenderPipelineState* m_meshGrassPSO;
+    
+    // Far-field impostors: cards listed by the cull pass, drawn from a baked atlas
+    GrassImpostorAtlas* m_impostorAtlas;
+    MTL::Buffer* m_impostorBuffer;                    // GrassImpostor per listed cell (GPU-only)
+    MTL::Buffer* m_impostorDrawArgsBuffer;            // GrassImpostorDrawArguments written by the cull pass
+    bool m_impostorsEnabled;                          // Runtime toggle (O key)
+    float m_impostorDistance;                         // Center of the blade-to-card crossfade band
+    float m_impostorFadeWidth;
+    bool m_prevOKeyState;
+    
+    // Sun shadow maps (null when unavailable); the renderer draws their casters
+    ShadowMaps* m_shadowMaps;
+    bool m_shadowMapsEnabled;
+    bool m_shadowMapsActive;                          // Receivers sample the maps this frame
+    bool m_shadowOverlayActive;                       // The overlay is drawn this frame
+    bool m_shadowRedraw[SHADOW_CASCADE_COUNT];        // Cascades drawn this frame
+    std::vector<simd::uint2> m_shadowCasterRanges;    // Cascade 0's grass cells (first instance, count), copied from the culler
+    uint64_t m_shadowStreamerVersion;                 // Streamed chunks the cascades were drawn with
+    PipelineKey m_grassShadowPipelineKey;             // Depth-only caster pipelines
+    PipelineKey m_terrainShadowPipelineKey;
+    PipelineKey m_interactorShadowPipelineKey;
+    
+    // Visibility-buffer grass shading: blade IDs drawn after the scene pass, lit once per pixel
+    bool m_grassVisibilitySupported;                  // Apple GPUs (framebuffer fetch, fragment primitive IDs)
+    bool m_grassVisibilityEnabled;                    // Runtime toggle (V key)
+    bool m_prevVKeyState;
+    
+    // Indirect command buffers: static passes encoded once, grass draws encoded by the GPU
+    MTL::IndirectCommandBuffer* m_sceneICBs[kMaxFramesInFlight]; // Sky, ground LODs, ball (one per uniform slot)
+    MTL::IndirectCommandBuffer* m_grassICB;           // One draw per LOD, written after culling
+    MTL::Buffer* m_grassICBArgumentBuffer;            // Argument buffer exposing m_grassICB to the encode kernel
+    MTL::ComputePipelineState* m_encodeGrassCommandsPSO;
+    bool m_useIndirectCommandBuffers;                 // Runtime toggle (I key)
+    bool m_prevIKeyState;
+    bool m_prevRKeyState;
+    ShaderWatcher* m_shaderWatcher;                   // Watches the shader sources (or null)
+    bool m_prevLKeyState;
+    
+    // GPU timestamp instrumentation
+    GpuProfiler* m_profiler;
+    GpuBreadcrumbs* m_breadcrumbs;                    // Frame command buffer descriptor and fault reports
+    uint64_t m_frameSerial;                           // Frames encoded (breadcrumb reports)
+    FrameCapture* m_frameCapture;                     // Programmatic .gputrace captures
+    int m_captureCount;                               // Documents written from the F12 key
+    bool m_prevF12KeyState;
+    TraceRecorder* m_trace;                           // Chrome trace ring (records while enabled)
+    int m_traceCount;                                 // Traces written from the F11 key
+    bool m_prevF11KeyState;
+    InputRecording* m_inputRecording;                 // Frames since startInputRecording() (null when off)
+    int m_inputRecordingCount;                        // Recordings written from the F10 key
+    bool m_prevF10KeyState;
+    VideoRecorder* m_videoRecorder;                   // Created by the first startVideoRecording()
+    int m_videoCount;                                 // Videos written from the F8 key
+    bool m_prevF8KeyState;
+    struct PendingReadback {
+        ReadbackTarget target;
+        int level;
+        TextureReadback::Callback callback;
+        int deferrals; // Frames the output copy waited for a copyable drawable
+    };
+    TextureReadback* m_readback;                      // Staging pool of the render target readbacks
+    std::vector<PendingReadback> m_pendingReadbacks;  // Requested, copied by the next draw()
+    int m_screenshotCount;                            // Screenshots written from the F7 key
+    bool m_prevF7KeyState;
+    
+    // Heap backing every size-dependent render target (resizes reuse its memory)
+    RenderTargetHeap* m_targetHeap;
+    
+    // Residency set of the long-lived resources (null set before macOS 15), synced every frame
+    GpuResidency* m_residency;
+    std::vector<const MTL::Allocation*> m_residentAllocations; // Scratch for syncResidency()
+    
+    // GPU memory accounting, sampled every kGpuMemorySampleInterval frames; under pressure the
+    // cache budgets below are cut, and restored once the pressure clears
+    GpuMemoryBudget* m_gpuMemory;
+    int m_gpuMemorySampleFrame;
+    size_t m_resourceCacheBudget;     // Set by setResourceCacheBudget()
+    bool m_gpuMemoryShrunk;           // Cache budgets are below their set values
+    
+    // Threadgroup sizes for every compute dispatch, from each pipeline's limits
+    ComputeDispatch* m_computeDispatch;
+    
+    SimulationClock m_simulationClocks[SimulationSystemCount]; // Advanced once per frame in draw()
+    float m_simulationRates[SimulationSystemCount];            // Set rates (the clocks run them scaled)
+    
+    // Power policy state: the scene clock's pauses and how long the frame has been static
+    PowerPolicy m_powerPolicy;
+    bool m_scenePaused;
+    double m_scenePauseStart;         // Wall time the current pause began
+    double m_scenePausedTotal;        // Wall time spent paused before it
+    bool m_inputActive;               // A key or button was held, or the cursor moved, in the last update()
+    double m_idleCursorX;             // Cursor of the last update()
+    double m_idleCursorY;
+    glm::vec3 m_idleCameraPosition;   // Camera pose of the last frame
+    float m_idleCameraYaw;
+    float m_idleCameraPitch;
+    double m_staticSince;             // Wall time the frame stopped changing (< 0: it is changing)
+    bool m_idle;
+    bool m_prevZKeyState;
+    
+    // Work-stealing pool shared by the CPU systems: grass generation, texture decodes, chunk
+    // streaming and, with setParallelEncoding(true), the scene's sub-encoders
+    JobSystem* m_jobSystem;
+    bool m_parallelEncoding;
+    bool m_prevEKeyState;
+    
+    // The scene's draw-order segments and their sub-encoders, refilled every frame (kept so the
+    // frame reuses their storage)
+    typedef std::function<void(MTL::RenderCommandEncoder*)> SceneSegment;
+    std::vector<SceneSegment> m_sceneSegments;
+    std::vector<MTL::RenderCommandEncoder*> m_sceneSegmentEncoders;
+    
+    // Dynamic resolution + MetalFX spatial upscaling (null when unsupported)
+    DynamicResolution* m_dynamicResolution;
+    QualityGovernor* m_qualityGovernor; // Null when off
+    bool m_prevUKeyState;
+    bool m_temporalUpscaling;         // Scene pass is 1x with motion vectors, upscaled by the temporal scaler (or resolved by TAA)
+    bool m_temporalRequested;         // Mode to switch to once its pipelines are built
+    bool m_prevMKeyState;
+    
+    // In-house TAA of the temporal scene pass (null when its resolve kernel is missing)
+    TemporalAntialiasing* m_temporalAntialiasing;
+    MTL::ComputePipelineState* m_temporalResolvePSO;
+    bool m_temporalAntialiasingEnabled;   // The temporal scene pass is resolved by TAA, not the temporal scaler
+    bool m_temporalAntialiasingRequested; // With m_temporalRequested: resolve to switch to
+    bool m_prevFKeyState;
+    
+    // Variable rasterization rate of the scene pass (null when unsupported)
+    VariableRasterizationRate* m_rasterizationRate;
+    PipelineKey m_postRateMappedPipelineKey;  // Post pass reading the scene through the rate map
+    bool m_prevYKeyState;
+    
+    // In-tile post of the 4x scene pass (null when the GPU has no tile shaders; the MSAA scene keys
+    // then carry no tile attachments)
+    MTL::RenderPipelineState* m_tilePostPSO;
+    bool m_tilePostEnabled;
+    bool m_prevQKeyState;
+    Uniforms m_prevUniforms[MAX_RENDER_VIEWS]; // Last frame's uniforms per view (motion vector history)
+    bool m_prevUniformsValid;
+    simd::float2 m_hiZUVScale;        // Render region / target size of the frame that produced the Hi-Z depth
+    
+    // Frame graph (rebuilt every frame; owns the transient MSAA targets)
+    RenderGraph* m_renderGraph;
+    
+    // Pipeline binary cache and asynchronous render pipeline creation
+    PipelineArchive* m_pipelineArchive;
+    PipelineCache* m_pipelineCache;       // Owns m_pso / m_groundPSO / m_ballPSO / m_skyPSO
+    ScenePipelineKeys m_msaaPipelineKeys;     // MSAA scene pass (m_sceneSampleCount)
+    ScenePipelineKeys m_temporalPipelineKeys; // 1x scene pass writing motion vectors (temporal upscaling)
+    NS::UInteger m_sceneSampleCount;          // Of the MSAA keys, the mesh and tile pipelines and the scene targets
+    NS::UInteger m_sceneSampleCountRequested; // Count to switch to once its pipelines are built
+    RenderSettings::Quality m_renderQuality;  // Preset of the last applied settings
+    PipelineKey m_postPipelineKey;            // Fog + tone mapping of the HDR scene into the 8-bit output
+    GrassShadingFeatures m_grassShadingFeatures; // Baked into the grass keys with the trample debug tint
+    bool m_halfPrecisionShading;          // Baked into the grass, ground and sky keys
+    bool m_prevHKeyState;
+    bool m_geometryBlades;                // Baked into the grass keys (and their alpha-to-coverage)
+    bool m_prevGKeyState;
+    bool m_grassDepthPrepass;             // Classic grass path: depth prepass, then shading at equal depth
+    bool m_prevNKeyState;
+    uint64_t m_pipelineGeneration;        // Cache generation the current pipelines were taken from
+    bool m_pipelinesReady;                // All pipelines built and the ICBs encoded
+    
+    // Performance overlay and the stats it shows
+    PerformanceOverlay* m_overlay;
+    bool m_prevF1KeyState;
+    InputLatch m_inputLatch;
+    uint64_t m_lastCameraUpdateNs;       // Latch mode: camera steps use the time between latches
+    float m_cpuFrameMs;                               // Last deltaTime passed to update()
+    MTL::Buffer* m_cullStatsBuffers[kMaxFramesInFlight]; // Shared copies of the draw arguments per frame
+    uint32_t m_visibleBladeCounts[GRASS_LOD_COUNT];   // Read back from the completed frame in this slot
+    bool m_visibleBladeCountsValid;
+    bool m_cullStatsPending[kMaxFramesInFlight];      // Slot holds an unread copy
+    CullUniforms m_microbenchCull;                    // Cull inputs of the last frame (cull microbenchmark)
+    bool m_microbenchCullValid;                       // The last frame ran the compute cull
+    
     // Mouse input tracking
     bool m_firstMouse;
     float m_lastX;
     float m_lastY;
     
     void buildShaders();
+    void syncResidency(); // Hand the current long-lived resources to m_residency
+    void updateGpuMemoryBudget(); // Sample m_gpuMemory when due and shrink or restore the caches
+    void writeGrassResourceTable(); // This frame slot's GrassResourceTable, once per frame before encoding
+    void updateSceneConstants(); // Refresh m_sceneConstants; copies into this frame's slot only if it is stale
+    // Bind the frame's table to the given stages and declare the resources it references
+    void bindGrassResources(MTL::RenderCommandEncoder* encoder, MTL::RenderStages stages) const;
     void buildBuffers(); // Create vertex data
     void buildInstanceBuffer(); // Create instance buffer
+    void generateGrassOnGPU(); // Dispatch the generation kernel into m_instanceBuffer / m_cellBuffer
+    // Generation kernel over the cell rectangle between two corner cells (inclusive); the default,
+    // the whole field, resets the placed count first. False without its inputs
+    bool encodeGrassGeneration(MTL::CommandBuffer* commandBuffer, int firstCell = 0, int lastCell = -1);
+    void encodeCpuCellReadback(MTL::CommandBuffer* commandBuffer); // Host copy of the generated cells for the CPU culler
     void buildTextures(); // Create textures
-    void buildGround(); // Create ground mesh
-    void buildTrampleMaps(); // Create trample map textures
+    void buildGrassAlbedoArray(); // Copy the loaded grass albedo variants into the slices of a new array
+    void buildGround(); // Create the terrain heightmap and the chunk meshes of every LOD
+    void selectTerrainLods(const simd::float3& cameraPosition); // Fill this frame's chunk list by distance
+    void encodeTerrainCommands(MTL::IndirectCommandBuffer* sceneICB); // Ground commands for this frame's chunk list
+    void encodeInteractorCommand(MTL::IndirectCommandBuffer* sceneICB); // Instanced interactor bodies for this frame's count
+    Interactor scriptedInteractor(int index, float time, float prevTime) const; // Orbit lifted onto the terrain
+    Interactor interactorShape(int index) const; // Radii of an interactor this frame (external or scripted)
+    InteractorShape scriptedShape(int index) const; // Cold stream of scripted interactor index
+    NS::UInteger trampleFootprint(float texelsPerMeter) const; // Stamp grid side of the largest interactor, in texels
+    float sceneTime() const;            // Scene clock: fixed time, or wall time less the pauses
+    void applySimulationRates();        // m_simulationRates scaled by the power policy into the clocks
+    void applyQualityGovernorStep();    // The governor's level into the render scale and simulation rates
+    float grassDensityLodDistance() const; // m_grassDensityLodDistance thinned by the governor
+    double presentInterval();           // Minimum seconds on screen for this frame's drawable (0 = none)
+    bool isBladePhysicsActive() const;
+    MTL::Buffer* grassBladeStateBuffer() const; // Bound to the grass stages (a placeholder while blade physics is off)
+    void buildTrampleMaps(); // Create and clear the trample map
+    void buildWindField();
+    WindGustUniforms prepareWindGusts(); // This frame's spawns and step (empty when no gust is live)
+    void encodeWindGusts(MTL::ComputeCommandEncoder* computeEncoder, const WindGustUniforms& gusts);
+    bool buildWindFluid();     // Zeroed fluid buffers (on the first setWindFluid(true))
+    void buildAtmosphereLut();
+    void buildLightClusters(); // Point light arrays and the cluster lists
+    bool ensureTrampleStagingBuffer(); // Snapshot staging buffer, created on first use
+    void buildCullingBuffers(); // Create visible instance list and indirect draw arguments
+    bool buildVisibleInstanceBuffer(); // Bucket regions and identity region for m_grassInstanceCapacity blades
+    bool ensureGrassInstanceCapacity(uint32_t count); // Grow the per-blade lists (waits for the GPU)
+    // First visible list entry of the identity region, after the cull pass's bucket regions
+    uint32_t identityVisibleBase() const { return m_grassInstanceCapacity * GRASS_DRAW_BUCKET_COUNT; }
+    void buildImpostors();      // Atlas and card buffers, then the first bake
+    void buildShadowMaps();     // Shadow map textures and the caster pipelines
+    void bakeGrassImpostors();  // Re-render the atlas patches from the current instances
+    int impostorSourceCell(int variant) const; // Cell an atlas variant is baked from
+    void buildIndirectCommandBuffers(); // Encode the static passes once and prepare the GPU-encoded grass ICB
+    void buildHiZPyramid(int width, int height); // Create Hi-Z texture and per-level views
+    void releaseHiZPyramid();
+    void encodeHiZBuild(MTL::ComputeCommandEncoder* encoder); // Reduce m_depthTexture into the pyramid
+    // Reset the draw arguments, optionally build Hi-Z and sort the cells, cull, and optionally write the grass ICB
+    void encodeGrassCull(MTL::ComputeCommandEncoder* cullEncoder, const CullUniforms& cullUniforms,
+                         bool useHiZ, bool useGrassICB, bool sortCells);
+    void encodeGrassInstances(MTL::RenderCommandEncoder* renderEncoder, MTL::RenderPipelineState* pipeline,
+                              bool useGrassICB, bool useIndirectGrassDraw,
+                              NS::UInteger uniformOffset, int firstBucket = 0,
+                              int bucketCount = GRASS_DRAW_BUCKET_COUNT); // Culled instanced grass draws (of the given buckets) for the view at uniformOffset
+    bool finishPipelineBuild(); // Swap in finished pipelines and (re-)encode the ICBs; true once every pipeline exists
+    void reloadShaders();       // Rebuild the scene pipelines from a freshly loaded library
+    void applyShaderHotReload(); // Rebuild the pipelines using functions the watcher recompiled
+    // Blades and cells the cull and draw passes read this frame: the streamed pool or the field
+    MTL::Buffer* grassInstanceBuffer() const;
+    MTL::Buffer* grassCellBuffer() const;
+    uint32_t grassCellCount() const;
+    void updateCpuCells();      // Hand the CPU culler the current cells (streamed: every frame)
+    // Follow the camera and the sun; pick the cascades redrawn this frame and list cascade 0's blades
+    void prepareShadowMaps(const glm::vec3& cameraPosition);
+    // Casters of one shadow map: terrain (and blades) into a cascade, the interactor bodies into the overlay
+    void encodeShadowMap(MTL::RenderCommandEncoder* encoder, int map, MTL::Buffer* interactorBuffer);
+    // Command buffer of the frame queue for work outside the render graph (uploads, rebuilds):
+    // the next frame keeps its async compute passes behind it
+    MTL::CommandBuffer* newOutOfGraphCommandBuffer();
+    bool beginGrassEditing();   // Move the field into m_grassEditor and its own buffers; false while streaming
+    void discardGrassEdits();   // Drop m_grassEditor (the caller rewrites both buffers)
+    void flushGrassEdits();     // Upload the slots edited since the last frame (own command buffer)
+    // Slots of live edited blades within radius of center, in cell order
+    std::vector<uint32_t> grassSlotsInRadius(simd::float2 center, float radius) const;
+    void encodeSceneICBs();     // Encode the static passes (again after a pipeline swap)
+    void applyTemporalUpscaling(); // Switch scene pipelines to m_temporalRequested (and the resolve) once they are built
+    void requestTemporalScenePass(bool temporal); // Set m_temporalRequested and start building its pipelines
+    ScenePipelineKeys msaaPipelineKeys(NS::UInteger sampleCount) const; // The MSAA scene keys at another sample count
+    void applySceneSampleCount();  // Switch the MSAA pipelines to m_sceneSampleCountRequested once they are built
+    ScenePipelineKeys objectIdPipelineKeys(const ScenePipelineKeys& keys, bool enabled) const; // keys with or without the ID attachment
+    void applyObjectIds();         // Switch the scene pipelines to m_objectIdsRequested once they are built
+    void renderOverlay(MTL::RenderPassDescriptor* renderPassDescriptor, MTL::CommandBuffer* commandBuffer,
+                       MTL::RenderCommandEncoder* renderEncoder);
+    MTL::ComputePipelineState* buildComputePipeline(MTL::Library* library, const char* functionName);
+    void buildMeshGrassPipeline(MTL::Library* library); // (Re)build m_meshGrassPSO with the current grass permutation
+    void buildTilePostPipeline(MTL::Library* library);  // m_tilePostPSO, where the GPU supports tile shaders
+    std::vector<PipelineConstant> grassFeatureConstants() const; // Trample debug tint + GrassShadingFeatures
+    PipelineConstant halfPrecisionConstant() const;
+    PipelineConstant geometryBladesConstant() const;
+    PipelineConstant sparseGroundConstant() const;
+    void updateShadingPipelineKeys(); // Put grassFeatureConstants(), the blade mode, the precision and the ground mode into the scene keys
+    void updateGrassPermutation();  // After a feature change: re-key and rebuild the grass pipelines
+    void buildBladeMeshes(MTL::BlitCommandEncoder* uploadEncoder); // Shared blade LOD meshes, capped at m_grassBladeSegments
+    bool buildTrampleTextures(int size); // Trample map, summary pyramid and dirty tiles (released first)
+    void releaseTrampleTextures();
     void createSphereMesh(float radius, int radialSegments, int verticalSegments,
                           std::vector<Vertex>& vertices, std::vector<uint16_t>& indices);
 };
\ No newline at end of file
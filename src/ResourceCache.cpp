@@ -0,0 +1,171 @@
+#include "ResourceCache.hpp"
+#include "Texture.hpp"
+#include "UploadRing.hpp"
+#include <cstdio>
+#include <iostream>
+
+ResourceCache::ResourceCache(TextureLoader* textureLoader, UploadRing* uploadRing, size_t budgetBytes)
+    : m_textureLoader(textureLoader)
+    , m_uploadRing(uploadRing)
+    , m_budgetBytes(budgetBytes)
+    , m_residentBytes(0)
+    , m_useCounter(0)
+{
+}
+
+ResourceCache::~ResourceCache()
+{
+    for (auto& [key, entry] : m_entries) {
+        destroy(entry);
+    }
+}
+
+Texture* ResourceCache::acquireTexture(const std::vector<std::string>& candidatePaths, uint32_t placeholderRGBA,
+                                       TextureLoader::LoadedCallback onLoaded)
+{
+    // Key: every candidate (the fallback order is part of the asset) plus the placeholder color
+    char placeholder[16];
+    std::snprintf(placeholder, sizeof(placeholder), "#%08x", placeholderRGBA);
+    std::string key = "texture:";
+    for (const std::string& path : candidatePaths) {
+        key += path + "|";
+    }
+    key += placeholder;
+
+    auto found = m_entries.find(key);
+    if (found != m_entries.end()) {
+        Entry& entry = found->second;
+        ++entry.refCount;
+        entry.lastUse = ++m_useCounter;
+        if (onLoaded) {
+            if (entry.loading) {
+                entry.waiting.push_back(onLoaded);
+            } else {
+                onLoaded(entry.texture, entry.loaded);
+            }
+        }
+        return entry.texture;
+    }
+
+    Entry entry = { nullptr, nullptr, 1, true, false, 0, ++m_useCounter, {} };
+    if (onLoaded) {
+        entry.waiting.push_back(onLoaded);
+    }
+    Entry& inserted = m_entries.emplace(key, std::move(entry)).first->second;
+    inserted.texture = m_textureLoader->load(candidatePaths, placeholderRGBA, [this, key](Texture* texture, bool loaded) {
+        onTextureLoaded(key, texture, loaded);
+    });
+    m_keys[inserted.texture] = key;
+    return inserted.texture;
+}
+
+void ResourceCache::onTextureLoaded(const std::string& key, Texture* texture, bool loaded)
+{
+    auto found = m_entries.find(key);
+    if (found == m_entries.end()) {
+        return;
+    }
+    Entry& entry = found->second;
+    entry.loading = false; // A failed load is evictable too (its placeholder is all there is)
+    entry.loaded = loaded;
+    MTL::Texture* metalTexture = texture->getMetalTexture();
+    entry.bytes = metalTexture ? metalTexture->allocatedSize() : 0;
+    m_residentBytes += entry.bytes;
+
+    // The callbacks may acquire or release, so run them from a copy
+    std::vector<TextureLoader::LoadedCallback> waiting;
+    waiting.swap(entry.waiting);
+    for (const TextureLoader::LoadedCallback& onLoaded : waiting) {
+        onLoaded(texture, loaded);
+    }
+    evict();
+}
+
+MTL::Buffer* ResourceCache::acquireBuffer(const std::string& key, MTL::BlitCommandEncoder* blitEncoder, const void* data, size_t size)
+{
+    std::string bufferKey = "buffer:" + key;
+    auto found = m_entries.find(bufferKey);
+    if (found != m_entries.end()) {
+        ++found->second.refCount;
+        found->second.lastUse = ++m_useCounter;
+        return found->second.buffer;
+    }
+
+    MTL::Buffer* buffer = m_uploadRing->newPrivateBuffer(blitEncoder, data, size);
+    if (!buffer) {
+        return nullptr;
+    }
+    Entry entry = { nullptr, buffer, 1, false, true, buffer->allocatedSize(), ++m_useCounter, {} };
+    m_entries.emplace(bufferKey, std::move(entry));
+    m_keys[buffer] = bufferKey;
+    m_residentBytes += buffer->allocatedSize();
+    evict();
+    return buffer;
+}
+
+void ResourceCache::release(Texture* texture)
+{
+    releaseKey(texture);
+}
+
+void ResourceCache::release(MTL::Buffer* buffer)
+{
+    releaseKey(buffer);
+}
+
+void ResourceCache::releaseKey(const void* resource)
+{
+    auto key = m_keys.find(resource);
+    if (key == m_keys.end()) {
+        std::cerr << "ResourceCache: released a resource it does not own" << std::endl;
+        return;
+    }
+    Entry& entry = m_entries[key->second];
+    if (entry.refCount <= 0) {
+        std::cerr << "ResourceCache: " << key->second << " released more often than acquired" << std::endl;
+        return;
+    }
+    --entry.refCount;
+    entry.lastUse = ++m_useCounter;
+    evict();
+}
+
+void ResourceCache::setBudget(size_t budgetBytes)
+{
+    m_budgetBytes = budgetBytes;
+    evict();
+}
+
+void ResourceCache::evict()
+{
+    while (m_residentBytes > m_budgetBytes) {
+        auto oldest = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            const Entry& entry = it->second;
+            if (entry.refCount == 0 && !entry.loading && (oldest == m_entries.end() || entry.lastUse < oldest->second.lastUse)) {
+                oldest = it;
+            }
+        }
+        if (oldest == m_entries.end()) {
+            return; // Everything left is in use
+        }
+        m_residentBytes -= oldest->second.bytes;
+        m_keys.erase(oldest->second.texture ? static_cast<const void*>(oldest->second.texture)
+                                            : static_cast<const void*>(oldest->second.buffer));
+        destroy(oldest->second);
+        m_entries.erase(oldest);
+    }
+}
+
+void ResourceCache::destroy(Entry& entry)
+{
+    // Frames in flight keep the Metal objects alive (their command buffers retain them)
+    if (entry.texture) {
+        delete entry.texture;
+        entry.texture = nullptr;
+    }
+    if (entry.buffer) {
+        m_uploadRing->releasePrivateBuffer(entry.buffer);
+        entry.buffer = nullptr;
+    }
+}
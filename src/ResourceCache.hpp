@@ -0,0 +1,60 @@
+#pragma once
+#include "TextureLoader.hpp"
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class Texture;
+class UploadRing;
+
+// Shared textures and static mesh buffers, keyed by path and load options: every acquire of
+// the same key returns the same object, so an asset costs one load and one upload however many
+// materials reference it. A second acquire while the first load is still in flight shares it
+// (its onLoaded waits too). Released entries stay cached and are evicted least recently used
+// first once the resident size exceeds the budget; referenced (or loading) entries never are.
+// Render thread only (TextureLoader runs its callbacks inside update()).
+class ResourceCache {
+public:
+    ResourceCache(TextureLoader* textureLoader, UploadRing* uploadRing, size_t budgetBytes = 256 * 1024 * 1024);
+    ~ResourceCache(); // Frees every entry, referenced or not
+
+    // Texture from the first candidate that loads (see TextureLoader::load); one reference per call.
+    // onLoaded runs once the real texture is swapped in (or the load failed), right away if it already did.
+    Texture* acquireTexture(const std::vector<std::string>& candidatePaths, uint32_t placeholderRGBA,
+                            TextureLoader::LoadedCallback onLoaded = nullptr);
+    // Private buffer named key; data is uploaded through blitEncoder only on the first acquire
+    MTL::Buffer* acquireBuffer(const std::string& key, MTL::BlitCommandEncoder* blitEncoder, const void* data, size_t size);
+    void release(Texture* texture);
+    void release(MTL::Buffer* buffer);
+
+    void setBudget(size_t budgetBytes); // Evicts right away if the cache is over the new budget
+    size_t getBudget() const { return m_budgetBytes; }
+    size_t getResidentBytes() const { return m_residentBytes; }
+
+private:
+    struct Entry {
+        Texture* texture;
+        MTL::Buffer* buffer;
+        int refCount;
+        bool loading;   // The loader still holds the texture (never evicted)
+        bool loaded;    // The real texture arrived (false: failed, the placeholder stays)
+        size_t bytes;   // Counted once loaded
+        uint64_t lastUse;
+        std::vector<TextureLoader::LoadedCallback> waiting; // onLoaded of every acquire during the load
+    };
+
+    void onTextureLoaded(const std::string& key, Texture* texture, bool loaded);
+    void releaseKey(const void* resource);
+    void evict();
+    void destroy(Entry& entry);
+
+    TextureLoader* m_textureLoader;
+    UploadRing* m_uploadRing;
+    size_t m_budgetBytes;
+    size_t m_residentBytes;
+    uint64_t m_useCounter;                       // Ticks on every acquire and release (LRU order)
+    std::map<std::string, Entry> m_entries;
+    std::map<const void*, std::string> m_keys;   // Texture / buffer -> its entry
+};
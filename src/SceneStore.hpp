@@ -0,0 +1,325 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Handle of an entity in a SceneStore: stays valid while the entity exists, whatever moves
+// around it (index into the handle table, generation to reject handles of removed entities)
+struct SceneHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool isValid() const { return index != UINT32_MAX; }
+};
+
+// Handle bookkeeping shared by the stores: a table entry per handle, pointing at its record in
+// the dense arrays, and the handle of every record (removal moves the last record into the hole)
+class SceneHandleTable {
+public:
+    size_t size() const { return m_recordHandles.size(); }
+
+    SceneHandle add() // For the record appended at size()
+    {
+        uint32_t handleIndex;
+        if (!m_freeHandles.empty()) {
+            handleIndex = m_freeHandles.back();
+            m_freeHandles.pop_back();
+        } else {
+            handleIndex = static_cast<uint32_t>(m_handleRecords.size());
+            m_handleRecords.push_back(0);
+            m_generations.push_back(0);
+        }
+        m_handleRecords[handleIndex] = static_cast<uint32_t>(m_recordHandles.size());
+        m_recordHandles.push_back(handleIndex);
+        return { handleIndex, m_generations[handleIndex] };
+    }
+
+    bool contains(SceneHandle handle) const
+    {
+        return handle.index < m_handleRecords.size() && m_generations[handle.index] == handle.generation &&
+               m_handleRecords[handle.index] != UINT32_MAX;
+    }
+
+    uint32_t record(SceneHandle handle) const { return m_handleRecords[handle.index]; } // contains() first
+    SceneHandle handleAt(uint32_t record) const
+    {
+        uint32_t handleIndex = m_recordHandles[record];
+        return { handleIndex, m_generations[handleIndex] };
+    }
+
+    // Frees the handle of record; the caller moves the last record into it (when it is not the last)
+    void remove(SceneHandle handle)
+    {
+        uint32_t recordIndex = m_handleRecords[handle.index];
+        uint32_t last = static_cast<uint32_t>(m_recordHandles.size() - 1);
+        if (recordIndex != last) {
+            m_recordHandles[recordIndex] = m_recordHandles[last];
+            m_handleRecords[m_recordHandles[recordIndex]] = recordIndex;
+        }
+        m_recordHandles.pop_back();
+        m_handleRecords[handle.index] = UINT32_MAX;
+        m_generations[handle.index]++;
+        m_freeHandles.push_back(handle.index);
+    }
+
+    void clear()
+    {
+        for (uint32_t handleIndex : m_recordHandles) {
+            m_handleRecords[handleIndex] = UINT32_MAX;
+            m_generations[handleIndex]++;
+            m_freeHandles.push_back(handleIndex);
+        }
+        m_recordHandles.clear();
+    }
+
+private:
+    std::vector<uint32_t> m_recordHandles;  // Handle table entry of each record
+    std::vector<uint32_t> m_handleRecords;  // Record of each handle table entry (UINT32_MAX = free)
+    std::vector<uint32_t> m_generations;    // Bumped when a handle table entry is freed
+    std::vector<uint32_t> m_freeHandles;
+};
+
+// Records written since each slot's last upload, as one range per slot
+template <int Slots>
+class SceneDirtyRanges {
+public:
+    void mark(uint32_t begin, uint32_t end)
+    {
+        for (Range& range : m_ranges) {
+            range.begin = std::min(range.begin, begin);
+            range.end = std::max(range.end, end);
+        }
+    }
+
+    // Copy the slot's range of source (clamped to count and capacity) into buffer, which holds
+    // one element per record; returns the elements copied. Without a buffer the range stays.
+    template <typename T>
+    size_t upload(int slot, MTL::Buffer* buffer, const T* source, size_t count, size_t capacity)
+    {
+        size_t begin = 0;
+        size_t end = take(slot, buffer, count, capacity, begin);
+        if (begin < end) {
+            std::memcpy(static_cast<T*>(buffer->contents()) + begin, source + begin, (end - begin) * sizeof(T));
+        }
+        return end > begin ? end - begin : 0;
+    }
+
+    // The slot's range clamped to count and capacity ([begin, returned end)), cleared when buffer is set
+    size_t take(int slot, MTL::Buffer* buffer, size_t count, size_t capacity, size_t& begin)
+    {
+        Range& range = m_ranges[slot];
+        begin = range.begin;
+        size_t end = buffer ? std::min({ static_cast<size_t>(range.end), count, capacity }) : 0;
+        if (buffer) {
+            range = Range();
+        }
+        return end;
+    }
+
+private:
+    struct Range {
+        uint32_t begin = UINT32_MAX;
+        uint32_t end = 0;
+    };
+    Range m_ranges[Slots];
+};
+
+// Dense store of GPU-visible scene entities (point lights) for Slots per-frame buffers.
+// Records stay packed in [0, size()) in the layout the shaders read, so the GPU takes a prefix
+// and uploads are plain copies; removal moves the last record into the hole. Writes widen one
+// dirty range per slot, and upload() copies only that slot's range, so the per-frame cost
+// follows the changed entities, not the store size. Lights stay whole records: the cluster pass
+// and the shading read every field of a light together, and none of them changes per frame.
+template <typename Record, int Slots>
+class SceneStore {
+public:
+    size_t size() const { return m_records.size(); }
+    bool empty() const { return m_records.empty(); }
+    const Record* data() const { return m_records.data(); }
+
+    SceneHandle add(const Record& record)
+    {
+        SceneHandle handle = m_handles.add();
+        m_records.push_back(record);
+        uint32_t recordIndex = static_cast<uint32_t>(m_records.size() - 1);
+        m_dirty.mark(recordIndex, recordIndex + 1);
+        return handle;
+    }
+
+    bool contains(SceneHandle handle) const { return m_handles.contains(handle); }
+    const Record* get(SceneHandle handle) const { return contains(handle) ? &m_records[m_handles.record(handle)] : nullptr; }
+
+    bool update(SceneHandle handle, const Record& record)
+    {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t recordIndex = m_handles.record(handle);
+        m_records[recordIndex] = record;
+        m_dirty.mark(recordIndex, recordIndex + 1);
+        return true;
+    }
+
+    bool remove(SceneHandle handle)
+    {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t recordIndex = m_handles.record(handle);
+        uint32_t last = static_cast<uint32_t>(m_records.size() - 1);
+        if (recordIndex != last) {
+            m_records[recordIndex] = m_records[last];
+            m_dirty.mark(recordIndex, recordIndex + 1);
+        }
+        m_records.pop_back();
+        m_handles.remove(handle);
+        return true;
+    }
+
+    // Replace every record (handles of the previous ones become invalid); new handles in order
+    void assign(const Record* records, size_t count, std::vector<SceneHandle>* handles = nullptr)
+    {
+        clear();
+        for (size_t i = 0; i < count; ++i) {
+            SceneHandle handle = add(records[i]);
+            if (handles) {
+                handles->push_back(handle);
+            }
+        }
+    }
+
+    void clear()
+    {
+        m_handles.clear();
+        m_records.clear();
+    }
+
+    // Copy the records written since this slot's last upload into its buffer (at most capacity
+    // records); returns the records copied
+    size_t upload(int slot, MTL::Buffer* buffer, size_t capacity)
+    {
+        return m_dirty.upload(slot, buffer, m_records.data(), m_records.size(), capacity);
+    }
+
+    // Every record goes out again (e.g. the slot buffers were recreated)
+    void markAllDirty() { m_dirty.mark(0, static_cast<uint32_t>(m_records.size())); }
+
+private:
+    std::vector<Record> m_records;  // Packed, GPU layout
+    SceneHandleTable m_handles;
+    SceneDirtyRanges<Slots> m_dirty;
+};
+
+// Structure-of-arrays store for entities that move (interactors, gust emitters): each entity is
+// split into a Hot part, rewritten as it moves, and a Cold part set when it is added and rarely
+// after, kept in separate dense arrays with a dirty range each. A frame that moves every entity
+// marks only the hot range, so only the hot fields go out again. The GPU either reads the streams
+// as arrays of their own (uploadHot() / uploadCold() into one buffer each) or whole records,
+// which uploadRecords() fills field by field (Hot::writeTo / Cold::writeTo into that Record type)
+// from the dirty part of each stream only.
+template <typename Hot, typename Cold, int Slots>
+class SceneArrayStore {
+public:
+    size_t size() const { return m_hot.size(); }
+    bool empty() const { return m_hot.empty(); }
+    const Hot* hot() const { return m_hot.data(); }
+    const Cold* cold() const { return m_cold.data(); }
+    SceneHandle handleAt(size_t index) const { return m_handles.handleAt(static_cast<uint32_t>(index)); }
+
+    SceneHandle add(const Hot& hot, const Cold& cold)
+    {
+        SceneHandle handle = m_handles.add();
+        m_hot.push_back(hot);
+        m_cold.push_back(cold);
+        uint32_t index = static_cast<uint32_t>(m_hot.size() - 1);
+        m_hotDirty.mark(index, index + 1);
+        m_coldDirty.mark(index, index + 1);
+        return handle;
+    }
+
+    bool contains(SceneHandle handle) const { return m_handles.contains(handle); }
+    const Hot* getHot(SceneHandle handle) const { return contains(handle) ? &m_hot[m_handles.record(handle)] : nullptr; }
+    const Cold* getCold(SceneHandle handle) const { return contains(handle) ? &m_cold[m_handles.record(handle)] : nullptr; }
+
+    bool updateHot(SceneHandle handle, const Hot& hot) { return write(handle, m_hot, m_hotDirty, hot); }
+    bool updateCold(SceneHandle handle, const Cold& cold) { return write(handle, m_cold, m_coldDirty, cold); }
+
+    bool remove(SceneHandle handle)
+    {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t index = m_handles.record(handle);
+        uint32_t last = static_cast<uint32_t>(m_hot.size() - 1);
+        if (index != last) {
+            m_hot[index] = m_hot[last];
+            m_cold[index] = m_cold[last];
+            m_hotDirty.mark(index, index + 1);
+            m_coldDirty.mark(index, index + 1);
+        }
+        m_hot.pop_back();
+        m_cold.pop_back();
+        m_handles.remove(handle);
+        return true;
+    }
+
+    void clear()
+    {
+        m_handles.clear();
+        m_hot.clear();
+        m_cold.clear();
+    }
+
+    // Each stream's dirty range into a buffer of its own (at most capacity entries); returns the entries copied
+    size_t uploadHot(int slot, MTL::Buffer* buffer, size_t capacity) { return m_hotDirty.upload(slot, buffer, m_hot.data(), m_hot.size(), capacity); }
+    size_t uploadCold(int slot, MTL::Buffer* buffer, size_t capacity) { return m_coldDirty.upload(slot, buffer, m_cold.data(), m_cold.size(), capacity); }
+
+    // Both dirty ranges into the slot's array of whole records (at most capacity); returns the
+    // records written to
+    template <typename Record>
+    size_t uploadRecords(int slot, MTL::Buffer* buffer, size_t capacity)
+    {
+        Record* records = buffer ? static_cast<Record*>(buffer->contents()) : nullptr;
+        size_t hotBegin = 0;
+        size_t hotEnd = m_hotDirty.take(slot, buffer, m_hot.size(), capacity, hotBegin);
+        for (size_t i = hotBegin; i < hotEnd; ++i) {
+            m_hot[i].writeTo(records[i]);
+        }
+        size_t coldBegin = 0;
+        size_t coldEnd = m_coldDirty.take(slot, buffer, m_cold.size(), capacity, coldBegin);
+        for (size_t i = coldBegin; i < coldEnd; ++i) {
+            m_cold[i].writeTo(records[i]);
+        }
+        size_t begin = std::min(hotBegin, coldBegin);
+        size_t end = std::max(hotEnd, coldEnd);
+        return end > begin ? end - begin : 0;
+    }
+
+    // Every entry goes out again (e.g. the GPU rewrote the slot buffers)
+    void markAllDirty()
+    {
+        m_hotDirty.mark(0, static_cast<uint32_t>(m_hot.size()));
+        m_coldDirty.mark(0, static_cast<uint32_t>(m_cold.size()));
+    }
+
+private:
+    template <typename T>
+    bool write(SceneHandle handle, std::vector<T>& stream, SceneDirtyRanges<Slots>& dirty, const T& value)
+    {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t index = m_handles.record(handle);
+        stream[index] = value;
+        dirty.mark(index, index + 1);
+        return true;
+    }
+
+    std::vector<Hot> m_hot;   // Packed, one entry per entity
+    std::vector<Cold> m_cold;
+    SceneHandleTable m_handles;
+    SceneDirtyRanges<Slots> m_hotDirty;
+    SceneDirtyRanges<Slots> m_coldDirty;
+};
@@ -6,12 +6,138 @@
     // Metal has built-in types: float2, float3, float4, float4x4
 #else
     #include <simd/simd.h>
+    #include <cstdint>
+    using uint = uint32_t;
     using float2 = simd::float2;
     using float3 = simd::float3;
     using float4 = simd::float4;
     using float4x4 = simd::float4x4;
+    using uint2 = simd::uint2;
+    using uint4 = simd::uint4;
 #endif
 
+// Stamp time of trample map texels the ball never touched (decayed to 0 at any decay rate)
+#define TRAMPLE_NEVER_STAMPED -1.0e6f
+
+// Blades whose root is trampled at least this hard are culled; weaker trampling flattens them
+#define TRAMPLE_CULL_THRESHOLD 0.5f
+
+// Trample summary pyramid: the base level holds the min / max stamp time of each
+// TRAMPLE_SUMMARY_TILE x TRAMPLE_SUMMARY_TILE block of the map's storage (toroidal, like the map)
+#define TRAMPLE_SUMMARY_TILE 32
+
+// Trampled soil under the flattened blades (ground fragment stage, same trample map): darkening
+// at full strength and the depth of the footprint the ground normal is bent by
+#define GROUND_TRAMPLE_DARKENING 0.35f
+#define GROUND_TRAMPLE_DEPTH 0.03f
+
+// Trample interactors (ball, players, NPCs, vehicles), binned over the trample window on a
+// grid whose cells are 32x32-texel tiles of the 1024x1024 trample map
+#define MAX_INTERACTORS 256 // Also the physics threadgroup size (one thread per body)
+#define INTERACTOR_BIN_GRID 32 // Bins per side
+#define INTERACTOR_BIN_CAPACITY 8 // Interactors listed per bin (further overlaps are dropped)
+#define INTERACTOR_MIN_RADIUS 0.05f // Footprint and body radii an external producer is held to (meters)
+#define INTERACTOR_MAX_RADIUS 4.0f
+#define INTERACTOR_BLOB_SHADOW_SCALE 1.2f // Blob shadow radius relative to the interactor radius
+
+// Wind field: texels per side over the ground bounds (also the cells of the optional fluid grid,
+// fine enough for the wakes of interactors)
+#define WIND_FIELD_SIZE 128
+#define WIND_MAX_GUSTS 16 // Gust emitters injecting into the wind fluid per frame
+#define WIND_MAX_GUST_PARTICLES 256 // GPU gust particles alive at once (a new one replaces the oldest)
+#define WIND_MAX_GUST_SPAWNS 32 // Gust particles spawned per frame (further spawns are dropped)
+
+// Number of blade mesh LODs (7 / 3 / 1 height segments)
+#define GRASS_LOD_COUNT 3
+
+// Slices of the grass albedo array (grass_albedo.png, grass_albedo_2.png, ...); each blade picks one
+#define GRASS_ALBEDO_VARIANT_COUNT 3
+
+// Vegetation species (grass blades, clover, flowers): each has its own LOD meshes in the shared
+// blade vertex / index buffers and its own material. The cull pass appends every blade to the draw
+// bucket of its species and LOD (bucket = species * GRASS_LOD_COUNT + lod), one indirect draw each,
+// so a species adds GRASS_LOD_COUNT draws whatever its instance count.
+#define GRASS_SPECIES_COUNT 3
+#define GRASS_SPECIES_GRASS 0
+#define GRASS_SPECIES_CLOVER 1
+#define GRASS_SPECIES_FLOWERS 2
+#define GRASS_DRAW_BUCKET_COUNT (GRASS_SPECIES_COUNT * GRASS_LOD_COUNT)
+
+// Blade albedo palette (GrassPalette.cpp): texels along the blade (odd, so the gradient's middle
+// stop lands on one) by rows of per-blade variation; a fresh and a withered slice per species
+#define GRASS_PALETTE_WIDTH 33
+#define GRASS_PALETTE_HEIGHT 8
+
+// Share of the placed blades that are clover and flowers (the rest are grass blades)
+#define GRASS_SPECIES_CLOVER_SHARE 0.12f
+#define GRASS_SPECIES_FLOWERS_SHARE 0.05f
+
+// Mesh shader grass path: blades culled per object threadgroup, blades emitted per mesh threadgroup
+#define GRASS_MESH_OBJECT_THREADS 32 // Blades tested by one object threadgroup
+#define GRASS_MESH_PAYLOAD_CAPACITY (GRASS_MESH_OBJECT_THREADS * 2) // Crossfading blades appear twice
+#define GRASS_MESH_BLADES_PER_GROUP 8 // Blades emitted by one mesh threadgroup
+#define GRASS_MESH_MAX_VERTICES 128 // 8 blades x 16 vertices (7-segment strip)
+#define GRASS_MESH_MAX_PRIMITIVES 112 // 8 blades x 14 triangles
+
+// Far-field grass impostors: an atlas of baked grass patches, one column per view elevation and
+// one row per patch variant, IMPOSTOR_FRAME_SIZE texels per square frame
+#define IMPOSTOR_ELEVATION_COUNT 4
+#define IMPOSTOR_VARIANT_COUNT 2
+#define IMPOSTOR_FRAME_SIZE 256
+
+// Heightmap terrain: one chunk per grass cell, TERRAIN_CHUNK_QUADS quads per side at LOD 0 (one
+// per heightmap sample spacing), halved at every further LOD. The heightmap holds one height per
+// quad corner of the LOD 0 grid over the field.
+#define TERRAIN_CHUNKS_PER_SIDE 16
+#define TERRAIN_CHUNK_QUADS 8
+#define TERRAIN_LOD_COUNT 4 // 8 / 4 / 2 / 1 quads per chunk side
+#define TERRAIN_HEIGHTMAP_SIZE (TERRAIN_CHUNKS_PER_SIDE * TERRAIN_CHUNK_QUADS + 1)
+#define TERRAIN_SKIRT_DEPTH 0.5f // Chunk skirts hide the cracks between neighbouring LODs
+
+// Ground albedo: the tiled texture repeats GROUND_TEXTURE_TILING times across the field. The
+// sparse ground texture covers the field once at SPARSE_GROUND_SIZE texels per side; its tiles
+// are mapped on demand from the ground fragment feedback (one pixel per
+// SPARSE_GROUND_FEEDBACK_CELL x SPARSE_GROUND_FEEDBACK_CELL block writes it).
+#define GROUND_TEXTURE_TILING 20.0f
+#define SPARSE_GROUND_SIZE 8192
+#define SPARSE_GROUND_MAX_LEVELS 14 // Full mip chain of SPARSE_GROUND_SIZE
+#define SPARSE_GROUND_FEEDBACK_CELL 4
+
+// Atmosphere LUT: sky radiance by view direction, rebuilt only when the sun changes. Columns span
+// the angle between the view and the sun (0..pi), rows the sine of the view elevation.
+#define ATMOSPHERE_LUT_WIDTH 128
+#define ATMOSPHERE_LUT_HEIGHT 64
+#define ATMOSPHERE_LUT_MIN_ELEVATION -0.2f // Sine of the lowest row (below the horizon for the fog)
+// Exposure lift of the post pass before its Reinhard tone map; the atmosphere LUT stores linear
+// radiance that this exposure and tone map bring back to the intended sky colors
+#define POST_EXPOSURE 1.12f
+
+// Sun shadow maps: SHADOW_CASCADE_COUNT cascades around the camera hold the static casters
+// (terrain, blades at rest) and are redrawn only when the sun, the grass cells or the cascade's
+// snapped region change; one more map, redrawn every frame, holds the dynamic casters (the
+// interactor bodies). Blades take the finest cascade covering them and the overlay, one
+// comparison sample each (2x2 hardware PCF).
+#define SHADOW_CASCADE_COUNT 2
+#define SHADOW_MAP_COUNT (SHADOW_CASCADE_COUNT + 1) // Map SHADOW_CASCADE_COUNT is the dynamic overlay
+
+// Blade instances sit this far above the ground: the blade meshes start 0.5 below their origin
+#define GRASS_INSTANCE_ELEVATION 0.5f
+
+// Multi-view rendering: cameras drawn per frame from one cull pass. View v's Uniforms start
+// UNIFORMS_VIEW_STRIDE * v bytes into the uniform buffer (a buffer offset every GPU accepts).
+#define MAX_RENDER_VIEWS 4
+#define UNIFORMS_VIEW_STRIDE 1024
+
+// Clustered point lights: each view's frustum is split into screen tiles and exponential depth
+// slices (froxels), and the cluster pass lists the lights touching each one, so a fragment only
+// visits the lights of its own cluster. Further lights of a crowded cluster are dropped.
+#define MAX_POINT_LIGHTS 1024
+#define LIGHT_CLUSTER_TILES_X 16
+#define LIGHT_CLUSTER_TILES_Y 8
+#define LIGHT_CLUSTER_SLICES 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_TILES_X * LIGHT_CLUSTER_TILES_Y * LIGHT_CLUSTER_SLICES) // Per view
+#define LIGHT_CLUSTER_CAPACITY 32 // Lights listed per cluster
+
 enum VertexAttributes {
     VertexAttributePosition = 0,
     VertexAttributeNormal   = 1, 
@@ -21,12 +147,201 @@ enum VertexAttributes {
 enum BufferIndices {
     BufferIndexMeshPositions = 0,
     BufferIndexInstanceData  = 1, 
-    BufferIndexUniforms      = 2
+    BufferIndexUniforms      = 2,
+    BufferIndexVisibleInstances = 3, // Compacted instance indices written by the cull pass
+    BufferIndexCullUniforms     = 4, // CullUniforms for the mesh shader path
+    BufferIndexInteractors      = 5, // Interactor array (first uniforms.interactorCount entries)
+    BufferIndexInteractorBins   = 6, // Per-tile interactor lists written by the bin pass
+    BufferIndexGrassIndices     = 7, // Blade index buffer (visibility-buffer shading rebuilds triangles)
+    BufferIndexRenderSize       = 8, // float2 render region size in pixels (visibility-buffer shading, post pass)
+    BufferIndexImpostors        = 9, // GrassImpostor list written by the cull pass
+    BufferIndexImpostorUniforms = 10, // GrassImpostorUniforms (impostor cards and their bake)
+    BufferIndexTerrainChunks    = 11, // Terrain chunks drawn this frame: chunk index | LOD << 16
+    BufferIndexSparseGround     = 12, // SparseGroundUniforms (sparse ground texture layout)
+    BufferIndexSparseGroundResidency = 13, // uchar per level 0 tile: finest level resident under it
+    BufferIndexSparseGroundFeedback  = 14, // uint per streamed tile, set when a ground pixel needs it
+    BufferIndexBladeStates      = 15, // BladeState per instance (blade physics near the camera)
+    BufferIndexGrassResources   = 16, // GrassResourceTable of the frame (bindless grass pass)
+    BufferIndexSceneConstants   = 17, // SceneConstants (bounds, tuning and materials; rewritten on change)
+    BufferIndexRasterizationRateMap = 18, // Rate map parameters of the scene pass (post pass decoder)
+    BufferIndexPointLights      = 19, // PointLight array (first uniforms.pointLightCount entries)
+    BufferIndexLightClusters    = 20, // LightCluster per froxel, LIGHT_CLUSTER_COUNT per view
+    BufferIndexShadowCaster     = 21  // ShadowCasterUniforms (shadow map caster passes)
+};
+
+// Buffer slots for the grass culling compute kernels
+enum CullBufferIndices {
+    CullBufferIndexInstances        = 0,
+    CullBufferIndexVisibleInstances = 1,
+    CullBufferIndexDrawArguments    = 2,
+    CullBufferIndexUniforms         = 3,
+    CullBufferIndexCells            = 4,
+    CullBufferIndexGrassCommands    = 5, // Argument buffer holding the grass indirect command buffer
+    CullBufferIndexGrassIndices     = 6, // Blade index buffer referenced by the encoded draws
+    CullBufferIndexImpostors        = 7, // Far-field cells drawn as impostor cards
+    CullBufferIndexImpostorDrawArguments = 8, // Indirect draw of the impostor cards
+    CullBufferIndexCellOrder        = 9  // Cell indices nearest first (one cull threadgroup each)
+};
+
+// Buffer slots for the procedural grass generation kernel (texture 0: the terrain heightmap,
+// texture 1: the density / species mask)
+enum GenerateBufferIndices {
+    GenerateBufferIndexInstances   = 0,
+    GenerateBufferIndexCells       = 1,
+    GenerateBufferIndexUniforms    = 2,
+    GenerateBufferIndexPlacedCount = 3  // atomic_uint: blades accepted by the density mask
+};
+
+// Texture slots of the density brush (paintGrassDensity, uniforms in buffer 0)
+enum GrassPaintTextureIndices {
+    GrassPaintTextureIndexPrevious = 0, // Copy of the rectangle before the dab
+    GrassPaintTextureIndexMask     = 1  // Density / species mask (written)
+};
+
+// Buffer slots for the trample kernels (binning and stamping)
+enum TrampleBufferIndices {
+    TrampleBufferIndexUniforms    = 0,
+    TrampleBufferIndexInteractors = 1,
+    TrampleBufferIndexBins        = 2,
+    TrampleBufferIndexClearRegion = 3, // int4: first world texel (xy) and size (zw) of a region to clear
+    TrampleBufferIndexQueryPoints = 4, // float2 world XZ positions of CPU trample queries
+    TrampleBufferIndexQueryResults = 5, // float strength per query point
+    TrampleBufferIndexQueryCount  = 6, // uint: points in this frame's query batch
+    TrampleBufferIndexDirtyTiles  = 7, // uint per summary tile, set by every kernel that writes the map
+    TrampleBufferIndexUpdatedTiles = 8, // atomic_uint: summary tiles re-reduced this frame (trace counter)
+    TrampleBufferIndexSceneConstants = 9 // SceneConstants (decay rate of the CPU queries)
+};
+
+// Texture slots of the post pass (plus TextureIndexAtmosphere for the fog color)
+enum PostTextureIndices {
+    PostTextureIndexSceneColor = 0, // Resolved linear HDR scene color
+    PostTextureIndexSceneDepth = 1  // Resolved scene depth (1 = nothing drawn)
+};
+
+// Texture slots of the temporal antialiasing resolve (TemporalResolveUniforms in buffer 0)
+enum TemporalTextureIndices {
+    TemporalTextureIndexColor   = 0, // This frame's jittered 1x HDR scene color
+    TemporalTextureIndexMotion  = 1, // Motion vectors (UV offset to last frame's position, y down)
+    TemporalTextureIndexDepth   = 2, // Scene depth: the nearest neighbour's motion is taken
+    TemporalTextureIndexHistory = 3, // Last frame's resolved color
+    TemporalTextureIndexOutput  = 4  // This frame's resolved color (next frame's history)
+};
+
+// Texture slots for the grass culling compute kernels
+enum CullTextureIndices {
+    CullTextureIndexHiZ = 0, // Hierarchical-Z max-depth pyramid (previous frame)
+    CullTextureIndexTrampleMap = 1, // Trample stamp times (trampled blades are dropped)
+    CullTextureIndexTrampleSummary = 2 // Min / max stamp time pyramid (whole-cell trample test)
 };
 
 enum TextureIndices {
-    TextureIndexGrass = 0,
-    TextureIndexTrampleMap = 1
+    TextureIndexGrass = 0,          // Grass albedo array (slice = instanceAlbedoVariant())
+    TextureIndexTrampleMap = 1,
+    TextureIndexWindField = 2, // Wind bend per texel, slice 0 this frame, slice 1 last frame
+    TextureIndexNoise = 3,     // Shared value-noise lattice (valueNoise())
+    TextureIndexImpostorNormal = 4, // Impostor atlas: bake-view blade normal, a = coverage
+    TextureIndexImpostorBlade = 5,  // Impostor atlas: (height along the blade, blade hash, withered flag)
+    TextureIndexImpostorDepth = 6,  // Impostor atlas: meters behind the frame's front plane
+    TextureIndexTerrainHeight = 7,  // Terrain heightmap (terrainHeight())
+    TextureIndexAtmosphere = 8,     // Atmosphere LUT (atmosphereColor()): sky and post-pass fog color
+    TextureIndexSparseGround = 9,   // Sparse ground albedo (only its resident tiles are backed by memory)
+    TextureIndexGrassPalette = 10,  // Blade albedo palette (grassPaletteColor()); table-bound for the forward grass
+    TextureIndexTrampleSummary = 11, // Trample summary pyramid (ground: skips the map reads of untouched tiles)
+    TextureIndexShadowMaps = 12     // Sun shadow maps: SHADOW_MAP_COUNT slots from here (cascades, then the overlay)
+};
+
+// Buffer slots for the wind field kernel (texture 0: the field, texture 1: the noise lattice)
+enum WindBufferIndices {
+    WindBufferIndexUniforms = 0,
+    WindBufferIndexFluid       = 1, // WindFluidUniforms (fluid kernels only)
+    WindBufferIndexVelocityIn  = 2, // float2 per cell, WIND_FIELD_SIZE^2 row-major
+    WindBufferIndexVelocityOut = 3,
+    WindBufferIndexPressureIn  = 4, // float per cell
+    WindBufferIndexPressureOut = 5,
+    WindBufferIndexDivergence  = 6, // float per cell
+    WindBufferIndexInteractors = 7,
+    WindBufferIndexSceneConstants = 8, // SceneConstants (ground bounds)
+    WindBufferIndexGusts       = 9, // WindGustParticle per slot, persistent across frames
+    WindBufferIndexGustUniforms = 10, // WindGustUniforms (setBytes, once per frame)
+    WindBufferIndexGustPlacements = 11, // WindGustPlacement per gust emitter (per-frame copy)
+    WindBufferIndexGustFlows   = 12  // WindGustFlow per gust emitter (per-frame copy)
+};
+
+// Buffer slots for the interactor physics kernel (texture 0: the terrain heightmap,
+// texture 1: the density / species mask)
+enum InteractorPhysicsBufferIndices {
+    InteractorPhysicsBufferIndexBodies      = 0, // InteractorBody state, persistent across frames
+    InteractorPhysicsBufferIndexInteractors = 1, // This frame's Interactor array (spawn on reset, output)
+    InteractorPhysicsBufferIndexUniforms    = 2  // InteractorPhysicsUniforms
+};
+
+// Buffer slots for the blade physics kernel (texture 0: the wind field)
+enum BladePhysicsBufferIndices {
+    BladePhysicsBufferIndexUniforms    = 0, // View 0's Uniforms (bounds, interactor count and bins)
+    BladePhysicsBufferIndexInstances   = 1,
+    BladePhysicsBufferIndexCells       = 2,
+    BladePhysicsBufferIndexStates      = 3,
+    BladePhysicsBufferIndexInteractors = 4,
+    BladePhysicsBufferIndexBins        = 5,
+    BladePhysicsBufferIndexParams      = 6, // BladePhysicsUniforms
+    BladePhysicsBufferIndexCellList    = 7, // uint cell index per threadgroup (the cells near the camera)
+    BladePhysicsBufferIndexSceneConstants = 8 // SceneConstants (ground and grass bounds)
+};
+
+// Buffer slots for the light cluster kernel (one dispatch per view)
+enum LightClusterBufferIndices {
+    LightClusterBufferIndexUniforms = 0, // The view's Uniforms
+    LightClusterBufferIndexLights   = 1,
+    LightClusterBufferIndexClusters = 2  // The view's LIGHT_CLUSTER_COUNT clusters
+};
+
+// Buffer slots for the atmosphere LUT kernel (texture 0: the LUT)
+enum AtmosphereBufferIndices {
+    AtmosphereBufferIndexUniforms = 0
+};
+
+// Buffer slots for the sparse ground tile kernel (texture 0: sparse ground, 1: ground albedo, 2: noise)
+enum SparseFillBufferIndices {
+    SparseFillBufferIndexTiles    = 0, // SparseGroundTile per dispatch slice
+    SparseFillBufferIndexUniforms = 1  // SparseGroundFillUniforms
+};
+
+// Buffer slots of the object ID pick kernels (the ID attachment is texture 0)
+enum PickBufferIndices {
+    PickBufferIndexResults  = 0, // uint ID per region pixel, row by row
+    PickBufferIndexUniforms = 1  // ObjectPickUniforms
+};
+
+// Object IDs (optional R32Uint scene attachment, color(4)): the kind in the top bits, its index below.
+// 0 is nothing (the cleared sky); ground IDs hold the terrain chunk, blade IDs the instance index,
+// interactor IDs the interactor slot.
+#define OBJECT_ID_KIND_SHIFT 28
+#define OBJECT_ID_INDEX_MASK 0x0FFFFFFFu
+enum ObjectIdKind {
+    ObjectIdKindNone = 0,
+    ObjectIdKindGround = 1,
+    ObjectIdKindBlade = 2,
+    ObjectIdKindInteractor = 3
+};
+#define OBJECT_ID(kind, index) ((uint(kind) << OBJECT_ID_KIND_SHIFT) | (uint(index) & OBJECT_ID_INDEX_MASK))
+#define OBJECT_ID_KIND(id) (uint(id) >> OBJECT_ID_KIND_SHIFT)
+#define OBJECT_ID_INDEX(id) (uint(id) & OBJECT_ID_INDEX_MASK)
+
+// Function constants specializing the scene pipelines
+enum FunctionConstantIndices {
+    FunctionConstantIndexWriteMotionVectors = 0, // Temporal upscaling and TAA: scene fragments also write motion to color(1)
+    FunctionConstantIndexWriteGrassVisibility = 1, // Visibility-buffer grass: the blade vertex stage passes its visible slot
+    FunctionConstantIndexTrampleDebug = 2,   // Grass: tint blades by trample strength (T key)
+    FunctionConstantIndexContactShadows = 3, // Grass: contact and blob shadows under the interactors
+    FunctionConstantIndexTranslucency = 4,   // Grass: backlit tip translucency
+    FunctionConstantIndexWindSheen = 5,      // Grass: brightness lift on wind-bent tips
+    FunctionConstantIndexHalfPrecision = 6,  // Grass, ground: half-precision shading math and interpolants
+    FunctionConstantIndexGeometryBlades = 7, // Grass: tapered blade geometry instead of the alpha-tested texture
+    FunctionConstantIndexSparseGround = 8,   // Ground: sample the sparse ground texture and write its feedback
+    FunctionConstantIndexRasterizationRateMap = 9, // Post: the scene was rasterized through a rate map
+    FunctionConstantIndexWriteTileDepth = 10, // In-tile post: scene fragments also write their depth to color(3)
+    FunctionConstantIndexWriteObjectId = 11, // Picking: grass, ground and ball fragments write their object ID to color(4)
+    FunctionConstantIndexCoverageSamples = 12 // Grass, impostors: MSAA samples alpha-to-coverage quantizes the opacity into (int)
 };
 
 // Vertex structure - alignment safe between C++ and Metal
@@ -36,35 +351,811 @@ struct Vertex {
     float2 texcoord;
 };
 
-// Instance data for each grass blade
+// Instance data for each grass blade (16 bytes, quantized)
+//  positionXZ   : X and Z as unorm16 over the grass bounds (grassMinXZ .. grassMaxXZ)
+//  heightScale  : low 16 bits = Y as half, high 16 bits = uniform scale as unorm16 over [0, INSTANCE_MAX_SCALE]
+//  rotationType : low 16 bits = Y rotation as unorm16 over [0, 2*PI), bits 16-23 = albedo variant
+//                 (grass albedo array slice, < GRASS_ALBEDO_VARIANT_COUNT), bits 24-31 = species
+//                 (< GRASS_SPECIES_COUNT; 0 = grass blade)
+//  attributes   : baked per-blade attributes (computed once at generation time)
+//                 bits 0-7 = variation hash, bits 8-15 = initial tilt over [-INSTANCE_MAX_TILT, +INSTANCE_MAX_TILT],
+//                 bits 16-23 = idle sway phase over [0, 2*PI), bits 24-31 = attribute flags
+#define INSTANCE_MAX_SCALE 2.0f
+#define INSTANCE_MAX_TILT 0.5236f // 15 degrees
+#define INSTANCE_FLAG_YELLOW 0x1u // Withered yellow-green blade
+
 struct InstanceData {
-    float4x4 modelMatrix; 
+    uint positionXZ;
+    uint heightScale;
+    uint rotationType;
+    uint attributes;
+};
+
+// Species of a placed blade from a uniform random number in [0, 1) (generation kernel and CPU placement)
+inline uint grassSpeciesFromUnit(float u) {
+    if (u < GRASS_SPECIES_FLOWERS_SHARE) {
+        return GRASS_SPECIES_FLOWERS;
+    }
+    return u < GRASS_SPECIES_FLOWERS_SHARE + GRASS_SPECIES_CLOVER_SHARE ? GRASS_SPECIES_CLOVER : GRASS_SPECIES_GRASS;
+}
+
+// Something that tramples grass: stamps the trample map, flattens blades and casts contact shadows.
+// The same buffer places the drawn bodies (one instanced draw of the ball mesh for all of them).
+struct Interactor {
+    float3 position; // World-space center this frame
+    float3 prevPosition; // Center last frame (grass and body motion vectors)
+    float radius; // Footprint radius (stamp, flatten ring, contact shadow)
+    float falloff; // Width of the soft flatten band beyond the radius
+    float bodyRadius; // Radius of the drawn sphere (the ball mesh is scaled from its 0.5 radius)
+    float halfHeight; // Upright capsules: half the segment between the cap centers (0 = sphere)
+    float4 material; // rgb = body albedo, a = specular strength
+};
+
+// Rigid body of the GPU interactor simulation: a sphere, or an upright capsule when halfHeight > 0
+struct InteractorBody {
+    float3 position; // Center
+    float3 velocity;
+    float radius; // Sphere / cap radius
+    float halfHeight;
+    float inverseMass; // 0 = kinematic (follows InteractorPhysicsUniforms.kinematicPosition)
+    float footprintScale; // Footprint radius relative to the body radius
+    float4 material;
+    float3 previousPosition; // Before the last step; frames are drawn between it and position
+    float3 drawnPosition; // Position written to last frame's interactor array
+};
+
+// This frame's steps of the interactor simulation (setBytes, once per frame)
+struct InteractorPhysicsUniforms {
+    float3 kinematicPosition; // Scripted position of body 0 (the ball) after the last step, when it is kinematic
+    float3 kinematicStartPosition; // ... and before the first one (the steps move it in between)
+    float2 groundMinXZ; // Heightmap and density mask bounds; bodies bounce off their edges
+    float2 groundMaxXZ;
+    float deltaTime; // Per step (SimulationClock)
+    float frameDeltaTime; // Display frame time the spawn velocities are measured over
+    float alpha; // Progress of the frame past the last step (drawn positions interpolate)
+    uint stepCount; // Fixed steps due this frame (0: only the drawn positions move)
+    float gravity;
+    float friction; // Tangential speed lost per second on the ground (rolling and sliding)
+    float grassDrag; // Extra loss per second in full-density grass (scaled by the mask's density)
+    float restitution; // Bounce off the ground and off each other
+    uint bodyCount;
+    uint reset; // 1: (re)spawn the bodies from the interactor array instead of stepping
+    uint kinematicBall; // 1: body 0 follows kinematicPosition and pushes the others around
+    uint useDensityMap; // 0: uniform full-density grass
+};
+
+// Wind source injected into the fluid: velocity is added within radius of the position, strongest
+// at the center, for as long as the CPU lists it (the external control frames carry these)
+struct WindGust {
+    float2 position; // World XZ
+    float2 velocity; // World XZ, meters per second
+    float radius;
+    float pad0;
+    float pad1;
+    float pad2;
+};
+
+// A listed gust emitter as the fluid advection reads it: two arrays (SceneArrayStore streams), so
+// only the stream that changed is uploaded into the frame's copy
+struct WindGustPlacement {
+    float2 position; // World XZ
+    float radius;
+    float endTime; // uniforms.time the emitter stops (the CPU drops it then)
+};
+
+struct WindGustFlow {
+    float2 velocity; // World XZ, meters per second
+};
+
+// Localized wind event simulated on the GPU (downdraft, blast, passing gust): the center drifts
+// and slows down, the reach grows, and the air velocity fades out over the lifetime. The wind
+// field kernels sum every live particle per texel, so blades pay one texture sample regardless
+// of how many are alive
+struct WindGustParticle {
+    float2 position; // World XZ of the center
+    float2 drift; // Center velocity (m/s), damped by drag
+    float2 wind; // Air velocity at the center at full strength (m/s, world XZ)
+    float radialSpeed; // Outward air speed halfway to the rim (m/s; negative pulls inward)
+    float radius; // Reach at spawn (meters)
+    float growth; // Reach gained per second (blast fronts widen)
+    float drag; // Drift fraction lost per second
+    float age; // Seconds since spawn (>= lifetime: dead)
+    float lifetime;
+    float2 prevPosition; // Center and age at last frame's clock (wind field slice 1)
+    float prevAge;
+    float pad0;
+};
+
+// A particle written into slot (chosen by the CPU, oldest first) by this frame's step
+struct WindGustSpawn {
+    WindGustParticle particle;
+    uint slot;
+    uint pad0;
+    uint pad1;
+    uint pad2;
+};
+
+// Gust particle step and wind field splat (setBytes, once per frame)
+struct WindGustUniforms {
+    float deltaTime; // Display frame time the particles advance by (same clocks as the field slices)
+    float bendPerVelocity; // Blade bend strength per m/s of gust velocity
+    uint particleCount; // Slots ever spawned (the rest hold no particle yet)
+    uint spawnCount;
+    WindGustSpawn spawns[WIND_MAX_GUST_SPAWNS];
+};
+
+// One step of the wind fluid (setBytes, once per frame)
+struct WindFluidUniforms {
+    float2 ambientVelocity; // Prevailing wind that carries the wakes downwind (m/s)
+    float deltaTime;
+    float cellSize; // Meters per fluid cell
+    float dissipation; // Velocity fraction lost per second (wakes and gusts die out)
+    float bendPerVelocity; // Blade bend strength per m/s of fluid velocity
+    float wakeStrength; // Share of an interactor's velocity imparted to the air it passes
+    uint interactorCount;
+    uint gustCount; // Emitters in the gust placement and flow arrays
+    float frameDeltaTime; // Display frame time the interactor motion is measured over
+    uint pad0;
+    uint pad1;
+};
+
+// Persistent spring state of one blade: its tip bend as an XZ vector (direction of the lean,
+// length = bend angle in radians at the tip) and the bend's rate of change
+struct BladeState {
+    float2 bend;
+    float2 velocity;
+};
+
+// One step of the blade springs (setBytes, once per frame)
+struct BladePhysicsUniforms {
+    float deltaTime;
+    float stiffness; // Spring constant of the recovery towards the wind pose (1/s^2, varied per blade)
+    float dampingRatio; // Below 1 the blades overshoot and sway back
+    float interactorPush; // Tip bend (radians) at an interactor's center, pointing away from it
+    uint cellCount; // Threadgroups / entries of the cell list
+};
+
+// Interactors whose reach overlaps one trample tile (indices into the interactor array)
+struct InteractorBin {
+    uint count;
+    uint indices[INTERACTOR_BIN_CAPACITY];
+};
+
+// Small local light (firefly, lantern): lights everything within radius, fading out at it
+struct PointLight {
+    float3 position; // World space
+    float radius;
+    float3 color; // Linear HDR intensity at 1 m
+};
+
+// Lights whose sphere overlaps one froxel (indices into the light array)
+struct LightCluster {
+    uint count;
+    uint indices[LIGHT_CLUSTER_CAPACITY];
+};
+
+// One cell of the grass grid: instances are sorted by cell, so each cell
+// owns the contiguous range [firstInstance, firstInstance + instanceCount)
+struct GrassCell {
+    float4 boundsMin; // World-space AABB (xyz), includes blade extents
+    float4 boundsMax;
+    uint firstInstance;
+    uint instanceCount;
+    uint pad0;
+    uint pad1;
+};
+
+// Entry in the compacted visible list written by the cull pass
+struct VisibleInstance {
+    uint instanceID; // Index into the instance buffer
+    float lodFade; // Crossfade weight at LOD boundaries (1.0 = fully opaque)
+    uint viewMask; // Bit v set when the blade is inside view v's frustum
+};
+
+// Bindless resources of the classic and visibility grass stages (tier 2 argument buffer): meshes,
+// instance data and simulation state by GPU address, textures by resource ID. One table per frame
+// slot replaces the per-draw slot bindings; blades pick their albedo slice (material) and species
+// from the instance data. On the CPU the entries are MTL::Buffer::gpuAddress() and
+// MTL::Texture::gpuResourceID() values.
+#ifdef __METAL_VERSION__
+    #define GRASS_TABLE_POINTER(...) __VA_ARGS__ *
+    #define GRASS_TABLE_TEXTURE(...) __VA_ARGS__
+#else
+    #define GRASS_TABLE_POINTER(...) uint64_t
+    #define GRASS_TABLE_TEXTURE(...) uint64_t
+#endif
+struct GrassResourceTable {
+    GRASS_TABLE_POINTER(constant Vertex) vertices;           // Every species' LOD meshes
+    GRASS_TABLE_POINTER(constant InstanceData) instances;
+    GRASS_TABLE_POINTER(const device VisibleInstance) visibleInstances;
+    GRASS_TABLE_POINTER(const device Interactor) interactors; // This frame's interactors
+    GRASS_TABLE_POINTER(const device InteractorBin) interactorBins;
+    GRASS_TABLE_POINTER(const device BladeState) bladeStates; // Read only with uniforms.bladePhysicsRadius > 0
+    GRASS_TABLE_POINTER(const device PointLight) pointLights; // Read only with uniforms.pointLightCount > 0
+    GRASS_TABLE_POINTER(const device LightCluster) lightClusters;
+    GRASS_TABLE_TEXTURE(texture2d<float, access::read>) trampleMap;
+    GRASS_TABLE_TEXTURE(texture2d_array<float>) windField;
+    GRASS_TABLE_TEXTURE(texture2d_array<float>) albedo;      // Slice = instanceAlbedoVariant()
+    GRASS_TABLE_TEXTURE(texture2d<float>) noise;
+    GRASS_TABLE_TEXTURE(texture3d<float>) palette;          // This frame's GrassPalette slot
+    GRASS_TABLE_TEXTURE(depth2d<float>) shadowMaps[SHADOW_MAP_COUNT]; // Read only with uniforms.shadowMapCount > 0
 };
 
+// GPU-written indirect draw arguments for the grass pass (one per species and LOD bucket).
+// Layout matches MTL::DrawIndexedPrimitivesIndirectArguments; the cull kernel
+// bumps instanceCount atomically for every visible blade.
+struct GrassDrawArguments {
+    uint indexCount;
+#ifdef __METAL_VERSION__
+    atomic_uint instanceCount;
+#else
+    uint instanceCount;
+#endif
+    uint indexStart;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// Far-field cell drawn as an impostor card (appended by the cull pass)
+struct GrassImpostor {
+    float4 centerFade; // xyz = patch center, w = fade-in weight (1 beyond the fade band)
+};
+
+// GPU-written indirect draw of the impostor cards (one 4-vertex strip per listed cell).
+// Layout matches MTL::DrawPrimitivesIndirectArguments.
+struct GrassImpostorDrawArguments {
+    uint vertexCount;
+#ifdef __METAL_VERSION__
+    atomic_uint instanceCount;
+#else
+    uint instanceCount;
+#endif
+    uint vertexStart;
+    uint baseInstance;
+};
+
+// Impostor atlas layout, shared by the bake and the cards
+struct GrassImpostorUniforms {
+    float4 elevations; // View elevation of each atlas column (radians above the horizon, ascending)
+    float cardSize; // Side of a square patch frame (and of a card) in meters
+};
+
+// Caster pass of one shadow map (ShadowMaps): the map's projection and the rest-pose blade strip
+// of each species (blade-local, before the instance scale)
+struct ShadowCasterUniforms {
+    float4x4 viewProjection;
+    float4 bladeShapes[GRASS_SPECIES_COUNT]; // x = half width, y = root height, z = height
+};
+
+// Sparse ground texture layout. Levels below pinnedLevel are streamed: feedback holds one entry per
+// tile of each, starting at feedbackOffset[level]; pinnedLevel and coarser are always resident.
+struct SparseGroundUniforms {
+    uint tilesPerSide; // Level 0 tiles per side
+    uint levelCount;   // Mip levels of the texture
+    uint pinnedLevel;
+    uint feedbackOffset[SPARSE_GROUND_MAX_LEVELS + 1];
+};
+
+// Region of the sparse ground texture filled by the tile kernel (one tile, or the whole mip tail level)
+struct SparseGroundTile {
+    uint4 region; // xy = first texel, zw = size, in texels of the level
+    uint level;
+    uint pad0;
+    uint pad1;
+    uint pad2;
+};
+
+// Per-frame parameters for the grass culling kernel
+struct CullUniforms {
+    float4 frustumPlanes[6 * MAX_RENDER_VIEWS]; // Six per view; xyz = inward normal, w = distance (normalized)
+    float4x4 prevViewProjection; // View-projection the Hi-Z depth was rendered with
+    float3 cameraPosition; // View 0 (the mesh path culls for it alone)
+    float4 viewCameraPositions[MAX_RENDER_VIEWS]; // xyz per view: LODs follow the nearest camera
+    uint viewCount; // Views culled together (a blade is kept inside any of their frustums)
+    float4 lodDistances; // x = LOD0->1 distance, y = LOD1->2 distance
+    uint4 bucketMeshes[GRASS_DRAW_BUCKET_COUNT]; // Per bucket: x = index count, y = first index, z = base vertex of its mesh
+    float2 fieldMinXZ; // Instance position quantization bounds
+    float2 fieldMaxXZ;
+    uint instanceCount; // Number of instances in the instance buffer
+    uint cellCount; // Number of cells in the cell buffer (one threadgroup each)
+    uint bucketCapacity; // Stride (in entries) between per-bucket regions of the visible list
+    float bladeRadius; // Conservative bounding sphere radius of a blade
+    float lodFadeWidth; // Width of the crossfade band around each LOD distance
+    float2 hiZSize; // Size of Hi-Z level 0 in texels
+    uint hiZMipCount; // Number of Hi-Z levels
+    uint hiZEnabled; // 1 when the Hi-Z pyramid holds valid depth for prevViewProjection
+    float2 hiZUVScale; // Fraction of the pyramid covered by last frame's render region (dynamic resolution)
+    float2 trampleWindowMinXZ; // Trample window (same as Uniforms)
+    float trampleWindowSize;
+    float time; // Clock the trample decay is evaluated at
+    float trampleDecayRate;
+    uint trampleSummaryMipCount; // Levels of the trample summary pyramid
+    uint trampleSummaryEnabled; // 1 when cells are tested against the summary before their blades
+    uint impostorEnabled; // 1 when far cells are listed as impostor cards instead of drawing their blades
+    float impostorDistance; // Center of the band where a cell's blades fade into its card
+    float impostorFadeWidth;
+    float densityLodDistance; // Distance past which cells draw only a prefix of their blades (0 = off)
+    uint cellOrderEnabled; // 1 when threadgroup i culls cellOrder[i] (front to back) instead of cell i
+    uint impostorsOnly; // 1 when cells only list their impostor cards (the mesh path draws the blades)
+};
+
+// Cells the front-to-back sort orders, all in one threadgroup (one thread per cell; power of two)
+#define GRASS_CELL_SORT_CAPACITY 256
+
+// Parameters for GPU-side procedural placement (fixed blade count per cell,
+// so instance i belongs to cell i / bladesPerCell and the buffer stays cell-sorted)
+struct GrassGenerateUniforms {
+    float2 fieldMinXZ; // Field bounds (also the quantization bounds of InstanceData)
+    float2 fieldMaxXZ;
+    uint seed; // Placement seed
+    uint cellsPerSide; // Grid resolution
+    uint bladesPerCell; // Density: candidate blades (and instance slots) per cell
+    float bladeRadius; // Conservative blade radius added to cell bounds
+    float minScale; // Random uniform scale range
+    float maxScale;
+    uint useDensityMap; // Reject candidates against the density mask (0 = keep every candidate)
+    uint2 firstCell; // Dispatched rectangle of cells: threadgroup i places cell firstCell + (i % cellSpan, i / cellSpan)
+    uint cellSpan; // Cells per row of the rectangle (cellsPerSide for the whole field)
+    uint incremental; // 1 when the cells are placed again: the placed count trades their previous blades for the new
+};
+
+// One dab of the density / species brush over a rectangle of mask texels (paintGrassDensity)
+struct GrassPaintUniforms {
+    uint2 origin; // First texel of the rectangle (thread (0, 0)); the previous texels are read at the thread position
+    uint2 size;   // Texels of the rectangle
+    float2 center; // Brush center and radius in texels
+    float radius;
+    float hardness; // Share of the radius painted at full strength (the rest falls off smoothly)
+    float strength; // Blend toward the targets at full strength
+    float density; // Target density (R)
+    float species; // Target species (G)
+    uint paintSpecies; // 0 keeps the texels' species
+};
+
+// Share of the blades on a species texel that use its dominant albedo variant (the rest stay random)
+#define GRASS_SPECIES_DOMINANCE 0.75
+
+// Progressive order within a cell: blade k sits at point k of the R2 low-discrepancy sequence
+// (shifted by a per-cell random offset), so every prefix of a cell's blades covers it evenly
+#define GRASS_PROGRESSIVE_STEP_X 0.7548776662f
+#define GRASS_PROGRESSIVE_STEP_Y 0.5698402910f
+
+// Density LOD: smallest share of a cell's blades drawn far away (see grassDensityLodFraction())
+#define GRASS_DENSITY_LOD_MIN_FRACTION 0.3f
+// Widest blade strip half-width (clover, 0.28) at the largest blade scale (1.2): how far the
+// density LOD's widening can push a blade point sideways, per unit of extra width
+#define GRASS_BLADE_MAX_HALF_WIDTH 0.34f
+
+// Baked wind poses (SceneConstants::windPoses): the blade bend rotates every point by an angle
+// linear in its height, so the pose of a blade point is its bend angle's (sin, 1 - cos), baked at
+// GRASS_WIND_POSE_COUNT angles over [-GRASS_WIND_POSE_MAX_ANGLE, +GRASS_WIND_POSE_MAX_ANGLE] and looked
+// up by the bend angle (wind strength times height); larger angles take the procedural rotation.
+#define GRASS_WIND_POSE_COUNT 64
+#define GRASS_WIND_POSE_MAX_ANGLE 2.0f
+
+// Per-frame, per-view constants (cameras, clocks, interactors, trample window). Parameters that
+// only change with settings live in SceneConstants.
 struct Uniforms {
     float4x4 viewMatrix;
     float4x4 projectionMatrix;
     float3 lightDirection; // Light direction (used by ground shader)
-    float3 lightColor; // Light color (used by ground shader)
     float time; // Time for wind animation
     float3 cameraPosition; // Camera position for billboard calculations
     float3 sunDirection; // Sun direction for lighting calculations
     float3 sunColor; // Sun color
-    float3 interactorPos; // World position of the ball (used for ball shader positioning)
-    float interactorRadius; // Ball radius (used to set ballRadius)
     
     // Trample map system
-    float3 ballWorldPos; // Ball center position (world space)
-    float ballRadius; // Ball radius for trample map
-    float2 groundMinXZ; // Ground bounds min (X, Z) for world->UV mapping
-    float2 groundMaxXZ; // Ground bounds max (X, Z) for world->UV mapping
-    float dt; // Time step for trample decay
-    float trampleDecayRate; // Decay rate (default: 0.35)
-    float showTrampleMap; // Debug flag: 1.0 to visualize trample map, 0.0 for normal rendering
+    uint interactorCount; // Valid entries of the interactor buffer (at most MAX_INTERACTORS)
+    float3 bladePhysicsCenter; // Camera the blade simulation follows (view 0)
+    float bladePhysicsRadius; // Blades this close to the center bend by their BladeState (0 = stateless wind)
+    float2 trampleWindowMinXZ; // World XZ of the trample window's first texel (follows the camera)
+    float trampleWindowSize; // Extent of the trample window in meters (the map's texels cover it)
+    
+    // Temporal upscaling and TAA: projectionMatrix carries the subpixel jitter, motion vectors do not
+    float4x4 unjitteredViewProjection; // This frame's view-projection without jitter
+    float4x4 prevViewProjection; // Last frame's unjittered view-projection
+    float3 prevCameraPosition; // Last frame's billboard reference
+    float prevTime; // Last frame's wind clock
+    float4x4 inverseViewProjection; // Inverse of this frame's (jittered) view-projection: sky view rays
+    
+    // Multi-view: every view's copy holds all cameras, so the density LOD widens blades by the
+    // same nearest-camera distance the cull pass thinned them by
+    uint viewIndex; // Bit of this view in VisibleInstance::viewMask
+    uint viewCount;
+    float4 viewCameraPositions[MAX_RENDER_VIEWS]; // xyz per view
+    
+    // Clustered point lights (0 = none: no cluster pass, no per-fragment loop)
+    uint pointLightCount;
+    float lightClusterNear; // Depth range of the cluster slices (meters along the view axis)
+    float lightClusterFar;
+    
+    // Sun shadow maps (0 = none: the blob shadows stand in for the interactors' shadows)
+    uint shadowMapCount; // SHADOW_MAP_COUNT when on
+    uint shadowOverlayActive; // The overlay holds this frame's interactors (0: nothing dynamic to test)
+    float shadowDepthBias[SHADOW_MAP_COUNT]; // Receiver depth bias per map, in its depth units
+    float4x4 shadowViewProjection[SHADOW_MAP_COUNT]; // World to each map's clip space (orthographic)
+};
+
+// Scene constants: bounds, tuning and materials that only change with settings or the streamed
+// world. Bound next to Uniforms, but rewritten only when a value changes (one copy per frame in
+// flight, so a change reaches each slot once).
+struct SceneConstants {
+    float3 lightColor; // Light color (used by ground shader)
+    float2 groundMinXZ; // Ground bounds min (X, Z)
+    float2 groundMaxXZ; // Ground bounds max (X, Z)
+    float2 grassMinXZ; // Quantization bounds of InstanceData (the ground, or the streamed world)
+    float2 grassMaxXZ;
+    float grassDensityLodDistance; // Same as CullUniforms::densityLodDistance (the thinned blades widen)
+    float trampleDecayRate; // Trample strength lost per second after a stamp (default: 0.35)
+    uint trampleSummaryValid; // 1 when the summary pyramid follows the map this frame (ground early-out)
     
     // Soft interaction parameters (Ghibli-like)
-    float flattenBandWidth; // Width of flatten ring around ball
     float flattenStrength; // Strength of flatten compression (0-1)
-    float contactShadowRadius; // Radius of contact shadow effect
+    float contactShadowRadiusScale; // Contact shadow radius relative to each interactor's radius
     float contactShadowStrength; // Strength of contact shadow darkening (0-1)
-};
\ No newline at end of file
+    
+    // Distance fog of the post pass (meters from the camera); the variable rasterization rate
+    // lowers the rate of the rows past it
+    float fogStartDistance;
+    float fogEndDistance;
+    
+    // Baked wind poses: blades farther than windPoseDistance from the camera look their bend up in the
+    // table instead of the procedural rotation (0 = every blade procedural)
+    float windPoseDistance;
+    float2 windPoses[GRASS_WIND_POSE_COUNT];
+};
+
+// Sun the atmosphere LUT was built for
+struct AtmosphereUniforms {
+    float3 sunDirection; // Unit vector toward the sun
+    float3 sunColor;
+};
+
+// Parameters for the sparse ground tile kernel
+struct SparseGroundFillUniforms {
+    float2 groundMinXZ; // World bounds the texture covers
+    float2 groundMaxXZ;
+    uint size;          // Level 0 texels per side
+};
+
+// One pick region: output pixels [origin, origin + size), read from the ID attachment through
+// scale (the render region of a dynamic-resolution frame)
+struct ObjectPickUniforms {
+    uint2 origin;
+    uint2 size;
+    float2 scale;  // ID texels per output pixel
+    uint2 limit;   // ID texels rendered this frame (outside: ObjectIdKindNone)
+};
+
+// Temporal antialiasing resolve of one frame, over the render region (top-left of the targets)
+struct TemporalResolveUniforms {
+    uint2 renderSize;    // Pixels rendered this frame
+    float2 historyScale; // Last frame's render region over the history texture size
+    float blend;         // Weight of this frame's sample in a still pixel (the rest is history)
+    uint historyValid;   // 0: first frame, resize or camera cut (the output is this frame alone)
+};
+
+#ifdef __METAL_VERSION__
+// ---------------------------------------------------------
+// Scene pipeline specializations (motion vectors for temporal upscaling, visibility-buffer grass,
+// shading precision, the in-tile post depth)
+// ---------------------------------------------------------
+// Optional constants: pipelines built without them do not write (or interpolate) the extra outputs
+constant bool writeMotionVectorsValue [[function_constant(FunctionConstantIndexWriteMotionVectors)]];
+constant bool writeMotionVectors = is_function_constant_defined(writeMotionVectorsValue) && writeMotionVectorsValue;
+constant bool writeGrassVisibilityValue [[function_constant(FunctionConstantIndexWriteGrassVisibility)]];
+constant bool writeGrassVisibility = is_function_constant_defined(writeGrassVisibilityValue) && writeGrassVisibilityValue;
+// Colors, lighting, fog and tone mapping in half; positions and distances stay float
+constant bool halfPrecisionShadingValue [[function_constant(FunctionConstantIndexHalfPrecision)]];
+constant bool halfPrecisionShading = is_function_constant_defined(halfPrecisionShadingValue) && halfPrecisionShadingValue;
+constant bool fullPrecisionShading = !halfPrecisionShading;
+// In-tile post: tile functions cannot read the depth attachment, so the fog depth goes to a color
+constant bool writeTileDepthValue [[function_constant(FunctionConstantIndexWriteTileDepth)]];
+constant bool writeTileDepth = is_function_constant_defined(writeTileDepthValue) && writeTileDepthValue;
+// Picking: the object under each sample (see OBJECT_ID)
+constant bool writeObjectIdValue [[function_constant(FunctionConstantIndexWriteObjectId)]];
+constant bool writeObjectId = is_function_constant_defined(writeObjectIdValue) && writeObjectIdValue;
+// Alpha-to-coverage at 1x or 2x: the opacity is ordered-dithered onto the few coverage levels the
+// pass has (undefined: 4x and up, where the hardware levels are fine enough on their own)
+constant int coverageSamplesValue [[function_constant(FunctionConstantIndexCoverageSamples)]];
+constant int coverageSamples = is_function_constant_defined(coverageSamplesValue) ? coverageSamplesValue : 4;
+constant bool ditherCoverage = coverageSamples <= 2;
+
+// Scene fragment output: color plus the motion attachment of the temporal pipelines, the depth
+// copy of the in-tile post and the object ID of the picking pipelines
+struct SceneFragmentOut {
+    float4 color [[color(0)]];
+    float2 motion [[color(1), function_constant(writeMotionVectors)]];
+    float tileDepth [[color(3), function_constant(writeTileDepth)]];
+    uint objectId [[color(4), function_constant(writeObjectId)]];
+};
+
+// Trample map texels hold the stamp time; strength decays linearly from 1 at the stamp
+// (never-stamped texels hold TRAMPLE_NEVER_STAMPED)
+inline float trampleStrength(float stampTime, float time, float decayRate) {
+    return saturate(1.0 - decayRate * (time - stampTime));
+}
+
+// Trample clipmap: the map covers a camera-centred window whose origin is snapped to whole texels.
+// World texel g is stored at texel g mod size (toroidal), so scrolling the window only clears
+// the rows and columns it exposes, whatever the size of the world.
+inline float trampleTexelsPerMeter(uint mapSize, float windowSize) {
+    return float(mapSize) / windowSize;
+}
+
+inline int2 trampleWorldTexel(float2 worldXZ, float texelsPerMeter) {
+    return int2(floor(worldXZ * texelsPerMeter));
+}
+
+inline uint2 trampleStorageTexel(int2 worldTexel, uint2 mapSize) {
+    int2 size = int2(mapSize);
+    return uint2(((worldTexel % size) + size) % size);
+}
+
+// Dirty flag of the summary tile holding a storage texel
+inline uint trampleSummaryTileIndex(uint2 storageTexel, uint2 mapSize) {
+    uint2 tile = storageTexel / TRAMPLE_SUMMARY_TILE;
+    return tile.y * (mapSize.x / TRAMPLE_SUMMARY_TILE) + tile.x;
+}
+
+inline bool inTrampleWindow(float2 worldXZ, float2 windowMinXZ, float windowSize) {
+    float2 local = (worldXZ - windowMinXZ) / windowSize;
+    return all(local >= 0.0) && all(local < 1.0);
+}
+
+// Trample strength at a world position (untrampled outside the window); a direct read, since
+// stamp times must not blend with the never-stamped value
+inline float trampleAt(texture2d<float, access::read> trampleMap, float2 worldXZ,
+                       float2 windowMinXZ, float windowSize, float time, float decayRate) {
+    if (!inTrampleWindow(worldXZ, windowMinXZ, windowSize)) {
+        return 0.0;
+    }
+    uint2 mapSize = uint2(trampleMap.get_width(), trampleMap.get_height());
+    int2 worldTexel = trampleWorldTexel(worldXZ, trampleTexelsPerMeter(mapSize.x, windowSize));
+    return trampleStrength(trampleMap.read(trampleStorageTexel(worldTexel, mapSize)).r, time, decayRate);
+}
+
+// Offset from this frame's position to last frame's, in texture UV units (y down)
+inline float2 motionVector(float4 currentClip, float4 previousClip) {
+    float2 current = currentClip.xy / currentClip.w;
+    float2 previous = previousClip.xy / previousClip.w;
+    return (previous - current) * float2(0.5, -0.5);
+}
+
+// ---------------------------------------------------------
+// Interactor bins (bin kernel, blade flatten ring and contact shadows)
+// ---------------------------------------------------------
+// Distance from an interactor's center within which it affects grass
+inline float interactorReach(Interactor interactor) {
+    return max(interactor.radius + interactor.falloff, interactor.radius * INTERACTOR_BLOB_SHADOW_SCALE);
+}
+
+// Bin covering a world XZ position (positions outside the trample window clamp to the border bins)
+inline uint interactorBinIndex(float2 worldXZ, constant Uniforms &uniforms) {
+    float2 uv = saturate((worldXZ - uniforms.trampleWindowMinXZ) / uniforms.trampleWindowSize);
+    uint2 cell = min(uint2(uv * float(INTERACTOR_BIN_GRID)), uint2(INTERACTOR_BIN_GRID - 1));
+    return cell.y * INTERACTOR_BIN_GRID + cell.x;
+}
+
+// ---------------------------------------------------------
+// Clustered point lights (cluster kernel, grass and ground shading)
+// ---------------------------------------------------------
+// View-axis depth where slice `slice` starts (exponential: the froxels stay roughly cubic)
+inline float lightClusterSliceDepth(uint slice, constant Uniforms &uniforms) {
+    return uniforms.lightClusterNear * pow(uniforms.lightClusterFar / uniforms.lightClusterNear,
+                                           float(slice) / float(LIGHT_CLUSTER_SLICES));
+}
+
+// Cluster of a world position in the bound view (outside the depth range: the first / last slice)
+inline uint lightClusterIndex(float3 worldPos, constant Uniforms &uniforms) {
+    float4 clip = uniforms.projectionMatrix * uniforms.viewMatrix * float4(worldPos, 1.0);
+    float2 uv = saturate(clip.xy / max(clip.w, 1e-4) * 0.5 + 0.5);
+    uint2 tile = min(uint2(uv * float2(LIGHT_CLUSTER_TILES_X, LIGHT_CLUSTER_TILES_Y)),
+                     uint2(LIGHT_CLUSTER_TILES_X - 1, LIGHT_CLUSTER_TILES_Y - 1));
+    float depth = max(clip.w, uniforms.lightClusterNear);
+    float slices = log(depth / uniforms.lightClusterNear) / log(uniforms.lightClusterFar / uniforms.lightClusterNear);
+    uint slice = min(uint(slices * float(LIGHT_CLUSTER_SLICES)), uint(LIGHT_CLUSTER_SLICES - 1));
+    return uniforms.viewIndex * LIGHT_CLUSTER_COUNT + (slice * LIGHT_CLUSTER_TILES_Y + tile.y) * LIGHT_CLUSTER_TILES_X + tile.x;
+}
+
+// Diffuse light of the cluster's point lights at a surface point. Two-sided surfaces (blades)
+// take light from either face. Each light fades to zero at its radius.
+inline float3 clusteredPointLighting(float3 worldPos, float3 normal, bool twoSided, constant Uniforms &uniforms,
+                                     const device PointLight *lights, const device LightCluster *clusters) {
+    float3 irradiance = float3(0.0);
+    if (uniforms.pointLightCount == 0) {
+        return irradiance;
+    }
+    const device LightCluster &cluster = clusters[lightClusterIndex(worldPos, uniforms)];
+    for (uint i = 0; i < cluster.count; ++i) {
+        PointLight light = lights[cluster.indices[i]];
+        float3 toLight = light.position - worldPos;
+        float distanceSquared = dot(toLight, toLight);
+        float ratio = distanceSquared / (light.radius * light.radius);
+        float window = saturate(1.0 - ratio * ratio);
+        float NdotL = dot(normal, toLight * rsqrt(max(distanceSquared, 1e-6)));
+        NdotL = twoSided ? abs(NdotL) : max(NdotL, 0.0);
+        irradiance += light.color * (NdotL * window * window / (distanceSquared + 1.0));
+    }
+    return irradiance;
+}
+
+// Density LOD: share of a cell's (progressively ordered) blades drawn at a distance. Blades per
+// pixel grow with the square of the distance, so the share falls with it down to
+// GRASS_DENSITY_LOD_MIN_FRACTION; the drawn blades widen by its inverse to keep the coverage.
+inline float grassDensityLodFraction(float dist, float lodDistance) {
+    if (lodDistance <= 0.0 || dist <= lodDistance) {
+        return 1.0;
+    }
+    float ratio = lodDistance / dist;
+    return max(ratio * ratio, GRASS_DENSITY_LOD_MIN_FRACTION);
+}
+
+// Bounding radius of a blade drawn at density LOD share fraction: its half-width grows by 1 / fraction
+inline float grassDensityLodRadius(float bladeRadius, float fraction) {
+    return bladeRadius + GRASS_BLADE_MAX_HALF_WIDTH * (1.0 / fraction - 1.0);
+}
+
+// ---------------------------------------------------------
+// Packed instance decoding (shared by culling and vertex shaders)
+// ---------------------------------------------------------
+inline float3 instancePosition(InstanceData instance, float2 fieldMinXZ, float2 fieldMaxXZ) {
+    float2 xz = mix(fieldMinXZ, fieldMaxXZ, unpack_unorm2x16_to_float(instance.positionXZ));
+    float y = float(as_type<half2>(instance.heightScale).x);
+    return float3(xz.x, y, xz.y);
+}
+
+inline float instanceScale(InstanceData instance) {
+    return unpack_unorm2x16_to_float(instance.heightScale).y * INSTANCE_MAX_SCALE;
+}
+
+inline float instanceRotation(InstanceData instance) {
+    return unpack_unorm2x16_to_float(instance.rotationType).x * 6.28318;
+}
+
+inline uint instanceAlbedoVariant(InstanceData instance) {
+    return (instance.rotationType >> 16) & 0xFF;
+}
+
+inline uint instanceSpecies(InstanceData instance) {
+    return min(instance.rotationType >> 24, uint(GRASS_SPECIES_COUNT - 1));
+}
+
+// Draw bucket of a blade at a LOD (visible list region, indirect draw)
+inline uint grassDrawBucket(uint species, uint lod) {
+    return species * GRASS_LOD_COUNT + lod;
+}
+
+// Test a bounding sphere against the six frustum planes (cull kernel and mesh object stage)
+inline bool sphereInFrustum(float3 center, float radius, constant float4 *planes) {
+    for (int i = 0; i < 6; ++i) {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Distance from p to the nearest of count cameras (multi-view LOD selection)
+inline float nearestViewDistance(float3 p, constant float4 *cameras, uint count) {
+    float nearest = distance(p, cameras[0].xyz);
+    for (uint i = 1; i < count; ++i) {
+        nearest = min(nearest, distance(p, cameras[i].xyz));
+    }
+    return nearest;
+}
+
+// Baked attributes: replace the per-vertex sin-hashes of instanceID
+inline float instanceHash(InstanceData instance) {
+    return unpack_unorm4x8_to_float(instance.attributes).x;
+}
+
+inline float instanceTilt(InstanceData instance) {
+    return (unpack_unorm4x8_to_float(instance.attributes).y * 2.0 - 1.0) * INSTANCE_MAX_TILT;
+}
+
+inline float instanceIdlePhase(InstanceData instance) {
+    return unpack_unorm4x8_to_float(instance.attributes).z * 6.28318;
+}
+
+inline bool instanceIsYellow(InstanceData instance) {
+    return ((instance.attributes >> 24) & INSTANCE_FLAG_YELLOW) != 0;
+}
+
+inline uint packInstanceAttributes(float hash, float tilt, float idlePhase, uint flags) {
+    float4 unorms = float4(hash, tilt / INSTANCE_MAX_TILT * 0.5 + 0.5, fract(idlePhase / 6.28318), 0.0);
+    return (pack_float_to_unorm4x8(saturate(unorms)) & 0x00FFFFFFu) | ((flags & 0xFFu) << 24);
+}
+
+// Inverse of the decoders above (used by GPU-side generation)
+inline InstanceData packInstance(float3 position, float rotation, float scale, uint albedoVariant, uint species,
+                                 uint attributes, float2 fieldMinXZ, float2 fieldMaxXZ) {
+    float2 uv = saturate((position.xz - fieldMinXZ) / (fieldMaxXZ - fieldMinXZ));
+    float rotation01 = fract(rotation / 6.28318);
+    InstanceData instance;
+    instance.positionXZ = pack_float_to_unorm2x16(uv);
+    instance.heightScale = (as_type<ushort>(half(position.y)) & 0xFFFFu)
+                         | (pack_float_to_unorm2x16(float2(0.0, saturate(scale / INSTANCE_MAX_SCALE))) & 0xFFFF0000u);
+    instance.rotationType = (pack_float_to_unorm2x16(float2(rotation01, 0.0)) & 0xFFFFu) | ((albedoVariant & 0xFFu) << 16)
+                          | ((species & 0xFFu) << 24);
+    instance.attributes = attributes;
+    return instance;
+}
+
+// ---------------------------------------------------------
+// Terrain
+// ---------------------------------------------------------
+// Ground height at a world XZ position: bilinear between the heightmap samples on the corners of
+// the LOD 0 quad grid, i.e. exactly the LOD 0 surface (matches TerrainHeightmap::heightAt())
+inline float terrainHeight(texture2d<float> heightmap, float2 worldXZ, float2 groundMinXZ, float2 groundMaxXZ) {
+    float2 grid = saturate((worldXZ - groundMinXZ) / (groundMaxXZ - groundMinXZ)) * float(TERRAIN_HEIGHTMAP_SIZE - 1);
+    uint2 base = min(uint2(grid), uint2(TERRAIN_HEIGHTMAP_SIZE - 2));
+    float2 f = grid - float2(base);
+    float h00 = heightmap.read(base).r;
+    float h10 = heightmap.read(base + uint2(1, 0)).r;
+    float h01 = heightmap.read(base + uint2(0, 1)).r;
+    float h11 = heightmap.read(base + uint2(1, 1)).r;
+    return mix(mix(h00, h10, f.x), mix(h01, h11, f.x), f.y);
+}
+
+// ---------------------------------------------------------
+// Atmosphere
+// ---------------------------------------------------------
+// Sky radiance along a unit view direction, from the LUT built for sunDirection
+inline float3 atmosphereColor(texture2d<float> atmosphereLut, float3 viewDir, float3 sunDirection) {
+    constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
+    float u = acos(clamp(dot(viewDir, sunDirection), -1.0, 1.0)) * M_1_PI_F;
+    float v = (viewDir.y - ATMOSPHERE_LUT_MIN_ELEVATION) / (1.0 - ATMOSPHERE_LUT_MIN_ELEVATION);
+    float2 uv = (float2(u, saturate(v)) * float2(ATMOSPHERE_LUT_WIDTH - 1, ATMOSPHERE_LUT_HEIGHT - 1) + 0.5) /
+                float2(ATMOSPHERE_LUT_WIDTH, ATMOSPHERE_LUT_HEIGHT);
+    return atmosphereLut.sample(lutSampler, uv, level(0.0)).rgb;
+}
+
+// ---------------------------------------------------------
+// Wind (evaluated per wind field texel, sampled by the blade vertex stages)
+// ---------------------------------------------------------
+// Smooth value noise (0..1) with one lattice cell per texel of the shared noise texture: the
+// cubic-smoothed fraction is applied through the bilinear filter, so a lookup is one fetch.
+// The lattice coordinate wraps before the fraction is taken, so precision does not degrade
+// with distance from the origin (the pattern repeats every texture width instead).
+inline float valueNoise(texture2d<float> noiseTexture, float2 p) {
+    constexpr sampler noiseSampler(filter::linear, address::repeat);
+    float size = float(noiseTexture.get_width());
+    float2 i = floor(p);
+    float2 f = p - i;
+    float2 u = f * f * (3.0 - 2.0 * f); // Cubic smoothing
+    float2 cell = i - size * floor(i / size);
+    return noiseTexture.sample(noiseSampler, (cell + u + 0.5) / size, level(0.0)).r;
+}
+
+// Roystan-style fluid wind at a world position: xy = unit direction the blades bend toward,
+// z = bend strength (-0.3 rebound .. 1 full swell), w unused
+inline float4 grassWind(texture2d<float> noiseTexture, float2 worldXZ, float time) {
+    float2 windDir = normalize(float2(1.0, 0.5));
+    
+    // A. Main Swell (large wave)
+    // Key fix: remove +0.5 forced positive offset, allow negative rebound
+    float swellPhase = dot(worldXZ, windDir);
+    float rawSine = sin(swellPhase * 0.05 - time * 1.0); // -1 to 1
+    
+    // Map to [-0.3, 1.0] range
+    // 1.0 (large rightward tilt) -> 0.0 (upright) -> -0.3 (leftward inertia rebound)
+    // This creates a "swaying back and forth" feeling, not just "nodding"
+    float mainSwell = rawSine * 0.65 + 0.35;
+    
+    // B. Turbulence (detail noise)
+    float2 noiseUV = worldXZ * 0.2 - windDir * time * 2.0;
+    float turbulence = valueNoise(noiseTexture, noiseUV); // 0..1
+    // Allow noise to also perturb slightly leftward (-0.2 to 0.8)
+    turbulence = turbulence - 0.2;
+    
+    // C. Composite (blend)
+    return float4(windDir, mix(mainSwell, turbulence, 0.3), 0.0);
+}
+
+// Wind field texel centers span the ground bounds edge to edge
+inline float2 windFieldUV(float2 worldXZ, float2 groundMinXZ, float2 groundMaxXZ) {
+    float2 local = saturate((worldXZ - groundMinXZ) / (groundMaxXZ - groundMinXZ));
+    return (local * float(WIND_FIELD_SIZE - 1) + 0.5) / float(WIND_FIELD_SIZE);
+}
+#endif
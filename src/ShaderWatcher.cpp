@@ -0,0 +1,270 @@
+#include "ShaderWatcher.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+static const char* kSharedHeader = "ShaderTypes.h"; // Included by every source
+
+static bool hasSuffix(const std::string& value, const char* suffix)
+{
+    std::string ending(suffix);
+    return value.size() >= ending.size() && value.compare(value.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+static std::string quoted(const std::string& path)
+{
+    return "'" + path + "'";
+}
+
+// FNV-1a over the file contents (0 when it cannot be read)
+static uint64_t hashFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (std::istreambuf_iterator<char> it(file), end; it != end; ++it) {
+        hash = (hash ^ static_cast<uint8_t>(*it)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+ShaderWatcher::ShaderWatcher(MTL::Device* device, const std::string& sourceDir, const std::string& workDir)
+    : m_device(device)
+    , m_sourceDir(sourceDir)
+    , m_workDir(workDir)
+    , m_buildIndex(0)
+    , m_stopping(false)
+    , m_library(nullptr)
+{
+    mkdir(m_workDir.c_str(), 0755);
+    m_thread = std::thread(&ShaderWatcher::threadMain, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+
+    if (m_library) {
+        m_library->release();
+    }
+}
+
+MTL::Library* ShaderWatcher::takeLibrary(std::set<std::string>& changedFunctions)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MTL::Library* library = m_library;
+    m_library = nullptr;
+    changedFunctions.swap(m_changedFunctions);
+    m_changedFunctions.clear();
+    return library;
+}
+
+bool ShaderWatcher::scanSources(std::map<std::string, uint64_t>& hashes) const
+{
+    DIR* directory = opendir(m_sourceDir.c_str());
+    if (!directory) {
+        return false;
+    }
+    while (dirent* item = readdir(directory)) {
+        std::string name = item->d_name;
+        if (!hasSuffix(name, ".metal") && name != kSharedHeader) {
+            continue;
+        }
+        hashes[name] = hashFile(m_sourceDir + "/" + name);
+    }
+    closedir(directory);
+    return true;
+}
+
+bool ShaderWatcher::runCommand(const std::string& command, std::string& output)
+{
+    output.clear();
+    FILE* pipe = popen((command + " 2>&1").c_str(), "r");
+    if (!pipe) {
+        return false;
+    }
+    char buffer[512];
+    while (fgets(buffer, sizeof(buffer), pipe)) {
+        output += buffer;
+    }
+    return pclose(pipe) == 0;
+}
+
+bool ShaderWatcher::compile(const std::string& source, const std::string& air) const
+{
+    // Same invocation as the CMake shader build, into a scratch file: the last good AIR is only
+    // replaced by one that compiled
+    std::string output;
+    std::string scratch = air + ".new";
+    std::string command = "xcrun -sdk macosx metal -c " + quoted(m_sourceDir + "/" + source) + " -o " + quoted(scratch)
+                        + " -I" + quoted(m_sourceDir);
+    if (!runCommand(command, output)) {
+        std::cerr << "Shader compile failed: " << source << " (keeping the current library)\n" << output << std::endl;
+        std::remove(scratch.c_str());
+        return false;
+    }
+    if (std::rename(scratch.c_str(), air.c_str()) != 0) {
+        std::cerr << "Shader hot reload: failed to replace " << air << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MTL::Library* ShaderWatcher::link(const std::set<std::string>& airFiles, const std::string& output) const
+{
+    std::string command = "xcrun -sdk macosx metallib";
+    for (const std::string& air : airFiles) {
+        command += " " + quoted(air);
+    }
+    command += " -o " + quoted(output);
+
+    std::string log;
+    if (!runCommand(command, log)) {
+        std::cerr << "Shader link failed:\n" << log << std::endl;
+        return nullptr;
+    }
+
+    NS::Error* error = nullptr;
+    NS::URL* url = NS::URL::fileURLWithPath(NS::String::string(output.c_str(), NS::UTF8StringEncoding));
+    MTL::Library* library = m_device->newLibrary(url, &error);
+    if (!library) {
+        std::cerr << "Failed to load reloaded shader library " << output;
+        if (error) {
+            std::cerr << ": " << error->localizedDescription()->utf8String();
+        }
+        std::cerr << std::endl;
+    }
+    return library;
+}
+
+void ShaderWatcher::threadMain()
+{
+    bool initial = true; // The first pass only compiles the AIR later links need; the startup library is current
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!initial) {
+                m_wake.wait_for(lock, std::chrono::milliseconds(kPollIntervalMs), [this] { return m_stopping; });
+            }
+            if (m_stopping) {
+                return;
+            }
+        }
+
+        bool first = initial;
+        initial = false;
+
+        std::map<std::string, uint64_t> hashes;
+        if (!scanSources(hashes)) {
+            if (first) {
+                std::cerr << "Shader hot reload: cannot read " << m_sourceDir << std::endl;
+            }
+            continue;
+        }
+        if (hashes == m_hashes) {
+            continue;
+        }
+        if (!first) {
+            // Let the editor finish writing (saves can touch a file more than once)
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+            hashes.clear();
+            scanSources(hashes);
+        }
+
+        // An edit of the shared header recompiles every source
+        bool headerChanged = hashes[kSharedHeader] != m_hashes[kSharedHeader];
+        std::vector<std::string> changed;
+        std::set<std::string> airFiles;
+        for (const auto& item : hashes) {
+            if (!hasSuffix(item.first, ".metal")) {
+                continue;
+            }
+            auto previous = m_hashes.find(item.first);
+            if (headerChanged || previous == m_hashes.end() || previous->second != item.second) {
+                changed.push_back(item.first);
+            }
+            airFiles.insert(m_workDir + "/" + item.first.substr(0, item.first.size() - 6) + ".air");
+        }
+        // Failed sources are retried on their next edit, not every poll
+        m_hashes = hashes;
+        if (changed.empty()) {
+            continue;
+        }
+
+        NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+        auto start = std::chrono::steady_clock::now();
+        bool compiled = true;
+        for (const std::string& source : changed) {
+            std::string air = m_workDir + "/" + source.substr(0, source.size() - 6) + ".air";
+            if (compile(source, air)) {
+                if (!first) {
+                    m_unlinkedAir.insert(air);
+                }
+            } else {
+                compiled = false;
+            }
+        }
+
+        // A source whose every compile so far has failed has no AIR: a link would drop its functions
+        std::string missingAir;
+        for (const std::string& air : airFiles) {
+            struct stat info;
+            if (stat(air.c_str(), &info) != 0) {
+                missingAir = air;
+                break;
+            }
+        }
+        if (compiled && !first && !missingAir.empty()) {
+            std::cerr << "Shader hot reload: no compiled " << missingAir << " yet; keeping the current library" << std::endl;
+        }
+
+        if (compiled && !first && missingAir.empty()) {
+            // Functions of the sources recompiled since the last link (including those of a batch a
+            // failed compile held back): the pipelines to rebuild
+            std::set<std::string> functions;
+            MTL::Library* changedLibrary = link(m_unlinkedAir, m_workDir + "/changed.metallib");
+            if (changedLibrary) {
+                NS::Array* names = changedLibrary->functionNames();
+                for (NS::UInteger i = 0; i < names->count(); ++i) {
+                    functions.insert(names->object<NS::String>(i)->utf8String());
+                }
+                changedLibrary->release();
+            }
+
+            // A loaded library keeps reading its file: never overwrite one that may still be in use
+            std::string output = m_workDir + "/reload" + std::to_string(m_buildIndex++) + ".metallib";
+            MTL::Library* library = changedLibrary ? link(airFiles, output) : nullptr;
+            if (library) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "Shader hot reload: " << m_unlinkedAir.size() << " source(s), " << functions.size()
+                          << " function(s) recompiled in " << seconds << " s" << std::endl;
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_library) {
+                    m_library->release(); // Superseded before the render thread took it
+                } else {
+                    m_changedFunctions.clear();
+                }
+                m_library = library;
+                m_changedFunctions.insert(functions.begin(), functions.end());
+                m_unlinkedAir.clear();
+            }
+        }
+        if (first) {
+            std::cout << "Shader hot reload: watching " << m_sourceDir << std::endl;
+        }
+        pool->release();
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// Development-mode shader hot reload. A background thread polls the .metal sources (and the
+// shared ShaderTypes.h) for content changes (a hash of each file, so edits within the same
+// second of modification time are still seen), recompiles only the edited sources to AIR with
+// the same `xcrun metal` invocation as the build, relinks every AIR into a fresh metallib and
+// loads it. A failed compile keeps the source's last good AIR and links nothing, so the current
+// library stays in use until the source compiles again.
+// The render thread collects the result with takeLibrary() at a frame boundary, together with
+// the names of the functions defined by the recompiled sources, so only the pipelines using
+// them need rebuilding.
+class ShaderWatcher {
+public:
+    // sourceDir holds the .metal files; AIR and metallib outputs go to workDir
+    ShaderWatcher(MTL::Device* device, const std::string& sourceDir, const std::string& workDir);
+    ~ShaderWatcher(); // Stops the thread (waits for a compile in progress)
+
+    // Library linked since the last call (the caller owns the reference) and the functions of
+    // the recompiled sources; nullptr while nothing new has been built
+    MTL::Library* takeLibrary(std::set<std::string>& changedFunctions);
+
+private:
+    static constexpr int kPollIntervalMs = 250;
+
+    void threadMain();
+    bool scanSources(std::map<std::string, uint64_t>& hashes) const; // False when the source directory is unreadable
+    bool compile(const std::string& source, const std::string& air) const;
+    MTL::Library* link(const std::set<std::string>& airFiles, const std::string& output) const;
+    static bool runCommand(const std::string& command, std::string& output);
+
+    MTL::Device* m_device;
+    std::string m_sourceDir;
+    std::string m_workDir;
+    std::map<std::string, uint64_t> m_hashes;  // Source file -> content hash it was last compiled at
+    std::set<std::string> m_unlinkedAir;       // AIR recompiled since the last reload library
+    uint32_t m_buildIndex;                     // Distinct metallib names (a loaded library keeps its file)
+
+    std::thread m_thread;
+    std::mutex m_mutex;                        // Guards the fields below
+    std::condition_variable m_wake;
+    bool m_stopping;
+    MTL::Library* m_library;                   // Built, not yet taken
+    std::set<std::string> m_changedFunctions;
+};
@@ -5,42 +5,63 @@ using namespace metal;
 
 // Vertex shader output (rasterizer interpolated data)
 struct RasterizerData {
-    float4 position [[position]];
+    float4 position [[position, invariant]]; // Bit-identical in the depth prepass and the grass pass
     float2 texcoord;
-    float3 normal;
     float3 worldPos; // World position for view direction calculation
-    float instanceHash; // Hash value from instanceID for color variation
-    float windStrength; // Wind bend amount for "Wind Sheen" effect (Ghibli style)
-    float isYellow; // Flag for yellow-green withered grass (0.0 = normal, 1.0 = yellow)
-    float influence; // Interaction influence factor (1.0 = fully crushed, 0.0 = unaffected)
+    float influence; // Trample strength at the blade root (1.0 = fully crushed, 0.0 = unaffected)
+    float lodFade; // LOD crossfade weight from the cull pass (1.0 = fully opaque)
+    float4 currentClip [[function_constant(writeMotionVectors)]]; // Unjittered clip position (motion vectors)
+    float4 previousClip [[function_constant(writeMotionVectors)]]; // Same blade point last frame
+    uint visibleSlot [[flat, function_constant(writeGrassVisibility)]]; // Visible list entry (visibility-buffer grass)
+    uint objectId [[flat, function_constant(writeObjectId)]]; // The blade's instance (picking)
+    uint albedoVariant [[flat]]; // Slice of the grass albedo array (alpha mask)
+    uint species [[flat]]; // Vegetation species (material colors)
+    
+    // Shading-only interpolants, at the precision of the pipeline (read through bladeShading())
+    float3 normal [[function_constant(fullPrecisionShading)]];
+    float instanceHash [[function_constant(fullPrecisionShading)]]; // Baked per-blade hash for color variation
+    float windStrength [[function_constant(fullPrecisionShading)]]; // Wind bend amount for "Wind Sheen" effect (Ghibli style)
+    float isYellow [[function_constant(fullPrecisionShading)]]; // Flag for yellow-green withered grass (0.0 = normal, 1.0 = yellow)
+    half3 normalHalf [[function_constant(halfPrecisionShading)]];
+    half3 bladeToneHalf [[function_constant(halfPrecisionShading)]]; // (instanceHash, windStrength, isYellow)
 };
 
-// Pseudo-random function based on instance ID
-float random(float seed) {
-    return fract(sin(seed * 12.9898) * 43758.5453);
-}
+// Shading-only interpolants converted to the shading precision T
+template <typename T>
+struct BladeShading {
+    vec<T, 3> normal;
+    T instanceHash;
+    T windStrength;
+    T isYellow;
+};
 
-// Hash function for instanceID (returns 0.0 to 1.0)
-float hash(uint instanceID) {
-    return random(float(instanceID) * 0.12345 + 500.0);
+template <typename T>
+static BladeShading<T> bladeShading(RasterizerData in) {
+    BladeShading<T> blade;
+    if (halfPrecisionShading) {
+        blade.normal = vec<T, 3>(in.normalHalf);
+        blade.instanceHash = T(in.bladeToneHalf.x);
+        blade.windStrength = T(in.bladeToneHalf.y);
+        blade.isYellow = T(in.bladeToneHalf.z);
+    } else {
+        blade.normal = vec<T, 3>(in.normal);
+        blade.instanceHash = T(in.instanceHash);
+        blade.windStrength = T(in.windStrength);
+        blade.isYellow = T(in.isYellow);
+    }
+    return blade;
 }
 
-// ---------------------------------------------------------
-// IMPROVED NOISE FUNCTION (Bilinear Smooth)
-// ---------------------------------------------------------
-float noise2D(float2 p) {
-    float2 i = floor(p);
-    float2 f = fract(p);
-    float2 u = f * f * (3.0 - 2.0 * f); // Cubic smoothing
-    
-    // Hash function integrated
-    float2 magic = float2(12.9898, 78.233);
-    float a = fract(sin(dot(i, magic)) * 43758.5453);
-    float b = fract(sin(dot(i + float2(1.0, 0.0), magic)) * 43758.5453);
-    float c = fract(sin(dot(i + float2(0.0, 1.0), magic)) * 43758.5453);
-    float d = fract(sin(dot(i + float2(1.0, 1.0), magic)) * 43758.5453);
-    
-    return mix(mix(a, b, u.x), mix(c, d, u.x), u.y);
+static void setBladeShading(thread RasterizerData &out, float3 normal, float instanceHash, float windStrength, float isYellow) {
+    if (halfPrecisionShading) {
+        out.normalHalf = half3(normal);
+        out.bladeToneHalf = half3(instanceHash, windStrength, isYellow);
+    } else {
+        out.normal = normal;
+        out.instanceHash = instanceHash;
+        out.windStrength = windStrength;
+        out.isYellow = isYellow;
+    }
 }
 
 // Struct to hold instance variation data
@@ -49,34 +70,18 @@ struct InstanceVariation {
     float scale;
 };
 
-// Generate random rotation and scale based on instance ID
-InstanceVariation getInstanceVariation(uint instanceID) {
-    float rand1 = random(float(instanceID));
-    float rand2 = random(float(instanceID) * 0.5 + 100.0);
-    
+// Decode rotation and scale from the packed instance
+InstanceVariation getInstanceVariation(InstanceData instance) {
     InstanceVariation variation;
-    // Random rotation: 0 to 360 degrees
-    variation.rotation = rand1 * 6.28318; // 2 * PI
+    // Rotation: 0 to 360 degrees (quantized at placement time)
+    variation.rotation = instanceRotation(instance);
     
-    // Random scale: 0.8 to 1.2
-    variation.scale = 0.8 + rand2 * 0.4;
+    // Scale: 0.8 to 1.2 (quantized at placement time)
+    variation.scale = instanceScale(instance);
     
     return variation;
 }
 
-// Generate random bend direction angle (0 to 2*PI)
-float getBendDirection(uint instanceID) {
-    float rand = random(float(instanceID) * 0.3 + 200.0);
-    return rand * 6.28318; // 0 to 2*PI
-}
-
-// Generate random initial tilt angle (in radians, small range)
-float getInitialTilt(uint instanceID) {
-    float rand = random(float(instanceID) * 0.7 + 300.0);
-    // Tilt range: -15 to +15 degrees converted to radians
-    return (rand - 0.5) * 0.5236; // ±15 degrees = ±0.5236 radians
-}
-
 // Build a rotation matrix around Y-axis
 float4x4 rotationY(float angle) {
     float c = cos(angle);
@@ -96,45 +101,115 @@ float3 rotateVector(float3 v, float3 axis, float angle) {
     return v * c + axis * dot(axis, v) * (1.0 - c) + cross(axis, v) * s;
 }
 
+// Bend pose (sin, 1 - cos) of a bend angle from the baked table, linearly interpolated
+static float2 bakedWindPose(constant SceneConstants &scene, float angle) {
+    float x = (clamp(angle / GRASS_WIND_POSE_MAX_ANGLE, -1.0, 1.0) * 0.5 + 0.5) * float(GRASS_WIND_POSE_COUNT - 1);
+    uint i = min(uint(x), uint(GRASS_WIND_POSE_COUNT - 2));
+    return mix(scene.windPoses[i], scene.windPoses[i + 1], x - float(i));
+}
+
+// rotateVector() about the horizontal axis cross(up, w) (w: unit horizontal bend direction) by a
+// baked pose, with the axis' products written out: up tips toward w, w toward -up
+static float3 bendTowards(float3 v, float3 w, float2 pose) {
+    float along = dot(v.xz, w.xz);
+    return v + w * (v.y * pose.x - along * pose.y) - float3(0.0, 1.0, 0.0) * (v.y * pose.y + along * pose.x);
+}
+
+// Per-frame inputs of the blade animation (this frame's, or last frame's for motion vectors)
+struct GrassAnimation {
+    float time; // Wind clock
+    float3 cameraPosition; // Billboard reference
+    bool previousFrame; // Flatten rings around the interactors' previous positions
+};
+
+static GrassAnimation currentAnimation(constant Uniforms &uniforms) {
+    GrassAnimation animation;
+    animation.time = uniforms.time;
+    animation.cameraPosition = uniforms.cameraPosition;
+    animation.previousFrame = false;
+    return animation;
+}
+
+static GrassAnimation previousAnimation(constant Uniforms &uniforms) {
+    GrassAnimation animation;
+    animation.time = uniforms.prevTime;
+    animation.cameraPosition = uniforms.prevCameraPosition;
+    animation.previousFrame = true;
+    return animation;
+}
+
 // ---------------------------------------------------------
-// OPTIMIZED VERTEX SHADER (FIXED SWAY & NORMALS)
+// BLADE VERTEX DEFORMATION (shared by the vertex and mesh paths)
 // ---------------------------------------------------------
-vertex RasterizerData vertexMain(
-    uint vertexID [[vertex_id]],
-    uint instanceID [[instance_id]],
-    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
-    constant InstanceData *instances [[buffer(BufferIndexInstanceData)]],
-    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+// Geometry blades: the strip tapers to a point so the mesh is the silhouette, and the grass
+// pipelines draw it opaque (no texture alpha, fwidth, discard or alpha-to-coverage; MSAA
+// antialiases the geometric edges). Off when the constant is left undefined.
+constant bool geometryBladesValue [[function_constant(FunctionConstantIndexGeometryBlades)]];
+constant bool geometryBlades = is_function_constant_defined(geometryBladesValue) && geometryBladesValue;
+constant float kGeometryBladeWidth = 0.4; // Root width relative to the textured strip (the texture's blade is narrower than its quad)
+
+// vertexPosition / texcoord are the blade-local strip vertex (see appendBladeMesh)
+static RasterizerData grassBladeVertex(
+    float3 vertexPosition,
+    float2 texcoord,
+    InstanceData instance,
+    float lodFade,
+    BladeState bladeState,
+    GrassAnimation animation,
+    constant Uniforms &uniforms,
+    constant SceneConstants &scene,
+    const device Interactor *interactors,
+    const device InteractorBin *interactorBins,
+    texture2d<float, access::read> trampleMap,
+    texture2d_array<float> windField
 ) {
     RasterizerData out;
-    InstanceData instance = instances[instanceID];
-    
-    // 1. Get Base Instance World Position
-    float3 instanceWorldPos = float3(
-        instance.modelMatrix.columns[3].x, 
-        instance.modelMatrix.columns[3].y, 
-        instance.modelMatrix.columns[3].z
-    );
+    out.lodFade = lodFade;
+    out.albedoVariant = instanceAlbedoVariant(instance);
+    out.species = instanceSpecies(instance);
+    
+    // 1. Get Base Instance World Position (quantized over the grass bounds)
+    float3 instanceWorldPos = instancePosition(instance, scene.grassMinXZ, scene.grassMaxXZ);
+    
+    // Trample at the blade root. Past the cull threshold the blade is gone: the cull pass and the
+    // object stage never list it, and draws without them (CPU cell culling, the unculled fallback)
+    // move all its vertices behind the near plane here, before any bending work
+    float trample = trampleAt(trampleMap, instanceWorldPos.xz, uniforms.trampleWindowMinXZ,
+                              uniforms.trampleWindowSize, animation.time, scene.trampleDecayRate);
+    if (trample >= TRAMPLE_CULL_THRESHOLD) {
+        out.position = float4(0.0, 0.0, -1.0, 1.0);
+        out.worldPos = instanceWorldPos;
+        return out;
+    }
     
-    // 2. Randomization & Attributes
-    InstanceVariation variation = getInstanceVariation(instanceID);
+    // 2. Randomization & Attributes (baked at generation time)
+    InstanceVariation variation = getInstanceVariation(instance);
     float randomRotation = variation.rotation;
+    float bladeHash = instanceHash(instance);
     
     // 3. Billboard Rotation Calculation
-    float3 toCamera = normalize(uniforms.cameraPosition - instanceWorldPos);
+    float3 toCamera = normalize(animation.cameraPosition - instanceWorldPos);
     float3 toCameraXZ = normalize(float3(toCamera.x, 0.0, toCamera.z));
     float billboardAngle = atan2(toCameraXZ.x, toCameraXZ.z);
     float finalRotation = billboardAngle + randomRotation;
     float4x4 billboardRotation = rotationY(finalRotation);
     
     // 4. Vertex Setup
-    float3 vertexPosition = vertices[vertexID].position;
-    float2 texcoord = vertices[vertexID].texcoord;
     float t = 1.0 - texcoord.y; // 0=Root, 1=Tip
-    
-    // 5. Initial Tilt
-    float initialTiltAngle = getInitialTilt(instanceID);
-    float tiltAxisChoice = hash(instanceID); 
+    if (geometryBlades) {
+        // Full width low on the blade, closing to a point at the tip
+        vertexPosition.x *= kGeometryBladeWidth * (1.0 - t * t);
+    }
+    // Density LOD: the blades a far cell keeps widen by the share it dropped (the cull pass thins
+    // by the nearest of several views' cameras)
+    float densityLodDist = uniforms.viewCount > 1
+        ? nearestViewDistance(instanceWorldPos, uniforms.viewCameraPositions, uniforms.viewCount)
+        : distance(animation.cameraPosition, instanceWorldPos);
+    vertexPosition.x /= grassDensityLodFraction(densityLodDist, scene.grassDensityLodDistance);
+    
+    // 5. Initial Tilt (±15 degrees)
+    float initialTiltAngle = instanceTilt(instance);
+    float tiltAxisChoice = bladeHash;
     float c = cos(initialTiltAngle);
     float s = sin(initialTiltAngle);
     if (tiltAxisChoice < 0.5) {
@@ -153,34 +228,18 @@ vertex RasterizerData vertexMain(
 // ---------------------------------------------------------
     
     // 1. Idle Chaos (breathing effect)
-    float tTime = uniforms.time;
-    float seed = float(instanceID);
-    float idleFreq = 2.0 + hash(instanceID) * 1.5; 
-    float idlePhase = seed * 13.0;
+    float tTime = animation.time;
+    float idleFreq = 2.0 + bladeHash * 1.5; 
+    float idlePhase = instanceIdlePhase(instance);
     // Slightly increase idle amplitude to ensure motion even when still
     float idleStrength = sin(tTime * idleFreq + idlePhase) * 0.08; 
     
-    // 2. Roystan-Style Fluid Wind (main wind wave)
-    float2 windDir = normalize(float2(1.0, 0.5)); 
-    
-    // A. Main Swell (large wave)
-    // Key fix: remove +0.5 forced positive offset, allow negative rebound
-    float swellPhase = dot(instanceWorldPos.xz, windDir);
-    float rawSine = sin(swellPhase * 0.05 - tTime * 1.0); // -1 to 1
-    
-    // Map to [-0.3, 1.0] range
-    // 1.0 (large rightward tilt) -> 0.0 (upright) -> -0.3 (leftward inertia rebound)
-    // This creates a "swaying back and forth" feeling, not just "nodding"
-    float mainSwell = rawSine * 0.65 + 0.35;
-    
-    // B. Turbulence (detail noise)
-    float2 noiseUV = instanceWorldPos.xz * 0.2 - windDir * tTime * 2.0;
-    float turbulence = noise2D(noiseUV); // 0..1
-    // Allow noise to also perturb slightly leftward (-0.2 to 0.8)
-    turbulence = turbulence - 0.2;
-    
-    // C. Composite (blend)
-    float fluidWind = mix(mainSwell, turbulence, 0.3);
+    // 2. Roystan-Style Fluid Wind (main wind wave), from the wind field (grassWind() per texel)
+    constexpr sampler windSampler(filter::linear, address::clamp_to_edge);
+    float2 windUV = windFieldUV(instanceWorldPos.xz, scene.groundMinXZ, scene.groundMaxXZ);
+    float4 wind = windField.sample(windSampler, windUV, animation.previousFrame ? 1 : 0, level(0.0));
+    float2 windDir = normalize(wind.xy);
+    float fluidWind = wind.z;
     
     // 3. Combine Forces
     float totalWindStrength = fluidWind + idleStrength;
@@ -190,254 +249,540 @@ vertex RasterizerData vertexMain(
     float bendAngle = totalWindStrength * t * 1.2; 
     
     // 5. Calculate Rotation Axis (With Jitter)
-    float axisJitter = (hash(seed) - 0.5) * 0.2; 
+    float axisJitter = (bladeHash - 0.5) * 0.2; 
     float3 windVector3D = normalize(float3(windDir.x, 0.0, windDir.y));
     float3 jitteredWind = normalize(windVector3D + float3(windDir.y, 0.0, -windDir.x) * axisJitter);
     
-    float3 upVector = float3(0.0, 1.0, 0.0);
-    float3 bendAxis = normalize(cross(upVector, jitteredWind));
-    
-    // 6. Apply Rodrigues Rotation to GEOMETRY
-    float3 localPos = finalWorldPos - instanceWorldPos;
-    localPos = rotateVector(localPos, bendAxis, bendAngle);
-    finalWorldPos = instanceWorldPos + localPos;
-    
-    // ---------------------------------------------------------
-    // ROTATE NORMALS (fixes tip darkening issue)
-    // ---------------------------------------------------------
-    // We must rotate normals around the same axis, otherwise lighting thinks grass is straight
-    
-    // 1. Get original Billboard normal (points to Z axis, rotates with Billboard)
-    float3 forwardLocal = float3(0.0, 0.0, 1.0);
-    float3 initialNormal = (billboardRotation * float4(forwardLocal, 0.0)).xyz;
-    
-    // 2. Apply the same wind rotation to normals
-    // Only then can normals correctly reflect the bent geometry orientation
-    float3 rotatedNormal = rotateVector(initialNormal, bendAxis, bendAngle);
+    // Mid and far blades look the (sin, 1 - cos) of the same bend angle up in the baked poses
+    // instead of evaluating the rotation's trig, axis and Rodrigues products; the wind sample and
+    // idle sway above still run for them. Angles past the table and blades the spring simulation
+    // reaches keep the procedural path, so the switch does not show.
+    float3 initialNormal = (billboardRotation * float4(0.0, 0.0, 1.0, 0.0)).xyz; // Billboard normal (Z)
+    float3 rotatedNormal;
+    bool bakedPose = scene.windPoseDistance > 0.0 && densityLodDist > scene.windPoseDistance &&
+                     abs(bendAngle) <= GRASS_WIND_POSE_MAX_ANGLE &&
+                     (uniforms.bladePhysicsRadius <= 0.0 ||
+                      distance(uniforms.bladePhysicsCenter.xz, instanceWorldPos.xz) >= uniforms.bladePhysicsRadius);
+    if (bakedPose) {
+        float2 pose = bakedWindPose(scene, bendAngle);
+        finalWorldPos = instanceWorldPos + bendTowards(finalWorldPos - instanceWorldPos, jitteredWind, pose);
+        rotatedNormal = bendTowards(initialNormal, jitteredWind, pose);
+    } else {
+        float3 upVector = float3(0.0, 1.0, 0.0);
+        float3 bendAxis = normalize(cross(upVector, jitteredWind));
+    
+        // Blade physics: near the camera the simulated tip bend (wind response with inertia plus the
+        // interactors' push) replaces the wind bend, fading back to it at the simulation radius.
+        // Last frame's bend is extrapolated back along the spring's velocity.
+        if (uniforms.bladePhysicsRadius > 0.0) {
+            float simulated = 1.0 - smoothstep(uniforms.bladePhysicsRadius * 0.75, uniforms.bladePhysicsRadius,
+                                               distance(uniforms.bladePhysicsCenter.xz, instanceWorldPos.xz));
+            if (simulated > 0.0) {
+                float2 bend = bladeState.bend;
+                if (animation.previousFrame) {
+                    bend -= bladeState.velocity * (uniforms.time - uniforms.prevTime);
+                }
+                float2 tipBend = mix(jitteredWind.xz * totalWindStrength * 1.2, bend + jitteredWind.xz * idleStrength * 1.2, simulated);
+                float tipAngle = length(tipBend);
+                if (tipAngle > 1e-4) {
+                    bendAxis = normalize(cross(upVector, float3(tipBend.x, 0.0, tipBend.y)));
+                    bendAngle = tipAngle * t;
+                }
+            }
+        }
+    
+        // 6. Apply Rodrigues Rotation to GEOMETRY
+        float3 localPos = finalWorldPos - instanceWorldPos;
+        localPos = rotateVector(localPos, bendAxis, bendAngle);
+        finalWorldPos = instanceWorldPos + localPos;
+    
+        // ---------------------------------------------------------
+        // ROTATE NORMALS (fixes tip darkening issue)
+        // ---------------------------------------------------------
+        // We must rotate normals around the same axis, otherwise lighting thinks grass is straight
+    
+        // Apply the same wind rotation to the billboard normal
+        // Only then can normals correctly reflect the bent geometry orientation
+        rotatedNormal = rotateVector(initialNormal, bendAxis, bendAngle);
+    }
     
-    // 3. Blend a bit of (0,1,0) for softer lighting, but base must be rotatedNormal
+    // Blend a bit of (0,1,0) for softer lighting, but base must be rotatedNormal
     float3 stylizedNormal = normalize(rotatedNormal * 0.6 + float3(0.0, 1.0, 0.0) * 0.6);
 
     // ---------------------------------------------------------
     // SOFT FLATTEN RING (Ghibli-like compression, no sideways bending)
     // ---------------------------------------------------------
-    // Compute distance to the ball in XZ
+    // Strongest ring among the interactors binned to this point's tile (distance in XZ)
     float2 P = finalWorldPos.xz;
-    float2 ballCenterXZ = uniforms.ballWorldPos.xz;
-    float d = length(P - ballCenterXZ);
-    
-    // Ring mask (narrow, smooth falloff)
-    float ring = smoothstep(uniforms.ballRadius + uniforms.flattenBandWidth, 
-                           uniforms.ballRadius, d);
+    InteractorBin bin = interactorBins[interactorBinIndex(P, uniforms)];
+    float ring = 0.0;
+    for (uint i = 0; i < bin.count; ++i) {
+        Interactor interactor = interactors[bin.indices[i]];
+        float2 centerXZ = animation.previousFrame ? interactor.prevPosition.xz : interactor.position.xz;
+        float d = length(P - centerXZ);
+        
+        // Ring mask (narrow, smooth falloff)
+        ring = max(ring, smoothstep(interactor.radius + interactor.falloff, interactor.radius, d));
+    }
     
     // Height weighting (tip > base)
     // Use existing t (0=Root, 1=Tip) for height factor
     float heightW = saturate(t); // Already 0-1
     heightW = heightW * heightW; // Quadratic: stronger tip weighting
     
+    // Trample trail at the blade root: flattened geometrically, fully flat at the cull threshold
+    float trampleFlatten = saturate(trample / TRAMPLE_CULL_THRESHOLD);
+    out.influence = trample;
+    
     // Apply flatten by compressing towards root
-    if (ring > 0.001) {
+    float press = max(ring, trampleFlatten);
+    if (press > 0.001) {
         // Compute root world position for this blade
         float3 rootWorldPos = instanceWorldPos;
         
         // Apply flatten compression (no sideways bending)
-        float flatten = ring * heightW * uniforms.flattenStrength;
+        float flatten = press * heightW * scene.flattenStrength;
         finalWorldPos = rootWorldPos + (finalWorldPos - rootWorldPos) * (1.0 - flatten);
     }
     
-    // ---------------------------------------------------------
-    // Trample map system now handles grass clipping in fragment shader
-    // ---------------------------------------------------------
-    // Set influence to 0.0 (no longer used for vertex deformation)
-    out.influence = 0.0;
-    
     // Pass Output
     // Specular only responds to forward strong wind (mainSwell), ignore rebound phase
-    out.windStrength = max(0.0, fluidWind); 
+    float windStrength = max(0.0, fluidWind);
 
     float4 pos = uniforms.projectionMatrix * uniforms.viewMatrix * float4(finalWorldPos, 1.0);
     
     out.position = pos;
     out.texcoord = texcoord;
-    out.normal = stylizedNormal; // Use corrected normal
     out.worldPos = finalWorldPos;
-    out.instanceHash = hash(instanceID);
     
-    // Determine if this blade should be yellow-green (withered) - 10% probability
-    // Use a different hash seed to ensure independence from instanceHash
-    float yellowHash = hash(instanceID * 7 + 1000);
-    out.isYellow = (yellowHash > 0.9) ? 1.0 : 0.0;
+    // Corrected normal; yellow-green (withered) blades: 10% probability, flagged at generation time
+    setBladeShading(out, stylizedNormal, bladeHash, windStrength, instanceIsYellow(instance) ? 1.0 : 0.0);
+    
+    // Geometry blades cannot fade through coverage: a crossfading blade switches LOD halfway
+    // through the band, and the fading copy is moved behind the near plane (clipped)
+    if (geometryBlades && lodFade < 0.5) {
+        out.position = float4(0.0, 0.0, -1.0, 1.0);
+    }
     
     return out;
 }
 
-fragment float4 fragmentMain(
-    RasterizerData in [[stage_in]],
-    texture2d<float> colorTexture [[texture(TextureIndexGrass)]],
-    texture2d<float> trampleMap [[texture(TextureIndexTrampleMap)]],
-    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+// Uniforms of an amplified view: the multi-view grass pipeline binds consecutive views'
+// Uniforms (UNIFORMS_VIEW_STRIDE apart) and draws each blade once per view. Without
+// amplification the id is 0 and this is the bound view.
+static constant Uniforms &amplifiedViewUniforms(constant Uniforms &firstView, ushort amplificationID) {
+    return *reinterpret_cast<constant Uniforms *>(reinterpret_cast<constant uchar *>(&firstView) +
+                                                 amplificationID * UNIFORMS_VIEW_STRIDE);
+}
+
+// ---------------------------------------------------------
+// OPTIMIZED VERTEX SHADER (FIXED SWAY & NORMALS)
+// ---------------------------------------------------------
+vertex RasterizerData vertexMain(
+    uint vertexID [[vertex_id]],
+    uint drawInstanceID [[instance_id]],
+    ushort amplificationID [[amplification_id]],
+    constant GrassResourceTable &table [[buffer(BufferIndexGrassResources)]],
+    constant Uniforms &firstViewUniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]]
 ) {
-    // Define a constexpr sampler inside the shader function
-    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::clamp_to_edge);
-    
-    // ---------------------------------------------------------
-    // 0. TRAMPLE MAP: Hard clip grass where trampled
-    // ---------------------------------------------------------
-    // Map world position to trample map UV
-    float2 worldXZ = in.worldPos.xz;
-    float2 trampleUV = (worldXZ - uniforms.groundMinXZ) / (uniforms.groundMaxXZ - uniforms.groundMinXZ);
-    
-    // Sample trample map
-    constexpr sampler trampleSampler(mag_filter::linear, min_filter::linear, address::clamp_to_edge);
-    float trample = trampleMap.sample(trampleSampler, trampleUV).r;
+    // Remap the draw instance to the original instance (compacted by the cull pass).
+    // drawInstanceID already includes the per-bucket baseInstance offset.
+    VisibleInstance visible = table.visibleInstances[drawInstanceID];
+    constant Uniforms &uniforms = amplifiedViewUniforms(firstViewUniforms, amplificationID);
+    
+    // Listed for another view's frustum only: moved behind the near plane (clipped)
+    if ((visible.viewMask & (1u << uniforms.viewIndex)) == 0) {
+        RasterizerData out;
+        out.position = float4(0.0, 0.0, -1.0, 1.0);
+        return out;
+    }
     
-    // Hard clip: if trample > 0.5, discard fragment (grass disappears)
-    const float killThreshold = 0.5;
-    if (trample > killThreshold) {
-        discard_fragment();
+    InstanceData instance = table.instances[visible.instanceID];
+    float3 position = table.vertices[vertexID].position;
+    float2 texcoord = table.vertices[vertexID].texcoord;
+    BladeState bladeState = uniforms.bladePhysicsRadius > 0.0 ? table.bladeStates[visible.instanceID] : BladeState();
+    RasterizerData out = grassBladeVertex(position, texcoord, instance, visible.lodFade, bladeState, currentAnimation(uniforms), uniforms, scene,
+                                        table.interactors, table.interactorBins, table.trampleMap, table.windField);
+    
+    if (writeMotionVectors) {
+        // Same blade point under last frame's wind, billboard and flatten ring
+        RasterizerData previous = grassBladeVertex(position, texcoord, instance, visible.lodFade, bladeState, previousAnimation(uniforms), uniforms, scene,
+                                                       table.interactors, table.interactorBins, table.trampleMap, table.windField);
+        out.currentClip = uniforms.unjitteredViewProjection * float4(out.worldPos, 1.0);
+        out.previousClip = uniforms.prevViewProjection * float4(previous.worldPos, 1.0);
+    }
+    if (writeGrassVisibility) {
+        out.visibleSlot = drawInstanceID;
     }
+    if (writeObjectId) {
+        out.objectId = OBJECT_ID(ObjectIdKindBlade, visible.instanceID);
+    }
+    return out;
+}
+
+// ---------------------------------------------------------
+// MESH SHADER PATH (object stage culls + picks LOD, mesh stage emits strips)
+// ---------------------------------------------------------
+// Blades handed from one object threadgroup to its mesh threadgroups.
+// A blade inside a LOD crossfade band is listed twice (once per LOD).
+struct GrassMeshPayload {
+    uint count;
+    uint instanceID[GRASS_MESH_PAYLOAD_CAPACITY];
+    uchar bucket[GRASS_MESH_PAYLOAD_CAPACITY]; // Species and LOD mesh
+    half lodFade[GRASS_MESH_PAYLOAD_CAPACITY];
+};
+
+using GrassMesh = metal::mesh<RasterizerData, void,
+                              GRASS_MESH_MAX_VERTICES, GRASS_MESH_MAX_PRIMITIVES,
+                              topology::triangle>;
+
+// Height segments of a bucket's blade strip (6 indices per segment)
+static uint bladeSegments(constant CullUniforms &cull, uint bucket) {
+    return cull.bucketMeshes[bucket].x / 6;
+}
+
+static void appendPayloadEntry(object_data GrassMeshPayload &payload,
+                               threadgroup atomic_uint &entryCount,
+                               uint instanceID, uint bucket, float fade) {
+    uint slot = atomic_fetch_add_explicit(&entryCount, 1u, memory_order_relaxed);
+    payload.instanceID[slot] = instanceID;
+    payload.bucket[slot] = uchar(bucket);
+    payload.lodFade[slot] = half(fade);
+}
+
+// One thread per blade: frustum test and LOD selection (same policy as cullGrassInstances)
+[[object]] void grassObjectMain(
+    object_data GrassMeshPayload &payload [[payload]],
+    mesh_grid_properties meshGrid,
+    constant InstanceData *instances [[buffer(CullBufferIndexInstances)]],
+    constant CullUniforms &cull [[buffer(CullBufferIndexUniforms)]],
+    texture2d<float, access::read> trampleMap [[texture(CullTextureIndexTrampleMap)]],
+    uint instanceID [[thread_position_in_grid]],
+    uint tid [[thread_index_in_threadgroup]]
+) {
+    threadgroup atomic_uint entryCount;
+    if (tid == 0) {
+        atomic_store_explicit(&entryCount, 0u, memory_order_relaxed);
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    // Zero-scale instances are the slots the density mask left empty. Without cells the density LOD
+    // ranks blades by their baked hash (uniform thinning rather than the progressive prefix).
+    bool kept = instanceID < cull.instanceCount && instanceScale(instances[instanceID]) > 0.0;
+    float3 center = kept ? instancePosition(instances[instanceID], cull.fieldMinXZ, cull.fieldMaxXZ) : float3(0.0);
+    float densityFraction = grassDensityLodFraction(distance(center, cull.cameraPosition), cull.densityLodDistance);
+    kept = kept && instanceHash(instances[instanceID]) < densityFraction;
+    if (kept) {
+        float trample = trampleAt(trampleMap, center.xz, cull.trampleWindowMinXZ, cull.trampleWindowSize,
+                                  cull.time, cull.trampleDecayRate);
+        float bladeRadius = grassDensityLodRadius(cull.bladeRadius, densityFraction);
+        // Impostor band: the blade fades out by its own distance while the cull pass fades its
+        // cell's card in by the cell center's (within half a cell of each other)
+        float dist = distance(center, cull.cameraPosition);
+        float bladeFade = 1.0;
+        if (cull.impostorEnabled != 0) {
+            float bandStart = cull.impostorDistance - cull.impostorFadeWidth * 0.5;
+            bladeFade = 1.0 - saturate((dist - bandStart) / max(cull.impostorFadeWidth, 1e-4));
+        }
+        if (bladeFade > 0.0 && trample < TRAMPLE_CULL_THRESHOLD && sphereInFrustum(center, bladeRadius, cull.frustumPlanes)) {
+            uint species = instanceSpecies(instances[instanceID]);
+            float halfBand = cull.lodFadeWidth * 0.5;
+            uint lod = 0;
+            bool appended = false;
+            for (uint i = 0; i < GRASS_LOD_COUNT - 1; ++i) {
+                float boundary = cull.lodDistances[i];
+                if (dist < boundary - halfBand) {
+                    break;
+                }
+                if (dist < boundary + halfBand) {
+                    float fadeIn = saturate((dist - (boundary - halfBand)) / max(cull.lodFadeWidth, 1e-4));
+                    appendPayloadEntry(payload, entryCount, instanceID, grassDrawBucket(species, i), (1.0 - fadeIn) * bladeFade);
+                    appendPayloadEntry(payload, entryCount, instanceID, grassDrawBucket(species, i + 1), fadeIn * bladeFade);
+                    appended = true;
+                    break;
+                }
+                lod = i + 1;
+            }
+            if (!appended) {
+                appendPayloadEntry(payload, entryCount, instanceID, grassDrawBucket(species, lod), bladeFade);
+            }
+        }
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup | mem_flags::mem_object_data);
+    if (tid == 0) {
+        uint count = atomic_load_explicit(&entryCount, memory_order_relaxed);
+        payload.count = count;
+        meshGrid.set_threadgroups_per_grid(uint3((count + GRASS_MESH_BLADES_PER_GROUP - 1) / GRASS_MESH_BLADES_PER_GROUP, 1, 1));
+    }
+}
+
+// Emits up to GRASS_MESH_BLADES_PER_GROUP payload blades as procedural strips
+[[mesh]] void grassMeshMain(
+    GrassMesh output,
+    const object_data GrassMeshPayload &payload [[payload]],
+    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
+    constant InstanceData *instances [[buffer(BufferIndexInstanceData)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    constant CullUniforms &cull [[buffer(BufferIndexCullUniforms)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]],
+    const device InteractorBin *interactorBins [[buffer(BufferIndexInteractorBins)]],
+    const device BladeState *bladeStates [[buffer(BufferIndexBladeStates)]],
+    texture2d<float, access::read> trampleMap [[texture(TextureIndexTrampleMap)]],
+    texture2d_array<float> windField [[texture(TextureIndexWindField)]],
+    uint tid [[thread_index_in_threadgroup]],
+    uint groupID [[threadgroup_position_in_grid]]
+) {
+    // Entries [first, first + bladeCount) of the payload belong to this group
+    uint first = groupID * GRASS_MESH_BLADES_PER_GROUP;
+    uint bladeCount = min(uint(GRASS_MESH_BLADES_PER_GROUP), payload.count - min(first, payload.count));
+
+    // Per-blade vertex / primitive offsets inside this group (at most 8 blades, serial prefix sum)
+    uint vertexStart[GRASS_MESH_BLADES_PER_GROUP + 1];
+    uint primitiveStart[GRASS_MESH_BLADES_PER_GROUP + 1];
+    vertexStart[0] = 0;
+    primitiveStart[0] = 0;
+    for (uint b = 0; b < bladeCount; ++b) {
+        uint segments = bladeSegments(cull, payload.bucket[first + b]);
+        vertexStart[b + 1] = vertexStart[b] + (segments + 1) * 2;
+        primitiveStart[b + 1] = primitiveStart[b] + segments * 2;
+    }
+
+    if (tid == 0) {
+        output.set_primitive_count(primitiveStart[bladeCount]);
+    }
+
+    // Vertex: thread tid emits vertex tid of the group
+    if (tid < vertexStart[bladeCount]) {
+        uint b = 0;
+        while (tid >= vertexStart[b + 1]) {
+            ++b;
+        }
+        uint entry = first + b;
+        uint local = tid - vertexStart[b];
+
+        // Strip vertices are stored row by row (left, right), so vertex k of the emitted strip is
+        // vertex k of the species' LOD mesh (see appendBladeMesh)
+        Vertex strip = vertices[cull.bucketMeshes[payload.bucket[entry]].z + local];
+        float3 position = strip.position;
+        float2 texcoord = strip.texcoord;
+
+        uint instanceID = payload.instanceID[entry];
+        BladeState bladeState = uniforms.bladePhysicsRadius > 0.0 ? bladeStates[instanceID] : BladeState();
+        output.set_vertex(tid, grassBladeVertex(position, texcoord, instances[instanceID],
+                                                float(payload.lodFade[entry]), bladeState, currentAnimation(uniforms), uniforms, scene,
+                                                interactors, interactorBins, trampleMap, windField));
+    }
+
+    // Primitive: thread tid emits triangle tid of the group
+    if (tid < primitiveStart[bladeCount]) {
+        uint b = 0;
+        while (tid >= primitiveStart[b + 1]) {
+            ++b;
+        }
+        uint local = tid - primitiveStart[b];
+        uint seg = local / 2;
+        uint base = vertexStart[b];
+        uint Lr = base + seg * 2;
+        uint Rr = Lr + 1;
+        uint Lr1 = Lr + 2;
+        uint Rr1 = Lr + 3;
+        if ((local & 1) == 0) {
+            output.set_index(tid * 3 + 0, Lr);
+            output.set_index(tid * 3 + 1, Rr);
+            output.set_index(tid * 3 + 2, Lr1);
+        } else {
+            output.set_index(tid * 3 + 0, Rr);
+            output.set_index(tid * 3 + 1, Rr1);
+            output.set_index(tid * 3 + 2, Lr1);
+        }
+    }
+}
+
+// ---------------------------------------------------------
+// BLADE SHADING (forward fragment and visibility-buffer shade pass)
+// ---------------------------------------------------------
+// Shading permutations: pipelines compile the disabled features and the debug tint out.
+// Features whose constant is left undefined stay on; the debug tint stays off.
+constant bool trampleDebugValue [[function_constant(FunctionConstantIndexTrampleDebug)]];
+constant bool trampleDebug = is_function_constant_defined(trampleDebugValue) && trampleDebugValue;
+constant bool contactShadowsValue [[function_constant(FunctionConstantIndexContactShadows)]];
+constant bool contactShadowsEnabled = !is_function_constant_defined(contactShadowsValue) || contactShadowsValue;
+constant bool translucencyValue [[function_constant(FunctionConstantIndexTranslucency)]];
+constant bool translucencyEnabled = !is_function_constant_defined(translucencyValue) || translucencyValue;
+constant bool windSheenValue [[function_constant(FunctionConstantIndexWindSheen)]];
+constant bool windSheenEnabled = !is_function_constant_defined(windSheenValue) || windSheenValue;
+
+// Blade albedo from the palette (GrassPalette.cpp): height along the blade, the blade's hash and
+// its withered flag in one trilinear fetch; the filter blends the species' fresh and withered
+// slices, so a fractional flag (impostor texels between columns) mixes like the old blend did
+static float3 grassPaletteColor(texture3d<float> palette, float t, float variation, float withered, uint species) {
+    constexpr sampler paletteSampler(filter::linear, address::clamp_to_edge);
+    float3 uvw = float3((t * float(GRASS_PALETTE_WIDTH - 1) + 0.5) / float(GRASS_PALETTE_WIDTH),
+                        (variation * float(GRASS_PALETTE_HEIGHT - 1) + 0.5) / float(GRASS_PALETTE_HEIGHT),
+                        (float(min(species, uint(GRASS_SPECIES_COUNT - 1)) * 2) + saturate(withered) + 0.5) /
+                            float(GRASS_SPECIES_COUNT * 2));
+    return palette.sample(paletteSampler, uvw, level(0.0)).rgb;
+}
+
+// Sun visibility from the shadow maps: the finest static cascade covering the point and the
+// dynamic overlay, one comparison sample each (linear filtering: 2x2 PCF in the sampler).
+// Points outside every map are lit; dynamicCovered tells the blob shadow whether the overlay
+// already darkened the point.
+struct SunShadow {
+    float visibility;
+    bool dynamicCovered;
+};
+
+static bool shadowMapCoord(constant Uniforms &uniforms, uint map, float3 worldPos, thread float3 &coord) {
+    float4 clip = uniforms.shadowViewProjection[map] * float4(worldPos, 1.0);
+    coord = float3(clip.x * 0.5 + 0.5, 0.5 - clip.y * 0.5, clip.z - uniforms.shadowDepthBias[map]);
+    return all(coord.xy > 0.0) && all(coord.xy < 1.0) && clip.z > 0.0 && clip.z < 1.0;
+}
+
+static SunShadow sunShadow(float3 worldPos, constant Uniforms &uniforms, depth2d<float> cascade0, depth2d<float> cascade1,
+                           depth2d<float> overlay) {
+    constexpr sampler shadowSampler(filter::linear, address::clamp_to_edge, compare_func::less_equal);
+    SunShadow shadow = { 1.0, false };
+    if (uniforms.shadowMapCount == 0) {
+        return shadow;
+    }
+    float3 coord;
+    if (shadowMapCoord(uniforms, 0, worldPos, coord)) {
+        shadow.visibility = cascade0.sample_compare(shadowSampler, coord.xy, coord.z);
+    } else if (shadowMapCoord(uniforms, 1, worldPos, coord)) {
+        shadow.visibility = cascade1.sample_compare(shadowSampler, coord.xy, coord.z);
+    }
+    if (uniforms.shadowOverlayActive && shadowMapCoord(uniforms, SHADOW_CASCADE_COUNT, worldPos, coord)) {
+        shadow.visibility = min(shadow.visibility, overlay.sample_compare(shadowSampler, coord.xy, coord.z));
+        shadow.dynamicCovered = true;
+    }
+    return shadow;
+}
+
+// Linear HDR blade color at an interpolated blade point; the texture RGB is not used. Fog,
+// exposure and tone mapping are applied once per pixel by the post pass (PostShaders.metal).
+// T is the shading precision (half on halfPrecisionShading pipelines): colors and lighting are
+// fine at 16 bits, world-space positions and distances stay float.
+template <typename T>
+static vec<T, 3> shadeGrassBlade(
+    RasterizerData in,
+    constant Uniforms &uniforms,
+    constant SceneConstants &scene,
+    const device Interactor *interactors,
+    const device InteractorBin *interactorBins,
+    texture2d<float> noiseTexture,
+    texture3d<float> palette,
+    float3 pointLight,
+    SunShadow sun
+) {
+    typedef vec<T, 3> T3;
+    BladeShading<T> blade = bladeShading<T>(in);
     
     // ---------------------------------------------------------
-    // 1. Analytic Antialiasing: Smooth alpha edges using derivatives
+    // 0. TRAMPLE MAP (strength at the blade root, from the vertex stage)
     // ---------------------------------------------------------
-    // Sample the texture color
-    float4 textureSample = colorTexture.sample(textureSampler, in.texcoord);
-    float alpha = textureSample.a;
-    
-    // Calculate how fast alpha is changing relative to screen pixels
-    // fwidth() returns the sum of absolute derivatives in x and y screen space
-    float px = fwidth(alpha);
-    
-    // Calculate a smooth opacity based on the 0.5 threshold
-    // smoothstep creates a smooth transition around the threshold
-    // The transition width is controlled by px (derivative-based)
-    float opacity = smoothstep(0.5 - px, 0.5 + px, alpha);
-    
-    // Apply generic transparency adjustment - discard very transparent fragments
-    if (opacity < 0.1) {
-        discard_fragment();
-    }
+    // Trampled blades are flattened geometrically and culled before rasterization,
+    // so nothing is discarded here (keeps hidden surface removal effective)
+    T trample = T(in.influence);
     
     // ---------------------------------------------------------
-    // 2. Procedural Coloring: Generate vertical gradient RGB (ignore texture RGB)
+    // 2. Procedural Coloring: palette lookup (ignore texture RGB)
     // ---------------------------------------------------------
     // Calculate height factor: t=0.0 at root (bottom), t=1.0 at tip (top)
     // Assuming texture Y=1 is bottom and Y=0 is top (common in Metal/stb_image)
     // We want t=0 at bottom, t=1 at top for the gradient
-    float t = 1.0 - in.texcoord.y; // t=0 at bottom (texcoord.y=1), t=1 at top (texcoord.y=0)
-    
-    // Define Colors (Lush Green Style)
-    float3 rootColor = float3(0.05, 0.2, 0.05);   // Very Dark Green (almost black) at roots
-    float3 midColor  = float3(0.1, 0.5, 0.1);     // Healthy Base Green in middle
-    float3 tipColor  = float3(0.30, 0.75, 0.25);  // Softer green at tips (reduced harsh yellow-green)
-    
-    // Multi-stop gradient for better look
-    float3 gradientColor;
-    if (t < 0.5) {
-        // Bottom half: root to mid
-        gradientColor = mix(rootColor, midColor, t * 2.0);
-    } else {
-        // Top half: mid to tip
-        gradientColor = mix(midColor, tipColor, (t - 0.5) * 2.0);
-    }
+    T t = T(1.0 - in.texcoord.y); // t=0 at bottom (texcoord.y=1), t=1 at top (texcoord.y=0)
+    T tipFactor = t;              // 0 bottom, 1 top
     
     // ---------------------------------------------------------
-    // 3. Per-Instance Color Variation: Lush Green Variations + Withered Yellow
+    // 3. Species Gradient, Per-Instance Variation and Withered Tips (the season's palette)
     // ---------------------------------------------------------
-    // Use instance hash for per-blade distinctness (passed from vertex shader)
-    float noise = in.instanceHash; // Returns 0.0 to 1.0
-    
-    // Create lighter green variation (fresh, not dead)
-    float3 lighterGreen = float3(0.2, 0.7, 0.3); // Fresh, lighter green variation
-    
-    // Mix base gradient color with lighter variation - subtle mix for natural variation
-    float3 variedColor = mix(gradientColor, lighterGreen, noise * 0.3); // Max 30% variation
-    
-    // Yellow-green withered color for ~10% of blades (softer pastel, less saturated)
-    float3 dryColor = float3(0.70, 0.78, 0.45); // Softer pastel yellow-green (less saturated)
-    
-    // Apply dryness more near tips than roots (so roots remain grounded)
-    float tipFactor = 1.0 - in.texcoord.y;      // 0 bottom, 1 top
-    float dryAmount = in.isYellow * smoothstep(0.3, 1.0, tipFactor) * 0.45; // max 45% blend, mostly at tips
-    variedColor = mix(variedColor, dryColor, dryAmount);
+    // The root / middle / tip stops, the lighter green mixed in by instance hash and the dry
+    // blend towards the tips of withered blades are baked per (height, hash, species, withered)
+    T3 variedColor = T3(grassPaletteColor(palette, float(t), float(blade.instanceHash), float(blade.isYellow), in.species));
     
     // ---------------------------------------------------------
     // 4. Wrap Diffuse + Colored Ambient (Ghibli-style lighting)
     // ---------------------------------------------------------
-    float3 normal = normalize(in.normal);
-    float3 sunDir = normalize(uniforms.sunDirection);
+    T3 normal = normalize(blade.normal);
+    T3 sunDir = T3(normalize(uniforms.sunDirection));
     
     // Wrap diffuse: softer than half-lambert, avoids "everything gets bright" look
-    float NdotL = dot(normal, sunDir);
-    float wrap = 0.45; // wrap amount (0.3~0.6). Higher = softer.
-    float wrapDiffuse = saturate((NdotL + wrap) / (1.0 + wrap));
+    T NdotL = dot(normal, sunDir);
+    T wrap = T(0.45); // wrap amount (0.3~0.6). Higher = softer.
+    T wrapDiffuse = saturate((NdotL + wrap) / (T(1.0) + wrap));
+    T sunVisibility = T(sun.visibility); // Shadow maps: the sun's share reaching the point
     
     // Use a slightly colored ambient (Ghibli-ish: cool shadows, warm sun)
-    float3 ambientColor = float3(0.22, 0.27, 0.30); // cooler sky-like fill
-    float ambientStrength = 0.50;                   // lift midtones (cleaner look)
+    T3 ambientColor = T3(0.22, 0.27, 0.30); // cooler sky-like fill
+    T ambientStrength = T(0.50);            // lift midtones (cleaner look)
     
-    // Combine diffuse lighting
-    float3 lighting = uniforms.sunColor * wrapDiffuse + ambientColor * ambientStrength;
+    // Combine diffuse lighting (plus the point lights of the blade's cluster)
+    T3 lighting = T3(uniforms.sunColor) * (wrapDiffuse * sunVisibility) + ambientColor * ambientStrength + T3(pointLight);
     
     // ---------------------------------------------------------
     // 5. Broad Subtle Specular Highlight (Soft, warm-neutral)
     // ---------------------------------------------------------
-    // Calculate view direction
-    float3 viewDir = normalize(uniforms.cameraPosition - in.worldPos);
+    // Calculate view direction (from float world positions)
+    T3 viewDir = T3(normalize(uniforms.cameraPosition - in.worldPos));
     
     // Blinn-Phong half vector
-    float3 halfDir = normalize(sunDir + viewDir);
+    T3 halfDir = normalize(sunDir + viewDir);
     
     // Broad highlight: low power, low strength (avoids tight yellow stripes)
-    float specularStrength = 0.035; // much smaller
-    float specularPower = 12.0;     // much broader
-    float spec = pow(max(0.0, dot(normal, halfDir)), specularPower) * specularStrength;
+    T specularStrength = T(0.035); // much smaller
+    T specularPower = T(12.0);     // much broader
+    T spec = pow(max(T(0.0), dot(normal, halfDir)), specularPower) * specularStrength;
     
     // Keep it mostly near tips, but softer (quadratic weighting)
-    // Reuse tipFactor defined earlier in Section 3
-    spec *= (tipFactor * tipFactor); // quadratic tip weighting
+    // Reuse tipFactor defined earlier in Section 2
+    spec *= (tipFactor * tipFactor) * sunVisibility; // quadratic tip weighting, no highlight in shadow
     
     // Warm-neutral specular tint (avoid yellow)
-    float3 specTint = float3(1.0, 1.0, 0.97);
-    float3 specularLight = specTint * spec;
+    T3 specTint = T3(1.0, 1.0, 0.97);
+    T3 specularLight = specTint * spec;
     
     // ---------------------------------------------------------
     // 6. Wind Sheen Effect (Brightness lift, not yellow tint)
     // ---------------------------------------------------------
-    float t_height = 1.0 - in.texcoord.y;
-    
-    // Tip mask (top 20%)
-    float tipMask = smoothstep(0.80, 1.00, t_height);
-    
-    // Wind mask (only on peaks)
-    float windMask = smoothstep(0.65, 1.00, in.windStrength);
-    
-    // Small intensity only (gentle brightness lift, not strong yellow mix)
-    float sheen = tipMask * windMask * 0.18; // max 18%
-    
-    // Lift toward warm-white (not yellow-green)
-    float3 sheenTarget = float3(0.98, 0.99, 0.95);
-    float3 windTintedColor = mix(variedColor, sheenTarget, sheen);
+    T3 windTintedColor = variedColor;
+    if (windSheenEnabled) {
+        // Tip mask (top 20%)
+        T tipMask = smoothstep(T(0.80), T(1.00), t);
+        
+        // Wind mask (only on peaks)
+        T windMask = smoothstep(T(0.65), T(1.00), blade.windStrength);
+        
+        // Small intensity only (gentle brightness lift, not strong yellow mix)
+        T sheen = tipMask * windMask * T(0.18); // max 18%
+        
+        // Lift toward warm-white (not yellow-green)
+        T3 sheenTarget = T3(0.98, 0.99, 0.95);
+        windTintedColor = mix(variedColor, sheenTarget, sheen);
+    }
     
     // ---------------------------------------------------------
     // 7. Final Color Composition
     // ---------------------------------------------------------
     // FinalColor = (WindTintedColor * RandomVariation) * (HalfLambert + Ambient) + Specular
-    float3 finalColor = windTintedColor * lighting + specularLight;
+    T3 finalColor = windTintedColor * lighting + specularLight;
     
     // LOW-FREQUENCY WORLD COLOR VARIATION (avoid "one-pot green")
     // Very low frequency noise in world space to introduce subtle warm/cool variation.
     // Keep it subtle to avoid "dirty" look.
-    float nLow = noise2D(in.worldPos.xz * 0.03);  // very low frequency
-    nLow = nLow * 2.0 - 1.0;                      // -1..1
+    T nLow = T(valueNoise(noiseTexture, in.worldPos.xz * 0.03)); // very low frequency
+    nLow = nLow * T(2.0) - T(1.0);              // -1..1
     
-    float tVar = 0.5 + 0.5 * nLow;                // 0..1
-    float3 coolTint = float3(0.92, 0.98, 1.05);   // slightly bluish (cool shadow feel)
-    float3 warmTint = float3(1.05, 1.02, 0.95);   // slightly warm (sun-kissed feel)
+    T tVar = T(0.5) + T(0.5) * nLow;            // 0..1
+    T3 coolTint = T3(0.92, 0.98, 1.05);         // slightly bluish (cool shadow feel)
+    T3 warmTint = T3(1.05, 1.02, 0.95);         // slightly warm (sun-kissed feel)
     
-    float3 tint = mix(coolTint, warmTint, tVar);
+    T3 tint = mix(coolTint, warmTint, tVar);
     // Max 6% tint influence
-    finalColor *= mix(float3(1.0), tint, 0.06);
+    finalColor *= mix(T3(1.0), tint, T(0.06));
     
     // ---------------------------------------------------------
     // 8. Stronger Ambient Occlusion (AO) at Roots
@@ -446,10 +791,10 @@ fragment float4 fragmentMain(
     // t=0.0 at bottom (root), t=1.0 at top (tip)
     // We want darkening ONLY at the bottom 40%
     // smoothstep(0.0, 0.4, t) gives 0.0 at t=0 (root), 1.0 at t=0.4 (transition point)
-    float occlusion = smoothstep(0.0, 0.4, t);
+    T occlusion = smoothstep(T(0.0), T(0.4), t);
     
     // Apply intensity: 0.45 brightness at root (softer dark), 1.0 brightness at tip (bright)
-    float aoFactor = 0.45 + 0.55 * occlusion; // softer root darkening (less muddy)
+    T aoFactor = T(0.45) + T(0.55) * occlusion; // softer root darkening (less muddy)
     
     // Apply AO to the color: roots are shadow-dark, tips are fully lit
     finalColor *= aoFactor;
@@ -459,102 +804,588 @@ fragment float4 fragmentMain(
     // ---------------------------------------------------------
     // Only affects tips and only when backlit relative to the sun direction.
     // Keep intensity low to avoid glowing/overexposure.
-    float3 normalTrans = normalize(in.normal);
-    float3 sunDirTrans = normalize(uniforms.sunDirection);
-    float NdotLTrans = dot(normalTrans, sunDirTrans);
-    
-    float tipMaskTrans = smoothstep(0.60, 1.00, tipFactor);      // only upper portion
-    float backlit = smoothstep(0.0, 0.60, -NdotLTrans);          // 0..1 when back-facing
-    float trans = backlit * tipMaskTrans * 0.12;                 // cap ~12%
-    
-    float3 transColor = float3(0.90, 1.00, 0.85);                // slightly warm green
-    finalColor = mix(finalColor, finalColor * transColor, trans);
+    if (translucencyEnabled) {
+        T tipMaskTrans = smoothstep(T(0.60), T(1.00), tipFactor); // only upper portion
+        T backlit = smoothstep(T(0.0), T(0.60), -NdotL);           // 0..1 when back-facing
+        T trans = backlit * tipMaskTrans * T(0.12) * sunVisibility; // cap ~12%, none in shadow
+        
+        T3 transColor = T3(0.90, 1.00, 0.85);                      // slightly warm green
+        finalColor = mix(finalColor, finalColor * transColor, trans);
+    }
     
     // ---------------------------------------------------------
-    // CONTACT SHADOW (Subtle darkening near ball)
+    // CONTACT SHADOW (Subtle darkening near interactors)
     // ---------------------------------------------------------
-    // Compute distance (same as vertex shader)
-    float2 P = in.worldPos.xz;
-    float2 ballCenterXZ = uniforms.ballWorldPos.xz;
-    float d = length(P - ballCenterXZ);
+    if (contactShadowsEnabled) {
+        // Same bins as the vertex flatten ring; the darkest shadow of the tile's interactors wins.
+        // Distances are world-space (float); only the resulting masks drop to T.
+        float2 P = in.worldPos.xz;
+        InteractorBin bin = interactorBins[interactorBinIndex(P, uniforms)];
+        float shadow = 0.0;
+        float shadowFactor = 1.0;
+        for (uint i = 0; i < bin.count; ++i) {
+            Interactor interactor = interactors[bin.indices[i]];
+            float d = length(P - interactor.position.xz);
+            
+            // Contact shadow mask (localized, smooth falloff)
+            shadow = max(shadow, smoothstep(interactor.radius * scene.contactShadowRadiusScale, 0.0, d));
+            
+            // Blob shadow: soft gradient, 0.0 = center (dark), 1.0 = edge (bright),
+            // radius slightly larger than the interactor for soft falloff
+            shadowFactor = min(shadowFactor, smoothstep(0.0, interactor.radius * INTERACTOR_BLOB_SHADOW_SCALE, d));
+        }
+        shadow *= scene.contactShadowStrength;
+        
+        // Apply contact shadow
+        finalColor *= T(1.0 - shadow);
+        
+        // ---------------------------------------------------------
+        // 9. FAKE BLOB SHADOW (Interactor Grounding)
+        // ---------------------------------------------------------
+        // shadowFactor was gathered from the same bin as the contact shadow (horizontal distance only);
+        // where the shadow overlay covers the point the bodies' real shadow replaces it
+        if (!sun.dynamicCovered) {
+            // Clamp minimum brightness so shadow doesn't get too dark (maintains visibility)
+            // This simulates ambient light even in shadowed areas
+            shadowFactor = saturate(shadowFactor + 0.4); // Min brightness 0.4 (40% of original)
+            
+            // Apply shadow darkening to grass color
+            finalColor *= T(shadowFactor);
+        }
+    }
     
-    // Contact shadow mask (localized, smooth falloff)
-    float shadow = smoothstep(uniforms.contactShadowRadius, 0.0, d);
-    shadow *= uniforms.contactShadowStrength;
+    // ============================================================================
+    // DEBUG: Visualize trample map (trampleDebug permutation, T key)
+    // ============================================================================
+    if (trampleDebug) {
+        // Tint grass by trample value: red where trampled, normal color elsewhere
+        T3 trampleTint = mix(T3(1.0, 1.0, 1.0), T3(1.0, 0.0, 0.0), trample);
+        finalColor *= trampleTint;
+    }
     
-    // Apply contact shadow
-    finalColor.rgb *= (1.0 - shadow);
+    return finalColor;
+}
+
+// Blade color at the precision the pipeline was specialized for. Point lights and the shadow
+// lookups are done in float (distances and positions), then join the sun in the blade's lighting
+// at the shading precision.
+static float3 shadeGrassBladeAtPrecision(
+    RasterizerData in,
+    constant Uniforms &uniforms,
+    constant SceneConstants &scene,
+    const device Interactor *interactors,
+    const device InteractorBin *interactorBins,
+    texture2d<float> noiseTexture,
+    texture3d<float> palette,
+    const device PointLight *pointLights,
+    const device LightCluster *lightClusters,
+    SunShadow shadow
+) {
+    float3 pointLight = clusteredPointLighting(in.worldPos, normalize(bladeShading<float>(in).normal), true, uniforms,
+                                               pointLights, lightClusters);
+    if (halfPrecisionShading) {
+        return float3(shadeGrassBlade<half>(in, uniforms, scene, interactors, interactorBins, noiseTexture, palette, pointLight,
+                                            shadow));
+    }
+    return shadeGrassBlade<float>(in, uniforms, scene, interactors, interactorBins, noiseTexture, palette, pointLight, shadow);
+}
+
+// 4x4 ordered dither thresholds (low-sample coverage, visibility pass LOD crossfade)
+constant uchar kBayer4x4[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+
+// Opacity for alpha-to-coverage at 1x and 2x: with one or two coverage levels a thin blade edge
+// would snap on and off as it moves by a fraction of a pixel. The dither, fixed in screen space,
+// picks the level per pixel instead, so a 4x4 block keeps the average opacity and the pattern
+// does not crawl. Unchanged at 4x and up (the hardware patterns are fine enough).
+static float ditheredCoverage(float opacity, float2 position) {
+    if (!ditherCoverage) {
+        return opacity;
+    }
+    uint2 pixel = uint2(position) % 4;
+    float threshold = (float(kBayer4x4[pixel.y * 4 + pixel.x]) + 0.5) / 16.0;
+    float levels = float(coverageSamples);
+    return saturate(floor(opacity * levels + threshold) / levels);
+}
+
+// Coverage of a textured blade fragment: the derivative-smoothed alpha test, times the LOD
+// crossfade. Shared by fragmentMain and its depth prepass, so both resolve the same samples.
+static float grassBladeOpacity(RasterizerData in, texture2d_array<float> albedo) {
+    // Define a constexpr sampler inside the shader function
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::clamp_to_edge);
     
     // ---------------------------------------------------------
-    // 9. FAKE BLOB SHADOW (Ball Grounding)
+    // 1. Analytic Antialiasing: Smooth alpha edges using derivatives
     // ---------------------------------------------------------
-    // Calculate horizontal distance from grass to ball (ignore height)
-    float2 grassPosXZ = in.worldPos.xz;
-    float2 ballPosXZ = uniforms.ballWorldPos.xz;
-    float shadowDist = distance(grassPosXZ, ballPosXZ);
+    // Sample the texture color
+    float4 textureSample = albedo.sample(textureSampler, in.texcoord, in.albedoVariant);
+    float alpha = textureSample.a;
     
-    // Shadow radius slightly larger than the ball radius for soft falloff
-    float shadowRadius = uniforms.ballRadius * 1.2;
+    // Calculate how fast alpha is changing relative to screen pixels
+    // fwidth() returns the sum of absolute derivatives in x and y screen space
+    float px = fwidth(alpha);
     
-    // Create soft gradient: 0.0 = center (dark), 1.0 = edge (bright)
-    // smoothstep creates a smooth transition from dark center to bright edge
-    float shadowFactor = smoothstep(0.0, shadowRadius, shadowDist);
+    // Calculate a smooth opacity based on the 0.5 threshold
+    // smoothstep creates a smooth transition around the threshold
+    // The transition width is controlled by px (derivative-based)
+    float opacity = smoothstep(0.5 - px, 0.5 + px, alpha);
     
-    // Clamp minimum brightness so shadow doesn't get too dark (maintains visibility)
-    // This simulates ambient light even in shadowed areas
-    shadowFactor = saturate(shadowFactor + 0.4); // Min brightness 0.4 (40% of original)
+    // LOD crossfade: alpha-to-coverage turns the fade into complementary sample masks
+    return ditheredCoverage(opacity * in.lodFade, in.position.xy);
+}
+
+fragment SceneFragmentOut fragmentMain(
+    RasterizerData in [[stage_in]],
+    ushort amplificationID [[amplification_id]],
+    constant GrassResourceTable &table [[buffer(BufferIndexGrassResources)]],
+    constant Uniforms &firstViewUniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]]
+) {
+    // The specular highlight looks from the camera of the view being drawn
+    constant Uniforms &uniforms = amplifiedViewUniforms(firstViewUniforms, amplificationID);
+    const device Interactor *interactors = table.interactors;
+    const device InteractorBin *interactorBins = table.interactorBins;
+    const device PointLight *pointLights = table.pointLights;
+    const device LightCluster *lightClusters = table.lightClusters;
+    texture2d<float> noiseTexture = table.noise;
+    
+    // Geometry blades: opaque, the mesh is the silhouette and the vertex stage resolved the LOD fade
+    if (geometryBlades) {
+        SceneFragmentOut out;
+        SunShadow shadow = sunShadow(in.worldPos, uniforms, table.shadowMaps[0], table.shadowMaps[1], table.shadowMaps[2]);
+        out.color = float4(shadeGrassBladeAtPrecision(in, uniforms, scene, interactors, interactorBins, noiseTexture,
+                                                      table.palette, pointLights, lightClusters, shadow), 1.0);
+        if (writeMotionVectors) {
+            out.motion = motionVector(in.currentClip, in.previousClip);
+        }
+        if (writeTileDepth) {
+            out.tileDepth = in.position.z;
+        }
+        if (writeObjectId) {
+            out.objectId = in.objectId;
+        }
+        return out;
+    }
     
-    // Apply shadow darkening to grass color
-    finalColor *= shadowFactor;
+    float opacity = grassBladeOpacity(in, table.albedo);
     
-    // ---------------------------------------------------------
-    // DISTANCE FOG (Before tone mapping for subtle atmospheric perspective)
-    // ---------------------------------------------------------
-    // Calculate distance from camera to this fragment
-    float dist = length(in.worldPos - uniforms.cameraPosition);
+    // Apply generic transparency adjustment - discard very transparent fragments
+    if (opacity < 0.1) {
+        discard_fragment();
+    }
     
-    // Fog Parameters (Gentler atmospheric perspective)
-    // Start: Fog begins at 12 meters (grass is clear close up)
-    // End: Fog becomes fully opaque at 40 meters (hides the edge of the plane)
-    float fogStart = 12.0;
-    float fogEnd = 40.0;
+    SunShadow shadow = sunShadow(in.worldPos, uniforms, table.shadowMaps[0], table.shadowMaps[1], table.shadowMaps[2]);
+    float3 finalColor = shadeGrassBladeAtPrecision(in, uniforms, scene, interactors, interactorBins, noiseTexture,
+                                                   table.palette, pointLights, lightClusters, shadow);
     
-    // Calculate Fog Factor (0.0 = No Fog, 1.0 = Full Fog)
-    // Gentler exponential curve with cap to avoid full overwrite
-    float fogLin = saturate((dist - fogStart) / (fogEnd - fogStart));
-    float fogFactor = 1.0 - exp(-fogLin * 1.2);
-    fogFactor = min(fogFactor, 0.75); // never fully overwrite the grass
+    // Return final color with smoothed opacity for Alpha-to-Coverage
+    SceneFragmentOut out;
+    out.color = float4(finalColor, opacity);
+    if (writeMotionVectors) {
+        // Temporal pipelines have no MSAA to spread the opacity over: alpha-test the edge
+        // and let the temporal upscaler antialias it across jittered frames
+        if (opacity < 0.5) {
+            discard_fragment();
+        }
+        out.motion = motionVector(in.currentClip, in.previousClip);
+    }
+    if (writeTileDepth) {
+        out.tileDepth = in.position.z;
+    }
+    if (writeObjectId) {
+        out.objectId = in.objectId;
+    }
+    return out;
+}
+
+// Depth prepass of the textured blades: the same coverage as fragmentMain (alpha test, then the
+// opacity through alpha-to-coverage under MSAA or the 0.5 test of the temporal pipelines) and no
+// shading, so the grass pass after it shades only the nearest blade of each sample (equal depth
+// test). Geometry blades need no fragment stage at all for it.
+fragment float4 grassDepthPrepassFragment(
+    RasterizerData in [[stage_in]],
+    constant GrassResourceTable &table [[buffer(BufferIndexGrassResources)]]
+) {
+    float opacity = grassBladeOpacity(in, table.albedo);
+    if (opacity < 0.1 || (writeMotionVectors && opacity < 0.5)) {
+        discard_fragment();
+    }
+    return float4(0.0, 0.0, 0.0, opacity);
+}
+
+// ---------------------------------------------------------
+// VISIBILITY-BUFFER GRASS (IDs first, then lighting once per pixel)
+// ---------------------------------------------------------
+// Attachments of the grass visibility pass. color(2) holds (visible slot + 1, triangle of the
+// blade strip) of the nearest blade, 0 where no blade covers the pixel.
+struct GrassVisibilityOut {
+    float4 color [[color(0)]];
+    float2 motion [[color(1), function_constant(writeMotionVectors)]];
+    uint2 visibility [[color(2)]];
+};
+
+// Coverage only: the alpha test of the temporal pipelines, with the LOD crossfade as an ordered
+// dither (no alpha-to-coverage at 1x). Scene color passes through for grassShadeFragment.
+fragment GrassVisibilityOut grassVisibilityFragment(
+    RasterizerData in [[stage_in]],
+    uint primitiveID [[primitive_id]],
+    float4 color [[color(0)]],
+    constant GrassResourceTable &table [[buffer(BufferIndexGrassResources)]],
+    constant CullUniforms &cull [[buffer(BufferIndexCullUniforms)]]
+) {
+    // Threshold flipped on odd LODs: the two copies of a crossfading blade cover disjoint pixels
+    // (geometry blades need neither: their shape is the mesh and the vertex stage picks one copy)
+    uint bucket = min(in.visibleSlot / cull.bucketCapacity, uint(GRASS_DRAW_BUCKET_COUNT - 1));
+    uint lod = bucket % GRASS_LOD_COUNT;
+    if (!geometryBlades) {
+        constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::clamp_to_edge);
+        float alpha = table.albedo.sample(textureSampler, in.texcoord, in.albedoVariant).a;
+        uint2 pixel = uint2(in.position.xy) % 4;
+        float dither = (float(kBayer4x4[pixel.y * 4 + pixel.x]) + 0.5) / 16.0;
+        if ((lod & 1) != 0) {
+            dither = 1.0 - dither;
+        }
+        if (alpha < 0.5 || in.lodFade <= dither) {
+            discard_fragment();
+        }
+    }
     
-    // Make fog less strong on blade tips (keep silhouette detail)
-    fogFactor *= mix(1.0, 0.75, tipFactor);
+    GrassVisibilityOut out;
+    out.color = color;
+    if (writeMotionVectors) {
+        out.motion = motionVector(in.currentClip, in.previousClip);
+    }
+    // Triangle within the blade's strip (also correct if the ID keeps counting across instances)
+    out.visibility = uint2(in.visibleSlot + 1, primitiveID % (cull.bucketMeshes[bucket].x / 3));
+    return out;
+}
+
+// Perspective-correct barycentrics of an NDC point in a clip-space triangle
+static float3 perspectiveBarycentrics(float4 clip0, float4 clip1, float4 clip2, float2 ndc) {
+    float2 p0 = clip0.xy / clip0.w;
+    float2 edge1 = clip1.xy / clip1.w - p0;
+    float2 edge2 = clip2.xy / clip2.w - p0;
+    float2 offset = ndc - p0;
+    float area = edge1.x * edge2.y - edge2.x * edge1.y;
+    float b1 = (offset.x * edge2.y - edge2.x * offset.y) / area;
+    float b2 = (edge1.x * offset.y - offset.x * edge1.y) / area;
+    float3 weights = float3(1.0 - b1 - b2, b1, b2) / float3(clip0.w, clip1.w, clip2.w);
+    return weights / (weights.x + weights.y + weights.z);
+}
+
+// Blade attributes at barycentric weights (per-blade values are equal at every corner)
+static RasterizerData interpolateBlade(RasterizerData a, RasterizerData b, RasterizerData c, float3 w) {
+    RasterizerData out = a;
+    out.texcoord = a.texcoord * w.x + b.texcoord * w.y + c.texcoord * w.z;
+    out.worldPos = a.worldPos * w.x + b.worldPos * w.y + c.worldPos * w.z;
+    out.influence = a.influence * w.x + b.influence * w.y + c.influence * w.z;
+    if (halfPrecisionShading) {
+        half3 h = half3(w);
+        out.normalHalf = a.normalHalf * h.x + b.normalHalf * h.y + c.normalHalf * h.z;
+        out.bladeToneHalf.y = a.bladeToneHalf.y * h.x + b.bladeToneHalf.y * h.y + c.bladeToneHalf.y * h.z;
+    } else {
+        out.normal = a.normal * w.x + b.normal * w.y + c.normal * w.z;
+        out.windStrength = a.windStrength * w.x + b.windStrength * w.y + c.windStrength * w.z;
+    }
+    return out;
+}
+
+// Full-screen pass after the visibility draw: every grass pixel rebuilds its triangle from the
+// IDs (same deformation as vertexMain), interpolates it at the pixel center and is lit once,
+// however many blades were drawn over it
+fragment GrassVisibilityOut grassShadeFragment(
+    float4 position [[position]],
+    float4 color [[color(0)]],
+    float2 motion [[color(1), function_constant(writeMotionVectors)]],
+    uint2 visibility [[color(2)]],
+    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
+    constant InstanceData *instances [[buffer(BufferIndexInstanceData)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    const device VisibleInstance *visibleInstances [[buffer(BufferIndexVisibleInstances)]],
+    constant CullUniforms &cull [[buffer(BufferIndexCullUniforms)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]],
+    const device InteractorBin *interactorBins [[buffer(BufferIndexInteractorBins)]],
+    const device BladeState *bladeStates [[buffer(BufferIndexBladeStates)]],
+    const device ushort *indices [[buffer(BufferIndexGrassIndices)]],
+    constant float2 &renderSize [[buffer(BufferIndexRenderSize)]],
+    const device PointLight *pointLights [[buffer(BufferIndexPointLights)]],
+    const device LightCluster *lightClusters [[buffer(BufferIndexLightClusters)]],
+    texture2d<float, access::read> trampleMap [[texture(TextureIndexTrampleMap)]],
+    texture2d_array<float> windField [[texture(TextureIndexWindField)]],
+    texture2d<float> noiseTexture [[texture(TextureIndexNoise)]],
+    texture3d<float> palette [[texture(TextureIndexGrassPalette)]],
+    array<depth2d<float>, SHADOW_MAP_COUNT> shadowMaps [[texture(TextureIndexShadowMaps)]]
+) {
+    if (visibility.x == 0) {
+        discard_fragment();
+    }
     
-    // Fog Color: Match background/clear color to remove horizon seams
-    float3 fogColor = float3(0.40, 0.60, 0.90);
+    uint slot = visibility.x - 1;
+    uint bucket = min(slot / cull.bucketCapacity, uint(GRASS_DRAW_BUCKET_COUNT - 1));
+    VisibleInstance visible = visibleInstances[slot];
+    InstanceData instance = instances[visible.instanceID];
+    GrassAnimation animation = currentAnimation(uniforms);
+    BladeState bladeState = uniforms.bladePhysicsRadius > 0.0 ? bladeStates[visible.instanceID] : BladeState();
+    
+    uint firstIndex = cull.bucketMeshes[bucket].y + visibility.y * 3;
+    RasterizerData corners[3];
+    for (uint i = 0; i < 3; ++i) {
+        Vertex corner = vertices[cull.bucketMeshes[bucket].z + indices[firstIndex + i]];
+        corners[i] = grassBladeVertex(corner.position, corner.texcoord, instance, visible.lodFade, bladeState, animation, uniforms, scene,
+                                      interactors, interactorBins, trampleMap, windField);
+    }
     
-    // Mix the grass color with the fog color based on distance (before tone mapping)
-    finalColor = mix(finalColor, fogColor, fogFactor);
+    // Pixel center in NDC (pixels are y down)
+    float2 ndc = float2(position.x / renderSize.x * 2.0 - 1.0, 1.0 - position.y / renderSize.y * 2.0);
+    float3 weights = perspectiveBarycentrics(corners[0].position, corners[1].position, corners[2].position, ndc);
+    RasterizerData in = interpolateBlade(corners[0], corners[1], corners[2], weights);
+    
+    GrassVisibilityOut out;
+    SunShadow shadow = sunShadow(in.worldPos, uniforms, shadowMaps[0], shadowMaps[1], shadowMaps[2]);
+    out.color = float4(shadeGrassBladeAtPrecision(in, uniforms, scene, interactors, interactorBins, noiseTexture,
+                                                  palette, pointLights, lightClusters, shadow), 1.0);
+    if (writeMotionVectors) {
+        out.motion = motion;
+    }
+    out.visibility = visibility;
+    return out;
+}
+
+// ---------------------------------------------------------
+// MICROBENCHMARK QUAD STACK (Renderer::runMicrobenchmark)
+// ---------------------------------------------------------
+// Layer instanceID of a full-screen quad (4-vertex strip) carrying mid-blade interpolants, so
+// fragmentMain runs a fixed number of times per pixel whatever the camera sees
+vertex RasterizerData grassOverdrawVertex(
+    uint vertexID [[vertex_id]],
+    uint layer [[instance_id]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+) {
+    float2 ndc = float2((vertexID & 1) ? 1.0 : -1.0, (vertexID & 2) ? 1.0 : -1.0);
+    float4 world = uniforms.inverseViewProjection * float4(ndc, 0.5, 1.0);
     
-    // ---------------------------------------------------------
-    // EXPOSURE + TONE MAPPING (Lift midtones, keep highlights controlled)
-    // ---------------------------------------------------------
-    // Lift exposure slightly for a cleaner, fresher look.
-    // Reinhard will still compress highlights to avoid blow-out.
-    finalColor *= 1.12;
+    RasterizerData out;
+    out.position = float4(ndc, 0.5, 1.0);
+    out.texcoord = float2(0.5, 0.35); // Inside every alpha mask: no fragment is discarded
+    out.worldPos = world.xyz / world.w;
+    out.influence = 0.0;
+    out.lodFade = 1.0;
+    out.albedoVariant = layer % GRASS_ALBEDO_VARIANT_COUNT;
+    out.species = 0;
+    if (writeMotionVectors) {
+        out.currentClip = out.position;
+        out.previousClip = out.position;
+    }
+    if (writeGrassVisibility) {
+        out.visibleSlot = layer;
+    }
+    setBladeShading(out, normalize(uniforms.cameraPosition - out.worldPos), fract(float(layer) * 0.618034), 0.5, 0.0);
+    return out;
+}
+
+// ---------------------------------------------------------
+// GRASS IMPOSTORS (far cells drawn as one baked card each)
+// ---------------------------------------------------------
+// Bake: LOD 0 blades of a patch cell, undeformed apart from the billboard and idle pose
+vertex RasterizerData grassImpostorBakeVertex(
+    uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
+    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
+    const device InstanceData *instances [[buffer(BufferIndexInstanceData)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]],
+    const device InteractorBin *interactorBins [[buffer(BufferIndexInteractorBins)]],
+    texture2d<float, access::read> trampleMap [[texture(TextureIndexTrampleMap)]],
+    texture2d_array<float> windField [[texture(TextureIndexWindField)]]
+) {
+    return grassBladeVertex(vertices[vertexID].position, vertices[vertexID].texcoord, instances[instanceID], 1.0, BladeState(),
+                            currentAnimation(uniforms), uniforms, scene, interactors, interactorBins, trampleMap, windField);
+}
+
+// Atlas frame texel: the lighting inputs of the nearest blade (alpha-tested, coverage 1)
+struct GrassImpostorBakeOut {
+    float4 normal [[color(0)]]; // View-space normal * 0.5 + 0.5, a = coverage
+    float4 blade [[color(1)]];  // (height along the blade, blade hash, withered flag)
+    float depth [[color(2)]];   // Meters behind the frame's front plane
+};
+
+fragment GrassImpostorBakeOut grassImpostorBakeFragment(
+    RasterizerData in [[stage_in]],
+    texture2d_array<float> colorTexture [[texture(TextureIndexGrass)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant GrassImpostorUniforms &impostor [[buffer(BufferIndexImpostorUniforms)]]
+) {
+    constexpr sampler textureSampler(mag_filter::linear, min_filter::linear, address::clamp_to_edge);
+    if (colorTexture.sample(textureSampler, in.texcoord, in.albedoVariant).a < 0.5) {
+        discard_fragment();
+    }
     
-    // Simple Reinhard tone map per-channel
-    finalColor = finalColor / (finalColor + float3(1.0));
+    // View space (right, up, toward the eye): the cards rebuild the world normal from their own basis
+    BladeShading<float> blade = bladeShading<float>(in);
+    float3 viewNormal = normalize((uniforms.viewMatrix * float4(blade.normal, 0.0)).xyz);
     
-    // ============================================================================
-    // DEBUG: Visualize trample map (when showTrampleMap > 0.5)
-    // ============================================================================
-    if (uniforms.showTrampleMap > 0.5) {
-        // Tint grass by trample value: red where trampled, normal color elsewhere
-        float3 trampleTint = mix(float3(1.0, 1.0, 1.0), float3(1.0, 0.0, 0.0), trample);
-        finalColor *= trampleTint;
+    GrassImpostorBakeOut out;
+    out.normal = float4(viewNormal * 0.5 + 0.5, 1.0);
+    out.blade = float4(1.0 - in.texcoord.y, blade.instanceHash, blade.isYellow, 1.0);
+    out.depth = in.position.z * impostor.cardSize; // Orthographic depth spans one card side
+    return out;
+}
+
+// Card of one far cell: a camera-facing square on the patch's front plane
+struct ImpostorRasterizerData {
+    float4 position [[position]];
+    float2 frameUV;                // 0..1 across the card, y down like the atlas frames
+    float3 worldPos;               // On the card
+    float3 right [[flat]];         // Card basis (the bake view's x, y and z axes)
+    float3 up [[flat]];
+    float3 toCamera [[flat]];
+    float fade [[flat]];           // Fade-in over the impostor band
+    uint variant [[flat]];         // Atlas row
+    uint column [[flat]];          // Lower of the two blended elevation columns
+    float columnBlend [[flat]];    // Weight of column + 1
+};
+
+vertex ImpostorRasterizerData grassImpostorVertex(
+    uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
+    const device GrassImpostor *impostors [[buffer(BufferIndexImpostors)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant GrassImpostorUniforms &impostor [[buffer(BufferIndexImpostorUniforms)]]
+) {
+    GrassImpostor card = impostors[instanceID];
+    float3 center = card.centerFade.xyz;
+    
+    // Spherical billboard, oriented like the bake views (lookAt with Y up)
+    float3 toCamera = normalize(uniforms.cameraPosition - center);
+    float3 right = normalize(cross(float3(0.0, 1.0, 0.0), toCamera));
+    float3 up = cross(toCamera, right);
+    
+    // Elevation columns around the view elevation (clamped to the baked range)
+    float elevation = asin(clamp(toCamera.y, -1.0, 1.0));
+    float4 elevations = impostor.elevations;
+    uint column = 0;
+    for (uint i = 1; i < IMPOSTOR_ELEVATION_COUNT - 1; ++i) {
+        column = (elevation >= elevations[i]) ? i : column;
     }
+    float columnBlend = saturate((elevation - elevations[column]) / (elevations[column + 1] - elevations[column]));
     
-    // Return final color with smoothed opacity for Alpha-to-Coverage
-    return float4(finalColor, opacity);
+    // Triangle strip corners (0,0) (1,0) (0,1) (1,1); card y up, frame y down
+    float2 corner = float2(float(vertexID & 1), float(vertexID >> 1));
+    float halfSize = impostor.cardSize * 0.5;
+    float3 worldPos = center + toCamera * halfSize + (right * (corner.x - 0.5) + up * (corner.y - 0.5)) * impostor.cardSize;
+    
+    // Patch variant from the cell position (stable per cell)
+    uint2 cellKey = uint2(int2(floor(center.xz)) + 32768);
+    uint hash = (cellKey.x * 73856093u) ^ (cellKey.y * 19349663u);
+    
+    ImpostorRasterizerData out;
+    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * float4(worldPos, 1.0);
+    out.frameUV = float2(corner.x, 1.0 - corner.y);
+    out.worldPos = worldPos;
+    out.right = right;
+    out.up = up;
+    out.toCamera = toCamera;
+    out.fade = card.centerFade.w;
+    out.variant = hash % IMPOSTOR_VARIANT_COUNT;
+    out.column = column;
+    out.columnBlend = columnBlend;
+    return out;
+}
+
+// Premultiplied atlas texel of one frame (coverage-weighted, so frames and edges blend cleanly)
+struct ImpostorSample {
+    float4 normal; // a = coverage
+    float3 blade;
+    float depth;
+};
+
+static ImpostorSample sampleImpostorFrame(uint column, uint variant, float2 frameUV,
+                                          texture2d<float> normalAtlas, texture2d<float> bladeAtlas,
+                                          texture2d<float> depthAtlas) {
+    constexpr sampler atlasSampler(filter::linear, address::clamp_to_edge);
+    
+    // Half a texel inside the frame: bilinear taps never reach the neighbouring frames
+    float2 inset = 0.5 / float2(IMPOSTOR_FRAME_SIZE);
+    float2 uv = (float2(column, variant) + clamp(frameUV, inset, 1.0 - inset))
+              / float2(IMPOSTOR_ELEVATION_COUNT, IMPOSTOR_VARIANT_COUNT);
+    
+    ImpostorSample frame;
+    frame.normal = normalAtlas.sample(atlasSampler, uv);
+    frame.blade = bladeAtlas.sample(atlasSampler, uv).rgb;
+    frame.depth = depthAtlas.sample(atlasSampler, uv).r;
+    return frame;
+}
+
+// Scene attachments plus the depth of the reconstructed blade point (never nearer than the card)
+struct ImpostorFragmentOut {
+    float4 color [[color(0)]];
+    float2 motion [[color(1), function_constant(writeMotionVectors)]];
+    float tileDepth [[color(3), function_constant(writeTileDepth)]];
+    float depth [[depth(greater)]];
+};
+
+// Lighting inputs from the two elevation frames, shaded like a blade at the reconstructed point
+fragment ImpostorFragmentOut grassImpostorFragment(
+    ImpostorRasterizerData in [[stage_in]],
+    texture2d<float> normalAtlas [[texture(TextureIndexImpostorNormal)]],
+    texture2d<float> bladeAtlas [[texture(TextureIndexImpostorBlade)]],
+    texture2d<float> depthAtlas [[texture(TextureIndexImpostorDepth)]],
+    texture2d<float> noiseTexture [[texture(TextureIndexNoise)]],
+    texture3d<float> palette [[texture(TextureIndexGrassPalette)]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]],
+    constant GrassImpostorUniforms &impostor [[buffer(BufferIndexImpostorUniforms)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]],
+    const device InteractorBin *interactorBins [[buffer(BufferIndexInteractorBins)]],
+    const device PointLight *pointLights [[buffer(BufferIndexPointLights)]],
+    const device LightCluster *lightClusters [[buffer(BufferIndexLightClusters)]]
+) {
+    ImpostorSample low = sampleImpostorFrame(in.column, in.variant, in.frameUV, normalAtlas, bladeAtlas, depthAtlas);
+    ImpostorSample high = sampleImpostorFrame(in.column + 1, in.variant, in.frameUV, normalAtlas, bladeAtlas, depthAtlas);
+    float4 normal = mix(low.normal, high.normal, in.columnBlend);
+    float3 bladeInputs = mix(low.blade, high.blade, in.columnBlend);
+    float depth = mix(low.depth, high.depth, in.columnBlend);
+    
+    // Alpha-to-coverage carries the fade at 4x (dithered at 1x and 2x); the temporal pipelines alpha-test instead
+    float coverage = normal.a;
+    float opacity = ditheredCoverage(coverage * in.fade, in.position.xy);
+    if (opacity < (writeMotionVectors ? 0.5 : 0.1)) {
+        discard_fragment();
+    }
+    
+    // Un-premultiply (uncovered texels are zero)
+    float invCoverage = 1.0 / coverage;
+    float3 viewNormal = normal.xyz * invCoverage * 2.0 - 1.0;
+    bladeInputs *= invCoverage;
+    depth *= invCoverage;
+    
+    // Stand-in blade point: behind the card along its axis (the bake is orthographic)
+    RasterizerData blade;
+    blade.worldPos = in.worldPos - in.toCamera * depth;
+    blade.texcoord = float2(0.5, 1.0 - bladeInputs.x);
+    blade.influence = 0.0;
+    blade.lodFade = 1.0;
+    blade.species = GRASS_SPECIES_GRASS; // The atlas bakes grass blades
+    float3 worldNormal = normalize(in.right * viewNormal.x + in.up * viewNormal.y + in.toCamera * viewNormal.z);
+    setBladeShading(blade, worldNormal, bladeInputs.y, 0.0, bladeInputs.z);
+    
+    // Far-field cards lie beyond the shadow cascades (lit, with the blob shadows)
+    ImpostorFragmentOut out;
+    SunShadow shadow = { 1.0, false };
+    out.color = float4(shadeGrassBladeAtPrecision(blade, uniforms, scene, interactors, interactorBins, noiseTexture,
+                                                  palette, pointLights, lightClusters, shadow), opacity);
+    if (writeMotionVectors) {
+        float4 currentClip = uniforms.unjitteredViewProjection * float4(blade.worldPos, 1.0);
+        float4 previousClip = uniforms.prevViewProjection * float4(blade.worldPos, 1.0);
+        out.motion = motionVector(currentClip, previousClip);
+    }
+    float4 clip = uniforms.projectionMatrix * uniforms.viewMatrix * float4(blade.worldPos, 1.0);
+    out.depth = max(clip.z / clip.w, in.position.z);
+    if (writeTileDepth) {
+        out.tileDepth = out.depth;
+    }
+    return out;
 }
 
 // ---------------------------------------------------------
@@ -565,25 +1396,50 @@ struct BallRasterizerData {
     float4 position [[position]];
     float3 worldPos;
     float3 normal;
+    float4 material [[flat]]; // The interactor's albedo and specular strength
+    float4 currentClip [[function_constant(writeMotionVectors)]]; // Unjittered clip position (motion vectors)
+    float4 previousClip [[function_constant(writeMotionVectors)]]; // Same point at last frame's interactor position
+    uint objectId [[flat, function_constant(writeObjectId)]]; // The interactor's slot (picking)
 };
 
+// Ball mesh vertex placed on an interactor's body, relative to its center (the mesh has radius
+// 0.5); capsules split the sphere at its equator and move the hemispheres apart into caps
+static float3 interactorBodyOffset(float3 meshPosition, Interactor interactor) {
+    float3 localPos = meshPosition * (interactor.bodyRadius * 2.0);
+    localPos.y += sign(localPos.y) * interactor.halfHeight;
+    return localPos;
+}
+
+// One instance per interactor: the body is the ball mesh scaled to its radius at its position
 vertex BallRasterizerData vertexBall(
     uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
     constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
-    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]]
 ) {
     BallRasterizerData out;
+    Interactor interactor = interactors[instanceID];
+    out.material = interactor.material;
+    if (writeObjectId) {
+        out.objectId = OBJECT_ID(ObjectIdKindInteractor, instanceID);
+    }
     
     // Get vertex position in local space
-    float3 localPos = vertices[vertexID].position;
+    float3 localPos = interactorBodyOffset(vertices[vertexID].position, interactor);
     
     // Translate to interactor position
-    float3 worldPos = localPos + uniforms.interactorPos;
+    float3 worldPos = localPos + interactor.position;
     
     // Transform to clip space
     out.position = uniforms.projectionMatrix * uniforms.viewMatrix * float4(worldPos, 1.0);
     out.worldPos = worldPos;
     
+    if (writeMotionVectors) {
+        out.currentClip = uniforms.unjitteredViewProjection * float4(worldPos, 1.0);
+        out.previousClip = uniforms.prevViewProjection * float4(localPos + interactor.prevPosition, 1.0);
+    }
+    
     // Pass normal in object space (no rotation applied, so object space = world space)
     // Normalize to ensure it's unit length after interpolation
     out.normal = normalize(vertices[vertexID].normal);
@@ -591,7 +1447,7 @@ vertex BallRasterizerData vertexBall(
     return out;
 }
 
-fragment float4 fragmentBall(
+fragment SceneFragmentOut fragmentBall(
     BallRasterizerData in [[stage_in]],
     constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
 ) {
@@ -606,9 +1462,9 @@ fragment float4 fragmentBall(
     // Calculate view direction (from fragment to camera)
     float3 viewDir = normalize(uniforms.cameraPosition - in.worldPos);
     
-    // Material properties
-    float3 diffuseColor = float3(0.9, 0.9, 0.9); // Bright white/grey
-    float specularStrength = 0.8; // High specular for glossy look
+    // Material properties (per interactor; the ball is bright white/grey and glossy)
+    float3 diffuseColor = in.material.rgb;
+    float specularStrength = in.material.a;
     float shininess = 64.0; // Sharp, glossy highlight
     
     // Ambient component
@@ -627,5 +1483,60 @@ fragment float4 fragmentBall(
     // Final color: Ambient + Diffuse + Specular
     float3 finalColor = ambient + diffuse + specularColor;
     
-    return float4(finalColor, 1.0);
+    SceneFragmentOut out;
+    out.color = float4(finalColor, 1.0);
+    if (writeMotionVectors) {
+        out.motion = motionVector(in.currentClip, in.previousClip);
+    }
+    if (writeTileDepth) {
+        out.tileDepth = in.position.z;
+    }
+    if (writeObjectId) {
+        out.objectId = in.objectId;
+    }
+    return out;
+}
+
+// ---------------------------------------------------------
+// SUN SHADOW CASTERS (depth-only passes of ShadowMaps)
+// ---------------------------------------------------------
+// Static cascades: every blade at rest as one triangle (root edge to tip) at its baked rotation,
+// with no wind, trample or camera-facing turn, so the cascade stays valid however the camera
+// and the simulation move. Empty slots have no scale and collapse to a point.
+vertex float4 grassShadowVertex(
+    uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
+    constant InstanceData *instances [[buffer(BufferIndexInstanceData)]],
+    constant ShadowCasterUniforms &caster [[buffer(BufferIndexShadowCaster)]],
+    constant SceneConstants &scene [[buffer(BufferIndexSceneConstants)]]
+) {
+    InstanceData instance = instances[instanceID];
+    float4 shape = caster.bladeShapes[instanceSpecies(instance)];
+    float scale = instanceScale(instance);
+    float rotation = instanceRotation(instance);
+    
+    // The alpha-masked blade covers the middle of its strip, about as wide as a geometry blade
+    float halfWidth = shape.x * kGeometryBladeWidth * scale;
+    float3 right = float3(cos(rotation), 0.0, -sin(rotation));
+    float3 position = instancePosition(instance, scene.grassMinXZ, scene.grassMaxXZ);
+    if (vertexID == 2) {
+        position.y += (shape.y + shape.z) * scale;
+    } else {
+        position += right * (vertexID == 0 ? -halfWidth : halfWidth);
+        position.y += shape.y * scale;
+    }
+    return caster.viewProjection * float4(position, 1.0);
+}
+
+// Dynamic overlay: the interactor bodies, placed like vertexBall
+vertex float4 interactorShadowVertex(
+    uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
+    constant Vertex *vertices [[buffer(BufferIndexMeshPositions)]],
+    constant ShadowCasterUniforms &caster [[buffer(BufferIndexShadowCaster)]],
+    const device Interactor *interactors [[buffer(BufferIndexInteractors)]]
+) {
+    Interactor interactor = interactors[instanceID];
+    float3 worldPos = interactorBodyOffset(vertices[vertexID].position, interactor) + interactor.position;
+    return caster.viewProjection * float4(worldPos, 1.0);
 }
@@ -0,0 +1,100 @@
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE // Metal clip depth, as in Renderer.hpp
+#include "ShadowMaps.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+ShadowMaps::ShadowMaps(MTL::Device* device)
+    : m_textures()
+    , m_viewProjection()
+    , m_center()
+    , m_sunDirection(0.0f, 1.0f, 0.0f)
+    , m_dirty()
+    , m_placed(false)
+{
+    static const char* kLabels[SHADOW_MAP_COUNT] = { "Shadow cascade 0", "Shadow cascade 1", "Shadow overlay" };
+    MTL::TextureDescriptor* desc = MTL::TextureDescriptor::alloc()->init();
+    desc->setPixelFormat(kDepthFormat);
+    desc->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+    desc->setStorageMode(MTL::StorageModePrivate);
+    for (int map = 0; map < SHADOW_MAP_COUNT; ++map) {
+        desc->setWidth(kLayouts[map].size);
+        desc->setHeight(kLayouts[map].size);
+        m_textures[map] = device->newTexture(desc);
+        if (m_textures[map]) {
+            m_textures[map]->setLabel(NS::String::string(kLabels[map], NS::UTF8StringEncoding));
+        } else {
+            std::cerr << "Failed to create " << kLabels[map] << " (" << kLayouts[map].size << "^2)" << std::endl;
+        }
+    }
+    desc->release();
+    invalidate();
+}
+
+ShadowMaps::~ShadowMaps()
+{
+    for (MTL::Texture* texture : m_textures) {
+        if (texture) {
+            texture->release();
+        }
+    }
+}
+
+bool ShadowMaps::isValid() const
+{
+    for (MTL::Texture* texture : m_textures) {
+        if (!texture) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShadowMaps::invalidate()
+{
+    for (bool& dirty : m_dirty) {
+        dirty = true;
+    }
+}
+
+void ShadowMaps::update(const glm::vec3& cameraPosition, const glm::vec3& sunDirection)
+{
+    glm::vec3 sun = glm::normalize(sunDirection);
+    bool sunTurned = !m_placed || glm::dot(sun, m_sunDirection) < kSunTolerance;
+    if (sunTurned) {
+        m_sunDirection = sun;
+    }
+    for (int map = 0; map < SHADOW_MAP_COUNT; ++map) {
+        // Recentered once the camera is a whole step away (no flip-flop about a grid line), so
+        // everything within halfExtent - snap of the camera stays covered
+        float snap = kLayouts[map].snap;
+        glm::vec3 offset = glm::abs(cameraPosition - m_center[map]);
+        bool moved = !m_placed || std::max(offset.x, std::max(offset.y, offset.z)) > snap;
+        if (moved) {
+            m_center[map] = glm::floor(cameraPosition / snap + 0.5f) * snap;
+        }
+        if (moved || sunTurned) {
+            updateProjection(map);
+            if (map < SHADOW_CASCADE_COUNT) {
+                m_dirty[map] = true;
+            }
+        }
+    }
+    m_placed = true;
+}
+
+float ShadowMaps::getDepthBias(int map) const
+{
+    return kLayouts[map].bias / (2.0f * kDepthRange);
+}
+
+void ShadowMaps::updateProjection(int map)
+{
+    // Eye kDepthRange toward the sun from the center, looking back along it
+    glm::vec3 up = std::abs(m_sunDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(m_center[map] + m_sunDirection * kDepthRange, m_center[map], up);
+    float halfExtent = kLayouts[map].halfExtent;
+    glm::mat4 projection = glm::ortho(-halfExtent, halfExtent, -halfExtent, halfExtent, 0.0f, 2.0f * kDepthRange);
+    m_viewProjection[map] = projection * view;
+}
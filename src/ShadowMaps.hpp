@@ -0,0 +1,60 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "ShaderTypes.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// Sun shadow maps: SHADOW_CASCADE_COUNT orthographic cascades along the sun, centred on the
+// camera and snapped to a coarse grid, hold the static casters and keep their depth until they
+// have to move (the camera left the snapped region, the sun turned, or invalidate(): the grass
+// or the terrain changed), so a still or slowly moving camera pays nothing for them. The overlay
+// (map SHADOW_CASCADE_COUNT) is redrawn every frame with the dynamic casters only. The renderer
+// draws the casters; this class owns the depth textures, the projections and the dirty state.
+class ShadowMaps {
+public:
+    static constexpr MTL::PixelFormat kDepthFormat = MTL::PixelFormatDepth16Unorm;
+    static constexpr int kOverlay = SHADOW_CASCADE_COUNT;
+
+    explicit ShadowMaps(MTL::Device* device);
+    ~ShadowMaps();
+
+    bool isValid() const;
+
+    // Every cascade redraws at its next update
+    void invalidate();
+    // Per frame: follow the camera and the sun (direction toward it); cascades whose projection
+    // changed are flagged for a redraw, the overlay always follows
+    void update(const glm::vec3& cameraPosition, const glm::vec3& sunDirection);
+    bool needsRedraw(int cascade) const { return m_dirty[cascade]; }
+    void markDrawn(int cascade) { m_dirty[cascade] = false; }
+    // Cascade 0 holds the blades; coarser maps have texels too big for them and take the terrain only
+    bool castsGrass(int map) const { return map == 0; }
+
+    MTL::Texture* getTexture(int map) const { return m_textures[map]; }
+    const glm::mat4& getViewProjection(int map) const { return m_viewProjection[map]; }
+    float getDepthBias(int map) const; // Receiver bias in the map's depth units
+
+private:
+    struct Layout {
+        float halfExtent; // Meters from the center to each side
+        float snap;       // The center moves in steps of this many meters
+        float bias;       // Receiver bias in meters along the sun
+        uint32_t size;    // Texels per side
+    };
+    static constexpr Layout kLayouts[SHADOW_MAP_COUNT] = {
+        { 12.0f, 4.0f, 0.05f, 2048 },
+        { 40.0f, 16.0f, 0.15f, 2048 },
+        { 22.0f, 1.0f, 0.05f, 1024 },
+    };
+    static constexpr float kDepthRange = 50.0f;      // Casters this far toward the sun, receivers this far away
+    static constexpr float kSunTolerance = 0.99995f; // Cosine of the turn (~0.6 degrees) that redraws the cascades
+
+    void updateProjection(int map);
+
+    MTL::Texture* m_textures[SHADOW_MAP_COUNT];
+    glm::mat4 m_viewProjection[SHADOW_MAP_COUNT];
+    glm::vec3 m_center[SHADOW_MAP_COUNT];
+    glm::vec3 m_sunDirection; // Of the current projections
+    bool m_dirty[SHADOW_CASCADE_COUNT];
+    bool m_placed;            // update() has run since the last invalidate()
+};
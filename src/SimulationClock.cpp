@@ -0,0 +1,52 @@
+#include "SimulationClock.hpp"
+#include <algorithm>
+
+SimulationClock::SimulationClock(float rateHz)
+    : m_rate(0.0f)
+    , m_step(0.0f)
+    , m_time(0.0f)
+    , m_alpha(1.0f)
+    , m_stepCount(0)
+    , m_started(false)
+{
+    setRate(rateHz);
+}
+
+void SimulationClock::setRate(float rateHz)
+{
+    m_rate = std::max(rateHz, 0.0f);
+    m_step = m_rate > 0.0f ? 1.0f / m_rate : 0.0f;
+    m_started = false;
+}
+
+int SimulationClock::advance(float frameTime)
+{
+    if (!m_started || frameTime < m_time) {
+        // First frame (or the clock was reset): one step, so the simulation starts right away
+        m_started = true;
+        m_time = frameTime;
+        m_step = m_rate > 0.0f ? 1.0f / m_rate : 0.0f;
+        m_alpha = 1.0f;
+        m_stepCount = 1;
+        return m_stepCount;
+    }
+
+    if (m_rate <= 0.0f) {
+        m_step = std::min(frameTime - m_time, kMaxVariableStep);
+        m_time = frameTime;
+        m_alpha = 1.0f;
+        m_stepCount = 1;
+        return m_stepCount;
+    }
+
+    int due = static_cast<int>((frameTime - m_time) / m_step);
+    if (due > kMaxStepsPerFrame) {
+        // Drop the backlog: the simulation slows down through the hitch instead of spiralling
+        m_time = frameTime - static_cast<float>(kMaxStepsPerFrame) * m_step;
+        due = kMaxStepsPerFrame;
+    }
+    m_time += static_cast<float>(due) * m_step;
+    m_alpha = std::clamp((frameTime - m_time) / m_step, 0.0f, 1.0f);
+    m_stepCount = due;
+    return m_stepCount;
+}
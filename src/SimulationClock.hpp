@@ -0,0 +1,34 @@
+#pragma once
+
+// Step clock of one simulation (trample stamping, interactor physics, wind fluid), driven by the
+// frame clock. At a fixed rate, advance() returns the whole steps that fell due since the last
+// frame, so the result no longer depends on the display rate; getAlpha() is how far the frame is
+// past the last step, for drawing between the last two simulated states. A hitch runs at most
+// kMaxStepsPerFrame steps and drops the rest rather than trying to catch up. Rate 0 steps once
+// per frame by the (capped) frame delta, as the simulations did before.
+class SimulationClock {
+public:
+    static constexpr int kMaxStepsPerFrame = 4;
+    static constexpr float kMaxVariableStep = 1.0f / 30.0f;
+
+    explicit SimulationClock(float rateHz = 0.0f);
+
+    void setRate(float rateHz); // Steps per second (0 = once per frame); restarts the clock
+    float getRate() const { return m_rate; }
+
+    // Steps due at frameTime (seconds); the clock restarts if frameTime went backwards
+    int advance(float frameTime);
+
+    float getStep() const { return m_step; }   // Seconds per step (this frame's delta at rate 0)
+    float getTime() const { return m_time; }   // Simulated time after this frame's steps
+    float getAlpha() const { return m_alpha; } // (frameTime - getTime()) / getStep(), in [0, 1]
+    int getStepCount() const { return m_stepCount; }
+
+private:
+    float m_rate;
+    float m_step;
+    float m_time;
+    float m_alpha;
+    int m_stepCount;
+    bool m_started;
+};
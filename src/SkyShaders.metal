@@ -37,25 +37,31 @@ vertex SkyRasterizerData vertexSkyFullscreen(uint vertexID [[vertex_id]]) {
     return out;
 }
 
-fragment float4 fragmentSkyGradient(SkyRasterizerData in [[stage_in]]) {
-    float2 uv = in.uv;
-
-    // Fix vertical direction:
-    float y = 1.0 - saturate(uv.y); // 0 = horizon, 1 = top
-
-    // More saturated, clearer "Ghibli-ish" palette (not washed out)
-    float3 topColor     = float3(0.16, 0.38, 0.82);
-    float3 horizonColor = float3(0.72, 0.90, 0.98);  // keep
-    float3 hazeColor    = float3(0.80, 0.90, 0.98);
-
-    // Base gradient: keep contrast
-    float t = smoothstep(0.0, 1.0, y);
-    float3 col = mix(horizonColor, topColor, t);
-
-    // Haze: strongest near horizon, dies quickly upward (avoid whole-sky whitening)
-    float haze = exp2(-y * 10.0);
-    col = mix(col, hazeColor, haze * 0.25);
+// Sky drawn last: the same triangle at the far plane, so the depth test only passes where
+// nothing was drawn, with the homogeneous world point under each corner for the view rays
+struct SkyRayRasterizerData {
+    float4 position [[position]];
+    float4 farPoint; // World position on the far plane (divide by w after interpolation)
+};
 
-    return float4(saturate(col), 1.0);
+vertex SkyRayRasterizerData vertexSky(
+    uint vertexID [[vertex_id]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]]
+) {
+    float2 pos = float2(vertexID == 1 ? 3.0 : -1.0, vertexID == 2 ? 3.0 : -1.0);
+    
+    SkyRayRasterizerData out;
+    out.position = float4(pos, 1.0, 1.0);
+    out.farPoint = uniforms.inverseViewProjection * float4(pos, 1.0, 1.0);
+    return out;
 }
 
+// Sky color from the atmosphere LUT along this pixel's view ray
+fragment float4 fragmentSkyGradient(
+    SkyRayRasterizerData in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(BufferIndexUniforms)]],
+    texture2d<float> atmosphereLut [[texture(TextureIndexAtmosphere)]]
+) {
+    float3 viewDir = normalize(in.farPoint.xyz / in.farPoint.w - uniforms.cameraPosition);
+    return float4(atmosphereColor(atmosphereLut, viewDir, uniforms.sunDirection), 1.0);
+}
@@ -0,0 +1,42 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// Fill newly mapped regions of the sparse ground texture. One dispatch slice per SparseGroundTile;
+// threads outside a tile's region (the mip tail levels are smaller than a tile) return early.
+// There is no unique ground art, so texels are generated: the tiled ground albedo at the mip
+// matching the level's texel footprint, varied by world-space value noise so the field no longer
+// repeats every 1/GROUND_TEXTURE_TILING of its width.
+kernel void fillSparseGroundTiles(
+    texture2d<float, access::write> sparseTexture [[texture(0)]],
+    texture2d<float> groundAlbedo [[texture(1)]],
+    texture2d<float> noiseTexture [[texture(2)]],
+    constant SparseGroundTile *tiles [[buffer(SparseFillBufferIndexTiles)]],
+    constant SparseGroundFillUniforms &uniforms [[buffer(SparseFillBufferIndexUniforms)]],
+    uint3 gid [[thread_position_in_grid]]
+) {
+    SparseGroundTile tile = tiles[gid.z];
+    if (gid.x >= tile.region.z || gid.y >= tile.region.w) {
+        return;
+    }
+
+    constexpr sampler albedoSampler(filter::linear, mip_filter::linear, address::repeat);
+
+    uint2 texel = tile.region.xy + gid.xy;
+    float levelSize = float(max(uniforms.size >> tile.level, 1u));
+    float2 uv = (float2(texel) + 0.5) / levelSize;
+
+    // Albedo texels under one texel of this level
+    float albedoTexels = float(groundAlbedo.get_width()) * GROUND_TEXTURE_TILING;
+    float lod = max(log2(albedoTexels / levelSize), 0.0);
+    float4 color = groundAlbedo.sample(albedoSampler, uv * GROUND_TEXTURE_TILING, level(lod));
+
+    // Unique macro variation (v runs from +Z to -Z, as on the ground vertices)
+    float2 worldXZ = mix(uniforms.groundMinXZ, uniforms.groundMaxXZ, float2(uv.x, 1.0 - uv.y));
+    float macro = valueNoise(noiseTexture, worldXZ * 0.35);
+    float detail = valueNoise(noiseTexture, worldXZ * 2.7 + 17.0);
+    color.rgb *= mix(0.75, 1.2, macro) * mix(0.9, 1.1, detail);
+
+    sparseTexture.write(color, texel, tile.level);
+}
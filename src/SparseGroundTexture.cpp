@@ -0,0 +1,550 @@
+#include "SparseGroundTexture.hpp"
+#include "ComputeDispatch.hpp"
+#include "PipelineArchive.hpp"
+#include "PipelineCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static constexpr MTL::PixelFormat kSparseFormat = MTL::PixelFormatRGBA8Unorm;
+
+static uint32_t levelTexels(uint32_t level)
+{
+    return std::max<uint32_t>(SPARSE_GROUND_SIZE >> level, 1u);
+}
+
+bool SparseGroundTexture::isSupported(MTL::Device* device)
+{
+    return device && device->supportsFamily(MTL::GPUFamilyApple6);
+}
+
+SparseGroundTexture::SparseGroundTexture(MTL::Device* device, MTL::Library* library, PipelineArchive* archive,
+                                         const ComputeDispatch* dispatch, int frameCount, size_t budgetBytes)
+    : m_device(device)
+    , m_dispatch(dispatch)
+    , m_frameCount(std::min(frameCount, kMaxFrames))
+    , m_fillPSO(nullptr)
+    , m_heap(nullptr)
+    , m_texture(nullptr)
+    , m_feedbackBuffers()
+    , m_residencyBuffers()
+    , m_tileBuffers()
+    , m_slot(0)
+    , m_uniforms()
+    , m_tileSize(0, 0, 0)
+    , m_tileBytes(0)
+    , m_budgetTiles(0)
+    , m_heapBudgetTiles(0)
+    , m_maxBudgetTiles(0)
+    , m_heapReserveTiles(0)
+    , m_tailLevel(0)
+    , m_firstLevel()
+    , m_frame(0)
+    , m_pinnedMapped(false)
+    , m_residencyVersion(1)
+    , m_slotResidencyVersion()
+{
+    m_tileSize = m_device->sparseTileSize(MTL::TextureType2D, kSparseFormat, 1);
+    m_tileBytes = m_device->sparseTileSizeInBytes();
+    if (m_tileSize.width == 0 || m_tileSize.width != m_tileSize.height || m_tileBytes == 0 ||
+        SPARSE_GROUND_SIZE % m_tileSize.width != 0) {
+        std::cerr << "Unsupported sparse tile size for the ground texture" << std::endl;
+        return;
+    }
+
+    uint32_t tileTexels = static_cast<uint32_t>(m_tileSize.width);
+    m_uniforms.tilesPerSide = SPARSE_GROUND_SIZE / tileTexels;
+    m_uniforms.levelCount = SPARSE_GROUND_MAX_LEVELS;
+
+    // Levels smaller than a tile end up in the mip tail; the real first tail level is only known
+    // once the texture exists, so the heap is sized from this estimate plus a few spare pages
+    uint32_t estimatedTail = 0;
+    while (estimatedTail < m_uniforms.levelCount && levelTexels(estimatedTail) >= tileTexels) {
+        ++estimatedTail;
+    }
+    uint32_t pinnedLevel = 0;
+    while ((m_uniforms.tilesPerSide >> pinnedLevel) > kPinnedTilesPerSide && pinnedLevel < estimatedTail) {
+        ++pinnedLevel;
+    }
+    uint32_t pinnedTiles = 0;
+    for (uint32_t level = pinnedLevel; level < estimatedTail; ++level) {
+        uint32_t tiles = levelTexels(level) / tileTexels;
+        pinnedTiles += tiles * tiles;
+    }
+    m_budgetTiles = std::max<uint32_t>(static_cast<uint32_t>(budgetBytes / m_tileBytes), kMaxMapsPerFrame);
+    m_maxBudgetTiles = m_budgetTiles;
+    m_heapReserveTiles = pinnedTiles + kTailPageReserve;
+    if (!createTexture(m_budgetTiles)) {
+        return;
+    }
+
+    m_tailLevel = std::min<uint32_t>(static_cast<uint32_t>(m_texture->firstMipmapInTail()), m_uniforms.levelCount);
+    m_uniforms.pinnedLevel = std::min(pinnedLevel, m_tailLevel);
+
+    // Streamed levels: one feedback entry (and residency flag) per tile
+    uint32_t tileCount = 0;
+    for (uint32_t level = 0; level < m_uniforms.pinnedLevel; ++level) {
+        uint32_t tiles = m_uniforms.tilesPerSide >> level;
+        m_firstLevel[level] = tileCount;
+        m_uniforms.feedbackOffset[level] = tileCount;
+        tileCount += tiles * tiles;
+    }
+    m_resident.assign(tileCount, 0);
+    m_lastRequested.assign(tileCount, 0);
+    m_residentTiles.reserve(m_maxBudgetTiles);
+    m_residencyMap.assign(m_uniforms.tilesPerSide * m_uniforms.tilesPerSide, static_cast<uint8_t>(m_uniforms.pinnedLevel));
+
+    // Fill list: a frame's streamed tiles plus, after setup or invalidate(), every pinned region
+    pinnedTiles = 0;
+    for (uint32_t level = m_uniforms.pinnedLevel; level < m_tailLevel; ++level) {
+        uint32_t tiles = levelTexels(level) / tileTexels;
+        pinnedTiles += tiles * tiles;
+    }
+    size_t tileCapacity = kMaxMapsPerFrame + pinnedTiles + m_uniforms.levelCount;
+    size_t residencySize = sizeof(SparseGroundUniforms) + m_residencyMap.size();
+    for (int i = 0; i < m_frameCount; ++i) {
+        m_feedbackBuffers[i] = m_device->newBuffer(std::max<size_t>(tileCount, 1) * sizeof(uint32_t), MTL::ResourceStorageModeShared);
+        m_residencyBuffers[i] = m_device->newBuffer(residencySize, MTL::ResourceStorageModeShared);
+        m_tileBuffers[i] = m_device->newBuffer(tileCapacity * sizeof(SparseGroundTile), MTL::ResourceStorageModeShared);
+        if (!m_feedbackBuffers[i] || !m_residencyBuffers[i] || !m_tileBuffers[i]) {
+            std::cerr << "Failed to create sparse ground buffers" << std::endl;
+            return;
+        }
+        std::memset(m_feedbackBuffers[i]->contents(), 0, m_feedbackBuffers[i]->length());
+        std::memcpy(m_residencyBuffers[i]->contents(), &m_uniforms, sizeof(SparseGroundUniforms));
+        std::memcpy(static_cast<uint8_t*>(m_residencyBuffers[i]->contents()) + sizeof(SparseGroundUniforms),
+                    m_residencyMap.data(), m_residencyMap.size());
+    }
+
+    MTL::Function* function = PipelineCache::newFunction(library, "fillSparseGroundTiles", {});
+    if (!function) {
+        std::cerr << "Failed to load fillSparseGroundTiles function" << std::endl;
+        return;
+    }
+    m_fillPSO = archive->newComputePipeline(function, "fillSparseGroundTiles");
+    function->release();
+
+    queuePinnedRegions();
+}
+
+SparseGroundTexture::~SparseGroundTexture()
+{
+    for (const RetiredHeap& retired : m_retiredHeaps) {
+        retired.texture->release();
+        retired.heap->release();
+    }
+    for (int i = 0; i < kMaxFrames; ++i) {
+        if (m_feedbackBuffers[i]) {
+            m_feedbackBuffers[i]->release();
+        }
+        if (m_residencyBuffers[i]) {
+            m_residencyBuffers[i]->release();
+        }
+        if (m_tileBuffers[i]) {
+            m_tileBuffers[i]->release();
+        }
+    }
+    if (m_fillPSO) {
+        m_fillPSO->release();
+    }
+    if (m_texture) {
+        m_texture->release();
+    }
+    if (m_heap) {
+        m_heap->release();
+    }
+}
+
+bool SparseGroundTexture::createTexture(uint32_t budgetTiles)
+{
+    MTL::HeapDescriptor* heapDescriptor = MTL::HeapDescriptor::alloc()->init();
+    heapDescriptor->setType(MTL::HeapTypeSparse);
+    heapDescriptor->setStorageMode(MTL::StorageModePrivate);
+    heapDescriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    heapDescriptor->setSize((budgetTiles + m_heapReserveTiles) * m_tileBytes);
+    MTL::Heap* heap = m_device->newHeap(heapDescriptor);
+    heapDescriptor->release();
+    if (!heap) {
+        std::cerr << "Failed to create sparse ground heap" << std::endl;
+        return false;
+    }
+
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setTextureType(MTL::TextureType2D);
+    textureDescriptor->setPixelFormat(kSparseFormat);
+    textureDescriptor->setWidth(SPARSE_GROUND_SIZE);
+    textureDescriptor->setHeight(SPARSE_GROUND_SIZE);
+    textureDescriptor->setMipmapLevelCount(m_uniforms.levelCount);
+    textureDescriptor->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    textureDescriptor->setStorageMode(MTL::StorageModePrivate);
+    MTL::Texture* texture = heap->newTexture(textureDescriptor);
+    textureDescriptor->release();
+    if (!texture) {
+        std::cerr << "Failed to create sparse ground texture" << std::endl;
+        heap->release();
+        return false;
+    }
+    texture->setLabel(NS::String::string("Sparse Ground", NS::UTF8StringEncoding));
+    m_heap = heap;
+    m_texture = texture;
+    m_heapBudgetTiles = budgetTiles;
+    return true;
+}
+
+void SparseGroundTexture::rebuildHeap()
+{
+    // Frames in flight still sample the current texture: it goes once they have all completed
+    MTL::Heap* heap = m_heap;
+    MTL::Texture* texture = m_texture;
+    if (!createTexture(m_budgetTiles)) {
+        m_heap = heap; // Keep streaming within the old heap
+        m_texture = texture;
+        m_budgetTiles = std::min(m_budgetTiles, m_heapBudgetTiles);
+        return;
+    }
+    RetiredHeap retired = { heap, texture, m_frameCount };
+    m_retiredHeaps.push_back(retired);
+
+    // Nothing is mapped in the new texture: the pinned regions first, the streamed tiles as requested again
+    for (uint32_t index : m_residentTiles) {
+        m_resident[index] = 0;
+    }
+    m_residentTiles.clear();
+    m_mapQueue.clear();
+    m_unmapQueue.clear();
+    m_pinnedMapped = false;
+    queuePinnedRegions();
+    ++m_residencyVersion;
+    rebuildResidencyMap();
+}
+
+uint32_t SparseGroundTexture::tileIndex(uint32_t level, uint32_t x, uint32_t y) const
+{
+    return m_firstLevel[level] + y * (m_uniforms.tilesPerSide >> level) + x;
+}
+
+void SparseGroundTexture::queuePinnedRegions()
+{
+    // Whole tiles of the pinned levels, then every level of the tail (each smaller than a tile)
+    uint32_t tileTexels = static_cast<uint32_t>(m_tileSize.width);
+    m_pinnedFills.clear();
+    for (uint32_t level = m_uniforms.pinnedLevel; level < m_uniforms.levelCount; ++level) {
+        uint32_t size = levelTexels(level);
+        uint32_t step = level < m_tailLevel ? tileTexels : size;
+        for (uint32_t y = 0; y < size; y += step) {
+            for (uint32_t x = 0; x < size; x += step) {
+                SparseGroundTile tile = {};
+                tile.region = simd::make_uint4(x, y, step, step);
+                tile.level = level;
+                m_pinnedFills.push_back(tile);
+            }
+        }
+    }
+}
+
+void SparseGroundTexture::invalidate()
+{
+    if (!isValid()) {
+        return;
+    }
+    for (uint32_t index : m_residentTiles) {
+        m_resident[index] = 0;
+        m_unmapQueue.push_back(index);
+    }
+    m_residentTiles.clear();
+    queuePinnedRegions();
+    ++m_residencyVersion;
+    rebuildResidencyMap();
+}
+
+void SparseGroundTexture::update(int slot)
+{
+    if (!isValid()) {
+        return;
+    }
+    m_slot = slot;
+    ++m_frame;
+
+    // Each update() follows the completion of one more frame that may have sampled a retired heap
+    for (size_t i = 0; i < m_retiredHeaps.size();) {
+        if (--m_retiredHeaps[i].framesLeft > 0) {
+            ++i;
+            continue;
+        }
+        m_retiredHeaps[i].texture->release();
+        m_retiredHeaps[i].heap->release();
+        m_retiredHeaps[i] = m_retiredHeaps.back();
+        m_retiredHeaps.pop_back();
+    }
+    // Budget well below (or above) the heap's: move to a heap of its size before this frame's mapping
+    if (m_budgetTiles > m_heapBudgetTiles || m_heapBudgetTiles - m_budgetTiles >= std::max(m_heapBudgetTiles / 4, kMaxMapsPerFrame)) {
+        rebuildHeap();
+    }
+
+    // Requests of the completed frame in this slot. The ring of tiles around a requested one comes
+    // with it (filter footprints cross tile borders, and the camera moves on before the next
+    // readback), and so do their coarser parents, so the levels between a pixel's resident
+    // fallback and its tile stream in coarse to fine
+    uint32_t* feedback = static_cast<uint32_t*>(m_feedbackBuffers[slot]->contents());
+    for (uint32_t level = 0; level < m_uniforms.pinnedLevel; ++level) {
+        uint32_t tiles = m_uniforms.tilesPerSide >> level;
+        for (uint32_t y = 0; y < tiles; ++y) {
+            for (uint32_t x = 0; x < tiles; ++x) {
+                uint32_t index = tileIndex(level, x, y);
+                if (!feedback[index]) {
+                    continue;
+                }
+                feedback[index] = 0;
+                for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, tiles - 1); ++ny) {
+                    for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, tiles - 1); ++nx) {
+                        requestTile(level, nx, ny);
+                    }
+                }
+            }
+        }
+    }
+
+    // Map requested tiles coarse first; past the budget, evict the least recently requested tile
+    // that has no resident finer tile under it (those are evicted first, keeping chains intact)
+    bool changed = !m_unmapQueue.empty();
+    for (int level = static_cast<int>(m_uniforms.pinnedLevel) - 1; level >= 0 && m_mapQueue.size() < kMaxMapsPerFrame; --level) {
+        uint32_t tiles = m_uniforms.tilesPerSide >> level;
+        for (uint32_t index = m_firstLevel[level]; index < m_firstLevel[level] + tiles * tiles && m_mapQueue.size() < kMaxMapsPerFrame; ++index) {
+            if (m_resident[index] || m_lastRequested[index] != m_frame) {
+                continue;
+            }
+            if (m_residentTiles.size() >= m_budgetTiles) {
+                size_t victim = findEvictionVictim();
+                if (victim == m_residentTiles.size()) {
+                    break;
+                }
+                evictResident(victim);
+            }
+            queueMap(index);
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        ++m_residencyVersion;
+        rebuildResidencyMap();
+    }
+
+    // Publish into the slot (its previous frame has completed: the ring semaphore waited for it)
+    if (m_slotResidencyVersion[slot] != m_residencyVersion) {
+        uint8_t* contents = static_cast<uint8_t*>(m_residencyBuffers[slot]->contents());
+        std::memcpy(contents, &m_uniforms, sizeof(SparseGroundUniforms));
+        std::memcpy(contents + sizeof(SparseGroundUniforms), m_residencyMap.data(), m_residencyMap.size());
+        m_slotResidencyVersion[slot] = m_residencyVersion;
+    }
+}
+
+void SparseGroundTexture::requestTile(uint32_t level, uint32_t x, uint32_t y)
+{
+    // The tile and its coarser parents; a parent already requested this frame has its own parents too
+    for (uint32_t parent = level; parent < m_uniforms.pinnedLevel; ++parent) {
+        uint32_t parentIndex = tileIndex(parent, x >> (parent - level), y >> (parent - level));
+        if (m_lastRequested[parentIndex] == m_frame) {
+            break;
+        }
+        m_lastRequested[parentIndex] = m_frame;
+    }
+}
+
+void SparseGroundTexture::queueMap(uint32_t index)
+{
+    // Resident from this frame on: encodeUpdates() maps and fills it before the scene pass samples it
+    m_resident[index] = 1;
+    m_residentTiles.push_back(index);
+    m_mapQueue.push_back(index);
+}
+
+void SparseGroundTexture::rebuildResidencyMap()
+{
+    // Finest level of the unbroken resident chain above each level 0 tile...
+    uint32_t tilesPerSide = m_uniforms.tilesPerSide;
+    std::vector<uint8_t> chain(m_residencyMap.size());
+    for (uint32_t y = 0; y < tilesPerSide; ++y) {
+        for (uint32_t x = 0; x < tilesPerSide; ++x) {
+            uint32_t finest = m_uniforms.pinnedLevel;
+            while (finest > 0 && m_resident[tileIndex(finest - 1, x >> (finest - 1), y >> (finest - 1))]) {
+                --finest;
+            }
+            chain[y * tilesPerSide + x] = static_cast<uint8_t>(finest);
+        }
+    }
+    // ...and of its ring: a sample near the tile's border filters texels of the neighbor too
+    for (uint32_t y = 0; y < tilesPerSide; ++y) {
+        for (uint32_t x = 0; x < tilesPerSide; ++x) {
+            uint8_t level = 0;
+            for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, tilesPerSide - 1); ++ny) {
+                for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, tilesPerSide - 1); ++nx) {
+                    level = std::max(level, chain[ny * tilesPerSide + nx]);
+                }
+            }
+            m_residencyMap[y * tilesPerSide + x] = level;
+        }
+    }
+}
+
+void SparseGroundTexture::encodeUpdates(MTL::CommandBuffer* commandBuffer, MTL::Texture* groundAlbedo, MTL::Texture* noiseTexture,
+                                        const simd::float2& groundMinXZ, const simd::float2& groundMaxXZ)
+{
+    if (!isValid() || !groundAlbedo || !noiseTexture) {
+        return;
+    }
+
+    // Tile coordinates of a streamed tile index
+    auto tileOf = [this](uint32_t index, uint32_t& level, uint32_t& x, uint32_t& y) {
+        level = 0;
+        while (level + 1 < m_uniforms.pinnedLevel && index >= m_firstLevel[level + 1]) {
+            ++level;
+        }
+        uint32_t tiles = m_uniforms.tilesPerSide >> level;
+        x = (index - m_firstLevel[level]) % tiles;
+        y = (index - m_firstLevel[level]) / tiles;
+    };
+
+    MTL::ResourceStateCommandEncoder* mapEncoder = commandBuffer->resourceStateCommandEncoder();
+    if (!mapEncoder) {
+        return;
+    }
+    uint32_t level, x, y;
+    for (uint32_t index : m_unmapQueue) {
+        tileOf(index, level, x, y);
+        mapEncoder->updateTextureMapping(m_texture, MTL::SparseTextureMappingModeUnmap, MTL::Region::Make2D(x, y, 1, 1), level, 0);
+    }
+    if (!m_pinnedMapped) {
+        // Regions are in tiles; mapping one region of the tail maps all of it
+        for (uint32_t pinned = m_uniforms.pinnedLevel; pinned < m_tailLevel; ++pinned) {
+            uint32_t tiles = levelTexels(pinned) / static_cast<uint32_t>(m_tileSize.width);
+            mapEncoder->updateTextureMapping(m_texture, MTL::SparseTextureMappingModeMap, MTL::Region::Make2D(0, 0, tiles, tiles), pinned, 0);
+        }
+        if (m_tailLevel < m_uniforms.levelCount) {
+            mapEncoder->updateTextureMapping(m_texture, MTL::SparseTextureMappingModeMap, MTL::Region::Make2D(0, 0, 1, 1), m_tailLevel, 0);
+        }
+        m_pinnedMapped = true;
+    }
+    for (uint32_t index : m_mapQueue) {
+        tileOf(index, level, x, y);
+        mapEncoder->updateTextureMapping(m_texture, MTL::SparseTextureMappingModeMap, MTL::Region::Make2D(x, y, 1, 1), level, 0);
+    }
+    mapEncoder->endEncoding();
+
+    // Fill the new regions (the heap is hazard-tracked, so the writes follow the mapping)
+    SparseGroundTile* tiles = static_cast<SparseGroundTile*>(m_tileBuffers[m_slot]->contents());
+    uint32_t tileCount = 0;
+    for (const SparseGroundTile& pinned : m_pinnedFills) {
+        tiles[tileCount++] = pinned;
+    }
+    uint32_t tileTexels = static_cast<uint32_t>(m_tileSize.width);
+    for (uint32_t index : m_mapQueue) {
+        tileOf(index, level, x, y);
+        SparseGroundTile tile = {};
+        tile.region = simd::make_uint4(x * tileTexels, y * tileTexels, tileTexels, tileTexels);
+        tile.level = level;
+        tiles[tileCount++] = tile;
+    }
+    m_pinnedFills.clear();
+    m_mapQueue.clear();
+    m_unmapQueue.clear();
+    if (tileCount == 0) {
+        return;
+    }
+
+    MTL::ComputeCommandEncoder* fillEncoder = commandBuffer->computeCommandEncoder();
+    if (!fillEncoder) {
+        return;
+    }
+    SparseGroundFillUniforms fillUniforms = {};
+    fillUniforms.groundMinXZ = groundMinXZ;
+    fillUniforms.groundMaxXZ = groundMaxXZ;
+    fillUniforms.size = SPARSE_GROUND_SIZE;
+    fillEncoder->setComputePipelineState(m_fillPSO);
+    fillEncoder->setTexture(m_texture, 0);
+    fillEncoder->setTexture(groundAlbedo, 1);
+    fillEncoder->setTexture(noiseTexture, 2);
+    fillEncoder->setBuffer(m_tileBuffers[m_slot], 0, SparseFillBufferIndexTiles);
+    fillEncoder->setBytes(&fillUniforms, sizeof(SparseGroundFillUniforms), SparseFillBufferIndexUniforms);
+    m_dispatch->dispatch(fillEncoder, m_fillPSO, MTL::Size(tileTexels, tileTexels, tileCount));
+    fillEncoder->endEncoding();
+}
+
+size_t SparseGroundTexture::findEvictionVictim() const
+{
+    // Least recently requested tile that has no resident finer tile under it (those are evicted
+    // first, keeping chains intact); tiles this frame requested are never evicted
+    size_t victim = m_residentTiles.size();
+    for (size_t i = 0; i < m_residentTiles.size(); ++i) {
+        uint32_t candidate = m_residentTiles[i];
+        if (m_lastRequested[candidate] == m_frame ||
+            (victim < m_residentTiles.size() && m_lastRequested[candidate] >= m_lastRequested[m_residentTiles[victim]])) {
+            continue;
+        }
+        // Finer tiles under the candidate keep it resident
+        uint32_t candidateLevel = 0;
+        while (candidateLevel + 1 < m_uniforms.pinnedLevel && candidate >= m_firstLevel[candidateLevel + 1]) {
+            ++candidateLevel;
+        }
+        bool hasChildren = false;
+        if (candidateLevel > 0) {
+            uint32_t candidateTiles = m_uniforms.tilesPerSide >> candidateLevel;
+            uint32_t local = candidate - m_firstLevel[candidateLevel];
+            uint32_t cx = local % candidateTiles;
+            uint32_t cy = local / candidateTiles;
+            for (uint32_t child = 0; child < 4 && !hasChildren; ++child) {
+                hasChildren = m_resident[tileIndex(candidateLevel - 1, cx * 2 + (child & 1), cy * 2 + (child >> 1))] != 0;
+            }
+        }
+        if (!hasChildren) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void SparseGroundTexture::evictResident(size_t residentIndex)
+{
+    uint32_t evicted = m_residentTiles[residentIndex];
+    m_residentTiles[residentIndex] = m_residentTiles.back();
+    m_residentTiles.pop_back();
+    m_resident[evicted] = 0;
+    m_unmapQueue.push_back(evicted);
+}
+
+void SparseGroundTexture::setBudgetBytes(size_t budgetBytes)
+{
+    if (!isValid()) {
+        return;
+    }
+    // The construction budget stays the ceiling; update() moves to a heap sized for a new budget
+    m_budgetTiles = std::clamp<uint32_t>(static_cast<uint32_t>(budgetBytes / m_tileBytes), kMaxMapsPerFrame, m_maxBudgetTiles);
+
+    // Over the new budget: unmap with the next encodeUpdates(), finest and oldest first
+    bool changed = false;
+    while (m_residentTiles.size() > m_budgetTiles) {
+        size_t victim = findEvictionVictim();
+        if (victim == m_residentTiles.size()) {
+            break;
+        }
+        evictResident(victim);
+        changed = true;
+    }
+    if (changed) {
+        ++m_residencyVersion;
+        rebuildResidencyMap();
+    }
+}
+
+size_t SparseGroundTexture::getResidentBytes() const
+{
+    if (!m_texture) {
+        return 0;
+    }
+    size_t pinnedTiles = 0;
+    for (uint32_t level = m_uniforms.pinnedLevel; level < m_tailLevel; ++level) {
+        size_t tiles = levelTexels(level) / m_tileSize.width;
+        pinnedTiles += tiles * tiles;
+    }
+    return (m_residentTiles.size() + pinnedTiles) * m_tileBytes + m_texture->tailSizeInBytes();
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include "ShaderTypes.h"
+#include <cstdint>
+#include <vector>
+
+class ComputeDispatch;
+class PipelineArchive;
+
+// Virtual texturing for the ground: one SPARSE_GROUND_SIZE^2 RGBA8 texture covering the field
+// once, allocated from a sparse heap so only its mapped tiles take memory. The ground fragment
+// shader writes the tiles (and levels) it samples into a per-slot feedback buffer; update() reads a
+// slot back once the frame that wrote it has completed, maps the requested tiles and the ring
+// around each (coarse levels first, a few per frame), evicts the least recently requested tiles
+// past the page budget and publishes a residency map the shader clamps its sampling to (the
+// finest level resident over a tile and its ring). The coarse levels and the mip
+// tail stay mapped, so every pixel always has a resident level to fall back to. A clearly smaller
+// (or a restored) budget moves the texture to a heap sized for it, so the memory is returned too.
+class SparseGroundTexture {
+public:
+    // Sparse heaps and textures need an Apple GPU family 6+ device
+    static bool isSupported(MTL::Device* device);
+
+    SparseGroundTexture(MTL::Device* device, MTL::Library* library, PipelineArchive* archive,
+                        const ComputeDispatch* dispatch, int frameCount, size_t budgetBytes);
+    ~SparseGroundTexture();
+
+    // Consume the feedback of the completed frame in slot, choose this frame's map / unmap set and
+    // publish the residency map into the slot (before the slot's scene pass is encoded)
+    void update(int slot);
+    // True when update() queued mapping changes for encodeUpdates()
+    bool hasPendingUpdates() const { return !m_mapQueue.empty() || !m_unmapQueue.empty() || !m_pinnedFills.empty(); }
+    // Apply the queued unmaps and maps, then fill the newly mapped regions from the ground albedo
+    void encodeUpdates(MTL::CommandBuffer* commandBuffer, MTL::Texture* groundAlbedo, MTL::Texture* noiseTexture,
+                       const simd::float2& groundMinXZ, const simd::float2& groundMaxXZ);
+    // The albedo the tiles are generated from changed: drop every streamed tile and refill the pinned ones
+    void invalidate();
+
+    bool isValid() const { return m_texture && m_fillPSO && m_tileBuffers[0]; }
+    MTL::Texture* getTexture() const { return m_texture; }
+    MTL::Buffer* getUniformBuffer(int slot) const { return m_residencyBuffers[slot]; } // SparseGroundUniforms...
+    NS::UInteger getResidencyOffset() const { return sizeof(SparseGroundUniforms); }  // ...then the residency map
+    MTL::Buffer* getFeedbackBuffer(int slot) const { return m_feedbackBuffers[slot]; }
+    size_t getResidentBytes() const;
+    size_t getBudgetBytes() const { return m_budgetTiles * m_tileBytes; }
+    // Streamed tile budget, at most the construction budget; tiles past a smaller budget are
+    // unmapped with the next encodeUpdates(). A budget a quarter below the heap's (or above it)
+    // moves the texture to a heap of that size at the next update(): the streamed tiles start over,
+    // and the old heap is released once the frames in flight that sample it have completed.
+    void setBudgetBytes(size_t budgetBytes);
+    size_t getMaxBudgetBytes() const { return m_maxBudgetTiles * m_tileBytes; }
+    size_t getHeapBytes() const { return m_heap ? m_heap->size() : 0; }
+
+private:
+    static constexpr int kMaxFrames = 3;              // Slots of the per-frame buffers
+    static constexpr uint32_t kMaxMapsPerFrame = 64;  // Tiles mapped (and filled) per frame
+    static constexpr uint32_t kPinnedTilesPerSide = 4; // Levels this coarse or coarser stay mapped
+    static constexpr uint32_t kTailPageReserve = 4;   // Heap pages set aside for the mip tail
+
+    struct RetiredHeap {
+        MTL::Heap* heap;
+        MTL::Texture* texture;
+        int framesLeft; // update() calls until no frame in flight samples it
+    };
+
+    uint32_t tileIndex(uint32_t level, uint32_t x, uint32_t y) const;
+    void requestTile(uint32_t level, uint32_t x, uint32_t y); // Marks it and its parents requested this frame
+    void queueMap(uint32_t index);
+    void queuePinnedRegions();
+    void rebuildResidencyMap();
+    size_t findEvictionVictim() const;       // Index into m_residentTiles (its size when none may go)
+    void evictResident(size_t residentIndex);
+    bool createTexture(uint32_t budgetTiles); // Heap for budgetTiles streamed tiles, and the texture in it
+    void rebuildHeap();
+
+    MTL::Device* m_device;
+    const ComputeDispatch* m_dispatch;
+    int m_frameCount;
+    MTL::ComputePipelineState* m_fillPSO;
+    MTL::Heap* m_heap;
+    MTL::Texture* m_texture;
+    MTL::Buffer* m_feedbackBuffers[kMaxFrames];  // uint per streamed tile (shared, cleared after readback)
+    MTL::Buffer* m_residencyBuffers[kMaxFrames]; // SparseGroundUniforms + uchar per level 0 tile
+    MTL::Buffer* m_tileBuffers[kMaxFrames];      // SparseGroundTile list of the slot's fill dispatch
+    int m_slot;                                  // Slot of the last update()
+
+    SparseGroundUniforms m_uniforms;
+    MTL::Size m_tileSize;       // Texels of one sparse tile
+    size_t m_tileBytes;
+    uint32_t m_budgetTiles;     // Streamed tiles that may be mapped at once
+    uint32_t m_heapBudgetTiles; // Budget the current heap was sized for
+    uint32_t m_maxBudgetTiles;  // Construction budget (ceiling of setBudgetBytes())
+    uint32_t m_heapReserveTiles; // Heap pages on top of the budget: pinned levels and the mip tail
+    std::vector<RetiredHeap> m_retiredHeaps;
+    uint32_t m_tailLevel;       // First mip level in the tail (== levelCount without a tail)
+    uint32_t m_firstLevel[SPARSE_GROUND_MAX_LEVELS + 1]; // First tile index of each level below pinnedLevel
+
+    // Streamed tiles, indexed like the feedback buffer
+    std::vector<uint8_t> m_resident;
+    std::vector<uint64_t> m_lastRequested; // update() that last saw the tile (or a finer one under it) requested
+    std::vector<uint32_t> m_residentTiles;
+    uint64_t m_frame;
+
+    std::vector<uint32_t> m_mapQueue;      // Streamed tiles to map and fill next encodeUpdates()
+    std::vector<uint32_t> m_unmapQueue;
+    std::vector<SparseGroundTile> m_pinnedFills; // Pinned regions to (re)fill next encodeUpdates()
+    bool m_pinnedMapped;
+
+    std::vector<uint8_t> m_residencyMap;   // CPU copy: finest resident level per level 0 tile
+    uint64_t m_residencyVersion;
+    uint64_t m_slotResidencyVersion[kMaxFrames];
+};
@@ -0,0 +1,120 @@
+#include "TemporalAntialiasing.hpp"
+#include "ComputeDispatch.hpp"
+#include "RenderTargetHeap.hpp"
+#include "ShaderTypes.h"
+#include <iostream>
+
+// Radical inverse of index in the given base (Halton sequence, values in [0, 1))
+static float halton(uint32_t index, uint32_t base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0) {
+        fraction /= static_cast<float>(base);
+        result += fraction * static_cast<float>(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+TemporalAntialiasing::TemporalAntialiasing(MTL::Device* device, RenderTargetHeap* heap, MTL::PixelFormat colorFormat)
+    : m_device(device)
+    , m_heap(heap)
+    , m_colorFormat(colorFormat)
+    , m_motionTexture(nullptr)
+    , m_history{ nullptr, nullptr }
+    , m_current(0)
+    , m_renderSize(simd::make_uint2(0, 0))
+    , m_prevRenderSize(simd::make_uint2(0, 0))
+    , m_historyValid(false)
+    , m_resolved(false)
+    , m_jitterIndex(0)
+{
+}
+
+TemporalAntialiasing::~TemporalAntialiasing()
+{
+    if (m_motionTexture) {
+        m_motionTexture->release();
+    }
+    for (MTL::Texture* history : m_history) {
+        if (history) {
+            history->release();
+        }
+    }
+}
+
+void TemporalAntialiasing::resize(NS::UInteger width, NS::UInteger height)
+{
+    if (m_motionTexture) {
+        m_motionTexture->release();
+        m_motionTexture = nullptr;
+    }
+    for (MTL::Texture*& history : m_history) {
+        if (history) {
+            history->release();
+            history = nullptr;
+        }
+    }
+    m_historyValid = false;
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setWidth(width);
+    descriptor->setHeight(height);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setPixelFormat(kMotionFormat);
+    descriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+    m_motionTexture = m_heap->newTexture(descriptor);
+
+    // Written by the resolve, sampled (bilinear) by the next frame's
+    descriptor->setPixelFormat(m_colorFormat);
+    descriptor->setUsage(MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite);
+    for (MTL::Texture*& history : m_history) {
+        history = m_heap->newTexture(descriptor);
+    }
+    descriptor->release();
+
+    if (!isAvailable()) {
+        std::cerr << "Failed to create temporal antialiasing targets" << std::endl;
+    }
+}
+
+simd::float2 TemporalAntialiasing::beginFrame(NS::UInteger renderWidth, NS::UInteger renderHeight)
+{
+    // A frame that was not resolved (pipelines still compiling) left no history behind
+    m_historyValid = m_historyValid && m_resolved;
+    m_resolved = false;
+    m_current ^= 1;
+    m_prevRenderSize = m_renderSize;
+    m_renderSize = simd::make_uint2(static_cast<uint32_t>(renderWidth), static_cast<uint32_t>(renderHeight));
+
+    m_jitterIndex = m_jitterIndex % kJitterPhases + 1; // Index 0 would be the unjittered (0, 0)
+    return simd::make_float2(halton(m_jitterIndex, 2) - 0.5f, halton(m_jitterIndex, 3) - 0.5f);
+}
+
+void TemporalAntialiasing::encodeResolve(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline,
+                                         const ComputeDispatch& dispatch, MTL::Texture* color, MTL::Texture* depth)
+{
+    MTL::Texture* history = getHistoryTexture();
+    TemporalResolveUniforms uniforms;
+    uniforms.renderSize = m_renderSize;
+    uniforms.historyScale = simd::make_float2(static_cast<float>(m_prevRenderSize.x) / static_cast<float>(history->width()),
+                                              static_cast<float>(m_prevRenderSize.y) / static_cast<float>(history->height()));
+    uniforms.blend = kBlend;
+    uniforms.historyValid = m_historyValid ? 1 : 0;
+
+    encoder->setComputePipelineState(pipeline);
+    encoder->setTexture(color, TemporalTextureIndexColor);
+    encoder->setTexture(m_motionTexture, TemporalTextureIndexMotion);
+    encoder->setTexture(depth, TemporalTextureIndexDepth);
+    encoder->setTexture(history, TemporalTextureIndexHistory);
+    encoder->setTexture(getOutputTexture(), TemporalTextureIndexOutput);
+    encoder->setBytes(&uniforms, sizeof(uniforms), 0);
+    dispatch.dispatch(encoder, pipeline, MTL::Size::Make(m_renderSize.x, m_renderSize.y, 1));
+
+    m_historyValid = true;
+    m_resolved = true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <simd/simd.h>
+#include <cstdint>
+
+class ComputeDispatch;
+class RenderTargetHeap;
+
+// Temporal antialiasing without MetalFX, a cheaper alternative to the MSAA scene pass at high
+// resolutions: the scene renders one sample per pixel through a subpixel-jittered projection and
+// writes motion vectors (the temporal scene pipelines), and resolveTemporalAntialiasing blends
+// every pixel with last frame's result reprojected along its motion vector, clipped to the
+// pixel's neighbourhood. Two output-sized history targets alternate: last frame's is read while
+// this frame's is written, and the post pass tone maps the latter.
+class TemporalAntialiasing {
+public:
+    static constexpr MTL::PixelFormat kMotionFormat = MTL::PixelFormatRG16Float;
+
+    TemporalAntialiasing(MTL::Device* device, RenderTargetHeap* heap, MTL::PixelFormat colorFormat);
+    ~TemporalAntialiasing();
+
+    // Recreate the history and motion targets for a new output size (the history starts over)
+    void resize(NS::UInteger width, NS::UInteger height);
+
+    // Per frame, before the scene is drawn: swap the history targets for a render region of
+    // renderWidth x renderHeight; returns the jitter offset in render pixels (y down)
+    simd::float2 beginFrame(NS::UInteger renderWidth, NS::UInteger renderHeight);
+    // Resolve the frame's scene color into getOutputTexture() (the motion texture is read too)
+    void encodeResolve(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline,
+                       const ComputeDispatch& dispatch, MTL::Texture* color, MTL::Texture* depth);
+
+    bool isAvailable() const { return m_motionTexture && m_history[0] && m_history[1]; }
+    void resetHistory() { m_historyValid = false; } // Camera cut: the next resolve starts over
+    MTL::Texture* getMotionTexture() const { return m_motionTexture; }
+    MTL::Texture* getHistoryTexture() const { return m_history[m_current ^ 1]; } // Last frame's resolve
+    MTL::Texture* getOutputTexture() const { return m_history[m_current]; }      // This frame's resolve
+
+private:
+    static constexpr uint32_t kJitterPhases = 8;   // Halton(2, 3) cycle length
+    static constexpr float kBlend = 0.1f;          // Weight of the new sample in a still pixel
+
+    MTL::Device* m_device;
+    RenderTargetHeap* m_heap;
+    MTL::PixelFormat m_colorFormat;
+    MTL::Texture* m_motionTexture;  // Scene pass color(1): per-pixel motion in render-UV units
+    MTL::Texture* m_history[2];     // Resolved color, alternating between frames
+    int m_current;                  // History target written this frame
+    simd::uint2 m_renderSize;       // Render region of this frame and the last
+    simd::uint2 m_prevRenderSize;
+    bool m_historyValid;            // The other target holds last frame's resolve
+    bool m_resolved;                // A resolve was encoded since beginFrame()
+    uint32_t m_jitterIndex;
+};
@@ -0,0 +1,125 @@
+#include "TerrainHeightmap.hpp"
+#include "ShaderTypes.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Ground level of the flat field the hills are added to (the original ground plane)
+static constexpr float kBaseHeight = -0.5f;
+
+// PCG hash (matches pcgHash() in GrassGenerate.metal)
+static uint32_t pcgHash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Smooth value noise in [-1, 1] with one lattice cell per unit
+static float valueNoise(float x, float z, uint32_t seed)
+{
+    float ix = std::floor(x);
+    float iz = std::floor(z);
+    float fx = x - ix;
+    float fz = z - iz;
+    float ux = fx * fx * (3.0f - 2.0f * fx);
+    float uz = fz * fz * (3.0f - 2.0f * fz);
+
+    auto lattice = [seed](float cx, float cz) {
+        uint32_t h = pcgHash(static_cast<uint32_t>(static_cast<int32_t>(cx)) ^ pcgHash(static_cast<uint32_t>(static_cast<int32_t>(cz)) ^ seed));
+        return static_cast<float>(h >> 8) * (2.0f / 16777216.0f) - 1.0f;
+    };
+    float a = lattice(ix, iz);
+    float b = lattice(ix + 1.0f, iz);
+    float c = lattice(ix, iz + 1.0f);
+    float d = lattice(ix + 1.0f, iz + 1.0f);
+    float row0 = a + (b - a) * ux;
+    float row1 = c + (d - c) * ux;
+    return row0 + (row1 - row0) * uz;
+}
+
+TerrainHeightmap::TerrainHeightmap(MTL::Device* device, float halfSize, uint32_t seed)
+    : m_halfSize(halfSize)
+    , m_heights(static_cast<size_t>(TERRAIN_HEIGHTMAP_SIZE) * TERRAIN_HEIGHTMAP_SIZE)
+    , m_texture(nullptr)
+{
+    // Three octaves of rolling hills (wavelengths in meters), masked to a flat meadow in the center
+    const float wavelengths[3] = { 14.0f, 6.0f, 2.5f };
+    const float amplitudes[3] = { 0.7f, 0.25f, 0.08f };
+    float spacing = 2.0f * m_halfSize / static_cast<float>(TERRAIN_HEIGHTMAP_SIZE - 1);
+    for (int z = 0; z < TERRAIN_HEIGHTMAP_SIZE; ++z) {
+        for (int x = 0; x < TERRAIN_HEIGHTMAP_SIZE; ++x) {
+            float worldX = -m_halfSize + static_cast<float>(x) * spacing;
+            float worldZ = -m_halfSize + static_cast<float>(z) * spacing;
+
+            float hills = 0.0f;
+            for (int octave = 0; octave < 3; ++octave) {
+                hills += amplitudes[octave] * valueNoise(worldX / wavelengths[octave], worldZ / wavelengths[octave],
+                                                         pcgHash(seed + static_cast<uint32_t>(octave)));
+            }
+            float t = std::clamp((std::sqrt(worldX * worldX + worldZ * worldZ) - 3.0f) / 6.0f, 0.0f, 1.0f);
+            float mask = t * t * (3.0f - 2.0f * t);
+            m_heights[static_cast<size_t>(z) * TERRAIN_HEIGHTMAP_SIZE + x] = kBaseHeight + hills * mask;
+        }
+    }
+
+    // Read with exact texel loads (no filtering), so R32Float keeps the host values bit for bit
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(MTL::PixelFormatR32Float);
+    descriptor->setWidth(TERRAIN_HEIGHTMAP_SIZE);
+    descriptor->setHeight(TERRAIN_HEIGHTMAP_SIZE);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+
+    m_texture = device->newTexture(descriptor);
+    descriptor->release();
+
+    if (!m_texture) {
+        std::cerr << "Failed to create terrain heightmap" << std::endl;
+        return;
+    }
+    m_texture->replaceRegion(MTL::Region::Make2D(0, 0, TERRAIN_HEIGHTMAP_SIZE, TERRAIN_HEIGHTMAP_SIZE), 0,
+                             m_heights.data(), TERRAIN_HEIGHTMAP_SIZE * sizeof(float));
+}
+
+TerrainHeightmap::~TerrainHeightmap()
+{
+    if (m_texture) {
+        m_texture->release();
+    }
+}
+
+float TerrainHeightmap::sample(int x, int z) const
+{
+    x = std::clamp(x, 0, TERRAIN_HEIGHTMAP_SIZE - 1);
+    z = std::clamp(z, 0, TERRAIN_HEIGHTMAP_SIZE - 1);
+    return m_heights[static_cast<size_t>(z) * TERRAIN_HEIGHTMAP_SIZE + x];
+}
+
+float TerrainHeightmap::heightAt(float x, float z) const
+{
+    float scale = static_cast<float>(TERRAIN_HEIGHTMAP_SIZE - 1) / (2.0f * m_halfSize);
+    float gridX = std::clamp((x + m_halfSize) * scale, 0.0f, static_cast<float>(TERRAIN_HEIGHTMAP_SIZE - 1));
+    float gridZ = std::clamp((z + m_halfSize) * scale, 0.0f, static_cast<float>(TERRAIN_HEIGHTMAP_SIZE - 1));
+    int baseX = std::min(static_cast<int>(gridX), TERRAIN_HEIGHTMAP_SIZE - 2);
+    int baseZ = std::min(static_cast<int>(gridZ), TERRAIN_HEIGHTMAP_SIZE - 2);
+    float fx = gridX - static_cast<float>(baseX);
+    float fz = gridZ - static_cast<float>(baseZ);
+
+    float h0 = sample(baseX, baseZ) + (sample(baseX + 1, baseZ) - sample(baseX, baseZ)) * fx;
+    float h1 = sample(baseX, baseZ + 1) + (sample(baseX + 1, baseZ + 1) - sample(baseX, baseZ + 1)) * fx;
+    return h0 + (h1 - h0) * fz;
+}
+
+simd::float2 TerrainHeightmap::heightRange(int firstX, int firstZ, int quads) const
+{
+    simd::float2 range = simd::make_float2(sample(firstX, firstZ), sample(firstX, firstZ));
+    for (int z = firstZ; z <= firstZ + quads; ++z) {
+        for (int x = firstX; x <= firstX + quads; ++x) {
+            float h = sample(x, z);
+            range = simd::make_float2(std::min(range.x, h), std::max(range.y, h));
+        }
+    }
+    return range;
+}
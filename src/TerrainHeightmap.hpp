@@ -0,0 +1,30 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <simd/simd.h>
+#include <cstdint>
+#include <vector>
+
+// Rolling ground under the grass: TERRAIN_HEIGHTMAP_SIZE^2 heights on the corners of the LOD 0
+// terrain grid over [-halfSize, +halfSize]. The same samples are uploaded once (R32Float, read
+// with terrainHeight() in the shaders) and kept on the host, so the CPU fallback, the impostor
+// bake and the interactors place things on exactly the surface the GPU draws and plants.
+// The hills fade out toward the field center, leaving a flat meadow around the start view.
+class TerrainHeightmap {
+public:
+    TerrainHeightmap(MTL::Device* device, float halfSize, uint32_t seed);
+    ~TerrainHeightmap();
+
+    MTL::Texture* getMetalTexture() const { return m_texture; }
+
+    // Ground height at a world XZ position (matches terrainHeight() in the shaders)
+    float heightAt(float x, float z) const;
+    // Min / max height over the samples of a square of the grid (e.g. one chunk / grass cell)
+    simd::float2 heightRange(int firstX, int firstZ, int quads) const;
+
+private:
+    float sample(int x, int z) const;
+
+    float m_halfSize;              // Field spans [-halfSize, +halfSize] on X and Z
+    std::vector<float> m_heights;  // Row-major, z rows of x samples
+    MTL::Texture* m_texture;
+};
@@ -91,6 +91,14 @@ Texture::Texture(MTL::Device* device, MTL::CommandQueue* commandQueue, const std
     descriptor->release();
 }
 
+Texture::Texture(MTL::Texture* texture)
+    : m_texture(texture)
+    , m_width(texture ? static_cast<int>(texture->width()) : 0)
+    , m_height(texture ? static_cast<int>(texture->height()) : 0)
+    , m_channels(4)
+{
+}
+
 Texture::~Texture()
 {
     if (m_texture) {
@@ -98,3 +106,15 @@ Texture::~Texture()
     }
 }
 
+void Texture::replace(MTL::Texture* texture, int width, int height)
+{
+    // Frames in flight keep the old texture alive (their command buffers retain it)
+    if (m_texture) {
+        m_texture->release();
+    }
+    m_texture = texture;
+    m_width = width;
+    m_height = height;
+    m_channels = 4;
+}
+
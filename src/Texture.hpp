@@ -5,11 +5,16 @@
 class Texture {
 public:
     Texture(MTL::Device* device, MTL::CommandQueue* commandQueue, const std::string& filepath);
+    explicit Texture(MTL::Texture* texture); // Takes ownership (e.g. a TextureLoader placeholder)
     ~Texture();
 
+    // The placeholder until a TextureLoader swaps the real texture in (fetch it every frame)
     MTL::Texture* getMetalTexture() const { return m_texture; }
 
 private:
+    friend class TextureLoader;
+    void replace(MTL::Texture* texture, int width, int height); // Takes ownership, releases the old one
+
     MTL::Texture* m_texture;
     int m_width, m_height, m_channels;
-};
\ No newline at end of file
+};
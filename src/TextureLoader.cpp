@@ -0,0 +1,421 @@
+#include "TextureLoader.hpp"
+#include "Texture.hpp"
+#include "UploadRing.hpp"
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+TextureLoader::TextureLoader(MTL::Device* device, MTL::CommandQueue* commandQueue, UploadRing* uploadRing, JobSystem* jobs)
+    : m_device(device)
+    , m_commandQueue(commandQueue)
+    , m_uploadRing(uploadRing)
+    , m_ioQueue(nullptr)
+    , m_jobs(jobs)
+    , m_decoding(0)
+    , m_stopping(false)
+{
+    // Fast resource loading (Metal 3 GPUs, macOS 13+): KTX2 levels stream from the file into the
+    // texture without a CPU read, decode or staging copy
+    if (m_device->supportsFamily(MTL::GPUFamilyMetal3)) {
+        MTL::IOCommandQueueDescriptor* descriptor = MTL::IOCommandQueueDescriptor::alloc()->init();
+        descriptor->setType(MTL::IOCommandQueueTypeConcurrent);
+        descriptor->setPriority(MTL::IOPriorityNormal);
+        NS::Error* error = nullptr;
+        m_ioQueue = m_device->newIOCommandQueue(descriptor, &error);
+        descriptor->release();
+        if (!m_ioQueue) {
+            std::cerr << "Failed to create IO command queue";
+            if (error) {
+                std::cerr << " - " << error->localizedDescription()->utf8String();
+            }
+            std::cerr << std::endl;
+        }
+    }
+}
+
+TextureLoader::~TextureLoader()
+{
+    // Queued jobs find no request left; running ones finish their file
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_requests.clear();
+    }
+    if (m_jobs) {
+        m_jobs->wait(m_decodeJobs);
+    }
+
+    // Decoded but never uploaded
+    for (Decoded& decoded : m_decoded) {
+        if (decoded.pixels) {
+            stbi_image_free(decoded.pixels);
+        }
+        if (decoded.streamed) {
+            decoded.streamed->release();
+        }
+    }
+    if (m_ioQueue) {
+        m_ioQueue->release();
+    }
+}
+
+Texture* TextureLoader::load(const std::vector<std::string>& candidatePaths, uint32_t placeholderRGBA, LoadedCallback onLoaded)
+{
+    Texture* texture = new Texture(newPlaceholder(placeholderRGBA));
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back({ candidatePaths, texture, onLoaded });
+    }
+    if (m_jobs) {
+        m_jobs->run([this] { decodeNext(); }, &m_decodeJobs, nullptr, true);
+    } else {
+        decodeNext();
+    }
+    return texture;
+}
+
+void TextureLoader::decodeNext()
+{
+    Request request;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || m_requests.empty()) {
+            return;
+        }
+        request = std::move(m_requests.front());
+        m_requests.pop_front();
+        ++m_decoding;
+    }
+
+    // stbi_load is reentrant; force 4 channels (RGBA) like Texture does. The job's
+    // autoreleased Metal objects (IO command buffers, URLs) drain with each request.
+    NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+    Decoded decoded = { std::move(request), nullptr, 0, 0, {}, nullptr };
+    for (const std::string& path : decoded.request.candidatePaths) {
+        bool lz4 = hasSuffix(path, ".ktx2.lz4");
+        if (lz4 || (m_ioQueue && hasSuffix(path, ".ktx2"))) {
+            if (!m_ioQueue) {
+                continue; // IO-compressed files need fast resource loading: try the next candidate
+            }
+            if (streamKtx2(path, lz4, decoded)) {
+                break;
+            }
+            continue;
+        }
+        if (hasSuffix(path, ".ktx2")) {
+            std::string error;
+            if (!Ktx2::read(path, decoded.compressed, error)) {
+                std::cerr << "Failed to load KTX2 texture: " << error << std::endl;
+            } else if (!supportsFormat(decoded.compressed.format)) {
+                std::cerr << "KTX2 format of " << path << " is not supported by this GPU, trying the next candidate" << std::endl;
+            } else {
+                decoded.width = static_cast<int>(decoded.compressed.levels[0].width);
+                decoded.height = static_cast<int>(decoded.compressed.levels[0].height);
+                break;
+            }
+            decoded.compressed = {};
+            continue;
+        }
+        int channels = 0;
+        decoded.pixels = stbi_load(path.c_str(), &decoded.width, &decoded.height, &channels, 4);
+        if (decoded.pixels) {
+            break;
+        }
+        std::cerr << "Failed to load image: " << path;
+        if (stbi_failure_reason()) {
+            std::cerr << " - " << stbi_failure_reason();
+        }
+        std::cerr << std::endl;
+    }
+    pool->release();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoded.push_back(std::move(decoded));
+        --m_decoding;
+    }
+    m_decodeFinished.notify_all();
+}
+
+void TextureLoader::update()
+{
+    std::vector<Decoded> batch;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        batch.swap(m_decoded);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    // One command buffer uploads the whole batch through the staging ring and generates its mips
+    MTL::CommandBuffer* commandBuffer = m_commandQueue ? m_commandQueue->commandBuffer() : nullptr;
+    MTL::BlitCommandEncoder* blitEncoder = commandBuffer ? commandBuffer->blitCommandEncoder() : nullptr;
+    std::vector<std::pair<Decoded*, MTL::Texture*>> uploaded;
+    std::vector<Decoded*> failed;
+    if (!blitEncoder) {
+        std::cerr << "Failed to create texture upload command buffer" << std::endl;
+    }
+
+    for (Decoded& decoded : batch) {
+        if (decoded.streamed) {
+            uploaded.push_back({ &decoded, decoded.streamed }); // Already resident, nothing to blit
+            decoded.streamed = nullptr;
+            continue;
+        }
+        if (!decoded.compressed.levels.empty()) {
+            MTL::Texture* texture = blitEncoder ? newCompressedTexture(blitEncoder, decoded.compressed) : nullptr;
+            if (!texture) {
+                std::cerr << "Failed to create Metal texture for " << decoded.request.candidatePaths.front() << std::endl;
+                failed.push_back(&decoded);
+            } else {
+                uploaded.push_back({ &decoded, texture });
+            }
+            decoded.compressed = {};
+            continue;
+        }
+        if (!decoded.pixels) {
+            failed.push_back(&decoded); // Every candidate failed (logged by the worker): keep the placeholder
+            continue;
+        }
+
+        // Linear RGBA8 (alpha masks must not be color-corrected) with a full mip chain, in
+        // private storage so it keeps lossless compression
+        int maxDimension = std::max(decoded.width, decoded.height);
+        int mipmapLevelCount = static_cast<int>(std::floor(std::log2(static_cast<double>(maxDimension)))) + 1;
+        MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+        descriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+        descriptor->setWidth(decoded.width);
+        descriptor->setHeight(decoded.height);
+        descriptor->setMipmapLevelCount(mipmapLevelCount);
+        descriptor->setTextureType(MTL::TextureType2D);
+        descriptor->setUsage(MTL::TextureUsageShaderRead);
+        descriptor->setStorageMode(MTL::StorageModePrivate);
+        MTL::Texture* texture = blitEncoder ? m_device->newTexture(descriptor) : nullptr;
+        descriptor->release();
+
+        if (!texture) {
+            std::cerr << "Failed to create Metal texture for " << decoded.request.candidatePaths.front() << std::endl;
+            failed.push_back(&decoded);
+        } else {
+            m_uploadRing->uploadTexture(blitEncoder, texture, 0, MTL::Region::Make2D(0, 0, decoded.width, decoded.height),
+                                        decoded.pixels, decoded.width * 4, decoded.height);
+            if (mipmapLevelCount > 1) {
+                blitEncoder->generateMipmaps(texture);
+            }
+            uploaded.push_back({ &decoded, texture });
+        }
+        stbi_image_free(decoded.pixels);
+        decoded.pixels = nullptr;
+    }
+
+    if (blitEncoder) {
+        blitEncoder->endEncoding();
+    }
+    if (commandBuffer) {
+        m_uploadRing->commit(commandBuffer);
+        commandBuffer->commit();
+    }
+
+    // Later frames are committed after the upload and mip blits, so the textures can be used right away
+    for (auto& [decoded, texture] : uploaded) {
+        decoded->request.texture->replace(texture, decoded->width, decoded->height);
+        if (decoded->request.onLoaded) {
+            decoded->request.onLoaded(decoded->request.texture, true);
+        }
+    }
+    for (Decoded* decoded : failed) {
+        if (decoded->request.onLoaded) {
+            decoded->request.onLoaded(decoded->request.texture, false);
+        }
+    }
+}
+
+void TextureLoader::waitUntilLoaded()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool finished = m_decodeFinished.wait_for(lock, std::chrono::duration<double>(kWaitTimeoutSeconds),
+                                                  [this] { return m_requests.empty() && m_decoding == 0; });
+        if (!finished) {
+            std::cerr << "Textures still loading after " << kWaitTimeoutSeconds << " s, continuing with their placeholders" << std::endl;
+        }
+    }
+    update();
+}
+
+bool TextureLoader::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests.empty() && m_decoding == 0 && m_decoded.empty();
+}
+
+bool TextureLoader::supportsFormat(Ktx2::Format format) const
+{
+    switch (format) {
+        case Ktx2::FormatRGBA8Unorm:
+            return true;
+        case Ktx2::FormatBC1RGBAUnorm:
+        case Ktx2::FormatBC3Unorm:
+            return m_device->supportsBCTextureCompression();
+        case Ktx2::FormatASTC4x4Unorm:
+            return m_device->supportsFamily(MTL::GPUFamilyApple2);
+    }
+    return false;
+}
+
+bool TextureLoader::hasSuffix(const std::string& path, const char* suffix)
+{
+    size_t length = std::strlen(suffix);
+    return path.size() > length && path.compare(path.size() - length, length, suffix) == 0;
+}
+
+bool TextureLoader::streamKtx2(const std::string& path, bool lz4, Decoded& decoded)
+{
+    NS::Error* error = nullptr;
+    NS::URL* url = NS::URL::fileURLWithPath(NS::String::string(path.c_str(), NS::UTF8StringEncoding));
+    MTL::IOFileHandle* handle = lz4 ? m_device->newIOHandle(url, MTL::IOCompressionMethodLZ4, &error)
+                                    : m_device->newIOHandle(url, &error);
+    if (!handle) {
+        std::cerr << "Failed to open " << path;
+        if (error) {
+            std::cerr << " - " << error->localizedDescription()->utf8String();
+        }
+        std::cerr << std::endl;
+        return false;
+    }
+
+    // Header, then header plus level index: two small blocking reads on this worker
+    std::vector<uint8_t> index(Ktx2::HeaderSize);
+    bool loaded = readBytes(handle, index.data(), index.size());
+    size_t indexSize = loaded ? Ktx2::indexSize(index.data()) : 0;
+    if (indexSize > index.size()) {
+        index.resize(indexSize);
+        loaded = readBytes(handle, index.data(), index.size());
+    }
+
+    Ktx2::Format format = Ktx2::FormatRGBA8Unorm;
+    std::vector<Ktx2::Level> levels;
+    std::string parseError;
+    MTL::Texture* texture = nullptr;
+    if (!loaded || !Ktx2::parseIndex(index.data(), index.size(), format, levels, parseError)) {
+        std::cerr << "Failed to load KTX2 texture: " << path << (parseError.empty() ? "" : " - " + parseError) << std::endl;
+    } else if (!supportsFormat(format)) {
+        std::cerr << "KTX2 format of " << path << " is not supported by this GPU, trying the next candidate" << std::endl;
+    } else {
+        texture = newLevelTexture(format, levels[0].width, levels[0].height, levels.size());
+    }
+
+    // Every level straight from the file (decompressed by the IO queue) into private storage
+    if (texture) {
+        MTL::IOCommandBuffer* commandBuffer = m_ioQueue->commandBuffer();
+        for (size_t level = 0; level < levels.size(); ++level) {
+            const Ktx2::Level& mip = levels[level];
+            commandBuffer->loadTexture(texture, 0, level, MTL::Size(mip.width, mip.height, 1),
+                                       Ktx2::bytesPerRow(format, mip.width), mip.size, MTL::Origin(0, 0, 0), handle, mip.offset);
+        }
+        if (!waitForIO(commandBuffer)) {
+            std::cerr << "Failed to stream KTX2 texture: " << path << std::endl;
+            texture->release();
+            texture = nullptr;
+        }
+    }
+    handle->release();
+
+    if (!texture) {
+        return false;
+    }
+    decoded.streamed = texture;
+    decoded.width = static_cast<int>(levels[0].width);
+    decoded.height = static_cast<int>(levels[0].height);
+    return true;
+}
+
+bool TextureLoader::readBytes(MTL::IOFileHandle* handle, void* destination, size_t size)
+{
+    MTL::IOCommandBuffer* commandBuffer = m_ioQueue->commandBuffer();
+    commandBuffer->loadBytes(destination, size, handle, 0);
+    return waitForIO(commandBuffer);
+}
+
+bool TextureLoader::waitForIO(MTL::IOCommandBuffer* commandBuffer)
+{
+    // Polled with a deadline (waitUntilCompleted has none): a stuck read is cancelled and the
+    // candidate fails; the cancel completes the buffer, so the destination is free afterwards
+    commandBuffer->commit();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(kIOTimeoutSeconds);
+    while (commandBuffer->status() == MTL::IOStatusPending) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "IO read timed out after " << kIOTimeoutSeconds << " s, cancelling it" << std::endl;
+            commandBuffer->tryCancel();
+            commandBuffer->waitUntilCompleted();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return commandBuffer->status() == MTL::IOStatusComplete;
+}
+
+MTL::Texture* TextureLoader::newLevelTexture(Ktx2::Format format, uint32_t width, uint32_t height, size_t levelCount)
+{
+    MTL::PixelFormat pixelFormat = MTL::PixelFormatRGBA8Unorm;
+    switch (format) {
+        case Ktx2::FormatRGBA8Unorm:   pixelFormat = MTL::PixelFormatRGBA8Unorm; break;
+        case Ktx2::FormatBC1RGBAUnorm: pixelFormat = MTL::PixelFormatBC1_RGBA; break;
+        case Ktx2::FormatBC3Unorm:     pixelFormat = MTL::PixelFormatBC3_RGBA; break;
+        case Ktx2::FormatASTC4x4Unorm: pixelFormat = MTL::PixelFormatASTC_4x4_LDR; break;
+    }
+
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(pixelFormat);
+    descriptor->setWidth(width);
+    descriptor->setHeight(height);
+    descriptor->setMipmapLevelCount(levelCount);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModePrivate);
+    MTL::Texture* texture = m_device->newTexture(descriptor);
+    descriptor->release();
+    return texture;
+}
+
+MTL::Texture* TextureLoader::newCompressedTexture(MTL::BlitCommandEncoder* blitEncoder, const Ktx2::Image& image)
+{
+    // The mips come from the file: blocks are staged and blitted as-is, nothing is generated on the GPU
+    MTL::Texture* texture = newLevelTexture(image.format, image.levels[0].width, image.levels[0].height, image.levels.size());
+    if (!texture) {
+        return nullptr;
+    }
+
+    for (size_t level = 0; level < image.levels.size(); ++level) {
+        const Ktx2::Level& mip = image.levels[level];
+        size_t bytesPerRow = Ktx2::bytesPerRow(image.format, mip.width);
+        m_uploadRing->uploadTexture(blitEncoder, texture, level, MTL::Region::Make2D(0, 0, mip.width, mip.height),
+                                    image.data.data() + mip.offset, bytesPerRow, mip.size / bytesPerRow);
+    }
+    return texture;
+}
+
+MTL::Texture* TextureLoader::newPlaceholder(uint32_t rgba)
+{
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::alloc()->init();
+    descriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    descriptor->setWidth(1);
+    descriptor->setHeight(1);
+    descriptor->setTextureType(MTL::TextureType2D);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(MTL::StorageModeShared);
+    MTL::Texture* placeholder = m_device->newTexture(descriptor);
+    descriptor->release();
+
+    if (!placeholder) {
+        std::cerr << "Failed to create placeholder texture" << std::endl;
+        return nullptr;
+    }
+    placeholder->replaceRegion(MTL::Region::Make2D(0, 0, 1, 1), 0, &rgba, sizeof(rgba));
+    return placeholder;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "JobSystem.hpp"
+#include "Ktx2.hpp"
+#include <Metal/Metal.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Texture;
+class UploadRing;
+
+// Asynchronous image textures: files are decoded as background jobs of the JobSystem while the caller
+// keeps going, and every Texture handed out starts as a 1x1 placeholder. update() (render
+// thread, once per frame) creates the decoded textures in private storage, uploads them through
+// the UploadRing and generates the mips of the whole batch in one command buffer, then swaps them
+// into their Texture objects; the queue orders the blits before any later frame, so nothing
+// waits for the GPU. Startup cost no longer grows with
+// the number of assets: decodes run in parallel and the renderer never blocks on them.
+// Candidates ending in .ktx2 (see vegetation_texconv) are uploaded as-is, GPU-compressed with
+// their pre-baked mips; one in a format the device cannot sample is skipped for the next. With
+// fast resource loading (MTLIOCommandQueue) they stream from the file straight into the texture,
+// and .ktx2.lz4 candidates (IO-compressed, decompressed by the queue) are accepted too.
+// Every request ends: a load that fails (or an IO read that outlives kIOTimeoutSeconds) still
+// reports back, with loaded false, so nothing waits on it forever.
+class TextureLoader {
+public:
+    typedef std::function<void(Texture* texture, bool loaded)> LoadedCallback;
+
+    TextureLoader(MTL::Device* device, MTL::CommandQueue* commandQueue, UploadRing* uploadRing, JobSystem* jobs);
+    ~TextureLoader(); // Waits for the decodes already running
+
+    // Texture showing placeholderRGBA (packed 0xAABBGGRR) until the first candidate path that
+    // decodes is uploaded; the caller owns it. onLoaded runs inside update() after the swap.
+    // If no candidate loads, the error is logged, the placeholder stays and onLoaded gets false.
+    Texture* load(const std::vector<std::string>& candidatePaths, uint32_t placeholderRGBA, LoadedCallback onLoaded = nullptr);
+
+    void update();            // Upload and swap in every finished decode (render thread)
+    void waitUntilLoaded();   // Block until every requested file is decoded (kWaitTimeoutSeconds at most), then update()
+    bool isIdle() const;      // Nothing left to decode or upload
+
+private:
+    static constexpr double kIOTimeoutSeconds = 10.0;   // One IO command buffer; cancelled and failed after
+    static constexpr double kWaitTimeoutSeconds = 30.0; // waitUntilLoaded() gives up and keeps the placeholders
+
+    struct Request {
+        std::vector<std::string> candidatePaths;
+        Texture* texture;
+        LoadedCallback onLoaded;
+    };
+    struct Decoded {
+        Request request;
+        unsigned char* pixels; // RGBA8 from stbi_load (nullptr for KTX2 or when every candidate failed)
+        int width;
+        int height;
+        Ktx2::Image compressed; // Levels of a KTX2 candidate read on the CPU (empty otherwise)
+        MTL::Texture* streamed; // KTX2 candidate already loaded by the IO queue
+    };
+
+    void decodeNext(); // One background job per request
+    bool supportsFormat(Ktx2::Format format) const;
+    static bool hasSuffix(const std::string& path, const char* suffix);
+    bool streamKtx2(const std::string& path, bool lz4, Decoded& decoded); // Blocks the job until resident
+    bool readBytes(MTL::IOFileHandle* handle, void* destination, size_t size);
+    bool waitForIO(MTL::IOCommandBuffer* commandBuffer); // Commits it; false on error or timeout
+    MTL::Texture* newLevelTexture(Ktx2::Format format, uint32_t width, uint32_t height, size_t levelCount);
+    MTL::Texture* newCompressedTexture(MTL::BlitCommandEncoder* blitEncoder, const Ktx2::Image& image);
+    MTL::Texture* newPlaceholder(uint32_t rgba);
+
+    MTL::Device* m_device;
+    MTL::CommandQueue* m_commandQueue;
+    UploadRing* m_uploadRing;
+    MTL::IOCommandQueue* m_ioQueue;            // Fast resource loading (nullptr when unsupported)
+    JobSystem* m_jobs;
+    JobSystem::Counter m_decodeJobs;           // Queued and running decodes
+    mutable std::mutex m_mutex;
+    std::condition_variable m_decodeFinished;  // waitUntilLoaded() waits for results
+    std::deque<Request> m_requests;            // Waiting for a job
+    std::vector<Decoded> m_decoded;            // Waiting for update()
+    int m_decoding;                            // Requests a job is decoding right now
+    bool m_stopping;
+};
@@ -0,0 +1,254 @@
+#include "TextureReadback.hpp"
+#include <CoreGraphics/CoreGraphics.h>
+#include <ImageIO/ImageIO.h>
+#include <algorithm>
+#include <iostream>
+
+TextureReadback::TextureReadback(MTL::Device* device, JobSystem* jobSystem)
+    : m_device(device)
+    , m_jobSystem(jobSystem)
+    , m_buffersInUse(0)
+{
+}
+
+TextureReadback::~TextureReadback()
+{
+    m_jobSystem->wait(m_callbacks);
+    for (MTL::Buffer* buffer : m_buffers) {
+        buffer->release();
+    }
+}
+
+size_t TextureReadback::bytesPerPixel(MTL::PixelFormat format)
+{
+    switch (format) {
+        case MTL::PixelFormatR8Unorm:
+            return 1;
+        case MTL::PixelFormatR16Float:
+            return 2;
+        case MTL::PixelFormatBGRA8Unorm:
+        case MTL::PixelFormatBGRA8Unorm_sRGB:
+        case MTL::PixelFormatRGBA8Unorm:
+        case MTL::PixelFormatRGBA8Unorm_sRGB:
+        case MTL::PixelFormatRG16Float:
+        case MTL::PixelFormatR32Float:
+        case MTL::PixelFormatDepth32Float:
+            return 4;
+        case MTL::PixelFormatRGBA16Float:
+        case MTL::PixelFormatRG32Float:
+            return 8;
+        case MTL::PixelFormatRGBA32Float:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool TextureReadback::encode(MTL::BlitCommandEncoder* blitEncoder, MTL::Texture* texture, NS::UInteger level, Callback callback)
+{
+    size_t pixelBytes = texture ? bytesPerPixel(texture->pixelFormat()) : 0;
+    if (!texture || pixelBytes == 0 || level >= texture->mipmapLevelCount() || texture->sampleCount() > 1 ||
+        texture->storageMode() == MTL::StorageModeMemoryless || texture->framebufferOnly()) {
+        std::cerr << "Readback: texture " << (texture && texture->label() ? texture->label()->utf8String() : "")
+                  << " cannot be copied to the CPU" << std::endl;
+        return false;
+    }
+
+    ReadbackImage image;
+    image.data = nullptr;
+    image.width = static_cast<uint32_t>(std::max<NS::UInteger>(texture->width() >> level, 1));
+    image.height = static_cast<uint32_t>(std::max<NS::UInteger>(texture->height() >> level, 1));
+    image.bytesPerRow = image.width * pixelBytes;
+    image.pixelFormat = texture->pixelFormat();
+    int slot = acquireBuffer(image.bytesPerRow * image.height);
+    if (slot < 0) {
+        std::cerr << "Readback: failed to allocate " << image.bytesPerRow * image.height << " staging bytes" << std::endl;
+        return false;
+    }
+
+    MTL::Buffer* buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer = m_buffers[slot];
+    }
+    blitEncoder->copyFromTexture(texture, 0, level, MTL::Origin::Make(0, 0, 0), MTL::Size::Make(image.width, image.height, 1),
+                                 buffer, 0, image.bytesPerRow, image.bytesPerRow * image.height);
+    m_encoded.push_back({ slot, buffer, image, std::move(callback) });
+    return true;
+}
+
+void TextureReadback::submit(MTL::CommandBuffer* commandBuffer)
+{
+    if (m_encoded.empty()) {
+        return;
+    }
+    std::vector<Pending> pending;
+    pending.swap(m_encoded);
+
+    // The completion handler only queues the callbacks: encoding files there would hold up the
+    // handlers of later frames
+    commandBuffer->addCompletedHandler([this, pending](MTL::CommandBuffer* completed) {
+        bool ok = completed->status() == MTL::CommandBufferStatusCompleted;
+        for (const Pending& readback : pending) {
+            if (!ok) {
+                releaseBuffer(readback.slot);
+                continue;
+            }
+            m_jobSystem->run([this, readback]() {
+                ReadbackImage image = readback.image;
+                image.data = readback.buffer->contents();
+                readback.callback(image);
+                releaseBuffer(readback.slot);
+            }, &m_callbacks, nullptr, true);
+        }
+        if (!ok) {
+            std::cerr << "Readback: command buffer failed, " << pending.size() << " readbacks dropped" << std::endl;
+        }
+    });
+}
+
+size_t TextureReadback::getPoolBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for (MTL::Buffer* buffer : m_buffers) {
+        bytes += buffer->length();
+    }
+    return bytes;
+}
+
+int TextureReadback::acquireBuffer(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Smallest free buffer that fits; repeated captures of the same targets reuse theirs
+    int best = -1;
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        if (!m_bufferInUse[i] && m_buffers[i]->length() >= bytes &&
+            (best < 0 || m_buffers[i]->length() < m_buffers[best]->length())) {
+            best = static_cast<int>(i);
+        }
+    }
+    if (best < 0) {
+        MTL::Buffer* buffer = m_device->newBuffer(bytes, MTL::ResourceStorageModeShared);
+        if (!buffer) {
+            return -1;
+        }
+        buffer->setLabel(NS::String::string("Readback staging", NS::UTF8StringEncoding));
+        m_buffers.push_back(buffer);
+        m_bufferInUse.push_back(false);
+        best = static_cast<int>(m_buffers.size() - 1);
+    }
+    m_bufferInUse[best] = true;
+    m_buffersInUse++;
+    return best;
+}
+
+void TextureReadback::releaseBuffer(int slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bufferInUse[slot] = false;
+        m_buffersInUse--;
+    }
+    m_bufferReleased.notify_all();
+}
+
+void TextureReadback::waitForBuffers(size_t maxInUse)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_bufferReleased.wait(lock, [this, maxInUse]() { return m_buffersInUse < std::max<size_t>(maxInUse, 1); });
+}
+
+void TextureReadback::waitForCallbacks()
+{
+    m_jobSystem->wait(m_callbacks);
+}
+
+const char* readbackImageExtension(MTL::PixelFormat format)
+{
+    switch (format) {
+        case MTL::PixelFormatBGRA8Unorm:
+        case MTL::PixelFormatBGRA8Unorm_sRGB:
+        case MTL::PixelFormatRGBA8Unorm:
+        case MTL::PixelFormatRGBA8Unorm_sRGB:
+            return ".png";
+        case MTL::PixelFormatRGBA16Float:
+        case MTL::PixelFormatR32Float:
+        case MTL::PixelFormatDepth32Float:
+            return ".exr";
+        default:
+            return "";
+    }
+}
+
+bool writeReadbackImage(const ReadbackImage& image, const std::string& path)
+{
+    // Pixel layout of the formats ImageIO can take as they are
+    size_t bitsPerComponent = 0;
+    size_t bitsPerPixel = 0;
+    CGBitmapInfo bitmapInfo = 0;
+    CFStringRef colorSpaceName = nullptr;
+    CFStringRef type = nullptr;
+    switch (image.pixelFormat) {
+        case MTL::PixelFormatBGRA8Unorm:
+        case MTL::PixelFormatBGRA8Unorm_sRGB:
+            bitsPerComponent = 8;
+            bitsPerPixel = 32;
+            bitmapInfo = kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst;
+            colorSpaceName = kCGColorSpaceSRGB;
+            type = CFSTR("public.png");
+            break;
+        case MTL::PixelFormatRGBA8Unorm:
+        case MTL::PixelFormatRGBA8Unorm_sRGB:
+            bitsPerComponent = 8;
+            bitsPerPixel = 32;
+            bitmapInfo = kCGBitmapByteOrderDefault | kCGImageAlphaNoneSkipLast;
+            colorSpaceName = kCGColorSpaceSRGB;
+            type = CFSTR("public.png");
+            break;
+        case MTL::PixelFormatRGBA16Float:
+            bitsPerComponent = 16;
+            bitsPerPixel = 64;
+            bitmapInfo = kCGBitmapFloatComponents | kCGBitmapByteOrder16Little | kCGImageAlphaNoneSkipLast;
+            colorSpaceName = kCGColorSpaceExtendedLinearSRGB;
+            type = CFSTR("com.ilm.openexr-image");
+            break;
+        case MTL::PixelFormatR32Float:
+        case MTL::PixelFormatDepth32Float:
+            bitsPerComponent = 32;
+            bitsPerPixel = 32;
+            bitmapInfo = kCGBitmapFloatComponents | kCGBitmapByteOrder32Little | kCGImageAlphaNone;
+            colorSpaceName = kCGColorSpaceLinearGray;
+            type = CFSTR("com.ilm.openexr-image");
+            break;
+        default:
+            std::cerr << "Readback: no image encoding for pixel format " << image.pixelFormat << std::endl;
+            return false;
+    }
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(colorSpaceName);
+    CGDataProviderRef provider = CGDataProviderCreateWithData(nullptr, image.data, image.bytesPerRow * image.height, nullptr);
+    CGImageRef cgImage = CGImageCreate(image.width, image.height, bitsPerComponent, bitsPerPixel, image.bytesPerRow, colorSpace,
+                                       bitmapInfo, provider, nullptr, false, kCGRenderingIntentDefault);
+    CFURLRef url = CFURLCreateFromFileSystemRepresentation(nullptr, reinterpret_cast<const UInt8*>(path.c_str()),
+                                                           static_cast<CFIndex>(path.size()), false);
+    CGImageDestinationRef destination = (cgImage && url) ? CGImageDestinationCreateWithURL(url, type, 1, nullptr) : nullptr;
+    bool ok = false;
+    if (destination) {
+        CGImageDestinationAddImage(destination, cgImage, nullptr);
+        ok = CGImageDestinationFinalize(destination);
+        CFRelease(destination);
+    }
+    if (url) {
+        CFRelease(url);
+    }
+    if (cgImage) {
+        CGImageRelease(cgImage);
+    }
+    CGDataProviderRelease(provider);
+    CGColorSpaceRelease(colorSpace);
+    if (!ok) {
+        std::cerr << "Readback: failed to write " << path << std::endl;
+    }
+    return ok;
+}
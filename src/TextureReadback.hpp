@@ -0,0 +1,72 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "JobSystem.hpp"
+
+// Pixels of one texture level, tightly packed rows in the texture's own format
+struct ReadbackImage {
+    const void* data;
+    uint32_t width;
+    uint32_t height;
+    size_t bytesPerRow;
+    MTL::PixelFormat pixelFormat;
+};
+
+// Asynchronous texture readback: encode() blits a texture level into a pooled shared buffer on
+// the frame's own command buffer, and once that command buffer completes the callback runs on a
+// background job with a CPU pointer to the pixels; the buffer goes back to the pool when the
+// callback returns. Nothing waits on the GPU, so screenshots and debug dumps (including their
+// file encoding, done in the callback) never hitch a frame.
+class TextureReadback {
+public:
+    typedef std::function<void(const ReadbackImage& image)> Callback; // image.data valid during the call only
+
+    TextureReadback(MTL::Device* device, JobSystem* jobSystem);
+    ~TextureReadback(); // After the GPU finished the submitted frames: waits for their callbacks
+
+    // Copy level of texture on blitEncoder; false (and no callback) for formats without a plain
+    // CPU layout (compressed, multisampled, memoryless or framebuffer-only textures)
+    bool encode(MTL::BlitCommandEncoder* blitEncoder, MTL::Texture* texture, NS::UInteger level, Callback callback);
+    // Before the command buffer holding the blits is committed: arms their callbacks
+    void submit(MTL::CommandBuffer* commandBuffer);
+    // Block while maxInUse or more staging buffers are still waiting for (or in) their callbacks:
+    // bounds how far a producer of readbacks runs ahead of slow callbacks
+    void waitForBuffers(size_t maxInUse);
+    // Block until the callbacks of every completed readback have returned
+    void waitForCallbacks();
+
+    size_t getPoolBytes() const;
+
+    static size_t bytesPerPixel(MTL::PixelFormat format); // 0 = not read back
+
+private:
+    struct Pending {
+        int slot;
+        MTL::Buffer* buffer; // Taken here: the pool vector may grow while a worker reads
+        ReadbackImage image;
+        Callback callback;
+    };
+
+    int acquireBuffer(size_t bytes);
+    void releaseBuffer(int slot);
+
+    MTL::Device* m_device;
+    JobSystem* m_jobSystem;
+    JobSystem::Counter m_callbacks;      // Callback jobs queued and not finished yet
+    mutable std::mutex m_mutex;          // Guards the pool (released from worker threads)
+    std::vector<MTL::Buffer*> m_buffers; // Shared staging buffers, kept for later readbacks
+    std::vector<bool> m_bufferInUse;
+    size_t m_buffersInUse;
+    std::condition_variable m_bufferReleased;
+    std::vector<Pending> m_encoded;      // Encoded since the last submit()
+};
+
+// Extension for writeReadbackImage: ".png" for 8-bit color, ".exr" for float formats, "" otherwise
+const char* readbackImageExtension(MTL::PixelFormat format);
+// Encode image into path with ImageIO (8-bit PNG, or half / float OpenEXR); call from a worker
+bool writeReadbackImage(const ReadbackImage& image, const std::string& path);
@@ -0,0 +1,117 @@
+#include "TraceRecorder.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <time.h>
+
+TraceRecorder::TraceRecorder(size_t capacity)
+    : m_enabled(false)
+    , m_events(std::max<size_t>(capacity, 1))
+    , m_recorded(0)
+{
+}
+
+uint64_t TraceRecorder::now()
+{
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+uint32_t TraceRecorder::currentTrack()
+{
+    static std::atomic<uint32_t> s_nextTrack(1);
+    static thread_local uint32_t t_track = 0;
+    if (t_track == 0) {
+        t_track = s_nextTrack.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t_track;
+}
+
+void TraceRecorder::push(const Event& event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events[m_recorded % m_events.size()] = event;
+    m_recorded++;
+}
+
+void TraceRecorder::complete(const char* name, uint64_t startNs, uint64_t endNs, uint32_t track)
+{
+    if (!m_enabled) {
+        return;
+    }
+    push({ name, startNs, endNs > startNs ? endNs - startNs : 0, 0.0, track ? track : currentTrack(), 'X' });
+}
+
+void TraceRecorder::counter(const char* name, double value)
+{
+    if (!m_enabled) {
+        return;
+    }
+    push({ name, now(), 0, value, currentTrack(), 'C' });
+}
+
+void TraceRecorder::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_recorded = 0;
+}
+
+bool TraceRecorder::write(const std::string& path) const
+{
+    std::vector<Event> events;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = static_cast<size_t>(std::min<uint64_t>(m_recorded, m_events.size()));
+        uint64_t first = m_recorded - count;
+        events.reserve(count);
+        for (uint64_t i = first; i < m_recorded; ++i) {
+            events.push_back(m_events[i % m_events.size()]);
+        }
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    // Microseconds relative to the oldest event (keeps the numbers short and exact in a double)
+    uint64_t origin = UINT64_MAX;
+    std::vector<uint32_t> tracks;
+    for (const Event& event : events) {
+        origin = std::min(origin, event.startNs);
+        if (std::find(tracks.begin(), tracks.end(), event.track) == tracks.end()) {
+            tracks.push_back(event.track);
+        }
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (uint32_t track : tracks) {
+        std::string name = track == kGpuTrack ? "GPU" : "CPU " + std::to_string(track);
+        out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << track
+            << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << name << "\"}}";
+        first = false;
+    }
+    out.precision(3);
+    out << std::fixed;
+    for (const Event& event : events) {
+        double ts = static_cast<double>(event.startNs - origin) * 1e-3;
+        out << (first ? "" : ",\n") << "{\"ph\":\"" << event.phase << "\",\"pid\":1,\"tid\":" << event.track
+            << ",\"name\":\"" << event.name << "\",\"ts\":" << ts;
+        if (event.phase == 'X') {
+            out << ",\"dur\":" << static_cast<double>(event.durationNs) * 1e-3;
+        } else {
+            out << ",\"args\":{\"value\":" << event.value << "}";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        std::cerr << "Failed to write trace " << path << std::endl;
+        return false;
+    }
+    std::cout << "Trace: wrote " << events.size() << " events to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-frame trace for long captures, written as Chrome Trace Event JSON (chrome://tracing,
+// Perfetto). CPU scopes, GPU pass spans and counters go into a fixed ring of events, so a
+// recording keeps the last capacity events whatever its length and costs one short lock per
+// event; nothing is recorded while disabled. Times are nanoseconds on the clock of
+// MTL::Device::sampleTimestamps() (mach uptime), so GPU timestamps converted with the
+// profiler's calibration line up with the CPU scopes. Names must be string literals (or outlive
+// the recorder): only the pointer is stored.
+class TraceRecorder {
+public:
+    static constexpr uint32_t kGpuTrack = 1000; // Thread id of the GPU pass spans
+
+    explicit TraceRecorder(size_t capacity = 1 << 16);
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+    static uint64_t now(); // Nanoseconds
+
+    // A finished span on the calling thread (track 0 = this thread's track)
+    void complete(const char* name, uint64_t startNs, uint64_t endNs, uint32_t track = 0);
+    void counter(const char* name, double value);
+
+    // Span of the enclosing block
+    class Scope {
+    public:
+        Scope(TraceRecorder* recorder, const char* name)
+            : m_recorder(recorder && recorder->isEnabled() ? recorder : nullptr)
+            , m_name(name)
+            , m_start(m_recorder ? now() : 0) {}
+        ~Scope() {
+            if (m_recorder) {
+                m_recorder->complete(m_name, m_start, now());
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        TraceRecorder* m_recorder;
+        const char* m_name;
+        uint64_t m_start;
+    };
+
+    // The recorded events, oldest first, as a Chrome trace (the ring keeps recording)
+    bool write(const std::string& path) const;
+    void clear();
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+        double value;
+        uint32_t track;
+        char phase;         // 'X' complete span, 'C' counter
+    };
+
+    static uint32_t currentTrack(); // Small id per recording thread, in first-use order
+    void push(const Event& event);
+
+    std::atomic<bool> m_enabled; // Read by GPU completion handlers too
+    std::vector<Event> m_events; // Ring of m_events.size() entries
+    uint64_t m_recorded;         // Events pushed so far (the next index, modulo the size)
+    mutable std::mutex m_mutex;
+};
@@ -3,49 +3,183 @@
 
 using namespace metal;
 
-// Compute shader to update trample map
-// Implements decay + hard-edge ball stamp
+// Compute shaders for the trample interactors
+// Texels store the last time an interactor covered them; the decay is evaluated where the map is
+// sampled (trampleStrength), so only the texels under the interactors' footprints are dispatched.
+// Decaying texels need no update at all, so the footprints are the whole active set; no tile
+// mask or indirect dispatch is required.
+// The map is a toroidal clipmap around the camera (see trampleStorageTexel): only the strips
+// the window scrolls onto are cleared each frame.
+// Every kernel writing the map flags the summary tiles it touched; reduceTrampleTiles re-reduces
+// only those into the min / max summary pyramid used by the cull pass.
 
-kernel void updateTrampleMap(
-    texture2d<float, access::read> inputTexture [[texture(0)]],
-    texture2d<float, access::write> outputTexture [[texture(1)]],
-    constant Uniforms &uniforms [[buffer(0)]],
+// Forget the stamps of the world texels that left the window (their storage now holds new ones)
+kernel void clearTrampleRegion(
+    texture2d<float, access::write> trampleMap [[texture(0)]],
+    constant int4 &region [[buffer(TrampleBufferIndexClearRegion)]],
+    device uint *dirtyTiles [[buffer(TrampleBufferIndexDirtyTiles)]],
     uint2 gid [[thread_position_in_grid]]
 ) {
-    // Check bounds
-    if (gid.x >= outputTexture.get_width() || gid.y >= outputTexture.get_height()) {
-        return;
-    }
-    
-    // Read current trample value
-    float2 uv = float2(gid) / float2(outputTexture.get_width(), outputTexture.get_height());
-    float currentTrample = inputTexture.read(gid).r;
-    
-    // ============================================================
-    // STEP 1: DECAY
-    // ============================================================
-    // Decay every frame: trample = max(0, trample - decayRate * dt)
-    float decayedTrample = max(0.0, currentTrample - uniforms.trampleDecayRate * uniforms.dt);
-    
-    // ============================================================
-    // STEP 2: STAMP BALL FOOTPRINT
-    // ============================================================
-    // Map pixel UV to world XZ position
-    float2 worldXZ = mix(uniforms.groundMinXZ, uniforms.groundMaxXZ, uv);
-    
-    // Calculate distance from world position to ball center (on XZ plane)
-    float2 ballCenterXZ = uniforms.ballWorldPos.xz;
-    float2 P = worldXZ;
-    float2 toBall = P - ballCenterXZ;
-    float dist = length(toBall);
-    
-    // Hard edge stamp: if d < radius, stamp = 1, else stamp = 0
-    float stamp = (dist < uniforms.ballRadius) ? 1.0 : 0.0;
-    
-    // Update: trample = max(trample, stamp)
-    float newTrample = max(decayedTrample, stamp);
-    
-    // Write output
-    outputTexture.write(float4(newTrample, 0.0, 0.0, 1.0), gid);
+    if (int(gid.x) >= region.z || int(gid.y) >= region.w) {
+        return;
+    }
+    uint2 mapSize = uint2(trampleMap.get_width(), trampleMap.get_height());
+    uint2 storageTexel = trampleStorageTexel(region.xy + int2(gid), mapSize);
+    trampleMap.write(float4(TRAMPLE_NEVER_STAMPED, 0.0, 0.0, 1.0), storageTexel);
+    dirtyTiles[trampleSummaryTileIndex(storageTexel, mapSize)] = 1;
+}
+
+// One thread per bin: list the interactors whose reach (this frame or last) overlaps the tile.
+// The grass shaders then only test the interactors of the bin they fall in.
+kernel void binInteractors(
+    constant Uniforms &uniforms [[buffer(TrampleBufferIndexUniforms)]],
+    const device Interactor *interactors [[buffer(TrampleBufferIndexInteractors)]],
+    device InteractorBin *bins [[buffer(TrampleBufferIndexBins)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= INTERACTOR_BIN_GRID || gid.y >= INTERACTOR_BIN_GRID) {
+        return;
+    }
+
+    // World XZ rectangle of this tile
+    float tileSize = uniforms.trampleWindowSize / float(INTERACTOR_BIN_GRID);
+    float2 tileMin = uniforms.trampleWindowMinXZ + float2(gid) * tileSize;
+    float2 tileMax = tileMin + tileSize;
+
+    InteractorBin bin;
+    bin.count = 0;
+    uint interactorCount = min(uniforms.interactorCount, uint(MAX_INTERACTORS));
+    for (uint i = 0; i < interactorCount && bin.count < INTERACTOR_BIN_CAPACITY; ++i) {
+        Interactor interactor = interactors[i];
+        float reach = interactorReach(interactor);
+
+        // Circle vs. rectangle: distance from the center to the closest point of the tile
+        float current = distance(clamp(interactor.position.xz, tileMin, tileMax), interactor.position.xz);
+        float previous = distance(clamp(interactor.prevPosition.xz, tileMin, tileMax), interactor.prevPosition.xz);
+        if (reach > 0.0 && min(current, previous) <= reach) { // Zeroed (removed) or airborne: no footprint
+            bin.indices[bin.count++] = i;
+        }
+    }
+    bins[gid.y * INTERACTOR_BIN_GRID + gid.x] = bin;
+}
+
+// Grid z selects the interactor; x / y cover the largest footprint, anchored at each interactor.
+// Every thread tests a single interactor; overlapping footprints write the same stamp time.
+kernel void stampTrampleMap(
+    texture2d<float, access::write> trampleMap [[texture(0)]],
+    constant Uniforms &uniforms [[buffer(TrampleBufferIndexUniforms)]],
+    const device Interactor *interactors [[buffer(TrampleBufferIndexInteractors)]],
+    device uint *dirtyTiles [[buffer(TrampleBufferIndexDirtyTiles)]],
+    uint3 gid [[thread_position_in_grid]]
+) {
+    if (gid.z >= min(uniforms.interactorCount, uint(MAX_INTERACTORS))) {
+        return;
+    }
+    Interactor interactor = interactors[gid.z];
+
+    // World texel of this thread, from the first texel of this interactor's footprint
+    uint2 mapSize = uint2(trampleMap.get_width(), trampleMap.get_height());
+    float texelsPerMeter = trampleTexelsPerMeter(mapSize.x, uniforms.trampleWindowSize);
+    int2 texel = trampleWorldTexel(interactor.position.xz - interactor.radius, texelsPerMeter) + int2(gid.xy);
+
+    // Check bounds: texels outside the window have no storage this frame
+    int2 windowMin = int2(round(uniforms.trampleWindowMinXZ * texelsPerMeter));
+    if (any(texel < windowMin) || any(texel >= windowMin + int2(mapSize))) {
+        return;
+    }
+
+    // Map world texel to world XZ position
+    float2 worldXZ = float2(texel) / texelsPerMeter;
+
+    // Hard edge stamp: texels inside the interactor radius (XZ plane) are trampled now
+    float dist = length(worldXZ - interactor.position.xz);
+    if (dist < interactor.radius) {
+        uint2 storageTexel = trampleStorageTexel(texel, mapSize);
+        trampleMap.write(float4(uniforms.time, 0.0, 0.0, 1.0), storageTexel);
+        dirtyTiles[trampleSummaryTileIndex(storageTexel, mapSize)] = 1;
+    }
 }
 
+// One threadgroup per summary tile: min / max stamp time of a tile written since its last
+// reduction (the flags are uniform per threadgroup, so clean tiles exit at once)
+kernel void reduceTrampleTiles(
+    texture2d<float, access::read> trampleMap [[texture(0)]],
+    texture2d<float, access::write> summaryLevel [[texture(1)]],
+    device uint *dirtyTiles [[buffer(TrampleBufferIndexDirtyTiles)]],
+    device atomic_uint *updatedTiles [[buffer(TrampleBufferIndexUpdatedTiles)]],
+    uint2 tile [[threadgroup_position_in_grid]],
+    uint2 tid [[thread_position_in_threadgroup]],
+    uint2 threadsPerGroup [[threads_per_threadgroup]],
+    uint simdLane [[thread_index_in_simdgroup]],
+    uint simdIndex [[simdgroup_index_in_threadgroup]],
+    uint simdCount [[simdgroups_per_threadgroup]]
+) {
+    threadgroup float2 simdRanges[32]; // Per-simdgroup (min, max)
+
+    uint2 summarySize = uint2(summaryLevel.get_width(), summaryLevel.get_height());
+    if (tile.x >= summarySize.x || tile.y >= summarySize.y) {
+        return;
+    }
+    uint tileIndex = tile.y * summarySize.x + tile.x;
+    if (dirtyTiles[tileIndex] == 0) {
+        return;
+    }
+
+    // Each thread folds a strided subset of the tile, then the simdgroups and the threadgroup
+    uint2 origin = tile * TRAMPLE_SUMMARY_TILE;
+    float2 stampRange = float2(INFINITY, -INFINITY); // (min, max)
+    for (uint y = tid.y; y < TRAMPLE_SUMMARY_TILE; y += threadsPerGroup.y) {
+        for (uint x = tid.x; x < TRAMPLE_SUMMARY_TILE; x += threadsPerGroup.x) {
+            float stamp = trampleMap.read(origin + uint2(x, y)).r;
+            stampRange = float2(min(stampRange.x, stamp), max(stampRange.y, stamp));
+        }
+    }
+    stampRange = float2(simd_min(stampRange.x), simd_max(stampRange.y));
+
+    if (simdLane == 0) {
+        simdRanges[simdIndex] = stampRange;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    if (tid.x == 0 && tid.y == 0) {
+        for (uint i = 1; i < simdCount; ++i) {
+            stampRange = float2(min(stampRange.x, simdRanges[i].x), max(stampRange.y, simdRanges[i].y));
+        }
+        summaryLevel.write(float4(stampRange, 0.0, 0.0), tile);
+        dirtyTiles[tileIndex] = 0;
+        atomic_fetch_add_explicit(updatedTiles, 1u, memory_order_relaxed);
+    }
+}
+
+// Summary level N: 2x2 min / max of level N-1 (single-level views; every level is a power of two)
+kernel void downsampleTrampleSummary(
+    texture2d<float, access::read> srcLevel [[texture(0)]],
+    texture2d<float, access::write> dstLevel [[texture(1)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= dstLevel.get_width() || gid.y >= dstLevel.get_height()) {
+        return;
+    }
+    float2 a = srcLevel.read(gid * 2).rg;
+    float2 b = srcLevel.read(gid * 2 + uint2(1, 0)).rg;
+    float2 c = srcLevel.read(gid * 2 + uint2(0, 1)).rg;
+    float2 d = srcLevel.read(gid * 2 + uint2(1, 1)).rg;
+    dstLevel.write(float4(min(min(a.x, b.x), min(c.x, d.x)), max(max(a.y, b.y), max(c.y, d.y)), 0.0, 0.0), gid);
+}
+
+// CPU trample queries (footsteps, AI): strength at each batched point after this frame's stamps
+kernel void queryTrampleStrength(
+    texture2d<float, access::read> trampleMap [[texture(0)]],
+    constant Uniforms &uniforms [[buffer(TrampleBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(TrampleBufferIndexSceneConstants)]],
+    const device float2 *points [[buffer(TrampleBufferIndexQueryPoints)]],
+    device float *results [[buffer(TrampleBufferIndexQueryResults)]],
+    constant uint &pointCount [[buffer(TrampleBufferIndexQueryCount)]],
+    uint gid [[thread_position_in_grid]]
+) {
+    if (gid >= pointCount) {
+        return;
+    }
+    results[gid] = trampleAt(trampleMap, points[gid], uniforms.trampleWindowMinXZ, uniforms.trampleWindowSize,
+                             uniforms.time, scene.trampleDecayRate);
+}
@@ -0,0 +1,136 @@
+#include "TrampleSnapshot.hpp"
+#include "ShaderTypes.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// Storage texel of a world texel in a toroidal map (matches trampleStorageTexel() in the shaders)
+static uint32_t wrapTexel(int32_t worldTexel, uint32_t mapSize)
+{
+    int32_t size = static_cast<int32_t>(mapSize);
+    return static_cast<uint32_t>(((worldTexel % size) + size) % size);
+}
+
+TrampleSnapshot::TrampleSnapshot()
+    : m_size(0)
+    , m_windowTexel(simd::make_int2(0, 0))
+    , m_strength()
+{
+}
+
+void TrampleSnapshot::capture(const float* stampTimes, uint32_t mapSize, simd::int2 windowTexel, float time, float decayRate)
+{
+    m_size = mapSize;
+    m_windowTexel = windowTexel;
+    m_strength.assign(static_cast<size_t>(mapSize) * mapSize, 0);
+
+    for (uint32_t y = 0; y < mapSize; ++y) {
+        const float* row = stampTimes + static_cast<size_t>(wrapTexel(windowTexel.y + static_cast<int32_t>(y), mapSize)) * mapSize;
+        for (uint32_t x = 0; x < mapSize; ++x) {
+            float stampTime = row[wrapTexel(windowTexel.x + static_cast<int32_t>(x), mapSize)];
+            float strength = std::clamp(1.0f - decayRate * (time - stampTime), 0.0f, 1.0f);
+            m_strength[static_cast<size_t>(y) * mapSize + x] = static_cast<uint8_t>(std::lround(strength * 255.0f));
+        }
+    }
+}
+
+void TrampleSnapshot::restore(float* stampTimes, uint32_t mapSize, simd::int2 windowTexel, float time, float decayRate) const
+{
+    std::fill(stampTimes, stampTimes + static_cast<size_t>(mapSize) * mapSize, TRAMPLE_NEVER_STAMPED);
+    if (isEmpty() || decayRate <= 0.0f) {
+        return;
+    }
+
+    // Overlap of the snapshot's window with the target window, in world texels
+    int32_t minX = std::max(m_windowTexel.x, windowTexel.x);
+    int32_t minY = std::max(m_windowTexel.y, windowTexel.y);
+    int32_t maxX = std::min(m_windowTexel.x + static_cast<int32_t>(m_size), windowTexel.x + static_cast<int32_t>(mapSize));
+    int32_t maxY = std::min(m_windowTexel.y + static_cast<int32_t>(m_size), windowTexel.y + static_cast<int32_t>(mapSize));
+
+    for (int32_t y = minY; y < maxY; ++y) {
+        const uint8_t* row = m_strength.data() + static_cast<size_t>(y - m_windowTexel.y) * m_size;
+        float* target = stampTimes + static_cast<size_t>(wrapTexel(y, mapSize)) * mapSize;
+        for (int32_t x = minX; x < maxX; ++x) {
+            uint8_t strength = row[x - m_windowTexel.x];
+            if (strength > 0) {
+                // Stamp time that decays to this strength at time
+                target[wrapTexel(x, mapSize)] = time - (1.0f - static_cast<float>(strength) / 255.0f) / decayRate;
+            }
+        }
+    }
+}
+
+size_t TrampleSnapshot::getTrampledTexelCount() const
+{
+    return m_strength.size() - static_cast<size_t>(std::count(m_strength.begin(), m_strength.end(), uint8_t(0)));
+}
+
+bool TrampleSnapshot::save(const std::string& path) const
+{
+    // Runs of (length 1..255, strength) pairs
+    std::vector<uint8_t> runs;
+    for (size_t i = 0; i < m_strength.size();) {
+        uint8_t value = m_strength[i];
+        size_t length = 1;
+        while (i + length < m_strength.size() && length < 255 && m_strength[i + length] == value) {
+            ++length;
+        }
+        runs.push_back(static_cast<uint8_t>(length));
+        runs.push_back(value);
+        i += length;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write trample snapshot " << path << std::endl;
+        return false;
+    }
+    uint32_t header[5] = { kMagic, kVersion, m_size, static_cast<uint32_t>(m_windowTexel.x), static_cast<uint32_t>(m_windowTexel.y) };
+    uint64_t runBytes = runs.size();
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(&runBytes), sizeof(runBytes));
+    file.write(reinterpret_cast<const char*>(runs.data()), static_cast<std::streamsize>(runs.size()));
+    return file.good();
+}
+
+bool TrampleSnapshot::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open trample snapshot " << path << std::endl;
+        return false;
+    }
+
+    uint32_t header[5] = {};
+    uint64_t runBytes = 0;
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    file.read(reinterpret_cast<char*>(&runBytes), sizeof(runBytes));
+    if (!file || header[0] != kMagic || header[1] != kVersion || header[2] == 0 || (runBytes & 1) != 0) {
+        std::cerr << "Invalid trample snapshot " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> runs(runBytes);
+    file.read(reinterpret_cast<char*>(runs.data()), static_cast<std::streamsize>(runs.size()));
+    if (!file) {
+        std::cerr << "Truncated trample snapshot " << path << std::endl;
+        return false;
+    }
+
+    size_t texelCount = static_cast<size_t>(header[2]) * header[2];
+    std::vector<uint8_t> strength;
+    strength.reserve(texelCount);
+    for (size_t i = 0; i < runs.size(); i += 2) {
+        strength.insert(strength.end(), runs[i], runs[i + 1]);
+    }
+    if (strength.size() != texelCount) {
+        std::cerr << "Corrupt trample snapshot " << path << std::endl;
+        return false;
+    }
+
+    m_size = header[2];
+    m_windowTexel = simd::make_int2(static_cast<int32_t>(header[3]), static_cast<int32_t>(header[4]));
+    m_strength.swap(strength);
+    return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <simd/simd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Persistent copy of the trample map covering one clipmap window.
+// Stamp times only mean something relative to the clock they were taken at, so a snapshot
+// stores the strength at capture time quantized to 8 bits (0 = untouched, the vast majority)
+// and restore() turns it back into stamp times for the restoring clock. Files hold the
+// strengths run-length encoded in world-window order, with the window's first world texel,
+// so a snapshot restores into whatever window the map holds later.
+class TrampleSnapshot {
+public:
+    TrampleSnapshot();
+
+    // Quantize the stamp times of a mapSize x mapSize toroidal map holding windowTexel's window
+    void capture(const float* stampTimes, uint32_t mapSize, simd::int2 windowTexel, float time, float decayRate);
+    // Stamp times for a map holding windowTexel's window at time (never-stamped outside the snapshot)
+    void restore(float* stampTimes, uint32_t mapSize, simd::int2 windowTexel, float time, float decayRate) const;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    bool isEmpty() const { return m_strength.empty(); }
+    size_t getTrampledTexelCount() const;
+
+private:
+    static constexpr uint32_t kMagic = 0x504d5254; // "TRMP"
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t m_size;                // Texels per side
+    simd::int2 m_windowTexel;       // First world texel of the captured window
+    std::vector<uint8_t> m_strength; // m_size * m_size strengths, row-major from m_windowTexel
+};
@@ -0,0 +1,131 @@
+#include "UploadRing.hpp"
+#include "BufferHeap.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Satisfies the buffer-to-texture offset rules of every pixel and block format
+static constexpr size_t kUploadAlignment = 256;
+
+UploadRing::UploadRing(MTL::Device* device, size_t capacity)
+    : m_device(device)
+    , m_bufferHeap(nullptr)
+    , m_staging(nullptr)
+    , m_capacity(capacity)
+    , m_head(0)
+    , m_committedHead(0)
+    , m_tail(0)
+{
+    m_staging = m_device->newBuffer(m_capacity, MTL::ResourceStorageModeShared | MTL::ResourceCPUCacheModeWriteCombined);
+    if (!m_staging) {
+        std::cerr << "Failed to create upload staging buffer" << std::endl;
+        m_capacity = 0;
+    }
+}
+
+UploadRing::~UploadRing()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_retired.wait(lock, [this] { return m_tail >= m_committedHead; });
+    }
+    for (MTL::Buffer* buffer : m_overflow) {
+        buffer->release();
+    }
+    if (m_staging) {
+        m_staging->release();
+    }
+}
+
+MTL::Buffer* UploadRing::stage(const void* data, size_t size, size_t& offset)
+{
+    if (size <= m_capacity) {
+        // Never split an upload across the end of the ring
+        uint64_t start = (m_head + kUploadAlignment - 1) / kUploadAlignment * kUploadAlignment;
+        if (start % m_capacity + size > m_capacity) {
+            start += m_capacity - start % m_capacity;
+        }
+        uint64_t end = start + size;
+
+        // Wait for committed batches only; the open batch cannot retire before it is committed
+        if (end - m_committedHead <= m_capacity) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_retired.wait(lock, [this, end] { return end - m_tail <= m_capacity; });
+            m_head = end;
+            offset = static_cast<size_t>(start % m_capacity);
+            std::memcpy(static_cast<uint8_t*>(m_staging->contents()) + offset, data, size);
+            return m_staging;
+        }
+    }
+
+    MTL::Buffer* buffer = m_device->newBuffer(data, size, MTL::ResourceStorageModeShared);
+    if (!buffer) {
+        std::cerr << "Failed to create upload staging buffer of " << size << " bytes" << std::endl;
+        return nullptr;
+    }
+    m_overflow.push_back(buffer);
+    offset = 0;
+    return buffer;
+}
+
+MTL::Buffer* UploadRing::newPrivateBuffer(MTL::BlitCommandEncoder* blitEncoder, const void* data, size_t size)
+{
+    MTL::Buffer* buffer = m_bufferHeap ? m_bufferHeap->newBuffer(size) : m_device->newBuffer(size, MTL::ResourceStorageModePrivate);
+    if (!buffer) {
+        return nullptr;
+    }
+    uploadBuffer(blitEncoder, buffer, 0, data, size);
+    return buffer;
+}
+
+void UploadRing::releasePrivateBuffer(MTL::Buffer* buffer)
+{
+    if (m_bufferHeap) {
+        m_bufferHeap->release(buffer);
+    } else if (buffer) {
+        buffer->release();
+    }
+}
+
+void UploadRing::uploadBuffer(MTL::BlitCommandEncoder* blitEncoder, MTL::Buffer* destination, size_t destinationOffset,
+                              const void* data, size_t size)
+{
+    size_t offset = 0;
+    MTL::Buffer* source = blitEncoder && destination ? stage(data, size, offset) : nullptr;
+    if (source) {
+        blitEncoder->copyFromBuffer(source, offset, destination, destinationOffset, size);
+    }
+}
+
+void UploadRing::uploadTexture(MTL::BlitCommandEncoder* blitEncoder, MTL::Texture* destination, NS::UInteger level,
+                               const MTL::Region& region, const void* data, size_t bytesPerRow, size_t rowCount)
+{
+    size_t offset = 0;
+    size_t size = bytesPerRow * rowCount;
+    MTL::Buffer* source = blitEncoder && destination ? stage(data, size, offset) : nullptr;
+    if (source) {
+        blitEncoder->copyFromBuffer(source, offset, bytesPerRow, size, region.size, destination, 0, level, region.origin);
+    }
+}
+
+void UploadRing::commit(MTL::CommandBuffer* commandBuffer)
+{
+    if (!commandBuffer) {
+        return;
+    }
+    uint64_t batchEnd = m_head;
+    std::vector<MTL::Buffer*> overflow;
+    overflow.swap(m_overflow);
+    m_committedHead = batchEnd;
+
+    commandBuffer->addCompletedHandler([this, batchEnd, overflow](MTL::CommandBuffer*) {
+        for (MTL::Buffer* buffer : overflow) {
+            buffer->release();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tail = std::max(m_tail, batchEnd);
+        }
+        m_retired.notify_all();
+    });
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class BufferHeap;
+
+// CPU -> GPU uploads into private storage. Data is copied into one reusable shared staging
+// buffer (used as a ring) and blitted into StorageModePrivate buffers and textures, so the
+// destinations keep lossless compression and the GPU's preferred layout. Staging space is
+// recycled when the command buffer passed to commit() completes; an upload that would have to
+// wait on its own uncommitted batch (or is larger than the ring) gets a one-off staging buffer.
+// Single producer (the render thread); completion handlers may run on any thread.
+class UploadRing {
+public:
+    UploadRing(MTL::Device* device, size_t capacity = 16 * 1024 * 1024);
+    ~UploadRing(); // Waits for committed uploads still in flight
+
+    // Caller owns the buffer (hand it back with releasePrivateBuffer()); it is usable by any
+    // command buffer committed after this batch
+    MTL::Buffer* newPrivateBuffer(MTL::BlitCommandEncoder* blitEncoder, const void* data, size_t size);
+    void releasePrivateBuffer(MTL::Buffer* buffer);
+    // Sub-allocate the private buffers from heap instead of one device allocation each
+    void setBufferHeap(BufferHeap* heap) { m_bufferHeap = heap; }
+    void uploadBuffer(MTL::BlitCommandEncoder* blitEncoder, MTL::Buffer* destination, size_t destinationOffset,
+                      const void* data, size_t size);
+    // rowCount rows of bytesPerRow (rows of blocks for compressed formats) into one mip level
+    void uploadTexture(MTL::BlitCommandEncoder* blitEncoder, MTL::Texture* destination, NS::UInteger level,
+                       const MTL::Region& region, const void* data, size_t bytesPerRow, size_t rowCount);
+
+    // Call before commandBuffer->commit(): everything staged since the last commit is recycled
+    // once this command buffer completes
+    void commit(MTL::CommandBuffer* commandBuffer);
+    // Bytes staged by the committed batches so far (changes with every committed upload)
+    uint64_t getCommittedBytes() const { return m_committedHead; }
+
+private:
+    // Staging copy of data; returns the buffer and offset to blit from
+    MTL::Buffer* stage(const void* data, size_t size, size_t& offset);
+
+    MTL::Device* m_device;
+    BufferHeap* m_bufferHeap;            // Placement of the private buffers (or null)
+    MTL::Buffer* m_staging;
+    size_t m_capacity;
+    uint64_t m_head;                     // Bytes handed out so far (monotonic, wraps modulo capacity)
+    uint64_t m_committedHead;            // m_head at the last commit()
+    uint64_t m_tail;                     // Everything below is no longer read by the GPU (guarded by m_mutex)
+    std::vector<MTL::Buffer*> m_overflow; // One-off staging buffers of the open batch
+    std::mutex m_mutex;
+    std::condition_variable m_retired;
+};
@@ -0,0 +1,160 @@
+#include "VariableRasterizationRate.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static float smoothStep(float edge0, float edge1, float x)
+{
+    float t = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+VariableRasterizationRate::VariableRasterizationRate(MTL::Device* device)
+    : m_device(device)
+    , m_map(nullptr)
+    , m_version(0)
+    , m_width(0)
+    , m_height(0)
+    , m_enabled(false)
+    , m_targetFrameMs(1000.0f / 60.0f)
+    , m_filteredGpuMs(0.0)
+    , m_strength(kInitialStrength)
+    , m_builtStrength(-1.0f)
+    , m_builtFogStartZone(-1)
+    , m_builtFogEndZone(-1)
+{
+    for (int i = 0; i < kMaxFrames; ++i) {
+        m_parameterBuffers[i] = nullptr;
+        m_slotVersions[i] = 0;
+    }
+}
+
+VariableRasterizationRate::~VariableRasterizationRate()
+{
+    if (m_map) {
+        m_map->release();
+    }
+    for (int i = 0; i < kMaxFrames; ++i) {
+        if (m_parameterBuffers[i]) {
+            m_parameterBuffers[i]->release();
+        }
+    }
+}
+
+bool VariableRasterizationRate::isSupported(MTL::Device* device)
+{
+    return device->supportsRasterizationRateMap(1);
+}
+
+void VariableRasterizationRate::resize(NS::UInteger width, NS::UInteger height)
+{
+    m_width = width;
+    m_height = height;
+    m_builtStrength = -1.0f; // Rebuilt for the new screen size by the next update()
+}
+
+void VariableRasterizationRate::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    // Start from the middle strength and let the controller settle again
+    m_strength = kInitialStrength;
+    m_filteredGpuMs = 0.0;
+}
+
+void VariableRasterizationRate::update(double gpuFrameMs, float fogStartRow, float fogEndRow)
+{
+    if (!m_enabled || m_width == 0 || m_height == 0) {
+        return;
+    }
+
+    // Smooth the per-frame noise; over budget (negative error) raises the strength
+    if (gpuFrameMs > 0.0) {
+        m_filteredGpuMs = (m_filteredGpuMs <= 0.0) ? gpuFrameMs : m_filteredGpuMs * 0.9 + gpuFrameMs * 0.1;
+        double error = (m_targetFrameMs - m_filteredGpuMs) / m_targetFrameMs;
+        if (std::abs(error) >= kDeadband) {
+            m_strength = std::clamp(m_strength - static_cast<float>(error) * kAdjustRate, kMinStrength, kMaxStrength);
+        }
+    }
+
+    // Fog rows snap to the rate zones, so a slowly tilting camera rebuilds the map a few times
+    // per screen height rather than every frame
+    float strength = std::round(m_strength / kStrengthStep) * kStrengthStep;
+    int fogStartZone = std::clamp(static_cast<int>(std::floor(fogStartRow * kZones)), -1, kZones);
+    int fogEndZone = std::clamp(static_cast<int>(std::floor(fogEndRow * kZones)), -1, kZones);
+    if (m_map && strength == m_builtStrength && fogStartZone == m_builtFogStartZone && fogEndZone == m_builtFogEndZone) {
+        return;
+    }
+    rebuild(strength, fogStartZone, fogEndZone);
+}
+
+void VariableRasterizationRate::rebuild(float strength, int fogStartZone, int fogEndZone)
+{
+    // Separable rates: columns fall off toward the left and right edges; rows fall off toward the
+    // top and bottom edges and, above the fog start row, toward the fog end row and beyond
+    // (the sky there costs little either way)
+    float horizontal[kZones];
+    float vertical[kZones];
+    float fogStart = static_cast<float>(fogStartZone) / kZones;
+    float fogEnd = std::min(static_cast<float>(fogEndZone) / kZones, fogStart - 1.0f / kZones);
+    for (int i = 0; i < kZones; ++i) {
+        float center = (static_cast<float>(i) + 0.5f) / kZones;
+        float edge = smoothStep(kPeripheryStart, 0.5f, std::abs(center - 0.5f));
+        float fog = std::clamp((fogStart - center) / (fogStart - fogEnd), 0.0f, 1.0f);
+        horizontal[i] = 1.0f - strength * (1.0f - kMinRate) * edge;
+        vertical[i] = 1.0f - strength * (1.0f - kMinRate) * std::max(edge, fog);
+    }
+
+    MTL::RasterizationRateLayerDescriptor* layer = MTL::RasterizationRateLayerDescriptor::alloc()->init(
+        MTL::Size(kZones, kZones, 0), horizontal, vertical);
+    MTL::RasterizationRateMapDescriptor* descriptor = MTL::RasterizationRateMapDescriptor::rasterizationRateMapDescriptor(
+        MTL::Size(m_width, m_height, 0), layer);
+    descriptor->setLabel(NS::String::string("Scene rate map", NS::UTF8StringEncoding));
+    MTL::RasterizationRateMap* map = m_device->newRasterizationRateMap(descriptor);
+    layer->release();
+    if (!map) {
+        std::cerr << "Failed to create rasterization rate map" << std::endl;
+        return;
+    }
+
+    // Frames in flight keep the previous map through their render pass descriptors
+    if (m_map) {
+        m_map->release();
+    }
+    m_map = map;
+    m_builtStrength = strength;
+    m_builtFogStartZone = fogStartZone;
+    m_builtFogEndZone = fogEndZone;
+    m_version++;
+}
+
+MTL::Size VariableRasterizationRate::getPhysicalSize() const
+{
+    return m_map ? m_map->physicalSize(0) : MTL::Size(m_width, m_height, 1);
+}
+
+MTL::Buffer* VariableRasterizationRate::parameterBuffer(int slot)
+{
+    if (!m_map || slot < 0 || slot >= kMaxFrames) {
+        return nullptr;
+    }
+
+    // Same zone count every rebuild, so the size only matters for the first copy; a larger one
+    // replaces the buffer (the command buffers still reading the old one retain it)
+    MTL::SizeAndAlign sizeAndAlign = m_map->parameterBufferSizeAndAlign();
+    if (!m_parameterBuffers[slot] || m_parameterBuffers[slot]->length() < sizeAndAlign.size) {
+        if (m_parameterBuffers[slot]) {
+            m_parameterBuffers[slot]->release();
+        }
+        m_parameterBuffers[slot] = m_device->newBuffer(sizeAndAlign.size, MTL::ResourceStorageModeShared);
+        m_slotVersions[slot] = 0;
+        if (!m_parameterBuffers[slot]) {
+            std::cerr << "Failed to create rasterization rate parameter buffer" << std::endl;
+            return nullptr;
+        }
+    }
+    if (m_slotVersions[slot] != m_version) {
+        m_map->copyParameterDataToBuffer(m_parameterBuffers[slot], 0);
+        m_slotVersions[slot] = m_version;
+    }
+    return m_parameterBuffers[slot];
+}
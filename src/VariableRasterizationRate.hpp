@@ -0,0 +1,66 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <cstdint>
+
+// Variable rasterization rate for the scene pass: a MTL::RasterizationRateMap lowers the shading
+// rate toward the screen edges and over the rows past the fog distance (far grass there is mostly
+// fog color), and the scene is rasterized into the smaller physical region the map compresses the
+// screen into. The post pass reads the scene through the map's screen-to-physical mapping, so it
+// still writes every output pixel. How far the rates drop follows the GPU frame time like
+// DynamicResolution's scale: the strength grows while frames are over budget and relaxes under it.
+class VariableRasterizationRate {
+public:
+    static constexpr int kMaxFrames = 3; // Parameter buffer copies (frames in flight)
+
+    explicit VariableRasterizationRate(MTL::Device* device);
+    ~VariableRasterizationRate();
+
+    static bool isSupported(MTL::Device* device);
+
+    // Screen size of the map (the scene's full-resolution targets)
+    void resize(NS::UInteger width, NS::UInteger height);
+
+    // Feed the latest resolved GPU frame time and the screen rows (0 = top, 1 = bottom) where the
+    // ground in front of the camera reaches the fog start and end distances; rebuilds the map when
+    // the quantized rates change
+    void update(double gpuFrameMs, float fogStartRow, float fogEndRow);
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+    float getTargetFrameMs() const { return m_targetFrameMs; }
+    void setTargetFrameMs(float targetFrameMs) { m_targetFrameMs = targetFrameMs; }
+    float getStrength() const { return m_strength; }
+
+    MTL::RasterizationRateMap* getMap() const { return m_map; }
+    MTL::Size getPhysicalSize() const;
+    // The current map's parameters for the shader decoder, in the frame slot's copy
+    MTL::Buffer* parameterBuffer(int slot);
+
+private:
+    static constexpr int kZones = 16;               // Rate samples per axis
+    static constexpr float kMinRate = 0.25f;        // Rate of a fully reduced zone at strength 1
+    static constexpr float kPeripheryStart = 0.3f;  // Distance from the screen center where the edge falloff starts
+    static constexpr float kMinStrength = 0.25f;    // Fog and edge rows always lose a little
+    static constexpr float kMaxStrength = 1.0f;
+    static constexpr float kInitialStrength = 0.5f;
+    static constexpr float kStrengthStep = 0.125f;  // Quantization: the map is rebuilt only when a step is crossed
+    static constexpr float kDeadband = 0.05f;       // Ignore budget errors below 5%
+    static constexpr float kAdjustRate = 0.05f;     // Strength change per unit of budget error per frame
+
+    void rebuild(float strength, int fogStartZone, int fogEndZone);
+
+    MTL::Device* m_device;
+    MTL::RasterizationRateMap* m_map;
+    MTL::Buffer* m_parameterBuffers[kMaxFrames];
+    uint64_t m_version;                // Bumped by every rebuild
+    uint64_t m_slotVersions[kMaxFrames]; // Version each parameter copy holds (0 = never written)
+    NS::UInteger m_width;
+    NS::UInteger m_height;
+    bool m_enabled;
+    float m_targetFrameMs;
+    double m_filteredGpuMs;
+    float m_strength;
+    float m_builtStrength;             // Quantized inputs of the current map
+    int m_builtFogStartZone;
+    int m_builtFogEndZone;
+};
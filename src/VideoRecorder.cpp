@@ -0,0 +1,277 @@
+#include "VideoRecorder.hpp"
+#include <CoreMedia/CoreMedia.h>
+#include <CoreVideo/CoreVideo.h>
+#include <VideoToolbox/VideoToolbox.h>
+#include <algorithm>
+#include <iostream>
+
+// Average bit rate per pixel and frame: about 15 Mbit/s at 1080p60, plenty for review recordings
+static constexpr double kBitsPerPixel = 0.12;
+static const uint8_t kStartCode[4] = { 0, 0, 0, 1 };
+
+static void setNumberProperty(VTCompressionSessionRef session, CFStringRef key, double value)
+{
+    CFNumberRef number = CFNumberCreate(nullptr, kCFNumberDoubleType, &value);
+    VTSessionSetProperty(session, key, number);
+    CFRelease(number);
+}
+
+static bool hasExtension(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    return dot != std::string::npos && (slash == std::string::npos || dot > slash);
+}
+
+struct VideoRecorderCallbacks {
+    // Encoder thread, in submission order (no frame reordering)
+    static void encoded(void* recorder, void* surface, OSStatus status, VTEncodeInfoFlags flags, CMSampleBufferRef sampleBuffer)
+    {
+        bool ok = status == noErr && !(flags & kVTEncodeInfo_FrameDropped) && sampleBuffer;
+        static_cast<VideoRecorder*>(recorder)->writeSample(static_cast<int>(reinterpret_cast<intptr_t>(surface)), ok ? sampleBuffer : nullptr);
+    }
+};
+
+VideoRecorder::VideoRecorder(MTL::Device* device)
+    : m_device(device)
+    , m_session(nullptr)
+    , m_hevc(true)
+    , m_file(nullptr)
+    , m_interval(1.0 / 60.0)
+    , m_nextTime(-1.0)
+    , m_frameNumber(0)
+    , m_acquired(-1)
+    , m_encodedFrames(0)
+    , m_droppedFrames(0)
+{
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    stop();
+}
+
+bool VideoRecorder::start(const std::string& path, uint32_t width, uint32_t height, MTL::PixelFormat format, double framesPerSecond)
+{
+    if (isRecording() || path.empty() || width == 0 || height == 0 || framesPerSecond <= 0.0) {
+        return false;
+    }
+    if (format != MTL::PixelFormatBGRA8Unorm && format != MTL::PixelFormatBGRA8Unorm_sRGB) {
+        std::cerr << "Video recording needs a BGRA8 output (pixel format " << format << ")" << std::endl;
+        return false;
+    }
+
+    // Hardware encoders only: a software fallback would compete with the renderer for the CPU
+    CFMutableDictionaryRef specification = CFDictionaryCreateMutable(nullptr, 1, &kCFTypeDictionaryKeyCallBacks,
+                                                                     &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(specification, kVTVideoEncoderSpecification_RequireHardwareAcceleratedVideoEncoder, kCFBooleanTrue);
+    VTCompressionSessionRef session = nullptr;
+    m_hevc = true;
+    OSStatus status = VTCompressionSessionCreate(nullptr, static_cast<int32_t>(width), static_cast<int32_t>(height),
+                                                 kCMVideoCodecType_HEVC, specification, nullptr, nullptr,
+                                                 &VideoRecorderCallbacks::encoded, this, &session);
+    if (status != noErr) {
+        m_hevc = false;
+        status = VTCompressionSessionCreate(nullptr, static_cast<int32_t>(width), static_cast<int32_t>(height),
+                                            kCMVideoCodecType_H264, specification, nullptr, nullptr,
+                                            &VideoRecorderCallbacks::encoded, this, &session);
+    }
+    CFRelease(specification);
+    if (status != noErr || !session) {
+        std::cerr << "Video recording unavailable: no hardware encoder for " << width << "x" << height << " (" << status << ")" << std::endl;
+        return false;
+    }
+
+    // Real time, no B-frames: samples come back in order, a few frames after submission
+    VTSessionSetProperty(session, kVTCompressionPropertyKey_RealTime, kCFBooleanTrue);
+    VTSessionSetProperty(session, kVTCompressionPropertyKey_AllowFrameReordering, kCFBooleanFalse);
+    setNumberProperty(session, kVTCompressionPropertyKey_ExpectedFrameRate, framesPerSecond);
+    setNumberProperty(session, kVTCompressionPropertyKey_MaxKeyFrameInterval, std::max(1.0, framesPerSecond * 2.0));
+    setNumberProperty(session, kVTCompressionPropertyKey_AverageBitRate,
+                      static_cast<double>(width) * static_cast<double>(height) * framesPerSecond * kBitsPerPixel);
+    VTCompressionSessionPrepareToEncodeFrames(session);
+
+    // Surface pool: IOSurface-backed pixel buffers the encoder reads in place, each wrapped as a
+    // texture the GPU copies frames into
+    CFDictionaryRef surfaceProperties = CFDictionaryCreate(nullptr, nullptr, nullptr, 0, &kCFTypeDictionaryKeyCallBacks,
+                                                           &kCFTypeDictionaryValueCallBacks);
+    CFMutableDictionaryRef attributes = CFDictionaryCreateMutable(nullptr, 2, &kCFTypeDictionaryKeyCallBacks,
+                                                                  &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(attributes, kCVPixelBufferIOSurfacePropertiesKey, surfaceProperties);
+    CFDictionarySetValue(attributes, kCVPixelBufferMetalCompatibilityKey, kCFBooleanTrue);
+    MTL::TextureDescriptor* descriptor = MTL::TextureDescriptor::texture2DDescriptor(format, width, height, false);
+    descriptor->setUsage(MTL::TextureUsageShaderRead);
+    descriptor->setStorageMode(m_device->hasUnifiedMemory() ? MTL::StorageModeShared : MTL::StorageModeManaged);
+    bool ok = true;
+    for (int i = 0; i < kSurfaceCount && ok; ++i) {
+        CVPixelBufferRef pixelBuffer = nullptr;
+        ok = CVPixelBufferCreate(nullptr, width, height, kCVPixelFormatType_32BGRA, attributes, &pixelBuffer) == kCVReturnSuccess;
+        m_surfaces[i].pixelBuffer = pixelBuffer;
+        IOSurfaceRef surface = ok ? CVPixelBufferGetIOSurface(pixelBuffer) : nullptr;
+        m_surfaces[i].texture = surface ? m_device->newTexture(descriptor, surface, 0) : nullptr;
+        m_surfaces[i].busy.store(false, std::memory_order_relaxed);
+        ok = ok && m_surfaces[i].texture;
+    }
+    CFRelease(attributes);
+    CFRelease(surfaceProperties);
+    if (!ok) {
+        std::cerr << "Video recording: failed to create the encoder surfaces" << std::endl;
+        VTCompressionSessionInvalidate(session);
+        CFRelease(session);
+        releaseSurfaces();
+        return false;
+    }
+
+    m_path = hasExtension(path) ? path : path + (m_hevc ? ".hevc" : ".h264");
+    m_file = std::fopen(m_path.c_str(), "wb");
+    if (!m_file) {
+        std::cerr << "Video recording: cannot write " << m_path << std::endl;
+        VTCompressionSessionInvalidate(session);
+        CFRelease(session);
+        releaseSurfaces();
+        return false;
+    }
+
+    m_session = session;
+    m_interval = 1.0 / framesPerSecond;
+    m_nextTime = -1.0;
+    m_frameNumber = 0;
+    m_acquired = -1;
+    m_encodedFrames.store(0, std::memory_order_relaxed);
+    m_droppedFrames.store(0, std::memory_order_relaxed);
+    std::cout << "Video recording: " << m_path << " (" << (m_hevc ? "HEVC" : "H.264") << ", " << width << "x" << height
+              << " at " << framesPerSecond << " fps)" << std::endl;
+    return true;
+}
+
+void VideoRecorder::stop()
+{
+    if (!m_session) {
+        return;
+    }
+    // Emits the samples still in the encoder (written by the callback before this returns)
+    VTCompressionSessionCompleteFrames(m_session, kCMTimeInvalid);
+    VTCompressionSessionInvalidate(m_session);
+    CFRelease(m_session);
+    m_session = nullptr;
+    releaseSurfaces();
+    std::fclose(m_file);
+    m_file = nullptr;
+    std::cout << "Video recording: wrote " << m_path << " (" << getEncodedFrames() << " frames, " << getDroppedFrames()
+              << " dropped)" << std::endl;
+}
+
+void VideoRecorder::releaseSurfaces()
+{
+    for (Surface& surface : m_surfaces) {
+        if (surface.texture) {
+            surface.texture->release();
+            surface.texture = nullptr;
+        }
+        if (surface.pixelBuffer) {
+            CVPixelBufferRelease(surface.pixelBuffer);
+            surface.pixelBuffer = nullptr;
+        }
+    }
+}
+
+MTL::Texture* VideoRecorder::acquireFrame(double time)
+{
+    if (!m_session || m_acquired >= 0) {
+        return nullptr;
+    }
+    // Frames at the recording rate; after a hitch the cadence restarts instead of catching up
+    if (m_nextTime >= 0.0 && time < m_nextTime) {
+        return nullptr;
+    }
+    m_nextTime = (m_nextTime < 0.0 || time - m_nextTime > m_interval) ? time + m_interval : m_nextTime + m_interval;
+
+    for (int i = 0; i < kSurfaceCount; ++i) {
+        bool expected = false;
+        if (m_surfaces[i].busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            m_acquired = i;
+            return m_surfaces[i].texture;
+        }
+    }
+    m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void VideoRecorder::submitFrame(MTL::CommandBuffer* commandBuffer)
+{
+    if (m_acquired < 0) {
+        return;
+    }
+    int surface = m_acquired;
+    m_acquired = -1;
+    CMTime presentationTime = CMTimeMakeWithSeconds(static_cast<double>(m_frameNumber++) * m_interval, 600);
+
+    // Once the copy has landed the surface goes to the encoder, which returns it from its callback
+    commandBuffer->addCompletedHandler([this, surface, presentationTime](MTL::CommandBuffer* completed) {
+        OSStatus status = -1;
+        if (completed->status() == MTL::CommandBufferStatusCompleted) {
+            status = VTCompressionSessionEncodeFrame(m_session, m_surfaces[surface].pixelBuffer, presentationTime, kCMTimeInvalid,
+                                                     nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(surface)), nullptr);
+        }
+        if (status != noErr) {
+            m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            m_surfaces[surface].busy.store(false, std::memory_order_release);
+        }
+    });
+}
+
+void VideoRecorder::writeSample(int surface, const void* sample)
+{
+    CMSampleBufferRef sampleBuffer = static_cast<CMSampleBufferRef>(const_cast<void*>(sample));
+    if (sampleBuffer && CMSampleBufferDataIsReady(sampleBuffer)) {
+        // Key frames carry the parameter sets in-band, so the stream can be cut anywhere after one
+        bool keyFrame = true;
+        CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
+        if (attachments && CFArrayGetCount(attachments) > 0) {
+            CFDictionaryRef attachment = static_cast<CFDictionaryRef>(CFArrayGetValueAtIndex(attachments, 0));
+            keyFrame = !CFDictionaryContainsKey(attachment, kCMSampleAttachmentKey_NotSync);
+        }
+        CMFormatDescriptionRef format = CMSampleBufferGetFormatDescription(sampleBuffer);
+        int lengthBytes = 4;
+        size_t setCount = 0;
+        for (size_t i = 0; format && (i == 0 || i < setCount); ++i) {
+            const uint8_t* set = nullptr;
+            size_t setBytes = 0;
+            OSStatus status = m_hevc
+                ? CMVideoFormatDescriptionGetHEVCParameterSetAtIndex(format, i, &set, &setBytes, &setCount, &lengthBytes)
+                : CMVideoFormatDescriptionGetH264ParameterSetAtIndex(format, i, &set, &setBytes, &setCount, &lengthBytes);
+            if (status != noErr) {
+                break;
+            }
+            if (keyFrame) {
+                std::fwrite(kStartCode, 1, sizeof(kStartCode), m_file);
+                std::fwrite(set, 1, setBytes, m_file);
+            }
+        }
+
+        // AVCC / HVCC length-prefixed NAL units to Annex B start codes
+        CMBlockBufferRef block = CMSampleBufferGetDataBuffer(sampleBuffer);
+        size_t bytes = block ? CMBlockBufferGetDataLength(block) : 0;
+        m_sampleBytes.resize(bytes);
+        if (bytes > 0 && CMBlockBufferCopyDataBytes(block, 0, bytes, m_sampleBytes.data()) == kCMBlockBufferNoErr) {
+            size_t offset = 0;
+            while (offset + static_cast<size_t>(lengthBytes) <= bytes) {
+                size_t unitBytes = 0;
+                for (int b = 0; b < lengthBytes; ++b) {
+                    unitBytes = (unitBytes << 8) | m_sampleBytes[offset + b];
+                }
+                offset += static_cast<size_t>(lengthBytes);
+                unitBytes = std::min(unitBytes, bytes - offset);
+                std::fwrite(kStartCode, 1, sizeof(kStartCode), m_file);
+                std::fwrite(m_sampleBytes.data() + offset, 1, unitBytes, m_file);
+                offset += unitBytes;
+            }
+        }
+        m_encodedFrames.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_droppedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (surface >= 0 && surface < kSurfaceCount) {
+        m_surfaces[surface].busy.store(false, std::memory_order_release);
+    }
+}
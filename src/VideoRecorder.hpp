@@ -0,0 +1,68 @@
+#pragma once
+#include <Metal/Metal.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct OpaqueVTCompressionSession;
+struct __CVBuffer;
+
+// Hardware video recording of rendered frames (VideoToolbox HEVC, or H.264 where the GPU has no
+// HEVC encoder) into an Annex B elementary stream (`ffmpeg -r 60 -i video.hevc -c copy video.mp4`
+// muxes it). The encoder reads a small fixed pool of IOSurface-backed pixel buffers, each also
+// wrapped as a Metal texture: a frame costs one GPU blit into a free surface, and the surface is
+// handed to the encoder from the command buffer's completion handler, so nothing is read back to
+// the CPU and draw() never waits. When every surface is still queued in the encoder the frame is
+// dropped instead (back-pressure), and compressed samples are written on the encoder's thread.
+class VideoRecorder {
+public:
+    explicit VideoRecorder(MTL::Device* device);
+    ~VideoRecorder(); // stop() must have been called, or the GPU be idle
+
+    // Open path (.hevc / .h264 appended for the codec when it has no extension) for frames of
+    // width x height in format (BGRA8Unorm or its sRGB variant), sampled at framesPerSecond
+    bool start(const std::string& path, uint32_t width, uint32_t height, MTL::PixelFormat format, double framesPerSecond);
+    // Once the GPU is done with every submitted frame: flushes the encoder and closes the file
+    void stop();
+    bool isRecording() const { return m_session != nullptr; }
+    const std::string& getPath() const { return m_path; }
+
+    // Per frame, at time (seconds): the surface to copy the frame into, or nullptr when no frame
+    // is due at this rate or every surface is still encoding (dropped). A surface acquired here
+    // must be submitted with the command buffer holding the copy, before it is committed.
+    MTL::Texture* acquireFrame(double time);
+    void submitFrame(MTL::CommandBuffer* commandBuffer);
+
+    uint64_t getEncodedFrames() const { return m_encodedFrames.load(std::memory_order_relaxed); }
+    uint64_t getDroppedFrames() const { return m_droppedFrames.load(std::memory_order_relaxed); }
+
+private:
+    friend struct VideoRecorderCallbacks;
+
+    static constexpr int kSurfaceCount = 4; // Enough for the encoder's latency at 60 fps
+
+    struct Surface {
+        __CVBuffer* pixelBuffer = nullptr;
+        MTL::Texture* texture = nullptr;
+        std::atomic<bool> busy{ false }; // From acquireFrame() until the encoder has consumed it
+    };
+
+    void releaseSurfaces();
+    void writeSample(int surface, const void* sampleBuffer); // sampleBuffer: CMSampleBufferRef or null (dropped)
+
+    MTL::Device* m_device;
+    OpaqueVTCompressionSession* m_session;
+    bool m_hevc;
+    FILE* m_file;
+    std::string m_path;
+    Surface m_surfaces[kSurfaceCount];
+    double m_interval;         // Seconds between recorded frames
+    double m_nextTime;         // Time the next frame is due (< 0 before the first)
+    uint64_t m_frameNumber;    // Submitted frames: presentation timestamps at the recording rate
+    int m_acquired;            // Surface acquired for the frame being encoded (-1 = none)
+    std::vector<uint8_t> m_sampleBytes; // Encoder thread: one compressed sample
+    std::atomic<uint64_t> m_encodedFrames;
+    std::atomic<uint64_t> m_droppedFrames;
+};
@@ -0,0 +1,276 @@
+#include <metal_stdlib>
+#include "ShaderTypes.h"
+
+using namespace metal;
+
+// ---------------------------------------------------------
+// Gust particles (WindGustParticle, one slot per thread)
+// ---------------------------------------------------------
+// This frame's spawns replace their slots; live particles drift and age by the frame time, and
+// keep last frame's state for the wind field's previous slice
+kernel void stepWindGusts(
+    constant WindGustUniforms &gustUniforms [[buffer(WindBufferIndexGustUniforms)]],
+    device WindGustParticle *gusts [[buffer(WindBufferIndexGusts)]],
+    uint gid [[thread_position_in_grid]]
+) {
+    if (gid >= min(gustUniforms.particleCount, uint(WIND_MAX_GUST_PARTICLES))) {
+        return;
+    }
+    // A slot spawned twice in one frame keeps the later particle
+    for (uint s = min(gustUniforms.spawnCount, uint(WIND_MAX_GUST_SPAWNS)); s > 0; --s) {
+        if (gustUniforms.spawns[s - 1].slot == gid) {
+            WindGustParticle spawned = gustUniforms.spawns[s - 1].particle;
+            spawned.age = 0.0;
+            spawned.prevAge = 0.0;
+            spawned.prevPosition = spawned.position;
+            gusts[gid] = spawned;
+            return;
+        }
+    }
+    WindGustParticle gust = gusts[gid];
+    if (gust.age >= gust.lifetime) {
+        return;
+    }
+    float dt = gustUniforms.deltaTime;
+    gust.prevPosition = gust.position;
+    gust.prevAge = gust.age;
+    gust.position += gust.drift * dt;
+    gust.drift *= exp(-gust.drag * dt);
+    gust.age += dt;
+    gusts[gid] = gust;
+}
+
+// Air velocity of one particle at worldXZ, for its center and age at one of the two clocks:
+// the push along wind is strongest at the center, the radial (blast) flow halfway to the rim,
+// and both fade out quadratically over the lifetime
+static float2 windGustVelocity(WindGustParticle gust, float2 center, float age, float2 worldXZ) {
+    if (age >= gust.lifetime) {
+        return float2(0.0);
+    }
+    float radius = max(gust.radius + gust.growth * age, 1e-3);
+    float2 offset = worldXZ - center;
+    float d = length(offset) / radius;
+    if (d >= 1.0) {
+        return float2(0.0);
+    }
+    float fade = 1.0 - age / gust.lifetime;
+    float2 radial = d > 1e-4 ? offset / (d * radius) * gust.radialSpeed * 4.0 * d * (1.0 - d) : float2(0.0);
+    return (gust.wind * (1.0 - d) * (1.0 - d) + radial) * fade * fade;
+}
+
+// Sum of every spawned particle at worldXZ (previous: at last frame's clock). The loop runs over
+// the same slots in every thread, so the particles come through the constant cache
+static float2 sumWindGusts(constant WindGustParticle *gusts, constant WindGustUniforms &gustUniforms, float2 worldXZ, bool previous) {
+    float2 velocity = float2(0.0);
+    for (uint i = 0; i < min(gustUniforms.particleCount, uint(WIND_MAX_GUST_PARTICLES)); ++i) {
+        WindGustParticle gust = gusts[i];
+        velocity += previous ? windGustVelocity(gust, gust.prevPosition, gust.prevAge, worldXZ)
+                             : windGustVelocity(gust, gust.position, gust.age, worldXZ);
+    }
+    return velocity;
+}
+
+// Procedural wind plus an air velocity (fluid perturbation, gusts) as one bend vector per texel;
+// a negative bend (rebound) becomes a positive one towards the opposite direction, which bends
+// blades the same
+static float4 addWindVelocity(float4 wind, float2 velocity, float bendPerVelocity) {
+    float2 bend = wind.xy * wind.z + velocity * bendPerVelocity;
+    float strength = length(bend);
+    return strength > 1e-4 ? float4(bend / strength, min(strength, 1.6), 0.0) : float4(wind.xy, 0.0, 0.0);
+}
+
+// Wind field over the ground bounds, rewritten every frame before the grass is drawn.
+// The blade vertex stages sample it at their root instead of evaluating the noise and swell per
+// vertex; slice 1 holds the wind at last frame's clock for the motion-vector pass. Richer wind
+// models (gust particles, local eddies) only change what is written here and cost nothing extra
+// per blade.
+kernel void updateWindField(
+    texture2d_array<float, access::write> windField [[texture(0)]],
+    texture2d<float> noiseTexture [[texture(1)]],
+    constant Uniforms &uniforms [[buffer(WindBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(WindBufferIndexSceneConstants)]],
+    constant WindGustUniforms &gustUniforms [[buffer(WindBufferIndexGustUniforms)]],
+    constant WindGustParticle *gusts [[buffer(WindBufferIndexGusts)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= windField.get_width() || gid.y >= windField.get_height()) {
+        return;
+    }
+    // Texel centers land on the bounds at the edges (see windFieldUV)
+    float2 local = float2(gid) / float2(windField.get_width() - 1, windField.get_height() - 1);
+    float2 worldXZ = mix(scene.groundMinXZ, scene.groundMaxXZ, local);
+    float4 wind = grassWind(noiseTexture, worldXZ, uniforms.time);
+    float4 prevWind = grassWind(noiseTexture, worldXZ, uniforms.prevTime);
+    if (gustUniforms.particleCount > 0) {
+        wind = addWindVelocity(wind, sumWindGusts(gusts, gustUniforms, worldXZ, false), gustUniforms.bendPerVelocity);
+        prevWind = addWindVelocity(prevWind, sumWindGusts(gusts, gustUniforms, worldXZ, true), gustUniforms.bendPerVelocity);
+    }
+    windField.write(wind, gid, 0);
+    windField.write(prevWind, gid, 1);
+}
+
+// ---------------------------------------------------------
+// Wind fluid (Stam's stable fluids on a WIND_FIELD_SIZE^2 grid over the ground)
+// ---------------------------------------------------------
+// Velocity perturbation on top of the procedural wind: gusts and interactors inject it, it is
+// carried downwind by the ambient wind, projected to be divergence-free and dies out over a few
+// seconds. updateWindFieldFluid() adds it to grassWind(), so the blades read it through the same
+// wind field. Cells are buffer entries (row-major) centered on the wind field's texels (edge to
+// edge over the ground), so every step is a plain device read / write.
+
+static uint windCellIndex(int2 cell) {
+    cell = clamp(cell, int2(0), int2(WIND_FIELD_SIZE - 1));
+    return uint(cell.y) * WIND_FIELD_SIZE + uint(cell.x);
+}
+
+static float2 sampleWindVelocity(const device float2 *velocity, float2 cell) {
+    float2 base = floor(cell);
+    float2 f = cell - base;
+    int2 i = int2(base);
+    float2 v00 = velocity[windCellIndex(i)];
+    float2 v10 = velocity[windCellIndex(i + int2(1, 0))];
+    float2 v01 = velocity[windCellIndex(i + int2(0, 1))];
+    float2 v11 = velocity[windCellIndex(i + int2(1, 1))];
+    return mix(mix(v00, v10, f.x), mix(v01, v11, f.x), f.y);
+}
+
+// Semi-Lagrangian advection by the ambient wind plus the perturbation itself, then dissipation
+// and the gust emitters
+kernel void advectWindFluid(
+    constant Uniforms &uniforms [[buffer(WindBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(WindBufferIndexSceneConstants)]],
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    const device float2 *velocityIn [[buffer(WindBufferIndexVelocityIn)]],
+    device float2 *velocityOut [[buffer(WindBufferIndexVelocityOut)]],
+    constant WindGustPlacement *gustPlacements [[buffer(WindBufferIndexGustPlacements)]],
+    constant WindGustFlow *gustFlows [[buffer(WindBufferIndexGustFlows)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= WIND_FIELD_SIZE || gid.y >= WIND_FIELD_SIZE) {
+        return;
+    }
+    uint index = gid.y * WIND_FIELD_SIZE + gid.x;
+    float2 carry = fluid.ambientVelocity + velocityIn[index];
+    float2 source = float2(gid) - carry * fluid.deltaTime / fluid.cellSize;
+    float2 velocity = sampleWindVelocity(velocityIn, source) * exp(-fluid.dissipation * fluid.deltaTime);
+
+    float2 worldXZ = scene.groundMinXZ + float2(gid) * fluid.cellSize;
+    for (uint g = 0; g < min(fluid.gustCount, uint(WIND_MAX_GUSTS)); ++g) {
+        WindGustPlacement placement = gustPlacements[g];
+        float weight = saturate(1.0 - distance(worldXZ, placement.position) / placement.radius);
+        velocity = mix(velocity, gustFlows[g].velocity, weight * weight);
+    }
+    velocityOut[index] = velocity;
+}
+
+// Grid z selects the interactor; x / y cover its footprint. Interactors drag the air they pass
+// towards a share of their own velocity (overlapping footprints race; either value is fine)
+kernel void splatWindInteractors(
+    constant Uniforms &uniforms [[buffer(WindBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(WindBufferIndexSceneConstants)]],
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    device float2 *velocity [[buffer(WindBufferIndexVelocityOut)]],
+    const device Interactor *interactors [[buffer(WindBufferIndexInteractors)]],
+    uint3 gid [[thread_position_in_grid]]
+) {
+    if (gid.z >= min(fluid.interactorCount, uint(MAX_INTERACTORS)) || fluid.frameDeltaTime <= 0.0) {
+        return;
+    }
+    Interactor interactor = interactors[gid.z];
+    float reach = interactor.radius + interactor.falloff;
+    int2 cell = int2(floor((interactor.position.xz - reach - scene.groundMinXZ) / fluid.cellSize)) + int2(gid.xy);
+    if (any(cell < int2(0)) || any(cell >= int2(WIND_FIELD_SIZE))) {
+        return;
+    }
+    float2 worldXZ = scene.groundMinXZ + float2(cell) * fluid.cellSize;
+    float weight = saturate(1.0 - distance(worldXZ, interactor.position.xz) / max(reach, 1e-3));
+    if (weight <= 0.0) {
+        return;
+    }
+    float2 bodyVelocity = (interactor.position.xz - interactor.prevPosition.xz) / fluid.frameDeltaTime;
+    uint index = windCellIndex(cell);
+    velocity[index] = mix(velocity[index], bodyVelocity * fluid.wakeStrength, weight);
+}
+
+kernel void windFluidDivergence(
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    const device float2 *velocity [[buffer(WindBufferIndexVelocityIn)]],
+    device float *divergence [[buffer(WindBufferIndexDivergence)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= WIND_FIELD_SIZE || gid.y >= WIND_FIELD_SIZE) {
+        return;
+    }
+    int2 cell = int2(gid);
+    float right = velocity[windCellIndex(cell + int2(1, 0))].x;
+    float left = velocity[windCellIndex(cell - int2(1, 0))].x;
+    float up = velocity[windCellIndex(cell + int2(0, 1))].y;
+    float down = velocity[windCellIndex(cell - int2(0, 1))].y;
+    divergence[gid.y * WIND_FIELD_SIZE + gid.x] = 0.5 * (right - left + up - down) / fluid.cellSize;
+}
+
+// One Jacobi iteration of the pressure Poisson equation (warm-started from last frame's pressure)
+kernel void windFluidPressure(
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    const device float *pressureIn [[buffer(WindBufferIndexPressureIn)]],
+    device float *pressureOut [[buffer(WindBufferIndexPressureOut)]],
+    const device float *divergence [[buffer(WindBufferIndexDivergence)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= WIND_FIELD_SIZE || gid.y >= WIND_FIELD_SIZE) {
+        return;
+    }
+    int2 cell = int2(gid);
+    uint index = gid.y * WIND_FIELD_SIZE + gid.x;
+    float neighbors = pressureIn[windCellIndex(cell + int2(1, 0))] + pressureIn[windCellIndex(cell - int2(1, 0))]
+                    + pressureIn[windCellIndex(cell + int2(0, 1))] + pressureIn[windCellIndex(cell - int2(0, 1))];
+    pressureOut[index] = 0.25 * (neighbors - divergence[index] * fluid.cellSize * fluid.cellSize);
+}
+
+// Removes the pressure gradient, leaving the divergence-free part of the velocity
+kernel void windFluidProject(
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    const device float2 *velocityIn [[buffer(WindBufferIndexVelocityIn)]],
+    device float2 *velocityOut [[buffer(WindBufferIndexVelocityOut)]],
+    const device float *pressure [[buffer(WindBufferIndexPressureIn)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= WIND_FIELD_SIZE || gid.y >= WIND_FIELD_SIZE) {
+        return;
+    }
+    int2 cell = int2(gid);
+    float2 gradient = 0.5 * float2(pressure[windCellIndex(cell + int2(1, 0))] - pressure[windCellIndex(cell - int2(1, 0))],
+                                   pressure[windCellIndex(cell + int2(0, 1))] - pressure[windCellIndex(cell - int2(0, 1))]) / fluid.cellSize;
+    uint index = gid.y * WIND_FIELD_SIZE + gid.x;
+    velocityOut[index] = velocityIn[index] - gradient;
+}
+
+kernel void updateWindFieldFluid(
+    texture2d_array<float, access::write> windField [[texture(0)]],
+    texture2d<float> noiseTexture [[texture(1)]],
+    constant Uniforms &uniforms [[buffer(WindBufferIndexUniforms)]],
+    constant SceneConstants &scene [[buffer(WindBufferIndexSceneConstants)]],
+    constant WindFluidUniforms &fluid [[buffer(WindBufferIndexFluid)]],
+    const device float2 *previousVelocity [[buffer(WindBufferIndexVelocityIn)]],
+    const device float2 *velocity [[buffer(WindBufferIndexVelocityOut)]],
+    constant WindGustUniforms &gustUniforms [[buffer(WindBufferIndexGustUniforms)]],
+    constant WindGustParticle *gusts [[buffer(WindBufferIndexGusts)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= windField.get_width() || gid.y >= windField.get_height()) {
+        return;
+    }
+    float2 local = float2(gid) / float2(windField.get_width() - 1, windField.get_height() - 1);
+    float2 worldXZ = mix(scene.groundMinXZ, scene.groundMaxXZ, local);
+    uint index = gid.y * WIND_FIELD_SIZE + gid.x;
+    float2 current = velocity[index];
+    float2 previous = previousVelocity[index];
+    if (gustUniforms.particleCount > 0) {
+        // Gust particles are not part of the fluid state: they add on top of it (same bend per
+        // m/s) instead of being carried and dissipated by the grid
+        current += sumWindGusts(gusts, gustUniforms, worldXZ, false);
+        previous += sumWindGusts(gusts, gustUniforms, worldXZ, true);
+    }
+    windField.write(addWindVelocity(grassWind(noiseTexture, worldXZ, uniforms.time), current, fluid.bendPerVelocity), gid, 0);
+    windField.write(addWindVelocity(grassWind(noiseTexture, worldXZ, uniforms.prevTime), previous, fluid.bendPerVelocity), gid, 1);
+}
@@ -2,18 +2,219 @@
 #define MTL_PRIVATE_IMPLEMENTATION
 #define MTK_PRIVATE_IMPLEMENTATION
 #define CA_PRIVATE_IMPLEMENTATION
+#define MTLFX_PRIVATE_IMPLEMENTATION
 
 #include <GLFW/glfw3.h>
 #include <Metal/Metal.hpp>
 #include <QuartzCore/QuartzCore.hpp>
+#include <MetalFX/MetalFX.hpp>
 
 #include "MetalLayerBridge.h"
 #include "Renderer.hpp"
+#include "RenderCalibration.hpp"
+#include "InputRecording.hpp"
+#include "FramePacket.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <chrono>
+#include <thread>
 
-int main() {
+// Render thread: owns the renderer while it runs. Each frame it drains the window thread's
+// packets (folded into one, so short taps survive), resizes when the drawable size changed, then
+// updates and draws; a blocking nextDrawable() or a slow frame no longer delays event handling.
+// With late latching the camera moves from the packets drained once draw() holds its drawable.
+struct RenderLoop {
+    Renderer* renderer = nullptr;
+    SpscQueue<FramePacket, 64>* packets = nullptr;
+    FramePacket input;
+    FramePacket carry;      // Drained by the latch after update(); opens the next frame's packet
+    bool hasCarry = false;
+    int width = 0;
+    int height = 0;
+    
+    void update(float deltaTime)
+    {
+        FramePacket packet;
+        bool first = true;
+        if (hasCarry) {
+            input = carry;
+            hasCarry = false;
+            first = false;
+        }
+        while (packets->tryPop(packet)) {
+            if (first) {
+                input = packet; // Held keys come from this frame's packets only
+                first = false;
+            } else {
+                input.merge(packet);
+            }
+        }
+        if (input.framebufferWidth > 0 && input.framebufferHeight > 0 &&
+            (input.framebufferWidth != width || input.framebufferHeight != height)) {
+            width = input.framebufferWidth;
+            height = input.framebufferHeight;
+            renderer->resize(width, height);
+        }
+        renderer->update(input, deltaTime);
+    }
+    
+    bool latch(FramePacket& latest)
+    {
+        FramePacket packet;
+        while (packets->tryPop(packet)) {
+            if (hasCarry) {
+                carry.merge(packet);
+            } else {
+                carry = packet;
+                hasCarry = true;
+            }
+        }
+        latest = input;
+        if (hasCarry) {
+            latest.merge(carry);
+        }
+        return true;
+    }
+};
+
+// Display link frame: the link hands out the drawable and its target presentation time, which
+// also steps the frame (one refresh interval per frame, whatever the callback jitter)
+struct DisplayLinkFrame {
+    RenderLoop* loop;
+    double lastPresentation;
+};
+
+static void onDisplayLinkFrame(void* drawable, double targetTimestamp, double targetPresentationTimestamp, void* userData)
+{
+    (void)targetTimestamp;
+    DisplayLinkFrame* frame = static_cast<DisplayLinkFrame*>(userData);
+    double deltaTime = frame->lastPresentation > 0.0 ? targetPresentationTimestamp - frame->lastPresentation : 0.0;
+    frame->lastPresentation = targetPresentationTimestamp;
+    frame->loop->update(static_cast<float>(std::min(deltaTime, 0.25)));
+    frame->loop->renderer->draw(static_cast<CA::MetalDrawable*>(drawable));
+}
+
+static void renderThreadMain(Renderer* renderer, SpscQueue<FramePacket, 64>* packets, std::atomic<bool>* running,
+                             int width, int height, void* metalLayer, bool displayLink, bool lateLatch)
+{
+    RenderLoop loop;
+    loop.renderer = renderer;
+    loop.packets = packets;
+    loop.width = width;
+    loop.height = height;
+    if (lateLatch || displayLink) {
+        renderer->setInputLatch([&loop](FramePacket& latest) { return loop.latch(latest); });
+    }
+    
+    // The link calls back on this thread's run loop
+    DisplayLinkFrame frame = { &loop, 0.0 };
+    void* link = displayLink ? CreateMetalDisplayLink(metalLayer, onDisplayLinkFrame, &frame) : nullptr;
+    if (displayLink && !link) {
+        std::cerr << "CAMetalDisplayLink needs macOS 14; falling back to nextDrawable()" << std::endl;
+    }
+    if (link) {
+        while (running->load(std::memory_order_acquire)) {
+            NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+            RunMetalDisplayLink(link, 0.1);
+            pool->release();
+        }
+        DestroyMetalDisplayLink(link);
+        renderer->setInputLatch(nullptr);
+        return;
+    }
+    
+    auto lastTime = std::chrono::high_resolution_clock::now();
+    while (running->load(std::memory_order_acquire)) {
+        NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+        
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastTime).count();
+        lastTime = currentTime;
+        
+        loop.update(deltaTime);
+        renderer->draw();
+        pool->release();
+    }
+    renderer->setInputLatch(nullptr);
+}
+
+int main(int argc, char** argv) {
+    // --single-thread: update, draw and poll events on the main thread, one after the other
+    // --display-link: frames paced by a CAMetalDisplayLink (render thread, macOS 14+)
+    // --late-latch: move the camera from the input drained just before encoding (implied by --display-link)
+    // --drawables N: swapchain depth, 2 (lower latency) or 3 (default, smoother under load)
+    // --no-vsync: present without waiting for the display refresh
+    // --quality NAME: low, medium, high (default) or ultra render settings
+    // --settings FILE: render settings file ("key = value" lines, after --quality)
+    // --calibrate: measure this GPU again instead of reading its cached calibration
+    // --no-calibrate: without --quality / --settings, start from the defaults instead of a calibration
+    // --record FILE: record the session's input from launch, written to FILE at exit (F10 records on demand)
+    // --replay FILE: replay a recording (its seed, camera path and clock) on the main thread, then quit
+    // --no-governor: keep the settings under thermal pressure and Low Power Mode (off for replays too)
+    // --gpu-breadcrumbs: mark each GPU pass's progress for the fault and hang reports
+    bool renderThread = true;
+    bool displayLink = false;
+    bool lateLatch = false;
+    int drawableCount = 3;
+    bool displaySync = true;
+    RenderSettings settings;
+    bool customSettings = false;
+    bool recalibrate = false;
+    bool calibrate = true;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    bool governor = true;
+    bool breadcrumbs = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--single-thread") == 0) {
+            renderThread = false;
+        } else if (std::strcmp(argv[i], "--display-link") == 0) {
+            displayLink = true;
+        } else if (std::strcmp(argv[i], "--late-latch") == 0) {
+            lateLatch = true;
+        } else if (std::strcmp(argv[i], "--drawables") == 0 && i + 1 < argc) {
+            drawableCount = std::atoi(argv[++i]) <= 2 ? 2 : 3;
+        } else if (std::strcmp(argv[i], "--no-vsync") == 0) {
+            displaySync = false;
+        } else if (std::strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            RenderSettings::Quality quality;
+            if (RenderSettings::parseQuality(argv[++i], quality)) {
+                settings = RenderSettings::preset(quality);
+                customSettings = true;
+            } else {
+                std::cerr << "Unknown quality " << argv[i] << " (low, medium, high, ultra)" << std::endl;
+            }
+        } else if (std::strcmp(argv[i], "--settings") == 0 && i + 1 < argc) {
+            customSettings = settings.load(argv[++i]) || customSettings;
+        } else if (std::strcmp(argv[i], "--calibrate") == 0) {
+            recalibrate = true;
+        } else if (std::strcmp(argv[i], "--no-calibrate") == 0) {
+            calibrate = false;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-governor") == 0) {
+            governor = false;
+        } else if (std::strcmp(argv[i], "--gpu-breadcrumbs") == 0) {
+            breadcrumbs = true;
+        }
+    }
+    InputRecording replay;
+    if (replayPath && !replay.load(replayPath)) {
+        return -1;
+    }
+    if (replayPath) {
+        // Frames are stepped from the file: no render thread, display link or latching
+        renderThread = false;
+    } else if (!renderThread && (displayLink || lateLatch)) {
+        std::cerr << "--display-link and --late-latch need the render thread; ignored with --single-thread" << std::endl;
+    }
+    
     // Initialize GLFW
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
@@ -39,6 +240,7 @@ int main() {
     
     // Cast that void* to CA::MetalLayer* (cpp wrapper)
     CA::MetalLayer* metalLayer = static_cast<CA::MetalLayer*>(layerPtr);
+    ConfigureMetalLayer(layerPtr, drawableCount, displaySync);
     
     // Create MTL::Device and Renderer
     MTL::Device* device = MTL::CreateSystemDefaultDevice();
@@ -49,7 +251,99 @@ int main() {
         return -1;
     }
     
-    Renderer* renderer = new Renderer(device, metalLayer);
+    // First launch on this GPU: pick the settings for a 60 Hz frame at the window's size
+    // (offscreen, before the real renderer exists); later launches read them back
+    if (!customSettings && (calibrate || recalibrate)) {
+        int framebufferWidth = 0;
+        int framebufferHeight = 0;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        customSettings = RenderCalibration::loadOrCalibrate(device, std::max(framebufferWidth, 1), std::max(framebufferHeight, 1),
+                                                            1000.0f / 60.0f, recalibrate, settings);
+    }
+    
+    Renderer* renderer = replayPath ? new Renderer(device, metalLayer, replay.seed) : new Renderer(device, metalLayer);
+    if (customSettings) {
+        renderer->applyRenderSettings(settings);
+    }
+    renderer->setQualityGovernor(governor && !replayPath); // Replays must see the recorded settings
+    if (breadcrumbs) {
+        renderer->setGpuBreadcrumbs(true);
+    }
+    renderer->attachOverlay(window, renderThread || replayPath);
+    if (recordPath) {
+        renderer->startInputRecording();
+    }
+    
+    if (replayPath) {
+        // The recorded packets replace the window's input; the window only has to stay open
+        renderer->waitForPipelines();
+        renderer->waitForTextures();
+        renderer->beginInputReplay(replay);
+        std::cout << "Replaying " << replay.frames.size() << " frames from " << replayPath << std::endl;
+        for (size_t frame = 0; frame < replay.frames.size() && !glfwWindowShouldClose(window); ++frame) {
+            NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
+            glfwPollEvents();
+            int width = 0;
+            int height = 0;
+            glfwGetFramebufferSize(window, &width, &height);
+            FramePacket input = replay.frames[frame].input;
+            input.framebufferWidth = width;
+            input.framebufferHeight = height;
+            glfwGetWindowSize(window, &input.windowWidth, &input.windowHeight);
+            renderer->setFixedTime(replay.frames[frame].sceneTime);
+            renderer->update(input, replay.frames[frame].deltaTime);
+            renderer->applyWindowState();
+            renderer->draw();
+            pool->release();
+        }
+        renderer->waitUntilIdle();
+        if (recordPath) {
+            renderer->stopInputRecording(recordPath);
+        }
+        delete renderer;
+        device->release();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
+    
+    if (renderThread) {
+        // The main thread only pumps events and samples input. A packet the full queue refuses
+        // stays pending and absorbs the next samples until the render thread catches up.
+        SpscQueue<FramePacket, 64> packets;
+        std::atomic<bool> running(true);
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        std::thread renderWorker(renderThreadMain, renderer, &packets, &running, width, height,
+                                 layerPtr, displayLink, lateLatch);
+        
+        FramePacket pending = FramePacket::sample(window);
+        bool hasPending = true;
+        while (!glfwWindowShouldClose(window)) {
+            glfwWaitEventsTimeout(1.0 / 240.0);
+            FramePacket packet = FramePacket::sample(window);
+            if (hasPending) {
+                pending.merge(packet);
+            } else {
+                pending = packet;
+            }
+            hasPending = !packets.tryPush(pending);
+            renderer->applyWindowState();
+        }
+        
+        running.store(false, std::memory_order_release);
+        renderWorker.join();
+        
+        if (recordPath) {
+            renderer->stopInputRecording(recordPath);
+        }
+        delete renderer;
+        device->release();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 0;
+    }
     
     // Set up resize callback to update MSAA textures when window is resized
     glfwSetFramebufferSizeCallback(window, [](GLFWwindow* win, int width, int height) {
@@ -82,6 +376,9 @@ int main() {
     }
     
     // Cleanup
+    if (recordPath) {
+        renderer->stopInputRecording(recordPath);
+    }
     delete renderer;
     device->release();
     glfwDestroyWindow(window);
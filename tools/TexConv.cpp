@@ -0,0 +1,251 @@
+// Offline texture converter: PNG / JPG -> KTX2 with a pre-baked mip chain, block-compressed so the
+// runtime uploads it without decoding or generating mips. Opaque images become BC1, images with
+// any alpha below 255 become BC3 (the grass alpha mask needs the interpolated alpha block).
+//
+//   vegetation_texconv [--rgba] [--lz4] input.png output
+//
+// --rgba stores uncompressed RGBA8 levels instead (reference / debugging).
+// --lz4 writes the KTX2 file through a Metal IO compression context (LZ4 chunks, macOS 13+);
+// TextureLoader streams such .ktx2.lz4 files straight into the texture with MTLIOCommandQueue.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#ifdef __APPLE__
+#define NS_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#include <Metal/Metal.hpp>
+#endif
+#include "Ktx2.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+struct Rgba8 {
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+};
+
+// 2x2 box filter (odd edges clamp); the textures are linear, so no gamma conversion
+static Rgba8 downsample(const Rgba8& source)
+{
+    Rgba8 result = { std::max(source.width / 2, 1), std::max(source.height / 2, 1), {} };
+    result.pixels.resize(static_cast<size_t>(result.width) * result.height * 4);
+    for (int y = 0; y < result.height; ++y) {
+        for (int x = 0; x < result.width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                int sum = 0;
+                for (int dy = 0; dy < 2; ++dy) {
+                    for (int dx = 0; dx < 2; ++dx) {
+                        int sx = std::min(x * 2 + dx, source.width - 1);
+                        int sy = std::min(y * 2 + dy, source.height - 1);
+                        sum += source.pixels[(static_cast<size_t>(sy) * source.width + sx) * 4 + c];
+                    }
+                }
+                result.pixels[(static_cast<size_t>(y) * result.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+static uint16_t toRgb565(const uint8_t* color)
+{
+    return static_cast<uint16_t>(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void fromRgb565(uint16_t packed, int* color)
+{
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// Four-color BC1 block (color0 > color1) from the bounding box of the 16 texels
+static void encodeColorBlock(const uint8_t texels[16][4], uint8_t* out)
+{
+    uint8_t minColor[3] = { 255, 255, 255 };
+    uint8_t maxColor[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            minColor[c] = std::min(minColor[c], texels[i][c]);
+            maxColor[c] = std::max(maxColor[c], texels[i][c]);
+        }
+    }
+    uint16_t color0 = toRgb565(maxColor);
+    uint16_t color1 = toRgb565(minColor);
+    uint32_t indices = 0;
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+    if (color0 != color1) {
+        int palette[4][3];
+        fromRgb565(color0, palette[0]);
+        fromRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 4; ++p) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = texels[i][c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+    std::memcpy(out, &color0, 2);
+    std::memcpy(out + 2, &color1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// Eight-value BC3 alpha block (alpha0 > alpha1)
+static void encodeAlphaBlock(const uint8_t texels[16][4], uint8_t* out)
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        alpha0 = std::max(alpha0, static_cast<int>(texels[i][3]));
+        alpha1 = std::min(alpha1, static_cast<int>(texels[i][3]));
+    }
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        int palette[8] = { alpha0, alpha1 };
+        for (int p = 1; p < 7; ++p) {
+            palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            for (int p = 1; p < 8; ++p) {
+                if (std::abs(texels[i][3] - palette[p]) < std::abs(texels[i][3] - palette[best])) {
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+    out[0] = static_cast<uint8_t>(alpha0);
+    out[1] = static_cast<uint8_t>(alpha1);
+    for (int b = 0; b < 6; ++b) {
+        out[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+    }
+}
+
+static void appendLevel(const Rgba8& level, Ktx2::Image& image)
+{
+    size_t size = Ktx2::levelSize(image.format, level.width, level.height);
+    size_t offset = image.data.size();
+    image.levels.push_back({ static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height), offset, size });
+    image.data.resize(offset + size);
+    uint8_t* out = image.data.data() + offset;
+
+    if (image.format == Ktx2::FormatRGBA8Unorm) {
+        std::memcpy(out, level.pixels.data(), size);
+        return;
+    }
+    for (int by = 0; by < (level.height + 3) / 4; ++by) {
+        for (int bx = 0; bx < (level.width + 3) / 4; ++bx) {
+            // Blocks past the edge of the small mips repeat the last row / column
+            uint8_t texels[16][4];
+            for (int i = 0; i < 16; ++i) {
+                int x = std::min(bx * 4 + i % 4, level.width - 1);
+                int y = std::min(by * 4 + i / 4, level.height - 1);
+                std::memcpy(texels[i], &level.pixels[(static_cast<size_t>(y) * level.width + x) * 4], 4);
+            }
+            if (image.format == Ktx2::FormatBC3Unorm) {
+                encodeAlphaBlock(texels, out);
+                out += 8;
+            }
+            encodeColorBlock(texels, out);
+            out += 8;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool uncompressed = false;
+    bool lz4 = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--rgba") == 0) {
+            uncompressed = true;
+        } else if (std::strcmp(argv[i], "--lz4") == 0) {
+            lz4 = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2) {
+        std::cerr << "Usage: vegetation_texconv [--rgba] [--lz4] input.png output" << std::endl;
+        return 1;
+    }
+
+    int channels = 0;
+    Rgba8 level = { 0, 0, {} };
+    unsigned char* pixels = stbi_load(paths[0].c_str(), &level.width, &level.height, &channels, 4);
+    if (!pixels) {
+        std::cerr << "Failed to load image: " << paths[0];
+        if (stbi_failure_reason()) {
+            std::cerr << " - " << stbi_failure_reason();
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    level.pixels.assign(pixels, pixels + static_cast<size_t>(level.width) * level.height * 4);
+    stbi_image_free(pixels);
+
+    bool hasAlpha = false;
+    for (size_t i = 3; i < level.pixels.size(); i += 4) {
+        hasAlpha = hasAlpha || level.pixels[i] < 255;
+    }
+    Ktx2::Image image;
+    image.format = uncompressed ? Ktx2::FormatRGBA8Unorm : (hasAlpha ? Ktx2::FormatBC3Unorm : Ktx2::FormatBC1RGBAUnorm);
+
+    // Full chain down to 1x1
+    for (;;) {
+        appendLevel(level, image);
+        if (level.width == 1 && level.height == 1) {
+            break;
+        }
+        level = downsample(level);
+    }
+
+    if (lz4) {
+#ifdef __APPLE__
+        // Same bytes as the .ktx2, in chunks the IO queue decompresses on the fly
+        std::vector<uint8_t> file = Ktx2::serialize(image);
+        MTL::IOCompresionContext context = MTL::IOCreateCompressionContext(paths[1].c_str(), MTL::IOCompressionMethodLZ4,
+                                                                           MTL::IOCompressionContextDefaultChunkSize());
+        if (!context) {
+            std::cerr << "Failed to create IO compression context for " << paths[1] << std::endl;
+            return 1;
+        }
+        MTL::IOCompressionContextAppendData(context, file.data(), file.size());
+        if (MTL::IOFlushAndDestroyCompressionContext(context) != MTL::IOCompressionStatusComplete) {
+            std::cerr << "Failed to write compressed texture: " << paths[1] << std::endl;
+            return 1;
+        }
+#else
+        std::cerr << "--lz4 needs Metal IO compression (macOS)" << std::endl;
+        return 1;
+#endif
+    } else {
+        std::string error;
+        if (!Ktx2::write(paths[1], image, error)) {
+            std::cerr << "Failed to write KTX2 texture: " << error << std::endl;
+            return 1;
+        }
+    }
+    std::cout << paths[0] << " -> " << paths[1] << " (" << image.levels.size() << " levels, "
+              << (uncompressed ? "RGBA8" : (hasAlpha ? "BC3" : "BC1")) << (lz4 ? ", LZ4" : "") << ")" << std::endl;
+    return 0;
+}